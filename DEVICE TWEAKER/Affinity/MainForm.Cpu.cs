@@ -13,6 +13,7 @@ public sealed partial class MainForm
     private readonly Dictionary<int, CpuLpInfo> _cpuLpByIndex = new();
     private readonly Dictionary<int, int> _cpuSetIdByIndex = new();
     private readonly Dictionary<int, int> _cpuIndexByCpuSetId = new();
+    private readonly Dictionary<(int Group, int Number), int> _cpuIndexByGroupNumber = new();
     private readonly HashSet<int> _effClassP = new();
     private readonly HashSet<int> _effClassE = new();
     private readonly Dictionary<int, int> _cppcRatings = new();
@@ -63,12 +64,14 @@ public sealed partial class MainForm
         _cpuLpByIndex.Clear();
         _cpuSetIdByIndex.Clear();
         _cpuIndexByCpuSetId.Clear();
+        _cpuIndexByGroupNumber.Clear();
         foreach (CpuLpInfo lp in cpuRaw.LPs)
         {
             _cpuLpByIndex[lp.LP] = lp;
             int cpuSetId = lp.CpuSetId >= 0 ? lp.CpuSetId : lp.LP;
             _cpuSetIdByIndex[lp.LP] = cpuSetId;
             _cpuIndexByCpuSetId.TryAdd(cpuSetId, lp.LP);
+            _cpuIndexByGroupNumber.TryAdd(GetCpuGroupNumber(lp.LP), lp.LP);
         }
 
         int group0Count = cpuRaw.LPs.Count(lp => lp.Group == 0);
@@ -77,7 +80,7 @@ public sealed partial class MainForm
             group0Count = cpuRaw.Logical;
         }
 
-        _maxLogical = Math.Min(group0Count, MaxAffinityBits);
+        _maxLogical = Math.Min(cpuRaw.Logical, CpuSet.GroupSize * CpuSet.MaxGroups);
         _grpHeight = UiScale(120) + (_maxLogical * UiScale(24)) + UiScale(160);
 
         int ccdCount = ccdMap.Values.Distinct().Count();
@@ -85,11 +88,55 @@ public sealed partial class MainForm
         WriteLog($"CPU.SUMMARY: logical={cpuRaw.Logical} physical={cpuRaw.PhysicalCores} groups={_cpuGroupCount} ccd={ccdCount} ccx={ccxCount} group0={group0Count} maxAffinity={_maxLogical}");
         if (_cpuGroupCount > 1)
         {
-            WriteLog($"CPU.GROUPS: using group0 for affinity UI (KAFFINITY max {MaxAffinityBits})");
+            string groupSizes = string.Join(",", cpuRaw.LPs.GroupBy(lp => lp.Group).OrderBy(g => g.Key).Select(g => $"G{g.Key}={g.Count()}"));
+            WriteLog($"CPU.GROUPS: affinity UI spans all groups [{groupSizes}]; interrupt policy targets one group, RSS ranges may cross groups");
         }
         WriteLog($"CPU.IDENT: {cpuVendor.Name} | Vendor={cpuVendor.Vendor} | SMT/HT={_smtText}");
     }
 
+    // Group and group-relative number of a system-wide LP index. Indices count
+    // through the groups in order, so without topology data groups are full.
+    private (int Group, int Number) GetCpuGroupNumber(int lp)
+    {
+        if (_cpuLpByIndex.TryGetValue(lp, out CpuLpInfo? info) && info.Group >= 0 && info.LocalIndex >= 0)
+        {
+            return (info.Group, info.LocalIndex);
+        }
+
+        return (lp / CpuSet.GroupSize, lp % CpuSet.GroupSize);
+    }
+
+    private bool TryGetCpuIndex(int group, int number, out int lp)
+    {
+        if (_cpuIndexByGroupNumber.TryGetValue((group, number), out lp))
+        {
+            return true;
+        }
+
+        lp = (group * CpuSet.GroupSize) + number;
+        return _cpuIndexByGroupNumber.Count == 0 && group >= 0 && number is >= 0 and < CpuSet.GroupSize;
+    }
+
+    private CpuSet BuildCpuSet(IEnumerable<int> lps)
+    {
+        return CpuSet.FromProcessors(lps.Where(lp => lp >= 0).Select(GetCpuGroupNumber));
+    }
+
+    private List<int> GetCpuSetLps(CpuSet set)
+    {
+        List<int> lps = [];
+        foreach ((int group, int number) in set.Processors)
+        {
+            if (TryGetCpuIndex(group, number, out int lp))
+            {
+                lps.Add(lp);
+            }
+        }
+
+        lps.Sort();
+        return lps;
+    }
+
     private void LoadCppcRatings(CpuTopology topology)
     {
         _cppcRatings.Clear();
@@ -6,29 +6,25 @@ namespace DeviceTweakerCS;
 
 public sealed partial class MainForm
 {
-    private static void RecalcAffinityMask(DeviceBlock block)
+    private void RecalcAffinityMask(DeviceBlock block)
     {
-        ulong mask = 0;
-        for (int i = 0; i < block.CpuBoxes.Count; i++)
+        CpuSet mask = BuildUiMask(block);
+        block.AffinityMask = mask;
+        if (block.AffinityReadError is not null)
         {
-            if (block.CpuBoxes[i].Checked)
-            {
-                mask |= 1UL << i;
-            }
+            block.AffinityLabel.Text = "Affinity Mask: unreadable, left unchanged";
         }
-
-        block.AffinityMask = mask;
-        if (block.Kind == DeviceKind.STOR)
+        else if (block.Kind == DeviceKind.STOR)
         {
-            block.AffinityLabel.Text = $"Affinity Mask: 0x{mask:X} (locked)";
+            block.AffinityLabel.Text = $"Affinity Mask: {mask} (locked)";
         }
         else if (block.Kind == DeviceKind.NET_NDIS)
         {
-            block.AffinityLabel.Text = $"Affinity (RSS mask): 0x{mask:X}";
+            block.AffinityLabel.Text = $"Affinity (RSS mask): {mask}";
         }
         else
         {
-            block.AffinityLabel.Text = $"Affinity Mask: 0x{mask:X}";
+            block.AffinityLabel.Text = $"Affinity Mask: {mask}";
         }
 
         // Keep Policy in sync with CPU selection so APPLY does what the checkboxes imply.
@@ -39,7 +35,7 @@ public sealed partial class MainForm
             return;
         }
 
-        if (mask == 0)
+        if (mask.IsEmpty)
         {
             if (block.PolicyCombo.Items.Contains("MachineDefault"))
             {
@@ -138,10 +134,21 @@ public sealed partial class MainForm
             return "active=Unknown";
         }
 
-        return $"adapterFound={state.AdapterFound} rssFound={state.RssFound} active={FormatNdisRuntimeBool(state.Enabled)} adapter=\"{state.AdapterName}\" desc=\"{state.InterfaceDescription}\" base=G{FormatNdisRuntimeValue(state.BaseProcessorGroup)}:{FormatNdisRuntimeValue(state.BaseProcessorNumber)} max=G{FormatNdisRuntimeValue(state.MaxProcessorGroup)}:{FormatNdisRuntimeValue(state.MaxProcessorNumber)} maxProcessors={FormatNdisRuntimeValue(state.MaxProcessors)} queues={FormatNdisRuntimeValue(state.NumberOfReceiveQueues)} profile=\"{state.Profile}\" error=\"{state.Error}\"";
+        return $"adapterFound={state.AdapterFound} rssFound={state.RssFound} active={FormatNdisRuntimeBool(state.Enabled)} adapter=\"{state.AdapterName}\" desc=\"{state.InterfaceDescription}\" base=G{FormatNdisRuntimeValue(state.BaseProcessorGroup)}:{FormatNdisRuntimeValue(state.BaseProcessorNumber)} max=G{FormatNdisRuntimeValue(state.MaxProcessorGroup)}:{FormatNdisRuntimeValue(state.MaxProcessorNumber)} maxProcessors={FormatNdisRuntimeValue(state.MaxProcessors)} queues={FormatNdisRuntimeValue(state.NumberOfReceiveQueues)} profile=\"{state.Profile}\" table=\"{NdisRssStateParser.FormatIndirection(state.IndirectionTable)}\" error=\"{state.Error}\"";
     }
 
-    private static string BuildNdisRssConflictText(NdisRssRuntimeState? state, int? registryBase, int? registryQueues, int? registryMaxProcessors)
+    // Where the active indirection table sends packets: logical processors in table order, each
+    // with its share of the entries.
+    private string FormatNdisRssTableCpus(IReadOnlyList<NdisRssProcessor> table)
+    {
+        IEnumerable<string> cpus = NdisRssStateParser.CountIndirection(table).Select(p =>
+            TryGetCpuIndex(p.Processor.Group, p.Processor.Number, out int lp)
+                ? $"{lp} ({p.Entries})"
+                : $"G{p.Processor.Group}:{p.Processor.Number} ({p.Entries})");
+        return $"{string.Join(", ", cpus)} of {table.Count}";
+    }
+
+    private string BuildNdisRssConflictText(NdisRssRuntimeState? state, int? registryBase, int? registryQueues, int? registryMaxProcessors)
     {
         if (state is null)
         {
@@ -160,9 +167,13 @@ public sealed partial class MainForm
         }
 
         List<string> parts = [];
-        if (registryBase.HasValue && state.BaseProcessorNumber.HasValue && registryBase.Value != state.BaseProcessorNumber.Value)
+        int? activeBase = state.BaseProcessorNumber.HasValue
+            && TryGetCpuIndex(state.BaseProcessorGroup ?? 0, state.BaseProcessorNumber.Value, out int activeLp)
+                ? activeLp
+                : state.BaseProcessorNumber;
+        if (registryBase.HasValue && activeBase.HasValue && registryBase.Value != activeBase.Value)
         {
-            parts.Add($"base registry={registryBase.Value} active={state.BaseProcessorNumber.Value}");
+            parts.Add($"base registry={registryBase.Value} active={activeBase.Value}");
         }
 
         if (registryQueues.HasValue && state.NumberOfReceiveQueues.HasValue && registryQueues.Value != state.NumberOfReceiveQueues.Value)
@@ -245,31 +256,40 @@ public sealed partial class MainForm
         block.NdisModeCombo.SelectedItem = text;
     }
 
-    private static ulong ReadAffinityMaskValue(object? rawOverride)
+    // A missing value is an empty mask; one that is there but does not decode is an error, so
+    // it is not shown, and later written back, as "no CPUs".
+    private static bool TryReadAffinityMaskValue(object? rawOverride, out CpuSet mask, out string? error)
     {
-        return rawOverride switch
-        {
-            byte[] bytes when bytes.Length >= 8 => BitConverter.ToUInt64(bytes, 0),
-            byte[] bytes when bytes.Length >= 4 => BitConverter.ToUInt32(bytes, 0),
-            int intVal => (uint)intVal,
-            uint uintVal => uintVal,
-            long longVal => (ulong)longVal,
-            ulong ulongVal => ulongVal,
-            _ => 0,
-        };
+        error = null;
+        if (rawOverride is null)
+        {
+            mask = CpuSet.Empty;
+            return true;
+        }
+
+        if (!CpuSet.TryDecodeAffinityPolicy(rawOverride, out mask))
+        {
+            error = rawOverride is byte[] bytes
+                ? $"AssignmentSetOverride has an unsupported layout ({bytes.Length} bytes)"
+                : $"AssignmentSetOverride has an unsupported type ({rawOverride.GetType().Name})";
+            return false;
+        }
+
+        return true;
     }
 
-    private static (int Policy, ulong Mask) ReadAffinityPolicyState(string affPath)
+    private static (int Policy, CpuSet Mask, string? Error) ReadAffinityPolicyState(string affPath)
     {
         int policy = 0;
-        ulong mask = 0;
+        CpuSet mask = CpuSet.Empty;
+        string? error = null;
 
         try
         {
             using RegistryKey? affKey = Registry.LocalMachine.OpenSubKey(affPath);
             if (affKey is null)
             {
-                return (policy, mask);
+                return (policy, mask, error);
             }
 
             if (affKey.GetValue("DevicePolicy") is int pv)
@@ -277,25 +297,26 @@ public sealed partial class MainForm
                 policy = pv;
             }
 
-            mask = ReadAffinityMaskValue(affKey.GetValue("AssignmentSetOverride"));
+            TryReadAffinityMaskValue(affKey.GetValue("AssignmentSetOverride"), out mask, out error);
         }
-        catch
+        catch (Exception ex)
         {
+            error = $"failed to read the affinity policy: {ex.Message}";
         }
 
-        return (policy, mask);
+        return (policy, mask, error);
     }
 
-    private void ApplyMaskToCpuBoxes(DeviceBlock block, ulong mask)
+    private void ApplyMaskToCpuBoxes(DeviceBlock block, CpuSet mask)
     {
         block.AffinityMask = mask;
+        HashSet<int> selected = [.. GetCpuSetLps(mask)];
         block.SuppressCpuEvents++;
         try
         {
             for (int i = 0; i < block.CpuBoxes.Count; i++)
             {
-                ulong bit = 1UL << i;
-                block.CpuBoxes[i].Checked = (mask & bit) != 0;
+                block.CpuBoxes[i].Checked = selected.Contains(i);
             }
         }
         finally
@@ -319,11 +340,24 @@ public sealed partial class MainForm
                 return;
             }
 
-            ulong mask = block.AffinityMask;
+            if (block.AffinityReadError is not null)
+            {
+                WriteLog($"RSS.IRQ.SET: {block.Device.InstanceId} skipped, {block.AffinityReadError}");
+                report?.AddError($"{block.Device.Name} — RSS IRQ policy", $"{block.AffinityReadError}; left unchanged (pick CPUs to replace it)");
+                return;
+            }
+
+            CpuSet mask = block.AffinityMask;
+            if (!mask.TryEncodeAffinityPolicy(out byte[] bytes))
+            {
+                WriteLog($"RSS.IRQ.SET: {block.Device.InstanceId} skipped, mask={mask} spans processor groups");
+                report?.AddError($"{block.Device.Name} — RSS IRQ policy", "selected CPUs span processor groups; an interrupt can target only one group");
+                return;
+            }
+
             affKey.SetValue("DevicePolicy", 4, RegistryValueKind.DWord);
-            byte[] bytes = IntPtr.Size >= 8 ? BitConverter.GetBytes(mask) : BitConverter.GetBytes((uint)mask);
             affKey.SetValue("AssignmentSetOverride", bytes, RegistryValueKind.Binary);
-            WriteLog($"RSS.IRQ.SET: {block.Device.InstanceId} DevicePolicy=4 mask=0x{mask:X}");
+            WriteLog($"RSS.IRQ.SET: {block.Device.InstanceId} DevicePolicy=4 mask={mask}");
         }
         catch (Exception ex)
         {
@@ -435,7 +469,7 @@ public sealed partial class MainForm
             block.SuppressCpuEvents--;
         }
 
-        block.AffinityMask = 0;
+        block.AffinityMask = CpuSet.Empty;
 
         bool isTestDevice = block.Device.IsTestDevice;
         string regBase = block.Device.RegBase;
@@ -586,11 +620,17 @@ public sealed partial class MainForm
                     Profile: "TEST",
                     Error: "test-device")
                 : GetNdisRssRuntimeState(block.Device.InstanceId);
-            (int irqPolicy, ulong irqMask) = isTestDevice
-                ? (0, 0UL)
+            (int irqPolicy, CpuSet irqMask, string? irqError) = isTestDevice
+                ? (0, CpuSet.Empty, null)
                 : ReadAffinityPolicyState(prioAffPath);
+            block.AffinityReadError = irqError;
+            if (irqError is not null)
+            {
+                WriteLog($"LOAD.ERROR: {block.Device.InstanceId} {irqError}; the IRQ policy is left unchanged on APPLY");
+            }
+
             bool hasRss = baseCore.HasValue;
-            bool hasIrqPolicy = irqPolicy == 4 && irqMask != 0;
+            bool hasIrqPolicy = irqPolicy == 4 && !irqMask.IsEmpty;
             NdisAffinityMode ndisMode = skipTestWifiAffinity
                 ? NdisAffinityMode.IrqPolicy
                 : hasRss && hasIrqPolicy
@@ -618,7 +658,7 @@ public sealed partial class MainForm
             block.RssBaseCore = baseCore;
             if (skipTestWifiAffinity)
             {
-                block.AffinityMask = 0;
+                block.AffinityMask = CpuSet.Empty;
             }
             else if (baseCore is >= 0 && baseCore < _maxLogical)
             {
@@ -626,7 +666,8 @@ public sealed partial class MainForm
             }
             else if (hasIrqPolicy)
             {
-                int selectedCount = Math.Max(1, Enumerable.Range(0, block.CpuBoxes.Count).Count(i => (irqMask & (1UL << i)) != 0));
+                List<int> irqLps = GetCpuSetLps(irqMask).Where(lp => lp < block.CpuBoxes.Count).ToList();
+                int selectedCount = Math.Max(1, irqLps.Count);
                 if (block.RssQueueBox is not null)
                 {
                     block.SuppressCpuEvents++;
@@ -640,14 +681,14 @@ public sealed partial class MainForm
                     }
                 }
 
-                block.RssBaseCore = Enumerable.Range(0, block.CpuBoxes.Count).FirstOrDefault(i => (irqMask & (1UL << i)) != 0);
+                block.RssBaseCore = irqLps.FirstOrDefault();
                 ApplyMaskToCpuBoxes(block, irqMask);
             }
 
             string loadPrefix = isTestDevice ? "LOAD.TEST" : "LOAD";
             WriteLog($"{loadPrefix}.RSS.ACTIVE: {block.Device.InstanceId} {FormatNdisRssRuntimeState(block.NdisRssRuntime)}");
             LogNdisRssComparison(loadPrefix, block.Device.InstanceId, block.NdisRssRuntime, baseCore, registryQueues, null);
-            WriteLog($"{loadPrefix}: NET_NDIS {block.Device.InstanceId} MSI={(msiSupported == 1 ? "Enabled" : "Disabled")} Limit={(limitPresent ? limit.ToString() : "Unlimited")} PrioVal={prioValue} Mode={FormatNdisAffinityMode(ndisMode)} BaseCore={(baseCore ?? -1)} Queues={queues} IrqPolicy={irqPolicy} IrqMask=0x{irqMask:X} Mask=0x{block.AffinityMask:X}");
+            WriteLog($"{loadPrefix}: NET_NDIS {block.Device.InstanceId} MSI={(msiSupported == 1 ? "Enabled" : "Disabled")} Limit={(limitPresent ? limit.ToString() : "Unlimited")} PrioVal={prioValue} Mode={FormatNdisAffinityMode(ndisMode)} BaseCore={(baseCore ?? -1)} Queues={queues} IrqPolicy={irqPolicy} IrqMask={irqMask} Mask={block.AffinityMask}");
         }
         else
         {
@@ -655,26 +696,18 @@ public sealed partial class MainForm
             block.PolicyCombo.Items.AddRange(new object[] { "MachineDefault", "All", "AllClose", "Single", "SpecCPU", "SpreadMessages" });
 
             string affPath = intBase + @"\Affinity Policy";
-            ulong mask = 0;
+            CpuSet mask = CpuSet.Empty;
             int policyVal = 0;
+            string? affinityError = null;
             if (!isTestDevice)
             {
-                try
-                {
-                    using RegistryKey? affKey = Registry.LocalMachine.OpenSubKey(affPath);
-                    if (affKey is not null)
-                    {
-                        if (affKey.GetValue("DevicePolicy") is int pv)
-                        {
-                            policyVal = pv;
-                        }
+                (policyVal, mask, affinityError) = ReadAffinityPolicyState(affPath);
+            }
 
-                        mask = ReadAffinityMaskValue(affKey.GetValue("AssignmentSetOverride"));
-                    }
-                }
-                catch
-                {
-                }
+            block.AffinityReadError = affinityError;
+            if (affinityError is not null)
+            {
+                WriteLog($"LOAD.ERROR: {block.Device.InstanceId} {affinityError}; the affinity is left unchanged on APPLY");
             }
 
             block.PolicyCombo.SelectedItem = policyVal switch
@@ -687,23 +720,10 @@ public sealed partial class MainForm
                 _ => "MachineDefault",
             };
 
-            block.AffinityMask = mask;
-            block.SuppressCpuEvents++;
-            try
-            {
-                for (int i = 0; i < block.CpuBoxes.Count; i++)
-                {
-                    ulong bit = 1UL << i;
-                    block.CpuBoxes[i].Checked = (mask & bit) != 0;
-                }
-            }
-            finally
-            {
-                block.SuppressCpuEvents--;
-            }
+            ApplyMaskToCpuBoxes(block, mask);
 
             string loadPrefix = isTestDevice ? "LOAD.TEST" : "LOAD";
-            WriteLog($"{loadPrefix}: {block.Device.InstanceId} Kind={block.Kind} MSI={(msiSupported == 1 ? "Enabled" : "Disabled")} Limit={(limitPresent ? limit.ToString() : "Unlimited")} PrioVal={prioValue} PolicyVal={policyVal} Mask=0x{block.AffinityMask:X}");
+            WriteLog($"{loadPrefix}: {block.Device.InstanceId} Kind={block.Kind} MSI={(msiSupported == 1 ? "Enabled" : "Disabled")} Limit={(limitPresent ? limit.ToString() : "Unlimited")} PrioVal={prioValue} PolicyVal={policyVal} Mask={block.AffinityMask}");
         }
 
         RecalcAffinityMask(block);
@@ -776,6 +796,7 @@ public sealed partial class MainForm
 
         LoadRawMouseThrottleControls(block);
         RefreshNicItrBlock(block);
+        RefreshNvmeBlock(block);
         UpdateImodSelectorsFromText(block);
         UpdateBlockInfoText(block);
     }
@@ -847,6 +868,11 @@ public sealed partial class MainForm
             {
                 info.AppendLine();
                 info.Append($"RSS: {FormatNdisRuntimeBool(runtime.Enabled)} base {FormatNdisRuntimeValue(runtime.BaseProcessorNumber)} queues {FormatNdisRuntimeValue(runtime.NumberOfReceiveQueues)}");
+                if (runtime.IndirectionTable is { Count: > 0 } table)
+                {
+                    info.AppendLine();
+                    info.Append($"RSS CPUs: {FormatNdisRssTableCpus(table)}");
+                }
             }
             if (TryGetNicItrProfile(block.Device.InstanceId) is NicItrProfile nicProfile)
             {
@@ -1096,7 +1122,7 @@ public sealed partial class MainForm
             RecordError("remove legacy priority settings", ex);
         }
 
-        WriteLog($"APPLY: {block.Device.InstanceId} MSI={mode} Limit={limitText} Prio={prioStr} Mask=0x{block.AffinityMask:X} Kind={block.Kind}");
+        WriteLog($"APPLY: {block.Device.InstanceId} MSI={mode} Limit={limitText} Prio={prioStr} Mask={block.AffinityMask} Kind={block.Kind}");
 
         if (block.PowerSavingCheck is not null && block.Kind == DeviceKind.USB)
         {
@@ -1205,8 +1231,9 @@ public sealed partial class MainForm
                 ClearNdisIrqPolicy(block, report);
             }
 
-            WriteLog($"APPLY: NET_NDIS {block.Device.InstanceId} mode={FormatNdisAffinityMode(ndisMode)} baseCore={baseCore} queues={queues} mask=0x{block.AffinityMask:X}");
+            WriteLog($"APPLY: NET_NDIS {block.Device.InstanceId} mode={FormatNdisAffinityMode(ndisMode)} baseCore={baseCore} queues={queues} mask={block.AffinityMask}");
             _ndisRssRuntimeCache.Remove(NormalizeInstanceId(block.Device.InstanceId));
+            _ndisRssRuntimeSnapshot = null;
             block.NdisRssRuntime = GetNdisRssRuntimeState(block.Device.InstanceId);
             WriteLog($"APPLY.RSS.ACTIVE: {block.Device.InstanceId} {FormatNdisRssRuntimeState(block.NdisRssRuntime)}");
             int? appliedRssBase = ndisMode is NdisAffinityMode.Rss or NdisAffinityMode.Both ? baseCore : null;
@@ -1243,6 +1270,13 @@ public sealed partial class MainForm
             RecordError("create affinity policy key", ex);
         }
 
+        if (block.AffinityReadError is not null)
+        {
+            WriteLog($"APPLY.REG.SKIP: {block.Device.InstanceId} operation=set-affinity reason=\"{block.AffinityReadError}\"");
+            report?.AddError($"{block.Device.Name} — set affinity", $"{block.AffinityReadError}; left unchanged (pick CPUs to replace it)");
+            return;
+        }
+
         string policyStr = block.PolicyCombo.SelectedItem?.ToString() ?? "MachineDefault";
         int policyVal = policyStr switch
         {
@@ -1254,10 +1288,10 @@ public sealed partial class MainForm
             _ => 0,
         };
 
-        ulong mask = block.AffinityMask;
+        CpuSet mask = block.AffinityMask;
         if (policyVal == 0)
         {
-            mask = 0;
+            mask = CpuSet.Empty;
         }
 
         try
@@ -1270,7 +1304,7 @@ public sealed partial class MainForm
                 return;
             }
 
-            if (mask == 0 || policyVal == 0)
+            if (mask.IsEmpty || policyVal == 0)
             {
                 // Empty CPU selection / MachineDefault = clear DT affinity override (like RESET).
                 affKey.SetValue("DevicePolicy", 0, RegistryValueKind.DWord);
@@ -1279,14 +1313,21 @@ public sealed partial class MainForm
                 return;
             }
 
+            if (!mask.TryEncodeAffinityPolicy(out byte[] bytes))
+            {
+                // GROUP_AFFINITY names one group; the kernel would drop the rest silently.
+                WriteLog($"APPLY.REG.ERROR: {block.Device.InstanceId} operation=set-affinity policy={policyStr} mask={mask} error=spans-processor-groups");
+                report?.AddError($"{block.Device.Name} — set affinity", "selected CPUs span processor groups; an interrupt can target only one group");
+                return;
+            }
+
             affKey.SetValue("DevicePolicy", policyVal, RegistryValueKind.DWord);
-            byte[] bytes = IntPtr.Size >= 8 ? BitConverter.GetBytes(mask) : BitConverter.GetBytes((uint)mask);
             affKey.SetValue("AssignmentSetOverride", bytes, RegistryValueKind.Binary);
-            WriteLog($"APPLY: AFFINITY {block.Device.InstanceId} policy={policyStr} value={policyVal} mask=0x{mask:X}");
+            WriteLog($"APPLY: AFFINITY {block.Device.InstanceId} policy={policyStr} value={policyVal} mask={mask}");
         }
         catch (Exception ex)
         {
-            WriteLog($"APPLY.REG.ERROR: {block.Device.InstanceId} operation=set-affinity policy={policyStr} mask=0x{mask:X} path=HKLM\\{affPath} error=\"{FlattenLogText(ex.ToString())}\"");
+            WriteLog($"APPLY.REG.ERROR: {block.Device.InstanceId} operation=set-affinity policy={policyStr} mask={mask} path=HKLM\\{affPath} error=\"{FlattenLogText(ex.ToString())}\"");
             RecordError("set affinity", ex);
         }
     }
@@ -1308,7 +1349,7 @@ public sealed partial class MainForm
                 block.SuppressCpuEvents--;
             }
 
-            block.AffinityMask = 0;
+            block.AffinityMask = CpuSet.Empty;
             block.AffinityLabel.Text = "Affinity Mask: 0x0";
             block.PrioCombo.SelectedItem = "Undefined";
             if (block.Kind == DeviceKind.NET_NDIS)
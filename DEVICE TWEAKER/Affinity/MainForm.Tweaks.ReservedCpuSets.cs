@@ -5,7 +5,9 @@ namespace DeviceTweakerCS;
 
 public sealed partial class MainForm
 {
-    private bool[] GetReservedCpuSets(int count)
+    // Null when the value is there but could not be read or decoded, so callers never take it
+    // for "nothing reserved" and write that back.
+    private bool[]? GetReservedCpuSets(int count)
     {
         if (count <= 0)
         {
@@ -21,27 +23,28 @@ public sealed partial class MainForm
         try
         {
             using RegistryKey? key = Registry.LocalMachine.OpenSubKey(keyPath);
-            if (key?.GetValue(valueName) is byte[] bytes)
+            object? raw = key?.GetValue(valueName);
+            if (raw is byte[] bytes)
             {
                 rawHex = string.Join(" ", bytes.Select(b => b.ToString("X2")));
-                int bitIndex = 0;
-                foreach (byte b in bytes)
+                if (!CpuSet.TryDecodeBitmap(bytes, out List<int> ids))
                 {
-                    for (int i = 0; i < 8; i++)
-                    {
-                        if ((b & (1 << i)) != 0)
-                        {
-                            rawIds.Add(bitIndex);
-                        }
-
-                        bitIndex++;
-                    }
+                    WriteLog($"RESERVED.ERROR: failed to decode ReservedCpuSets bytes=[{rawHex}]");
+                    return null;
                 }
+
+                rawIds.AddRange(ids);
+            }
+            else if (raw is not null)
+            {
+                WriteLog($"RESERVED.ERROR: ReservedCpuSets is {key!.GetValueKind(valueName)}, not REG_BINARY");
+                return null;
             }
         }
         catch (Exception ex)
         {
             WriteLog($"RESERVED.ERROR: failed to read ReservedCpuSets: {ex.Message}");
+            return null;
         }
 
         List<int> setBits = [];
@@ -110,27 +113,15 @@ public sealed partial class MainForm
             setBits.Add(i);
         }
 
-        int maxIndex = setBits.Count > 0 ? setBits.Max() : -1;
-        int byteCount = maxIndex >= 0 ? (maxIndex / 8) + 1 : 0;
-        byte[] bytes = new byte[byteCount];
-
-        foreach (int id in setBits)
+        try
         {
-            if (id < 0)
+            byte[] bytes = [];
+            if (hasAny && !CpuSet.TryEncodeBitmap(setBits, out bytes))
             {
-                continue;
+                WriteLog($"RESERVED.ERROR: ReservedCpuSets cannot hold set=[{string.Join(',', setBits)}]; registry left unchanged");
+                return false;
             }
 
-            int byteIndex = id / 8;
-            int bitIndex = id % 8;
-            if (byteIndex >= 0 && byteIndex < bytes.Length)
-            {
-                bytes[byteIndex] = (byte)(bytes[byteIndex] | (1 << bitIndex));
-            }
-        }
-
-        try
-        {
             using RegistryKey key = Registry.LocalMachine.CreateSubKey(keyPath) ?? throw new InvalidOperationException("Failed to open HKLM key");
             if (!hasAny)
             {
@@ -214,7 +205,7 @@ public sealed partial class MainForm
             return;
         }
 
-        if (_suppressReservedCpuEvents > 0)
+        if (_suppressReservedCpuEvents > 0 || tag.ReadFailed)
         {
             return;
         }
@@ -258,27 +249,14 @@ public sealed partial class MainForm
         }
     }
 
-    private static byte[] BuildReservedCpuSetBytes(IReadOnlyList<int> setBits)
+    private static string FormatReservedCpuSetBytes(IReadOnlyList<int> setBits)
     {
-        int maxIndex = setBits.Count > 0 ? setBits.Max() : -1;
-        int byteCount = maxIndex >= 0 ? (maxIndex / 8) + 1 : 0;
-        byte[] bytes = new byte[byteCount];
-        foreach (int id in setBits)
+        if (!CpuSet.TryEncodeBitmap(setBits, out byte[] bytes))
         {
-            if (id < 0)
-            {
-                continue;
-            }
-
-            int byteIndex = id / 8;
-            int bitIndex = id % 8;
-            if (byteIndex >= 0 && byteIndex < bytes.Length)
-            {
-                bytes[byteIndex] = (byte)(bytes[byteIndex] | (1 << bitIndex));
-            }
+            return "unencodable";
         }
 
-        return bytes;
+        return bytes.Length == 0 ? "empty" : string.Join(" ", bytes.Select(b => b.ToString("X2")));
     }
 
     private void UpdateReservedCpuValueLabel(ReservedCpuPanelTag tag)
@@ -296,8 +274,7 @@ public sealed partial class MainForm
             return;
         }
 
-        byte[] bytes = BuildReservedCpuSetBytes(setBits);
-        string hex = bytes.Length == 0 ? "empty" : string.Join(" ", bytes.Select(b => b.ToString("X2")));
+        string hex = FormatReservedCpuSetBytes(setBits);
         tag.ValueLabel.Text = $"Value: ReservedCpuSets = [{hex}] | CPUs: {string.Join(", ", setBits)}";
         tag.ValueLabel.Tag = tag.ValueLabel.Text;
     }
@@ -315,7 +292,7 @@ public sealed partial class MainForm
             logicalCount = Environment.ProcessorCount;
         }
 
-        bool[] reservedBits = GetReservedCpuSets(logicalCount);
+        bool[]? reservedBits = GetReservedCpuSets(logicalCount);
 
         Panel grp = new DeviceCardPanel
         {
@@ -429,7 +406,7 @@ public sealed partial class MainForm
                 BackColor = _bgForm,
             };
             StyleCpuCheckbox(cb, i);
-            if (reservedBits.Length > i && reservedBits[i])
+            if (reservedBits is not null && reservedBits.Length > i && reservedBits[i])
             {
                 cb.Checked = true;
                 cb.ForeColor = _accent;
@@ -461,8 +438,15 @@ public sealed partial class MainForm
             Meta = meta,
             PathLabel = pathLabel,
             ValueLabel = valueLabel,
+            ReadFailed = reservedBits is null,
         };
         UpdateReservedCpuValueLabel((ReservedCpuPanelTag)grp.Tag);
+        if (reservedBits is null)
+        {
+            inner.Enabled = false;
+            valueLabel.Text = "Value: ReservedCpuSets = unreadable, left unchanged (see the log)";
+            valueLabel.Tag = "ReservedCpuSets = unreadable";
+        }
 
         return grp;
     }
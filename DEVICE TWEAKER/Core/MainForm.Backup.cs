@@ -56,6 +56,7 @@ public sealed partial class MainForm
         public DateTime CreatedAt { get; set; }
         public string Reason { get; set; } = string.Empty;
         public List<RegistryValueBackup> RegistryValues { get; set; } = [];
+        // imod-config.ini; backups taken before it replaced the startup script hold ApplyIMOD.ps1.
         public FileBackup? ImodScript { get; set; }
     }
 
@@ -257,12 +258,12 @@ public sealed partial class MainForm
                 "DCSettingIndex");
         }
 
-        string startupScript = GetImodStartupPath();
+        string startupConfig = GetImodConfigPath();
         backup.ImodScript = new FileBackup
         {
-            Path = startupScript,
-            Exists = File.Exists(startupScript),
-            Text = File.Exists(startupScript) ? File.ReadAllText(startupScript, Encoding.UTF8) : null,
+            Path = startupConfig,
+            Exists = File.Exists(startupConfig),
+            Text = File.Exists(startupConfig) ? File.ReadAllText(startupConfig, Encoding.UTF8) : null,
         };
 
         return backup;
@@ -561,25 +562,21 @@ public sealed partial class MainForm
             ValidateRegistryValueBackup(value);
         }
 
-        if (backup.ImodScript is not null
-            && !string.Equals(
-                Path.GetFullPath(backup.ImodScript.Path),
-                Path.GetFullPath(GetImodStartupPath()),
-                StringComparison.OrdinalIgnoreCase))
+        if (backup.ImodScript is not null && !IsManagedImodStartupFile(backup.ImodScript.Path))
         {
-            throw new InvalidOperationException("Backup contains an unmanaged IMOD script path.");
+            throw new InvalidOperationException("Backup contains an unmanaged IMOD startup file path.");
         }
 
         List<RegistryValueBackup> rollbackValues = [];
         FileBackup? rollbackScript = null;
         if (backup.ImodScript is not null)
         {
-            string startupPath = GetImodStartupPath();
+            string startupConfig = GetImodConfigPath();
             rollbackScript = new FileBackup
             {
-                Path = startupPath,
-                Exists = File.Exists(startupPath),
-                Text = File.Exists(startupPath) ? File.ReadAllText(startupPath, Encoding.UTF8) : null,
+                Path = startupConfig,
+                Exists = File.Exists(startupConfig),
+                Text = File.Exists(startupConfig) ? File.ReadAllText(startupConfig, Encoding.UTF8) : null,
             };
         }
 
@@ -611,6 +608,7 @@ public sealed partial class MainForm
             if (backup.ImodScript is not null)
             {
                 RestoreFileBackup(backup.ImodScript);
+                SyncImodStartupEntry(backup.ImodScript.Path);
                 InvalidateImodCache();
             }
         }
@@ -635,11 +633,12 @@ public sealed partial class MainForm
                 try
                 {
                     RestoreFileBackup(rollbackScript);
+                    SyncImodStartupEntry(rollbackScript.Path);
                     InvalidateImodCache();
                 }
                 catch (Exception ex)
                 {
-                    rollbackErrors.Add($"IMOD script: {ex.Message}");
+                    rollbackErrors.Add($"IMOD startup config: {ex.Message}");
                 }
             }
 
@@ -856,9 +855,7 @@ public sealed partial class MainForm
             return;
         }
 
-        string expectedPath = Path.GetFullPath(GetImodStartupPath());
-        string actualPath = Path.GetFullPath(backup.Path);
-        if (!string.Equals(actualPath, expectedPath, StringComparison.OrdinalIgnoreCase))
+        if (!IsManagedImodStartupFile(backup.Path))
         {
             throw new InvalidOperationException("Refusing to restore an unmanaged file path.");
         }
@@ -881,6 +878,13 @@ public sealed partial class MainForm
         File.WriteAllText(backup.Path, backup.Text ?? string.Empty, Encoding.UTF8);
     }
 
+    private bool IsManagedImodStartupFile(string path)
+    {
+        string actualPath = Path.GetFullPath(path);
+        return string.Equals(actualPath, Path.GetFullPath(GetImodConfigPath()), StringComparison.OrdinalIgnoreCase)
+            || string.Equals(actualPath, Path.GetFullPath(GetImodLegacyScriptPath()), StringComparison.OrdinalIgnoreCase);
+    }
+
     private static string MakeBackupFileReason(string reason)
     {
         if (string.IsNullOrWhiteSpace(reason))
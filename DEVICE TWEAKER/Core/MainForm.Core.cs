@@ -11,6 +11,7 @@ public sealed partial class MainForm : Form
 {
     private readonly List<DeviceBlock> _blocks = [];
     private readonly Dictionary<string, NdisRssRuntimeState> _ndisRssRuntimeCache = new(StringComparer.OrdinalIgnoreCase);
+    private NdisRssRuntimeSnapshot? _ndisRssRuntimeSnapshot;
 
     private Panel _devicesHost = null!;
     private Panel _devicesPanel = null!;
@@ -356,7 +357,7 @@ public sealed partial class MainForm : Form
                 string audio = b.Device.AudioEndpoints ?? string.Empty;
 
                 WriteLog(
-                    $"BOOT.DEV: {b.Device.InstanceId} Kind={b.Kind} Class={cls} Name=\"{name}\" MSI={msi} Prio={prio} Policy={policy} Mask=0x{b.AffinityMask:X} UsbRoles=\"{usb}\" UsbPolling=\"{usbPolling}\" Audio=\"{audio}\"");
+                    $"BOOT.DEV: {b.Device.InstanceId} Kind={b.Kind} Class={cls} Name=\"{name}\" MSI={msi} Prio={prio} Policy={policy} Mask={b.AffinityMask} UsbRoles=\"{usb}\" UsbPolling=\"{usbPolling}\" Audio=\"{audio}\"");
             }
         }
     }
@@ -459,18 +460,18 @@ public sealed partial class MainForm : Form
         return null;
     }
 
-    private static ulong BuildUiMask(DeviceBlock block)
+    private CpuSet BuildUiMask(DeviceBlock block)
     {
-        ulong mask = 0;
+        List<int> lps = [];
         for (int i = 0; i < block.CpuBoxes.Count; i++)
         {
             if (block.CpuBoxes[i].Checked)
             {
-                mask |= 1UL << i;
+                lps.Add(i);
             }
         }
 
-        return mask;
+        return BuildCpuSet(lps);
     }
 
     private static int? MapPrioText(string? text)
@@ -608,7 +609,7 @@ public sealed partial class MainForm : Form
         }
     }
 
-    private static ulong? TryGetAssignmentMask(RegistryKey? key)
+    private static CpuSet? TryGetAssignmentMask(RegistryKey? key)
     {
         if (key is null)
         {
@@ -618,27 +619,10 @@ public sealed partial class MainForm : Form
         try
         {
             object? raw = key.GetValue("AssignmentSetOverride");
-            if (raw is byte[] bytes)
-            {
-                if (bytes.Length >= 8)
-                {
-                    return BitConverter.ToUInt64(bytes, 0);
-                }
-
-                if (bytes.Length >= 4)
-                {
-                    return BitConverter.ToUInt32(bytes, 0);
-                }
-
-                return null;
-            }
-
             return raw switch
             {
-                int i => (uint)i,
-                uint ui => ui,
-                long l => (ulong)l,
-                ulong ul => ul,
+                byte[] bytes when bytes.Length < 4 => null,
+                byte[] or int or uint or long or ulong => CpuSet.DecodeAffinityPolicy(raw),
                 _ => null,
             };
         }
@@ -653,6 +637,11 @@ public sealed partial class MainForm : Form
         if (value is byte[] bytes)
         {
             string hex = string.Join(" ", bytes.Select(b => b.ToString("X2")));
+            if (bytes.Length == CpuSet.GroupAffinitySize)
+            {
+                return $"{CpuSet.DecodeAffinityPolicy(bytes)} (GROUP_AFFINITY) bytes=[{hex}]";
+            }
+
             if (bytes.Length >= 8)
             {
                 ulong mask = BitConverter.ToUInt64(bytes, 0);
@@ -1008,7 +997,7 @@ public sealed partial class MainForm : Form
             string policyLabel = FlattenLogText(b.PolicyLabel.Text);
 
             WriteLog(
-                $"GUI.BLOCK.STATE: idx={i} msi={msi} limit={limit} prio={prio} policy={policy} policyLabel=\"{policyLabel}\" policyEnabled={b.PolicyCombo.Enabled} mask=0x{b.AffinityMask:X} affinityText=\"{affinityText}\" irqText=\"{irqText}\" cpuChecked=[{FormatIndexList(selected)}]");
+                $"GUI.BLOCK.STATE: idx={i} msi={msi} limit={limit} prio={prio} policy={policy} policyLabel=\"{policyLabel}\" policyEnabled={b.PolicyCombo.Enabled} mask={b.AffinityMask} affinityText=\"{affinityText}\" irqText=\"{irqText}\" cpuChecked=[{FormatIndexList(selected)}]");
 
             string imodValue = b.ImodBox.Text?.Trim() ?? string.Empty;
             string imodDefault = FlattenLogText(b.ImodDefaultLabel.Text);
@@ -1075,8 +1064,7 @@ public sealed partial class MainForm : Form
                 .OrderBy(x => x)
                 .ToList();
             string valueText = tag.ValueLabel.Text;
-            byte[] bytes = BuildReservedCpuSetBytes(reserved);
-            string bytesText = bytes.Length == 0 ? "none" : string.Join(" ", bytes.Select(b => b.ToString("X2")));
+            string bytesText = reserved.Count == 0 ? "none" : FormatReservedCpuSetBytes(reserved);
             WriteLog($"GUI.RESERVED: count={tag.Meta.Count} set=[{FormatIndexList(reserved)}] bytes=[{bytesText}] value=\"{SanitizeLogValue(valueText)}\"");
         }
         else
@@ -1555,10 +1543,10 @@ public sealed partial class MainForm : Form
             if (expectsIrq && !block.Device.IsTestDevice)
             {
                 int? irqPolicy = TryGetRegInt(affKey, "DevicePolicy");
-                ulong irqMask = TryGetAssignmentMask(affKey) ?? 0;
-                if (irqPolicy != 4 || irqMask == 0)
+                CpuSet irqMask = TryGetAssignmentMask(affKey) ?? CpuSet.Empty;
+                if (irqPolicy != 4 || irqMask.IsEmpty)
                 {
-                    LogIssue("rssIrqPolicyMissing", $"mode={FormatNdisAffinityMode(ndisMode)} policy={(irqPolicy?.ToString(CultureInfo.InvariantCulture) ?? "missing")} mask=0x{irqMask:X}");
+                    LogIssue("rssIrqPolicyMissing", $"mode={FormatNdisAffinityMode(ndisMode)} policy={(irqPolicy?.ToString(CultureInfo.InvariantCulture) ?? "missing")} mask={irqMask}");
                 }
             }
 
@@ -1663,18 +1651,18 @@ public sealed partial class MainForm : Form
                     }
                 }
 
-                ulong uiMask = BuildUiMask(block);
+                CpuSet uiMask = BuildUiMask(block);
                 if (uiMask != block.AffinityMask)
                 {
-                    LogIssue("uiMaskOutOfSync", $"ui=0x{uiMask:X} state=0x{block.AffinityMask:X}");
+                    LogIssue("uiMaskOutOfSync", $"ui={uiMask} state={block.AffinityMask}");
                 }
 
-                ulong? regMaskRaw = TryGetAssignmentMask(affKey);
-                ulong regMask = regMaskRaw ?? 0;
+                CpuSet? regMaskRaw = TryGetAssignmentMask(affKey);
+                CpuSet regMask = regMaskRaw ?? CpuSet.Empty;
                 if (uiMask != regMask)
                 {
-                    string suffix = regMaskRaw.HasValue ? string.Empty : " regMissing=1";
-                    LogIssue("maskMismatch", $"ui=0x{uiMask:X} reg=0x{regMask:X}{suffix}");
+                    string suffix = regMaskRaw is not null ? string.Empty : " regMissing=1";
+                    LogIssue("maskMismatch", $"ui={uiMask} reg={regMask}{suffix}");
                 }
             }
         }
@@ -22,8 +22,11 @@ public sealed partial class MainForm
     private const uint SpdrpCompatibleIds = 0x00000002;
     private const uint SpdrpService = 0x00000004;
     private const uint SpdrpFriendlyName = 0x0000000C;
+    private const uint SpdrpBusNumber = 0x00000015;
+    private const uint SpdrpAddress = 0x0000001C;
 
     private const uint RegSz = 1;
+    private const uint RegDword = 4;
     private const uint RegMultiSz = 7;
 
     private const uint AllocLogConf = 0x00000002;
@@ -79,6 +82,42 @@ public sealed partial class MainForm
         CtlCode(FileDeviceImod, ImodIoctlIndex + 2, MethodBuffered, FileAnyAccess);
     private static readonly uint IoctlImodWritePhysicalMemory =
         CtlCode(FileDeviceImod, ImodIoctlIndex + 3, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodApplyBatch =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 4, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodOpenSession =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 5, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodCloseSession =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 6, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodSessionRead =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 7, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodQueryTopology =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 9, MethodBuffered, FileAnyAccess);
+    private static readonly uint IoctlImodQueryVersion =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 14, MethodBuffered, FileAnyAccess);
+
+    // Bit n is IOCTL ImodIoctlIndex + n. The prebuilt DTIMOD.sys has only map, unmap, read and
+    // write and fails the version query, so that is what a failed query means.
+    private const uint ImodLegacyIoctlMask = 0x000F;
+
+    private const uint ImodBatchVersion = 1;
+    private const uint ImodBatchStatusWritten = 0;
+    private const uint ImodBatchStatusReadFailed = 2;
+    private const uint ImodBatchStatusWriteFailed = 3;
+    private const uint ImodBatchStatusUnchanged = 4;
+    private const uint ImodBatchStatusInactive = 5;
+    private const uint ImodBatchStatusVerifyFailed = 6;
+    private const uint ImodBatchStatusVerified = 7;
+    private const uint ImodBatchFlagDiff = 0x1;
+    private const uint ImodBatchFlagVerify = 0x2;
+    private const ulong ImodSessionMaxLength = 0x100000;
+    private const uint ImodTopologyVersion = 1;
+    private const uint ImodTopologyFlagWalk = 0x1;
+    private const uint ImodTopologySlotCapacity = 255;
+    private const uint ImodTopologyEndpointCapacity = 255 * 31;
+    private const byte ImodTopologySlotHub = 0x01;
+    private const byte ImodTopologyEndpointTrbValid = 0x01;
+    private const int ErrorInvalidFunction = 1;
+    private const int ErrorInvalidParameter = 87;
 
     private sealed class ImodControllerInfo
     {
@@ -86,14 +125,19 @@ public sealed partial class MainForm
         public string Caption { get; init; } = string.Empty;
         public uint ProblemCode { get; init; }
         public ulong BaseAddress { get; init; }
+        public ulong BaseLength { get; init; }
         public bool HasBase { get; init; }
         public string BaseError { get; init; } = string.Empty;
+        public PciMsixTarget? Msix { get; init; }
     }
 
     private sealed class XhciInterrupterTopology
     {
         public Dictionary<uint, List<uint>> ByRootPort { get; } = [];
         public Dictionary<uint, List<uint>> ByDeviceAddress { get; } = [];
+        // Keyed by port path as in UsbTopologyInterop: "7" is root port 7, "7.2.4" is port 4
+        // of the hub on port 2 of the hub on root port 7.
+        public Dictionary<string, List<uint>> ByRoute { get; } = new(StringComparer.Ordinal);
         public int EndpointTargetCount { get; set; }
         public int SlotTargetCount { get; set; }
         public uint MaxSlots { get; set; }
@@ -254,6 +298,39 @@ public sealed partial class MainForm
         out int bytesReturned,
         IntPtr overlapped);
 
+    [DllImport("kernel32.dll", SetLastError = true)]
+    private static extern bool DeviceIoControl(
+        IntPtr deviceHandle,
+        uint ioControlCode,
+        ref ImodSessionStruct inBuffer,
+        int inBufferSize,
+        ref ImodSessionStruct outBuffer,
+        int outBufferSize,
+        out int bytesReturned,
+        IntPtr overlapped);
+
+    [DllImport("kernel32.dll", SetLastError = true)]
+    private static extern bool DeviceIoControl(
+        IntPtr deviceHandle,
+        uint ioControlCode,
+        ref ImodSessionAccessStruct inBuffer,
+        int inBufferSize,
+        ref ImodSessionAccessStruct outBuffer,
+        int outBufferSize,
+        out int bytesReturned,
+        IntPtr overlapped);
+
+    [DllImport("kernel32.dll", SetLastError = true)]
+    private static extern bool DeviceIoControl(
+        IntPtr deviceHandle,
+        uint ioControlCode,
+        IntPtr inBuffer,
+        int inBufferSize,
+        out ImodDriverVersionStruct outBuffer,
+        int outBufferSize,
+        out int bytesReturned,
+        IntPtr overlapped);
+
     [DllImport("kernel32.dll", SetLastError = true)]
     private static extern bool DeviceIoControl(
         IntPtr deviceHandle,
@@ -273,6 +350,9 @@ public sealed partial class MainForm
         public int ControllersFound { get; set; }
         public int ControllersApplied { get; set; }
         public int WriteFailures { get; set; }
+        public int Written { get; set; }
+        public int Skipped { get; set; }
+        public int Verified { get; set; }
         public int SkippedDisabled { get; set; }
         public int MissingBase { get; set; }
         public int ReadFailures { get; set; }
@@ -436,17 +516,66 @@ public sealed partial class MainForm
                         }
                     }
 
+                    // Interrupters that already hold their interval or are not enabled are left
+                    // alone, so a rerun on a tuned machine costs reads only.
+                    const uint applyFlags = ImodBatchFlagDiff | ImodBatchFlagVerify;
                     uint writeFailures = 0;
+                    uint written = 0;
+                    uint skipped = 0;
+                    uint verified = 0;
                     uint writeCount = desiredIntervals is { Count: > 0 }
                         ? Math.Min(maxIntrs, (uint)desiredIntervals.Count)
                         : maxIntrs;
+                    uint[] targetIntervals = new uint[writeCount];
                     for (uint i = 0; i < writeCount; ++i)
                     {
-                        ulong interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
-                        uint targetInterval = desiredIntervals is { Count: > 0 }
+                        targetIntervals[i] = desiredIntervals is { Count: > 0 }
                             ? desiredIntervals[(int)i]
                             : desiredInterval;
-                        if (!TryWriteImodInterval(imodDriver, interrupterAddress, targetInterval, out ioError))
+                    }
+
+                    bool batchApplied = false;
+                    if (writeCount > 0 && !imodDriver.BatchUnsupported)
+                    {
+                        if (TryApplyImodBatch(
+                                imodDriver,
+                                controller,
+                                hcsparamsOffset,
+                                rtsoff,
+                                targetIntervals,
+                                applyFlags,
+                                out uint[] batchStatuses,
+                                out ioError))
+                        {
+                            for (uint i = 0; i < writeCount; ++i)
+                            {
+                                if (!CountImodStatus(batchStatuses[i], ref written, ref skipped, ref verified))
+                                {
+                                    writeFailures++;
+                                    ulong interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
+                                    WriteLog($"IMOD: write failed {controller.DeviceId} @ {ToHex(interrupterAddress)}: batch status {batchStatuses[i]}");
+                                }
+                            }
+
+                            batchApplied = true;
+                        }
+                        else if (!imodDriver.BatchUnsupported)
+                        {
+                            stats.ReadFailures++;
+                            WriteLog($"IMOD: batch apply failed {controller.DeviceId}: {ioError}");
+                            continue;
+                        }
+                        else
+                        {
+                            WriteLog("IMOD: driver has no batch IOCTL, using per-register writes");
+                        }
+                    }
+
+                    for (uint i = 0; !batchApplied && i < writeCount; ++i)
+                    {
+                        ulong interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
+                        uint status = ApplyImodIntervalDiff(imodDriver, interrupterAddress - 0x4, targetIntervals[i], applyFlags, out ioError);
+                        if (!CountImodStatus(status, ref written, ref skipped, ref verified))
                         {
                             writeFailures++;
                             WriteLog($"IMOD: write failed {controller.DeviceId} @ {ToHex(interrupterAddress)}: {ioError}");
@@ -455,11 +584,14 @@ public sealed partial class MainForm
 
                     stats.ControllersApplied++;
                     stats.WriteFailures += (int)writeFailures;
+                    stats.Written += (int)written;
+                    stats.Skipped += (int)skipped;
+                    stats.Verified += (int)verified;
 
                     string modeText = desiredIntervals is { Count: > 0 }
                         ? $"vector={desiredIntervals.Count}"
                         : $"interval={FormatImodValue(desiredInterval)}";
-                    WriteLog($"IMOD: {controller.DeviceId} writes={writeCount}/{maxIntrs} {modeText} failures={writeFailures}");
+                    WriteLog($"IMOD: {controller.DeviceId} interrupters={writeCount}/{maxIntrs} {modeText} written={written} skipped={skipped} verified={verified} failures={writeFailures}");
                 }
             }
         }
@@ -1079,7 +1211,7 @@ public sealed partial class MainForm
             return false;
         }
 
-        bool persistDriver = config.HasScript || HasCustomImod(config);
+        bool persistDriver = config.HasStartupConfig || HasCustomImod(config);
         if (!EnsureImodDriverOnDisk(persistDriver, out string driverPath, out error))
         {
             return false;
@@ -1158,10 +1290,17 @@ public sealed partial class MainForm
                 ulong runtimeAddress = capabilityAddress + rtsoffValue;
                 List<uint> values = [];
 
+                ulong sessionLength = (ulong)rtsoffValue + 0x24 + (0x20UL * readCount);
+                uint sessionId = 0;
+                bool sessionOpen = readCount > 0
+                    && TryOpenImodSession(imodDriver, capabilityAddress, sessionLength, out sessionId, out _);
                 for (uint i = 0; i < readCount; i++)
                 {
                     ulong interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
-                    if (!TryReadPhys32(imodDriver, interrupterAddress, out uint registerValue, out ioError))
+                    bool readOk = sessionOpen
+                        ? TryReadImodSession32(imodDriver, sessionId, (uint)(interrupterAddress - capabilityAddress), out uint registerValue, out ioError)
+                        : TryReadPhys32(imodDriver, interrupterAddress, out registerValue, out ioError);
+                    if (!readOk)
                     {
                         WriteLog($"IMOD.READBACK: read failed {controller.DeviceId} @ {ToHex(interrupterAddress)}: {ioError}");
                         continue;
@@ -1170,12 +1309,25 @@ public sealed partial class MainForm
                     values.Add(registerValue & 0xFFFF);
                 }
 
+                if (sessionOpen)
+                {
+                    TryCloseImodSession(imodDriver, sessionId);
+                }
+
                 if (values.Count > 0)
                 {
                     string normalizedControllerId = NormalizeInstanceId(controller.DeviceId);
                     valuesByDeviceId[normalizedControllerId] = values;
                     if (TryFormatImodInterrupterRoleMap(controller, imodDriver, maxIntrs, values, out string mapText, out string mapDetail))
                     {
+                        // xHCI interrupter n raises MSI-X vector n, so the table says where each one lands.
+                        if (TryDescribeMsix(imodDriver, controller.Msix, index => $"IR{index}", out string msixLine, out string msixDetail))
+                        {
+                            mapText += $"\r\n{msixLine}";
+                            mapDetail += $"\r\n{msixLine}\r\n{msixDetail}";
+                        }
+
+                        WriteLog($"IMOD.MSIX: {controller.DeviceId} {FlattenLogText(msixDetail)}");
                         mapByDeviceId[normalizedControllerId] = mapText;
                         mapDetailByDeviceId[normalizedControllerId] = mapDetail;
                         WriteLog($"IMOD.MAP: {controller.DeviceId} {mapDetail}");
@@ -1946,6 +2098,7 @@ public sealed partial class MainForm
             return false;
         }
 
+        int routeMatches = 0;
         int addressMatches = 0;
         int rootPortMatches = 0;
         int classifiedEndpoints = 0;
@@ -1968,7 +2121,16 @@ public sealed partial class MainForm
 
             classifiedEndpoints++;
             bool mapped = false;
-            if (endpoint.DeviceAddress > 0
+            if (TryGetUsbRoute(endpoint.TopologyPath, out string route)
+                && topology.ByRoute.TryGetValue(route, out List<uint>? routeIntrs))
+            {
+                AddAdaptiveRoleToInterrupters(rolesByInterrupter, routeIntrs, role);
+                routeMatches++;
+                mapped = true;
+            }
+
+            if (!mapped
+                && endpoint.DeviceAddress > 0
                 && topology.ByDeviceAddress.TryGetValue((uint)endpoint.DeviceAddress, out List<uint>? addressIntrs))
             {
                 AddAdaptiveRoleToInterrupters(rolesByInterrupter, addressIntrs, role);
@@ -1992,7 +2154,7 @@ public sealed partial class MainForm
         }
 
         detail =
-            $"exact xHCI map: addressMatches={addressMatches}, rootPortMatches={rootPortMatches}, endpointTargets={topology.EndpointTargetCount}, slotTargets={topology.SlotTargetCount}, classified={classifiedEndpoints}, filteredGenericHid={filteredGamepadEndpoints}; {topologyDetail}";
+            $"exact xHCI map: routeMatches={routeMatches}, addressMatches={addressMatches}, rootPortMatches={rootPortMatches}, endpointTargets={topology.EndpointTargetCount}, slotTargets={topology.SlotTargetCount}, classified={classifiedEndpoints}, filteredGenericHid={filteredGamepadEndpoints}; {topologyDetail}";
         return true;
     }
 
@@ -2013,9 +2175,12 @@ public sealed partial class MainForm
         }
     }
 
-    private static Dictionary<uint, HashSet<string>> BuildAdaptiveRootPortRoles(string controllerDeviceId)
+    // Roles below the controller by root port and, where the device's port path fits a Route
+    // String, by that path, so IMOD.exe can tell apart devices that share a hub.
+    private static (Dictionary<uint, HashSet<string>> ByRootPort, Dictionary<string, HashSet<string>> ByRoute) BuildAdaptivePortRoles(string controllerDeviceId)
     {
         Dictionary<uint, HashSet<string>> rolesByRootPort = [];
+        Dictionary<string, HashSet<string>> rolesByRoute = new(StringComparer.Ordinal);
         List<UsbEndpointInfo> endpoints;
         try
         {
@@ -2023,7 +2188,7 @@ public sealed partial class MainForm
         }
         catch
         {
-            return rolesByRootPort;
+            return (rolesByRootPort, rolesByRoute);
         }
 
         foreach (UsbEndpointInfo endpoint in endpoints)
@@ -2035,16 +2200,26 @@ public sealed partial class MainForm
                 continue;
             }
 
-            if (!rolesByRootPort.TryGetValue(rootPort, out HashSet<string>? roles))
+            AddAdaptivePortRole(rolesByRootPort, rootPort, role);
+            if (TryGetUsbRoute(endpoint.TopologyPath, out string route))
             {
-                roles = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
-                rolesByRootPort[rootPort] = roles;
+                AddAdaptivePortRole(rolesByRoute, route, role);
             }
+        }
 
-            roles.Add(role);
+        return (rolesByRootPort, rolesByRoute);
+    }
+
+    private static void AddAdaptivePortRole<TKey>(Dictionary<TKey, HashSet<string>> rolesByPort, TKey port, string role)
+        where TKey : notnull
+    {
+        if (!rolesByPort.TryGetValue(port, out HashSet<string>? roles))
+        {
+            roles = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+            rolesByPort[port] = roles;
         }
 
-        return rolesByRootPort;
+        roles.Add(role);
     }
 
     private HashSet<string> BuildAdaptiveControllerRoleFallback(string controllerDeviceId)
@@ -2190,6 +2365,26 @@ public sealed partial class MainForm
         out XhciInterrupterTopology topology,
         out string detail)
     {
+        if (!imodDriver.TopologyUnsupported
+            && TryQueryXhciTopology(
+                imodDriver,
+                controller,
+                out ImodTopologyHeader snapshot,
+                out ImodTopologySlot[] snapshotSlots,
+                out ImodTopologyEndpoint[] snapshotEndpoints,
+                out ImodTopologyWalk? walk,
+                out _))
+        {
+            topology = BuildXhciInterrupterTopology(snapshot, snapshotSlots, snapshotEndpoints, maxIntrs);
+            bool described = TryDescribeXhciInterrupterTopology(topology, out detail);
+            if (walk is ImodTopologyWalk cost)
+            {
+                detail += $", walk=slots {cost.slotsScanned} (read {cost.slotsRead}, reused {cost.slotsReused}, dropped {cost.slotsDropped}), maps {cost.maps}, reads {cost.reads}";
+            }
+
+            return described;
+        }
+
         topology = new XhciInterrupterTopology();
         ulong capabilityAddress = controller.BaseAddress;
 
@@ -2265,6 +2460,7 @@ public sealed partial class MainForm
             }
 
             bool isHub = ((slotDword0 >> 26) & 0x1) != 0;
+            uint routeString = slotDword0 & 0xFFFFF;
             uint contextEntries = (slotDword0 >> 27) & 0x1F;
             uint slotState = (slotDword3 >> 27) & 0x1F;
             uint rootPort = (slotDword1 >> 16) & 0xFF;
@@ -2276,34 +2472,183 @@ public sealed partial class MainForm
                 continue;
             }
 
-            if (TryReadEndpointInterrupterTarget(
+            List<uint> interrupters = [];
+            if (TryReadEndpointInterrupterTargets(
                     imodDriver,
                     deviceContext,
                     contextSize,
                     contextEntries,
                     maxIntrs,
-                    out uint endpointInterrupter))
+                    interrupters))
+            {
+                topology.EndpointTargetCount++;
+            }
+            else
+            {
+                topology.SlotTargetCount++;
+                if (interrupter < maxIntrs)
+                {
+                    interrupters.Add(interrupter);
+                }
+            }
+
+            AddXhciSlotInterrupters(topology, rootPort, routeString, deviceAddress, interrupters);
+        }
+
+        return TryDescribeXhciInterrupterTopology(topology, out detail);
+    }
+
+    private static XhciInterrupterTopology BuildXhciInterrupterTopology(
+        ImodTopologyHeader snapshot,
+        ImodTopologySlot[] slots,
+        ImodTopologyEndpoint[] endpoints,
+        uint maxIntrs)
+    {
+        XhciInterrupterTopology topology = new()
+        {
+            MaxSlots = snapshot.maxSlots,
+            ContextSize = snapshot.contextSize,
+        };
+
+        foreach (ImodTopologySlot slot in slots)
+        {
+            bool isHub = (slot.flags & ImodTopologySlotHub) != 0;
+            if (slot.slotState < 2 || isHub || slot.rootPort == 0)
+            {
+                continue;
+            }
+
+            List<uint> interrupters = [];
+            if (TryFindEndpointInterrupterTargets(slot, endpoints, maxIntrs, interrupters))
             {
-                interrupter = endpointInterrupter;
                 topology.EndpointTargetCount++;
             }
             else
             {
                 topology.SlotTargetCount++;
+                if (slot.interrupter < maxIntrs)
+                {
+                    interrupters.Add(slot.interrupter);
+                }
             }
 
-            if (interrupter >= maxIntrs)
+            AddXhciSlotInterrupters(topology, slot.rootPort, slot.routeString, slot.deviceAddress, interrupters);
+        }
+
+        return topology;
+    }
+
+    // Every interrupter the slot's periodic and bulk endpoints target, so a device whose
+    // endpoints are spread over several interrupters gets its interval on all of them.
+    private static bool TryFindEndpointInterrupterTargets(
+        ImodTopologySlot slot,
+        ImodTopologyEndpoint[] endpoints,
+        uint maxIntrs,
+        List<uint> interrupters)
+    {
+        int end = Math.Min(endpoints.Length, slot.firstEndpoint + slot.endpointCount);
+        for (int i = slot.firstEndpoint; i < end; i++)
+        {
+            ImodTopologyEndpoint endpoint = endpoints[i];
+            if (endpoint.contextIndex < 2
+                || endpoint.state == 0
+                || endpoint.type is not (3 or 5 or 7)
+                || (endpoint.flags & ImodTopologyEndpointTrbValid) == 0
+                || endpoint.trbType is not (1 or 3 or 5))
             {
                 continue;
             }
 
+            if (endpoint.trbInterrupter < maxIntrs && !interrupters.Contains(endpoint.trbInterrupter))
+            {
+                interrupters.Add(endpoint.trbInterrupter);
+            }
+        }
+
+        return interrupters.Count > 0;
+    }
+
+    private static void AddXhciSlotInterrupters(
+        XhciInterrupterTopology topology,
+        uint rootPort,
+        uint routeString,
+        uint deviceAddress,
+        List<uint> interrupters)
+    {
+        bool hasRoute = TryFormatXhciRoute(rootPort, routeString, out string route);
+        foreach (uint interrupter in interrupters)
+        {
             AddUniqueInterrupter(topology.ByRootPort, rootPort, interrupter);
+            if (hasRoute)
+            {
+                AddUniqueInterrupter(topology.ByRoute, route, interrupter);
+            }
+
             if (deviceAddress > 0)
             {
                 AddUniqueInterrupter(topology.ByDeviceAddress, deviceAddress, interrupter);
             }
         }
+    }
+
+    // Root port and slot context Route String as the port path IMOD.exe reads from
+    // ROUTE_ROLES ("7.2.4"), formatted by Common/imod_topology.c.
+    private static bool TryFormatXhciRoute(uint rootPort, uint routeString, out string route)
+    {
+        route = string.Empty;
+        byte[] text = new byte[NativeImodCore.TopologyRouteTextSize];
+        try
+        {
+            if (NativeImodCore.ImodTopologyFormatRoute(rootPort, routeString, text, (uint)text.Length, out uint written) != NativeImodCore.ResultSuccess)
+            {
+                return false;
+            }
+
+            route = Encoding.ASCII.GetString(text, 0, (int)written);
+            return true;
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            // Without IMODCore.dll devices still match by address and root port.
+            return false;
+        }
+    }
+
+    // "HC0/Port7/Port2/Port4" -> "7.2.4". Paths deeper than five hubs, or through a hub port
+    // above 15, cannot be expressed as a Route String and do not match.
+    private static bool TryGetUsbRoute(string topologyPath, out string route)
+    {
+        route = string.Empty;
+        List<uint> ports = [];
+        foreach (string segment in topologyPath.Split(['/', '\\'], StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries))
+        {
+            if (!segment.StartsWith("Port", StringComparison.OrdinalIgnoreCase))
+            {
+                continue;
+            }
+
+            if (!uint.TryParse(segment.AsSpan(4), System.Globalization.NumberStyles.None, System.Globalization.CultureInfo.InvariantCulture, out uint port)
+                || ports.Count == NativeImodCore.TopologyRouteMaxPorts)
+            {
+                return false;
+            }
+
+            ports.Add(port);
+        }
 
+        try
+        {
+            return NativeImodCore.ImodTopologyEncodeRoute([.. ports], (uint)ports.Count, out uint rootPort, out uint routeString) == NativeImodCore.ResultSuccess
+                && TryFormatXhciRoute(rootPort, routeString, out route);
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            return false;
+        }
+    }
+
+    private static bool TryDescribeXhciInterrupterTopology(XhciInterrupterTopology topology, out string detail)
+    {
         if (topology.ByRootPort.Count == 0 && topology.ByDeviceAddress.Count == 0)
         {
             detail = "no active xHCI device/interrupter topology was found";
@@ -2311,14 +2656,17 @@ public sealed partial class MainForm
         }
 
         detail =
-            $"slots={maxSlots}, ctx={contextSize}, byAddress={topology.ByDeviceAddress.Count}, byRootPort={topology.ByRootPort.Count}, endpointTargets={topology.EndpointTargetCount}, slotTargets={topology.SlotTargetCount}, "
+            $"slots={topology.MaxSlots}, ctx={topology.ContextSize}, byRoute={topology.ByRoute.Count}, byAddress={topology.ByDeviceAddress.Count}, byRootPort={topology.ByRootPort.Count}, endpointTargets={topology.EndpointTargetCount}, slotTargets={topology.SlotTargetCount}, "
+            + FormatXhciTopologyMap("route", topology.ByRoute)
+            + ", "
             + FormatXhciTopologyMap("addr", topology.ByDeviceAddress)
             + ", "
             + FormatXhciTopologyMap("rootPort", topology.ByRootPort);
         return true;
     }
 
-    private static string FormatXhciTopologyMap(string name, IReadOnlyDictionary<uint, List<uint>> map)
+    private static string FormatXhciTopologyMap<TKey>(string name, IReadOnlyDictionary<TKey, List<uint>> map)
+        where TKey : notnull
     {
         if (map.Count == 0)
         {
@@ -2327,7 +2675,7 @@ public sealed partial class MainForm
 
         const int maxShown = 16;
         List<string> parts = [];
-        foreach (KeyValuePair<uint, List<uint>> pair in map.OrderBy(static kvp => kvp.Key))
+        foreach (KeyValuePair<TKey, List<uint>> pair in map.OrderBy(static kvp => kvp.Key))
         {
             string intrs = pair.Value.Count == 0
                 ? "-"
@@ -2343,15 +2691,14 @@ public sealed partial class MainForm
         return $"{name}Map=[{string.Join(", ", parts)}{suffix}]";
     }
 
-    private static bool TryReadEndpointInterrupterTarget(
+    private static bool TryReadEndpointInterrupterTargets(
         ImodDriverContext imodDriver,
         ulong deviceContext,
         uint contextSize,
         uint contextEntries,
         uint maxIntrs,
-        out uint interrupter)
+        List<uint> interrupters)
     {
-        interrupter = 0;
         if (contextSize == 0 || contextEntries < 2)
         {
             return false;
@@ -2397,17 +2744,17 @@ public sealed partial class MainForm
             }
 
             uint target = (trbDword2 >> 22) & 0x3FF;
-            if (target < maxIntrs)
+            if (target < maxIntrs && !interrupters.Contains(target))
             {
-                interrupter = target;
-                return true;
+                interrupters.Add(target);
             }
         }
 
-        return false;
+        return interrupters.Count > 0;
     }
 
-    private static void AddUniqueInterrupter(Dictionary<uint, List<uint>> map, uint key, uint interrupter)
+    private static void AddUniqueInterrupter<TKey>(Dictionary<TKey, List<uint>> map, TKey key, uint interrupter)
+        where TKey : notnull
     {
         if (!map.TryGetValue(key, out List<uint>? intrs))
         {
@@ -2423,6 +2770,23 @@ public sealed partial class MainForm
 
     private static bool TryReadPhys64ForAdaptive(ImodDriverContext imodDriver, ulong address, out ulong value, out string? error)
     {
+        if (!imodDriver.Phys64Unsupported)
+        {
+            if (TryReadPhysicalMemory(imodDriver, address, 8, out value, out error, out int lastError))
+            {
+                return true;
+            }
+
+            // Only an older driver that rejects 8-byte reads outright turns them off; a bad
+            // DCBAA or context pointer fails the same way on the 4-byte path below.
+            if (lastError != ErrorInvalidParameter && lastError != ErrorInvalidFunction)
+            {
+                return false;
+            }
+
+            imodDriver.Phys64Unsupported = true;
+        }
+
         value = 0;
         if (!TryReadPhys32(imodDriver, address, out uint low, out error))
         {
@@ -3006,7 +3370,8 @@ public sealed partial class MainForm
                 _ = TryGetDeviceProblemCode(devInfo.DevInst, out uint problemCode);
 
                 ulong baseAddress = 0;
-                bool hasBase = TryGetDeviceMemoryBase(devInfo.DevInst, out baseAddress, out string? baseError);
+                bool hasBase = TryGetDeviceMemoryBase(devInfo.DevInst, out baseAddress, out ulong baseLength, out string? baseError);
+                _ = TryGetPciMsixTarget(devInfoSet, ref devInfo, out PciMsixTarget? msix);
 
                 controllers.Add(new ImodControllerInfo
                 {
@@ -3014,8 +3379,10 @@ public sealed partial class MainForm
                     Caption = caption,
                     ProblemCode = problemCode,
                     BaseAddress = baseAddress,
+                    BaseLength = baseLength,
                     HasBase = hasBase,
                     BaseError = baseError ?? string.Empty,
+                    Msix = msix,
                 });
             }
         }
@@ -3094,8 +3461,26 @@ public sealed partial class MainForm
     }
 
     private static bool TryGetDeviceMemoryBase(uint devInst, out ulong baseAddress, out string? error)
+    {
+        return TryGetDeviceMemoryBase(devInst, out baseAddress, out _, out error);
+    }
+
+    private static bool TryGetDeviceMemoryBase(uint devInst, out ulong baseAddress, out ulong baseLength, out string? error)
     {
         baseAddress = 0;
+        baseLength = 0;
+        if (!TryGetDeviceMemoryRanges(devInst, out List<(ulong Base, ulong Length)> ranges, out error))
+        {
+            return false;
+        }
+
+        (baseAddress, baseLength) = ranges.MinBy(static range => range.Base);
+        return true;
+    }
+
+    private static bool TryGetDeviceMemoryRanges(uint devInst, out List<(ulong Base, ulong Length)> ranges, out string? error)
+    {
+        ranges = [];
         error = null;
 
         int cr = CM_Get_First_Log_Conf(out IntPtr logConf, devInst, AllocLogConf);
@@ -3111,8 +3496,6 @@ public sealed partial class MainForm
 
         try
         {
-            bool found = false;
-            ulong minBase = 0;
             foreach (uint resType in new[] { ResTypeMem, ResTypeMemLarge })
             {
                 int resCr = CM_Get_Next_Res_Des(out IntPtr resDes, logConf, resType, IntPtr.Zero, 0);
@@ -3124,13 +3507,9 @@ public sealed partial class MainForm
                         byte[] buffer = new byte[dataSize];
                         if (CM_Get_Res_Des_Data(resDes, buffer, dataSize, 0) == CrSuccess)
                         {
-                            if (TryExtractBaseFromResource(resType, buffer, out ulong candidate))
+                            if (TryExtractBaseFromResource(resType, buffer, out ulong candidate, out ulong candidateLength))
                             {
-                                if (!found || candidate < minBase)
-                                {
-                                    minBase = candidate;
-                                    found = true;
-                                }
+                                ranges.Add((candidate, candidateLength));
                             }
                         }
                     }
@@ -3142,13 +3521,12 @@ public sealed partial class MainForm
                 }
             }
 
-            if (!found)
+            if (ranges.Count == 0)
             {
                 error = "no memory resource found";
                 return false;
             }
 
-            baseAddress = minBase;
             return true;
         }
         finally
@@ -3157,9 +3535,10 @@ public sealed partial class MainForm
         }
     }
 
-    private static bool TryExtractBaseFromResource(uint resType, byte[] data, out ulong baseAddress)
+    private static bool TryExtractBaseFromResource(uint resType, byte[] data, out ulong baseAddress, out ulong baseLength)
     {
         baseAddress = 0;
+        baseLength = 0;
 
         if (resType == ResTypeMem)
         {
@@ -3186,6 +3565,7 @@ public sealed partial class MainForm
             }
 
             baseAddress = candidate;
+            baseLength = mem.MD_Alloc_End >= candidate ? mem.MD_Alloc_End - candidate + 1 : 0;
             return true;
         }
 
@@ -3214,6 +3594,7 @@ public sealed partial class MainForm
             }
 
             baseAddress = candidate;
+            baseLength = mem.MLD_Alloc_End >= candidate ? mem.MLD_Alloc_End - candidate + 1 : 0;
             return true;
         }
 
@@ -3348,15 +3729,395 @@ public sealed partial class MainForm
         return TryWritePhysicalMemory(ctx, address, 4, value, out error);
     }
 
-    private static bool TryWriteImodInterval(ImodDriverContext ctx, ulong address, uint interval, out string? error)
+    // Per-register counterpart of one batch entry: takes the interrupter's IMAN address and
+    // returns the same ImodBatchStatus* code the driver would.
+    private static uint ApplyImodIntervalDiff(ImodDriverContext ctx, ulong imanAddress, uint interval, uint flags, out string? error)
+    {
+        ulong imodAddress = imanAddress + 0x4;
+        interval &= 0xFFFF;
+
+        if (!TryReadPhys32(ctx, imodAddress, out uint currentValue, out error))
+        {
+            return ImodBatchStatusReadFailed;
+        }
+
+        if ((flags & ImodBatchFlagDiff) != 0)
+        {
+            if ((currentValue & 0xFFFF) == interval)
+            {
+                return ImodBatchStatusUnchanged;
+            }
+
+            if (!TryReadPhys32(ctx, imanAddress, out uint imanValue, out error))
+            {
+                return ImodBatchStatusReadFailed;
+            }
+
+            if ((imanValue & 0x2) == 0)
+            {
+                return ImodBatchStatusInactive;
+            }
+        }
+
+        if (!TryWritePhys32(ctx, imodAddress, (currentValue & 0xFFFF0000) | interval, out error))
+        {
+            return ImodBatchStatusWriteFailed;
+        }
+
+        if ((flags & ImodBatchFlagVerify) == 0)
+        {
+            return ImodBatchStatusWritten;
+        }
+
+        if (!TryReadPhys32(ctx, imodAddress, out currentValue, out error))
+        {
+            return ImodBatchStatusVerifyFailed;
+        }
+
+        if ((currentValue & 0xFFFF) != interval)
+        {
+            error = $"read back {ToHex(currentValue & 0xFFFF)} after write";
+            return ImodBatchStatusVerifyFailed;
+        }
+
+        return ImodBatchStatusVerified;
+    }
+
+    // Tallies one ImodBatchStatus* code; returns false for failures.
+    private static bool CountImodStatus(uint status, ref uint written, ref uint skipped, ref uint verified)
+    {
+        switch (status)
+        {
+            case ImodBatchStatusVerified:
+                verified++;
+                written++;
+                return true;
+            case ImodBatchStatusWritten:
+                written++;
+                return true;
+            case ImodBatchStatusUnchanged:
+            case ImodBatchStatusInactive:
+                skipped++;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    private static bool TryOpenImodSession(
+        ImodDriverContext ctx,
+        ulong address,
+        ulong length,
+        out uint sessionId,
+        out string? error)
     {
-        if (!TryReadPhys32(ctx, address, out uint currentValue, out error))
+        sessionId = 0;
+        error = null;
+
+        if (ctx.SessionUnsupported)
+        {
+            error = "driver has no session IOCTL";
+            return false;
+        }
+
+        if (length == 0 || length > ImodSessionMaxLength)
         {
+            error = $"session window {ToHex(length)} is out of range";
             return false;
         }
 
-        uint mergedValue = (currentValue & 0xFFFF0000) | (interval & 0xFFFF);
-        return TryWritePhys32(ctx, address, mergedValue, out error);
+        ImodSessionStruct session = new()
+        {
+            physAddress = address,
+            length = (uint)length,
+        };
+
+        if (!DeviceIoControl(
+                ctx.DriverHandle,
+                IoctlImodOpenSession,
+                ref session,
+                Marshal.SizeOf<ImodSessionStruct>(),
+                ref session,
+                Marshal.SizeOf<ImodSessionStruct>(),
+                out int bytesReturned,
+                IntPtr.Zero))
+        {
+            int lastError = Marshal.GetLastWin32Error();
+            if (lastError == ErrorInvalidFunction)
+            {
+                ctx.SessionUnsupported = true;
+            }
+
+            error = $"failed to open IMOD session via driver: {GetWin32ErrorMessage(lastError)}";
+            return false;
+        }
+
+        if (bytesReturned < Marshal.SizeOf<ImodSessionStruct>() || session.sessionId == 0)
+        {
+            error = "failed to open IMOD session via driver: incomplete ioctl response";
+            return false;
+        }
+
+        sessionId = session.sessionId;
+        return true;
+    }
+
+    private static void TryCloseImodSession(ImodDriverContext ctx, uint sessionId)
+    {
+        ImodSessionStruct session = new()
+        {
+            sessionId = sessionId,
+        };
+
+        _ = DeviceIoControl(
+            ctx.DriverHandle,
+            IoctlImodCloseSession,
+            ref session,
+            Marshal.SizeOf<ImodSessionStruct>(),
+            ref session,
+            Marshal.SizeOf<ImodSessionStruct>(),
+            out _,
+            IntPtr.Zero);
+    }
+
+    private static bool TryReadImodSession32(
+        ImodDriverContext ctx,
+        uint sessionId,
+        uint offset,
+        out uint value,
+        out string? error)
+    {
+        value = 0;
+        error = null;
+        ImodSessionAccessStruct access = new()
+        {
+            sessionId = sessionId,
+            offset = offset,
+            accessSizeInBytes = 4,
+        };
+
+        if (!DeviceIoControl(
+                ctx.DriverHandle,
+                IoctlImodSessionRead,
+                ref access,
+                Marshal.SizeOf<ImodSessionAccessStruct>(),
+                ref access,
+                Marshal.SizeOf<ImodSessionAccessStruct>(),
+                out int bytesReturned,
+                IntPtr.Zero))
+        {
+            error = $"failed to read IMOD session via driver: {GetWin32ErrorMessage(Marshal.GetLastWin32Error())}";
+            return false;
+        }
+
+        if (bytesReturned < Marshal.SizeOf<ImodSessionAccessStruct>())
+        {
+            error = "failed to read IMOD session via driver: incomplete ioctl response";
+            return false;
+        }
+
+        value = unchecked((uint)access.value);
+        return true;
+    }
+
+    private static bool TryApplyImodBatch(
+        ImodDriverContext ctx,
+        ImodControllerInfo controller,
+        uint hcsparamsOffset,
+        uint rtsoff,
+        uint[] intervals,
+        uint flags,
+        out uint[] statuses,
+        out string? error)
+    {
+        statuses = [];
+        error = null;
+
+        if (ctx.BatchFlagsUnsupported)
+        {
+            flags = 0;
+        }
+
+        int headerSize = Marshal.SizeOf<ImodBatchHeader>();
+        int bufferSize = headerSize + (intervals.Length * sizeof(uint));
+        IntPtr buffer = Marshal.AllocHGlobal(bufferSize);
+        try
+        {
+            ImodBatchHeader header = new()
+            {
+                version = ImodBatchVersion,
+                count = (uint)intervals.Length,
+                capabilityAddress = controller.BaseAddress,
+                barLength = controller.BaseLength,
+                hcsparamsOffset = hcsparamsOffset,
+                rtsoffOffset = rtsoff,
+                flags = flags,
+            };
+            Marshal.StructureToPtr(header, buffer, false);
+            for (int i = 0; i < intervals.Length; i++)
+            {
+                Marshal.WriteInt32(buffer, headerSize + (i * sizeof(uint)), unchecked((int)(intervals[i] & 0xFFFF)));
+            }
+
+            if (!DeviceIoControl(
+                    ctx.DriverHandle,
+                    IoctlImodApplyBatch,
+                    buffer,
+                    bufferSize,
+                    buffer,
+                    bufferSize,
+                    out int bytesReturned,
+                    IntPtr.Zero))
+            {
+                int lastError = Marshal.GetLastWin32Error();
+                if (lastError == ErrorInvalidFunction)
+                {
+                    ctx.BatchUnsupported = true;
+                }
+                else if (lastError == ErrorInvalidParameter && flags != 0)
+                {
+                    // Older DTIMOD.sys rejects any batch flags; retry once writing every interrupter.
+                    ctx.BatchFlagsUnsupported = true;
+                    if (TryApplyImodBatch(ctx, controller, hcsparamsOffset, rtsoff, intervals, 0, out statuses, out error))
+                    {
+                        return true;
+                    }
+
+                    ctx.BatchFlagsUnsupported = false;
+                    return false;
+                }
+
+                error = $"failed to apply IMOD batch via driver: {GetWin32ErrorMessage(lastError)}";
+                return false;
+            }
+
+            if (bytesReturned < bufferSize)
+            {
+                error = "failed to apply IMOD batch via driver: incomplete ioctl response";
+                return false;
+            }
+
+            statuses = new uint[intervals.Length];
+            for (int i = 0; i < intervals.Length; i++)
+            {
+                statuses[i] = unchecked((uint)Marshal.ReadInt32(buffer, headerSize + (i * sizeof(uint))));
+            }
+
+            return true;
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(buffer);
+        }
+    }
+
+    private static bool TryQueryXhciTopology(
+        ImodDriverContext ctx,
+        ImodControllerInfo controller,
+        out ImodTopologyHeader header,
+        out ImodTopologySlot[] slots,
+        out ImodTopologyEndpoint[] endpoints,
+        out ImodTopologyWalk? walk,
+        out string? error)
+    {
+        header = default;
+        slots = [];
+        endpoints = [];
+        walk = null;
+        error = null;
+
+        // DTIMOD keeps the walk cached per controller while it stays loaded; the walk record
+        // says how much of this query it could reuse.
+        uint flags = ctx.TopologyWalkUnsupported ? 0 : ImodTopologyFlagWalk;
+        int headerSize = Marshal.SizeOf<ImodTopologyHeader>();
+        int slotSize = Marshal.SizeOf<ImodTopologySlot>();
+        int endpointSize = Marshal.SizeOf<ImodTopologyEndpoint>();
+        int endpointsOffset = headerSize + ((int)ImodTopologySlotCapacity * slotSize);
+        int walkOffset = endpointsOffset + ((int)ImodTopologyEndpointCapacity * endpointSize);
+        int bufferSize = walkOffset + (flags != 0 ? Marshal.SizeOf<ImodTopologyWalk>() : 0);
+        IntPtr buffer = Marshal.AllocHGlobal(bufferSize);
+        try
+        {
+            ImodTopologyHeader request = new()
+            {
+                version = ImodTopologyVersion,
+                flags = flags,
+                capabilityAddress = controller.BaseAddress,
+                barLength = controller.BaseLength,
+                hcsparamsOffset = ImodDefaultHcsparamsOffset,
+                slotCapacity = ImodTopologySlotCapacity,
+                endpointCapacity = ImodTopologyEndpointCapacity,
+            };
+            Marshal.StructureToPtr(request, buffer, false);
+
+            if (!DeviceIoControl(
+                    ctx.DriverHandle,
+                    IoctlImodQueryTopology,
+                    buffer,
+                    bufferSize,
+                    buffer,
+                    bufferSize,
+                    out int bytesReturned,
+                    IntPtr.Zero))
+            {
+                int lastError = Marshal.GetLastWin32Error();
+                if (lastError == ErrorInvalidFunction)
+                {
+                    ctx.TopologyUnsupported = true;
+                }
+                else if (lastError == ErrorInvalidParameter && flags != 0)
+                {
+                    // Older DTIMOD.sys rejects any topology flags; retry once without the walk record.
+                    ctx.TopologyWalkUnsupported = true;
+                    if (TryQueryXhciTopology(ctx, controller, out header, out slots, out endpoints, out walk, out error))
+                    {
+                        return true;
+                    }
+
+                    ctx.TopologyWalkUnsupported = false;
+                    return false;
+                }
+
+                error = $"failed to query xHCI topology via driver: {GetWin32ErrorMessage(lastError)}";
+                return false;
+            }
+
+            if (bytesReturned < bufferSize)
+            {
+                error = "failed to query xHCI topology via driver: incomplete ioctl response";
+                return false;
+            }
+
+            header = Marshal.PtrToStructure<ImodTopologyHeader>(buffer);
+            if (header.slotCount > ImodTopologySlotCapacity || header.endpointCount > ImodTopologyEndpointCapacity)
+            {
+                error = "failed to query xHCI topology via driver: malformed ioctl response";
+                return false;
+            }
+
+            slots = new ImodTopologySlot[header.slotCount];
+            for (int i = 0; i < slots.Length; i++)
+            {
+                slots[i] = Marshal.PtrToStructure<ImodTopologySlot>(buffer + headerSize + (i * slotSize));
+            }
+
+            endpoints = new ImodTopologyEndpoint[header.endpointCount];
+            for (int i = 0; i < endpoints.Length; i++)
+            {
+                endpoints[i] = Marshal.PtrToStructure<ImodTopologyEndpoint>(buffer + endpointsOffset + (i * endpointSize));
+            }
+
+            if (flags != 0)
+            {
+                walk = Marshal.PtrToStructure<ImodTopologyWalk>(buffer + walkOffset);
+            }
+
+            return true;
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(buffer);
+        }
     }
 
     private static bool TryMapPhysicalMemory(ImodDriverContext ctx, ulong address, ulong size, out PhysStruct phys, out string? error)
@@ -3404,9 +4165,21 @@ public sealed partial class MainForm
         uint size,
         out ulong value,
         out string? error)
+    {
+        return TryReadPhysicalMemory(ctx, address, size, out value, out error, out _);
+    }
+
+    private static bool TryReadPhysicalMemory(
+        ImodDriverContext ctx,
+        ulong address,
+        uint size,
+        out ulong value,
+        out string? error,
+        out int lastError)
     {
         value = 0;
         error = null;
+        lastError = 0;
         PhysAccessStruct access = new()
         {
             physAddress = address,
@@ -3424,7 +4197,8 @@ public sealed partial class MainForm
                 out bytesReturned,
                 IntPtr.Zero))
         {
-            error = $"failed to read physical memory via driver: {GetWin32ErrorMessage(Marshal.GetLastWin32Error())}";
+            lastError = Marshal.GetLastWin32Error();
+            error = $"failed to read physical memory via driver: {GetWin32ErrorMessage(lastError)}";
             return false;
         }
 
@@ -3621,6 +4395,28 @@ public sealed partial class MainForm
         }
     }
 
+    // IMODCore.dll is embedded like IMOD.exe and loaded from beside it, so both publish flavours
+    // get it; when the build carried none, the default search next to the GUI runs instead.
+    internal static void RegisterImodCoreResolver()
+    {
+        NativeLibrary.SetDllImportResolver(typeof(MainForm).Assembly, (name, _, _) =>
+        {
+            if (!string.Equals(name, NativeImodCore.LibraryName, StringComparison.OrdinalIgnoreCase))
+            {
+                return IntPtr.Zero;
+            }
+
+            string path = Path.Combine(GetImodDataDirectory(), ImodCoreFileName);
+            if (!TryWriteEmbeddedImodResource("DeviceTweakerCS.IMOD.IMODCore.dll", ".IMOD.IMODCore.dll", path, out string? error))
+            {
+                AppDiagnostics.Write($"IMOD.CORE: {error}");
+                return IntPtr.Zero;
+            }
+
+            return NativeLibrary.TryLoad(path, out IntPtr handle) ? handle : IntPtr.Zero;
+        });
+    }
+
     private static Stream? OpenManifestResourceStreamExactOrSuffix(string exactName, string suffix)
     {
         Assembly asm = typeof(MainForm).Assembly;
@@ -3788,6 +4584,13 @@ public sealed partial class MainForm
         public bool ServiceCreated { get; private set; }
         public bool ServiceStartedByContext { get; private set; }
         public bool InitializedSuccessfully { get; private set; }
+        public bool BatchUnsupported { get; set; }
+        public bool BatchFlagsUnsupported { get; set; }
+        public bool SessionUnsupported { get; set; }
+        public bool Phys64Unsupported { get; set; }
+        public bool TopologyUnsupported { get; set; }
+        public bool TopologyWalkUnsupported { get; set; }
+        public bool MsixUnsupported { get; set; }
         public string DriverPath { get; }
         private readonly Action<string>? _log;
 
@@ -3829,9 +4632,38 @@ public sealed partial class MainForm
 
             DriverHandle = deviceHandle;
             InitializedSuccessfully = true;
+            QueryDriverVersion();
             return true;
         }
 
+        // Presets the *Unsupported flags so an older DTIMOD.sys is never sent an IOCTL it lacks;
+        // the callers already fall back to per-register access or report the feature missing.
+        private void QueryDriverVersion()
+        {
+            uint interfaceVersion = 1;
+            uint ioctlMask = ImodLegacyIoctlMask;
+            if (DeviceIoControl(
+                    DriverHandle,
+                    IoctlImodQueryVersion,
+                    IntPtr.Zero,
+                    0,
+                    out ImodDriverVersionStruct version,
+                    Marshal.SizeOf<ImodDriverVersionStruct>(),
+                    out int bytesReturned,
+                    IntPtr.Zero)
+                && bytesReturned >= Marshal.SizeOf<ImodDriverVersionStruct>())
+            {
+                interfaceVersion = version.interfaceVersion;
+                ioctlMask = version.ioctlMask | ImodLegacyIoctlMask;
+            }
+
+            BatchUnsupported |= (ioctlMask & (1u << 4)) == 0;
+            SessionUnsupported |= (ioctlMask & (1u << 5)) == 0;
+            TopologyUnsupported |= (ioctlMask & (1u << 9)) == 0;
+            MsixUnsupported |= (ioctlMask & (1u << 13)) == 0;
+            _log?.Invoke($"IMOD.DRIVER: interface={interfaceVersion} ioctls=0x{ioctlMask:X4}");
+        }
+
         private bool EnsureImodDriverService(out string? error)
         {
             error = null;
@@ -4181,6 +5013,107 @@ public sealed partial class MainForm
         public ulong value;
     }
 
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodDriverVersionStruct
+    {
+        public uint interfaceVersion;
+        public uint ioctlMask;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodSessionStruct
+    {
+        public ulong physAddress;
+        public uint length;
+        public uint sessionId;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodSessionAccessStruct
+    {
+        public uint sessionId;
+        public uint offset;
+        public uint accessSizeInBytes;
+        public uint reserved;
+        public ulong value;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodBatchHeader
+    {
+        public uint version;
+        public uint count;
+        public ulong capabilityAddress;
+        public ulong barLength;
+        public uint hcsparamsOffset;
+        public uint rtsoffOffset;
+        public uint flags;
+        public uint maxIntrs;
+        public ulong runtimeAddress;
+        public uint written;
+        public uint failed;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodTopologyHeader
+    {
+        public uint version;
+        public uint flags;
+        public ulong capabilityAddress;
+        public ulong barLength;
+        public uint hcsparamsOffset;
+        public uint slotCapacity;
+        public uint endpointCapacity;
+        public uint capLength;
+        public uint maxSlots;
+        public uint maxIntrs;
+        public uint contextSize;
+        public uint slotCount;
+        public uint endpointCount;
+        public uint truncated;
+        public ulong dcbaap;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodTopologySlot
+    {
+        public byte slotId;
+        public byte slotState;
+        public byte rootPort;
+        public byte deviceAddress;
+        public uint routeString;
+        public ushort interrupter;
+        public byte contextEntries;
+        public byte flags;
+        public ushort firstEndpoint;
+        public ushort endpointCount;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodTopologyEndpoint
+    {
+        public byte contextIndex;
+        public byte state;
+        public byte type;
+        public byte flags;
+        public ushort trbInterrupter;
+        public byte trbType;
+        public byte reserved;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodTopologyWalk
+    {
+        public uint slotsScanned;
+        public uint slotsRead;
+        public uint slotsReused;
+        public uint slotsDropped;
+        public uint endpointsRead;
+        public uint maps;
+        public uint reads;
+        public uint reserved;
+    }
+
     [StructLayout(LayoutKind.Sequential)]
     private struct MemDes
     {
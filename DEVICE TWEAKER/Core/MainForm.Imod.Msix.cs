@@ -0,0 +1,307 @@
+using System.Runtime.InteropServices;
+
+namespace DeviceTweakerCS;
+
+public sealed partial class MainForm
+{
+    private const uint ImodMsixVersion = 1;
+    private const uint ImodMsixKindNone = 0;
+    private const uint ImodMsixKindMsi = 1;
+    private const uint ImodMsixStateEnabled = 0x1;
+    private const uint ImodMsixStateFunctionMasked = 0x2;
+    private const byte ImodMsixEntryMasked = 0x01;
+    private const byte ImodMsixEntryRemapped = 0x02;
+    private const byte ImodMsixEntryLogical = 0x04;
+    private const byte ImodMsixEntryLevel = 0x10;
+    private const byte ImodMsixEntryNotApic = 0x20;
+    private const byte ImodMsixEntryResolved = 0x40;
+    private const int ImodMsixVisibleVectors = 8;
+    private static readonly uint IoctlImodQueryMsix =
+        CtlCode(FileDeviceImod, ImodIoctlIndex + 13, MethodBuffered, FileAnyAccess);
+
+    // Where DTIMOD finds the function's config space, and the memory ranges Windows assigned
+    // it; the MSI-X table is only read when its BAR is one of them.
+    private sealed record PciMsixTarget(uint Bus, uint Device, uint Function, IReadOnlyList<(ulong Base, ulong Length)> MemoryRanges);
+
+    private static bool TryGetPciMsixTarget(IntPtr devInfoSet, ref SP_DEVINFO_DATA devInfo, out PciMsixTarget? target)
+    {
+        target = null;
+        if (!TryGetDeviceDwordProperty(devInfoSet, ref devInfo, SpdrpBusNumber, out uint bus)
+            || !TryGetDeviceDwordProperty(devInfoSet, ref devInfo, SpdrpAddress, out uint address)
+            || !TryGetDeviceMemoryRanges(devInfo.DevInst, out List<(ulong Base, ulong Length)> ranges, out _))
+        {
+            return false;
+        }
+
+        // SPDRP_ADDRESS for PCI is (device << 16) | function.
+        target = new PciMsixTarget(bus, address >> 16, address & 0xFFFF, ranges);
+        return true;
+    }
+
+    private static bool TryGetDeviceDwordProperty(IntPtr devInfoSet, ref SP_DEVINFO_DATA devInfo, uint property, out uint value)
+    {
+        value = 0;
+        if (!TryGetDevicePropertyData(devInfoSet, ref devInfo, property, out byte[] data, out uint regType)
+            || regType != RegDword
+            || data.Length < sizeof(uint))
+        {
+            return false;
+        }
+
+        value = BitConverter.ToUInt32(data, 0);
+        return true;
+    }
+
+    // One line for the map label and one line per vector for the tooltip and the log.
+    private bool TryDescribeMsix(
+        ImodDriverContext ctx,
+        PciMsixTarget? target,
+        Func<int, string> vectorLabel,
+        out string line,
+        out string detail)
+    {
+        line = string.Empty;
+        if (target is null)
+        {
+            detail = "unavailable: no PCI bus/device/function";
+            return false;
+        }
+
+        if (ctx.MsixUnsupported)
+        {
+            detail = "unavailable: DTIMOD.sys predates IOCTL_IMOD_QUERY_MSIX";
+            return false;
+        }
+
+        if (!TryQueryMsix(ctx, target, out ImodMsixHeader header, out ImodMsixEntry[] entries, out string? error))
+        {
+            detail = $"unavailable: {error}";
+            return false;
+        }
+
+        string pci = $"pci {target.Bus:X2}:{target.Device:X2}.{target.Function}";
+        if (header.kind == ImodMsixKindNone)
+        {
+            detail = $"{pci}: no MSI or MSI-X capability (line-based interrupt)";
+            return false;
+        }
+
+        string kind = header.kind == ImodMsixKindMsi ? "msi" : "msi-x";
+
+        List<string> state = [];
+        if ((header.state & ImodMsixStateEnabled) == 0)
+        {
+            state.Add("disabled");
+        }
+
+        if ((header.state & ImodMsixStateFunctionMasked) != 0)
+        {
+            state.Add("function masked");
+        }
+
+        string stateText = state.Count == 0 ? string.Empty : $" ({string.Join(", ", state)})";
+        string count = entries.Length == header.tableSize ? $"{entries.Length}" : $"{entries.Length}/{header.tableSize}";
+        IEnumerable<string> visible = entries
+            .Take(ImodMsixVisibleVectors)
+            .Select(entry => $"{vectorLabel(entry.index)}→{FormatMsixTarget(entry)}{((entry.flags & ImodMsixEntryMasked) != 0 ? " masked" : string.Empty)}");
+        line = $"{kind} {count}{stateText}: {string.Join(", ", visible)}"
+            + (entries.Length > ImodMsixVisibleVectors ? $", +{entries.Length - ImodMsixVisibleVectors} more" : string.Empty);
+
+        IEnumerable<string> rows = entries.Select(entry =>
+            $"#{entry.index} {vectorLabel(entry.index)}: vector 0x{entry.vector:X2} {FormatMsixDestination(entry)} → {FormatMsixTarget(entry)}"
+            + ((entry.flags & ImodMsixEntryLevel) != 0 ? ", level" : string.Empty)
+            + ((entry.flags & ImodMsixEntryMasked) != 0 ? ", masked" : string.Empty)
+            + $", addr {ToHex(entry.address)} data {ToHex(entry.data)}");
+        string table = header.kind == ImodMsixKindMsi
+            ? $"{pci} {kind} cap@0x{header.capabilityOffset:X2}"
+            : $"{pci} {kind} cap@0x{header.capabilityOffset:X2} table BAR{header.tableBir}+0x{header.tableOffset:X} ({ToHex(header.barAddress)})";
+        detail = $"{table}{stateText}\r\n{string.Join("\r\n", rows)}";
+        return true;
+    }
+
+    private string FormatMsixTarget(ImodMsixEntry entry)
+    {
+        if ((entry.flags & ImodMsixEntryNotApic) != 0)
+        {
+            return "unset";
+        }
+
+        if ((entry.flags & ImodMsixEntryRemapped) != 0)
+        {
+            return "IOMMU";
+        }
+
+        if ((entry.flags & ImodMsixEntryLogical) != 0)
+        {
+            return $"logical 0x{entry.destination:X}";
+        }
+
+        return (entry.flags & ImodMsixEntryResolved) != 0 && TryGetCpuIndex(entry.group, entry.number, out int lp)
+            ? $"CPU {lp}"
+            : $"APIC {entry.destination}";
+    }
+
+    private static string FormatMsixDestination(ImodMsixEntry entry)
+    {
+        if ((entry.flags & ImodMsixEntryNotApic) != 0)
+        {
+            return "no APIC destination";
+        }
+
+        return (entry.flags & ImodMsixEntryRemapped) != 0
+            ? $"remap handle {entry.destination}"
+            : $"APIC {entry.destination}";
+    }
+
+    private static bool TryQueryMsix(
+        ImodDriverContext ctx,
+        PciMsixTarget target,
+        out ImodMsixHeader header,
+        out ImodMsixEntry[] entries,
+        out string? error)
+    {
+        // The header alone names the BAR holding the table; its length comes from the
+        // device's own resources, never from the config space.
+        if (!TryQueryMsixOnce(ctx, target, 0, 0, out header, out entries, out error))
+        {
+            return false;
+        }
+
+        if (header.kind == ImodMsixKindNone || header.tableSize == 0)
+        {
+            return true;
+        }
+
+        ulong barLength = 0;
+        if (header.kind != ImodMsixKindMsi)
+        {
+            ulong barAddress = header.barAddress;
+            (ulong Base, ulong Length) bar = target.MemoryRanges.FirstOrDefault(range => range.Base == barAddress);
+            if (bar.Length == 0)
+            {
+                error = $"MSI-X BAR {ToHex(barAddress)} is not one of the device's memory resources";
+                return false;
+            }
+
+            barLength = bar.Length;
+        }
+
+        return TryQueryMsixOnce(ctx, target, header.tableSize, barLength, out header, out entries, out error);
+    }
+
+    private static bool TryQueryMsixOnce(
+        ImodDriverContext ctx,
+        PciMsixTarget target,
+        uint entryCapacity,
+        ulong barLength,
+        out ImodMsixHeader header,
+        out ImodMsixEntry[] entries,
+        out string? error)
+    {
+        header = default;
+        entries = [];
+        error = null;
+
+        int headerSize = Marshal.SizeOf<ImodMsixHeader>();
+        int entrySize = Marshal.SizeOf<ImodMsixEntry>();
+        int bufferSize = headerSize + ((int)entryCapacity * entrySize);
+        IntPtr buffer = Marshal.AllocHGlobal(bufferSize);
+        try
+        {
+            ImodMsixHeader request = new()
+            {
+                version = ImodMsixVersion,
+                bus = target.Bus,
+                device = target.Device,
+                function = target.Function,
+                entryCapacity = entryCapacity,
+                barLength = barLength,
+            };
+            Marshal.StructureToPtr(request, buffer, false);
+
+            if (!DeviceIoControl(
+                    ctx.DriverHandle,
+                    IoctlImodQueryMsix,
+                    buffer,
+                    bufferSize,
+                    buffer,
+                    bufferSize,
+                    out int bytesReturned,
+                    IntPtr.Zero))
+            {
+                int lastError = Marshal.GetLastWin32Error();
+                if (lastError == ErrorInvalidFunction)
+                {
+                    ctx.MsixUnsupported = true;
+                }
+
+                error = $"failed to query MSI/MSI-X via driver: {GetWin32ErrorMessage(lastError)}";
+                return false;
+            }
+
+            if (bytesReturned < bufferSize)
+            {
+                error = "failed to query MSI/MSI-X via driver: incomplete ioctl response";
+                return false;
+            }
+
+            header = Marshal.PtrToStructure<ImodMsixHeader>(buffer);
+            if (header.entryCount > entryCapacity)
+            {
+                error = "failed to query MSI/MSI-X via driver: malformed ioctl response";
+                return false;
+            }
+
+            entries = new ImodMsixEntry[header.entryCount];
+            for (int i = 0; i < entries.Length; i++)
+            {
+                entries[i] = Marshal.PtrToStructure<ImodMsixEntry>(buffer + headerSize + (i * entrySize));
+            }
+
+            return true;
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(buffer);
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodMsixHeader
+    {
+        public uint version;
+        public uint flags;
+        public uint bus;
+        public uint device;
+        public uint function;
+        public uint entryCapacity;
+        public ulong barLength;
+        public uint kind;
+        public uint state;
+        public uint capabilityOffset;
+        public uint messageControl;
+        public uint tableSize;
+        public uint tableBir;
+        public uint tableOffset;
+        public uint pbaBir;
+        public uint pbaOffset;
+        public uint entryCount;
+        public ulong barAddress;
+    }
+
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    private struct ImodMsixEntry
+    {
+        public ulong address;
+        public uint data;
+        public uint vectorControl;
+        public uint destination;
+        public ushort index;
+        public ushort group;
+        public byte number;
+        public byte vector;
+        public byte deliveryMode;
+        public byte flags;
+        public uint reserved;
+    }
+}
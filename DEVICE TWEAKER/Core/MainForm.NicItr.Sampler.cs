@@ -0,0 +1,651 @@
+using System.Diagnostics;
+using System.Globalization;
+using System.Net.NetworkInformation;
+
+namespace DeviceTweakerCS;
+
+// Per-queue packet rates for the NIC ITR block and the moderation value that fits them. Mirrors
+// IMOD/Common/imod_nicsampler.c (see IMODBench nic_* for the same model over a simulated register
+// window): Intel queues are measured from the descriptor ring heads in the NIC's own BAR, Realtek
+// adapters from the OS packet counters, since nothing in their BAR counts packets. The recommendation
+// is the shortest interval that keeps a vector inside the AUTO interrupt budget, capped at
+// NicSampleMaxLatencyUs of added latency.
+public sealed partial class MainForm
+{
+    private const uint NicSampleDescriptorSize = 16;
+    private const uint NicSampleHeadMask = 0xFFFF;
+    private const uint NicSampleMaxRingDescriptors = 0x10000;
+    private const int NicSampleMaxQueues = 16;
+    private const uint NicSampleRingLengthOffset = 0x08;
+    private const uint NicSampleRingHeadOffset = 0x10;
+    private const uint NicSampleRingTailOffset = 0x18;
+    private const int NicSampleDurationMs = 2000;
+    private const int NicSampleWindowMs = 100;
+    private const uint NicSampleMaxLatencyUs = 200;
+    private const uint NicSampleInterruptNs = 3000;
+    private const uint NicSamplePacketNs = 300;
+
+    private sealed record NicRingLayout(uint RxBase, uint TxBase, uint QueueStride, int MaxQueues);
+
+    private enum NicItrRecommendationReason
+    {
+        None,
+        Budget,
+        LatencyCeiling,
+        Unsupported,
+    }
+
+    private sealed record NicItrRecommendation(
+        ulong Value,
+        ulong IntervalNs,
+        ulong InterruptsPerSecond,
+        ulong LoadPermille,
+        NicItrRecommendationReason Reason);
+
+    // Rates of the queue feeding each vector; Rate is null for a vector nothing was measured
+    // for ("Other", or queues past the sampled ones), which keeps its current value. The peak is
+    // the busiest NicSampleWindowMs window and is what the recommendation is sized for.
+    private sealed record NicItrSampleVector(
+        NicQueueRate? Rate,
+        ulong PeakPacketsPerSecond,
+        ulong Current,
+        NicItrRecommendation? Recommendation);
+
+    private sealed record NicItrSampleResult(string Source, long ElapsedMs, List<NicItrSampleVector> Vectors);
+
+    // imod_nicsampler.h IMOD_NIC_QUEUE_RATE: heads give packets, a moved tail gives at least one
+    // DPC, and the moderation model gives the expected interrupt rate for the measured packets.
+    private sealed class NicQueueRate
+    {
+        private bool _hasPrevious;
+        private uint _previousRxHead;
+        private uint _previousRxTail;
+        private uint _previousTxHead;
+        private uint _previousTxTail;
+        private ulong _previousPackets;
+        private ulong _previousTimeUs;
+
+        public ulong Samples { get; private set; }
+        public ulong TotalPackets { get; private set; }
+        public ulong TailUpdates { get; private set; }
+        public ulong ElapsedUs { get; private set; }
+        public ulong PacketsPerSecond { get; private set; }
+        public ulong PeakPacketsPerSecond { get; private set; }
+        public ulong AveragePacketsPerSecond { get; private set; }
+        public ulong InterruptsPerSecondMin { get; private set; }
+        public ulong InterruptsPerSecond { get; private set; }
+
+        public void Accumulate(
+            ulong timeUs,
+            (uint Count, uint Head, uint Tail) rx,
+            (uint Count, uint Head, uint Tail) tx,
+            InterruptBudgetModeration moderation,
+            ulong value)
+        {
+            Samples++;
+            if (_hasPrevious && timeUs >= _previousTimeUs)
+            {
+                ulong packets = RingDelta(_previousRxHead, rx.Head, rx.Count) + RingDelta(_previousTxHead, tx.Head, tx.Count);
+                if (rx.Tail != _previousRxTail || tx.Tail != _previousTxTail)
+                {
+                    TailUpdates++;
+                }
+
+                Update(packets, timeUs - _previousTimeUs, moderation, value);
+            }
+
+            _hasPrevious = true;
+            (_previousRxHead, _previousRxTail, _previousTxHead, _previousTxTail) = (rx.Head, rx.Tail, tx.Head, tx.Tail);
+            _previousTimeUs = timeUs;
+        }
+
+        public void AccumulateCounter(ulong timeUs, ulong packets, InterruptBudgetModeration moderation, ulong value)
+        {
+            Samples++;
+
+            // A counter that went backwards was reset with the adapter.
+            if (_hasPrevious && timeUs >= _previousTimeUs && packets >= _previousPackets)
+            {
+                Update(packets - _previousPackets, timeUs - _previousTimeUs, moderation, value);
+            }
+
+            _hasPrevious = true;
+            _previousPackets = packets;
+            _previousTimeUs = timeUs;
+        }
+
+        private static ulong RingDelta(uint previous, uint current, uint count)
+        {
+            return count != 0 ? (current + count - (previous % count)) % count : 0;
+        }
+
+        private void Update(ulong packets, ulong elapsedUs, InterruptBudgetModeration moderation, ulong value)
+        {
+            TotalPackets += packets;
+            ElapsedUs += elapsedUs;
+            PacketsPerSecond = elapsedUs != 0 ? (packets * 1_000_000UL) / elapsedUs : 0;
+            PeakPacketsPerSecond = Math.Max(PeakPacketsPerSecond, PacketsPerSecond);
+            if (ElapsedUs == 0)
+            {
+                return;
+            }
+
+            AveragePacketsPerSecond = (TotalPackets * 1_000_000UL) / ElapsedUs;
+            InterruptsPerSecondMin = (TailUpdates * 1_000_000UL) / ElapsedUs;
+            ulong modelled = GetInterruptBudgetRate(moderation, value, (uint)Math.Min(AveragePacketsPerSecond, uint.MaxValue));
+            InterruptsPerSecond = Math.Max(modelled, InterruptsPerSecondMin);
+        }
+    }
+
+    // igb/igc (82576 ... I226) keep queue n at 0xC000/0xE000 + n * 0x40; e1000e (I219) has one
+    // queue pair at 0x2800/0x3800. Realtek rings live in host memory only.
+    private static NicRingLayout? GetNicRingLayout(NicItrProfile profile)
+    {
+        return profile.Moderation switch
+        {
+            InterruptBudgetModeration.IntelEitr => new NicRingLayout(0xC000, 0xE000, 0x40, NicSampleMaxQueues),
+            InterruptBudgetModeration.IntelItr => new NicRingLayout(0x2800, 0x3800, 0x100, 1),
+            _ => null,
+        };
+    }
+
+    private static ulong GetNicItrMaxUnits(InterruptBudgetModeration moderation)
+    {
+        return moderation switch
+        {
+            InterruptBudgetModeration.XhciImodi => 0xFFFF,
+            InterruptBudgetModeration.IntelEitr => 0x1FFF,
+            InterruptBudgetModeration.IntelItr => 0xFFFF,
+            InterruptBudgetModeration.RealtekIntrMit => 0xF,
+            InterruptBudgetModeration.RealtekIntrMitV2 => 0x7F,
+            _ => 0,
+        };
+    }
+
+    // Current with its interval field replaced; the other fields (Realtek TX halves and frame
+    // thresholds, Intel CNT_WDIS) are kept.
+    private static ulong EncodeNicItrInterval(InterruptBudgetModeration moderation, ulong current, ulong units)
+    {
+        ulong maxUnits = GetNicItrMaxUnits(moderation);
+        units = Math.Min(units, maxUnits);
+        return moderation switch
+        {
+            InterruptBudgetModeration.IntelEitr => (current & ~(0x1FFFUL << 2)) | (units << 2),
+            InterruptBudgetModeration.None => current,
+            _ => (current & ~maxUnits) | units,
+        };
+    }
+
+    private static NicItrRecommendation EvaluateNicItr(InterruptBudgetModeration moderation, ulong value, uint packetsPerSecond)
+    {
+        ulong interrupts = GetInterruptBudgetRate(moderation, value, packetsPerSecond);
+        ulong loadNs = (interrupts * NicSampleInterruptNs) + ((ulong)packetsPerSecond * NicSamplePacketNs);
+        return new NicItrRecommendation(
+            value,
+            GetInterruptBudgetIntervalNs(moderation, value),
+            interrupts,
+            (loadNs + 500_000UL) / 1_000_000UL,
+            NicItrRecommendationReason.None);
+    }
+
+    private static bool NicItrFitsBudget(NicItrRecommendation recommendation)
+    {
+        return recommendation.InterruptsPerSecond <= InterruptBudgetMaxInterrupts
+            && recommendation.LoadPermille <= InterruptBudgetMaxLoadPermille;
+    }
+
+    private static NicItrRecommendation RecommendNicItr(InterruptBudgetModeration moderation, ulong current, uint packetsPerSecond)
+    {
+        ulong maxUnits = GetNicItrMaxUnits(moderation);
+        if (maxUnits == 0)
+        {
+            return EvaluateNicItr(moderation, current, packetsPerSecond) with { Reason = NicItrRecommendationReason.Unsupported };
+        }
+
+        // Every family's interval is linear in its field, so one unit gives the ceiling.
+        ulong unitNs = GetInterruptBudgetIntervalNs(moderation, EncodeNicItrInterval(moderation, 0, 1));
+        ulong ceiling = unitNs != 0 ? Math.Min(maxUnits, (NicSampleMaxLatencyUs * 1000UL) / unitNs) : maxUnits;
+
+        NicItrRecommendation recommendation = EvaluateNicItr(moderation, EncodeNicItrInterval(moderation, current, 0), packetsPerSecond);
+        if (NicItrFitsBudget(recommendation))
+        {
+            return recommendation;
+        }
+
+        recommendation = EvaluateNicItr(moderation, EncodeNicItrInterval(moderation, current, ceiling), packetsPerSecond);
+        if (!NicItrFitsBudget(recommendation))
+        {
+            return recommendation with { Reason = NicItrRecommendationReason.LatencyCeiling };
+        }
+
+        // The rate only falls as the interval grows: 0 misses the budget, ceiling meets it.
+        ulong low = 0;
+        ulong high = ceiling;
+        while (high - low > 1)
+        {
+            ulong middle = low + ((high - low) / 2);
+            if (NicItrFitsBudget(EvaluateNicItr(moderation, EncodeNicItrInterval(moderation, current, middle), packetsPerSecond)))
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle;
+            }
+        }
+
+        return EvaluateNicItr(moderation, EncodeNicItrInterval(moderation, current, high), packetsPerSecond)
+            with { Reason = NicItrRecommendationReason.Budget };
+    }
+
+    private async void SampleNicItrFromBlock(DeviceBlock block)
+    {
+        if (block.NicItrBox is null || block.NicItrStatusLabel is null)
+        {
+            return;
+        }
+
+        NicItrProfile? profile = TryGetNicItrProfile(block.Device.InstanceId);
+        if (profile is null)
+        {
+            return;
+        }
+
+        WriteLog($"UI: SAMPLE NIC ITR button clicked device={block.Device.InstanceId}");
+        if (block.Device.IsTestDevice)
+        {
+            block.NicItrStatusLabel.Text = "current: sample skipped (test)";
+            block.NicItrStatusLabel.ForeColor = _statusInactive;
+            return;
+        }
+
+        int generation = ++block.NicItrOperationGeneration;
+        block.NicItrStatusLabel.Text = $"current: sampling {NicSampleDurationMs / 1000.0:0.#} s...";
+        block.NicItrStatusLabel.ForeColor = _statusInactive;
+        if (block.NicItrSampleButton is not null)
+        {
+            block.NicItrSampleButton.Enabled = false;
+        }
+
+        string instanceId = block.Device.InstanceId;
+        try
+        {
+            (bool ok, NicItrSampleResult? sample, string? error) result = await Task.Run(() =>
+            {
+                bool ok = TrySampleNicItr(instanceId, profile, out NicItrSampleResult? sample, out string? error);
+                return (ok, sample, error);
+            });
+
+            if (IsDisposed
+                || block.NicItrBox.IsDisposed
+                || block.NicItrStatusLabel.IsDisposed
+                || generation != block.NicItrOperationGeneration)
+            {
+                return;
+            }
+
+            if (!result.ok || result.sample is null)
+            {
+                block.NicItrStatusLabel.Text = $"current: {FormatNicItrError(result.error)}";
+                block.NicItrStatusLabel.ForeColor = IsNicItrActionableError(result.error) || IsNicItrDriverLoadError(result.error) ? _statusDanger : _mutedText;
+                SetNicItrTooltip(block, $"{profile.FamilyName}\nsample failed: {result.error}");
+                WriteLog($"NIC.SAMPLE: {instanceId} failed: {result.error}");
+                return;
+            }
+
+            ShowNicItrSample(block, profile, result.sample);
+        }
+        catch (Exception ex)
+        {
+            WriteLog($"NIC.SAMPLE: {instanceId} exception: {ex.Message}");
+            if (IsDisposed
+                || block.NicItrStatusLabel.IsDisposed
+                || generation != block.NicItrOperationGeneration)
+            {
+                return;
+            }
+
+            block.NicItrStatusLabel.Text = "current: sample failed";
+            block.NicItrStatusLabel.ForeColor = _statusDanger;
+            SetNicItrTooltip(block, $"{profile.FamilyName}\nsample failed: {ex.Message}");
+        }
+        finally
+        {
+            if (!IsDisposed && block.NicItrSampleButton is not null && !block.NicItrSampleButton.IsDisposed)
+            {
+                block.NicItrSampleButton.Enabled = true;
+            }
+        }
+    }
+
+    // The recommendation goes into the box for SET to apply; nothing is written here.
+    private void ShowNicItrSample(DeviceBlock block, NicItrProfile profile, NicItrSampleResult sample)
+    {
+        List<ulong> recommended = sample.Vectors.Select(vector => vector.Recommendation?.Value ?? vector.Current).ToList();
+        bool changed = sample.Vectors.Any(vector => vector.Recommendation is not null && vector.Recommendation.Value != vector.Current);
+        block.NicItrSampledRates = sample.Vectors
+            .Select(vector => (uint)Math.Min(vector.Rate?.AveragePacketsPerSecond ?? 0, uint.MaxValue))
+            .ToList();
+        block.NicItrBox!.Text = FormatNicItrValueList(recommended, profile);
+
+        string[] rows = sample.Vectors
+            .Select((vector, index) => FormatNicItrSampleRow(GetNicItrVectorLabel(profile, index), vector, profile))
+            .ToArray();
+        block.NicItrStatusLabel!.Text = changed
+            ? $"current: sampled, recommendation loaded (SET applies)"
+            : $"current: sampled, current values fit";
+        block.NicItrStatusLabel.ForeColor = _statusActive;
+        if (block.NicItrTimeLabel is not null)
+        {
+            block.NicItrTimeLabel.Text = rows.Length > 4
+                ? string.Join(", ", sample.Vectors.Select((vector, index) => $"{GetNicItrVectorLabel(profile, index)} {FormatNicSampleRate(vector.Rate?.AveragePacketsPerSecond)}"))
+                : string.Join(Environment.NewLine, rows);
+            block.NicItrTimeLabel.ForeColor = _mutedText;
+        }
+
+        SetNicItrTooltip(
+            block,
+            $"{profile.FamilyName}\nsampled {sample.ElapsedMs} ms from {sample.Source}; target ≤{NicSampleMaxLatencyUs} µs, "
+            + $"≤{InterruptBudgetMaxInterrupts} irq/s, ≤{InterruptBudgetMaxLoadPermille}‰ CPU per vector\n{string.Join("\n", rows)}");
+        WriteLog($"NIC.SAMPLE: {block.Device.InstanceId} profile=\"{profile.FamilyName}\" source={sample.Source} elapsed={sample.ElapsedMs}ms recommended={FormatNicItrValueList(recommended, profile)}");
+        foreach (string row in rows)
+        {
+            WriteLog($"NIC.SAMPLE: {block.Device.InstanceId} {row}");
+        }
+    }
+
+    private static string FormatNicItrSampleRow(string label, NicItrSampleVector vector, NicItrProfile profile)
+    {
+        if (vector.Rate is null || vector.Recommendation is null)
+        {
+            return $"{label}: not sampled, keeps {FormatNicItrValue(vector.Current, profile)}";
+        }
+
+        NicQueueRate rate = vector.Rate;
+        NicItrRecommendation recommendation = vector.Recommendation;
+        string perInterrupt = rate.InterruptsPerSecond != 0
+            ? (rate.AveragePacketsPerSecond / (double)rate.InterruptsPerSecond).ToString("0.0", CultureInfo.InvariantCulture)
+            : "-";
+        string reason = recommendation.Reason switch
+        {
+            NicItrRecommendationReason.LatencyCeiling => " (latency cap, over budget)",
+            NicItrRecommendationReason.Unsupported => " (no interval field)",
+            _ => string.Empty,
+        };
+        return $"{label}: {FormatNicSampleRate(rate.AveragePacketsPerSecond)} pkt/s (peak {FormatNicSampleRate(vector.PeakPacketsPerSecond)}), "
+            + $"{FormatNicSampleRate(rate.InterruptsPerSecond)} irq/s, {perInterrupt} pkt/irq -> "
+            + $"{FormatNicItrValue(recommendation.Value, profile)} ({recommendation.IntervalNs / 1000.0:0.#} us, "
+            + $"{FormatNicSampleRate(recommendation.InterruptsPerSecond)} irq/s){reason}";
+    }
+
+    private static string FormatNicSampleRate(ulong? value)
+    {
+        return value switch
+        {
+            null => "-",
+            >= 10_000 => $"{value.Value / 1000.0:0}k",
+            >= 1_000 => $"{value.Value / 1000.0:0.0}k",
+            _ => $"{value.Value}",
+        };
+    }
+
+    private bool TrySampleNicItr(
+        string instanceId,
+        NicItrProfile profile,
+        out NicItrSampleResult? sample,
+        out string? error)
+    {
+        sample = null;
+        error = null;
+
+        if (!IsAdministrator())
+        {
+            error = "administrator privileges required";
+            return false;
+        }
+
+        if (!TryGetPciMemoryBaseByInstanceId(instanceId, out ulong baseAddress, out PciMsixTarget? target, out error))
+        {
+            return false;
+        }
+
+        bool persistDriver = ShouldPersistSharedImodDriver();
+        if (!EnsureImodDriverOnDisk(persistDriver, out string driverPath, out error))
+        {
+            return false;
+        }
+
+        if (!IsImodDriverAlreadyAvailable())
+        {
+            error = "driver not loaded (press CHECK)";
+            return false;
+        }
+
+        try
+        {
+            if (!ImodDriverContext.TryInitialize(driverPath, WriteLog, out ImodDriverContext? driverContext, out error))
+            {
+                LogImodDriverLoadDiagnostics(driverPath, error);
+                return false;
+            }
+
+            using ImodDriverContext ctx = driverContext!;
+            List<ulong> current = [];
+            for (int q = 0; q < profile.MaxQueues; q++)
+            {
+                ulong address = baseAddress + profile.BaseOffset + (profile.Stride * (uint)q);
+                if (!TryReadNicRegister(ctx, address, profile.ReadWidth, out ulong raw, out error))
+                {
+                    return false;
+                }
+
+                current.Add(raw & profile.ReadMask);
+            }
+
+            InterruptBudgetModeration moderation = profile.Moderation;
+            NicRingLayout? layout = GetNicRingLayout(profile);
+            int firstQueue = profile.FirstQueueVector;
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            List<NicQueueRate> queues;
+            List<ulong> peaks;
+            string source;
+            if (layout is not null)
+            {
+                ulong barLength = target?.MemoryRanges.FirstOrDefault(range => range.Base == baseAddress).Length ?? 0;
+                if (barLength == 0)
+                {
+                    error = "NIC BAR length unknown";
+                    return false;
+                }
+
+                int queueCount = Math.Clamp(current.Count - firstQueue, 1, layout.MaxQueues);
+                if (!TrySampleNicRings(ctx, baseAddress, barLength, layout, queueCount, moderation, current, firstQueue, stopwatch, out queues, out peaks, out error))
+                {
+                    return false;
+                }
+
+                source = "descriptor rings";
+            }
+            else
+            {
+                if (!TrySampleNicCounters(GetNdisNetCfgInstanceId(instanceId), moderation, current, stopwatch, out NicQueueRate adapter, out error))
+                {
+                    return false;
+                }
+
+                // One adapter-wide rate; each vector is sized as if it carried all of it.
+                queues = Enumerable.Repeat(adapter, current.Count).ToList();
+                peaks = Enumerable.Repeat(adapter.PeakPacketsPerSecond, current.Count).ToList();
+                source = "OS packet counters";
+            }
+
+            List<NicItrSampleVector> vectors = current
+                .Select((value, index) =>
+                {
+                    int queue = layout is null ? index : index - firstQueue;
+                    if (queue < 0 || queue >= queues.Count)
+                    {
+                        return new NicItrSampleVector(null, 0, value, null);
+                    }
+
+                    uint peak = (uint)Math.Min(peaks[queue], uint.MaxValue);
+                    return new NicItrSampleVector(queues[queue], peaks[queue], value, RecommendNicItr(moderation, value, peak));
+                })
+                .ToList();
+            sample = new NicItrSampleResult(source, stopwatch.ElapsedMilliseconds, vectors);
+            return true;
+        }
+        finally
+        {
+            if (!persistDriver && !IsImodDriverSystemPath(driverPath))
+            {
+                DeleteFileIfExists(driverPath, "IMOD.DRIVER");
+            }
+        }
+    }
+
+    // Passes run back to back so a ring cannot lap between two reads of its head. The packet
+    // total of each queue is also taken every NicSampleWindowMs, and the busiest of those windows
+    // is the peak: one pass is far too short to say anything about bursts.
+    private static bool TrySampleNicRings(
+        ImodDriverContext ctx,
+        ulong baseAddress,
+        ulong barLength,
+        NicRingLayout layout,
+        int queueCount,
+        InterruptBudgetModeration moderation,
+        IReadOnlyList<ulong> current,
+        int firstQueue,
+        Stopwatch stopwatch,
+        out List<NicQueueRate> rates,
+        out List<ulong> peaks,
+        out string? error)
+    {
+        error = null;
+        rates = Enumerable.Range(0, queueCount).Select(_ => new NicQueueRate()).ToList();
+        List<NicQueueRate> windows = Enumerable.Range(0, queueCount).Select(_ => new NicQueueRate()).ToList();
+        peaks = [];
+        ulong nextWindowUs = 0;
+        while (true)
+        {
+            ulong timeUs = (ulong)(stopwatch.ElapsedTicks * 1_000_000L / Stopwatch.Frequency);
+            for (int q = 0; q < queueCount; q++)
+            {
+                ulong value = current[Math.Min(firstQueue + q, current.Count - 1)];
+                uint rxOffset = layout.RxBase + (layout.QueueStride * (uint)q);
+                uint txOffset = layout.TxBase + (layout.QueueStride * (uint)q);
+                if (!TryReadNicRing(ctx, baseAddress, barLength, rxOffset, out (uint Count, uint Head, uint Tail) rx, out error)
+                    || !TryReadNicRing(ctx, baseAddress, barLength, txOffset, out (uint Count, uint Head, uint Tail) tx, out error))
+                {
+                    return false;
+                }
+
+                rates[q].Accumulate(timeUs, rx, tx, moderation, value);
+            }
+
+            if (timeUs >= nextWindowUs)
+            {
+                for (int q = 0; q < queueCount; q++)
+                {
+                    ulong value = current[Math.Min(firstQueue + q, current.Count - 1)];
+                    windows[q].AccumulateCounter(timeUs, rates[q].TotalPackets, moderation, value);
+                }
+
+                nextWindowUs = timeUs + (NicSampleWindowMs * 1000UL);
+                if (stopwatch.ElapsedMilliseconds >= NicSampleDurationMs)
+                {
+                    break;
+                }
+            }
+
+            Thread.Yield();
+        }
+
+        peaks = windows.Select(window => window.PeakPacketsPerSecond).ToList();
+        return true;
+    }
+
+    // Length, head and tail of one ring, only ever inside the BAR. A block that reads back as
+    // all ones belongs to a function in reset or D3.
+    private static bool TryReadNicRing(
+        ImodDriverContext ctx,
+        ulong baseAddress,
+        ulong barLength,
+        uint offset,
+        out (uint Count, uint Head, uint Tail) ring,
+        out string? error)
+    {
+        ring = default;
+        if (offset + NicSampleRingTailOffset + sizeof(uint) > barLength)
+        {
+            error = $"ring registers at 0x{offset:X} are outside the {barLength / 1024} KiB BAR";
+            return false;
+        }
+
+        if (!TryReadPhys32(ctx, baseAddress + offset + NicSampleRingLengthOffset, out uint length, out error)
+            || !TryReadPhys32(ctx, baseAddress + offset + NicSampleRingHeadOffset, out uint head, out error)
+            || !TryReadPhys32(ctx, baseAddress + offset + NicSampleRingTailOffset, out uint tail, out error))
+        {
+            return false;
+        }
+
+        if (length == uint.MaxValue)
+        {
+            error = "NIC registers read as all ones (adapter in reset or D3)";
+            return false;
+        }
+
+        uint count = length / NicSampleDescriptorSize;
+        head &= NicSampleHeadMask;
+        tail &= NicSampleHeadMask;
+        if (count == 0)
+        {
+            return true;
+        }
+
+        if (count > NicSampleMaxRingDescriptors || head >= count || tail >= count)
+        {
+            error = $"ring registers at 0x{offset:X} are inconsistent (len {length}, head {head}, tail {tail})";
+            return false;
+        }
+
+        ring = (count, head, tail);
+        return true;
+    }
+
+    private static bool TrySampleNicCounters(
+        string? netCfgInstanceId,
+        InterruptBudgetModeration moderation,
+        IReadOnlyList<ulong> current,
+        Stopwatch stopwatch,
+        out NicQueueRate rate,
+        out string? error)
+    {
+        rate = new NicQueueRate();
+        error = null;
+        NetworkInterface? adapter = string.IsNullOrWhiteSpace(netCfgInstanceId)
+            ? null
+            : NetworkInterface.GetAllNetworkInterfaces()
+                .FirstOrDefault(nic => string.Equals(nic.Id.Trim('{', '}'), netCfgInstanceId, StringComparison.OrdinalIgnoreCase));
+        if (adapter is null)
+        {
+            error = "network interface not found for packet counters";
+            return false;
+        }
+
+        ulong value = current.Count > 0 ? current[0] : 0;
+        while (true)
+        {
+            IPInterfaceStatistics stats = adapter.GetIPStatistics();
+            ulong packets = (ulong)(stats.UnicastPacketsReceived + stats.NonUnicastPacketsReceived
+                + stats.UnicastPacketsSent + stats.NonUnicastPacketsSent);
+            rate.AccumulateCounter((ulong)(stopwatch.ElapsedTicks * 1_000_000L / Stopwatch.Frequency), packets, moderation, value);
+            if (stopwatch.ElapsedMilliseconds >= NicSampleDurationMs)
+            {
+                return true;
+            }
+
+            Thread.Sleep(NicSampleWindowMs);
+        }
+    }
+}
@@ -6,60 +6,76 @@ namespace DeviceTweakerCS;
 
 public sealed partial class MainForm
 {
-    private enum NicItrTimingKind
-    {
-        None,
-        IntelEitr,
-        IntelItr,
-        RealtekIntrMit,
-        RealtekIntrMitV2,
-    }
-
+    // One row of imod_nic.c's profile table. Moderation is the register's IMOD_BUDGET_MODERATION_*
+    // format; FirstQueueVector is 1 when vector 0 is the "Other" (link and mailbox) vector.
     private sealed record NicItrProfile(
         string FamilyName,
-        string VendorId,
-        string[] DeviceIds,
         uint BaseOffset,
         uint Stride,
         int MaxQueues,
         int ReadWidth,
         ulong ReadMask,
         ulong WriteOrBits,
-        NicItrTimingKind TimingKind,
-        string[]? VectorLabels = null);
-
-    private static readonly NicItrProfile[] NicItrProfiles =
-    [
-        new("Intel I225/I226 (EITR)", "8086", ["15F2", "15F3", "0D9F", "5502", "125B", "125C", "125D", "5503"], 0x1680, 0x4, 5, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr, ["Other", "Q0", "Q1", "Q2", "Q3"]),
-        new("Intel I210/I211 (EITR)", "8086", ["1533", "1536", "1537", "1538", "1539", "157B", "157C", "1F40", "1F41", "1F45"], 0x1680, 0x4, 4, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr),
-        new("Intel I350 (EITR)", "8086", ["1521", "1522", "1523", "1524"], 0x1680, 0x4, 8, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr),
-        new("Intel 82580 (EITR)", "8086", ["150E", "150F", "1510", "1511"], 0x1680, 0x4, 10, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr),
-        new("Intel 82576 (EITR)", "8086", ["1516", "1518", "1526"], 0x1680, 0x4, 25, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr),
-        new("Killer E3100 (EITR)", "8086", ["3100", "3101", "3102"], 0x1680, 0x4, 5, 32, 0x00007FFC, 0x80000000, NicItrTimingKind.IntelEitr, ["Other", "Q0", "Q1", "Q2", "Q3"]),
-        new("Intel I219 (ITR)", "8086", ["15B7", "15B8", "15B9", "15D7", "15D8", "15E3", "15BB", "15BC", "15BD", "15BE", "0D4C", "0D4D", "0D4E", "0D4F", "0D53", "0D55", "0D5C", "0D5D", "0D5E", "0D5F", "15FB", "15FC", "1A1E", "1A1F", "550A", "550B", "550C", "550D", "550E", "550F", "0DC5", "0DC6", "0DC7", "0DC8", "1A1C", "1A1D", "15F9", "15FA", "3166", "3167", "3197", "3198", "4DF4", "4B33", "4B34", "4DC2", "4DC3", "54B4", "54B5", "54B6", "54B7", "0126", "153A", "153B", "1559", "155A", "156F", "1570", "15D6"], 0x00C4, 0x0, 1, 32, 0x0000FFFF, 0, NicItrTimingKind.IntelItr),
-        new("Realtek RTL8111/8168", "10EC", ["8168", "8161", "8136", "8167", "8169"], 0x00E2, 0x0, 1, 16, 0xFFFF, 0, NicItrTimingKind.RealtekIntrMit),
-        new("Realtek RTL8125/8126", "10EC", ["8125", "8162", "8126"], 0x0A00, 0x8, 4, 32, 0x7F7F7F7F, 0, NicItrTimingKind.RealtekIntrMitV2),
-        new("Realtek RTL8168KB", "10EC", ["3000"], 0x00E2, 0x0, 1, 16, 0xFFFF, 0, NicItrTimingKind.RealtekIntrMit),
-        new("Killer E2500/E2600", "10EC", ["2600", "2502", "2500"], 0x00E2, 0x0, 1, 16, 0xFFFF, 0, NicItrTimingKind.RealtekIntrMit),
-    ];
+        InterruptBudgetModeration Moderation,
+        int FirstQueueVector);
 
-    private static NicItrProfile? TryGetNicItrProfile(string instanceId)
+    private sealed record NicItrProfileTable(NativeImodCore.NicIndex Index, Dictionary<IntPtr, NicItrProfile> Profiles);
+
+    // IMOD.exe reapplies [nic:] sections from the same table, so it comes from
+    // IMOD/Common/imod_nic.c through IMODCore.dll and adapters are matched through its VID/DID
+    // index. Loaded on first use so a missing IMODCore.dll only disables NIC ITR.
+    private static readonly Lazy<NicItrProfileTable?> NicItrProfiles = new(LoadNicItrProfiles);
+
+    private static NicItrProfileTable? LoadNicItrProfiles()
     {
-        if (!TryGetPciVenDev(instanceId, out string ven, out string dev))
+        try
         {
+            if (NativeImodCore.ImodNicIndexBuild(out NativeImodCore.NicIndex index) != NativeImodCore.ResultSuccess)
+            {
+                return null;
+            }
+
+            Dictionary<IntPtr, NicItrProfile> profiles = [];
+            uint count = NativeImodCore.ImodNicProfileCount();
+            for (uint i = 0; i < count; i++)
+            {
+                IntPtr entry = NativeImodCore.ImodNicProfileAt(i);
+                NativeImodCore.NicProfile native = Marshal.PtrToStructure<NativeImodCore.NicProfile>(entry);
+                profiles[entry] = new NicItrProfile(
+                    Marshal.PtrToStringAnsi(native.Name) ?? string.Empty,
+                    native.BaseOffset,
+                    native.Stride,
+                    (int)native.MaxQueues,
+                    (int)native.Width,
+                    native.ReadMask,
+                    native.WriteOrBits,
+                    (InterruptBudgetModeration)native.Moderation,
+                    (int)native.FirstQueueVector);
+            }
+
+            return new NicItrProfileTable(index, profiles);
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            AppDiagnostics.Write($"NIC.ITR: profile table unavailable ({ex.Message})");
             return null;
         }
+    }
 
-        foreach (NicItrProfile profile in NicItrProfiles)
+    private static NicItrProfile? TryGetNicItrProfile(string instanceId)
+    {
+        if (!TryGetPciVenDev(instanceId, out string ven, out string dev)
+            || NicItrProfiles.Value is not NicItrProfileTable table)
         {
-            if (string.Equals(profile.VendorId, ven, StringComparison.OrdinalIgnoreCase)
-                && profile.DeviceIds.Any(id => string.Equals(id, dev, StringComparison.OrdinalIgnoreCase)))
-            {
-                return profile;
-            }
+            return null;
         }
 
-        return null;
+        NativeImodCore.NicIndex index = table.Index;
+        IntPtr entry = NativeImodCore.ImodNicLookup(
+            ref index,
+            ushort.Parse(ven, NumberStyles.HexNumber, CultureInfo.InvariantCulture),
+            ushort.Parse(dev, NumberStyles.HexNumber, CultureInfo.InvariantCulture));
+        return table.Profiles.GetValueOrDefault(entry);
     }
 
     private async void RefreshNicItrBlock(DeviceBlock block)
@@ -115,10 +131,10 @@ public sealed partial class MainForm
         string instanceId = block.Device.InstanceId;
         try
         {
-            (bool ok, List<ulong> values, string? error) result = await Task.Run(() =>
+            (bool ok, List<ulong> values, string? msixLine, string? msixDetail, string? error) result = await Task.Run(() =>
             {
-                bool ok = TryReadNicItr(instanceId, profile, out List<ulong> values, out string? error);
-                return (ok, values, error);
+                bool ok = TryReadNicItr(instanceId, profile, out List<ulong> values, out string? msixLine, out string? msixDetail, out string? error);
+                return (ok, values, msixLine, msixDetail, error);
             });
 
             if (IsDisposed
@@ -153,13 +169,18 @@ public sealed partial class MainForm
             block.NicItrBox.Text = valueText;
             block.NicItrStatusLabel.Text = summaryText;
             block.NicItrStatusLabel.ForeColor = _statusActive;
+            bool hasMsix = !string.IsNullOrEmpty(result.msixLine);
             if (block.NicItrTimeLabel is not null)
             {
-                block.NicItrTimeLabel.Text = detailText;
+                block.NicItrTimeLabel.Text = hasMsix ? detailText + Environment.NewLine + result.msixLine : detailText;
                 block.NicItrTimeLabel.ForeColor = _mutedText;
             }
-            SetNicItrTooltip(block, $"{profile.FamilyName}\nraw: {valueText}\ntime: {timingText}");
+            SetNicItrTooltip(block, $"{profile.FamilyName}\nraw: {valueText}\ntime: {timingText}{(hasMsix ? $"\n{result.msixLine}" : string.Empty)}");
             WriteLog($"NIC.ITR.READ: {instanceId} profile=\"{profile.FamilyName}\" values={valueText} timing=\"{timingText}\"");
+            if (!string.IsNullOrEmpty(result.msixDetail))
+            {
+                WriteLog($"NIC.MSIX: {instanceId} {FlattenLogText(result.msixDetail)}");
+            }
         }
         catch (Exception ex)
         {
@@ -372,41 +393,26 @@ public sealed partial class MainForm
 
         try
         {
-            ResolveImodPaths(out string? scriptPath);
-            if (string.IsNullOrWhiteSpace(scriptPath))
-            {
-                scriptPath = GetImodStartupPath();
-            }
-
-            bool scriptExists = File.Exists(scriptPath);
-            ImodConfig config = scriptExists ? ParseImodScriptFile(scriptPath) : new ImodConfig();
-            config.HasScript = scriptExists;
+            ResolveImodPaths(out string? existingPath);
+            ImodConfig config = ReadImodStartupConfig(existingPath);
 
             string hwid = GetNicItrPersistenceKey(block.Device.InstanceId);
             config.NicItrEntries.RemoveAll(e => string.Equals(e.Hwid, hwid, StringComparison.OrdinalIgnoreCase));
             config.NicItrEntries.Add(new NicItrConfigEntry
             {
                 Hwid = hwid,
-                FamilyName = profile.FamilyName,
-                BaseOffset = profile.BaseOffset,
-                Stride = profile.Stride,
-                Queues = profile.MaxQueues,
-                Width = profile.ReadWidth,
-                Mask = profile.ReadMask,
-                OrBits = profile.WriteOrBits,
                 Values = values,
             });
 
-            WriteImodScript(config, scriptPath);
-            config.HasScript = true;
+            string configPath = SaveImodStartupConfig(config);
             _imodConfigCache = config;
-            _imodScriptPath = scriptPath;
+            _imodConfigPath = configPath;
             _imodConfigLoaded = true;
 
             block.NicItrStatusLabel.Text = "current: saved for startup";
             block.NicItrStatusLabel.ForeColor = _statusActive;
             UpdateNicItrInputTimeLabel(block);
-            WriteLog($"NIC.ITR.SAVE: {block.Device.InstanceId} key={hwid} profile=\"{profile.FamilyName}\" values={FormatNicItrValueList(values, profile)} path={scriptPath}");
+            WriteLog($"NIC.ITR.SAVE: {block.Device.InstanceId} key={hwid} profile=\"{profile.FamilyName}\" values={FormatNicItrValueList(values, profile)} path={configPath}");
         }
         catch (Exception ex)
         {
@@ -416,9 +422,17 @@ public sealed partial class MainForm
         }
     }
 
-    private bool TryReadNicItr(string instanceId, NicItrProfile profile, out List<ulong> values, out string? error)
+    private bool TryReadNicItr(
+        string instanceId,
+        NicItrProfile profile,
+        out List<ulong> values,
+        out string? msixLine,
+        out string? msixDetail,
+        out string? error)
     {
         values = [];
+        msixLine = null;
+        msixDetail = null;
         error = null;
 
         if (!IsAdministrator())
@@ -427,7 +441,7 @@ public sealed partial class MainForm
             return false;
         }
 
-        if (!TryGetPciMemoryBaseByInstanceId(instanceId, out ulong baseAddress, out error))
+        if (!TryGetPciMemoryBaseByInstanceId(instanceId, out ulong baseAddress, out PciMsixTarget? msix, out error))
         {
             return false;
         }
@@ -464,6 +478,13 @@ public sealed partial class MainForm
                 values.Add(raw & profile.ReadMask);
             }
 
+            // Which CPU each queue vector lands on; a failure here leaves the ITR read intact.
+            if (TryDescribeMsix(ctx, msix, index => GetNicItrVectorLabel(profile, index), out string line, out string detail))
+            {
+                msixLine = line;
+            }
+
+            msixDetail = detail;
             return true;
         }
         finally
@@ -537,7 +558,7 @@ public sealed partial class MainForm
     {
         EnsureImodConfigLoaded();
         return _imodConfigCache is not null
-            && (_imodConfigCache.HasScript || HasCustomImod(_imodConfigCache));
+            && (_imodConfigCache.HasStartupConfig || HasCustomImod(_imodConfigCache));
     }
 
     private static bool TryReadNicRegister(ImodDriverContext ctx, ulong address, int width, out ulong value, out string? error)
@@ -589,8 +610,18 @@ public sealed partial class MainForm
     }
 
     private bool TryGetPciMemoryBaseByInstanceId(string instanceId, out ulong baseAddress, out string? error)
+    {
+        return TryGetPciMemoryBaseByInstanceId(instanceId, out baseAddress, out _, out error);
+    }
+
+    private bool TryGetPciMemoryBaseByInstanceId(
+        string instanceId,
+        out ulong baseAddress,
+        out PciMsixTarget? msix,
+        out string? error)
     {
         baseAddress = 0;
+        msix = null;
         error = null;
         string target = NormalizeInstanceId(instanceId);
 
@@ -633,6 +664,7 @@ public sealed partial class MainForm
                     return false;
                 }
 
+                _ = TryGetPciMsixTarget(devInfoSet, ref devInfo, out msix);
                 return true;
             }
         }
@@ -790,9 +822,9 @@ public sealed partial class MainForm
 
     private static string GetNicItrVectorLabel(NicItrProfile profile, int index)
     {
-        if (profile.VectorLabels is not null && index >= 0 && index < profile.VectorLabels.Length)
+        if (profile.FirstQueueVector != 0)
         {
-            return profile.VectorLabels[index];
+            return index < profile.FirstQueueVector ? "Other" : $"Q{index - profile.FirstQueueVector}";
         }
 
         return profile.MaxQueues == 1 ? "ITR" : $"Q{index}";
@@ -848,7 +880,7 @@ public sealed partial class MainForm
 
     private static string FormatNicItrTimingList(IReadOnlyList<ulong> values, NicItrProfile profile)
     {
-        if (values.Count == 0 || profile.TimingKind == NicItrTimingKind.None)
+        if (values.Count == 0 || profile.Moderation == InterruptBudgetModeration.None)
         {
             return "n/a";
         }
@@ -862,12 +894,12 @@ public sealed partial class MainForm
     private static string FormatNicItrTiming(ulong raw, NicItrProfile profile)
     {
         raw &= profile.ReadMask;
-        return profile.TimingKind switch
+        return profile.Moderation switch
         {
-            NicItrTimingKind.IntelEitr => FormatDurationUs(((raw >> 2) & 0x1FFF) * 2),
-            NicItrTimingKind.IntelItr => FormatDurationNs(raw * 256),
-            NicItrTimingKind.RealtekIntrMit => FormatRealtekIntrMit(raw, timerUnitUs: 125, extended: false),
-            NicItrTimingKind.RealtekIntrMitV2 => FormatRealtekIntrMit(raw, timerUnitUs: 1, extended: true),
+            InterruptBudgetModeration.IntelEitr => FormatDurationUs(((raw >> 2) & 0x1FFF) * 2),
+            InterruptBudgetModeration.IntelItr => FormatDurationNs(raw * 256),
+            InterruptBudgetModeration.RealtekIntrMit => FormatRealtekIntrMit(raw, timerUnitUs: 125, extended: false),
+            InterruptBudgetModeration.RealtekIntrMitV2 => FormatRealtekIntrMit(raw, timerUnitUs: 1, extended: true),
             _ => "n/a",
         };
     }
@@ -880,12 +912,12 @@ public sealed partial class MainForm
             return "Off";
         }
 
-        return profile.TimingKind switch
+        return profile.Moderation switch
         {
-            NicItrTimingKind.RealtekIntrMit => FormatRealtekIntrMitDetail(raw, timerUnitUs: 125, extended: false),
-            NicItrTimingKind.RealtekIntrMitV2 => FormatRealtekIntrMitDetail(raw, timerUnitUs: 1, extended: true),
-            NicItrTimingKind.IntelEitr => "Delay " + FormatNicItrTiming(raw, profile),
-            NicItrTimingKind.IntelItr => "Delay " + FormatNicItrTiming(raw, profile),
+            InterruptBudgetModeration.RealtekIntrMit => FormatRealtekIntrMitDetail(raw, timerUnitUs: 125, extended: false),
+            InterruptBudgetModeration.RealtekIntrMitV2 => FormatRealtekIntrMitDetail(raw, timerUnitUs: 1, extended: true),
+            InterruptBudgetModeration.IntelEitr => "Delay " + FormatNicItrTiming(raw, profile),
+            InterruptBudgetModeration.IntelItr => "Delay " + FormatNicItrTiming(raw, profile),
             _ => FormatNicItrTiming(raw, profile),
         };
     }
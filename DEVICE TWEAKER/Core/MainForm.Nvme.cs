@@ -0,0 +1,477 @@
+using System.Globalization;
+using System.Text.RegularExpressions;
+
+namespace DeviceTweakerCS;
+
+public sealed partial class MainForm
+{
+    private const int NvmeVisibleQueues = 8;
+
+    // "100 x 8", "100us x 8 cd=2,3", "off" or "off cd=1".
+    private static readonly Regex NvmeInputPattern = new(
+        @"^(?:(?<off>off)|(?<time>\d+)\s*(?:us)?\s*[x*]\s*(?<threshold>\d+))(?:\s+cd\s*[=:]\s*(?<cd>\d+(?:\s*,\s*\d+)*))?$",
+        RegexOptions.IgnoreCase | RegexOptions.CultureInvariant);
+
+    private sealed record NvmeCoalescingInput(int TimeUs, int Threshold, List<int> DisabledVectors);
+
+    private static bool IsNvmeController(DeviceInfo device)
+    {
+        return device.Kind == DeviceKind.STOR && Regex.IsMatch(device.Name, "(?i)NVM\\s*Express|NVMe");
+    }
+
+    private async void RefreshNvmeBlock(DeviceBlock block)
+    {
+        if (block.NvmeBox is null || block.NvmeStatusLabel is null)
+        {
+            return;
+        }
+
+        if (block.Device.IsTestDevice)
+        {
+            block.NvmeBox.Text = "off";
+            block.NvmeStatusLabel.Text = "current: test preview";
+            block.NvmeStatusLabel.ForeColor = _statusActive;
+            SetNvmeDetail(block, "queues: test device, no pass-through read", _mutedText);
+            WriteLog($"NVME.IC.TEST: {block.Device.InstanceId} preview only");
+            return;
+        }
+
+        int generation = ++block.NvmeOperationGeneration;
+        block.NvmeStatusLabel.Text = "current: reading...";
+        block.NvmeStatusLabel.ForeColor = _statusInactive;
+        SetNvmeDetail(block, "queues: reading...", _statusInactive);
+
+        string instanceId = block.Device.InstanceId;
+        try
+        {
+            (bool ok, NvmeCoalescingState? state, string? msixLine, string? msixDetail, string? error) result = await Task.Run(() =>
+            {
+                bool ok = TryReadNvmeCoalescing(instanceId, out NvmeCoalescingState? state, out string? error);
+                string? msixLine = null;
+                string? msixDetail = null;
+                if (ok)
+                {
+                    TryDescribeNvmeMsix(instanceId, state!, out msixLine, out msixDetail);
+                }
+
+                return (ok, state, msixLine, msixDetail, error);
+            });
+
+            if (IsDisposed
+                || block.NvmeBox.IsDisposed
+                || block.NvmeStatusLabel.IsDisposed
+                || generation != block.NvmeOperationGeneration)
+            {
+                return;
+            }
+
+            if (!result.ok || result.state is null)
+            {
+                block.NvmeStatusLabel.Text = $"current: {FormatNvmeError(result.error)}";
+                block.NvmeStatusLabel.ForeColor = IsNicItrActionableError(result.error) ? _statusDanger : _mutedText;
+                SetNvmeDetail(block, "queues: unavailable", _statusInactive);
+                SetNvmeTooltip(block, $"NVMe interrupt coalescing\nread failed: {result.error}");
+                WriteLog($"NVME.IC.READ: {instanceId} failed: {result.error}");
+                return;
+            }
+
+            NvmeCoalescingState state = result.state;
+            string inputText = FormatNvmeInput(state.TimeUs, state.Threshold, GetNvmeDisabledVectors(state));
+            string detailText = FormatNvmeQueueDetail(state);
+            bool hasMsix = !string.IsNullOrEmpty(result.msixLine);
+            block.NvmeBox.Text = inputText;
+            block.NvmeStatusLabel.Text = $"current: {NvmeCoalescing.FormatCoalescing(state.TimeUs, state.Threshold)}";
+            block.NvmeStatusLabel.ForeColor = _statusActive;
+            SetNvmeDetail(block, hasMsix ? detailText + Environment.NewLine + result.msixLine : detailText, _mutedText);
+            SetNvmeTooltip(block, $"NVMe interrupt coalescing\n{inputText}\n{detailText}{(hasMsix ? $"\n{result.msixLine}" : string.Empty)}");
+            WriteLog($"NVME.IC.READ: {instanceId} value=\"{inputText}\" {FlattenLogText(detailText)}");
+            if (!string.IsNullOrEmpty(result.msixDetail))
+            {
+                WriteLog($"NVME.MSIX: {instanceId} {FlattenLogText(result.msixDetail)}");
+            }
+        }
+        catch (Exception ex)
+        {
+            WriteLog($"NVME.IC.READ: {instanceId} exception: {ex.Message}");
+            if (IsDisposed
+                || block.NvmeStatusLabel is null
+                || block.NvmeStatusLabel.IsDisposed
+                || generation != block.NvmeOperationGeneration)
+            {
+                return;
+            }
+
+            block.NvmeStatusLabel.Text = "current: read failed";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            SetNvmeDetail(block, "queues: unavailable", _statusInactive);
+            SetNvmeTooltip(block, $"NVMe interrupt coalescing\nread failed: {ex.Message}");
+        }
+    }
+
+    private async void ApplyNvmeFromBlock(DeviceBlock block)
+    {
+        if (block.NvmeBox is null || block.NvmeStatusLabel is null)
+        {
+            return;
+        }
+
+        if (!TryParseNvmeInput(block.NvmeBox.Text ?? string.Empty, out NvmeCoalescingInput input))
+        {
+            block.NvmeStatusLabel.Text = "current: invalid input";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            WriteLog($"NVME.IC.WRITE: {block.Device.InstanceId} invalid input=\"{block.NvmeBox.Text}\"");
+            return;
+        }
+
+        block.NvmeBox.Text = FormatNvmeInput(input.TimeUs, input.Threshold, input.DisabledVectors);
+        if (block.Device.IsTestDevice)
+        {
+            block.NvmeStatusLabel.Text = "current: test preview";
+            block.NvmeStatusLabel.ForeColor = _statusActive;
+            WriteLog($"NVME.IC.TEST.WRITE.SKIP: {block.Device.InstanceId} value=\"{block.NvmeBox.Text}\"");
+            return;
+        }
+
+        if (TryBlockSandboxHardwareWrite("NVMe COALESCING SET"))
+        {
+            return;
+        }
+
+        if (!CreateDeviceTweakerBackup("pre-nvme-coalescing", showDialog: false))
+        {
+            block.NvmeStatusLabel.Text = "current: backup failed";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            WriteLog($"NVME.IC.WRITE: {block.Device.InstanceId} cancelled because automatic backup failed");
+            ShowThemedInfo("NVMe coalescing apply was cancelled because the automatic backup failed.\nNo registry/hardware changes were made.");
+            return;
+        }
+
+        int generation = ++block.NvmeOperationGeneration;
+        block.NvmeStatusLabel.Text = "current: applying...";
+        block.NvmeStatusLabel.ForeColor = _statusInactive;
+        if (block.NvmeApplyButton is not null)
+        {
+            block.NvmeApplyButton.Enabled = false;
+        }
+
+        string instanceId = block.Device.InstanceId;
+        try
+        {
+            NvmeCoalescingApplyResult result = await Task.Run(() => ApplyNvmeCoalescing(instanceId, input));
+            WriteLog(
+                $"NVME.IC.WRITE: {instanceId} value=\"{FormatNvmeInput(input.TimeUs, input.Threshold, input.DisabledVectors)}\" "
+                + $"ok={result.Ok} written={result.Written} rolledBack={result.RolledBack} rollbackFailed={result.RollbackFailed}"
+                + (result.Error is null ? string.Empty : $" error={result.Error}"));
+            if (IsDisposed
+                || block.NvmeStatusLabel.IsDisposed
+                || generation != block.NvmeOperationGeneration)
+            {
+                return;
+            }
+
+            if (!result.Ok)
+            {
+                string rollback = result.RollbackFailed > 0
+                    ? $"rollback failed on {result.RollbackFailed}"
+                    : result.RolledBack > 0 ? "rolled back" : "nothing written";
+                block.NvmeStatusLabel.Text = $"current: {FormatNvmeError(result.Error)} ({rollback})";
+                block.NvmeStatusLabel.ForeColor = _statusDanger;
+                SetNvmeTooltip(block, $"NVMe interrupt coalescing\nwrite failed: {result.Error}\n{rollback}");
+                return;
+            }
+
+            RefreshNvmeBlock(block);
+        }
+        catch (Exception ex)
+        {
+            WriteLog($"NVME.IC.WRITE: {instanceId} exception: {ex.Message}");
+            if (IsDisposed
+                || block.NvmeStatusLabel is null
+                || block.NvmeStatusLabel.IsDisposed
+                || generation != block.NvmeOperationGeneration)
+            {
+                return;
+            }
+
+            block.NvmeStatusLabel.Text = "current: write failed";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            SetNvmeTooltip(block, $"NVMe interrupt coalescing\nwrite failed: {ex.Message}");
+        }
+        finally
+        {
+            if (!IsDisposed && block.NvmeApplyButton is not null && !block.NvmeApplyButton.IsDisposed)
+            {
+                block.NvmeApplyButton.Enabled = true;
+            }
+        }
+    }
+
+    // Coalescing lasts until the controller resets, so SAVE puts it in the IMOD startup script
+    // next to NIC ITR rather than asking the controller to keep it.
+    private void SaveNvmePersistenceFromBlock(DeviceBlock block)
+    {
+        if (block.NvmeBox is null || block.NvmeStatusLabel is null)
+        {
+            return;
+        }
+
+        if (!TryParseNvmeInput(block.NvmeBox.Text ?? string.Empty, out NvmeCoalescingInput input))
+        {
+            block.NvmeStatusLabel.Text = "current: enter \"<us> x <count>\" or \"off\"";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            WriteLog($"NVME.IC.SAVE: {block.Device.InstanceId} invalid input=\"{block.NvmeBox.Text}\"");
+            return;
+        }
+
+        string valueText = FormatNvmeInput(input.TimeUs, input.Threshold, input.DisabledVectors);
+        block.NvmeBox.Text = valueText;
+        if (block.Device.IsTestDevice)
+        {
+            block.NvmeStatusLabel.Text = "current: test preview";
+            block.NvmeStatusLabel.ForeColor = _statusActive;
+            WriteLog($"NVME.IC.TEST.SAVE.SKIP: {block.Device.InstanceId} value=\"{valueText}\"");
+            return;
+        }
+
+        try
+        {
+            ResolveImodPaths(out string? existingPath);
+            ImodConfig config = ReadImodStartupConfig(existingPath);
+
+            string hwid = GetNicItrPersistenceKey(block.Device.InstanceId);
+            config.NvmeEntries.RemoveAll(e => string.Equals(e.Hwid, hwid, StringComparison.OrdinalIgnoreCase));
+            config.NvmeEntries.Add(new NvmeConfigEntry
+            {
+                Hwid = hwid,
+                TimeUs = input.TimeUs,
+                Threshold = input.Threshold,
+                DisabledVectors = input.DisabledVectors,
+            });
+
+            string configPath = SaveImodStartupConfig(config);
+            _imodConfigCache = config;
+            _imodConfigPath = configPath;
+            _imodConfigLoaded = true;
+
+            block.NvmeStatusLabel.Text = "current: saved for startup";
+            block.NvmeStatusLabel.ForeColor = _statusActive;
+            WriteLog($"NVME.IC.SAVE: {block.Device.InstanceId} key={hwid} value=\"{valueText}\" path={configPath}");
+        }
+        catch (Exception ex)
+        {
+            block.NvmeStatusLabel.Text = "current: save failed";
+            block.NvmeStatusLabel.ForeColor = _statusDanger;
+            WriteLog($"NVME.IC.SAVE: {block.Device.InstanceId} failed: {ex.Message}");
+        }
+    }
+
+    private static bool TryReadNvmeCoalescing(string instanceId, out NvmeCoalescingState? state, out string? error)
+    {
+        state = null;
+        if (!IsAdministrator())
+        {
+            error = "administrator privileges required";
+            return false;
+        }
+
+        if (!NvmeInterop.TryOpen(instanceId, out NvmeInterop? controller, out error))
+        {
+            return false;
+        }
+
+        using (controller!)
+        {
+            return NvmeCoalescing.TryRead(controller!, out state, out error);
+        }
+    }
+
+    private static NvmeCoalescingApplyResult ApplyNvmeCoalescing(string instanceId, NvmeCoalescingInput input)
+    {
+        if (!IsAdministrator())
+        {
+            return new NvmeCoalescingApplyResult(false, "administrator privileges required", 0, 0, 0);
+        }
+
+        if (!NvmeInterop.TryOpen(instanceId, out NvmeInterop? controller, out string? error))
+        {
+            return new NvmeCoalescingApplyResult(false, error, 0, 0, 0);
+        }
+
+        using (controller!)
+        {
+            if (!NvmeCoalescing.TryRead(controller!, out NvmeCoalescingState? previous, out error))
+            {
+                return new NvmeCoalescingApplyResult(false, error, 0, 0, 0);
+            }
+
+            return NvmeCoalescing.Apply(controller!, previous!, input.TimeUs, input.Threshold, input.DisabledVectors);
+        }
+    }
+
+    // The MSI-X destinations need DTIMOD.sys; it is only used when something already loaded
+    // it (NIC CHECK, IMOD apply), so reading coalescing never loads a driver on its own.
+    private void TryDescribeNvmeMsix(string instanceId, NvmeCoalescingState state, out string? line, out string? detail)
+    {
+        line = null;
+        detail = null;
+        if (!IsImodDriverAlreadyAvailable()
+            || !TryGetPciMemoryBaseByInstanceId(instanceId, out _, out PciMsixTarget? msix, out _))
+        {
+            return;
+        }
+
+        bool persistDriver = ShouldPersistSharedImodDriver();
+        if (!EnsureImodDriverOnDisk(persistDriver, out string driverPath, out _))
+        {
+            return;
+        }
+
+        try
+        {
+            if (!ImodDriverContext.TryInitialize(driverPath, WriteLog, out ImodDriverContext? driverContext, out _))
+            {
+                return;
+            }
+
+            using ImodDriverContext ctx = driverContext!;
+            if (TryDescribeMsix(ctx, msix, index => FormatNvmeVectorQueues(index, state), out string msixLine, out string msixDetail))
+            {
+                line = msixLine;
+            }
+
+            detail = msixDetail;
+        }
+        finally
+        {
+            if (!persistDriver && !IsImodDriverSystemPath(driverPath))
+            {
+                DeleteFileIfExists(driverPath, "IMOD.DRIVER");
+            }
+        }
+    }
+
+    private static bool TryParseNvmeInput(string text, out NvmeCoalescingInput input)
+    {
+        input = new NvmeCoalescingInput(0, 1, []);
+        Match match = NvmeInputPattern.Match(text.Trim());
+        if (!match.Success)
+        {
+            return false;
+        }
+
+        int timeUs = 0;
+        int threshold = 1;
+        uint cdw11 = 0;
+        if (!match.Groups["off"].Success
+            && (!int.TryParse(match.Groups["time"].Value, NumberStyles.None, CultureInfo.InvariantCulture, out timeUs)
+                || !int.TryParse(match.Groups["threshold"].Value, NumberStyles.None, CultureInfo.InvariantCulture, out threshold)
+                || !NvmeCoalescing.TryEncodeCoalescing(timeUs, threshold, out cdw11)))
+        {
+            return false;
+        }
+
+        List<int> disabled = [];
+        if (match.Groups["cd"].Success)
+        {
+            foreach (string part in match.Groups["cd"].Value.Split(',', StringSplitOptions.TrimEntries))
+            {
+                if (!int.TryParse(part, NumberStyles.None, CultureInfo.InvariantCulture, out int vector)
+                    || vector < 1
+                    || vector >= NvmeCoalescing.MaxVectors)
+                {
+                    return false;
+                }
+
+                if (!disabled.Contains(vector))
+                {
+                    disabled.Add(vector);
+                }
+            }
+        }
+
+        disabled.Sort();
+        input = new NvmeCoalescingInput(NvmeCoalescing.DecodeCoalescing(cdw11).TimeUs, threshold, disabled);
+        return true;
+    }
+
+    private static string FormatNvmeInput(int timeUs, int threshold, IReadOnlyCollection<int> disabledVectors)
+    {
+        string coalescing = timeUs == 0 && threshold <= 1 ? "off" : $"{timeUs} x {threshold}";
+        return disabledVectors.Count == 0 ? coalescing : $"{coalescing} cd={string.Join(',', disabledVectors)}";
+    }
+
+    private static List<int> GetNvmeDisabledVectors(NvmeCoalescingState state)
+    {
+        return Enumerable.Range(1, Math.Max(0, state.Messages - 1)).Where(v => state.CoalescingDisable[v]).ToList();
+    }
+
+    // Windows reports no queue-to-vector list; this is StorNVMe's layout over the vectors the
+    // controller answered for.
+    private static string FormatNvmeQueueDetail(NvmeCoalescingState state)
+    {
+        IEnumerable<string> visible = Enumerable.Range(1, Math.Min(state.CompletionQueues, NvmeVisibleQueues))
+            .Select(q => $"Q{q}→v{NvmeCoalescing.QueueVector(q, state.Messages)}");
+        string more = state.CompletionQueues > NvmeVisibleQueues ? $", +{state.CompletionQueues - NvmeVisibleQueues} more" : string.Empty;
+        return $"queues: {state.SubmissionQueues} sq / {state.CompletionQueues} cq, vectors: {state.Messages}{Environment.NewLine}"
+            + $"map: {string.Join(", ", visible)}{more}";
+    }
+
+    private static string FormatNvmeVectorQueues(int vector, NvmeCoalescingState state)
+    {
+        List<string> queues = vector == 0 ? ["A"] : [];
+        for (int queue = 1; queue <= state.CompletionQueues; queue++)
+        {
+            if (NvmeCoalescing.QueueVector(queue, state.Messages) == vector)
+            {
+                queues.Add($"Q{queue}");
+            }
+        }
+
+        return queues.Count == 0 ? $"v{vector}" : string.Join('+', queues);
+    }
+
+    private static string FormatNvmeError(string? error)
+    {
+        if (string.IsNullOrWhiteSpace(error))
+        {
+            return "unavailable";
+        }
+
+        return IsNicItrActionableError(error) ? "admin required" : error;
+    }
+
+    private void SetNvmeDetail(DeviceBlock block, string text, Color color)
+    {
+        if (block.NvmeDetailLabel is null || block.NvmeDetailLabel.IsDisposed)
+        {
+            return;
+        }
+
+        block.NvmeDetailLabel.Text = text;
+        block.NvmeDetailLabel.ForeColor = color;
+    }
+
+    private void SetNvmeTooltip(DeviceBlock block, string text)
+    {
+        try
+        {
+            if (block.NvmeStatusLabel is not null)
+            {
+                _copyToolTip.SetToolTip(block.NvmeStatusLabel, text);
+            }
+
+            if (block.NvmeBox is not null)
+            {
+                _copyToolTip.SetToolTip(block.NvmeBox, text);
+            }
+
+            if (block.NvmeDetailLabel is not null)
+            {
+                _copyToolTip.SetToolTip(block.NvmeDetailLabel, text);
+            }
+        }
+        catch
+        {
+        }
+    }
+}
@@ -34,6 +34,7 @@ static class Program
             }
         };
 
+        MainForm.RegisterImodCoreResolver();
         Application.Run(new MainForm());
     }
 
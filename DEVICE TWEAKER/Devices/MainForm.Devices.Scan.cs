@@ -1,7 +1,5 @@
 ﻿using Microsoft.Win32;
-using System.Diagnostics;
 using System.Management;
-using System.Text.Json;
 using System.Text.RegularExpressions;
 
 namespace DeviceTweakerCS;
@@ -106,7 +104,7 @@ public sealed partial class MainForm
                 object? val = ck?.GetValue("*RssBaseProcNumber");
                 if (val is int i)
                 {
-                    return i;
+                    return MapNdisRssProcessor(ck?.GetValue("*RssBaseProcGroup"), i);
                 }
             }
             catch
@@ -120,7 +118,7 @@ public sealed partial class MainForm
             object? val = ek?.GetValue("*RssBaseProcNumber");
             if (val is int i)
             {
-                return i;
+                return MapNdisRssProcessor(ek?.GetValue("*RssBaseProcGroup"), i);
             }
         }
         catch
@@ -130,6 +128,14 @@ public sealed partial class MainForm
         return null;
     }
 
+    // NDIS keywords name a processor by group and group-relative number; the
+    // UI and AUTO work with the system-wide LP index.
+    private int MapNdisRssProcessor(object? rawGroup, int number)
+    {
+        int group = TryParseRegistryInt(rawGroup, out int parsed) ? parsed : 0;
+        return TryGetCpuIndex(group, number, out int lp) ? lp : number;
+    }
+
     private int? GetNdisRssQueues(string instanceId)
     {
         string enumPath = $@"SYSTEM\CurrentControlSet\Enum\{instanceId}";
@@ -238,166 +244,12 @@ public sealed partial class MainForm
         return state;
     }
 
+    // One in-process capture per refresh serves every adapter; _ndisRssRuntimeSnapshot is
+    // dropped with _ndisRssRuntimeCache.
     private NdisRssRuntimeState ReadNdisRssRuntimeState(string instanceId)
     {
-        string? netCfgInstanceId = GetNdisNetCfgInstanceId(instanceId);
-        string guid = EscapePowerShellSingleQuoted(netCfgInstanceId ?? string.Empty);
-        string pnp = EscapePowerShellSingleQuoted(instanceId);
-        string script =
-            "$ErrorActionPreference='SilentlyContinue';" +
-            $"$guid='{guid}';$pnp='{pnp}';" +
-            "$adapters=@(Get-NetAdapter -IncludeHidden -ErrorAction SilentlyContinue);" +
-            "$adapter=$null;" +
-            "if($guid){$adapter=$adapters|Where-Object{$_.InterfaceGuid -and ($_.InterfaceGuid.ToString() -ieq $guid)}|Select-Object -First 1};" +
-            "if(-not $adapter -and $pnp){$adapter=$adapters|Where-Object{($_.PnPDeviceID -as [string]) -ieq $pnp}|Select-Object -First 1};" +
-            "if(-not $adapter){[pscustomobject]@{AdapterFound=$false;RssFound=$false;Error='adapter-not-found'}|ConvertTo-Json -Compress;exit};" +
-            "$rss=Get-NetAdapterRss -Name $adapter.Name -ErrorAction SilentlyContinue;" +
-            "if(-not $rss){[pscustomobject]@{AdapterFound=$true;RssFound=$false;AdapterName=$adapter.Name;InterfaceDescription=$adapter.InterfaceDescription;Error='rss-not-found'}|ConvertTo-Json -Compress;exit};" +
-            "[pscustomobject]@{AdapterFound=$true;RssFound=$true;AdapterName=$adapter.Name;InterfaceDescription=$adapter.InterfaceDescription;Enabled=$rss.Enabled;BaseProcessorGroup=$rss.BaseProcessorGroup;BaseProcessorNumber=$rss.BaseProcessorNumber;MaxProcessorGroup=$rss.MaxProcessorGroup;MaxProcessorNumber=$rss.MaxProcessorNumber;MaxProcessors=$rss.MaxProcessors;NumberOfReceiveQueues=$rss.NumberOfReceiveQueues;Profile=$rss.Profile;Error=''}|ConvertTo-Json -Compress";
-
-        try
-        {
-            using Process process = new();
-            process.StartInfo = new ProcessStartInfo
-            {
-                FileName = "powershell.exe",
-                UseShellExecute = false,
-                CreateNoWindow = true,
-                RedirectStandardOutput = true,
-                RedirectStandardError = true,
-            };
-            process.StartInfo.ArgumentList.Add("-NoProfile");
-            process.StartInfo.ArgumentList.Add("-ExecutionPolicy");
-            process.StartInfo.ArgumentList.Add("Bypass");
-            process.StartInfo.ArgumentList.Add("-Command");
-            process.StartInfo.ArgumentList.Add(script);
-
-            process.Start();
-            string output = process.StandardOutput.ReadToEnd();
-            string error = process.StandardError.ReadToEnd();
-            if (!process.WaitForExit(3500))
-            {
-                try
-                {
-                    process.Kill(entireProcessTree: true);
-                }
-                catch
-                {
-                }
-
-                return EmptyNdisRssRuntimeState("powershell-timeout");
-            }
-
-            string json = ExtractJsonObject(output);
-            if (string.IsNullOrWhiteSpace(json))
-            {
-                return EmptyNdisRssRuntimeState(string.IsNullOrWhiteSpace(error) ? "empty-output" : error.Trim());
-            }
-
-            using JsonDocument doc = JsonDocument.Parse(json);
-            JsonElement root = doc.RootElement;
-            return new NdisRssRuntimeState(
-                AdapterFound: GetJsonBool(root, "AdapterFound") == true,
-                RssFound: GetJsonBool(root, "RssFound") == true,
-                Enabled: GetJsonBool(root, "Enabled"),
-                BaseProcessorGroup: GetJsonInt(root, "BaseProcessorGroup"),
-                BaseProcessorNumber: GetJsonInt(root, "BaseProcessorNumber"),
-                MaxProcessorGroup: GetJsonInt(root, "MaxProcessorGroup"),
-                MaxProcessorNumber: GetJsonInt(root, "MaxProcessorNumber"),
-                MaxProcessors: GetJsonInt(root, "MaxProcessors"),
-                NumberOfReceiveQueues: GetJsonInt(root, "NumberOfReceiveQueues"),
-                AdapterName: GetJsonString(root, "AdapterName"),
-                InterfaceDescription: GetJsonString(root, "InterfaceDescription"),
-                Profile: GetJsonString(root, "Profile"),
-                Error: GetJsonString(root, "Error"));
-        }
-        catch (Exception ex)
-        {
-            return EmptyNdisRssRuntimeState(ex.Message);
-        }
-    }
-
-    private static NdisRssRuntimeState EmptyNdisRssRuntimeState(string error)
-    {
-        return new NdisRssRuntimeState(
-            AdapterFound: false,
-            RssFound: false,
-            Enabled: null,
-            BaseProcessorGroup: null,
-            BaseProcessorNumber: null,
-            MaxProcessorGroup: null,
-            MaxProcessorNumber: null,
-            MaxProcessors: null,
-            NumberOfReceiveQueues: null,
-            AdapterName: string.Empty,
-            InterfaceDescription: string.Empty,
-            Profile: string.Empty,
-            Error: error);
-    }
-
-    private static string EscapePowerShellSingleQuoted(string value)
-    {
-        return value.Replace("'", "''");
-    }
-
-    private static string ExtractJsonObject(string output)
-    {
-        if (string.IsNullOrWhiteSpace(output))
-        {
-            return string.Empty;
-        }
-
-        int start = output.IndexOf('{');
-        int end = output.LastIndexOf('}');
-        return start >= 0 && end >= start ? output[start..(end + 1)] : string.Empty;
-    }
-
-    private static string GetJsonString(JsonElement root, string propertyName)
-    {
-        if (!root.TryGetProperty(propertyName, out JsonElement value) || value.ValueKind == JsonValueKind.Null)
-        {
-            return string.Empty;
-        }
-
-        return value.ValueKind == JsonValueKind.String
-            ? value.GetString() ?? string.Empty
-            : value.ToString();
-    }
-
-    private static int? GetJsonInt(JsonElement root, string propertyName)
-    {
-        if (!root.TryGetProperty(propertyName, out JsonElement value) || value.ValueKind == JsonValueKind.Null)
-        {
-            return null;
-        }
-
-        if (value.ValueKind == JsonValueKind.Number && value.TryGetInt32(out int intValue))
-        {
-            return intValue;
-        }
-
-        if (value.ValueKind == JsonValueKind.String && int.TryParse(value.GetString(), out int parsed))
-        {
-            return parsed;
-        }
-
-        return null;
-    }
-
-    private static bool? GetJsonBool(JsonElement root, string propertyName)
-    {
-        if (!root.TryGetProperty(propertyName, out JsonElement value) || value.ValueKind == JsonValueKind.Null)
-        {
-            return null;
-        }
-
-        return value.ValueKind switch
-        {
-            JsonValueKind.True => true,
-            JsonValueKind.False => false,
-            JsonValueKind.String when bool.TryParse(value.GetString(), out bool parsed) => parsed,
-            _ => null,
-        };
+        _ndisRssRuntimeSnapshot ??= NdisRssRuntimeSnapshot.Capture();
+        return _ndisRssRuntimeSnapshot.Find(GetNdisNetCfgInstanceId(instanceId), instanceId);
     }
 
     private void SetNdisBaseCore(
@@ -422,8 +274,9 @@ public sealed partial class MainForm
                     throw new InvalidOperationException("NDIS class key could not be opened for writing");
                 }
 
-                ck.SetValue("*RssBaseProcNumber", baseCore, RegistryValueKind.DWord);
-                WriteLog($"RSS.SET: {instanceId} -> *RssBaseProcNumber={baseCore} (class key)");
+                (int baseGroup, int baseNumber) = GetCpuGroupNumber(baseCore);
+                ck.SetValue("*RssBaseProcNumber", baseNumber, RegistryValueKind.DWord);
+                WriteLog($"RSS.SET: {instanceId} -> *RssBaseProcNumber={baseNumber} group={baseGroup} cpu={baseCore} (class key)");
             }
             catch (Exception ex)
             {
@@ -494,6 +347,8 @@ public sealed partial class MainForm
         }
 
         int maxCore = Math.Max(baseCore, baseCore + queues - 1);
+        (int baseGroup, int baseNumber) = GetCpuGroupNumber(baseCore);
+        (int maxGroup, int maxNumber) = GetCpuGroupNumber(maxCore);
         string? ckPath = GetClassKeyForDevice(instanceId);
         if (string.IsNullOrWhiteSpace(ckPath))
         {
@@ -511,16 +366,17 @@ public sealed partial class MainForm
                 return;
             }
 
-            ck.SetValue("*RssBaseProcGroup", 0, RegistryValueKind.DWord);
+            // The range runs from base to max in system order and may cross a
+            // group boundary; NDIS walks it the same way.
+            ck.SetValue("*RssBaseProcGroup", baseGroup, RegistryValueKind.DWord);
             ck.SetValue("*MaxRssProcessors", queues, RegistryValueKind.DWord);
-            ck.SetValue("*RSSMaxProcGroup", 0, RegistryValueKind.DWord);
-            ck.SetValue("*RssMaxProcNumber", maxCore, RegistryValueKind.DWord);
+            ck.SetValue("*RSSMaxProcGroup", maxGroup, RegistryValueKind.DWord);
+            ck.SetValue("*RssMaxProcNumber", maxNumber, RegistryValueKind.DWord);
             // Do not force NUMA node 0. When the keyword is absent, NDIS can
             // select the node closest to the adapter according to ACPI. This
-            // preserves the existing group-0 RSS policy without breaking
-            // multi-node systems.
+            // keeps multi-node systems on their local node.
             ck.DeleteValue("*NumaNodeId", throwOnMissingValue: false);
-            WriteLog($"RSS.EXTRA.SET: {instanceId} group=0 maxProcessors={queues} maxProc={maxCore} numa=automatic");
+            WriteLog($"RSS.EXTRA.SET: {instanceId} base={baseGroup}:{baseNumber} maxProcessors={queues} max={maxGroup}:{maxNumber} cpus={baseCore}-{maxCore} numa=automatic");
         }
         catch (Exception ex)
         {
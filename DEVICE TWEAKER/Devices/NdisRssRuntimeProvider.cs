@@ -0,0 +1,117 @@
+using System.Management;
+
+namespace DeviceTweakerCS;
+
+/// <summary>
+/// Active RSS state of every adapter, read in-process from root\StandardCimv2: the same
+/// MSFT_NetAdapter / MSFT_NetAdapterRssSettingData instances Get-NetAdapter and
+/// Get-NetAdapterRss return. One capture per device refresh covers all adapters.
+/// </summary>
+internal sealed class NdisRssRuntimeSnapshot
+{
+    private const string Scope = @"root\StandardCimv2";
+
+    private readonly List<IReadOnlyDictionary<string, object?>> _adapters = [];
+    private readonly Dictionary<string, IReadOnlyDictionary<string, object?>> _rssByName = new(StringComparer.OrdinalIgnoreCase);
+    private string _error = string.Empty;
+
+    private NdisRssRuntimeSnapshot()
+    {
+    }
+
+    public static NdisRssRuntimeSnapshot Capture()
+    {
+        NdisRssRuntimeSnapshot snapshot = new();
+        try
+        {
+            // Without IncludeHidden the provider leaves out hidden adapters, as Get-NetAdapter does.
+            ManagementNamedValueCollection context = new();
+            context.Add("IncludeHidden", true);
+            System.Management.EnumerationOptions options = new() { Context = context, ReturnImmediately = false };
+
+            using (ManagementObjectSearcher searcher = new(
+                Scope,
+                "SELECT Name, InterfaceDescription, InterfaceGuid, PnPDeviceID FROM MSFT_NetAdapter",
+                options))
+            {
+                foreach (ManagementBaseObject mo in searcher.Get())
+                {
+                    using (mo)
+                    {
+                        snapshot._adapters.Add(ReadProperties(mo));
+                    }
+                }
+            }
+
+            using (ManagementObjectSearcher searcher = new(Scope, "SELECT * FROM MSFT_NetAdapterRssSettingData", options))
+            {
+                foreach (ManagementBaseObject mo in searcher.Get())
+                {
+                    using (mo)
+                    {
+                        IReadOnlyDictionary<string, object?> rss = ReadProperties(mo);
+                        if (rss.GetValueOrDefault("Name") is string name && !string.IsNullOrWhiteSpace(name))
+                        {
+                            snapshot._rssByName[name] = rss;
+                        }
+                    }
+                }
+            }
+        }
+        catch (Exception ex)
+        {
+            snapshot._error = ex.Message;
+        }
+
+        return snapshot;
+    }
+
+    public NdisRssRuntimeState Find(string? interfaceGuid, string instanceId)
+    {
+        if (!string.IsNullOrWhiteSpace(_error))
+        {
+            return NdisRssStateParser.Empty(_error);
+        }
+
+        IReadOnlyDictionary<string, object?>? adapter = null;
+        if (!string.IsNullOrWhiteSpace(interfaceGuid))
+        {
+            adapter = _adapters.FirstOrDefault(a => string.Equals(
+                (a.GetValueOrDefault("InterfaceGuid") as string)?.Trim('{', '}'),
+                interfaceGuid.Trim('{', '}'),
+                StringComparison.OrdinalIgnoreCase));
+        }
+
+        adapter ??= _adapters.FirstOrDefault(a => string.Equals(
+            a.GetValueOrDefault("PnPDeviceID") as string,
+            instanceId,
+            StringComparison.OrdinalIgnoreCase));
+        if (adapter is null)
+        {
+            return NdisRssStateParser.Empty("adapter-not-found");
+        }
+
+        IReadOnlyDictionary<string, object?>? rss = adapter.GetValueOrDefault("Name") is string name
+            ? _rssByName.GetValueOrDefault(name)
+            : null;
+        return NdisRssStateParser.Parse(adapter, rss);
+    }
+
+    // Embedded instances (IndirectionTable entries) become nested bags for the parser.
+    private static IReadOnlyDictionary<string, object?> ReadProperties(ManagementBaseObject mo)
+    {
+        Dictionary<string, object?> bag = new(StringComparer.OrdinalIgnoreCase);
+        foreach (PropertyData property in mo.Properties)
+        {
+            bag[property.Name] = property.Value switch
+            {
+                ManagementBaseObject[] items => items.Select(ReadProperties).ToArray(),
+                ManagementBaseObject item => ReadProperties(item),
+                object value => value,
+                null => null,
+            };
+        }
+
+        return bag;
+    }
+}
@@ -725,7 +725,8 @@ public sealed partial class MainForm
             ? Math.Min(nicInputDesiredWidth, Math.Max(nicInputMinWidth, nicInlineMaxWidth))
             : Math.Min(nicInputDesiredWidth, Math.Max(nicInputMinWidth, nicInputAvailableWidth));
         int nicStatusWidth = Math.Max(UiScale(120), nicInputAvailableWidth);
-        int nicDetailRows = nicItrProfile is { MaxQueues: > 1 and <= 4 } ? nicItrProfile.MaxQueues : 2;
+        // One row per queue (or two for a summary), plus the MSI/MSI-X map line.
+        int nicDetailRows = (nicItrProfile is { MaxQueues: > 1 and <= 4 } ? nicItrProfile.MaxQueues : 2) + 1;
         int nicDetailHeight = Math.Max(UiScale(42), UiScale((nicDetailRows * 17) + 8));
         Label lblNicItr = new()
         {
@@ -797,8 +798,25 @@ public sealed partial class MainForm
         btnNicItrCheck.MouseEnter += (_, _) => SetTopButtonHoverStyle(btnNicItrCheck);
         btnNicItrCheck.MouseLeave += (_, _) => SetTopButtonBaseStyle(btnNicItrCheck);
 
-        // Recalc inline layout to fit SET+SAVE+CHECK on one row when possible.
-        int nicButtonsRowWidth = nicSetButtonWidth + nicButtonGap + nicSaveButtonWidth + nicButtonGap + nicCheckButtonWidth;
+        int nicSampleButtonWidth = UiScale(70);
+        Button btnNicItrSample = new()
+        {
+            Text = "SAMPLE",
+            Size = new Size(nicSampleButtonWidth, UiScale(24)),
+            Location = new Point(btnNicItrCheck.Right + nicButtonGap, btnNicItr.Top),
+            FlatStyle = FlatStyle.Flat,
+            Font = _blockFont,
+            UseVisualStyleBackColor = false,
+            Cursor = Cursors.Hand,
+            Visible = showNicItr,
+        };
+        SetTopButtonBaseStyle(btnNicItrSample);
+        btnNicItrSample.MouseEnter += (_, _) => SetTopButtonHoverStyle(btnNicItrSample);
+        btnNicItrSample.MouseLeave += (_, _) => SetTopButtonBaseStyle(btnNicItrSample);
+
+        // Recalc inline layout to fit SET+SAVE+CHECK+SAMPLE on one row when possible.
+        int nicButtonsRowWidth = nicSetButtonWidth + nicButtonGap + nicSaveButtonWidth + nicButtonGap + nicCheckButtonWidth
+            + nicButtonGap + nicSampleButtonWidth;
         nicInlineMaxWidth = availableSettingsWidth - valueX - nicInlineGap - nicButtonsRowWidth - UiScale(8);
         nicButtonsInline = nicInlineMaxWidth >= nicInputMinWidth;
         nicInputWidth = nicButtonsInline
@@ -810,12 +828,14 @@ public sealed partial class MainForm
             btnNicItr.Location = new Point(txtNicItr.Right + nicInlineGap, txtNicItr.Top);
             btnNicItrSave.Location = new Point(btnNicItr.Right + nicButtonGap, btnNicItr.Top);
             btnNicItrCheck.Location = new Point(btnNicItrSave.Right + nicButtonGap, btnNicItr.Top);
+            btnNicItrSample.Location = new Point(btnNicItrCheck.Right + nicButtonGap, btnNicItr.Top);
         }
         else
         {
             btnNicItr.Location = new Point(valueX, txtNicItr.Bottom + UiScale(6));
             btnNicItrSave.Location = new Point(btnNicItr.Right + nicButtonGap, btnNicItr.Top);
             btnNicItrCheck.Location = new Point(btnNicItrSave.Right + nicButtonGap, btnNicItr.Top);
+            btnNicItrSample.Location = new Point(btnNicItrCheck.Right + nicButtonGap, btnNicItr.Top);
         }
 
         Label lblNicItrStatus = new HighlightLabel()
@@ -844,9 +864,105 @@ public sealed partial class MainForm
 
         if (showNicItr)
         {
-            settingsPanel.Controls.AddRange([lblNicItr, txtNicItr, btnNicItr, btnNicItrSave, btnNicItrCheck, lblNicItrStatus, lblNicItrTime]);
+            settingsPanel.Controls.AddRange([lblNicItr, txtNicItr, btnNicItr, btnNicItrSave, btnNicItrCheck, btnNicItrSample, lblNicItrStatus, lblNicItrTime]);
             rowTop = lblNicItrTime.Bottom + rowGap;
             _copyToolTip.SetToolTip(btnNicItrCheck, "Load DTIMOD.sys (IMOD driver) and re-read current NIC ITR values.");
+            _copyToolTip.SetToolTip(btnNicItrSample, "Measure per-queue packet rates for 2 s and load recommended ITR values (SET applies them).");
+        }
+
+        bool showNvme = IsNvmeController(device);
+        int nvmeInputWidth = Math.Min(UiScale(190), Math.Max(UiScale(100), availableSettingsWidth - valueX - UiScale(8)));
+        int nvmeStatusWidth = Math.Max(UiScale(120), availableSettingsWidth - valueX - UiScale(8));
+        Label lblNvme = new()
+        {
+            Text = "NVMe IC:",
+            AutoSize = true,
+            Location = new Point(0, rowTop + labelOffset),
+            ForeColor = _fgMain,
+            Visible = showNvme,
+        };
+
+        ThemedTextBox txtNvme = new()
+        {
+            Location = new Point(valueX, rowTop),
+            Size = new Size(nvmeInputWidth, UiScale(24)),
+            BackColor = Color.FromArgb(18, 18, 22),
+            ForeColor = _fgMain,
+            TextAlign = HorizontalAlignment.Left,
+            Text = "off",
+            Visible = showNvme,
+            Font = _blockFont,
+        };
+        StyleDarkTextBox(txtNvme);
+
+        int nvmeButtonsWidth = nicSetButtonWidth + nicButtonGap + nicSaveButtonWidth;
+        bool nvmeButtonsInline = availableSettingsWidth - valueX - nvmeInputWidth - nicInlineGap - nvmeButtonsWidth - UiScale(8) >= 0;
+        Button btnNvme = new()
+        {
+            Text = "SET",
+            Size = new Size(nicSetButtonWidth, UiScale(24)),
+            Location = nvmeButtonsInline
+                ? new Point(txtNvme.Right + nicInlineGap, txtNvme.Top)
+                : new Point(valueX, txtNvme.Bottom + UiScale(6)),
+            FlatStyle = FlatStyle.Flat,
+            Font = _blockFont,
+            UseVisualStyleBackColor = false,
+            Cursor = Cursors.Hand,
+            Visible = showNvme,
+        };
+        SetTopButtonBaseStyle(btnNvme);
+        btnNvme.MouseEnter += (_, _) => SetTopButtonHoverStyle(btnNvme);
+        btnNvme.MouseLeave += (_, _) => SetTopButtonBaseStyle(btnNvme);
+
+        Button btnNvmeSave = new()
+        {
+            Text = "SAVE",
+            Size = new Size(nicSaveButtonWidth, UiScale(24)),
+            Location = new Point(btnNvme.Right + nicButtonGap, btnNvme.Top),
+            FlatStyle = FlatStyle.Flat,
+            Font = _blockFont,
+            UseVisualStyleBackColor = false,
+            Cursor = Cursors.Hand,
+            Visible = showNvme,
+        };
+        SetTopButtonBaseStyle(btnNvmeSave);
+        btnNvmeSave.MouseEnter += (_, _) => SetTopButtonHoverStyle(btnNvmeSave);
+        btnNvmeSave.MouseLeave += (_, _) => SetTopButtonBaseStyle(btnNvmeSave);
+
+        Label lblNvmeStatus = new HighlightLabel()
+        {
+            Text = "current: reading...",
+            HighlightText = "current:",
+            HighlightColor = _statusPrefix,
+            AutoSize = false,
+            Size = new Size(nvmeStatusWidth, UiScale(22)),
+            ForeColor = _statusInactive,
+            Location = new Point(valueX, Math.Max(txtNvme.Bottom, btnNvme.Bottom) + UiScale(4)),
+            Visible = showNvme,
+            UseMnemonic = false,
+        };
+
+        // Queue counts, the queue-to-vector map and the MSI-X line.
+        Label lblNvmeDetail = new()
+        {
+            Text = "queues: reading...",
+            AutoSize = false,
+            Size = new Size(nvmeStatusWidth, UiScale((3 * 17) + 8)),
+            ForeColor = _statusInactive,
+            Location = new Point(valueX, lblNvmeStatus.Bottom + UiScale(2)),
+            Visible = showNvme,
+            UseMnemonic = false,
+        };
+
+        if (showNvme)
+        {
+            settingsPanel.Controls.AddRange([lblNvme, txtNvme, btnNvme, btnNvmeSave, lblNvmeStatus, lblNvmeDetail]);
+            rowTop = lblNvmeDetail.Bottom + rowGap;
+            string nvmeTip = "NVMe Interrupt Coalescing: \"<time us> x <completions>\" or \"off\", optional \"cd=1,2\" to exempt I/O vectors.\n" +
+                "SET applies it through the storage pass-through and rolls back if the controller refuses any part.\n" +
+                "SAVE reapplies it from the IMOD startup script; the controller forgets it on reset.";
+            _copyToolTip.SetToolTip(lblNvme, nvmeTip);
+            _copyToolTip.SetToolTip(btnNvme, nvmeTip);
         }
 
         bool showRawMouseThrottle = HasMouseThrottleContext(device);
@@ -1634,6 +1750,12 @@ public sealed partial class MainForm
             NicItrApplyButton = showNicItr ? btnNicItr : null,
             NicItrSaveButton = showNicItr ? btnNicItrSave : null,
             NicItrCheckButton = showNicItr ? btnNicItrCheck : null,
+            NicItrSampleButton = showNicItr ? btnNicItrSample : null,
+            NvmeBox = showNvme ? txtNvme.Inner : null,
+            NvmeStatusLabel = showNvme ? lblNvmeStatus : null,
+            NvmeDetailLabel = showNvme ? lblNvmeDetail : null,
+            NvmeApplyButton = showNvme ? btnNvme : null,
+            NvmeSaveButton = showNvme ? btnNvmeSave : null,
             ImodAutoCheck = chkImod,
             ImodModeCombo = showImod ? cmbImodMode : null,
             ImodCheckButton = showImod ? btnImodCheck : null,
@@ -1646,7 +1768,7 @@ public sealed partial class MainForm
             RawMouseThrottleStatusLabel = showRawMouseThrottle ? lblRawMouseThrottleStatus : null,
             InfoLabel = lblInfo,
             RelayoutAction = RelayoutDeviceBlockChrome,
-            AffinityMask = 0,
+            AffinityMask = CpuSet.Empty,
             IrqCount = null,
         };
         createdBlock = block;
@@ -1657,6 +1779,8 @@ public sealed partial class MainForm
             {
                 if (block.SuppressCpuEvents == 0)
                 {
+                    // Picking CPUs replaces a value that could not be read.
+                    block.AffinityReadError = null;
                     if (block.Kind == DeviceKind.NET_NDIS)
                     {
                         HandleNdisCheckboxChanged(block, cb);
@@ -1710,11 +1834,26 @@ public sealed partial class MainForm
             block.NicItrCheckButton.Click += (_, _) => CheckImodDriverFromNicBlock(block);
         }
 
+        if (block.NicItrSampleButton is not null)
+        {
+            block.NicItrSampleButton.Click += (_, _) => SampleNicItrFromBlock(block);
+        }
+
         if (block.NicItrBox is not null)
         {
             block.NicItrBox.TextChanged += (_, _) => UpdateNicItrInputTimeLabel(block);
         }
 
+        if (block.NvmeApplyButton is not null)
+        {
+            block.NvmeApplyButton.Click += (_, _) => ApplyNvmeFromBlock(block);
+        }
+
+        if (block.NvmeSaveButton is not null)
+        {
+            block.NvmeSaveButton.Click += (_, _) => SaveNvmePersistenceFromBlock(block);
+        }
+
         if (showImod)
         {
             InitializeImodSelectors(block);
@@ -1756,6 +1895,10 @@ public sealed partial class MainForm
         {
             RefreshNicItrBlock(block);
         }
+        if (showNvme)
+        {
+            RefreshNvmeBlock(block);
+        }
     }
 
     private void LayoutBlocks()
@@ -2044,6 +2187,7 @@ public sealed partial class MainForm
         {
             InvalidateImodCache();
             _ndisRssRuntimeCache.Clear();
+            _ndisRssRuntimeSnapshot = null;
             Dictionary<string, string> priorImodStatuses = [];
             foreach (DeviceBlock block in _blocks)
             {
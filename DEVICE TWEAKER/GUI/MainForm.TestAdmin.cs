@@ -3740,12 +3740,14 @@ public sealed partial class MainForm
         _cpuLpByIndex.Clear();
         _cpuSetIdByIndex.Clear();
         _cpuIndexByCpuSetId.Clear();
+        _cpuIndexByGroupNumber.Clear();
         foreach (CpuLpInfo lp in topo.LPs)
         {
             _cpuLpByIndex[lp.LP] = lp;
             int cpuSetId = lp.CpuSetId >= 0 ? lp.CpuSetId : lp.LP;
             _cpuSetIdByIndex[lp.LP] = cpuSetId;
             _cpuIndexByCpuSetId.TryAdd(cpuSetId, lp.LP);
+            _cpuIndexByGroupNumber.TryAdd(GetCpuGroupNumber(lp.LP), lp.LP);
         }
 
         _maxLogical = Math.Min(topo.Logical, MaxAffinityBits);
@@ -0,0 +1,473 @@
+#include "imod_affinity.h"
+
+#define IMOD_AFFINITY_DEFAULT_ECORE 400UL
+#define IMOD_AFFINITY_DEFAULT_RANK 2UL
+#define IMOD_AFFINITY_DEFAULT_OFF_TARGET 300UL
+#define IMOD_AFFINITY_DEFAULT_CORE0 500UL
+#define IMOD_AFFINITY_DEFAULT_SMT 40UL
+#define IMOD_AFFINITY_DEFAULT_SMT_INPUT 250UL
+#define IMOD_AFFINITY_DEFAULT_SPLIT_CLUSTER 200UL
+#define IMOD_AFFINITY_DEFAULT_LOAD 1UL
+#define IMOD_AFFINITY_DEFAULT_OVERLOAD 20UL
+#define IMOD_AFFINITY_CAPACITY 1000UL
+
+typedef struct _IMOD_AFFINITY_CONTEXT
+{
+    const IMOD_AFFINITY_CONFIG *Config;
+    const IMOD_AFFINITY_PROCESSOR *Processors;
+    ULONG ProcessorCount;
+    const IMOD_AFFINITY_DEVICE *Devices;
+    ULONG DeviceCount;
+    PIMOD_AFFINITY_WORKSPACE Workspace;
+    ULONGLONG Evaluations;
+} IMOD_AFFINITY_CONTEXT, *PIMOD_AFFINITY_CONTEXT;
+
+VOID ImodAffinityDefaultConfig(PIMOD_AFFINITY_CONFIG Config)
+{
+    Config->TargetCcd = IMOD_AFFINITY_ANY;
+    Config->MaxPasses = IMOD_AFFINITY_MAX_PASSES;
+    Config->ECore = IMOD_AFFINITY_DEFAULT_ECORE;
+    Config->Rank = IMOD_AFFINITY_DEFAULT_RANK;
+    Config->OffTarget = IMOD_AFFINITY_DEFAULT_OFF_TARGET;
+    Config->Core0 = IMOD_AFFINITY_DEFAULT_CORE0;
+    Config->Smt = IMOD_AFFINITY_DEFAULT_SMT;
+    Config->SmtInput = IMOD_AFFINITY_DEFAULT_SMT_INPUT;
+    Config->SplitCluster = IMOD_AFFINITY_DEFAULT_SPLIT_CLUSTER;
+    Config->Load = IMOD_AFFINITY_DEFAULT_LOAD;
+    Config->Overload = IMOD_AFFINITY_DEFAULT_OVERLOAD;
+}
+
+static BOOLEAN ImodAffinityIsCritical(ULONG Role)
+{
+    return Role <= IMOD_AFFINITY_ROLE_NIC;
+}
+
+static ULONGLONG ImodAffinityLoadCost(const IMOD_AFFINITY_CONFIG *Config, ULONG Load)
+{
+    ULONGLONG cost = ((ULONGLONG)Config->Load * Load * Load) / IMOD_AFFINITY_CAPACITY;
+
+    return Load > IMOD_AFFINITY_CAPACITY ? cost + ((ULONGLONG)Config->Overload * (Load - IMOD_AFFINITY_CAPACITY)) : cost;
+}
+
+/*
+ * What placing Device on Processor adds to the cost of everything already
+ * placed. Pair terms count each pair once, from whichever member comes
+ * second, so summing this over a placement order gives the total.
+ */
+static ULONGLONG ImodAffinityAddCost(PIMOD_AFFINITY_CONTEXT Context, ULONG Device, ULONG Processor, PIMOD_AFFINITY_COST Parts)
+{
+    const IMOD_AFFINITY_CONFIG *config = Context->Config;
+    const IMOD_AFFINITY_PROCESSOR *processor = &Context->Processors[Processor];
+    const IMOD_AFFINITY_DEVICE *device = &Context->Devices[Device];
+    PIMOD_AFFINITY_WORKSPACE workspace = Context->Workspace;
+    ULONGLONG placement = 0;
+    ULONGLONG smt;
+    ULONGLONG cluster = 0;
+    ULONGLONG load;
+    ULONG inputs = workspace->CoreInputs[processor->Core];
+    ULONG others = workspace->CoreDevices[processor->Core] - inputs;
+
+    ++Context->Evaluations;
+
+    if (ImodAffinityIsCritical(device->Role))
+    {
+        placement += processor->Efficiency != 0 ? config->ECore : 0;
+        placement += (ULONGLONG)config->Rank * processor->Rank;
+        placement += config->TargetCcd != IMOD_AFFINITY_ANY && processor->Ccd != config->TargetCcd ? config->OffTarget : 0;
+    }
+
+    placement += (processor->Flags & IMOD_AFFINITY_PROCESSOR_CORE0) != 0 ? config->Core0 : 0;
+
+    smt = device->Role == IMOD_AFFINITY_ROLE_INPUT
+        ? (ULONGLONG)config->SmtInput * (inputs + others)
+        : ((ULONGLONG)config->SmtInput * inputs) + ((ULONGLONG)config->Smt * others);
+
+    if (device->Cluster != IMOD_AFFINITY_ANY)
+    {
+        cluster = (ULONGLONG)config->SplitCluster *
+            (workspace->ClusterPlaced[device->Cluster] - workspace->ClusterLlc[device->Cluster][processor->Llc]);
+    }
+
+    load = ImodAffinityLoadCost(config, workspace->Load[Processor] + device->LoadPermille) -
+        ImodAffinityLoadCost(config, workspace->Load[Processor]);
+
+    if (Parts != NULL)
+    {
+        Parts->Placement += placement;
+        Parts->Smt += smt;
+        Parts->SplitCluster += cluster;
+        Parts->Load += load;
+        Parts->Total += placement + smt + cluster + load;
+    }
+
+    return placement + smt + cluster + load;
+}
+
+static VOID ImodAffinityPlace(PIMOD_AFFINITY_CONTEXT Context, ULONG Device, ULONG Processor)
+{
+    const IMOD_AFFINITY_PROCESSOR *processor = &Context->Processors[Processor];
+    const IMOD_AFFINITY_DEVICE *device = &Context->Devices[Device];
+    PIMOD_AFFINITY_WORKSPACE workspace = Context->Workspace;
+
+    workspace->Load[Processor] += device->LoadPermille;
+    ++workspace->CoreDevices[processor->Core];
+    workspace->CoreInputs[processor->Core] += device->Role == IMOD_AFFINITY_ROLE_INPUT ? 1 : 0;
+    if (device->Cluster != IMOD_AFFINITY_ANY)
+    {
+        ++workspace->ClusterPlaced[device->Cluster];
+        ++workspace->ClusterLlc[device->Cluster][processor->Llc];
+    }
+
+    workspace->Placement[Device] = Processor;
+}
+
+static ULONG ImodAffinityRemove(PIMOD_AFFINITY_CONTEXT Context, ULONG Device)
+{
+    PIMOD_AFFINITY_WORKSPACE workspace = Context->Workspace;
+    ULONG processorIndex = workspace->Placement[Device];
+    const IMOD_AFFINITY_PROCESSOR *processor = &Context->Processors[processorIndex];
+    const IMOD_AFFINITY_DEVICE *device = &Context->Devices[Device];
+
+    workspace->Load[processorIndex] -= device->LoadPermille;
+    --workspace->CoreDevices[processor->Core];
+    workspace->CoreInputs[processor->Core] -= device->Role == IMOD_AFFINITY_ROLE_INPUT ? 1 : 0;
+    if (device->Cluster != IMOD_AFFINITY_ANY)
+    {
+        --workspace->ClusterPlaced[device->Cluster];
+        --workspace->ClusterLlc[device->Cluster][processor->Llc];
+    }
+
+    workspace->Placement[Device] = IMOD_AFFINITY_ANY;
+    return processorIndex;
+}
+
+static VOID ImodAffinityReset(PIMOD_AFFINITY_CONTEXT Context)
+{
+    PIMOD_AFFINITY_WORKSPACE workspace = Context->Workspace;
+    ULONG index;
+
+    RtlZeroMemory(workspace->Load, sizeof(workspace->Load));
+    RtlZeroMemory(workspace->CoreDevices, sizeof(workspace->CoreDevices));
+    RtlZeroMemory(workspace->CoreInputs, sizeof(workspace->CoreInputs));
+    RtlZeroMemory(workspace->ClusterPlaced, sizeof(workspace->ClusterPlaced));
+    RtlZeroMemory(workspace->ClusterLlc, sizeof(workspace->ClusterLlc));
+
+    for (index = 0; index < IMOD_AFFINITY_MAX_DEVICES; ++index)
+    {
+        workspace->Placement[index] = IMOD_AFFINITY_ANY;
+    }
+}
+
+static ULONG ImodAffinityValidate(
+    const IMOD_AFFINITY_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    const IMOD_AFFINITY_DEVICE *Devices,
+    ULONG DeviceCount,
+    PIMOD_AFFINITY_WORKSPACE Workspace)
+{
+    BOOLEAN usable = FALSE;
+    ULONG index;
+
+    if (Processors == NULL || Workspace == NULL || (Devices == NULL && DeviceCount != 0) ||
+        ProcessorCount == 0 || ProcessorCount > IMOD_AFFINITY_MAX_PROCESSORS || DeviceCount > IMOD_AFFINITY_MAX_DEVICES)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < ProcessorCount; ++index)
+    {
+        if (Processors[index].Core >= ProcessorCount || Processors[index].Llc >= ProcessorCount ||
+            Processors[index].Ccd >= ProcessorCount)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        usable = usable || (Processors[index].Flags & IMOD_AFFINITY_PROCESSOR_RESERVED) == 0;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        if (Devices[index].Role > IMOD_AFFINITY_ROLE_OTHER ||
+            (Devices[index].Cluster != IMOD_AFFINITY_ANY && Devices[index].Cluster >= IMOD_AFFINITY_MAX_CLUSTERS))
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    return usable ? IMOD_RESULT_SUCCESS : IMOD_RESULT_INVALID_PARAMETER;
+}
+
+/* Rebuilds the workspace from Placement in device order and returns the itemized cost. */
+static VOID ImodAffinityEvaluate(PIMOD_AFFINITY_CONTEXT Context, const ULONG *Placement, PIMOD_AFFINITY_COST Cost)
+{
+    ULONG device;
+
+    ImodAffinityReset(Context);
+    RtlZeroMemory(Cost, sizeof(*Cost));
+    for (device = 0; device < Context->DeviceCount; ++device)
+    {
+        ImodAffinityAddCost(Context, device, Placement[device], Cost);
+        ImodAffinityPlace(Context, device, Placement[device]);
+    }
+}
+
+ULONG ImodAffinityCost(
+    const IMOD_AFFINITY_CONFIG *Config,
+    const IMOD_AFFINITY_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    const IMOD_AFFINITY_DEVICE *Devices,
+    ULONG DeviceCount,
+    const ULONG *Placement,
+    PIMOD_AFFINITY_WORKSPACE Workspace,
+    PIMOD_AFFINITY_COST Cost)
+{
+    IMOD_AFFINITY_CONFIG defaults;
+    IMOD_AFFINITY_CONTEXT context;
+    ULONG result = ImodAffinityValidate(Processors, ProcessorCount, Devices, DeviceCount, Workspace);
+    ULONG index;
+
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (Cost == NULL || (Placement == NULL && DeviceCount != 0))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        if (Placement[index] >= ProcessorCount)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    if (Config == NULL)
+    {
+        ImodAffinityDefaultConfig(&defaults);
+        Config = &defaults;
+    }
+
+    context.Config = Config;
+    context.Processors = Processors;
+    context.ProcessorCount = ProcessorCount;
+    context.Devices = Devices;
+    context.DeviceCount = DeviceCount;
+    context.Workspace = Workspace;
+    context.Evaluations = 0;
+    ImodAffinityEvaluate(&context, Placement, Cost);
+    return IMOD_RESULT_SUCCESS;
+}
+
+/* Input first, then audio, GPU, NIC and the rest; heavier devices first within a role. */
+static BOOLEAN ImodAffinityPlacesBefore(const IMOD_AFFINITY_DEVICE *Devices, ULONG Left, ULONG Right)
+{
+    if (Devices[Left].Role != Devices[Right].Role)
+    {
+        return Devices[Left].Role < Devices[Right].Role;
+    }
+
+    if (Devices[Left].LoadPermille != Devices[Right].LoadPermille)
+    {
+        return Devices[Left].LoadPermille > Devices[Right].LoadPermille;
+    }
+
+    return Left < Right;
+}
+
+static ULONG ImodAffinityBestProcessor(PIMOD_AFFINITY_CONTEXT Context, ULONG Device, ULONG Current, ULONGLONG *Cost)
+{
+    ULONGLONG bestCost = Current != IMOD_AFFINITY_ANY ? ImodAffinityAddCost(Context, Device, Current, NULL) : ~0ULL;
+    ULONG best = Current;
+    ULONG processor;
+
+    for (processor = 0; processor < Context->ProcessorCount; ++processor)
+    {
+        ULONGLONG cost;
+
+        if (processor == Current || (Context->Processors[processor].Flags & IMOD_AFFINITY_PROCESSOR_RESERVED) != 0)
+        {
+            continue;
+        }
+
+        cost = ImodAffinityAddCost(Context, Device, processor, NULL);
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            best = processor;
+        }
+    }
+
+    *Cost = bestCost;
+    return best;
+}
+
+/* Tries to exchange the processors of Left and Right; keeps the exchange only if it is cheaper. */
+static BOOLEAN ImodAffinityTrySwap(PIMOD_AFFINITY_CONTEXT Context, ULONG Left, ULONG Right)
+{
+    ULONG leftProcessor = ImodAffinityRemove(Context, Left);
+    ULONG rightProcessor = ImodAffinityRemove(Context, Right);
+    ULONGLONG before;
+    ULONGLONG after;
+
+    before = ImodAffinityAddCost(Context, Left, leftProcessor, NULL);
+    ImodAffinityPlace(Context, Left, leftProcessor);
+    before += ImodAffinityAddCost(Context, Right, rightProcessor, NULL);
+    ImodAffinityRemove(Context, Left);
+
+    after = ImodAffinityAddCost(Context, Left, rightProcessor, NULL);
+    ImodAffinityPlace(Context, Left, rightProcessor);
+    after += ImodAffinityAddCost(Context, Right, leftProcessor, NULL);
+
+    if (after < before)
+    {
+        ImodAffinityPlace(Context, Right, leftProcessor);
+        return TRUE;
+    }
+
+    ImodAffinityRemove(Context, Left);
+    ImodAffinityPlace(Context, Left, leftProcessor);
+    ImodAffinityPlace(Context, Right, rightProcessor);
+    return FALSE;
+}
+
+ULONG ImodAffinityPlan(
+    const IMOD_AFFINITY_CONFIG *Config,
+    const IMOD_AFFINITY_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    const IMOD_AFFINITY_DEVICE *Devices,
+    ULONG DeviceCount,
+    PIMOD_AFFINITY_WORKSPACE Workspace,
+    PIMOD_AFFINITY_ASSIGNMENT Assignments,
+    PIMOD_AFFINITY_SUMMARY Summary)
+{
+    IMOD_AFFINITY_CONFIG defaults;
+    IMOD_AFFINITY_CONTEXT context;
+    ULONG placement[IMOD_AFFINITY_MAX_DEVICES];
+    ULONG result = ImodAffinityValidate(Processors, ProcessorCount, Devices, DeviceCount, Workspace);
+    ULONG maxPasses;
+    ULONG index;
+    ULONG other;
+    ULONGLONG cost;
+    BOOLEAN improved = TRUE;
+
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (Summary == NULL || (Assignments == NULL && DeviceCount != 0))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Config == NULL)
+    {
+        ImodAffinityDefaultConfig(&defaults);
+        Config = &defaults;
+    }
+
+    context.Config = Config;
+    context.Processors = Processors;
+    context.ProcessorCount = ProcessorCount;
+    context.Devices = Devices;
+    context.DeviceCount = DeviceCount;
+    context.Workspace = Workspace;
+    context.Evaluations = 0;
+    RtlZeroMemory(Summary, sizeof(*Summary));
+    ImodAffinityReset(&context);
+
+    /* Insertion sort: at most IMOD_AFFINITY_MAX_DEVICES entries. */
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        ULONG position = index;
+
+        while (position > 0 && ImodAffinityPlacesBefore(Devices, index, Workspace->Order[position - 1]))
+        {
+            Workspace->Order[position] = Workspace->Order[position - 1];
+            --position;
+        }
+
+        Workspace->Order[position] = index;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        ULONG device = Workspace->Order[index];
+
+        ImodAffinityPlace(&context, device, ImodAffinityBestProcessor(&context, device, IMOD_AFFINITY_ANY, &cost));
+    }
+
+    RtlCopyMemory(placement, Workspace->Placement, sizeof(ULONG) * DeviceCount);
+    ImodAffinityEvaluate(&context, placement, &Summary->Initial);
+
+    maxPasses = Config->MaxPasses == 0 || Config->MaxPasses > IMOD_AFFINITY_MAX_PASSES
+        ? IMOD_AFFINITY_MAX_PASSES
+        : Config->MaxPasses;
+
+    while (improved && Summary->Passes < maxPasses)
+    {
+        improved = FALSE;
+        ++Summary->Passes;
+
+        for (index = 0; index < DeviceCount; ++index)
+        {
+            ULONG current = ImodAffinityRemove(&context, index);
+            ULONG best = ImodAffinityBestProcessor(&context, index, current, &cost);
+
+            ImodAffinityPlace(&context, index, best);
+            if (best != current)
+            {
+                ++Summary->Relocations;
+                improved = TRUE;
+            }
+        }
+
+        for (index = 0; index < DeviceCount; ++index)
+        {
+            for (other = index + 1; other < DeviceCount; ++other)
+            {
+                if (Workspace->Placement[index] != Workspace->Placement[other] &&
+                    ImodAffinityTrySwap(&context, index, other))
+                {
+                    ++Summary->Swaps;
+                    improved = TRUE;
+                }
+            }
+        }
+    }
+
+    RtlCopyMemory(placement, Workspace->Placement, sizeof(ULONG) * DeviceCount);
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        const IMOD_AFFINITY_DEVICE *device = &Devices[index];
+        const IMOD_AFFINITY_PROCESSOR *processor = &Processors[placement[index]];
+        PIMOD_AFFINITY_ASSIGNMENT assignment = &Assignments[index];
+        BOOLEAN critical = ImodAffinityIsCritical(device->Role);
+
+        ImodAffinityRemove(&context, index);
+        assignment->Processor = placement[index];
+        assignment->Cost = ImodAffinityAddCost(&context, index, placement[index], NULL);
+        assignment->Reasons =
+            (critical && processor->Efficiency != 0 ? IMOD_AFFINITY_REASON_ECORE : 0) |
+            (critical && Config->TargetCcd != IMOD_AFFINITY_ANY && processor->Ccd != Config->TargetCcd
+                ? IMOD_AFFINITY_REASON_OFF_TARGET
+                : 0) |
+            ((processor->Flags & IMOD_AFFINITY_PROCESSOR_CORE0) != 0 ? IMOD_AFFINITY_REASON_CORE0 : 0) |
+            (Workspace->CoreDevices[processor->Core] != 0 ? IMOD_AFFINITY_REASON_SMT_SHARED : 0) |
+            (device->Cluster != IMOD_AFFINITY_ANY &&
+                    Workspace->ClusterPlaced[device->Cluster] != Workspace->ClusterLlc[device->Cluster][processor->Llc]
+                ? IMOD_AFFINITY_REASON_SPLIT_CLUSTER
+                : 0) |
+            (Workspace->Load[placement[index]] + device->LoadPermille > IMOD_AFFINITY_CAPACITY
+                ? IMOD_AFFINITY_REASON_OVERLOADED
+                : 0);
+        ImodAffinityPlace(&context, index, placement[index]);
+    }
+
+    ImodAffinityEvaluate(&context, placement, &Summary->Final);
+    Summary->Evaluations = context.Evaluations;
+    return IMOD_RESULT_SUCCESS;
+}
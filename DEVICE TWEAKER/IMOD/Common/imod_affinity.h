@@ -0,0 +1,153 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_AFFINITY_MAX_PROCESSORS 256UL
+#define IMOD_AFFINITY_MAX_DEVICES 128UL
+#define IMOD_AFFINITY_MAX_CLUSTERS 16UL
+#define IMOD_AFFINITY_MAX_PASSES 16UL
+#define IMOD_AFFINITY_ANY 0xFFFFFFFFUL
+
+#define IMOD_AFFINITY_ROLE_INPUT 0UL
+#define IMOD_AFFINITY_ROLE_AUDIO 1UL
+#define IMOD_AFFINITY_ROLE_GPU 2UL
+#define IMOD_AFFINITY_ROLE_NIC 3UL
+#define IMOD_AFFINITY_ROLE_STORAGE 4UL
+#define IMOD_AFFINITY_ROLE_OTHER 5UL
+
+#define IMOD_AFFINITY_PROCESSOR_RESERVED 0x1
+#define IMOD_AFFINITY_PROCESSOR_CORE0 0x2
+
+#define IMOD_AFFINITY_REASON_ECORE 0x1UL
+#define IMOD_AFFINITY_REASON_OFF_TARGET 0x2UL
+#define IMOD_AFFINITY_REASON_CORE0 0x4UL
+#define IMOD_AFFINITY_REASON_SMT_SHARED 0x8UL
+#define IMOD_AFFINITY_REASON_SPLIT_CLUSTER 0x10UL
+#define IMOD_AFFINITY_REASON_OVERLOADED 0x20UL
+
+/*
+ * One logical processor. Core, Llc and Ccd are dense indices below the
+ * processor count: SMT siblings share Core, a CCX or other last-level cache
+ * domain shares Llc. Rank is the CPPC order, 0 for the strongest core.
+ * Reserved processors (reserved CPU sets) never receive a device.
+ */
+typedef struct _IMOD_AFFINITY_PROCESSOR
+{
+    ULONG Core;
+    ULONG Llc;
+    ULONG Ccd;
+    ULONG Rank;
+    UCHAR Efficiency;
+    UCHAR Flags;
+    USHORT Reserved;
+} IMOD_AFFINITY_PROCESSOR, *PIMOD_AFFINITY_PROCESSOR;
+
+/*
+ * Devices with the same Cluster hand data to each other (mouse and GPU,
+ * NIC and the game's network thread) and pay for every pair split across
+ * last-level caches. Load is ISR plus DPC time in permille of a processor.
+ */
+typedef struct _IMOD_AFFINITY_DEVICE
+{
+    ULONG Role;
+    ULONG LoadPermille;
+    ULONG Cluster;
+} IMOD_AFFINITY_DEVICE, *PIMOD_AFFINITY_DEVICE;
+
+/*
+ * Cost weights, all in the same arbitrary unit. Latency-critical roles
+ * (input, audio, GPU, NIC) pay ECore, Rank per CPPC position and OffTarget
+ * outside TargetCcd. Every pair of devices on one physical core pays Smt,
+ * or SmtInput when one of them is input. Load costs Load * L^2 / 1000 per
+ * processor plus Overload per permille above 1000.
+ */
+typedef struct _IMOD_AFFINITY_CONFIG
+{
+    ULONG TargetCcd;
+    ULONG MaxPasses;
+    ULONG ECore;
+    ULONG Rank;
+    ULONG OffTarget;
+    ULONG Core0;
+    ULONG Smt;
+    ULONG SmtInput;
+    ULONG SplitCluster;
+    ULONG Load;
+    ULONG Overload;
+} IMOD_AFFINITY_CONFIG, *PIMOD_AFFINITY_CONFIG;
+
+/* Cost is what the device adds where it ends up; Reasons says why it is not zero. */
+typedef struct _IMOD_AFFINITY_ASSIGNMENT
+{
+    ULONG Processor;
+    ULONG Reasons;
+    ULONGLONG Cost;
+} IMOD_AFFINITY_ASSIGNMENT, *PIMOD_AFFINITY_ASSIGNMENT;
+
+typedef struct _IMOD_AFFINITY_COST
+{
+    ULONGLONG Total;
+    ULONGLONG Placement;
+    ULONGLONG Smt;
+    ULONGLONG SplitCluster;
+    ULONGLONG Load;
+} IMOD_AFFINITY_COST, *PIMOD_AFFINITY_COST;
+
+typedef struct _IMOD_AFFINITY_SUMMARY
+{
+    IMOD_AFFINITY_COST Initial;
+    IMOD_AFFINITY_COST Final;
+    ULONG Passes;
+    ULONG Relocations;
+    ULONG Swaps;
+    ULONGLONG Evaluations;
+} IMOD_AFFINITY_SUMMARY, *PIMOD_AFFINITY_SUMMARY;
+
+/* Scratch state of one plan; callers allocate it, it is large for a stack. */
+typedef struct _IMOD_AFFINITY_WORKSPACE
+{
+    ULONG Load[IMOD_AFFINITY_MAX_PROCESSORS];
+    ULONG CoreDevices[IMOD_AFFINITY_MAX_PROCESSORS];
+    ULONG CoreInputs[IMOD_AFFINITY_MAX_PROCESSORS];
+    ULONG ClusterPlaced[IMOD_AFFINITY_MAX_CLUSTERS];
+    ULONG ClusterLlc[IMOD_AFFINITY_MAX_CLUSTERS][IMOD_AFFINITY_MAX_PROCESSORS];
+    ULONG Placement[IMOD_AFFINITY_MAX_DEVICES];
+    ULONG Order[IMOD_AFFINITY_MAX_DEVICES];
+} IMOD_AFFINITY_WORKSPACE, *PIMOD_AFFINITY_WORKSPACE;
+
+VOID ImodAffinityDefaultConfig(PIMOD_AFFINITY_CONFIG Config);
+
+/* Cost of a given placement (one processor index per device), e.g. a greedy plan. */
+ULONG ImodAffinityCost(
+    const IMOD_AFFINITY_CONFIG *Config,
+    const IMOD_AFFINITY_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    const IMOD_AFFINITY_DEVICE *Devices,
+    ULONG DeviceCount,
+    const ULONG *Placement,
+    PIMOD_AFFINITY_WORKSPACE Workspace,
+    PIMOD_AFFINITY_COST Cost);
+
+/*
+ * Places every device on one processor: a greedy pass in criticality order,
+ * then relocations and pairwise swaps while any of them strictly lowers the
+ * cost, for at most MaxPasses passes. Ties go to the lower index, so the
+ * same input always gives the same plan.
+ */
+ULONG ImodAffinityPlan(
+    const IMOD_AFFINITY_CONFIG *Config,
+    const IMOD_AFFINITY_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    const IMOD_AFFINITY_DEVICE *Devices,
+    ULONG DeviceCount,
+    PIMOD_AFFINITY_WORKSPACE Workspace,
+    PIMOD_AFFINITY_ASSIGNMENT Assignments,
+    PIMOD_AFFINITY_SUMMARY Summary);
+
+#ifdef __cplusplus
+}
+#endif
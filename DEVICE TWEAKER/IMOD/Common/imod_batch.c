@@ -0,0 +1,215 @@
+#include "imod_batch.h"
+#include "imod_xhci.h"
+
+#define IMOD_BATCH_MAX_CAPABILITY_OFFSET 0x1000UL
+
+static BOOLEAN ImodBatchFitsController(ULONGLONG barLength, ULONGLONG offset, ULONGLONG length)
+{
+    ULONGLONG limit = barLength != 0 ? barLength : IMOD_XHCI_MAX_CONTROLLER_WINDOW;
+
+    return length <= limit && offset <= limit - length;
+}
+
+static ULONG ImodBatchReadControllerLayout(
+    const IMOD_PLATFORM *Platform,
+    struct tagImodBatchHeader *header,
+    ULONG *maxIntrs,
+    ULONG *runtimeOffset)
+{
+    IMOD_REGISTER_WINDOW capabilityWindow;
+    ULONG capabilityLength;
+    ULONG hcsparamsValue = 0;
+    ULONG rtsoffValue = 0;
+    BOOLEAN readOk;
+
+    capabilityLength = (header->hcsparamsOffset > header->rtsoffOffset
+        ? header->hcsparamsOffset
+        : header->rtsoffOffset) + sizeof(ULONG);
+
+    if (!ImodBatchFitsController(header->barLength, 0, capabilityLength))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (!Platform->MapWindow(Platform->Context, header->capabilityAddress, capabilityLength, &capabilityWindow))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &capabilityWindow, header->hcsparamsOffset, &hcsparamsValue) &&
+        Platform->Read32(Platform->Context, &capabilityWindow, header->rtsoffOffset, &rtsoffValue);
+
+    Platform->UnmapWindow(Platform->Context, &capabilityWindow);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    *maxIntrs = IMOD_XHCI_HCS1_MAX_INTRS(hcsparamsValue);
+    *runtimeOffset = rtsoffValue & IMOD_XHCI_RTSOFF_MASK;
+
+    /* A controller in D3 or behind a dead link reads back as all ones. */
+    if (*maxIntrs == 0 || *maxIntrs > IMOD_XHCI_MAX_INTERRUPTERS || *runtimeOffset == 0)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    if (!ImodBatchFitsController(header->barLength, *runtimeOffset, IMOD_XHCI_RUNTIME_WINDOW_SIZE(*maxIntrs)))
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodBatchApply(
+    const IMOD_PLATFORM *Platform,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    struct tagImodBatchHeader header;
+    IMOD_REGISTER_WINDOW runtimeWindow;
+    ULONG *entries;
+    ULONG requiredLength;
+    ULONG maxIntrs = 0;
+    ULONG runtimeOffset = 0;
+    ULONG result;
+    ULONG index;
+
+    *BytesReturned = 0;
+
+    if (Platform == NULL || Buffer == NULL || InputLength < sizeof(header) || OutputLength < sizeof(header))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&header, Buffer, sizeof(header));
+
+    if (header.version != IMOD_BATCH_VERSION)
+    {
+        return IMOD_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    if (header.count == 0 || header.count > IMOD_XHCI_MAX_INTERRUPTERS || (header.flags & ~IMOD_BATCH_FLAGS_VALID) != 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if ((header.hcsparamsOffset & 0x3) != 0 || (header.rtsoffOffset & 0x3) != 0 ||
+        header.hcsparamsOffset >= IMOD_BATCH_MAX_CAPABILITY_OFFSET ||
+        header.rtsoffOffset >= IMOD_BATCH_MAX_CAPABILITY_OFFSET ||
+        header.capabilityAddress == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    requiredLength = sizeof(header) + (header.count * sizeof(ULONG));
+    if (InputLength < requiredLength || OutputLength < requiredLength)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    result = ImodBatchReadControllerLayout(Platform, &header, &maxIntrs, &runtimeOffset);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            header.capabilityAddress + runtimeOffset,
+            IMOD_XHCI_RUNTIME_WINDOW_SIZE(maxIntrs),
+            &runtimeWindow))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    entries = (ULONG *)((UCHAR *)Buffer + sizeof(header));
+    header.maxIntrs = maxIntrs;
+    header.runtimeAddress = header.capabilityAddress + runtimeOffset;
+    header.written = 0;
+    header.failed = 0;
+
+    for (index = 0; index < header.count; ++index)
+    {
+        ULONG interval = entries[index] & IMOD_XHCI_IMODI_MASK;
+        ULONG interrupterOffset = IMOD_XHCI_INTERRUPTER_OFFSET(index);
+        ULONG offset = interrupterOffset + IMOD_XHCI_IMOD_OFFSET;
+        ULONG currentValue = 0;
+        ULONG imanValue = 0;
+
+        if (index >= maxIntrs || offset + sizeof(ULONG) > runtimeWindow.Length)
+        {
+            entries[index] = IMOD_BATCH_STATUS_OUT_OF_WINDOW;
+            continue;
+        }
+
+        if (!Platform->Read32(Platform->Context, &runtimeWindow, offset, &currentValue))
+        {
+            entries[index] = IMOD_BATCH_STATUS_READ_FAILED;
+            ++header.failed;
+            continue;
+        }
+
+        /* IMAN is only read once a write is due, so an unchanged interrupter costs one read. */
+        if ((header.flags & IMOD_BATCH_FLAG_DIFF) != 0)
+        {
+            if ((currentValue & IMOD_XHCI_IMODI_MASK) == interval)
+            {
+                entries[index] = IMOD_BATCH_STATUS_UNCHANGED;
+                continue;
+            }
+
+            if (!Platform->Read32(Platform->Context, &runtimeWindow, interrupterOffset + IMOD_XHCI_IMAN_OFFSET, &imanValue))
+            {
+                entries[index] = IMOD_BATCH_STATUS_READ_FAILED;
+                ++header.failed;
+                continue;
+            }
+
+            if ((imanValue & IMOD_XHCI_IMAN_IE) == 0)
+            {
+                entries[index] = IMOD_BATCH_STATUS_INACTIVE;
+                continue;
+            }
+        }
+
+        if (!Platform->Write32(
+                Platform->Context,
+                &runtimeWindow,
+                offset,
+                (currentValue & IMOD_XHCI_IMODC_MASK) | interval))
+        {
+            entries[index] = IMOD_BATCH_STATUS_WRITE_FAILED;
+            ++header.failed;
+            continue;
+        }
+
+        if ((header.flags & IMOD_BATCH_FLAG_VERIFY) != 0)
+        {
+            if (!Platform->Read32(Platform->Context, &runtimeWindow, offset, &currentValue) ||
+                (currentValue & IMOD_XHCI_IMODI_MASK) != interval)
+            {
+                entries[index] = IMOD_BATCH_STATUS_VERIFY_FAILED;
+                ++header.failed;
+                continue;
+            }
+
+            entries[index] = IMOD_BATCH_STATUS_VERIFIED;
+            ++header.written;
+            continue;
+        }
+
+        entries[index] = IMOD_BATCH_STATUS_WRITTEN;
+        ++header.written;
+    }
+
+    Platform->UnmapWindow(Platform->Context, &runtimeWindow);
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+    *BytesReturned = requiredLength;
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_BATCH_VERSION 1UL
+
+#define IMOD_BATCH_STATUS_WRITTEN 0UL
+#define IMOD_BATCH_STATUS_OUT_OF_WINDOW 1UL
+#define IMOD_BATCH_STATUS_READ_FAILED 2UL
+#define IMOD_BATCH_STATUS_WRITE_FAILED 3UL
+#define IMOD_BATCH_STATUS_UNCHANGED 4UL
+#define IMOD_BATCH_STATUS_INACTIVE 5UL
+#define IMOD_BATCH_STATUS_VERIFY_FAILED 6UL
+#define IMOD_BATCH_STATUS_VERIFIED 7UL
+
+/*
+ * DIFF reads IMAN and IMOD first and leaves alone interrupters that already
+ * hold the target IMODI or that the host driver never enabled (IMAN.IE = 0).
+ * VERIFY reads IMOD back after each write. Without flags every interrupter
+ * is written; drivers that predate the flags reject any nonzero value.
+ */
+#define IMOD_BATCH_FLAG_DIFF 0x00000001UL
+#define IMOD_BATCH_FLAG_VERIFY 0x00000002UL
+#define IMOD_BATCH_FLAGS_VALID (IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY)
+
+#pragma pack(push, 1)
+
+/*
+ * Request and reply share one buffer: the header is followed by `count`
+ * ULONGs holding the IMODI value per interrupter on input and the
+ * IMOD_BATCH_STATUS_* code per interrupter on output. `written` counts
+ * WRITTEN and VERIFIED entries, `failed` the read, write and verify
+ * failures; skipped interrupters are in neither.
+ */
+struct tagImodBatchHeader
+{
+    ULONG version;
+    ULONG count;
+    ULONGLONG capabilityAddress;
+    ULONGLONG barLength;
+    ULONG hcsparamsOffset;
+    ULONG rtsoffOffset;
+    ULONG flags;
+    ULONG maxIntrs;
+    ULONGLONG runtimeAddress;
+    ULONG written;
+    ULONG failed;
+};
+
+#pragma pack(pop)
+
+ULONG ImodBatchApply(
+    const IMOD_PLATFORM *Platform,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+#ifdef __cplusplus
+}
+#endif
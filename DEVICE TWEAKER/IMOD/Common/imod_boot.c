@@ -0,0 +1,403 @@
+#include "imod_boot.h"
+
+#define IMOD_BOOT_MAX_CAPABILITY_OFFSET 0x1000UL
+#define IMOD_BOOT_FNV_OFFSET_BASIS 0x811C9DC5UL
+#define IMOD_BOOT_FNV_PRIME 0x01000193UL
+
+ULONG ImodBootTableChecksum(const VOID *Data, ULONG Length)
+{
+    const UCHAR *bytes = (const UCHAR *)Data;
+    ULONG hash = IMOD_BOOT_FNV_OFFSET_BASIS;
+    ULONG index;
+
+    for (index = 0; index < Length; ++index)
+    {
+        hash ^= bytes[index];
+        hash *= IMOD_BOOT_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static BOOLEAN ImodBootControllerValid(
+    const struct tagImodBootTableHeader *Header,
+    const struct tagImodBootTableController *Controller)
+{
+    if (Controller->capabilityAddress == 0 || Controller->flags != 0 ||
+        (Controller->hcsparamsOffset & 0x3) != 0 || (Controller->rtsoffOffset & 0x3) != 0 ||
+        Controller->hcsparamsOffset >= IMOD_BOOT_MAX_CAPABILITY_OFFSET ||
+        Controller->rtsoffOffset >= IMOD_BOOT_MAX_CAPABILITY_OFFSET)
+    {
+        return FALSE;
+    }
+
+    /* Zero and all ones are what absent or powered-down controllers read back. */
+    if (Controller->hcsparamsSignature == 0 || Controller->hcsparamsSignature == 0xFFFFFFFFUL ||
+        IMOD_XHCI_HCS1_MAX_INTRS(Controller->hcsparamsSignature) == 0)
+    {
+        return FALSE;
+    }
+
+    return Controller->intervalCount <= IMOD_XHCI_MAX_INTERRUPTERS &&
+        Controller->firstInterval <= Header->intervalCount &&
+        Controller->intervalCount <= Header->intervalCount - Controller->firstInterval;
+}
+
+ULONG ImodBootTableParse(const VOID *Data, ULONG Length, PIMOD_BOOT_TABLE Table)
+{
+    const struct tagImodBootTableHeader *header = (const struct tagImodBootTableHeader *)Data;
+    const struct tagImodBootTableController *controllers;
+    ULONG requiredLength;
+    ULONG index;
+
+    RtlZeroMemory(Table, sizeof(*Table));
+
+    if (Data == NULL || Length < sizeof(*header))
+    {
+        return IMOD_RESULT_INVALID_TABLE;
+    }
+
+    if (header->magic != IMOD_BOOT_TABLE_MAGIC || header->headerSize != sizeof(*header))
+    {
+        return IMOD_RESULT_INVALID_TABLE;
+    }
+
+    if (header->version != IMOD_BOOT_TABLE_VERSION)
+    {
+        return IMOD_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    if (header->controllerCount == 0 || header->controllerCount > IMOD_BOOT_MAX_CONTROLLERS ||
+        header->intervalCount > IMOD_BOOT_MAX_INTERVALS)
+    {
+        return IMOD_RESULT_INVALID_TABLE;
+    }
+
+    requiredLength = sizeof(*header) +
+        (header->controllerCount * sizeof(struct tagImodBootTableController)) +
+        (header->intervalCount * sizeof(ULONG));
+    if (Length != requiredLength)
+    {
+        return IMOD_RESULT_INVALID_TABLE;
+    }
+
+    if (ImodBootTableChecksum((const UCHAR *)Data + sizeof(*header), Length - sizeof(*header)) != header->checksum)
+    {
+        return IMOD_RESULT_INVALID_TABLE;
+    }
+
+    controllers = (const struct tagImodBootTableController *)((const UCHAR *)Data + sizeof(*header));
+    for (index = 0; index < header->controllerCount; ++index)
+    {
+        if (!ImodBootControllerValid(header, &controllers[index]))
+        {
+            return IMOD_RESULT_INVALID_TABLE;
+        }
+    }
+
+    Table->Header = header;
+    Table->Controllers = controllers;
+    Table->Intervals = (const ULONG *)(controllers + header->controllerCount);
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodBootPlanInterval(const IMOD_BOOT_TABLE *Table, ULONG ControllerIndex, ULONG Interrupter)
+{
+    const struct tagImodBootTableController *controller = &Table->Controllers[ControllerIndex];
+
+    if (Interrupter < controller->intervalCount)
+    {
+        return Table->Intervals[controller->firstInterval + Interrupter] & IMOD_XHCI_IMODI_MASK;
+    }
+
+    return controller->defaultInterval & IMOD_XHCI_IMODI_MASK;
+}
+
+VOID ImodBootStateInitialize(PIMOD_BOOT_STATE State, const VOID *Data, ULONG Length)
+{
+    ULONG index;
+
+    RtlZeroMemory(State, sizeof(*State));
+
+    State->TableResult = ImodBootTableParse(Data, Length, &State->Table);
+    if (State->TableResult != IMOD_RESULT_SUCCESS)
+    {
+        State->TableState = IMOD_BOOT_TABLE_REJECTED;
+        return;
+    }
+
+    State->TableState = IMOD_BOOT_TABLE_LOADED;
+    for (index = 0; index < State->Table.Header->controllerCount; ++index)
+    {
+        State->Controllers[index].capabilityAddress = State->Table.Controllers[index].capabilityAddress;
+        State->Controllers[index].state = IMOD_BOOT_CONTROLLER_PENDING;
+    }
+}
+
+static BOOLEAN ImodBootReadHcsparams(
+    const IMOD_PLATFORM *Platform,
+    const struct tagImodBootTableController *Controller,
+    ULONG *Value,
+    ULONG *Result)
+{
+    IMOD_REGISTER_WINDOW window;
+    BOOLEAN readOk;
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            Controller->capabilityAddress,
+            Controller->hcsparamsOffset + sizeof(ULONG),
+            &window))
+    {
+        *Result = IMOD_RESULT_MAP_FAILED;
+        return FALSE;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &window, Controller->hcsparamsOffset, Value);
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        *Result = IMOD_RESULT_ACCESS_FAILED;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static VOID ImodBootApplyController(const IMOD_PLATFORM *Platform, PIMOD_BOOT_STATE State, ULONG Index)
+{
+    const struct tagImodBootTableController *controller = &State->Table.Controllers[Index];
+    struct tagImodBootControllerStatus *status = &State->Controllers[Index];
+    struct tagImodBatchHeader header;
+    ULONG *entries = State->Scratch + (sizeof(header) / sizeof(ULONG));
+    ULONG hcsparamsValue = 0;
+    ULONG maxIntrs;
+    ULONG bufferLength;
+    ULONG bytesReturned = 0;
+    ULONG interrupter;
+
+    ++status->attempts;
+
+    if (!ImodBootReadHcsparams(Platform, controller, &hcsparamsValue, &status->result))
+    {
+        return;
+    }
+
+    status->hcsparams = hcsparamsValue;
+
+    /* Not decoded yet or still in D3: leave it pending for the next arrival. */
+    if (hcsparamsValue == 0 || hcsparamsValue == 0xFFFFFFFFUL)
+    {
+        status->result = IMOD_RESULT_INVALID_CONTROLLER;
+        return;
+    }
+
+    if (hcsparamsValue != controller->hcsparamsSignature)
+    {
+        status->state = IMOD_BOOT_CONTROLLER_MISMATCH;
+        status->result = IMOD_RESULT_INVALID_CONTROLLER;
+        return;
+    }
+
+    maxIntrs = IMOD_XHCI_HCS1_MAX_INTRS(hcsparamsValue);
+    if (maxIntrs > IMOD_XHCI_MAX_INTERRUPTERS)
+    {
+        status->state = IMOD_BOOT_CONTROLLER_FAILED;
+        status->result = IMOD_RESULT_INVALID_CONTROLLER;
+        return;
+    }
+
+    RtlZeroMemory(&header, sizeof(header));
+    header.version = IMOD_BATCH_VERSION;
+    header.count = maxIntrs;
+    header.capabilityAddress = controller->capabilityAddress;
+    header.barLength = controller->barLength;
+    header.hcsparamsOffset = controller->hcsparamsOffset;
+    header.rtsoffOffset = controller->rtsoffOffset;
+    RtlCopyMemory(State->Scratch, &header, sizeof(header));
+
+    for (interrupter = 0; interrupter < maxIntrs; ++interrupter)
+    {
+        entries[interrupter] = ImodBootPlanInterval(&State->Table, Index, interrupter);
+    }
+
+    bufferLength = sizeof(header) + (maxIntrs * sizeof(ULONG));
+    status->result = ImodBatchApply(Platform, State->Scratch, bufferLength, bufferLength, &bytesReturned);
+    if (status->result == IMOD_RESULT_INVALID_CONTROLLER)
+    {
+        return;
+    }
+
+    if (status->result != IMOD_RESULT_SUCCESS)
+    {
+        status->state = IMOD_BOOT_CONTROLLER_FAILED;
+        return;
+    }
+
+    RtlCopyMemory(&header, State->Scratch, sizeof(header));
+    status->maxIntrs = header.maxIntrs;
+    status->written = header.written;
+    status->failed = header.failed;
+    State->RuntimeAddresses[Index] = header.runtimeAddress;
+    status->state = header.failed == 0 && header.written == maxIntrs
+        ? IMOD_BOOT_CONTROLLER_APPLIED
+        : IMOD_BOOT_CONTROLLER_FAILED;
+}
+
+ULONG ImodBootApplyPending(const IMOD_PLATFORM *Platform, PIMOD_BOOT_STATE State)
+{
+    ULONG pending = 0;
+    ULONG index;
+
+    if (State->TableState != IMOD_BOOT_TABLE_LOADED)
+    {
+        return 0;
+    }
+
+    ++State->ApplyPasses;
+
+    for (index = 0; index < State->Table.Header->controllerCount; ++index)
+    {
+        struct tagImodBootControllerStatus *status = &State->Controllers[index];
+
+        if (status->state == IMOD_BOOT_CONTROLLER_APPLIED || status->state == IMOD_BOOT_CONTROLLER_MISMATCH ||
+            status->attempts >= IMOD_BOOT_MAX_ATTEMPTS)
+        {
+            continue;
+        }
+
+        ImodBootApplyController(Platform, State, index);
+
+        if ((status->state == IMOD_BOOT_CONTROLLER_PENDING || status->state == IMOD_BOOT_CONTROLLER_FAILED) &&
+            status->attempts < IMOD_BOOT_MAX_ATTEMPTS)
+        {
+            ++pending;
+        }
+    }
+
+    return pending;
+}
+
+ULONG ImodBootWatchdogConfigSize(const IMOD_BOOT_STATE *State)
+{
+    ULONG entryCount = 0;
+    ULONG index;
+
+    if (State->TableState == IMOD_BOOT_TABLE_LOADED)
+    {
+        for (index = 0; index < State->Table.Header->controllerCount; ++index)
+        {
+            if (State->Controllers[index].state == IMOD_BOOT_CONTROLLER_APPLIED)
+            {
+                entryCount += State->Controllers[index].maxIntrs;
+            }
+        }
+    }
+
+    return sizeof(struct tagImodWatchdogConfigHeader) + (entryCount * sizeof(struct tagImodWatchdogEntry));
+}
+
+/* Buffer must hold ImodBootWatchdogConfigSize bytes; group ids are table indexes. */
+VOID ImodBootBuildWatchdogConfig(const IMOD_BOOT_STATE *State, ULONG PeriodMs, PVOID Buffer)
+{
+    struct tagImodWatchdogConfigHeader *header = (struct tagImodWatchdogConfigHeader *)Buffer;
+    struct tagImodWatchdogEntry *entries = (struct tagImodWatchdogEntry *)(header + 1);
+    ULONG index;
+
+    RtlZeroMemory(header, sizeof(*header));
+    header->version = IMOD_WATCHDOG_VERSION;
+    header->periodMs = PeriodMs;
+
+    if (State->TableState != IMOD_BOOT_TABLE_LOADED)
+    {
+        return;
+    }
+
+    for (index = 0; index < State->Table.Header->controllerCount; ++index)
+    {
+        const struct tagImodBootControllerStatus *status = &State->Controllers[index];
+        ULONG interrupter;
+
+        if (status->state != IMOD_BOOT_CONTROLLER_APPLIED)
+        {
+            continue;
+        }
+
+        for (interrupter = 0; interrupter < status->maxIntrs; ++interrupter)
+        {
+            struct tagImodWatchdogEntry *entry = &entries[header->entryCount++];
+
+            RtlZeroMemory(entry, sizeof(*entry));
+            entry->address = State->RuntimeAddresses[index] +
+                IMOD_XHCI_INTERRUPTER_OFFSET(interrupter) + IMOD_XHCI_IMOD_OFFSET;
+            entry->groupId = index;
+            entry->mask = IMOD_XHCI_IMODI_MASK;
+            entry->value = ImodBootPlanInterval(&State->Table, index, interrupter);
+            entry->accessSize = sizeof(ULONG);
+        }
+    }
+}
+
+ULONG ImodBootQueryStatus(
+    const IMOD_BOOT_STATE *State,
+    PVOID Buffer,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    struct tagImodBootStatusHeader header;
+    ULONG capacity;
+    ULONG index;
+
+    *BytesReturned = 0;
+
+    if (Buffer == NULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (OutputLength < sizeof(header))
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlZeroMemory(&header, sizeof(header));
+    header.version = IMOD_BOOT_STATUS_VERSION;
+    header.tableState = IMOD_BOOT_TABLE_NONE;
+
+    if (State != NULL)
+    {
+        header.tableState = State->TableState;
+        header.tableResult = State->TableResult;
+        header.applyPasses = State->ApplyPasses;
+        if (State->TableState == IMOD_BOOT_TABLE_LOADED)
+        {
+            header.controllerCount = State->Table.Header->controllerCount;
+        }
+    }
+
+    capacity = (OutputLength - sizeof(header)) / sizeof(struct tagImodBootControllerStatus);
+    for (index = 0; index < header.controllerCount; ++index)
+    {
+        const struct tagImodBootControllerStatus *status = &State->Controllers[index];
+
+        if (status->state == IMOD_BOOT_CONTROLLER_PENDING || status->state == IMOD_BOOT_CONTROLLER_FAILED)
+        {
+            ++header.pendingCount;
+        }
+
+        if (index < capacity)
+        {
+            RtlCopyMemory(
+                (UCHAR *)Buffer + sizeof(header) + (index * sizeof(*status)),
+                status,
+                sizeof(*status));
+        }
+    }
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+    *BytesReturned = sizeof(header) +
+        ((header.controllerCount < capacity ? header.controllerCount : capacity) *
+            sizeof(struct tagImodBootControllerStatus));
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "imod_batch.h"
+#include "imod_watchdog.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_BOOT_TABLE_VALUE_NAME L"ImodBootTable"
+#define IMOD_BOOT_WATCHDOG_VALUE_NAME L"ImodWatchdogPeriodMs"
+#define IMOD_BOOT_TABLE_MAGIC 0x54424D49UL /* 'IMBT' */
+#define IMOD_BOOT_TABLE_VERSION 1UL
+#define IMOD_BOOT_STATUS_VERSION 1UL
+
+#define IMOD_BOOT_MAX_CONTROLLERS 16UL
+#define IMOD_BOOT_MAX_INTERVALS (IMOD_BOOT_MAX_CONTROLLERS * IMOD_XHCI_MAX_INTERRUPTERS)
+#define IMOD_BOOT_MAX_ATTEMPTS 8UL
+
+#define IMOD_BOOT_TABLE_NONE 0UL
+#define IMOD_BOOT_TABLE_LOADED 1UL
+#define IMOD_BOOT_TABLE_REJECTED 2UL
+
+#define IMOD_BOOT_CONTROLLER_PENDING 0UL
+#define IMOD_BOOT_CONTROLLER_APPLIED 1UL
+#define IMOD_BOOT_CONTROLLER_MISMATCH 2UL
+#define IMOD_BOOT_CONTROLLER_FAILED 3UL
+
+#pragma pack(push, 1)
+
+/*
+ * Stored as REG_BINARY in the driver's service Parameters key: the header,
+ * then controllerCount controller records, then intervalCount ULONGs forming
+ * the shared interval pool. checksum is FNV-1a over everything after the
+ * header.
+ */
+struct tagImodBootTableHeader
+{
+    ULONG magic;
+    ULONG version;
+    ULONG headerSize;
+    ULONG controllerCount;
+    ULONG intervalCount;
+    ULONG checksum;
+};
+
+/*
+ * Interrupter i gets intervals[firstInterval + i] while i < intervalCount and
+ * defaultInterval after that. The entry is only applied while the controller
+ * at capabilityAddress still reports hcsparamsSignature in HCSPARAMS1.
+ */
+struct tagImodBootTableController
+{
+    ULONGLONG capabilityAddress;
+    ULONGLONG barLength;
+    ULONG hcsparamsOffset;
+    ULONG rtsoffOffset;
+    ULONG hcsparamsSignature;
+    ULONG defaultInterval;
+    ULONG firstInterval;
+    ULONG intervalCount;
+    ULONG flags;
+    ULONG reserved;
+};
+
+struct tagImodBootStatusHeader
+{
+    ULONG version;
+    ULONG tableState;
+    ULONG tableResult;
+    ULONG controllerCount;
+    ULONG pendingCount;
+    ULONG applyPasses;
+};
+
+struct tagImodBootControllerStatus
+{
+    ULONGLONG capabilityAddress;
+    ULONG state;
+    ULONG result;
+    ULONG hcsparams;
+    ULONG maxIntrs;
+    ULONG written;
+    ULONG failed;
+    ULONG attempts;
+    ULONG reserved;
+};
+
+#pragma pack(pop)
+
+typedef struct _IMOD_BOOT_TABLE
+{
+    const struct tagImodBootTableHeader *Header;
+    const struct tagImodBootTableController *Controllers;
+    const ULONG *Intervals;
+} IMOD_BOOT_TABLE, *PIMOD_BOOT_TABLE;
+
+/*
+ * Everything the driver keeps for the boot table. The table itself points
+ * into the caller's buffer, which must outlive the state. Scratch holds the
+ * batch request built for one controller at a time. RuntimeAddresses keeps
+ * where each applied controller's interrupters live for the watchdog.
+ */
+typedef struct _IMOD_BOOT_STATE
+{
+    IMOD_BOOT_TABLE Table;
+    ULONG TableState;
+    ULONG TableResult;
+    ULONG ApplyPasses;
+    struct tagImodBootControllerStatus Controllers[IMOD_BOOT_MAX_CONTROLLERS];
+    ULONGLONG RuntimeAddresses[IMOD_BOOT_MAX_CONTROLLERS];
+    ULONG Scratch[(sizeof(struct tagImodBatchHeader) / sizeof(ULONG)) + IMOD_XHCI_MAX_INTERRUPTERS];
+} IMOD_BOOT_STATE, *PIMOD_BOOT_STATE;
+
+ULONG ImodBootTableChecksum(const VOID *Data, ULONG Length);
+
+ULONG ImodBootTableParse(const VOID *Data, ULONG Length, PIMOD_BOOT_TABLE Table);
+
+ULONG ImodBootPlanInterval(const IMOD_BOOT_TABLE *Table, ULONG ControllerIndex, ULONG Interrupter);
+
+VOID ImodBootStateInitialize(PIMOD_BOOT_STATE State, const VOID *Data, ULONG Length);
+
+ULONG ImodBootApplyPending(const IMOD_PLATFORM *Platform, PIMOD_BOOT_STATE State);
+
+ULONG ImodBootWatchdogConfigSize(const IMOD_BOOT_STATE *State);
+
+VOID ImodBootBuildWatchdogConfig(const IMOD_BOOT_STATE *State, ULONG PeriodMs, PVOID Buffer);
+
+ULONG ImodBootQueryStatus(
+    const IMOD_BOOT_STATE *State,
+    PVOID Buffer,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+#include "imod_budget.h"
+
+#define IMOD_BUDGET_NS_PER_SECOND 1000000000ULL
+
+static ULONG ImodBudgetClamp(ULONGLONG Value)
+{
+    return Value > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (ULONG)Value;
+}
+
+/* Realtek keeps RX timer and RX frame count in the low half; TX is not modelled. */
+static ULONG ImodBudgetFrameThreshold(ULONG Moderation, ULONG Value)
+{
+    switch (Moderation)
+    {
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT:
+        return (Value >> 4) & 0xF;
+
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2:
+        return (Value >> 8) & 0x7F;
+
+    default:
+        return 0;
+    }
+}
+
+ULONGLONG ImodBudgetIntervalNs(ULONG Moderation, ULONG Value)
+{
+    switch (Moderation)
+    {
+    case IMOD_BUDGET_MODERATION_XHCI_IMODI:
+        return (ULONGLONG)(Value & IMOD_XHCI_IMODI_MASK) * IMOD_XHCI_IMODI_TICK_NS;
+
+    case IMOD_BUDGET_MODERATION_INTEL_EITR:
+        return (ULONGLONG)((Value >> 2) & 0x1FFF) * 2000ULL;
+
+    case IMOD_BUDGET_MODERATION_INTEL_ITR:
+        return (ULONGLONG)(Value & 0xFFFF) * 256ULL;
+
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT:
+        return (ULONGLONG)(Value & 0xF) * 125000ULL;
+
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2:
+        return (ULONGLONG)(Value & 0x7F) * 1000ULL;
+
+    default:
+        return 0;
+    }
+}
+
+ULONG ImodBudgetInterruptRate(ULONG Moderation, ULONG Value, ULONG EventsPerSecond)
+{
+    ULONGLONG intervalNs = ImodBudgetIntervalNs(Moderation, Value);
+    ULONG frames = ImodBudgetFrameThreshold(Moderation, Value);
+    ULONGLONG batch;
+
+    if (EventsPerSecond == 0)
+    {
+        return 0;
+    }
+
+    if (intervalNs == 0)
+    {
+        return EventsPerSecond;
+    }
+
+    /* Events per interrupt, scaled by 1e9: one plus what arrives within the interval. */
+    batch = IMOD_BUDGET_NS_PER_SECOND + ((ULONGLONG)EventsPerSecond * intervalNs);
+    if (frames != 0 && batch > (ULONGLONG)frames * IMOD_BUDGET_NS_PER_SECOND)
+    {
+        batch = (ULONGLONG)frames * IMOD_BUDGET_NS_PER_SECOND;
+    }
+
+    return ImodBudgetClamp((((ULONGLONG)EventsPerSecond * IMOD_BUDGET_NS_PER_SECOND) + (batch / 2)) / batch);
+}
+
+/*
+ * Processors of the device's mask, clipped to ProcessorCount so callers can
+ * pass masks straight from the registry. Returns 0 for an empty mask.
+ */
+static ULONG ImodBudgetCollectProcessors(const IMOD_BUDGET_DEVICE *Device, ULONG ProcessorCount, ULONG *List)
+{
+    ULONG first = (ULONG)Device->Group * IMOD_BUDGET_GROUP_SIZE;
+    ULONGLONG mask = Device->Affinity;
+    ULONG count = 0;
+    ULONG bit;
+
+    if (first >= ProcessorCount)
+    {
+        return 0;
+    }
+
+    if (ProcessorCount - first < IMOD_BUDGET_GROUP_SIZE)
+    {
+        mask &= (1ULL << (ProcessorCount - first)) - 1;
+    }
+
+    for (bit = 0; mask != 0; ++bit, mask >>= 1)
+    {
+        if ((mask & 1) != 0)
+        {
+            List[count++] = first + bit;
+        }
+    }
+
+    return count;
+}
+
+ULONG ImodBudgetEstimate(
+    const IMOD_BUDGET_CONFIG *Config,
+    const IMOD_BUDGET_DEVICE *Devices,
+    ULONG DeviceCount,
+    ULONG ProcessorCount,
+    PIMOD_BUDGET_PROCESSOR Processors,
+    ULONG *OverBudget)
+{
+    ULONGLONG interrupts[IMOD_BUDGET_MAX_PROCESSORS];
+    ULONGLONG events[IMOD_BUDGET_MAX_PROCESSORS];
+    ULONGLONG isrNs[IMOD_BUDGET_MAX_PROCESSORS];
+    ULONGLONG dpcNs[IMOD_BUDGET_MAX_PROCESSORS];
+    ULONG messageProcessor[IMOD_BUDGET_MAX_VECTORS];
+    ULONG targets[IMOD_BUDGET_GROUP_SIZE];
+    ULONG maxInterrupts;
+    ULONG maxLoad;
+    ULONG over = 0;
+    ULONG index;
+    ULONG vector;
+    ULONG processor;
+
+    if (Devices == NULL && DeviceCount != 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Processors == NULL || ProcessorCount == 0 || ProcessorCount > IMOD_BUDGET_MAX_PROCESSORS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        if (Devices[index].VectorCount == 0 || Devices[index].VectorCount > IMOD_BUDGET_MAX_VECTORS)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    maxInterrupts = Config != NULL && Config->MaxInterruptsPerSecond != 0
+        ? Config->MaxInterruptsPerSecond
+        : IMOD_BUDGET_DEFAULT_MAX_INTERRUPTS;
+    maxLoad = Config != NULL && Config->MaxLoadPermille != 0
+        ? Config->MaxLoadPermille
+        : IMOD_BUDGET_DEFAULT_MAX_LOAD_PERMILLE;
+
+    RtlZeroMemory(interrupts, sizeof(ULONGLONG) * ProcessorCount);
+    RtlZeroMemory(events, sizeof(ULONGLONG) * ProcessorCount);
+    RtlZeroMemory(isrNs, sizeof(ULONGLONG) * ProcessorCount);
+    RtlZeroMemory(dpcNs, sizeof(ULONGLONG) * ProcessorCount);
+    RtlZeroMemory(Processors, sizeof(IMOD_BUDGET_PROCESSOR) * ProcessorCount);
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        const IMOD_BUDGET_DEVICE *device = &Devices[index];
+        ULONG messages = device->MessageLimit == 0 || device->MessageLimit > device->VectorCount
+            ? device->VectorCount
+            : device->MessageLimit;
+        ULONG targetCount = ImodBudgetCollectProcessors(device, ProcessorCount, targets);
+        ULONG message;
+
+        /* Message m goes to the (m % n)-th processor of the mask, or of the machine without one. */
+        for (message = 0; message < messages; ++message)
+        {
+            messageProcessor[message] = targetCount != 0 ? targets[message % targetCount] : message % ProcessorCount;
+            ++Processors[messageProcessor[message]].Messages;
+        }
+
+        for (vector = 0; vector < device->VectorCount; ++vector)
+        {
+            ULONG rate = ImodBudgetInterruptRate(device->Moderation, device->Values[vector], device->EventsPerSecond[vector]);
+
+            processor = messageProcessor[vector % messages];
+            interrupts[processor] += rate;
+            events[processor] += device->EventsPerSecond[vector];
+            isrNs[processor] += (ULONGLONG)rate * device->IsrNs;
+            dpcNs[processor] += ((ULONGLONG)rate * device->DpcNs) + ((ULONGLONG)device->EventsPerSecond[vector] * device->EventNs);
+        }
+    }
+
+    for (processor = 0; processor < ProcessorCount; ++processor)
+    {
+        PIMOD_BUDGET_PROCESSOR entry = &Processors[processor];
+        ULONGLONG loadNs = isrNs[processor] + dpcNs[processor];
+
+        entry->InterruptsPerSecond = ImodBudgetClamp(interrupts[processor]);
+        entry->EventsPerSecond = ImodBudgetClamp(events[processor]);
+        entry->IsrNsPerSecond = ImodBudgetClamp(isrNs[processor]);
+        entry->DpcNsPerSecond = ImodBudgetClamp(dpcNs[processor]);
+        entry->LoadPermille = ImodBudgetClamp((loadNs + 500000ULL) / 1000000ULL);
+        entry->Flags = (interrupts[processor] > maxInterrupts ? IMOD_BUDGET_FLAG_OVER_RATE : 0) |
+            (entry->LoadPermille > maxLoad ? IMOD_BUDGET_FLAG_OVER_LOAD : 0);
+        over += entry->Flags != 0;
+    }
+
+    if (OverBudget != NULL)
+    {
+        *OverBudget = over;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
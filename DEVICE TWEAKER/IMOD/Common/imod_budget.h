@@ -0,0 +1,102 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_BUDGET_KIND_USB 0UL
+#define IMOD_BUDGET_KIND_NIC 1UL
+#define IMOD_BUDGET_KIND_STORAGE 2UL
+
+#define IMOD_BUDGET_MODERATION_NONE 0UL
+#define IMOD_BUDGET_MODERATION_XHCI_IMODI 1UL
+#define IMOD_BUDGET_MODERATION_INTEL_EITR 2UL
+#define IMOD_BUDGET_MODERATION_INTEL_ITR 3UL
+#define IMOD_BUDGET_MODERATION_REALTEK_INTRMIT 4UL
+#define IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2 5UL
+
+#define IMOD_BUDGET_MAX_VECTORS 64UL
+#define IMOD_BUDGET_MAX_PROCESSORS 256UL
+#define IMOD_BUDGET_GROUP_SIZE 64UL
+
+#define IMOD_BUDGET_FLAG_OVER_RATE 0x1UL
+#define IMOD_BUDGET_FLAG_OVER_LOAD 0x2UL
+
+#define IMOD_BUDGET_DEFAULT_MAX_INTERRUPTS 20000UL
+#define IMOD_BUDGET_DEFAULT_MAX_LOAD_PERMILLE 150UL
+
+/*
+ * One interrupting function. Vectors are the moderated event sources it
+ * owns (xHCI interrupters, NIC queues, NVMe completion queues), each with
+ * its own raw moderation value and event rate. MSI messages are granted up
+ * to MessageLimit (0 = one per vector) and vector v raises message
+ * v % messages, the way drivers fold queues onto fewer messages. Messages
+ * go round-robin to the processors of Group/Affinity; an empty mask means
+ * no policy, i.e. every processor. Costs are per interrupt (IsrNs, DpcNs)
+ * and per event handled in the DPC (EventNs).
+ */
+typedef struct _IMOD_BUDGET_DEVICE
+{
+    ULONG Kind;
+    ULONG Moderation;
+    ULONG VectorCount;
+    ULONG MessageLimit;
+    ULONG IsrNs;
+    ULONG DpcNs;
+    ULONG EventNs;
+    USHORT Group;
+    USHORT Reserved;
+    ULONGLONG Affinity;
+    ULONG Values[IMOD_BUDGET_MAX_VECTORS];
+    ULONG EventsPerSecond[IMOD_BUDGET_MAX_VECTORS];
+} IMOD_BUDGET_DEVICE, *PIMOD_BUDGET_DEVICE;
+
+/* Per-processor limits; a zero field falls back to the default above. */
+typedef struct _IMOD_BUDGET_CONFIG
+{
+    ULONG MaxInterruptsPerSecond;
+    ULONG MaxLoadPermille;
+} IMOD_BUDGET_CONFIG, *PIMOD_BUDGET_CONFIG;
+
+/* Processor n is group n / 64, bit n % 64. Load is ISR plus DPC time. */
+typedef struct _IMOD_BUDGET_PROCESSOR
+{
+    ULONG Messages;
+    ULONG InterruptsPerSecond;
+    ULONG EventsPerSecond;
+    ULONG IsrNsPerSecond;
+    ULONG DpcNsPerSecond;
+    ULONG LoadPermille;
+    ULONG Flags;
+} IMOD_BUDGET_PROCESSOR, *PIMOD_BUDGET_PROCESSOR;
+
+/* Shortest spacing between interrupts the raw value allows, in ns. */
+ULONGLONG ImodBudgetIntervalNs(ULONG Moderation, ULONG Value);
+
+/*
+ * Interrupts per second of one vector. Timer moderation holds interrupts
+ * apart by at least the interval and lets events pile up meanwhile, which
+ * gives EventsPerSecond / (1 + EventsPerSecond * interval). The Realtek
+ * frame threshold also ends a batch once that many frames are in.
+ */
+ULONG ImodBudgetInterruptRate(ULONG Moderation, ULONG Value, ULONG EventsPerSecond);
+
+/*
+ * Spreads every device's vectors over ProcessorCount processors and fills
+ * Processors. OverBudget, when given, receives the number of processors
+ * with any IMOD_BUDGET_FLAG_* set.
+ */
+ULONG ImodBudgetEstimate(
+    const IMOD_BUDGET_CONFIG *Config,
+    const IMOD_BUDGET_DEVICE *Devices,
+    ULONG DeviceCount,
+    ULONG ProcessorCount,
+    PIMOD_BUDGET_PROCESSOR Processors,
+    ULONG *OverBudget);
+
+#ifdef __cplusplus
+}
+#endif
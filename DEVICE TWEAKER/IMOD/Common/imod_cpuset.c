@@ -0,0 +1,354 @@
+#include "imod_cpuset.h"
+
+static ULONG ImodCpuSetPopCount(ULONGLONG Value)
+{
+    ULONG count = 0;
+
+    while (Value != 0)
+    {
+        Value &= Value - 1;
+        ++count;
+    }
+
+    return count;
+}
+
+static ULONG ImodCpuSetLowestBit(ULONGLONG Value)
+{
+    ULONG bit = 0;
+
+    while ((Value & 1) == 0)
+    {
+        Value >>= 1;
+        ++bit;
+    }
+
+    return bit;
+}
+
+static ULONG ImodCpuSetHighestBit(ULONGLONG Value)
+{
+    ULONG bit = 63;
+
+    while ((Value & (1ULL << bit)) == 0)
+    {
+        --bit;
+    }
+
+    return bit;
+}
+
+static BOOLEAN ImodCpuSetValidLayout(const IMOD_CPUSET_LAYOUT *Layout)
+{
+    ULONG group;
+
+    if (Layout == NULL || Layout->GroupCount == 0 || Layout->GroupCount > IMOD_CPUSET_MAX_GROUPS)
+    {
+        return FALSE;
+    }
+
+    for (group = 0; group < Layout->GroupCount; ++group)
+    {
+        if (Layout->ProcessorCount[group] > IMOD_CPUSET_GROUP_SIZE)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+VOID ImodCpuSetClear(PIMOD_CPUSET Set)
+{
+    RtlZeroMemory(Set, sizeof(*Set));
+}
+
+BOOLEAN ImodCpuSetAdd(PIMOD_CPUSET Set, ULONG Group, ULONG Number)
+{
+    if (Group >= IMOD_CPUSET_MAX_GROUPS || Number >= IMOD_CPUSET_GROUP_SIZE)
+    {
+        return FALSE;
+    }
+
+    Set->Groups[Group] |= 1ULL << Number;
+    return TRUE;
+}
+
+BOOLEAN ImodCpuSetContains(const IMOD_CPUSET *Set, ULONG Group, ULONG Number)
+{
+    return Group < IMOD_CPUSET_MAX_GROUPS && Number < IMOD_CPUSET_GROUP_SIZE &&
+        (Set->Groups[Group] & (1ULL << Number)) != 0;
+}
+
+ULONG ImodCpuSetCount(const IMOD_CPUSET *Set)
+{
+    ULONG count = 0;
+    ULONG group;
+
+    for (group = 0; group < IMOD_CPUSET_MAX_GROUPS; ++group)
+    {
+        count += ImodCpuSetPopCount(Set->Groups[group]);
+    }
+
+    return count;
+}
+
+ULONG ImodCpuSetGroupCount(const IMOD_CPUSET *Set, ULONG *First)
+{
+    ULONG count = 0;
+    ULONG group;
+
+    for (group = IMOD_CPUSET_MAX_GROUPS; group-- > 0;)
+    {
+        if (Set->Groups[group] != 0)
+        {
+            ++count;
+            if (First != NULL)
+            {
+                *First = group;
+            }
+        }
+    }
+
+    return count;
+}
+
+BOOLEAN ImodCpuSetToIndex(const IMOD_CPUSET_LAYOUT *Layout, ULONG Group, ULONG Number, ULONG *Index)
+{
+    ULONG index = 0;
+    ULONG group;
+
+    if (!ImodCpuSetValidLayout(Layout) || Group >= Layout->GroupCount || Number >= Layout->ProcessorCount[Group])
+    {
+        return FALSE;
+    }
+
+    for (group = 0; group < Group; ++group)
+    {
+        index += Layout->ProcessorCount[group];
+    }
+
+    *Index = index + Number;
+    return TRUE;
+}
+
+BOOLEAN ImodCpuSetFromIndex(const IMOD_CPUSET_LAYOUT *Layout, ULONG Index, ULONG *Group, ULONG *Number)
+{
+    ULONG group;
+
+    if (!ImodCpuSetValidLayout(Layout))
+    {
+        return FALSE;
+    }
+
+    for (group = 0; group < Layout->GroupCount; ++group)
+    {
+        if (Index < Layout->ProcessorCount[group])
+        {
+            *Group = group;
+            *Number = Index;
+            return TRUE;
+        }
+
+        Index -= Layout->ProcessorCount[group];
+    }
+
+    return FALSE;
+}
+
+ULONG ImodCpuSetEncodeAffinityPolicy(const IMOD_CPUSET *Set, UCHAR *Buffer, ULONG BufferSize, ULONG *Written)
+{
+    ULONG group = 0;
+    ULONG size;
+    ULONG index;
+
+    if (Set == NULL || Buffer == NULL || Written == NULL || ImodCpuSetGroupCount(Set, &group) > 1)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    size = group == 0 ? sizeof(ULONGLONG) : IMOD_CPUSET_GROUP_AFFINITY_SIZE;
+    if (BufferSize < size)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlZeroMemory(Buffer, size);
+    for (index = 0; index < sizeof(ULONGLONG); ++index)
+    {
+        Buffer[index] = (UCHAR)(Set->Groups[group] >> (index * 8));
+    }
+
+    if (group != 0)
+    {
+        Buffer[8] = (UCHAR)group;
+        Buffer[9] = (UCHAR)(group >> 8);
+    }
+
+    *Written = size;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodCpuSetDecodeAffinityPolicy(const UCHAR *Buffer, ULONG Length, PIMOD_CPUSET Set)
+{
+    ULONGLONG mask = 0;
+    ULONG group = 0;
+    ULONG width = Length >= sizeof(ULONGLONG) ? sizeof(ULONGLONG) : sizeof(ULONG);
+    ULONG index;
+
+    if (Buffer == NULL || Set == NULL || (Length != sizeof(ULONG) && Length != sizeof(ULONGLONG) &&
+        Length != IMOD_CPUSET_GROUP_AFFINITY_SIZE))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < width; ++index)
+    {
+        mask |= (ULONGLONG)Buffer[index] << (index * 8);
+    }
+
+    if (Length == IMOD_CPUSET_GROUP_AFFINITY_SIZE)
+    {
+        group = (ULONG)Buffer[8] | ((ULONG)Buffer[9] << 8);
+        if (group >= IMOD_CPUSET_MAX_GROUPS)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    ImodCpuSetClear(Set);
+    Set->Groups[group] = mask;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodCpuSetEncodeBitmap(
+    const IMOD_CPUSET *Set,
+    const IMOD_CPUSET_LAYOUT *Layout,
+    UCHAR *Buffer,
+    ULONG BufferSize,
+    ULONG *Written)
+{
+    ULONG first = 0;
+    ULONG used = 0;
+    ULONG group;
+
+    if (Set == NULL || Written == NULL || !ImodCpuSetValidLayout(Layout) || (Buffer == NULL && BufferSize != 0))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (BufferSize != 0)
+    {
+        RtlZeroMemory(Buffer, BufferSize);
+    }
+
+    for (group = 0; group < IMOD_CPUSET_MAX_GROUPS; ++group)
+    {
+        ULONGLONG mask = Set->Groups[group];
+        ULONG count = group < Layout->GroupCount ? Layout->ProcessorCount[group] : 0;
+
+        if (count < IMOD_CPUSET_GROUP_SIZE && (mask >> count) != 0)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        while (mask != 0)
+        {
+            ULONG index = first + ImodCpuSetLowestBit(mask);
+
+            if (index / 8 >= BufferSize)
+            {
+                return IMOD_RESULT_BUFFER_TOO_SMALL;
+            }
+
+            Buffer[index / 8] |= (UCHAR)(1U << (index % 8));
+            used = (index / 8) + 1;
+            mask &= mask - 1;
+        }
+
+        first += count;
+    }
+
+    *Written = used;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodCpuSetDecodeBitmap(const UCHAR *Buffer, ULONG Length, const IMOD_CPUSET_LAYOUT *Layout, PIMOD_CPUSET Set)
+{
+    ULONG index;
+
+    if (Set == NULL || !ImodCpuSetValidLayout(Layout) || (Buffer == NULL && Length != 0))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    ImodCpuSetClear(Set);
+    for (index = 0; index < Length * 8; ++index)
+    {
+        ULONG group;
+        ULONG number;
+
+        if ((Buffer[index / 8] & (1U << (index % 8))) == 0)
+        {
+            continue;
+        }
+
+        /* Bits past the last processor are ignored, as the kernel ignores them. */
+        if (ImodCpuSetFromIndex(Layout, index, &group, &number))
+        {
+            Set->Groups[group] |= 1ULL << number;
+        }
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodCpuSetRssRange(
+    const IMOD_CPUSET *Set,
+    const IMOD_CPUSET_LAYOUT *Layout,
+    PIMOD_CPUSET_RSS_RANGE Range,
+    BOOLEAN *Exact)
+{
+    ULONG first = 0;
+    ULONG last = 0;
+    ULONG lowIndex;
+    ULONG highIndex;
+    ULONG count;
+    ULONG group;
+
+    if (Set == NULL || Range == NULL || !ImodCpuSetValidLayout(Layout))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    count = ImodCpuSetCount(Set);
+    if (count == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    ImodCpuSetGroupCount(Set, &first);
+    for (group = 0; group < IMOD_CPUSET_MAX_GROUPS; ++group)
+    {
+        last = Set->Groups[group] != 0 ? group : last;
+    }
+
+    Range->BaseGroup = first;
+    Range->BaseNumber = ImodCpuSetLowestBit(Set->Groups[first]);
+    Range->MaxGroup = last;
+    Range->MaxNumber = ImodCpuSetHighestBit(Set->Groups[last]);
+    Range->MaxProcessors = count;
+
+    if (!ImodCpuSetToIndex(Layout, Range->BaseGroup, Range->BaseNumber, &lowIndex) ||
+        !ImodCpuSetToIndex(Layout, Range->MaxGroup, Range->MaxNumber, &highIndex))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Exact != NULL)
+    {
+        *Exact = highIndex - lowIndex + 1 == count;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_CPUSET_GROUP_SIZE 64UL
+#define IMOD_CPUSET_MAX_GROUPS 32UL
+#define IMOD_CPUSET_MAX_PROCESSORS (IMOD_CPUSET_GROUP_SIZE * IMOD_CPUSET_MAX_GROUPS)
+
+/* GROUP_AFFINITY: KAFFINITY Mask, USHORT Group, USHORT Reserved[3]. */
+#define IMOD_CPUSET_GROUP_AFFINITY_SIZE 16UL
+
+/*
+ * Processors by group: bit n of Groups[g] is processor n of group g, the
+ * KAFFINITY of that group. On a single-group machine Groups[0] is the
+ * plain affinity mask.
+ */
+typedef struct _IMOD_CPUSET
+{
+    ULONGLONG Groups[IMOD_CPUSET_MAX_GROUPS];
+} IMOD_CPUSET, *PIMOD_CPUSET;
+
+/*
+ * Active processors per group. Windows fills groups unevenly (two sockets
+ * of 48 make two groups of 48), so system-wide indices, as used by
+ * ReservedCpuSets and the NDIS RSS range, count through the groups in order.
+ */
+typedef struct _IMOD_CPUSET_LAYOUT
+{
+    ULONG GroupCount;
+    UCHAR ProcessorCount[IMOD_CPUSET_MAX_GROUPS];
+} IMOD_CPUSET_LAYOUT, *PIMOD_CPUSET_LAYOUT;
+
+/* RSS processor range as the NDIS RssBaseProcGroup ... RssMaxProcNumber keywords spell it. */
+typedef struct _IMOD_CPUSET_RSS_RANGE
+{
+    ULONG BaseGroup;
+    ULONG BaseNumber;
+    ULONG MaxGroup;
+    ULONG MaxNumber;
+    ULONG MaxProcessors;
+} IMOD_CPUSET_RSS_RANGE, *PIMOD_CPUSET_RSS_RANGE;
+
+VOID ImodCpuSetClear(PIMOD_CPUSET Set);
+BOOLEAN ImodCpuSetAdd(PIMOD_CPUSET Set, ULONG Group, ULONG Number);
+BOOLEAN ImodCpuSetContains(const IMOD_CPUSET *Set, ULONG Group, ULONG Number);
+ULONG ImodCpuSetCount(const IMOD_CPUSET *Set);
+
+/* Number of groups with at least one processor; First receives the lowest of them. */
+ULONG ImodCpuSetGroupCount(const IMOD_CPUSET *Set, ULONG *First);
+
+/* System-wide index of (Group, Number) and back; FALSE when the layout has no such processor. */
+BOOLEAN ImodCpuSetToIndex(const IMOD_CPUSET_LAYOUT *Layout, ULONG Group, ULONG Number, ULONG *Index);
+BOOLEAN ImodCpuSetFromIndex(const IMOD_CPUSET_LAYOUT *Layout, ULONG Index, ULONG *Group, ULONG *Number);
+
+/*
+ * AssignmentSetOverride for one group: the 8-byte KAFFINITY for group 0,
+ * which is what the value has always held, and a GROUP_AFFINITY otherwise.
+ * An interrupt targets a single group, so a set spanning several groups is
+ * rejected. Decode accepts 4-, 8- and 16-byte values.
+ */
+ULONG ImodCpuSetEncodeAffinityPolicy(const IMOD_CPUSET *Set, UCHAR *Buffer, ULONG BufferSize, ULONG *Written);
+ULONG ImodCpuSetDecodeAffinityPolicy(const UCHAR *Buffer, ULONG Length, PIMOD_CPUSET Set);
+
+/*
+ * ReservedCpuSets: bit i of the byte string is system-wide index i, trimmed
+ * after the last set byte. Written is 0 for an empty set.
+ */
+ULONG ImodCpuSetEncodeBitmap(
+    const IMOD_CPUSET *Set,
+    const IMOD_CPUSET_LAYOUT *Layout,
+    UCHAR *Buffer,
+    ULONG BufferSize,
+    ULONG *Written);
+ULONG ImodCpuSetDecodeBitmap(const UCHAR *Buffer, ULONG Length, const IMOD_CPUSET_LAYOUT *Layout, PIMOD_CPUSET Set);
+
+/*
+ * The RSS range NDIS walks from the first to the last processor of the
+ * set, across group boundaries. Exact is FALSE when the set has holes the
+ * range would still cover.
+ */
+ULONG ImodCpuSetRssRange(
+    const IMOD_CPUSET *Set,
+    const IMOD_CPUSET_LAYOUT *Layout,
+    PIMOD_CPUSET_RSS_RANGE Range,
+    BOOLEAN *Exact);
+
+#ifdef __cplusplus
+}
+#endif
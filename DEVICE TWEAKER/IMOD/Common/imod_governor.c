@@ -0,0 +1,121 @@
+#include "imod_governor.h"
+
+#define IMOD_GOVERNOR_TICKS_PER_SECOND (1000000000UL / IMOD_XHCI_IMODI_TICK_NS)
+
+VOID ImodGovernorInitialize(PIMOD_GOVERNOR_CHANNEL Channel, ULONG Interval)
+{
+    RtlZeroMemory(Channel, sizeof(*Channel));
+    Channel->Interval = Interval & IMOD_XHCI_IMODI_MASK;
+}
+
+/* Smallest IMODI that keeps one interrupter at or below IrqBudget interrupts per second. */
+ULONG ImodGovernorBudgetInterval(ULONG IrqBudget)
+{
+    ULONG interval;
+
+    if (IrqBudget == 0)
+    {
+        return 0;
+    }
+
+    interval = (IMOD_GOVERNOR_TICKS_PER_SECOND + IrqBudget - 1) / IrqBudget;
+    return interval > IMOD_XHCI_IMODI_MASK ? IMOD_XHCI_IMODI_MASK : interval;
+}
+
+static ULONG ImodGovernorClamp(const IMOD_GOVERNOR_LIMITS *Limits, ULONG Interval)
+{
+    ULONG minimum = Limits->MinInterval & IMOD_XHCI_IMODI_MASK;
+    ULONG maximum = Limits->MaxInterval & IMOD_XHCI_IMODI_MASK;
+
+    if (maximum < minimum)
+    {
+        maximum = minimum;
+    }
+
+    return Interval < minimum ? minimum : (Interval > maximum ? maximum : Interval);
+}
+
+/*
+ * One control step. The event rate is smoothed (EWMA, 1/4 weight) and
+ * compared with the budget through a dead band of +/- HysteresisPercent:
+ * above the band the interval rises to the budget interval, below it the
+ * interval drops back to the floor, and inside it nothing changes. After a
+ * change the channel holds for HoldTicks steps before it may move again.
+ */
+BOOLEAN ImodGovernorStep(
+    const IMOD_GOVERNOR_LIMITS *Limits,
+    PIMOD_GOVERNOR_CHANNEL Channel,
+    ULONG EventsPerSecond,
+    PIMOD_GOVERNOR_DECISION Decision)
+{
+    ULONG hysteresis = Limits->HysteresisPercent > IMOD_GOVERNOR_MAX_HYSTERESIS_PERCENT
+        ? IMOD_GOVERNOR_MAX_HYSTERESIS_PERCENT
+        : Limits->HysteresisPercent;
+    ULONGLONG upper;
+    ULONGLONG lower;
+    ULONG target = Channel->Interval;
+    ULONG reason = IMOD_GOVERNOR_REASON_NONE;
+
+    if (!Channel->Primed)
+    {
+        Channel->SmoothedEventsPerSecond = EventsPerSecond;
+        Channel->Primed = TRUE;
+    }
+    else
+    {
+        Channel->SmoothedEventsPerSecond = (ULONG)(((ULONGLONG)Channel->SmoothedEventsPerSecond * 3 + EventsPerSecond) / 4);
+    }
+
+    Decision->PreviousInterval = Channel->Interval;
+    Decision->Interval = Channel->Interval;
+    Decision->Reason = IMOD_GOVERNOR_REASON_NONE;
+    Decision->SmoothedEventsPerSecond = Channel->SmoothedEventsPerSecond;
+
+    /* Limits edited under a running governor are enforced right away. */
+    if (ImodGovernorClamp(Limits, Channel->Interval) != Channel->Interval)
+    {
+        target = ImodGovernorClamp(Limits, Channel->Interval);
+        reason = IMOD_GOVERNOR_REASON_LIMITS_CHANGED;
+    }
+    else if (Channel->HoldRemaining != 0)
+    {
+        --Channel->HoldRemaining;
+        return FALSE;
+    }
+    else if (Limits->IrqBudget == 0)
+    {
+        target = ImodGovernorClamp(Limits, 0);
+        reason = IMOD_GOVERNOR_REASON_LIMITS_CHANGED;
+    }
+    else
+    {
+        upper = ((ULONGLONG)Limits->IrqBudget * (100 + hysteresis)) / 100;
+        lower = ((ULONGLONG)Limits->IrqBudget * (100 - hysteresis)) / 100;
+
+        if (Channel->SmoothedEventsPerSecond > upper)
+        {
+            target = ImodGovernorClamp(Limits, ImodGovernorBudgetInterval(Limits->IrqBudget));
+            reason = target < ImodGovernorBudgetInterval(Limits->IrqBudget)
+                ? IMOD_GOVERNOR_REASON_LATENCY_CEILING
+                : IMOD_GOVERNOR_REASON_OVER_BUDGET;
+        }
+        else if (Channel->SmoothedEventsPerSecond < lower)
+        {
+            target = ImodGovernorClamp(Limits, 0);
+            reason = IMOD_GOVERNOR_REASON_UNDER_BUDGET;
+        }
+    }
+
+    if (target == Channel->Interval)
+    {
+        return FALSE;
+    }
+
+    Channel->Interval = target;
+    Channel->HoldRemaining = Limits->HoldTicks;
+    ++Channel->Adjustments;
+
+    Decision->Interval = target;
+    Decision->Reason = reason;
+    return TRUE;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT 20UL
+#define IMOD_GOVERNOR_DEFAULT_HOLD_TICKS 3UL
+#define IMOD_GOVERNOR_MAX_HYSTERESIS_PERCENT 90UL
+
+#define IMOD_GOVERNOR_REASON_NONE 0UL
+#define IMOD_GOVERNOR_REASON_OVER_BUDGET 1UL
+#define IMOD_GOVERNOR_REASON_UNDER_BUDGET 2UL
+#define IMOD_GOVERNOR_REASON_LATENCY_CEILING 3UL
+#define IMOD_GOVERNOR_REASON_LIMITS_CHANGED 4UL
+
+/*
+ * User limits for one interrupter, intervals in IMODI units (250 ns).
+ * MinInterval is the floor used whenever the rate fits the budget;
+ * MaxInterval is the latency ceiling and wins over the budget.
+ * IrqBudget of 0 pins the interrupter to MinInterval.
+ */
+typedef struct _IMOD_GOVERNOR_LIMITS
+{
+    ULONG MinInterval;
+    ULONG MaxInterval;
+    ULONG IrqBudget;
+    ULONG HysteresisPercent;
+    ULONG HoldTicks;
+} IMOD_GOVERNOR_LIMITS, *PIMOD_GOVERNOR_LIMITS;
+
+typedef struct _IMOD_GOVERNOR_CHANNEL
+{
+    BOOLEAN Primed;
+    ULONG Interval;
+    ULONG SmoothedEventsPerSecond;
+    ULONG HoldRemaining;
+    ULONG Adjustments;
+} IMOD_GOVERNOR_CHANNEL, *PIMOD_GOVERNOR_CHANNEL;
+
+typedef struct _IMOD_GOVERNOR_DECISION
+{
+    ULONG PreviousInterval;
+    ULONG Interval;
+    ULONG Reason;
+    ULONG SmoothedEventsPerSecond;
+} IMOD_GOVERNOR_DECISION, *PIMOD_GOVERNOR_DECISION;
+
+VOID ImodGovernorInitialize(PIMOD_GOVERNOR_CHANNEL Channel, ULONG Interval);
+
+ULONG ImodGovernorBudgetInterval(ULONG IrqBudget);
+
+BOOLEAN ImodGovernorStep(
+    const IMOD_GOVERNOR_LIMITS *Limits,
+    PIMOD_GOVERNOR_CHANNEL Channel,
+    ULONG EventsPerSecond,
+    PIMOD_GOVERNOR_DECISION Decision);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,361 @@
+#include "imod_latency.h"
+
+#define IMOD_LATENCY_NONE (~0ULL)
+#define IMOD_LATENCY_MAX_WARMUP 8000UL
+
+static ULONGLONG ImodLatencySplitMix(ULONGLONG Value)
+{
+    Value += 0x9E3779B97F4A7C15ULL;
+    Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBULL;
+    return Value ^ (Value >> 31);
+}
+
+ULONG ImodLatencyPeriod(const IMOD_LATENCY_DEVICE *Device)
+{
+    ULONG interval = Device->Interval == 0 ? 1 : Device->Interval;
+    ULONG frames = 1;
+    ULONG period;
+
+    if (Device->PollingHz != 0)
+    {
+        period = (8000UL + (Device->PollingHz / 2)) / Device->PollingHz;
+        return period == 0 ? 1 : (period > IMOD_LATENCY_MAX_PERIOD ? IMOD_LATENCY_MAX_PERIOD : period);
+    }
+
+    switch (Device->Speed)
+    {
+    case IMOD_LATENCY_SPEED_LOW:
+    case IMOD_LATENCY_SPEED_FULL:
+        while (frames * 2 <= interval && frames < 128)
+        {
+            frames *= 2;
+        }
+        return frames * 8;
+
+    case IMOD_LATENCY_SPEED_HIGH:
+    case IMOD_LATENCY_SPEED_SUPER:
+        return 1UL << ((interval > 16 ? 16 : interval) - 1);
+
+    default:
+        return 0;
+    }
+}
+
+static ULONG ImodLatencyPercentile(const ULONGLONG *Histogram, ULONGLONG Events, ULONG Permille, ULONG BinNs, ULONG MaxNs)
+{
+    ULONGLONG target = ((Events * Permille) + 999) / 1000;
+    ULONGLONG seen = 0;
+    ULONG bin;
+
+    if (Events == 0)
+    {
+        return 0;
+    }
+
+    for (bin = 0; bin < IMOD_LATENCY_BINS; ++bin)
+    {
+        seen += Histogram[bin];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+
+    if (bin == 0)
+    {
+        return 0;
+    }
+
+    return bin * BinNs < MaxNs ? bin * BinNs : MaxNs;
+}
+
+static ULONG ImodLatencyRate(ULONGLONG Count, ULONGLONG Microframes)
+{
+    ULONGLONG rate = Microframes == 0 ? 0 : (Count * (1000000000ULL / IMOD_LATENCY_MICROFRAME_NS)) / Microframes;
+
+    return rate > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (ULONG)rate;
+}
+
+/*
+ * The trials of a batch run in lockstep, one lane each, one microframe per
+ * step. Per lane the interrupter follows the IMOD rule: an event posted
+ * while the interval since the last interrupt has run out is reported at
+ * once; otherwise it waits for the interval to expire, and everything
+ * posted meanwhile rides on that one interrupt. The per-lane loops are
+ * free of branches so the compiler can vectorize them; only events are
+ * binned one by one.
+ */
+ULONG ImodLatencySimulateInterrupter(
+    const IMOD_LATENCY_CONFIG *Config,
+    const IMOD_LATENCY_DEVICE *Devices,
+    ULONG DeviceCount,
+    ULONG Interrupter,
+    ULONG Interval,
+    PIMOD_LATENCY_DEVICE_RESULT DeviceResults,
+    PIMOD_LATENCY_INTERRUPTER_RESULT Result)
+{
+    ULONG members[IMOD_LATENCY_MAX_DEVICES];
+    ULONG periods[IMOD_LATENCY_MAX_DEVICES];
+    ULONG duty[IMOD_LATENCY_MAX_DEVICES];
+    ULONG countdown[IMOD_LATENCY_MAX_DEVICES][IMOD_LATENCY_LANES];
+    UCHAR hits[IMOD_LATENCY_MAX_DEVICES][IMOD_LATENCY_LANES];
+    ULONGLONG random[IMOD_LATENCY_LANES];
+    ULONGLONG pending[IMOD_LATENCY_LANES];
+    ULONGLONG nextAllowed[IMOD_LATENCY_LANES];
+    ULONGLONG latency[IMOD_LATENCY_LANES];
+    ULONG posted[IMOD_LATENCY_LANES];
+    ULONG raised[IMOD_LATENCY_LANES];
+    ULONGLONG combined[IMOD_LATENCY_BINS];
+    ULONGLONG intervalNs;
+    ULONGLONG interrupts = 0;
+    ULONGLONG events = 0;
+    ULONG trials;
+    ULONG batches;
+    ULONG batch;
+    ULONG window;
+    ULONG warmup = 0;
+    ULONG binNs;
+    ULONG maxNs = 0;
+    ULONG memberCount = 0;
+    ULONG index;
+    ULONG lane;
+    ULONG microframe;
+    ULONG bin;
+
+    if (Config == NULL || Devices == NULL || DeviceResults == NULL || Result == NULL ||
+        DeviceCount > IMOD_LATENCY_MAX_DEVICES)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        ULONG period;
+
+        if (Devices[index].Interrupter != Interrupter)
+        {
+            continue;
+        }
+
+        period = ImodLatencyPeriod(&Devices[index]);
+        if (period == 0 || Devices[index].DutyPermille > 1000)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        members[memberCount] = index;
+        periods[memberCount] = period;
+        duty[memberCount] = (Devices[index].DutyPermille * 65536UL) / 1000;
+        ++memberCount;
+
+        if (period > warmup)
+        {
+            warmup = period;
+        }
+    }
+
+    Interval &= IMOD_XHCI_IMODI_MASK;
+    RtlZeroMemory(Result, sizeof(*Result));
+    Result->Interval = Interval;
+    if (memberCount == 0)
+    {
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    intervalNs = (ULONGLONG)Interval * IMOD_XHCI_IMODI_TICK_NS;
+    binNs = intervalNs == 0 ? 1 : (ULONG)((intervalNs + IMOD_LATENCY_BINS - 2) / (IMOD_LATENCY_BINS - 1));
+    trials = Config->Trials == 0 ? IMOD_LATENCY_DEFAULT_TRIALS : Config->Trials;
+    batches = (trials + IMOD_LATENCY_LANES - 1) / IMOD_LATENCY_LANES;
+    window = (Config->WindowUs == 0 ? IMOD_LATENCY_DEFAULT_WINDOW_US : Config->WindowUs) /
+        (IMOD_LATENCY_MICROFRAME_NS / 1000);
+    window = window == 0 ? 1 : window;
+
+    /*
+     * Start measuring once every device has polled and the first interval has run out. The
+     * warmup covers the longest interval IMODI can hold, not this one, so every candidate of a
+     * sweep measures the same microframes.
+     */
+    warmup += (ULONG)(((ULONGLONG)IMOD_XHCI_IMODI_MASK * IMOD_XHCI_IMODI_TICK_NS) / IMOD_LATENCY_MICROFRAME_NS) + 1;
+    warmup = warmup > IMOD_LATENCY_MAX_WARMUP ? IMOD_LATENCY_MAX_WARMUP : warmup;
+
+    for (index = 0; index < memberCount; ++index)
+    {
+        PIMOD_LATENCY_DEVICE_RESULT device = &DeviceResults[members[index]];
+
+        RtlZeroMemory(device, sizeof(*device));
+        device->PeriodMicroframes = periods[index];
+        device->BinNs = binNs;
+    }
+
+    for (batch = 0; batch < batches; ++batch)
+    {
+        for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+        {
+            ULONGLONG seed = ImodLatencySplitMix(
+                Config->Seed ^ ImodLatencySplitMix(((ULONGLONG)Interrupter << 32) | ((batch * IMOD_LATENCY_LANES) + lane)));
+
+            random[lane] = seed | 1;
+            pending[lane] = IMOD_LATENCY_NONE;
+            nextAllowed[lane] = 0;
+
+            for (index = 0; index < memberCount; ++index)
+            {
+                countdown[index][lane] = (ULONG)(ImodLatencySplitMix(seed + index + 1) % periods[index]);
+            }
+        }
+
+        for (microframe = 0; microframe < warmup + window; ++microframe)
+        {
+            ULONGLONG now = (ULONGLONG)microframe * IMOD_LATENCY_MICROFRAME_NS;
+
+            for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+            {
+                posted[lane] = 0;
+            }
+
+            for (index = 0; index < memberCount; ++index)
+            {
+                for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+                {
+                    ULONGLONG value = random[lane];
+                    ULONG poll = countdown[index][lane] == 0;
+                    ULONG hit;
+
+                    value ^= value << 13;
+                    value ^= value >> 7;
+                    value ^= value << 17;
+                    random[lane] = value;
+
+                    hit = poll & ((ULONG)(value >> 48) < duty[index]);
+                    countdown[index][lane] = poll ? periods[index] - 1 : countdown[index][lane] - 1;
+                    hits[index][lane] = (UCHAR)hit;
+                    posted[lane] += hit;
+                }
+            }
+
+            /* An interrupt due in this microframe also reports what is posted in it. */
+            for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+            {
+                ULONG expired = pending[lane] < now;
+                ULONG idle;
+                ULONG busy = posted[lane] != 0;
+                ULONGLONG fire;
+
+                nextAllowed[lane] = expired ? pending[lane] + intervalNs : nextAllowed[lane];
+                pending[lane] = expired ? IMOD_LATENCY_NONE : pending[lane];
+                idle = pending[lane] == IMOD_LATENCY_NONE;
+                fire = idle ? (now > nextAllowed[lane] ? now : nextAllowed[lane]) : pending[lane];
+
+                latency[lane] = fire - now;
+                raised[lane] = busy & idle;
+                pending[lane] = busy ? fire : pending[lane];
+            }
+
+            if (microframe < warmup)
+            {
+                continue;
+            }
+
+            for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+            {
+                interrupts += raised[lane];
+            }
+
+            for (index = 0; index < memberCount; ++index)
+            {
+                PIMOD_LATENCY_DEVICE_RESULT device = &DeviceResults[members[index]];
+
+                for (lane = 0; lane < IMOD_LATENCY_LANES; ++lane)
+                {
+                    ULONG delay;
+
+                    if (hits[index][lane] == 0)
+                    {
+                        continue;
+                    }
+
+                    delay = (ULONG)latency[lane];
+                    bin = delay == 0 ? 0 : 1 + ((delay - 1) / binNs);
+                    ++device->Histogram[bin < IMOD_LATENCY_BINS ? bin : IMOD_LATENCY_BINS - 1];
+                    ++device->Events;
+                    device->MaxNs = delay > device->MaxNs ? delay : device->MaxNs;
+                }
+            }
+        }
+    }
+
+    RtlZeroMemory(combined, sizeof(combined));
+
+    for (index = 0; index < memberCount; ++index)
+    {
+        PIMOD_LATENCY_DEVICE_RESULT device = &DeviceResults[members[index]];
+        ULONGLONG measured = (ULONGLONG)batches * IMOD_LATENCY_LANES * window;
+
+        device->EventsPerSecond = ImodLatencyRate(device->Events, measured);
+        device->P50Ns = ImodLatencyPercentile(device->Histogram, device->Events, 500, binNs, device->MaxNs);
+        device->P99Ns = ImodLatencyPercentile(device->Histogram, device->Events, 990, binNs, device->MaxNs);
+
+        for (bin = 0; bin < IMOD_LATENCY_BINS; ++bin)
+        {
+            combined[bin] += device->Histogram[bin];
+        }
+
+        events += device->Events;
+        maxNs = device->MaxNs > maxNs ? device->MaxNs : maxNs;
+    }
+
+    Result->Devices = memberCount;
+    Result->InterruptsPerSecond = ImodLatencyRate(interrupts, (ULONGLONG)batches * IMOD_LATENCY_LANES * window);
+    Result->EventsPerSecond = ImodLatencyRate(events, (ULONGLONG)batches * IMOD_LATENCY_LANES * window);
+    Result->P50Ns = ImodLatencyPercentile(combined, events, 500, binNs, maxNs);
+    Result->P99Ns = ImodLatencyPercentile(combined, events, 990, binNs, maxNs);
+    Result->MaxNs = maxNs;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodLatencySimulate(
+    const IMOD_LATENCY_CONFIG *Config,
+    const IMOD_LATENCY_DEVICE *Devices,
+    ULONG DeviceCount,
+    const ULONG *Intervals,
+    ULONG InterrupterCount,
+    PIMOD_LATENCY_DEVICE_RESULT DeviceResults,
+    PIMOD_LATENCY_INTERRUPTER_RESULT Results)
+{
+    ULONG interrupter;
+    ULONG index;
+    ULONG result;
+
+    if (Devices == NULL || Intervals == NULL || Results == NULL ||
+        InterrupterCount == 0 || InterrupterCount > IMOD_XHCI_MAX_INTERRUPTERS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < DeviceCount; ++index)
+    {
+        if (Devices[index].Interrupter >= InterrupterCount)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    for (interrupter = 0; interrupter < InterrupterCount; ++interrupter)
+    {
+        result = ImodLatencySimulateInterrupter(
+            Config,
+            Devices,
+            DeviceCount,
+            interrupter,
+            Intervals[interrupter],
+            DeviceResults,
+            &Results[interrupter]);
+        if (result != IMOD_RESULT_SUCCESS)
+        {
+            return result;
+        }
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
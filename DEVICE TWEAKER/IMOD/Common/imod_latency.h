@@ -0,0 +1,109 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_LATENCY_SPEED_LOW 1UL
+#define IMOD_LATENCY_SPEED_FULL 2UL
+#define IMOD_LATENCY_SPEED_HIGH 3UL
+#define IMOD_LATENCY_SPEED_SUPER 4UL
+
+#define IMOD_LATENCY_MICROFRAME_NS 125000UL
+#define IMOD_LATENCY_MAX_PERIOD 32768UL
+#define IMOD_LATENCY_MAX_DEVICES 64UL
+#define IMOD_LATENCY_LANES 16UL
+#define IMOD_LATENCY_BINS 256UL
+#define IMOD_LATENCY_DEFAULT_TRIALS 64UL
+#define IMOD_LATENCY_DEFAULT_WINDOW_US 250000UL
+
+/*
+ * One periodic endpoint. The poll period comes from PollingHz when it was
+ * measured, otherwise from bInterval the way xHCI schedules it: frames
+ * rounded down to a power of two for low/full speed, 2^(bInterval-1)
+ * microframes for high/super speed. DutyPermille is the share of polls
+ * that complete with data (a moving mouse 1000, an idle keyboard far less).
+ */
+typedef struct _IMOD_LATENCY_DEVICE
+{
+    ULONG Speed;
+    ULONG Interval;
+    ULONG PollingHz;
+    ULONG DutyPermille;
+    ULONG Interrupter;
+} IMOD_LATENCY_DEVICE, *PIMOD_LATENCY_DEVICE;
+
+/*
+ * Trials are rounded up to a multiple of IMOD_LATENCY_LANES. The random
+ * streams depend on Seed and the interrupter only, so every candidate
+ * interval of a sweep sees the same polls and completions.
+ */
+typedef struct _IMOD_LATENCY_CONFIG
+{
+    ULONG Trials;
+    ULONG WindowUs;
+    ULONGLONG Seed;
+} IMOD_LATENCY_CONFIG, *PIMOD_LATENCY_CONFIG;
+
+/*
+ * Latency added by moderation: from a transfer event being posted to the
+ * interrupt that reports it. Bin 0 holds events reported at once, bin n
+ * events delayed by ((n - 1) * BinNs, n * BinNs]; percentiles are the
+ * upper bin edge, so they are exact to within BinNs (1/255 of the interval).
+ */
+typedef struct _IMOD_LATENCY_DEVICE_RESULT
+{
+    ULONG PeriodMicroframes;
+    ULONG EventsPerSecond;
+    ULONG P50Ns;
+    ULONG P99Ns;
+    ULONG MaxNs;
+    ULONG BinNs;
+    ULONGLONG Events;
+    ULONGLONG Histogram[IMOD_LATENCY_BINS];
+} IMOD_LATENCY_DEVICE_RESULT, *PIMOD_LATENCY_DEVICE_RESULT;
+
+typedef struct _IMOD_LATENCY_INTERRUPTER_RESULT
+{
+    ULONG Interval;
+    ULONG Devices;
+    ULONG InterruptsPerSecond;
+    ULONG EventsPerSecond;
+    ULONG P50Ns;
+    ULONG P99Ns;
+    ULONG MaxNs;
+} IMOD_LATENCY_INTERRUPTER_RESULT, *PIMOD_LATENCY_INTERRUPTER_RESULT;
+
+/* Poll period in microframes, or 0 for an unknown speed. */
+ULONG ImodLatencyPeriod(const IMOD_LATENCY_DEVICE *Device);
+
+/*
+ * Simulates the devices bound to Interrupter with IMODI = Interval and
+ * writes their entries of DeviceResults (indexed like Devices). Interrupters
+ * do not interact, so sweeping a whole vector is sweeping each interrupter.
+ */
+ULONG ImodLatencySimulateInterrupter(
+    const IMOD_LATENCY_CONFIG *Config,
+    const IMOD_LATENCY_DEVICE *Devices,
+    ULONG DeviceCount,
+    ULONG Interrupter,
+    ULONG Interval,
+    PIMOD_LATENCY_DEVICE_RESULT DeviceResults,
+    PIMOD_LATENCY_INTERRUPTER_RESULT Result);
+
+/* Every interrupter of Intervals; Results has InterrupterCount entries. */
+ULONG ImodLatencySimulate(
+    const IMOD_LATENCY_CONFIG *Config,
+    const IMOD_LATENCY_DEVICE *Devices,
+    ULONG DeviceCount,
+    const ULONG *Intervals,
+    ULONG InterrupterCount,
+    PIMOD_LATENCY_DEVICE_RESULT DeviceResults,
+    PIMOD_LATENCY_INTERRUPTER_RESULT Results);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,402 @@
+#include "imod_msix.h"
+
+#define IMOD_MSIX_PCI_COMMAND 0x04UL
+#define IMOD_MSIX_PCI_STATUS 0x06UL
+#define IMOD_MSIX_PCI_HEADER_TYPE 0x0EUL
+#define IMOD_MSIX_PCI_BAR0 0x10UL
+#define IMOD_MSIX_PCI_CAPABILITIES 0x34UL
+#define IMOD_MSIX_PCI_COMMAND_MEMORY 0x0002UL
+#define IMOD_MSIX_PCI_STATUS_CAPABILITIES 0x0010UL
+
+#define IMOD_MSIX_CAP_ID_MSI 0x05
+#define IMOD_MSIX_CAP_ID_MSIX 0x11
+
+/* A capability is at least 4 bytes and sits above the 64-byte header. */
+#define IMOD_MSIX_MAX_CAPABILITIES 48UL
+
+#define IMOD_MSIX_APIC_WINDOW_MASK 0xFFF00000ULL
+#define IMOD_MSIX_APIC_WINDOW 0xFEE00000ULL
+
+static ULONG ImodMsixConfig8(const UCHAR *Config, ULONG Length, ULONG Offset)
+{
+    return Offset < Length ? Config[Offset] : 0;
+}
+
+static ULONG ImodMsixConfig16(const UCHAR *Config, ULONG Length, ULONG Offset)
+{
+    return ImodMsixConfig8(Config, Length, Offset) | (ImodMsixConfig8(Config, Length, Offset + 1) << 8);
+}
+
+static ULONG ImodMsixConfig32(const UCHAR *Config, ULONG Length, ULONG Offset)
+{
+    return ImodMsixConfig16(Config, Length, Offset) | (ImodMsixConfig16(Config, Length, Offset + 2) << 16);
+}
+
+/* Memory BAR base for Bir, FALSE for an I/O BAR or one the header type does not have. */
+static BOOLEAN ImodMsixReadBar(const UCHAR *Config, ULONG Length, ULONG Bir, ULONGLONG *Address)
+{
+    ULONG barCount = (ImodMsixConfig8(Config, Length, IMOD_MSIX_PCI_HEADER_TYPE) & 0x7F) == 0 ? 6 : 2;
+    ULONG low;
+
+    if (Bir >= barCount)
+    {
+        return FALSE;
+    }
+
+    low = ImodMsixConfig32(Config, Length, IMOD_MSIX_PCI_BAR0 + (Bir * 4));
+    if ((low & 0x1) != 0)
+    {
+        return FALSE;
+    }
+
+    *Address = low & ~0xFULL;
+
+    /* Type 2 in bits 2:1 is a 64-bit BAR, the next BAR slot holding the high dword. */
+    if (((low >> 1) & 0x3) == 0x2)
+    {
+        if (Bir + 1 >= barCount)
+        {
+            return FALSE;
+        }
+
+        *Address |= (ULONGLONG)ImodMsixConfig32(Config, Length, IMOD_MSIX_PCI_BAR0 + ((Bir + 1) * 4)) << 32;
+    }
+
+    return *Address != 0;
+}
+
+static VOID ImodMsixParseMsi(const UCHAR *Config, ULONG Length, ULONG Offset, PIMOD_MSIX_CAPABILITY Capability)
+{
+    ULONG control = ImodMsixConfig16(Config, Length, Offset + 2);
+    BOOLEAN wide = (control & 0x0080) != 0;
+    ULONG dataOffset = wide ? 0x0C : 0x08;
+
+    Capability->Kind = IMOD_MSIX_KIND_MSI;
+    Capability->Offset = Offset;
+    Capability->Control = control;
+    Capability->Enabled = (control & 0x0001) != 0;
+    Capability->PerVectorMask = (control & 0x0100) != 0;
+    Capability->Address = ImodMsixConfig32(Config, Length, Offset + 4);
+    if (wide)
+    {
+        Capability->Address |= (ULONGLONG)ImodMsixConfig32(Config, Length, Offset + 8) << 32;
+    }
+
+    Capability->Data = ImodMsixConfig16(Config, Length, Offset + dataOffset);
+    Capability->MaskBits = Capability->PerVectorMask ? ImodMsixConfig32(Config, Length, Offset + dataOffset + 4) : 0;
+
+    /* Multiple Message Enable is log2 of the vectors granted, at most 32. */
+    Capability->Vectors = 1UL << ((control >> 4) & 0x7);
+    if (Capability->Vectors > 32)
+    {
+        Capability->Vectors = 32;
+    }
+}
+
+static BOOLEAN ImodMsixParseMsix(const UCHAR *Config, ULONG Length, ULONG Offset, PIMOD_MSIX_CAPABILITY Capability)
+{
+    ULONG control = ImodMsixConfig16(Config, Length, Offset + 2);
+    ULONG table = ImodMsixConfig32(Config, Length, Offset + 4);
+    ULONG pba = ImodMsixConfig32(Config, Length, Offset + 8);
+
+    Capability->Kind = IMOD_MSIX_KIND_MSIX;
+    Capability->Offset = Offset;
+    Capability->Control = control;
+    Capability->Enabled = (control & 0x8000) != 0;
+    Capability->TableSize = (control & 0x07FF) + 1;
+    Capability->TableBir = table & 0x7;
+    Capability->TableOffset = table & 0xFFFFFFF8UL;
+    Capability->PbaBir = pba & 0x7;
+    Capability->PbaOffset = pba & 0xFFFFFFF8UL;
+    Capability->BarAddress = 0;
+
+    return ImodMsixReadBar(Config, Length, Capability->TableBir, &Capability->BarAddress);
+}
+
+ULONG ImodMsixParseConfig(const UCHAR *Config, ULONG Length, PIMOD_MSIX_CAPABILITY Capability)
+{
+    IMOD_MSIX_CAPABILITY msi;
+    IMOD_MSIX_CAPABILITY msix;
+    BOOLEAN haveMsi = FALSE;
+    BOOLEAN haveMsix = FALSE;
+    ULONG offset;
+    ULONG visited;
+
+    if (Config == NULL || Capability == NULL || Length < 0x40)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Capability, sizeof(*Capability));
+    RtlZeroMemory(&msi, sizeof(msi));
+    RtlZeroMemory(&msix, sizeof(msix));
+
+    /* All ones is what a read returns for a function that is absent or powered down. */
+    if (ImodMsixConfig16(Config, Length, 0) == 0xFFFF || ImodMsixConfig16(Config, Length, 0) == 0)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    if ((ImodMsixConfig16(Config, Length, IMOD_MSIX_PCI_STATUS) & IMOD_MSIX_PCI_STATUS_CAPABILITIES) == 0)
+    {
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    offset = ImodMsixConfig8(Config, Length, IMOD_MSIX_PCI_CAPABILITIES) & 0xFC;
+    for (visited = 0; offset >= 0x40 && offset + 4 <= Length && visited < IMOD_MSIX_MAX_CAPABILITIES; ++visited)
+    {
+        ULONG id = ImodMsixConfig8(Config, Length, offset);
+
+        if (id == IMOD_MSIX_CAP_ID_MSI && !haveMsi)
+        {
+            ImodMsixParseMsi(Config, Length, offset, &msi);
+            haveMsi = TRUE;
+        }
+        else if (id == IMOD_MSIX_CAP_ID_MSIX && !haveMsix)
+        {
+            if (!ImodMsixParseMsix(Config, Length, offset, &msix))
+            {
+                return IMOD_RESULT_INVALID_CONTROLLER;
+            }
+
+            haveMsix = TRUE;
+        }
+
+        offset = ImodMsixConfig8(Config, Length, offset + 1) & 0xFC;
+    }
+
+    if (haveMsix && (msix.Enabled || !(haveMsi && msi.Enabled)))
+    {
+        RtlCopyMemory(Capability, &msix, sizeof(msix));
+    }
+    else if (haveMsi)
+    {
+        RtlCopyMemory(Capability, &msi, sizeof(msi));
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+VOID ImodMsixDecodeMessage(
+    ULONGLONG Address,
+    ULONG Data,
+    const IMOD_MSIX_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    struct tagImodMsixEntry *Entry)
+{
+    ULONG index;
+
+    Entry->address = Address;
+    Entry->data = Data;
+    Entry->vector = (UCHAR)(Data & 0xFF);
+    Entry->deliveryMode = (UCHAR)((Data >> 8) & 0x7);
+    Entry->destination = 0;
+    Entry->group = 0;
+    Entry->number = 0;
+    Entry->flags &= IMOD_MSIX_ENTRY_MASKED;
+
+    if ((Data & 0x8000) != 0)
+    {
+        Entry->flags |= IMOD_MSIX_ENTRY_LEVEL;
+    }
+
+    if ((Address & IMOD_MSIX_APIC_WINDOW_MASK) != IMOD_MSIX_APIC_WINDOW)
+    {
+        Entry->flags |= IMOD_MSIX_ENTRY_NOT_APIC;
+        return;
+    }
+
+    /* Remappable format: handle[14:0] in bits 19:5, handle[15] in bit 2, SHV in bit 3. */
+    if ((Address & 0x10) != 0)
+    {
+        Entry->flags |= IMOD_MSIX_ENTRY_REMAPPED;
+        Entry->destination = (ULONG)((Address >> 5) & 0x7FFF) | (ULONG)(((Address >> 2) & 0x1) << 15);
+        if ((Address & 0x8) != 0)
+        {
+            Entry->destination += Data & 0xFFFF;
+        }
+
+        return;
+    }
+
+    /* Destination ID in bits 19:12, extended destination ID in bits 11:5. */
+    Entry->destination = (ULONG)((Address >> 12) & 0xFF) | (ULONG)(((Address >> 5) & 0x7F) << 8);
+    if ((Address & 0x8) != 0)
+    {
+        Entry->flags |= IMOD_MSIX_ENTRY_REDIRECTION_HINT;
+    }
+
+    if ((Address & 0x4) != 0)
+    {
+        Entry->flags |= IMOD_MSIX_ENTRY_LOGICAL;
+        return;
+    }
+
+    for (index = 0; Processors != NULL && index < ProcessorCount; ++index)
+    {
+        if (Processors[index].ApicId == Entry->destination)
+        {
+            Entry->group = Processors[index].Group;
+            Entry->number = Processors[index].Number;
+            Entry->flags |= IMOD_MSIX_ENTRY_RESOLVED;
+            return;
+        }
+    }
+}
+
+static ULONG ImodMsixReadTable(
+    const IMOD_PLATFORM *Platform,
+    struct tagImodMsixHeader *Header,
+    const IMOD_MSIX_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    struct tagImodMsixEntry *Entries)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG result = IMOD_RESULT_SUCCESS;
+    ULONG index;
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            Header->barAddress + Header->tableOffset,
+            Header->entryCount * IMOD_MSIX_ENTRY_SIZE,
+            &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    for (index = 0; index < Header->entryCount; ++index)
+    {
+        ULONG offset = index * IMOD_MSIX_ENTRY_SIZE;
+        ULONG addressLow = 0;
+        ULONG addressHigh = 0;
+        ULONG data = 0;
+        ULONG vectorControl = 0;
+
+        if (!Platform->Read32(Platform->Context, &window, offset, &addressLow) ||
+            !Platform->Read32(Platform->Context, &window, offset + 4, &addressHigh) ||
+            !Platform->Read32(Platform->Context, &window, offset + 8, &data) ||
+            !Platform->Read32(Platform->Context, &window, offset + 12, &vectorControl))
+        {
+            result = IMOD_RESULT_ACCESS_FAILED;
+            break;
+        }
+
+        RtlZeroMemory(&Entries[index], sizeof(Entries[index]));
+        Entries[index].index = (USHORT)index;
+        Entries[index].vectorControl = vectorControl;
+        Entries[index].flags = (vectorControl & 0x1) != 0 ? IMOD_MSIX_ENTRY_MASKED : 0;
+        ImodMsixDecodeMessage(((ULONGLONG)addressHigh << 32) | addressLow, data, Processors, ProcessorCount, &Entries[index]);
+    }
+
+    Platform->UnmapWindow(Platform->Context, &window);
+    return result;
+}
+
+ULONG ImodMsixSnapshot(
+    const IMOD_PLATFORM *Platform,
+    const UCHAR *Config,
+    ULONG ConfigLength,
+    const IMOD_MSIX_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    struct tagImodMsixHeader header;
+    struct tagImodMsixEntry *entries;
+    IMOD_MSIX_CAPABILITY capability;
+    ULONG requiredLength;
+    ULONG result;
+    ULONG index;
+
+    *BytesReturned = 0;
+
+    if (Platform == NULL || Buffer == NULL || InputLength < sizeof(header) || OutputLength < sizeof(header))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&header, Buffer, sizeof(header));
+
+    if (header.version != IMOD_MSIX_VERSION)
+    {
+        return IMOD_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    if (header.flags != 0 || header.entryCapacity > IMOD_MSIX_MAX_TABLE_SIZE)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    requiredLength = sizeof(header) + (header.entryCapacity * sizeof(struct tagImodMsixEntry));
+    if (InputLength < requiredLength || OutputLength < requiredLength)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    result = ImodMsixParseConfig(Config, ConfigLength, &capability);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    header.kind = capability.Kind;
+    header.state = capability.Enabled ? IMOD_MSIX_STATE_ENABLED : 0;
+    header.capabilityOffset = capability.Offset;
+    header.messageControl = capability.Control;
+    header.tableSize = capability.Kind == IMOD_MSIX_KIND_MSI ? capability.Vectors : capability.TableSize;
+    header.tableBir = capability.TableBir;
+    header.tableOffset = capability.TableOffset;
+    header.pbaBir = capability.PbaBir;
+    header.pbaOffset = capability.PbaOffset;
+    header.barAddress = capability.BarAddress;
+    header.entryCount = header.tableSize;
+    if (header.entryCount > header.entryCapacity)
+    {
+        header.entryCount = header.entryCapacity;
+        header.state |= IMOD_MSIX_STATE_TRUNCATED;
+    }
+
+    entries = (struct tagImodMsixEntry *)((UCHAR *)Buffer + sizeof(header));
+    RtlZeroMemory(entries, header.entryCapacity * sizeof(struct tagImodMsixEntry));
+
+    if (capability.Kind == IMOD_MSIX_KIND_MSI)
+    {
+        /* The function owns the low log2(Vectors) bits of the data, one vector per value. */
+        for (index = 0; index < header.entryCount; ++index)
+        {
+            ULONG data = (capability.Data & ~(capability.Vectors - 1)) | index;
+
+            entries[index].index = (USHORT)index;
+            entries[index].vectorControl = (capability.MaskBits >> index) & 0x1;
+            entries[index].flags = entries[index].vectorControl != 0 ? IMOD_MSIX_ENTRY_MASKED : 0;
+            ImodMsixDecodeMessage(capability.Address, data, Processors, ProcessorCount, &entries[index]);
+        }
+    }
+    else if (capability.Kind == IMOD_MSIX_KIND_MSIX && header.entryCount != 0)
+    {
+        if ((capability.Control & 0x4000) != 0)
+        {
+            header.state |= IMOD_MSIX_STATE_FUNCTION_MASKED;
+        }
+
+        /* The table has to be inside the BAR, and the BAR has to be decoding. */
+        if (header.barLength == 0 ||
+            (ULONGLONG)header.tableOffset + ((ULONGLONG)capability.TableSize * IMOD_MSIX_ENTRY_SIZE) > header.barLength ||
+            (ImodMsixConfig16(Config, ConfigLength, IMOD_MSIX_PCI_COMMAND) & IMOD_MSIX_PCI_COMMAND_MEMORY) == 0)
+        {
+            return IMOD_RESULT_INVALID_CONTROLLER;
+        }
+
+        result = ImodMsixReadTable(Platform, &header, Processors, ProcessorCount, entries);
+        if (result != IMOD_RESULT_SUCCESS)
+        {
+            return result;
+        }
+    }
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+    *BytesReturned = requiredLength;
+    return IMOD_RESULT_SUCCESS;
+}
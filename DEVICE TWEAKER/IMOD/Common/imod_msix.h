@@ -0,0 +1,156 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_MSIX_VERSION 1UL
+
+/* Type 0/1 header plus the capability list; MSI and MSI-X both live in it. */
+#define IMOD_MSIX_CONFIG_SIZE 256UL
+#define IMOD_MSIX_MAX_TABLE_SIZE 2048UL
+#define IMOD_MSIX_ENTRY_SIZE 16UL
+
+#define IMOD_MSIX_KIND_NONE 0UL
+#define IMOD_MSIX_KIND_MSI 1UL
+#define IMOD_MSIX_KIND_MSIX 2UL
+
+#define IMOD_MSIX_STATE_ENABLED 0x00000001UL
+#define IMOD_MSIX_STATE_FUNCTION_MASKED 0x00000002UL
+#define IMOD_MSIX_STATE_TRUNCATED 0x00000004UL
+
+#define IMOD_MSIX_ENTRY_MASKED 0x01
+/* Remappable format: destination holds the IRTE handle, the CPU is in the IOMMU. */
+#define IMOD_MSIX_ENTRY_REMAPPED 0x02
+/* Logical destination mode: destination is a logical APIC set, not one CPU. */
+#define IMOD_MSIX_ENTRY_LOGICAL 0x04
+#define IMOD_MSIX_ENTRY_REDIRECTION_HINT 0x08
+#define IMOD_MSIX_ENTRY_LEVEL 0x10
+/* Address outside the 0xFEExxxxx interrupt window, usually an unprogrammed entry. */
+#define IMOD_MSIX_ENTRY_NOT_APIC 0x20
+/* group/number name the processor whose APIC ID is the destination. */
+#define IMOD_MSIX_ENTRY_RESOLVED 0x40
+
+#pragma pack(push, 1)
+
+/*
+ * Request and reply share one buffer: the header is followed by
+ * entryCapacity entry records. Fields up to barLength are input; the rest
+ * are filled in. The table is only read when it lies inside the first
+ * barLength bytes of the BAR the capability names, so the query cannot
+ * be pointed anywhere but the device's own registers. An entryCapacity of
+ * 0 returns the header alone without touching the BAR, which is how a
+ * caller learns which BAR to pass the length of.
+ */
+struct tagImodMsixHeader
+{
+    ULONG version;
+    ULONG flags;
+    ULONG bus;
+    ULONG device;
+    ULONG function;
+    ULONG entryCapacity;
+    ULONGLONG barLength;
+    ULONG kind;
+    ULONG state;
+    ULONG capabilityOffset;
+    ULONG messageControl;
+    ULONG tableSize;
+    ULONG tableBir;
+    ULONG tableOffset;
+    ULONG pbaBir;
+    ULONG pbaOffset;
+    ULONG entryCount;
+    ULONGLONG barAddress;
+};
+
+/*
+ * One vector. destination is the APIC ID, with the extended destination
+ * ID in bits 14:8, or the interrupt remapping handle for a remapped entry.
+ */
+struct tagImodMsixEntry
+{
+    ULONGLONG address;
+    ULONG data;
+    ULONG vectorControl;
+    ULONG destination;
+    USHORT index;
+    USHORT group;
+    UCHAR number;
+    UCHAR vector;
+    UCHAR deliveryMode;
+    UCHAR flags;
+    ULONG reserved;
+};
+
+#pragma pack(pop)
+
+/* APIC ID of one processor, as CPUID leaf 0xB (or leaf 1 EBX[31:24]) reports it there. */
+typedef struct _IMOD_MSIX_PROCESSOR
+{
+    ULONG ApicId;
+    USHORT Group;
+    UCHAR Number;
+    UCHAR Reserved;
+} IMOD_MSIX_PROCESSOR, *PIMOD_MSIX_PROCESSOR;
+
+/*
+ * What the config space says. For MSI the message itself lives in the
+ * capability, so Address, Data and MaskBits are filled in and there is no
+ * table; Vectors is the enabled count (Multiple Message Enable).
+ */
+typedef struct _IMOD_MSIX_CAPABILITY
+{
+    ULONG Kind;
+    ULONG Offset;
+    ULONG Control;
+    ULONG TableSize;
+    ULONG TableBir;
+    ULONG TableOffset;
+    ULONG PbaBir;
+    ULONG PbaOffset;
+    ULONGLONG BarAddress;
+    ULONGLONG Address;
+    ULONG Data;
+    ULONG MaskBits;
+    ULONG Vectors;
+    BOOLEAN Enabled;
+    BOOLEAN PerVectorMask;
+} IMOD_MSIX_CAPABILITY, *PIMOD_MSIX_CAPABILITY;
+
+/*
+ * Walks the capability list of a config-space dump. When a function has
+ * both capabilities the enabled one wins, MSI-X if neither is. Kind is
+ * IMOD_MSIX_KIND_NONE for a function without either.
+ */
+ULONG ImodMsixParseConfig(const UCHAR *Config, ULONG Length, PIMOD_MSIX_CAPABILITY Capability);
+
+/* Decodes one x86 message; Processors may be NULL, leaving the entry unresolved. */
+VOID ImodMsixDecodeMessage(
+    ULONGLONG Address,
+    ULONG Data,
+    const IMOD_MSIX_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    struct tagImodMsixEntry *Entry);
+
+/*
+ * Fills the reply from a config-space dump of the function named in the
+ * header. MSI vectors come from the dump; MSI-X entries are read from the
+ * table through Platform, mapping only the table itself.
+ */
+ULONG ImodMsixSnapshot(
+    const IMOD_PLATFORM *Platform,
+    const UCHAR *Config,
+    ULONG ConfigLength,
+    const IMOD_MSIX_PROCESSOR *Processors,
+    ULONG ProcessorCount,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+#ifdef __cplusplus
+}
+#endif
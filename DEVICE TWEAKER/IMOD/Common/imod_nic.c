@@ -0,0 +1,341 @@
+#include "imod_nic.h"
+
+#define IMOD_NIC_INDEX_MULTIPLIER 0x9E3779B1UL
+
+/* The GUI reads this table through IMODCore.dll (Core/MainForm.NicItr.cs). */
+static const USHORT ImodNicI225Devices[] = {0x15F2, 0x15F3, 0x0D9F, 0x5502, 0x125B, 0x125C, 0x125D, 0x5503};
+static const USHORT ImodNicI210Devices[] = {0x1533, 0x1536, 0x1537, 0x1538, 0x1539, 0x157B, 0x157C, 0x1F40, 0x1F41, 0x1F45};
+static const USHORT ImodNicI350Devices[] = {0x1521, 0x1522, 0x1523, 0x1524};
+static const USHORT ImodNic82580Devices[] = {0x150E, 0x150F, 0x1510, 0x1511};
+static const USHORT ImodNic82576Devices[] = {0x1516, 0x1518, 0x1526};
+static const USHORT ImodNicE3100Devices[] = {0x3100, 0x3101, 0x3102};
+static const USHORT ImodNicI219Devices[] = {
+    0x15B7, 0x15B8, 0x15B9, 0x15D7, 0x15D8, 0x15E3, 0x15BB, 0x15BC, 0x15BD, 0x15BE,
+    0x0D4C, 0x0D4D, 0x0D4E, 0x0D4F, 0x0D53, 0x0D55, 0x0D5C, 0x0D5D, 0x0D5E, 0x0D5F,
+    0x15FB, 0x15FC, 0x1A1E, 0x1A1F, 0x550A, 0x550B, 0x550C, 0x550D, 0x550E, 0x550F,
+    0x0DC5, 0x0DC6, 0x0DC7, 0x0DC8, 0x1A1C, 0x1A1D, 0x15F9, 0x15FA, 0x3166, 0x3167,
+    0x3197, 0x3198, 0x4DF4, 0x4B33, 0x4B34, 0x4DC2, 0x4DC3, 0x54B4, 0x54B5, 0x54B6,
+    0x54B7, 0x0126, 0x153A, 0x153B, 0x1559, 0x155A, 0x156F, 0x1570, 0x15D6};
+static const USHORT ImodNicRtl8168Devices[] = {0x8168, 0x8161, 0x8136, 0x8167, 0x8169};
+static const USHORT ImodNicRtl8125Devices[] = {0x8125, 0x8162, 0x8126};
+static const USHORT ImodNicRtl8168KbDevices[] = {0x3000};
+static const USHORT ImodNicE2600Devices[] = {0x2600, 0x2502, 0x2500};
+
+#define IMOD_NIC_DEVICES(Ids) (Ids), (ULONG)(sizeof(Ids) / sizeof((Ids)[0]))
+
+static const IMOD_NIC_PROFILE ImodNicProfiles[] = {
+    {"Intel I225/I226 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 5, 32, 0x00007FFC, 0x80000000, 1, IMOD_NIC_DEVICES(ImodNicI225Devices)},
+    {"Intel I210/I211 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 4, 32, 0x00007FFC, 0x80000000, 0, IMOD_NIC_DEVICES(ImodNicI210Devices)},
+    {"Intel I350 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 8, 32, 0x00007FFC, 0x80000000, 0, IMOD_NIC_DEVICES(ImodNicI350Devices)},
+    {"Intel 82580 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 10, 32, 0x00007FFC, 0x80000000, 0, IMOD_NIC_DEVICES(ImodNic82580Devices)},
+    {"Intel 82576 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 25, 32, 0x00007FFC, 0x80000000, 0, IMOD_NIC_DEVICES(ImodNic82576Devices)},
+    {"Killer E3100 (EITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_EITR, IMOD_NIC_FAMILY_INTEL_IGB,
+        0x1680, 0x4, 5, 32, 0x00007FFC, 0x80000000, 1, IMOD_NIC_DEVICES(ImodNicE3100Devices)},
+    {"Intel I219 (ITR)", 0x8086, 0, IMOD_BUDGET_MODERATION_INTEL_ITR, IMOD_NIC_FAMILY_INTEL_E1000E,
+        0x00C4, 0x0, 1, 32, 0x0000FFFF, 0, 0, IMOD_NIC_DEVICES(ImodNicI219Devices)},
+    {"Realtek RTL8111/8168", 0x10EC, 0, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT, IMOD_NIC_FAMILY_REALTEK,
+        0x00E2, 0x0, 1, 16, 0x0000FFFF, 0, 0, IMOD_NIC_DEVICES(ImodNicRtl8168Devices)},
+    {"Realtek RTL8125/8126", 0x10EC, 0, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2, IMOD_NIC_FAMILY_REALTEK,
+        0x0A00, 0x8, 4, 32, 0x7F7F7F7F, 0, 0, IMOD_NIC_DEVICES(ImodNicRtl8125Devices)},
+    {"Realtek RTL8168KB", 0x10EC, 0, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT, IMOD_NIC_FAMILY_REALTEK,
+        0x00E2, 0x0, 1, 16, 0x0000FFFF, 0, 0, IMOD_NIC_DEVICES(ImodNicRtl8168KbDevices)},
+    {"Killer E2500/E2600", 0x10EC, 0, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT, IMOD_NIC_FAMILY_REALTEK,
+        0x00E2, 0x0, 1, 16, 0x0000FFFF, 0, 0, IMOD_NIC_DEVICES(ImodNicE2600Devices)},
+};
+
+#define IMOD_NIC_PROFILE_COUNT ((ULONG)(sizeof(ImodNicProfiles) / sizeof(ImodNicProfiles[0])))
+
+ULONG ImodNicProfileCount(VOID)
+{
+    return IMOD_NIC_PROFILE_COUNT;
+}
+
+const IMOD_NIC_PROFILE *ImodNicProfileAt(ULONG Index)
+{
+    return Index < IMOD_NIC_PROFILE_COUNT ? &ImodNicProfiles[Index] : NULL;
+}
+
+static ULONG ImodNicIndexHome(USHORT VendorId, USHORT DeviceId)
+{
+    ULONG key = ((ULONG)VendorId << 16) | DeviceId;
+
+    return (((key * IMOD_NIC_INDEX_MULTIPLIER) & 0xFFFFFFFFUL) >> 24) & (IMOD_NIC_INDEX_SLOTS - 1);
+}
+
+ULONG ImodNicIndexBuild(PIMOD_NIC_INDEX Index)
+{
+    ULONG profile;
+    ULONG device;
+
+    RtlZeroMemory(Index, sizeof(*Index));
+
+    for (profile = 0; profile < IMOD_NIC_PROFILE_COUNT; ++profile)
+    {
+        const IMOD_NIC_PROFILE *entry = &ImodNicProfiles[profile];
+
+        for (device = 0; device < entry->DeviceCount; ++device)
+        {
+            ULONG slot = ImodNicIndexHome(entry->VendorId, entry->DeviceIds[device]);
+            ULONG probes = 1;
+
+            /* Half full at most, so linear probing stays short. */
+            if (Index->Entries >= IMOD_NIC_INDEX_SLOTS / 2)
+            {
+                return IMOD_RESULT_BUFFER_TOO_SMALL;
+            }
+
+            while (Index->Slots[slot] != 0)
+            {
+                slot = (slot + 1) & (IMOD_NIC_INDEX_SLOTS - 1);
+                ++probes;
+            }
+
+            Index->Slots[slot] = ((profile + 1) << 16) | (device + 1);
+            ++Index->Entries;
+            if (probes > Index->MaxProbes)
+            {
+                Index->MaxProbes = probes;
+            }
+        }
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+const IMOD_NIC_PROFILE *ImodNicLookup(const IMOD_NIC_INDEX *Index, USHORT VendorId, USHORT DeviceId)
+{
+    ULONG slot = ImodNicIndexHome(VendorId, DeviceId);
+    ULONG probe;
+
+    for (probe = 0; probe < Index->MaxProbes && Index->Slots[slot] != 0; ++probe)
+    {
+        ULONG profile = (Index->Slots[slot] >> 16) - 1;
+        ULONG device = (Index->Slots[slot] & 0xFFFF) - 1;
+        const IMOD_NIC_PROFILE *entry = &ImodNicProfiles[profile];
+
+        if (entry->VendorId == VendorId && entry->DeviceIds[device] == DeviceId)
+        {
+            return entry;
+        }
+
+        slot = (slot + 1) & (IMOD_NIC_INDEX_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+ULONGLONG ImodNicIntervalNs(const IMOD_NIC_PROFILE *Profile, ULONG Value)
+{
+    return ImodBudgetIntervalNs(Profile->Moderation, Value & Profile->ReadMask);
+}
+
+ULONG ImodNicEncodeIntervalUs(const IMOD_NIC_PROFILE *Profile, ULONG Current, ULONG IntervalUs, ULONG *Value)
+{
+    ULONGLONG unitNs = ImodBudgetIntervalNs(Profile->Moderation, ImodNicSamplerEncodeInterval(Profile->Moderation, 0, 1));
+    ULONGLONG units;
+    ULONG encoded;
+
+    if (unitNs == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    units = (((ULONGLONG)IntervalUs * 1000) + (unitNs / 2)) / unitNs;
+    if (units > 0xFFFFFFFFULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    /* The encoder clamps to the field; a clamped value no longer decodes to the request. */
+    encoded = ImodNicSamplerEncodeInterval(Profile->Moderation, Current, (ULONG)units);
+    if (ImodBudgetIntervalNs(Profile->Moderation, encoded) != units * unitNs)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    *Value = encoded;
+    return IMOD_RESULT_SUCCESS;
+}
+
+static ULONG ImodNicTargetValue(const IMOD_NIC_PROFILE *Profile, const IMOD_NIC_APPLY *Apply, ULONG Vector, ULONG Current, ULONG *Target)
+{
+    ULONG value = Apply->Values[Vector < Apply->Count ? Vector : 0];
+
+    if ((Apply->Flags & IMOD_NIC_APPLY_INTERVAL_US) != 0)
+    {
+        return ImodNicEncodeIntervalUs(Profile, Current, value, Target);
+    }
+
+    *Target = value;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodNicApply(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG BarAddress,
+    ULONGLONG BarLength,
+    const IMOD_NIC_PROFILE *Profile,
+    PIMOD_NIC_APPLY Apply)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG accessSize;
+    ULONG widthMask;
+    ULONGLONG span;
+    ULONG vector;
+
+    if (Platform == NULL || Profile == NULL || Apply == NULL ||
+        (Apply->Flags & ~IMOD_NIC_APPLY_FLAGS_VALID) != 0 ||
+        Apply->Count == 0 || Apply->Count > IMOD_NIC_MAX_VECTORS ||
+        Profile->MaxQueues == 0 || Profile->MaxQueues > IMOD_NIC_MAX_VECTORS ||
+        (Profile->Width != 16 && Profile->Width != 32) || Profile->ReadMask == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    accessSize = Profile->Width / 8;
+    widthMask = Profile->Width == 16 ? 0xFFFFUL : 0xFFFFFFFFUL;
+    if ((Profile->BaseOffset % accessSize) != 0 || (Profile->Stride % accessSize) != 0 ||
+        (Profile->MaxQueues > 1 && Profile->Stride < accessSize) ||
+        ((Profile->ReadMask | Profile->WriteOrBits) & ~widthMask) != 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    /* Encoding does not depend on the other fields, so bad intervals fail before any access. */
+    for (vector = 0; vector < Profile->MaxQueues; ++vector)
+    {
+        ULONG target;
+
+        if (ImodNicTargetValue(Profile, Apply, vector, 0, &target) != IMOD_RESULT_SUCCESS)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    span = ((ULONGLONG)Profile->Stride * (Profile->MaxQueues - 1)) + accessSize;
+    if (BarLength == 0 || Profile->BaseOffset > BarLength || span > BarLength - Profile->BaseOffset ||
+        span > 0xFFFFFFFFULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (!Platform->MapWindow(Platform->Context, BarAddress + Profile->BaseOffset, (ULONG)span, &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    Apply->Applied = 0;
+    Apply->Failed = 0;
+    for (vector = 0; vector < Profile->MaxQueues; ++vector)
+    {
+        ULONG offset = vector * Profile->Stride;
+        ULONGLONG raw = 0;
+        ULONG current;
+        ULONG target = 0;
+
+        Apply->Previous[vector] = 0;
+        Apply->Written[vector] = 0;
+        if (!Platform->ReadRegister(Platform->Context, &window, offset, accessSize, &raw))
+        {
+            Apply->Status[vector] = IMOD_BATCH_STATUS_READ_FAILED;
+            ++Apply->Failed;
+            continue;
+        }
+
+        current = (ULONG)raw & widthMask;
+        Apply->Previous[vector] = current;
+
+        /* An adapter in D3 or behind a dead link reads back as all ones. */
+        if (vector == 0 && current == widthMask)
+        {
+            Platform->UnmapWindow(Platform->Context, &window);
+            return IMOD_RESULT_INVALID_CONTROLLER;
+        }
+
+        (VOID)ImodNicTargetValue(Profile, Apply, vector, current, &target);
+        target &= Profile->ReadMask;
+        if ((Apply->Flags & IMOD_BATCH_FLAG_DIFF) != 0 && (current & Profile->ReadMask) == target)
+        {
+            Apply->Status[vector] = IMOD_BATCH_STATUS_UNCHANGED;
+            continue;
+        }
+
+        Apply->Written[vector] = (current & ~Profile->ReadMask & widthMask) | target | Profile->WriteOrBits;
+        if (!Platform->WriteRegister(Platform->Context, &window, offset, accessSize, Apply->Written[vector]))
+        {
+            Apply->Status[vector] = IMOD_BATCH_STATUS_WRITE_FAILED;
+            ++Apply->Failed;
+            continue;
+        }
+
+        if ((Apply->Flags & IMOD_BATCH_FLAG_VERIFY) != 0)
+        {
+            if (!Platform->ReadRegister(Platform->Context, &window, offset, accessSize, &raw) ||
+                ((ULONG)raw & Profile->ReadMask) != target)
+            {
+                Apply->Status[vector] = IMOD_BATCH_STATUS_VERIFY_FAILED;
+                ++Apply->Failed;
+                continue;
+            }
+
+            Apply->Status[vector] = IMOD_BATCH_STATUS_VERIFIED;
+        }
+        else
+        {
+            Apply->Status[vector] = IMOD_BATCH_STATUS_WRITTEN;
+        }
+
+        ++Apply->Applied;
+    }
+
+    Platform->UnmapWindow(Platform->Context, &window);
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodNicWatchdogEntries(
+    ULONGLONG BarAddress,
+    const IMOD_NIC_PROFILE *Profile,
+    const IMOD_NIC_APPLY *Apply,
+    ULONG GroupId,
+    struct tagImodWatchdogEntry *Entries)
+{
+    ULONG count = 0;
+    ULONG vector;
+
+    for (vector = 0; vector < Profile->MaxQueues && vector < IMOD_NIC_MAX_VECTORS; ++vector)
+    {
+        struct tagImodWatchdogEntry *entry;
+        ULONG now;
+
+        switch (Apply->Status[vector])
+        {
+        case IMOD_BATCH_STATUS_UNCHANGED:
+            now = Apply->Previous[vector];
+            break;
+
+        case IMOD_BATCH_STATUS_WRITTEN:
+        case IMOD_BATCH_STATUS_VERIFIED:
+            now = Apply->Written[vector];
+            break;
+
+        default:
+            continue;
+        }
+
+        entry = &Entries[count++];
+        RtlZeroMemory(entry, sizeof(*entry));
+        entry->address = BarAddress + Profile->BaseOffset + ((ULONGLONG)vector * Profile->Stride);
+        entry->groupId = GroupId;
+        entry->mask = Profile->ReadMask;
+        entry->value = now & Profile->ReadMask;
+        entry->orBits = Profile->WriteOrBits & ~Profile->ReadMask;
+        entry->accessSize = Profile->Width / 8;
+    }
+
+    return count;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_batch.h"
+#include "imod_budget.h"
+#include "imod_nicsampler.h"
+#include "imod_watchdog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_NIC_MAX_VECTORS 32UL
+#define IMOD_NIC_INDEX_SLOTS 256UL
+
+/* Values are interval microseconds, encoded over each register's current value. */
+#define IMOD_NIC_APPLY_INTERVAL_US 0x00000100UL
+#define IMOD_NIC_APPLY_FLAGS_VALID (IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY | IMOD_NIC_APPLY_INTERVAL_US)
+
+/*
+ * Where one adapter family keeps its moderation registers: vector n at
+ * BaseOffset + n * Stride in the first memory BAR, Width bits wide. The
+ * interval and its companion fields live under ReadMask; WriteOrBits are
+ * set on every write and are write strobes (EITR.CNT_WDIS) rather than
+ * state, so they are not expected to read back. FirstQueueVector is 1 when
+ * vector 0 is the "Other" (link and mailbox) vector rather than a queue.
+ */
+typedef struct _IMOD_NIC_PROFILE
+{
+    const char *Name;
+    USHORT VendorId;
+    USHORT Reserved;
+    ULONG Moderation;
+    ULONG Family;
+    ULONG BaseOffset;
+    ULONG Stride;
+    ULONG MaxQueues;
+    ULONG Width;
+    ULONG ReadMask;
+    ULONG WriteOrBits;
+    ULONG FirstQueueVector;
+    const USHORT *DeviceIds;
+    ULONG DeviceCount;
+} IMOD_NIC_PROFILE, *PIMOD_NIC_PROFILE;
+
+/*
+ * Open-addressed VID/DID index over the built-in profiles. A slot holds the
+ * profile number in the high half and the device number in the low half,
+ * both plus one; MaxProbes bounds every lookup.
+ */
+typedef struct _IMOD_NIC_INDEX
+{
+    ULONG Slots[IMOD_NIC_INDEX_SLOTS];
+    ULONG Entries;
+    ULONG MaxProbes;
+} IMOD_NIC_INDEX, *PIMOD_NIC_INDEX;
+
+/*
+ * One masked write of every vector of a profile. Vectors past Count take
+ * Values[0]. Flags are IMOD_BATCH_FLAG_DIFF (leave vectors that already
+ * hold the value under ReadMask), IMOD_BATCH_FLAG_VERIFY (read back under
+ * ReadMask) and IMOD_NIC_APPLY_INTERVAL_US. Previous, Written and Status
+ * (IMOD_BATCH_STATUS_*) are filled in per vector; Applied and Failed count
+ * them the way the xHCI batch does.
+ */
+typedef struct _IMOD_NIC_APPLY
+{
+    ULONG Flags;
+    ULONG Count;
+    ULONG Values[IMOD_NIC_MAX_VECTORS];
+    ULONG Previous[IMOD_NIC_MAX_VECTORS];
+    ULONG Written[IMOD_NIC_MAX_VECTORS];
+    ULONG Status[IMOD_NIC_MAX_VECTORS];
+    ULONG Applied;
+    ULONG Failed;
+} IMOD_NIC_APPLY, *PIMOD_NIC_APPLY;
+
+ULONG ImodNicProfileCount(VOID);
+const IMOD_NIC_PROFILE *ImodNicProfileAt(ULONG Index);
+
+/* IMOD_RESULT_BUFFER_TOO_SMALL when the built-in table outgrows the index. */
+ULONG ImodNicIndexBuild(PIMOD_NIC_INDEX Index);
+
+/* NULL for an adapter without a built-in profile. */
+const IMOD_NIC_PROFILE *ImodNicLookup(const IMOD_NIC_INDEX *Index, USHORT VendorId, USHORT DeviceId);
+
+/* Interval the raw register value programs, in ns; 0 is off. */
+ULONGLONG ImodNicIntervalNs(const IMOD_NIC_PROFILE *Profile, ULONG Value);
+
+/*
+ * Current with its interval field set to the nearest multiple of the
+ * family's timer unit. Frame thresholds and the TX half of the Realtek
+ * registers are kept. IMOD_RESULT_INVALID_PARAMETER for a family without
+ * an interval field or an interval past the field's range.
+ */
+ULONG ImodNicEncodeIntervalUs(const IMOD_NIC_PROFILE *Profile, ULONG Current, ULONG IntervalUs, ULONG *Value);
+
+/*
+ * Every register must lie inside the first BarLength bytes of the BAR;
+ * only the vector registers themselves are mapped.
+ */
+ULONG ImodNicApply(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG BarAddress,
+    ULONGLONG BarLength,
+    const IMOD_NIC_PROFILE *Profile,
+    PIMOD_NIC_APPLY Apply);
+
+/*
+ * Watchdog entries that hold the vectors a successful ImodNicApply left
+ * in place, at the profile's width and with its WriteOrBits. Vectors that
+ * failed are left out. Entries must hold Profile->MaxQueues entries;
+ * returns how many were filled.
+ */
+ULONG ImodNicWatchdogEntries(
+    ULONGLONG BarAddress,
+    const IMOD_NIC_PROFILE *Profile,
+    const IMOD_NIC_APPLY *Apply,
+    ULONG GroupId,
+    struct tagImodWatchdogEntry *Entries);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,414 @@
+#include "imod_nicsampler.h"
+
+#define IMOD_NIC_US_PER_SECOND 1000000ULL
+#define IMOD_NIC_HEAD_MASK 0xFFFFUL
+#define IMOD_NIC_MAX_RING_DESCRIPTORS 0x10000UL
+
+static ULONG ImodNicClamp(ULONGLONG Value)
+{
+    return Value > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (ULONG)Value;
+}
+
+BOOLEAN ImodNicSamplerLayout(ULONG Family, PIMOD_NIC_LAYOUT Layout)
+{
+    RtlZeroMemory(Layout, sizeof(*Layout));
+    Layout->Family = Family;
+    Layout->LengthOffset = 0x08;
+    Layout->HeadOffset = 0x10;
+    Layout->TailOffset = 0x18;
+
+    switch (Family)
+    {
+    case IMOD_NIC_FAMILY_INTEL_IGB:
+        /* The 0x2800 + n * 0x100 block is only an alias of the first four queues. */
+        Layout->MaxQueues = IMOD_NIC_MAX_QUEUES;
+        Layout->RxBase = 0xC000;
+        Layout->TxBase = 0xE000;
+        Layout->QueueStride = 0x40;
+        return TRUE;
+
+    case IMOD_NIC_FAMILY_INTEL_E1000E:
+        Layout->MaxQueues = 1;
+        Layout->RxBase = 0x2800;
+        Layout->TxBase = 0x3800;
+        Layout->QueueStride = 0x100;
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ * Length, head and tail of one ring. A register block that reads back as
+ * all ones belongs to a function in reset or D3, not to a huge ring.
+ */
+static ULONG ImodNicReadRing(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG BarAddress,
+    ULONGLONG BarLength,
+    const IMOD_NIC_LAYOUT *Layout,
+    ULONG Offset,
+    ULONG *Count,
+    ULONG *Head,
+    ULONG *Tail)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG length = 0;
+    ULONG head = 0;
+    ULONG tail = 0;
+    ULONG size = Layout->TailOffset + sizeof(ULONG);
+    BOOLEAN readOk;
+
+    if ((ULONGLONG)Offset + size > BarLength)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (!Platform->MapWindow(Platform->Context, BarAddress + Offset, size, &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &window, Layout->LengthOffset, &length) &&
+        Platform->Read32(Platform->Context, &window, Layout->HeadOffset, &head) &&
+        Platform->Read32(Platform->Context, &window, Layout->TailOffset, &tail);
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    if (length == 0xFFFFFFFFUL)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    *Count = length / IMOD_NIC_DESCRIPTOR_SIZE;
+    *Head = head & IMOD_NIC_HEAD_MASK;
+    *Tail = tail & IMOD_NIC_HEAD_MASK;
+    if (*Count == 0)
+    {
+        *Head = 0;
+        *Tail = 0;
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    if (*Count > IMOD_NIC_MAX_RING_DESCRIPTORS || *Head >= *Count || *Tail >= *Count)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodNicSamplerReadQueue(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG BarAddress,
+    ULONGLONG BarLength,
+    const IMOD_NIC_LAYOUT *Layout,
+    ULONG Queue,
+    ULONGLONG TimeUs,
+    PIMOD_NIC_QUEUE_SAMPLE Sample)
+{
+    ULONG status;
+
+    if (Sample == NULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Sample, sizeof(*Sample));
+    if (Platform == NULL || Layout == NULL || BarAddress == 0 || Queue >= Layout->MaxQueues ||
+        Queue >= IMOD_NIC_MAX_QUEUES || Layout->TailOffset + sizeof(ULONG) > Layout->QueueStride)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    Sample->TimeUs = TimeUs;
+    status = ImodNicReadRing(
+        Platform,
+        BarAddress,
+        BarLength,
+        Layout,
+        Layout->RxBase + (Queue * Layout->QueueStride),
+        &Sample->RxCount,
+        &Sample->RxHead,
+        &Sample->RxTail);
+    if (status == IMOD_RESULT_SUCCESS)
+    {
+        status = ImodNicReadRing(
+            Platform,
+            BarAddress,
+            BarLength,
+            Layout,
+            Layout->TxBase + (Queue * Layout->QueueStride),
+            &Sample->TxCount,
+            &Sample->TxHead,
+            &Sample->TxTail);
+    }
+
+    if (status != IMOD_RESULT_SUCCESS)
+    {
+        RtlZeroMemory(Sample, sizeof(*Sample));
+    }
+
+    return status;
+}
+
+static ULONG ImodNicRingDelta(ULONG Previous, ULONG Current, ULONG Count)
+{
+    return Count != 0 ? (Current + Count - (Previous % Count)) % Count : 0;
+}
+
+static VOID ImodNicUpdateRates(PIMOD_NIC_QUEUE_RATE Rate, ULONG Packets, ULONGLONG Elapsed, ULONG Moderation, ULONG Value)
+{
+    ULONG modelled;
+
+    Rate->TotalPackets += Packets;
+    Rate->ElapsedUs += Elapsed;
+    Rate->PacketsPerSecond = Elapsed != 0 ? ImodNicClamp(((ULONGLONG)Packets * IMOD_NIC_US_PER_SECOND) / Elapsed) : 0;
+    if (Rate->PacketsPerSecond > Rate->PeakPacketsPerSecond)
+    {
+        Rate->PeakPacketsPerSecond = Rate->PacketsPerSecond;
+    }
+
+    if (Rate->ElapsedUs == 0)
+    {
+        return;
+    }
+
+    Rate->AveragePacketsPerSecond = ImodNicClamp((Rate->TotalPackets * IMOD_NIC_US_PER_SECOND) / Rate->ElapsedUs);
+    Rate->InterruptsPerSecondMin = ImodNicClamp((Rate->TailUpdates * IMOD_NIC_US_PER_SECOND) / Rate->ElapsedUs);
+
+    modelled = ImodBudgetInterruptRate(Moderation, Value, Rate->AveragePacketsPerSecond);
+    Rate->InterruptsPerSecond = modelled > Rate->InterruptsPerSecondMin ? modelled : Rate->InterruptsPerSecondMin;
+    Rate->PacketsPerInterruptX100 = Rate->InterruptsPerSecond != 0
+        ? ImodNicClamp(((ULONGLONG)Rate->AveragePacketsPerSecond * 100) / Rate->InterruptsPerSecond)
+        : 0;
+}
+
+VOID ImodNicSamplerAccumulate(
+    PIMOD_NIC_QUEUE_RATE Rate,
+    const IMOD_NIC_QUEUE_SAMPLE *Sample,
+    ULONG Moderation,
+    ULONG Value)
+{
+    ULONG packets;
+    BOOLEAN tailMoved;
+
+    ++Rate->Samples;
+
+    if (!Rate->HasPrevious || Sample->TimeUs < Rate->PreviousTimeUs)
+    {
+        Rate->HasPrevious = TRUE;
+        Rate->PreviousRxHead = Sample->RxHead;
+        Rate->PreviousRxTail = Sample->RxTail;
+        Rate->PreviousTxHead = Sample->TxHead;
+        Rate->PreviousTxTail = Sample->TxTail;
+        Rate->PreviousTimeUs = Sample->TimeUs;
+        return;
+    }
+
+    packets = ImodNicRingDelta(Rate->PreviousRxHead, Sample->RxHead, Sample->RxCount) +
+        ImodNicRingDelta(Rate->PreviousTxHead, Sample->TxHead, Sample->TxCount);
+    tailMoved = Sample->RxTail != Rate->PreviousRxTail || Sample->TxTail != Rate->PreviousTxTail;
+    if (tailMoved)
+    {
+        ++Rate->TailUpdates;
+    }
+
+    ImodNicUpdateRates(Rate, packets, Sample->TimeUs - Rate->PreviousTimeUs, Moderation, Value);
+
+    Rate->PreviousRxHead = Sample->RxHead;
+    Rate->PreviousRxTail = Sample->RxTail;
+    Rate->PreviousTxHead = Sample->TxHead;
+    Rate->PreviousTxTail = Sample->TxTail;
+    Rate->PreviousTimeUs = Sample->TimeUs;
+}
+
+VOID ImodNicSamplerAccumulateCounter(
+    PIMOD_NIC_QUEUE_RATE Rate,
+    ULONGLONG TimeUs,
+    ULONGLONG Packets,
+    ULONG Moderation,
+    ULONG Value)
+{
+    ULONGLONG packets;
+
+    ++Rate->Samples;
+
+    /* A counter that went backwards was reset with the adapter. */
+    if (!Rate->HasPrevious || TimeUs < Rate->PreviousTimeUs || Packets < Rate->PreviousPackets)
+    {
+        Rate->HasPrevious = TRUE;
+        Rate->PreviousPackets = Packets;
+        Rate->PreviousTimeUs = TimeUs;
+        return;
+    }
+
+    packets = Packets - Rate->PreviousPackets;
+    ImodNicUpdateRates(Rate, ImodNicClamp(packets), TimeUs - Rate->PreviousTimeUs, Moderation, Value);
+
+    Rate->PreviousPackets = Packets;
+    Rate->PreviousTimeUs = TimeUs;
+}
+
+static ULONG ImodNicMaxUnits(ULONG Moderation)
+{
+    switch (Moderation)
+    {
+    case IMOD_BUDGET_MODERATION_XHCI_IMODI:
+        return IMOD_XHCI_IMODI_MASK;
+
+    case IMOD_BUDGET_MODERATION_INTEL_EITR:
+        return 0x1FFF;
+
+    case IMOD_BUDGET_MODERATION_INTEL_ITR:
+        return 0xFFFF;
+
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT:
+        return 0xF;
+
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2:
+        return 0x7F;
+
+    default:
+        return 0;
+    }
+}
+
+ULONG ImodNicSamplerEncodeInterval(ULONG Moderation, ULONG Current, ULONG Units)
+{
+    ULONG maxUnits = ImodNicMaxUnits(Moderation);
+
+    if (Units > maxUnits)
+    {
+        Units = maxUnits;
+    }
+
+    switch (Moderation)
+    {
+    case IMOD_BUDGET_MODERATION_INTEL_EITR:
+        return (Current & ~(0x1FFFUL << 2)) | (Units << 2);
+
+    case IMOD_BUDGET_MODERATION_XHCI_IMODI:
+    case IMOD_BUDGET_MODERATION_INTEL_ITR:
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT:
+    case IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2:
+        return (Current & ~maxUnits) | Units;
+
+    default:
+        return Current;
+    }
+}
+
+static VOID ImodNicEvaluate(
+    const IMOD_NIC_TARGET *Target,
+    ULONG Moderation,
+    ULONG Value,
+    ULONG PacketsPerSecond,
+    PIMOD_NIC_RECOMMENDATION Recommendation)
+{
+    ULONGLONG loadNs;
+
+    Recommendation->Value = Value;
+    Recommendation->IntervalNs = ImodNicClamp(ImodBudgetIntervalNs(Moderation, Value));
+    Recommendation->InterruptsPerSecond = ImodBudgetInterruptRate(Moderation, Value, PacketsPerSecond);
+    Recommendation->PacketsPerInterruptX100 = Recommendation->InterruptsPerSecond != 0
+        ? ImodNicClamp(((ULONGLONG)PacketsPerSecond * 100) / Recommendation->InterruptsPerSecond)
+        : 0;
+
+    loadNs = ((ULONGLONG)Recommendation->InterruptsPerSecond * Target->InterruptNs) +
+        ((ULONGLONG)PacketsPerSecond * Target->PacketNs);
+    Recommendation->LoadPermille = ImodNicClamp((loadNs + 500000ULL) / 1000000ULL);
+}
+
+static BOOLEAN ImodNicFits(const IMOD_NIC_TARGET *Target, const IMOD_NIC_RECOMMENDATION *Recommendation)
+{
+    return (Target->MaxInterruptsPerSecond == 0 ||
+               Recommendation->InterruptsPerSecond <= Target->MaxInterruptsPerSecond) &&
+        (Target->MaxLoadPermille == 0 || Recommendation->LoadPermille <= Target->MaxLoadPermille);
+}
+
+ULONG ImodNicSamplerRecommend(
+    const IMOD_NIC_TARGET *Target,
+    ULONG Moderation,
+    ULONG Current,
+    ULONG PacketsPerSecond,
+    PIMOD_NIC_RECOMMENDATION Recommendation)
+{
+    ULONG maxUnits = ImodNicMaxUnits(Moderation);
+    ULONG ceiling = maxUnits;
+    ULONGLONG unitNs;
+    ULONG low;
+    ULONG high;
+
+    if (Target == NULL || Recommendation == NULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Recommendation, sizeof(*Recommendation));
+    if (maxUnits == 0)
+    {
+        ImodNicEvaluate(Target, Moderation, Current, PacketsPerSecond, Recommendation);
+        Recommendation->Reason = IMOD_NIC_REASON_UNSUPPORTED;
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    /* Every family's interval is linear in its field, so one unit gives the ceiling. */
+    unitNs = ImodBudgetIntervalNs(Moderation, ImodNicSamplerEncodeInterval(Moderation, 0, 1));
+    if (Target->MaxLatencyUs != 0 && unitNs != 0)
+    {
+        ULONGLONG units = ((ULONGLONG)Target->MaxLatencyUs * 1000ULL) / unitNs;
+        ceiling = units < maxUnits ? (ULONG)units : maxUnits;
+    }
+
+    ImodNicEvaluate(Target, Moderation, ImodNicSamplerEncodeInterval(Moderation, Current, 0), PacketsPerSecond, Recommendation);
+    if (ImodNicFits(Target, Recommendation))
+    {
+        Recommendation->Reason = IMOD_NIC_REASON_NONE;
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    ImodNicEvaluate(
+        Target,
+        Moderation,
+        ImodNicSamplerEncodeInterval(Moderation, Current, ceiling),
+        PacketsPerSecond,
+        Recommendation);
+    if (!ImodNicFits(Target, Recommendation))
+    {
+        Recommendation->Reason = IMOD_NIC_REASON_LATENCY_CEILING;
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    /* The rate only falls as the interval grows: 0 misses the budget, ceiling meets it. */
+    low = 0;
+    high = ceiling;
+    while (high - low > 1)
+    {
+        ULONG middle = low + ((high - low) / 2);
+
+        ImodNicEvaluate(
+            Target,
+            Moderation,
+            ImodNicSamplerEncodeInterval(Moderation, Current, middle),
+            PacketsPerSecond,
+            Recommendation);
+        if (ImodNicFits(Target, Recommendation))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle;
+        }
+    }
+
+    ImodNicEvaluate(Target, Moderation, ImodNicSamplerEncodeInterval(Moderation, Current, high), PacketsPerSecond, Recommendation);
+    Recommendation->Reason = IMOD_NIC_REASON_BUDGET;
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_budget.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_NIC_FAMILY_NONE 0UL
+/* 82576, 82580, I350, I210/I211, I225/I226: queue n at 0xC000/0xE000 + n * 0x40. */
+#define IMOD_NIC_FAMILY_INTEL_IGB 1UL
+/* I219: one queue pair at 0x2800/0x3800. */
+#define IMOD_NIC_FAMILY_INTEL_E1000E 2UL
+/*
+ * RTL8111/8168/8125: descriptor ownership lives in host memory and the
+ * tally counters are DMA'd there on request, so nothing in the BAR counts
+ * packets. Feed the adapter's OS packet counter to ImodNicSamplerAccumulateCounter.
+ */
+#define IMOD_NIC_FAMILY_REALTEK 3UL
+
+#define IMOD_NIC_MAX_QUEUES 16UL
+#define IMOD_NIC_DESCRIPTOR_SIZE 16UL
+
+#define IMOD_NIC_REASON_NONE 0UL
+#define IMOD_NIC_REASON_BUDGET 1UL
+#define IMOD_NIC_REASON_LATENCY_CEILING 2UL
+#define IMOD_NIC_REASON_UNSUPPORTED 3UL
+
+/*
+ * Where one queue's descriptor rings sit in the BAR. Queue n's registers
+ * are at RxBase/TxBase + n * QueueStride; Length is the ring size in bytes,
+ * Head the hardware's position and Tail the driver's.
+ */
+typedef struct _IMOD_NIC_LAYOUT
+{
+    ULONG Family;
+    ULONG MaxQueues;
+    ULONG RxBase;
+    ULONG TxBase;
+    ULONG QueueStride;
+    ULONG LengthOffset;
+    ULONG HeadOffset;
+    ULONG TailOffset;
+} IMOD_NIC_LAYOUT, *PIMOD_NIC_LAYOUT;
+
+/* One read of a queue pair. A ring with Count 0 is disabled and stays idle. */
+typedef struct _IMOD_NIC_QUEUE_SAMPLE
+{
+    ULONGLONG TimeUs;
+    ULONG RxCount;
+    ULONG RxHead;
+    ULONG RxTail;
+    ULONG TxCount;
+    ULONG TxHead;
+    ULONG TxTail;
+} IMOD_NIC_QUEUE_SAMPLE, *PIMOD_NIC_QUEUE_SAMPLE;
+
+/*
+ * Running statistics for one queue. Neither family exposes a per-queue
+ * interrupt count without clearing the driver's own statistics, so the
+ * interrupt rate is bracketed: the driver moves a tail at most once per
+ * DPC, so intervals in which a tail moved give a floor, and the moderation
+ * model (ImodBudgetInterruptRate) gives the expected rate for the measured
+ * packet rate. InterruptsPerSecond is the larger of the two. Packets are
+ * descriptors, which is one per frame without header split or jumbo chains.
+ */
+typedef struct _IMOD_NIC_QUEUE_RATE
+{
+    BOOLEAN HasPrevious;
+    ULONG PreviousRxHead;
+    ULONG PreviousRxTail;
+    ULONG PreviousTxHead;
+    ULONG PreviousTxTail;
+    ULONGLONG PreviousPackets;
+    ULONGLONG PreviousTimeUs;
+    ULONGLONG Samples;
+    ULONGLONG TotalPackets;
+    ULONGLONG TailUpdates;
+    ULONGLONG ElapsedUs;
+    ULONG PacketsPerSecond;
+    ULONG PeakPacketsPerSecond;
+    ULONG AveragePacketsPerSecond;
+    ULONG InterruptsPerSecondMin;
+    ULONG InterruptsPerSecond;
+    ULONG PacketsPerInterruptX100;
+} IMOD_NIC_QUEUE_RATE, *PIMOD_NIC_QUEUE_RATE;
+
+/*
+ * What a recommendation aims for. MaxLatencyUs caps the moderation
+ * interval and wins over the budget; the budget is MaxInterruptsPerSecond
+ * per vector and MaxLoadPermille of one processor at InterruptNs per
+ * interrupt plus PacketNs per packet. A zero field is not enforced.
+ */
+typedef struct _IMOD_NIC_TARGET
+{
+    ULONG MaxLatencyUs;
+    ULONG MaxInterruptsPerSecond;
+    ULONG MaxLoadPermille;
+    ULONG InterruptNs;
+    ULONG PacketNs;
+} IMOD_NIC_TARGET, *PIMOD_NIC_TARGET;
+
+typedef struct _IMOD_NIC_RECOMMENDATION
+{
+    ULONG Value;
+    ULONG IntervalNs;
+    ULONG InterruptsPerSecond;
+    ULONG PacketsPerInterruptX100;
+    ULONG LoadPermille;
+    ULONG Reason;
+} IMOD_NIC_RECOMMENDATION, *PIMOD_NIC_RECOMMENDATION;
+
+/* FALSE for IMOD_NIC_FAMILY_REALTEK and unknown families: no rings in the BAR. */
+BOOLEAN ImodNicSamplerLayout(ULONG Family, PIMOD_NIC_LAYOUT Layout);
+
+/*
+ * Reads one queue pair. Every register must lie inside the first
+ * BarLength bytes of the BAR, and only the queue's own registers are mapped.
+ */
+ULONG ImodNicSamplerReadQueue(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG BarAddress,
+    ULONGLONG BarLength,
+    const IMOD_NIC_LAYOUT *Layout,
+    ULONG Queue,
+    ULONGLONG TimeUs,
+    PIMOD_NIC_QUEUE_SAMPLE Sample);
+
+/*
+ * Heads only say where the hardware is, not how often it went around, so
+ * sample faster than the ring can fill or laps are lost. Moderation and
+ * Value are the queue's vector setting (IMOD_BUDGET_MODERATION_*).
+ */
+VOID ImodNicSamplerAccumulate(
+    PIMOD_NIC_QUEUE_RATE Rate,
+    const IMOD_NIC_QUEUE_SAMPLE *Sample,
+    ULONG Moderation,
+    ULONG Value);
+
+/* Same statistics from a running packet counter; there are no tails, so no floor. */
+VOID ImodNicSamplerAccumulateCounter(
+    PIMOD_NIC_QUEUE_RATE Rate,
+    ULONGLONG TimeUs,
+    ULONGLONG Packets,
+    ULONG Moderation,
+    ULONG Value);
+
+/* Current with its interval field replaced; the other fields are kept. */
+ULONG ImodNicSamplerEncodeInterval(ULONG Moderation, ULONG Current, ULONG Units);
+
+/*
+ * The shortest interval that keeps PacketsPerSecond inside the budget,
+ * capped by the latency ceiling, encoded over Current. Pass the peak rate
+ * to size for bursts rather than the average.
+ */
+ULONG ImodNicSamplerRecommend(
+    const IMOD_NIC_TARGET *Target,
+    ULONG Moderation,
+    ULONG Current,
+    ULONG PacketsPerSecond,
+    PIMOD_NIC_RECOMMENDATION Recommendation);
+
+#ifdef __cplusplus
+}
+#endif
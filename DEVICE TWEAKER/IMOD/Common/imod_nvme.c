@@ -0,0 +1,439 @@
+#include "imod_nvme.h"
+
+/* Where ImodNvmeApply records the coalescing write among the vector writes it may undo. */
+#define IMOD_NVME_STEP_COALESCING IMOD_NVME_MAX_VECTORS
+
+ULONG ImodNvmeGetFeatureCdw10(ULONG Feature, ULONG Select)
+{
+    return (Feature & 0xFFUL) | ((Select & 0x7UL) << 8);
+}
+
+ULONG ImodNvmeSetFeatureCdw10(ULONG Feature)
+{
+    return Feature & 0xFFUL;
+}
+
+ULONG ImodNvmeEncodeCoalescing(ULONG TimeUs, ULONG Threshold, ULONG *Cdw11)
+{
+    ULONG units;
+
+    if (Cdw11 == NULL || Threshold == 0 || Threshold > IMOD_NVME_MAX_THRESHOLD)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    units = (TimeUs / IMOD_NVME_TIME_UNIT_US) + ((TimeUs % IMOD_NVME_TIME_UNIT_US) >= (IMOD_NVME_TIME_UNIT_US / 2) ? 1 : 0);
+    if (units > 0xFF)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    *Cdw11 = (units << 8) | (Threshold - 1);
+    return IMOD_RESULT_SUCCESS;
+}
+
+VOID ImodNvmeDecodeCoalescing(ULONG Value, ULONG *TimeUs, ULONG *Threshold)
+{
+    *TimeUs = ((Value >> 8) & 0xFFUL) * IMOD_NVME_TIME_UNIT_US;
+    *Threshold = (Value & 0xFFUL) + 1;
+}
+
+ULONG ImodNvmeEncodeVectorConfig(ULONG Vector, BOOLEAN CoalescingDisable)
+{
+    return (Vector & 0xFFFFUL) | (CoalescingDisable ? 0x10000UL : 0);
+}
+
+ULONG ImodNvmeQueueVector(ULONG Queue, ULONG Messages)
+{
+    if (Queue == 0 || Messages <= 1)
+    {
+        return 0;
+    }
+
+    return 1 + ((Queue - 1) % (Messages - 1));
+}
+
+static BOOLEAN ImodNvmeGetVector(const IMOD_NVME_TRANSPORT *Transport, ULONG Select, ULONG Vector, UCHAR *CoalescingDisable)
+{
+    ULONG value = 0;
+
+    if (!Transport->GetFeature(
+            Transport->Context,
+            ImodNvmeGetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG, Select),
+            ImodNvmeEncodeVectorConfig(Vector, FALSE),
+            &value) ||
+        (value & 0xFFFFUL) != Vector)
+    {
+        return FALSE;
+    }
+
+    *CoalescingDisable = (UCHAR)((value >> 16) & 1);
+    return TRUE;
+}
+
+ULONG ImodNvmeRead(const IMOD_NVME_TRANSPORT *Transport, ULONG Select, PIMOD_NVME_STATE State)
+{
+    ULONG value = 0;
+    ULONG vector;
+
+    if (Transport == NULL || Transport->GetFeature == NULL || State == NULL || Select > IMOD_NVME_SELECT_SAVED)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(State, sizeof(*State));
+
+    /* The allocated queue count only exists as a current value. */
+    if (!Transport->GetFeature(
+            Transport->Context,
+            ImodNvmeGetFeatureCdw10(IMOD_NVME_FEATURE_NUMBER_OF_QUEUES, IMOD_NVME_SELECT_CURRENT),
+            0,
+            &value))
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    State->SubmissionQueues = (value & 0xFFFFUL) + 1;
+    State->CompletionQueues = (value >> 16) + 1;
+    if (!Transport->GetFeature(
+            Transport->Context,
+            ImodNvmeGetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_COALESCING, Select),
+            0,
+            &value))
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    State->Coalescing = value & 0xFFFFUL;
+    ImodNvmeDecodeCoalescing(value, &State->Settings.TimeUs, &State->Settings.Threshold);
+    State->Settings.Vectors = State->CompletionQueues < IMOD_NVME_MAX_VECTORS - 1
+        ? State->CompletionQueues + 1
+        : IMOD_NVME_MAX_VECTORS;
+    for (vector = 1; vector < State->Settings.Vectors; ++vector)
+    {
+        State->VectorRead[vector] =
+            ImodNvmeGetVector(Transport, Select, vector, &State->Settings.CoalescingDisable[vector]) ? 1 : 0;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+/*
+ * One vector at Rate completions per second. A window opens with the first
+ * completion and closes after Threshold entries or TimeUs, whichever comes
+ * first; the first completion of the window waits the longest, rounded up.
+ */
+static VOID ImodNvmeModel(ULONG Rate, ULONG TimeUs, ULONG Threshold, ULONG *Interrupts, ULONG *LatencyUs)
+{
+    ULONGLONG batchMilli;
+    ULONGLONG fillUs;
+
+    if (Rate == 0 || TimeUs == 0 || Threshold <= 1)
+    {
+        *Interrupts = Rate;
+        *LatencyUs = 0;
+        return;
+    }
+
+    batchMilli = 1000 + (((ULONGLONG)Rate * TimeUs) / 1000);
+    if (batchMilli > (ULONGLONG)Threshold * 1000)
+    {
+        batchMilli = (ULONGLONG)Threshold * 1000;
+    }
+
+    *Interrupts = (ULONG)((((ULONGLONG)Rate * 1000) + batchMilli - 1) / batchMilli);
+    fillUs = (((ULONGLONG)(Threshold - 1) * 1000000ULL) + Rate - 1) / Rate;
+    *LatencyUs = fillUs < TimeUs ? (ULONG)fillUs : TimeUs;
+}
+
+ULONG ImodNvmePlan(const IMOD_NVME_PLAN_INPUT *Input, PIMOD_NVME_PLAN Plan)
+{
+    ULONGLONG bestTotal = 0;
+    ULONG bestLatency = 0;
+    ULONG bestTime = 0;
+    ULONG bestThreshold = 1;
+    BOOLEAN bestUnder = FALSE;
+    BOOLEAN found = FALSE;
+    ULONG coalesced = 0;
+    ULONG units;
+    ULONG vector;
+
+    if (Input == NULL || Plan == NULL || Input->Vectors == 0 || Input->Vectors > IMOD_NVME_MAX_VECTORS ||
+        Input->MaxInterruptsPerSecond == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Plan, sizeof(*Plan));
+    for (vector = 1; vector < Input->Vectors; ++vector)
+    {
+        if (Input->LatencyCritical[vector] != 0)
+        {
+            Plan->Reason[vector] = IMOD_NVME_VECTOR_LATENCY_CRITICAL;
+        }
+        else if (Input->CompletionsPerSecond[vector] > Input->MaxInterruptsPerSecond)
+        {
+            Plan->Reason[vector] = IMOD_NVME_VECTOR_COALESCED;
+            ++coalesced;
+        }
+        else
+        {
+            Plan->Reason[vector] = IMOD_NVME_VECTOR_UNDER_LIMIT;
+        }
+    }
+
+    /*
+     * Every time and threshold the feature can hold. Under the limit, the
+     * smallest worst-case wait wins and then the fewest interrupts; short of
+     * it, the fewest interrupts. Ties keep the shorter time and the lower
+     * threshold.
+     */
+    for (units = 1; coalesced != 0 && units <= 0xFF; ++units)
+    {
+        ULONG timeUs = units * IMOD_NVME_TIME_UNIT_US;
+        ULONG threshold;
+
+        for (threshold = 2; threshold <= IMOD_NVME_MAX_THRESHOLD; ++threshold)
+        {
+            ULONGLONG total = 0;
+            ULONG worst = 0;
+            BOOLEAN under = TRUE;
+            BOOLEAN better;
+
+            for (vector = 1; vector < Input->Vectors; ++vector)
+            {
+                ULONG interrupts;
+                ULONG latency;
+
+                if (Plan->Reason[vector] != IMOD_NVME_VECTOR_COALESCED)
+                {
+                    continue;
+                }
+
+                ImodNvmeModel(Input->CompletionsPerSecond[vector], timeUs, threshold, &interrupts, &latency);
+                if (latency > Input->LatencyBudgetUs)
+                {
+                    break;
+                }
+
+                total += interrupts;
+                worst = latency > worst ? latency : worst;
+                under = under && interrupts <= Input->MaxInterruptsPerSecond;
+            }
+
+            if (vector < Input->Vectors)
+            {
+                continue;
+            }
+
+            if (!found || under != bestUnder)
+            {
+                better = !found || under;
+            }
+            else if (under)
+            {
+                better = worst < bestLatency || (worst == bestLatency && total < bestTotal);
+            }
+            else
+            {
+                better = total < bestTotal || (total == bestTotal && worst < bestLatency);
+            }
+
+            if (better)
+            {
+                found = TRUE;
+                bestUnder = under;
+                bestTotal = total;
+                bestLatency = worst;
+                bestTime = timeUs;
+                bestThreshold = threshold;
+            }
+        }
+    }
+
+    Plan->Settings.Vectors = Input->Vectors;
+    Plan->Settings.TimeUs = found ? bestTime : 0;
+    Plan->Settings.Threshold = found ? bestThreshold : 1;
+    Plan->UnderLimit = found ? bestUnder : coalesced == 0;
+    for (vector = 1; vector < Input->Vectors; ++vector)
+    {
+        BOOLEAN disable = found && Plan->Reason[vector] != IMOD_NVME_VECTOR_COALESCED;
+
+        Plan->Settings.CoalescingDisable[vector] = disable ? 1 : 0;
+        ImodNvmeModel(
+            Input->CompletionsPerSecond[vector],
+            disable ? 0 : Plan->Settings.TimeUs,
+            disable ? 1 : Plan->Settings.Threshold,
+            &Plan->InterruptsPerSecond[vector],
+            &Plan->AddedLatencyUs[vector]);
+        Plan->TotalInterruptsPerSecond += Plan->InterruptsPerSecond[vector];
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+static BOOLEAN ImodNvmeSetCoalescing(const IMOD_NVME_TRANSPORT *Transport, ULONG Cdw11)
+{
+    ULONG completion = 0;
+
+    return Transport->SetFeature(
+        Transport->Context,
+        ImodNvmeSetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_COALESCING),
+        Cdw11,
+        &completion);
+}
+
+static BOOLEAN ImodNvmeSetVector(const IMOD_NVME_TRANSPORT *Transport, ULONG Vector, UCHAR CoalescingDisable)
+{
+    ULONG completion = 0;
+
+    return Transport->SetFeature(
+        Transport->Context,
+        ImodNvmeSetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG),
+        ImodNvmeEncodeVectorConfig(Vector, CoalescingDisable != 0),
+        &completion);
+}
+
+ULONG ImodNvmeApply(const IMOD_NVME_TRANSPORT *Transport, PIMOD_NVME_APPLY Apply)
+{
+    IMOD_NVME_STATE state;
+    ULONG written[IMOD_NVME_MAX_VECTORS + 1];
+    ULONG writtenCount = 0;
+    ULONG targetCoalescing;
+    ULONG previousCoalescing;
+    ULONG value = 0;
+    ULONG vector;
+    ULONG status;
+
+    if (Transport == NULL || Transport->GetFeature == NULL || Transport->SetFeature == NULL || Apply == NULL ||
+        (Apply->Flags & ~IMOD_NVME_APPLY_FLAGS_VALID) != 0 || Apply->Target.Vectors > IMOD_NVME_MAX_VECTORS ||
+        ImodNvmeEncodeCoalescing(Apply->Target.TimeUs, Apply->Target.Threshold, &targetCoalescing) != IMOD_RESULT_SUCCESS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    status = ImodNvmeRead(Transport, IMOD_NVME_SELECT_CURRENT, &state);
+    if (status != IMOD_RESULT_SUCCESS)
+    {
+        return status;
+    }
+
+    /* Nothing is written unless every setting it touches could be read back first. */
+    for (vector = 1; vector < Apply->Target.Vectors; ++vector)
+    {
+        if (vector >= state.Settings.Vectors || state.VectorRead[vector] == 0)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+    }
+
+    RtlZeroMemory(&Apply->Previous, sizeof(Apply->Previous));
+    Apply->Previous.TimeUs = state.Settings.TimeUs;
+    Apply->Previous.Threshold = state.Settings.Threshold;
+    Apply->Previous.Vectors = Apply->Target.Vectors;
+    RtlCopyMemory(Apply->Previous.CoalescingDisable, state.Settings.CoalescingDisable, Apply->Target.Vectors);
+    previousCoalescing = state.Coalescing;
+    Apply->CoalescingStatus = IMOD_BATCH_STATUS_INACTIVE;
+    for (vector = 0; vector < IMOD_NVME_MAX_VECTORS; ++vector)
+    {
+        Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_INACTIVE;
+    }
+
+    Apply->Applied = 0;
+    Apply->RolledBack = 0;
+    Apply->RollbackFailed = 0;
+
+    /* Vectors before the coalescing, so a vector that must not be coalesced never is in between. */
+    for (vector = 1; vector < Apply->Target.Vectors; ++vector)
+    {
+        UCHAR target = Apply->Target.CoalescingDisable[vector] != 0 ? 1 : 0;
+        UCHAR readBack = 0;
+
+        if ((Apply->Flags & IMOD_BATCH_FLAG_DIFF) != 0 && Apply->Previous.CoalescingDisable[vector] == target)
+        {
+            Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_UNCHANGED;
+            continue;
+        }
+
+        if (!ImodNvmeSetVector(Transport, vector, target))
+        {
+            Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_WRITE_FAILED;
+            goto RollBack;
+        }
+
+        written[writtenCount++] = vector;
+        if ((Apply->Flags & IMOD_BATCH_FLAG_VERIFY) != 0)
+        {
+            if (!ImodNvmeGetVector(Transport, IMOD_NVME_SELECT_CURRENT, vector, &readBack) || readBack != target)
+            {
+                Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_VERIFY_FAILED;
+                goto RollBack;
+            }
+
+            Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_VERIFIED;
+        }
+        else
+        {
+            Apply->VectorStatus[vector] = IMOD_BATCH_STATUS_WRITTEN;
+        }
+
+        ++Apply->Applied;
+    }
+
+    if ((Apply->Flags & IMOD_BATCH_FLAG_DIFF) != 0 && previousCoalescing == targetCoalescing)
+    {
+        Apply->CoalescingStatus = IMOD_BATCH_STATUS_UNCHANGED;
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    if (!ImodNvmeSetCoalescing(Transport, targetCoalescing))
+    {
+        Apply->CoalescingStatus = IMOD_BATCH_STATUS_WRITE_FAILED;
+        goto RollBack;
+    }
+
+    written[writtenCount++] = IMOD_NVME_STEP_COALESCING;
+    if ((Apply->Flags & IMOD_BATCH_FLAG_VERIFY) != 0)
+    {
+        if (!Transport->GetFeature(
+                Transport->Context,
+                ImodNvmeGetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_COALESCING, IMOD_NVME_SELECT_CURRENT),
+                0,
+                &value) ||
+            (value & 0xFFFFUL) != targetCoalescing)
+        {
+            Apply->CoalescingStatus = IMOD_BATCH_STATUS_VERIFY_FAILED;
+            goto RollBack;
+        }
+
+        Apply->CoalescingStatus = IMOD_BATCH_STATUS_VERIFIED;
+    }
+    else
+    {
+        Apply->CoalescingStatus = IMOD_BATCH_STATUS_WRITTEN;
+    }
+
+    ++Apply->Applied;
+    return IMOD_RESULT_SUCCESS;
+
+RollBack:
+    while (writtenCount > 0)
+    {
+        BOOLEAN restored;
+
+        vector = written[--writtenCount];
+        restored = vector == IMOD_NVME_STEP_COALESCING
+            ? ImodNvmeSetCoalescing(Transport, previousCoalescing)
+            : ImodNvmeSetVector(Transport, vector, Apply->Previous.CoalescingDisable[vector]);
+        if (restored)
+        {
+            ++Apply->RolledBack;
+        }
+        else
+        {
+            ++Apply->RollbackFailed;
+        }
+    }
+
+    return IMOD_RESULT_ACCESS_FAILED;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Admin vector plus 64 I/O completion queue vectors. */
+#define IMOD_NVME_MAX_VECTORS 65UL
+
+#define IMOD_NVME_FEATURE_NUMBER_OF_QUEUES 0x07UL
+#define IMOD_NVME_FEATURE_INTERRUPT_COALESCING 0x08UL
+#define IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG 0x09UL
+
+/* Get Features SEL. */
+#define IMOD_NVME_SELECT_CURRENT 0UL
+#define IMOD_NVME_SELECT_DEFAULT 1UL
+#define IMOD_NVME_SELECT_SAVED 2UL
+
+/* Aggregation time is programmed in 100 us units, threshold as a 0's based entry count. */
+#define IMOD_NVME_TIME_UNIT_US 100UL
+#define IMOD_NVME_MAX_TIME_US (255UL * IMOD_NVME_TIME_UNIT_US)
+#define IMOD_NVME_MAX_THRESHOLD 256UL
+
+/*
+ * Only current values are written: the Windows storage pass-through cannot set SV, so
+ * nothing here asks the controller to keep them across a reset.
+ */
+#define IMOD_NVME_APPLY_FLAGS_VALID (IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY)
+
+/* Why the planner left a vector where it is. */
+#define IMOD_NVME_VECTOR_COALESCED 0UL
+#define IMOD_NVME_VECTOR_UNDER_LIMIT 1UL
+#define IMOD_NVME_VECTOR_LATENCY_CRITICAL 2UL
+
+/*
+ * Get/Set Features through whatever pass-through the host has: the storage
+ * protocol IOCTLs on Windows, a mock controller in IMODBench. Cdw10 holds
+ * the feature identifier, with SEL on a get; Completion receives
+ * dword 0 of the completion queue entry. FALSE is a failed command.
+ */
+typedef struct _IMOD_NVME_TRANSPORT
+{
+    PVOID Context;
+    BOOLEAN (*GetFeature)(PVOID Context, ULONG Cdw10, ULONG Cdw11, ULONG *Completion);
+    BOOLEAN (*SetFeature)(PVOID Context, ULONG Cdw10, ULONG Cdw11, ULONG *Completion);
+} IMOD_NVME_TRANSPORT, *PIMOD_NVME_TRANSPORT;
+
+/*
+ * Controller-wide Interrupt Coalescing plus the per-vector Coalescing
+ * Disable bits of vectors 1 .. Vectors - 1. Coalescing is off when TimeUs
+ * is 0 or Threshold is 1. Vector 0 belongs to the admin queue, which is
+ * never coalesced, and is not touched.
+ */
+typedef struct _IMOD_NVME_SETTINGS
+{
+    ULONG TimeUs;
+    ULONG Threshold;
+    ULONG Vectors;
+    UCHAR CoalescingDisable[IMOD_NVME_MAX_VECTORS];
+} IMOD_NVME_SETTINGS, *PIMOD_NVME_SETTINGS;
+
+/*
+ * What ImodNvmeRead found. Vectors is the allocated I/O completion queue
+ * count plus the admin vector; VectorRead is 0 for a vector the controller
+ * refused to report, which is normal when it has fewer MSI-X messages than
+ * queues.
+ */
+typedef struct _IMOD_NVME_STATE
+{
+    ULONG SubmissionQueues;
+    ULONG CompletionQueues;
+    ULONG Coalescing;
+    IMOD_NVME_SETTINGS Settings;
+    UCHAR VectorRead[IMOD_NVME_MAX_VECTORS];
+} IMOD_NVME_STATE, *PIMOD_NVME_STATE;
+
+/*
+ * Measured traffic for the planner. Vectors above MaxInterruptsPerSecond
+ * are coalesced, the rest and the LatencyCritical ones get Coalescing
+ * Disable; no coalesced vector may wait longer than LatencyBudgetUs.
+ */
+typedef struct _IMOD_NVME_PLAN_INPUT
+{
+    ULONG Vectors;
+    ULONG CompletionsPerSecond[IMOD_NVME_MAX_VECTORS];
+    UCHAR LatencyCritical[IMOD_NVME_MAX_VECTORS];
+    ULONG LatencyBudgetUs;
+    ULONG MaxInterruptsPerSecond;
+} IMOD_NVME_PLAN_INPUT, *PIMOD_NVME_PLAN_INPUT;
+
+/*
+ * The least coalescing that brings every coalesced vector under the limit,
+ * or, when the budget does not allow that, the fewest interrupts within the
+ * budget. Predictions are per vector; Reason is IMOD_NVME_VECTOR_*.
+ */
+typedef struct _IMOD_NVME_PLAN
+{
+    IMOD_NVME_SETTINGS Settings;
+    ULONG InterruptsPerSecond[IMOD_NVME_MAX_VECTORS];
+    ULONG AddedLatencyUs[IMOD_NVME_MAX_VECTORS];
+    ULONG Reason[IMOD_NVME_MAX_VECTORS];
+    ULONGLONG TotalInterruptsPerSecond;
+    BOOLEAN UnderLimit;
+} IMOD_NVME_PLAN, *PIMOD_NVME_PLAN;
+
+/*
+ * One all-or-nothing apply of Target. Previous is read first; with
+ * IMOD_BATCH_FLAG_DIFF settings that already hold are not written, with
+ * IMOD_BATCH_FLAG_VERIFY each write is read back. The first failed write or
+ * readback restores everything written so far, newest first, and the apply
+ * returns IMOD_RESULT_ACCESS_FAILED; RolledBack counts the restores and
+ * RollbackFailed the ones the controller refused too. CoalescingStatus and
+ * VectorStatus are IMOD_BATCH_STATUS_*.
+ */
+typedef struct _IMOD_NVME_APPLY
+{
+    ULONG Flags;
+    IMOD_NVME_SETTINGS Target;
+    IMOD_NVME_SETTINGS Previous;
+    ULONG CoalescingStatus;
+    ULONG VectorStatus[IMOD_NVME_MAX_VECTORS];
+    ULONG Applied;
+    ULONG RolledBack;
+    ULONG RollbackFailed;
+} IMOD_NVME_APPLY, *PIMOD_NVME_APPLY;
+
+ULONG ImodNvmeGetFeatureCdw10(ULONG Feature, ULONG Select);
+ULONG ImodNvmeSetFeatureCdw10(ULONG Feature);
+
+/*
+ * TimeUs rounds to the nearest 100 us. IMOD_RESULT_INVALID_PARAMETER for a
+ * threshold outside 1 .. 256 or a time past 25.5 ms.
+ */
+ULONG ImodNvmeEncodeCoalescing(ULONG TimeUs, ULONG Threshold, ULONG *Cdw11);
+VOID ImodNvmeDecodeCoalescing(ULONG Value, ULONG *TimeUs, ULONG *Threshold);
+
+ULONG ImodNvmeEncodeVectorConfig(ULONG Vector, BOOLEAN CoalescingDisable);
+
+/*
+ * StorNVMe's layout: the admin queue and I/O queue 1 share message 0 when
+ * the controller granted a single message, otherwise I/O queue n (from 1)
+ * takes message n, wrapping over messages 1 .. Messages - 1.
+ */
+ULONG ImodNvmeQueueVector(ULONG Queue, ULONG Messages);
+
+ULONG ImodNvmeRead(const IMOD_NVME_TRANSPORT *Transport, ULONG Select, PIMOD_NVME_STATE State);
+
+ULONG ImodNvmePlan(const IMOD_NVME_PLAN_INPUT *Input, PIMOD_NVME_PLAN Plan);
+
+ULONG ImodNvmeApply(const IMOD_NVME_TRANSPORT *Transport, PIMOD_NVME_APPLY Apply);
+
+#ifdef __cplusplus
+}
+#endif
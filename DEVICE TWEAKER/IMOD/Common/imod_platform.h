@@ -0,0 +1,47 @@
+#pragma once
+
+#include "imod_portable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_RESULT_SUCCESS 0UL
+#define IMOD_RESULT_INVALID_PARAMETER 1UL
+#define IMOD_RESULT_BUFFER_TOO_SMALL 2UL
+#define IMOD_RESULT_UNSUPPORTED_VERSION 3UL
+#define IMOD_RESULT_MAP_FAILED 4UL
+#define IMOD_RESULT_ACCESS_FAILED 5UL
+#define IMOD_RESULT_INVALID_CONTROLLER 6UL
+#define IMOD_RESULT_TOO_MANY_SESSIONS 7UL
+#define IMOD_RESULT_INVALID_SESSION 8UL
+#define IMOD_RESULT_INVALID_TABLE 9UL
+
+typedef struct _IMOD_REGISTER_WINDOW
+{
+    ULONGLONG PhysicalAddress;
+    ULONG Length;
+    PVOID Address;
+    PVOID MappingBase;
+    SIZE_T MappingSize;
+} IMOD_REGISTER_WINDOW, *PIMOD_REGISTER_WINDOW;
+
+/*
+ * Register access used by the shared engine. DTIMOD backs it with
+ * MmMapIoSpace mappings; user-mode hosts back it with a register file.
+ * ReadRegister/WriteRegister take 1, 2, 4 or 8 byte accesses.
+ */
+typedef struct _IMOD_PLATFORM
+{
+    PVOID Context;
+    BOOLEAN (*MapWindow)(PVOID Context, ULONGLONG PhysicalAddress, ULONG Length, PIMOD_REGISTER_WINDOW Window);
+    VOID (*UnmapWindow)(PVOID Context, PIMOD_REGISTER_WINDOW Window);
+    BOOLEAN (*Read32)(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG *Value);
+    BOOLEAN (*Write32)(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG Value);
+    BOOLEAN (*ReadRegister)(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG *Value);
+    BOOLEAN (*WriteRegister)(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG Value);
+} IMOD_PLATFORM, *PIMOD_PLATFORM;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * The shared IMOD engine sources are compiled into DTIMOD.sys, into IMOD.exe
+ * and into plain user-mode builds on hosts without the WDK. Kernel and Win32
+ * builds take the base types from their own headers; everything else gets the
+ * small stand-in below.
+ */
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t UCHAR;
+typedef uint16_t USHORT;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef uint64_t ULONGLONG;
+typedef int64_t LONGLONG;
+typedef uint8_t BOOLEAN;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef void *PVOID;
+
+#ifndef VOID
+#define VOID void
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#endif
@@ -0,0 +1,389 @@
+#include "imod_rss.h"
+
+static ULONG ImodRssKeyWindow(const UCHAR *Key, ULONG Bit)
+{
+    ULONG byte = Bit / 8;
+    ULONG shift = Bit % 8;
+    ULONGLONG window =
+        ((ULONGLONG)Key[byte] << 32) |
+        ((ULONGLONG)Key[byte + 1] << 24) |
+        ((ULONGLONG)Key[byte + 2] << 16) |
+        ((ULONGLONG)Key[byte + 3] << 8) |
+        (ULONGLONG)Key[byte + 4];
+
+    return (ULONG)((window >> (8 - shift)) & 0xFFFFFFFFULL);
+}
+
+ULONG ImodRssToeplitzPrepare(const UCHAR *Key, ULONG KeyLength, PIMOD_RSS_TOEPLITZ Toeplitz)
+{
+    ULONG position;
+
+    if (Key == NULL || Toeplitz == NULL || KeyLength < IMOD_RSS_KEY_SIZE)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (position = 0; position < IMOD_RSS_MAX_INPUT; ++position)
+    {
+        ULONG windows[8];
+        ULONG value;
+        ULONG bit;
+
+        /* Bit 0 is the byte's most significant bit, which meets the key first. */
+        for (bit = 0; bit < 8; ++bit)
+        {
+            windows[bit] = ImodRssKeyWindow(Key, (position * 8) + bit);
+        }
+
+        Toeplitz->Table[position][0] = 0;
+        for (value = 1; value < 256; ++value)
+        {
+            ULONG lowest = value & (0U - value);
+            ULONG index = 0;
+
+            while ((0x80U >> index) != lowest)
+            {
+                ++index;
+            }
+
+            Toeplitz->Table[position][value] = Toeplitz->Table[position][value ^ lowest] ^ windows[index];
+        }
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodRssHashReference(const UCHAR *Key, ULONG KeyLength, const UCHAR *Input, ULONG InputLength)
+{
+    ULONG result = 0;
+    ULONG byte;
+
+    if (KeyLength < InputLength + 4)
+    {
+        return 0;
+    }
+
+    for (byte = 0; byte < InputLength; ++byte)
+    {
+        ULONG bit;
+
+        for (bit = 0; bit < 8; ++bit)
+        {
+            if ((Input[byte] & (0x80U >> bit)) != 0)
+            {
+                result ^= ImodRssKeyWindow(Key, (byte * 8) + bit);
+            }
+        }
+    }
+
+    return result;
+}
+
+ULONG ImodRssFlowInput(const IMOD_RSS_FLOW *Flow, UCHAR *Input)
+{
+    ULONG addressLength;
+    ULONG length;
+
+    if (Flow->Family == IMOD_RSS_FAMILY_IPV4)
+    {
+        addressLength = 4;
+    }
+    else if (Flow->Family == IMOD_RSS_FAMILY_IPV6)
+    {
+        addressLength = 16;
+    }
+    else
+    {
+        return 0;
+    }
+
+    RtlCopyMemory(Input, Flow->Source, addressLength);
+    RtlCopyMemory(Input + addressLength, Flow->Destination, addressLength);
+    length = addressLength * 2;
+    if (Flow->HasPorts)
+    {
+        Input[length] = (UCHAR)(Flow->SourcePort >> 8);
+        Input[length + 1] = (UCHAR)Flow->SourcePort;
+        Input[length + 2] = (UCHAR)(Flow->DestinationPort >> 8);
+        Input[length + 3] = (UCHAR)Flow->DestinationPort;
+        length += 4;
+    }
+
+    return length;
+}
+
+ULONG ImodRssHash(const IMOD_RSS_TOEPLITZ *Toeplitz, const UCHAR *Input, ULONG InputLength)
+{
+    ULONG result = 0;
+    ULONG position;
+
+    if (InputLength > IMOD_RSS_MAX_INPUT)
+    {
+        return 0;
+    }
+
+    for (position = 0; position < InputLength; ++position)
+    {
+        result ^= Toeplitz->Table[position][Input[position]];
+    }
+
+    return result;
+}
+
+/* The TCP/IPv4 4-tuple, which is nearly all captured traffic, fully unrolled. */
+static ULONG ImodRssHashIpv4Ports(const IMOD_RSS_FLOW *Flow, const ULONG (*Table)[256])
+{
+    return Table[0][Flow->Source[0]] ^ Table[1][Flow->Source[1]] ^
+        Table[2][Flow->Source[2]] ^ Table[3][Flow->Source[3]] ^
+        Table[4][Flow->Destination[0]] ^ Table[5][Flow->Destination[1]] ^
+        Table[6][Flow->Destination[2]] ^ Table[7][Flow->Destination[3]] ^
+        Table[8][Flow->SourcePort >> 8] ^ Table[9][Flow->SourcePort & 0xFF] ^
+        Table[10][Flow->DestinationPort >> 8] ^ Table[11][Flow->DestinationPort & 0xFF];
+}
+
+VOID ImodRssHashFlows(const IMOD_RSS_TOEPLITZ *Toeplitz, const IMOD_RSS_FLOW *Flows, ULONG Count, ULONG *Hashes)
+{
+    const ULONG (*table)[256] = Toeplitz->Table;
+    ULONG index;
+
+    /* Straight from the flow fields: staging the input with ImodRssFlowInput costs more than the lookups. */
+    for (index = 0; index < Count; ++index)
+    {
+        const IMOD_RSS_FLOW *flow = &Flows[index];
+        ULONG addressLength;
+        ULONG result = 0;
+        ULONG byte;
+
+        if (flow->Family == IMOD_RSS_FAMILY_IPV4 && flow->HasPorts)
+        {
+            Hashes[index] = ImodRssHashIpv4Ports(flow, table);
+            continue;
+        }
+
+        if (flow->Family == IMOD_RSS_FAMILY_IPV4)
+        {
+            addressLength = 4;
+        }
+        else if (flow->Family == IMOD_RSS_FAMILY_IPV6)
+        {
+            addressLength = 16;
+        }
+        else
+        {
+            Hashes[index] = 0;
+            continue;
+        }
+
+        for (byte = 0; byte < addressLength; ++byte)
+        {
+            result ^= table[byte][flow->Source[byte]] ^ table[addressLength + byte][flow->Destination[byte]];
+        }
+
+        if (flow->HasPorts)
+        {
+            byte = addressLength * 2;
+            result ^= table[byte][flow->SourcePort >> 8] ^ table[byte + 1][flow->SourcePort & 0xFF] ^
+                table[byte + 2][flow->DestinationPort >> 8] ^ table[byte + 3][flow->DestinationPort & 0xFF];
+        }
+
+        Hashes[index] = result;
+    }
+}
+
+VOID ImodRssBucketsReset(PIMOD_RSS_BUCKETS Buckets)
+{
+    RtlZeroMemory(Buckets, sizeof(*Buckets));
+}
+
+VOID ImodRssBucketsAdd(PIMOD_RSS_BUCKETS Buckets, const IMOD_RSS_FLOW *Flows, const ULONG *Hashes, ULONG Count)
+{
+    ULONG index;
+
+    for (index = 0; index < Count; ++index)
+    {
+        ULONG bucket = Hashes[index] & (IMOD_RSS_MAX_TABLE - 1);
+        ULONG weight = Flows[index].Weight != 0 ? Flows[index].Weight : 1;
+
+        Buckets->Weight[bucket] += weight;
+        ++Buckets->Flows[bucket];
+        Buckets->TotalWeight += weight;
+    }
+
+    Buckets->TotalFlows += Count;
+}
+
+static BOOLEAN ImodRssCandidateValid(const IMOD_RSS_CANDIDATE *Candidate)
+{
+    ULONG entry;
+
+    if (Candidate->TableSize == 0 || Candidate->TableSize > IMOD_RSS_MAX_TABLE ||
+        (Candidate->TableSize & (Candidate->TableSize - 1)) != 0)
+    {
+        return FALSE;
+    }
+
+    if (Candidate->TableKind == IMOD_RSS_TABLE_EXPLICIT)
+    {
+        for (entry = 0; entry < Candidate->TableSize; ++entry)
+        {
+            if (Candidate->Indirection[entry] >= IMOD_RSS_MAX_PROCESSORS)
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    if (Candidate->Queues == 0)
+    {
+        return Candidate->TableKind == IMOD_RSS_TABLE_EXPLICIT;
+    }
+
+    return Candidate->Stride != 0 &&
+        (ULONGLONG)Candidate->BaseProcessor + ((ULONGLONG)(Candidate->Queues - 1) * Candidate->Stride) < IMOD_RSS_MAX_PROCESSORS;
+}
+
+/* Entry e of a TableSize table collects every bucket with the same low bits. */
+static VOID ImodRssFold(const IMOD_RSS_BUCKETS *Buckets, ULONG TableSize, ULONGLONG *Weight, ULONG *Flows)
+{
+    ULONG bucket;
+
+    RtlZeroMemory(Weight, sizeof(ULONGLONG) * TableSize);
+    RtlZeroMemory(Flows, sizeof(ULONG) * TableSize);
+    for (bucket = 0; bucket < IMOD_RSS_MAX_TABLE; ++bucket)
+    {
+        Weight[bucket & (TableSize - 1)] += Buckets->Weight[bucket];
+        Flows[bucket & (TableSize - 1)] += Buckets->Flows[bucket];
+    }
+}
+
+ULONG ImodRssFillIndirection(PIMOD_RSS_CANDIDATE Candidate, const IMOD_RSS_BUCKETS *Buckets)
+{
+    ULONGLONG weight[IMOD_RSS_MAX_TABLE];
+    ULONG flows[IMOD_RSS_MAX_TABLE];
+    UCHAR order[IMOD_RSS_MAX_TABLE];
+    ULONGLONG load[IMOD_RSS_MAX_PROCESSORS];
+    ULONG entry;
+
+    if (Candidate == NULL || !ImodRssCandidateValid(Candidate) ||
+        (Candidate->TableKind != IMOD_RSS_TABLE_EXPLICIT && Candidate->Queues == 0) ||
+        (Candidate->TableKind == IMOD_RSS_TABLE_BALANCED && Buckets == NULL))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Candidate->TableKind == IMOD_RSS_TABLE_EXPLICIT)
+    {
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    if (Candidate->TableKind == IMOD_RSS_TABLE_ROUND_ROBIN)
+    {
+        for (entry = 0; entry < Candidate->TableSize; ++entry)
+        {
+            Candidate->Indirection[entry] =
+                (UCHAR)(Candidate->BaseProcessor + ((entry % Candidate->Queues) * Candidate->Stride));
+        }
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    if (Candidate->TableKind != IMOD_RSS_TABLE_BALANCED)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    ImodRssFold(Buckets, Candidate->TableSize, weight, flows);
+
+    /* Heaviest entry first; ties keep table order so the fill is stable. */
+    for (entry = 0; entry < Candidate->TableSize; ++entry)
+    {
+        ULONG slot = entry;
+
+        while (slot > 0 && weight[order[slot - 1]] < weight[entry])
+        {
+            order[slot] = order[slot - 1];
+            --slot;
+        }
+        order[slot] = (UCHAR)entry;
+    }
+
+    RtlZeroMemory(load, sizeof(load));
+    for (entry = 0; entry < Candidate->TableSize; ++entry)
+    {
+        ULONG queue;
+        ULONG best = 0;
+
+        for (queue = 1; queue < Candidate->Queues; ++queue)
+        {
+            if (load[queue] < load[best])
+            {
+                best = queue;
+            }
+        }
+
+        load[best] += weight[order[entry]];
+        Candidate->Indirection[order[entry]] = (UCHAR)(Candidate->BaseProcessor + (best * Candidate->Stride));
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodRssEvaluate(const IMOD_RSS_BUCKETS *Buckets, const IMOD_RSS_CANDIDATE *Candidate, PIMOD_RSS_SPREAD Spread)
+{
+    ULONGLONG weight[IMOD_RSS_MAX_TABLE];
+    ULONG flows[IMOD_RSS_MAX_TABLE];
+    BOOLEAN member[IMOD_RSS_MAX_PROCESSORS];
+    ULONGLONG total = 0;
+    ULONG members = 0;
+    ULONG processor;
+    ULONG entry;
+
+    if (Buckets == NULL || Candidate == NULL || Spread == NULL || !ImodRssCandidateValid(Candidate))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Spread, sizeof(*Spread));
+    RtlZeroMemory(member, sizeof(member));
+    ImodRssFold(Buckets, Candidate->TableSize, weight, flows);
+
+    /* A queue the table never points at is still one of the candidate's processors, just idle. */
+    for (processor = 0; processor < Candidate->Queues; ++processor)
+    {
+        member[Candidate->BaseProcessor + (processor * Candidate->Stride)] = TRUE;
+    }
+
+    for (entry = 0; entry < Candidate->TableSize; ++entry)
+    {
+        processor = Candidate->Indirection[entry];
+        member[processor] = TRUE;
+        Spread->Load[processor] += weight[entry];
+        Spread->Flows[processor] += flows[entry];
+        total += weight[entry];
+    }
+
+    for (processor = 0; processor < IMOD_RSS_MAX_PROCESSORS; ++processor)
+    {
+        if (!member[processor])
+        {
+            continue;
+        }
+
+        ++members;
+        if (Spread->Load[processor] == 0)
+        {
+            ++Spread->IdleProcessors;
+        }
+        if (members == 1 || Spread->Load[processor] > Spread->Load[Spread->HotProcessor])
+        {
+            Spread->HotProcessor = processor;
+        }
+    }
+
+    if (total != 0)
+    {
+        Spread->HotSharePermille = (ULONG)((Spread->Load[Spread->HotProcessor] * 1000ULL) / total);
+        Spread->ImbalancePermille = (ULONG)((Spread->Load[Spread->HotProcessor] * 1000ULL * members) / total);
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
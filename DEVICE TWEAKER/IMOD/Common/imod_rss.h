@@ -0,0 +1,125 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 40 bytes cover the IPv6 4-tuple: every input bit needs the 32 key bits from its own on. */
+#define IMOD_RSS_KEY_SIZE 40UL
+#define IMOD_RSS_MAX_INPUT 36UL
+#define IMOD_RSS_MAX_TABLE 128UL
+#define IMOD_RSS_MAX_PROCESSORS 64UL
+
+#define IMOD_RSS_FAMILY_IPV4 4
+#define IMOD_RSS_FAMILY_IPV6 6
+
+/* How a candidate's indirection table is filled. */
+#define IMOD_RSS_TABLE_ROUND_ROBIN 0UL
+#define IMOD_RSS_TABLE_EXPLICIT 1UL
+#define IMOD_RSS_TABLE_BALANCED 2UL
+
+/*
+ * One captured flow. Addresses are in network order, ports in host order;
+ * without HasPorts the flow hashes as NDIS_HASH_IPV4/IPV6 (addresses only)
+ * instead of the TCP types. Weight is what the flow costs the processor
+ * that receives it, in packets or bytes; 0 counts as 1.
+ */
+typedef struct _IMOD_RSS_FLOW
+{
+    UCHAR Family;
+    UCHAR HasPorts;
+    USHORT Reserved;
+    UCHAR Source[16];
+    UCHAR Destination[16];
+    USHORT SourcePort;
+    USHORT DestinationPort;
+    ULONG Weight;
+} IMOD_RSS_FLOW, *PIMOD_RSS_FLOW;
+
+/*
+ * The key expanded for byte-at-a-time hashing: Table[p][v] is what input
+ * byte p holding v XORs into the hash, so a 4-tuple costs one lookup per
+ * input byte instead of one key shift per input bit.
+ */
+typedef struct _IMOD_RSS_TOEPLITZ
+{
+    ULONG Table[IMOD_RSS_MAX_INPUT][256];
+} IMOD_RSS_TOEPLITZ, *PIMOD_RSS_TOEPLITZ;
+
+/*
+ * Captured traffic by indirection table entry. NDIS indexes the table with
+ * the low bits of the hash, so a table of any smaller power-of-two size
+ * folds these buckets and the flows only have to be hashed once.
+ */
+typedef struct _IMOD_RSS_BUCKETS
+{
+    ULONGLONG Weight[IMOD_RSS_MAX_TABLE];
+    ULONG Flows[IMOD_RSS_MAX_TABLE];
+    ULONGLONG TotalWeight;
+    ULONGLONG TotalFlows;
+} IMOD_RSS_BUCKETS, *PIMOD_RSS_BUCKETS;
+
+/*
+ * One RSS configuration: Queues processors from BaseProcessor, Stride
+ * apart (2 keeps SMT siblings out), and a TableSize-entry indirection table.
+ * ImodRssFillIndirection writes Indirection for the round-robin fill NDIS
+ * miniports use and for the balanced fill; explicit tables are taken as set.
+ */
+typedef struct _IMOD_RSS_CANDIDATE
+{
+    ULONG BaseProcessor;
+    ULONG Queues;
+    ULONG Stride;
+    ULONG TableSize;
+    ULONG TableKind;
+    UCHAR Indirection[IMOD_RSS_MAX_TABLE];
+} IMOD_RSS_CANDIDATE, *PIMOD_RSS_CANDIDATE;
+
+/*
+ * Where a candidate puts the captured traffic. ImbalancePermille is the
+ * busiest processor's load over the mean of the candidate's processors
+ * (1000 is an even spread); IdleProcessors received nothing.
+ */
+typedef struct _IMOD_RSS_SPREAD
+{
+    ULONGLONG Load[IMOD_RSS_MAX_PROCESSORS];
+    ULONG Flows[IMOD_RSS_MAX_PROCESSORS];
+    ULONG HotProcessor;
+    ULONG ImbalancePermille;
+    ULONG HotSharePermille;
+    ULONG IdleProcessors;
+} IMOD_RSS_SPREAD, *PIMOD_RSS_SPREAD;
+
+/* IMOD_RSS_KEY_SIZE bytes or more; bytes past it are not used. */
+ULONG ImodRssToeplitzPrepare(const UCHAR *Key, ULONG KeyLength, PIMOD_RSS_TOEPLITZ Toeplitz);
+
+/* The bit-serial algorithm from the NDIS RSS specification, for checking the tables. */
+ULONG ImodRssHashReference(const UCHAR *Key, ULONG KeyLength, const UCHAR *Input, ULONG InputLength);
+
+/* Source, destination, then the ports in network order; 0 for a bad family. */
+ULONG ImodRssFlowInput(const IMOD_RSS_FLOW *Flow, UCHAR *Input);
+
+ULONG ImodRssHash(const IMOD_RSS_TOEPLITZ *Toeplitz, const UCHAR *Input, ULONG InputLength);
+
+/* Hashes[i] for Flows[i]; a flow with a bad family hashes to 0. */
+VOID ImodRssHashFlows(const IMOD_RSS_TOEPLITZ *Toeplitz, const IMOD_RSS_FLOW *Flows, ULONG Count, ULONG *Hashes);
+
+VOID ImodRssBucketsReset(PIMOD_RSS_BUCKETS Buckets);
+VOID ImodRssBucketsAdd(PIMOD_RSS_BUCKETS Buckets, const IMOD_RSS_FLOW *Flows, const ULONG *Hashes, ULONG Count);
+
+/*
+ * IMOD_RESULT_INVALID_PARAMETER for a table size that is not a power
+ * of two up to IMOD_RSS_MAX_TABLE, or processors past IMOD_RSS_MAX_PROCESSORS.
+ * The balanced fill hands the heaviest buckets out first, each to the
+ * processor with the least load so far: what a dynamic rebalance of the
+ * table could reach for this traffic.
+ */
+ULONG ImodRssFillIndirection(PIMOD_RSS_CANDIDATE Candidate, const IMOD_RSS_BUCKETS *Buckets);
+
+ULONG ImodRssEvaluate(const IMOD_RSS_BUCKETS *Buckets, const IMOD_RSS_CANDIDATE *Candidate, PIMOD_RSS_SPREAD Spread);
+
+#ifdef __cplusplus
+}
+#endif
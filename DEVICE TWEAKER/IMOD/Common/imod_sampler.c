@@ -0,0 +1,376 @@
+#include "imod_sampler.h"
+
+#define IMOD_SAMPLER_US_PER_SECOND 1000000ULL
+#define IMOD_SAMPLER_NS_PER_SECOND 1000000000ULL
+
+static BOOLEAN ImodSamplerRead64(
+    const IMOD_PLATFORM *Platform,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONGLONG *Value)
+{
+    ULONG low = 0;
+    ULONG high = 0;
+
+    if (!Platform->Read32(Platform->Context, Window, Offset, &low) ||
+        !Platform->Read32(Platform->Context, Window, Offset + sizeof(ULONG), &high))
+    {
+        return FALSE;
+    }
+
+    *Value = ((ULONGLONG)high << 32) | low;
+    return TRUE;
+}
+
+ULONG ImodSamplerReadEventRing(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG RuntimeAddress,
+    ULONG Interrupter,
+    PIMOD_EVENT_RING Ring)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG segmentCount = 0;
+    ULONGLONG tableAddress = 0;
+    BOOLEAN readOk;
+    ULONG index;
+
+    RtlZeroMemory(Ring, sizeof(*Ring));
+
+    if (Platform == NULL || RuntimeAddress == 0 || Interrupter >= IMOD_XHCI_MAX_INTERRUPTERS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            RuntimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(Interrupter),
+            IMOD_XHCI_INTERRUPTER_STRIDE,
+            &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &window, IMOD_XHCI_ERSTSZ_OFFSET, &segmentCount) &&
+        ImodSamplerRead64(Platform, &window, IMOD_XHCI_ERSTBA_OFFSET, &tableAddress);
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    /* Secondary interrupters the host driver never set up have no table. */
+    segmentCount &= IMOD_XHCI_ERSTSZ_MASK;
+    tableAddress &= IMOD_XHCI_ERST_BASE_MASK;
+    if (segmentCount == 0 || segmentCount > IMOD_SAMPLER_MAX_SEGMENTS || tableAddress == 0)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    if (!Platform->MapWindow(Platform->Context, tableAddress, segmentCount * IMOD_XHCI_ERST_ENTRY_SIZE, &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = TRUE;
+    for (index = 0; index < segmentCount && readOk; ++index)
+    {
+        ULONGLONG segmentBase = 0;
+        ULONG segmentSize = 0;
+
+        readOk = ImodSamplerRead64(Platform, &window, index * IMOD_XHCI_ERST_ENTRY_SIZE, &segmentBase) &&
+            Platform->Read32(Platform->Context, &window, (index * IMOD_XHCI_ERST_ENTRY_SIZE) + 8, &segmentSize);
+
+        segmentBase &= IMOD_XHCI_ERST_BASE_MASK;
+        segmentSize &= IMOD_XHCI_ERST_SIZE_MASK;
+        Ring->SegmentBase[index] = segmentBase;
+        Ring->SegmentTrbs[index] = segmentSize;
+        Ring->TrbCount += segmentSize;
+
+        if (readOk && (segmentBase == 0 || segmentSize < IMOD_XHCI_MIN_EVENT_SEGMENT_TRBS ||
+                segmentSize > IMOD_XHCI_MAX_EVENT_SEGMENT_TRBS))
+        {
+            Platform->UnmapWindow(Platform->Context, &window);
+            RtlZeroMemory(Ring, sizeof(*Ring));
+            return IMOD_RESULT_INVALID_CONTROLLER;
+        }
+    }
+
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        RtlZeroMemory(Ring, sizeof(*Ring));
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    Ring->TableAddress = tableAddress;
+    Ring->SegmentCount = segmentCount;
+    return IMOD_RESULT_SUCCESS;
+}
+
+BOOLEAN ImodSamplerDequeueIndex(const IMOD_EVENT_RING *Ring, ULONGLONG Erdp, ULONG *Index)
+{
+    ULONGLONG pointer = Erdp & IMOD_XHCI_RING_POINTER_MASK;
+    ULONG first = 0;
+    ULONG segment;
+
+    for (segment = 0; segment < Ring->SegmentCount; ++segment)
+    {
+        ULONGLONG base = Ring->SegmentBase[segment];
+
+        if (pointer >= base && pointer < base + ((ULONGLONG)Ring->SegmentTrbs[segment] * IMOD_XHCI_TRB_SIZE))
+        {
+            *Index = first + (ULONG)((pointer - base) / IMOD_XHCI_TRB_SIZE);
+            return TRUE;
+        }
+
+        first += Ring->SegmentTrbs[segment];
+    }
+
+    return FALSE;
+}
+
+static BOOLEAN ImodSamplerLocateTrb(const IMOD_EVENT_RING *Ring, ULONG Index, ULONG *Segment, ULONG *Offset)
+{
+    ULONG segment;
+
+    for (segment = 0; segment < Ring->SegmentCount; ++segment)
+    {
+        if (Index < Ring->SegmentTrbs[segment])
+        {
+            *Segment = segment;
+            *Offset = Index * IMOD_XHCI_TRB_SIZE;
+            return TRUE;
+        }
+
+        Index -= Ring->SegmentTrbs[segment];
+    }
+
+    return FALSE;
+}
+
+/*
+ * Counts events the controller has produced but software has not consumed.
+ * The TRB just behind the dequeue pointer carries the consumer cycle state
+ * (inverted when the dequeue pointer has just wrapped to index 0); pending
+ * TRBs are the run ahead of it that still match that cycle.
+ */
+static ULONG ImodSamplerCountPending(
+    const IMOD_PLATFORM *Platform,
+    const IMOD_EVENT_RING *Ring,
+    ULONG DequeueIndex,
+    ULONG ScanLimit,
+    ULONG *Pending)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG mappedSegment = IMOD_SAMPLER_MAX_SEGMENTS;
+    ULONG consumerCycle = 0;
+    ULONG limit = ScanLimit < Ring->TrbCount ? ScanLimit : Ring->TrbCount - 1;
+    ULONG result = IMOD_RESULT_SUCCESS;
+    ULONG step;
+
+    *Pending = 0;
+
+    for (step = 0; step <= limit; ++step)
+    {
+        /* Step 0 reads the last consumed TRB; the rest walk forward from the dequeue pointer. */
+        ULONG index = step == 0
+            ? (DequeueIndex + Ring->TrbCount - 1) % Ring->TrbCount
+            : (DequeueIndex + step - 1) % Ring->TrbCount;
+        ULONG segment = 0;
+        ULONG offset = 0;
+        ULONG control = 0;
+        ULONG expected;
+
+        if (!ImodSamplerLocateTrb(Ring, index, &segment, &offset))
+        {
+            result = IMOD_RESULT_INVALID_CONTROLLER;
+            break;
+        }
+
+        if (segment != mappedSegment)
+        {
+            if (mappedSegment != IMOD_SAMPLER_MAX_SEGMENTS)
+            {
+                Platform->UnmapWindow(Platform->Context, &window);
+                mappedSegment = IMOD_SAMPLER_MAX_SEGMENTS;
+            }
+
+            if (!Platform->MapWindow(
+                    Platform->Context,
+                    Ring->SegmentBase[segment],
+                    Ring->SegmentTrbs[segment] * IMOD_XHCI_TRB_SIZE,
+                    &window))
+            {
+                result = IMOD_RESULT_MAP_FAILED;
+                break;
+            }
+
+            mappedSegment = segment;
+        }
+
+        if (!Platform->Read32(Platform->Context, &window, offset + 12, &control))
+        {
+            result = IMOD_RESULT_ACCESS_FAILED;
+            break;
+        }
+
+        if (step == 0)
+        {
+            consumerCycle = control & IMOD_XHCI_TRB_CYCLE;
+            if (DequeueIndex == 0)
+            {
+                consumerCycle ^= IMOD_XHCI_TRB_CYCLE;
+            }
+            continue;
+        }
+
+        expected = index < DequeueIndex ? consumerCycle ^ IMOD_XHCI_TRB_CYCLE : consumerCycle;
+        if ((control & IMOD_XHCI_TRB_CYCLE) != expected)
+        {
+            break;
+        }
+
+        ++*Pending;
+    }
+
+    if (mappedSegment != IMOD_SAMPLER_MAX_SEGMENTS)
+    {
+        Platform->UnmapWindow(Platform->Context, &window);
+    }
+
+    return result;
+}
+
+ULONG ImodSamplerReadInterrupter(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG RuntimeAddress,
+    ULONG Interrupter,
+    const IMOD_EVENT_RING *Ring,
+    ULONG ScanLimit,
+    ULONGLONG TimeUs,
+    PIMOD_INTERRUPTER_SAMPLE Sample)
+{
+    IMOD_REGISTER_WINDOW window;
+    BOOLEAN readOk;
+
+    RtlZeroMemory(Sample, sizeof(*Sample));
+    Sample->TimeUs = TimeUs;
+    Sample->Pending = IMOD_SAMPLER_PENDING_UNKNOWN;
+
+    if (Platform == NULL || Ring == NULL || Ring->TrbCount == 0 || Interrupter >= IMOD_XHCI_MAX_INTERRUPTERS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            RuntimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(Interrupter),
+            IMOD_XHCI_INTERRUPTER_STRIDE,
+            &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &window, IMOD_XHCI_IMAN_OFFSET, &Sample->Iman) &&
+        Platform->Read32(Platform->Context, &window, IMOD_XHCI_IMOD_OFFSET, &Sample->Imod) &&
+        ImodSamplerRead64(Platform, &window, IMOD_XHCI_ERDP_OFFSET, &Sample->Erdp);
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    /* All ones is a controller in D3; a pointer outside the ring means the ERST was rebuilt. */
+    if (Sample->Iman == 0xFFFFFFFFUL || !ImodSamplerDequeueIndex(Ring, Sample->Erdp, &Sample->DequeueIndex))
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    if (ScanLimit == 0)
+    {
+        return IMOD_RESULT_SUCCESS;
+    }
+
+    return ImodSamplerCountPending(Platform, Ring, Sample->DequeueIndex, ScanLimit, &Sample->Pending);
+}
+
+ULONG ImodSamplerInterruptCeiling(ULONG ImodValue)
+{
+    ULONG interval = ImodValue & IMOD_XHCI_IMODI_MASK;
+
+    if (interval == 0)
+    {
+        return 0;
+    }
+
+    return (ULONG)(IMOD_SAMPLER_NS_PER_SECOND / ((ULONGLONG)interval * IMOD_XHCI_IMODI_TICK_NS));
+}
+
+/*
+ * The dequeue pointer only says where software is, not how often it went
+ * around, so sample faster than the ring can fill or laps are lost.
+ */
+VOID ImodSamplerAccumulate(
+    PIMOD_INTERRUPTER_RATE Rate,
+    const IMOD_EVENT_RING *Ring,
+    const IMOD_INTERRUPTER_SAMPLE *Sample)
+{
+    ULONGLONG elapsed;
+    ULONG events;
+    ULONG ceiling;
+
+    ++Rate->Samples;
+
+    if (Sample->Pending != IMOD_SAMPLER_PENDING_UNKNOWN && Sample->Pending > Rate->PeakPending)
+    {
+        Rate->PeakPending = Sample->Pending;
+    }
+
+    if (!Rate->HasPrevious || Sample->TimeUs < Rate->PreviousTimeUs || Ring->TrbCount == 0)
+    {
+        Rate->HasPrevious = TRUE;
+        Rate->PreviousIndex = Sample->DequeueIndex;
+        Rate->PreviousTimeUs = Sample->TimeUs;
+        return;
+    }
+
+    events = (Sample->DequeueIndex + Ring->TrbCount - (Rate->PreviousIndex % Ring->TrbCount)) % Ring->TrbCount;
+    elapsed = Sample->TimeUs - Rate->PreviousTimeUs;
+
+    Rate->TotalEvents += events;
+    Rate->ElapsedUs += elapsed;
+    if (events != 0)
+    {
+        ++Rate->DequeueUpdates;
+    }
+
+    Rate->LastEvents = events;
+    Rate->LastElapsedUs = elapsed > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (ULONG)elapsed;
+    Rate->EventsPerSecond = elapsed != 0 ? (ULONG)(((ULONGLONG)events * IMOD_SAMPLER_US_PER_SECOND) / elapsed) : 0;
+    if (Rate->EventsPerSecond > Rate->PeakEventsPerSecond)
+    {
+        Rate->PeakEventsPerSecond = Rate->EventsPerSecond;
+    }
+
+    Rate->EventsPerUpdateX100 = Rate->DequeueUpdates != 0
+        ? (ULONG)((Rate->TotalEvents * 100) / Rate->DequeueUpdates)
+        : 0;
+
+    /* Every interrupt carries at least one event, so the floor is 1.00. */
+    Rate->EventsPerInterruptMinX100 = 0;
+    if (Rate->EventsPerSecond != 0)
+    {
+        ceiling = ImodSamplerInterruptCeiling(Sample->Imod);
+        Rate->EventsPerInterruptMinX100 = 100;
+        if (ceiling != 0 && ((ULONGLONG)Rate->EventsPerSecond * 100) / ceiling > 100)
+        {
+            Rate->EventsPerInterruptMinX100 = (ULONG)(((ULONGLONG)Rate->EventsPerSecond * 100) / ceiling);
+        }
+    }
+
+    Rate->PreviousIndex = Sample->DequeueIndex;
+    Rate->PreviousTimeUs = Sample->TimeUs;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_SAMPLER_MAX_SEGMENTS 16UL
+#define IMOD_SAMPLER_DEFAULT_SCAN 64UL
+#define IMOD_SAMPLER_PENDING_UNKNOWN 0xFFFFFFFFUL
+
+/*
+ * Event ring geometry of one interrupter, read from its ERST. Ring indexes
+ * run over all segments in table order, so a dequeue position is a single
+ * number in [0, TrbCount).
+ */
+typedef struct _IMOD_EVENT_RING
+{
+    ULONGLONG TableAddress;
+    ULONG SegmentCount;
+    ULONG TrbCount;
+    ULONGLONG SegmentBase[IMOD_SAMPLER_MAX_SEGMENTS];
+    ULONG SegmentTrbs[IMOD_SAMPLER_MAX_SEGMENTS];
+} IMOD_EVENT_RING, *PIMOD_EVENT_RING;
+
+typedef struct _IMOD_INTERRUPTER_SAMPLE
+{
+    ULONGLONG TimeUs;
+    ULONG Iman;
+    ULONG Imod;
+    ULONGLONG Erdp;
+    ULONG DequeueIndex;
+    ULONG Pending;
+} IMOD_INTERRUPTER_SAMPLE, *PIMOD_INTERRUPTER_SAMPLE;
+
+/*
+ * Running statistics for one interrupter. The controller's interrupt count
+ * is not visible in registers, so events per interrupt is bracketed:
+ * the dequeue pointer moves at most once per interrupt (upper bound), and
+ * IMODI caps the interrupt rate (lower bound). Ratios are in hundredths.
+ */
+typedef struct _IMOD_INTERRUPTER_RATE
+{
+    BOOLEAN HasPrevious;
+    ULONG PreviousIndex;
+    ULONGLONG PreviousTimeUs;
+    ULONGLONG Samples;
+    ULONGLONG TotalEvents;
+    ULONGLONG DequeueUpdates;
+    ULONGLONG ElapsedUs;
+    ULONG LastEvents;
+    ULONG LastElapsedUs;
+    ULONG EventsPerSecond;
+    ULONG PeakEventsPerSecond;
+    ULONG EventsPerUpdateX100;
+    ULONG EventsPerInterruptMinX100;
+    ULONG PeakPending;
+} IMOD_INTERRUPTER_RATE, *PIMOD_INTERRUPTER_RATE;
+
+ULONG ImodSamplerReadEventRing(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG RuntimeAddress,
+    ULONG Interrupter,
+    PIMOD_EVENT_RING Ring);
+
+BOOLEAN ImodSamplerDequeueIndex(const IMOD_EVENT_RING *Ring, ULONGLONG Erdp, ULONG *Index);
+
+ULONG ImodSamplerReadInterrupter(
+    const IMOD_PLATFORM *Platform,
+    ULONGLONG RuntimeAddress,
+    ULONG Interrupter,
+    const IMOD_EVENT_RING *Ring,
+    ULONG ScanLimit,
+    ULONGLONG TimeUs,
+    PIMOD_INTERRUPTER_SAMPLE Sample);
+
+ULONG ImodSamplerInterruptCeiling(ULONG ImodValue);
+
+VOID ImodSamplerAccumulate(
+    PIMOD_INTERRUPTER_RATE Rate,
+    const IMOD_EVENT_RING *Ring,
+    const IMOD_INTERRUPTER_SAMPLE *Sample);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+#include "imod_session.h"
+#include "imod_xhci.h"
+
+static PIMOD_SESSION ImodSessionFind(PIMOD_SESSION_TABLE Table, ULONG SessionId)
+{
+    ULONG index;
+
+    if (SessionId == 0)
+    {
+        return NULL;
+    }
+
+    for (index = 0; index < IMOD_SESSION_MAX_PER_HANDLE; ++index)
+    {
+        if (Table->Sessions[index].Id == SessionId)
+        {
+            return &Table->Sessions[index];
+        }
+    }
+
+    return NULL;
+}
+
+static ULONG ImodSessionCheckAccess(const IMOD_SESSION *Session, ULONG Offset, ULONG AccessSize)
+{
+    if (AccessSize != sizeof(UCHAR) && AccessSize != sizeof(USHORT) &&
+        AccessSize != sizeof(ULONG) && AccessSize != sizeof(ULONGLONG))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if ((Offset & (AccessSize - 1)) != 0 ||
+        Offset > Session->Window.Length ||
+        Session->Window.Length - Offset < AccessSize)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+VOID ImodSessionTableInitialize(PIMOD_SESSION_TABLE Table)
+{
+    RtlZeroMemory(Table, sizeof(*Table));
+    Table->NextId = 1;
+}
+
+ULONG ImodSessionOpen(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONGLONG PhysicalAddress,
+    ULONG Length,
+    ULONG *SessionId)
+{
+    PIMOD_SESSION session = NULL;
+    ULONG index;
+
+    *SessionId = 0;
+
+    if (PhysicalAddress == 0 || Length == 0 || Length > IMOD_XHCI_MAX_CONTROLLER_WINDOW)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (index = 0; index < IMOD_SESSION_MAX_PER_HANDLE; ++index)
+    {
+        if (Table->Sessions[index].Id == 0)
+        {
+            session = &Table->Sessions[index];
+            break;
+        }
+    }
+
+    if (session == NULL)
+    {
+        return IMOD_RESULT_TOO_MANY_SESSIONS;
+    }
+
+    if (!Platform->MapWindow(Platform->Context, PhysicalAddress, Length, &session->Window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    if (Table->NextId == 0)
+    {
+        Table->NextId = 1;
+    }
+
+    session->Id = Table->NextId++;
+    *SessionId = session->Id;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodSessionClose(const IMOD_PLATFORM *Platform, PIMOD_SESSION_TABLE Table, ULONG SessionId)
+{
+    PIMOD_SESSION session = ImodSessionFind(Table, SessionId);
+
+    if (session == NULL)
+    {
+        return IMOD_RESULT_INVALID_SESSION;
+    }
+
+    Platform->UnmapWindow(Platform->Context, &session->Window);
+    session->Id = 0;
+    return IMOD_RESULT_SUCCESS;
+}
+
+VOID ImodSessionCloseAll(const IMOD_PLATFORM *Platform, PIMOD_SESSION_TABLE Table)
+{
+    ULONG index;
+
+    for (index = 0; index < IMOD_SESSION_MAX_PER_HANDLE; ++index)
+    {
+        if (Table->Sessions[index].Id != 0)
+        {
+            Platform->UnmapWindow(Platform->Context, &Table->Sessions[index].Window);
+            Table->Sessions[index].Id = 0;
+        }
+    }
+}
+
+ULONG ImodSessionRead(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONG SessionId,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG *Value)
+{
+    PIMOD_SESSION session = ImodSessionFind(Table, SessionId);
+    ULONG result;
+
+    *Value = 0;
+
+    if (session == NULL)
+    {
+        return IMOD_RESULT_INVALID_SESSION;
+    }
+
+    result = ImodSessionCheckAccess(session, Offset, AccessSize);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (!Platform->ReadRegister(Platform->Context, &session->Window, Offset, AccessSize, Value))
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodSessionWrite(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONG SessionId,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG Value)
+{
+    PIMOD_SESSION session = ImodSessionFind(Table, SessionId);
+    ULONG result;
+
+    if (session == NULL)
+    {
+        return IMOD_RESULT_INVALID_SESSION;
+    }
+
+    result = ImodSessionCheckAccess(session, Offset, AccessSize);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (!Platform->WriteRegister(Platform->Context, &session->Window, Offset, AccessSize, Value))
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_SESSION_MAX_PER_HANDLE 8UL
+
+typedef struct _IMOD_SESSION
+{
+    ULONG Id;
+    IMOD_REGISTER_WINDOW Window;
+} IMOD_SESSION, *PIMOD_SESSION;
+
+/*
+ * Register windows mapped once per driver handle. Id 0 marks a free slot;
+ * ids are never reused within one table so a stale id cannot reach a newer
+ * mapping.
+ */
+typedef struct _IMOD_SESSION_TABLE
+{
+    ULONG NextId;
+    IMOD_SESSION Sessions[IMOD_SESSION_MAX_PER_HANDLE];
+} IMOD_SESSION_TABLE, *PIMOD_SESSION_TABLE;
+
+VOID ImodSessionTableInitialize(PIMOD_SESSION_TABLE Table);
+
+ULONG ImodSessionOpen(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONGLONG PhysicalAddress,
+    ULONG Length,
+    ULONG *SessionId);
+
+ULONG ImodSessionClose(const IMOD_PLATFORM *Platform, PIMOD_SESSION_TABLE Table, ULONG SessionId);
+
+VOID ImodSessionCloseAll(const IMOD_PLATFORM *Platform, PIMOD_SESSION_TABLE Table);
+
+ULONG ImodSessionRead(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONG SessionId,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG *Value);
+
+ULONG ImodSessionWrite(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_SESSION_TABLE Table,
+    ULONG SessionId,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG Value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,627 @@
+#include "imod_simulator.h"
+
+#define IMOD_SIMULATOR_ALIGN(value, alignment) (((value) + ((alignment) - 1)) & ~((SIZE_T)(alignment) - 1))
+#define IMOD_SIMULATOR_PAGE 0x1000UL
+#define IMOD_SIMULATOR_ERST_STRIDE 0x40UL
+#define IMOD_SIMULATOR_MAX_EVENT_RING_TRBS 4096UL
+
+static ULONG ImodSimulatorGet32(const UCHAR *Base, SIZE_T Offset)
+{
+    ULONG value;
+
+    RtlCopyMemory(&value, Base + Offset, sizeof(value));
+    return value;
+}
+
+static VOID ImodSimulatorPut32(UCHAR *Base, SIZE_T Offset, ULONG Value)
+{
+    RtlCopyMemory(Base + Offset, &Value, sizeof(Value));
+}
+
+static VOID ImodSimulatorPut64(UCHAR *Base, SIZE_T Offset, ULONGLONG Value)
+{
+    ImodSimulatorPut32(Base, Offset, (ULONG)Value);
+    ImodSimulatorPut32(Base, Offset + sizeof(ULONG), (ULONG)(Value >> 32));
+}
+
+static ULONG ImodSimulatorBarLength(ULONG MaxIntrs)
+{
+    return (ULONG)IMOD_SIMULATOR_ALIGN(
+        IMOD_SIMULATOR_RUNTIME_OFFSET + IMOD_XHCI_RUNTIME_WINDOW_SIZE(MaxIntrs), IMOD_SIMULATOR_PAGE) +
+        IMOD_SIMULATOR_PAGE;
+}
+
+static ULONG ImodSimulatorContextSize(const IMOD_SIMULATOR_CONFIG *Config)
+{
+    return Config->Context64 ? 64UL : 32UL;
+}
+
+static ULONG ImodSimulatorDeviceStride(const IMOD_SIMULATOR_CONFIG *Config)
+{
+    return (IMOD_XHCI_DEVICE_CONTEXT_ENTRIES * ImodSimulatorContextSize(Config)) +
+        (IMOD_XHCI_MAX_CONTEXT_ENTRIES * IMOD_SIMULATOR_TRANSFER_RING_TRBS * IMOD_XHCI_TRB_SIZE);
+}
+
+/* Memory region layout: DCBAA, one ERST per interrupter, event rings, then one device block per slot. */
+static ULONG ImodSimulatorMemoryLength(const IMOD_SIMULATOR_CONFIG *Config, ULONG *ErstOffset, ULONG *EventRingOffset,
+    ULONG *DeviceOffset)
+{
+    SIZE_T offset = IMOD_SIMULATOR_ALIGN((Config->MaxSlots + 1) * sizeof(ULONGLONG), 64);
+
+    *ErstOffset = (ULONG)offset;
+    offset += Config->MaxIntrs * IMOD_SIMULATOR_ERST_STRIDE;
+    *EventRingOffset = (ULONG)offset;
+    offset += (SIZE_T)Config->MaxIntrs * Config->EventRingTrbs * IMOD_XHCI_TRB_SIZE;
+    *DeviceOffset = (ULONG)offset;
+    offset += (SIZE_T)Config->MaxSlots * ImodSimulatorDeviceStride(Config);
+
+    return (ULONG)IMOD_SIMULATOR_ALIGN(offset, IMOD_SIMULATOR_PAGE);
+}
+
+static BOOLEAN ImodSimulatorConfigValid(const IMOD_SIMULATOR_CONFIG *Config)
+{
+    ULONG erstOffset;
+    ULONG eventRingOffset;
+    ULONG deviceOffset;
+    ULONGLONG barEnd;
+    ULONGLONG memoryEnd;
+
+    if (Config == NULL || Config->MaxSlots == 0 || Config->MaxSlots > IMOD_XHCI_MAX_SLOTS ||
+        Config->MaxIntrs == 0 || Config->MaxIntrs > IMOD_XHCI_MAX_INTERRUPTERS ||
+        Config->MaxPorts == 0 || Config->MaxPorts > 0xFF ||
+        Config->EventRingTrbs < IMOD_XHCI_MIN_EVENT_SEGMENT_TRBS ||
+        Config->EventRingTrbs > IMOD_SIMULATOR_MAX_EVENT_RING_TRBS ||
+        Config->DefaultInterval > IMOD_XHCI_IMODI_MASK)
+    {
+        return FALSE;
+    }
+
+    if (Config->BarAddress == 0 || Config->MemoryAddress == 0 ||
+        (Config->BarAddress & (IMOD_SIMULATOR_PAGE - 1)) != 0 ||
+        (Config->MemoryAddress & (IMOD_SIMULATOR_PAGE - 1)) != 0)
+    {
+        return FALSE;
+    }
+
+    barEnd = Config->BarAddress + ImodSimulatorBarLength(Config->MaxIntrs);
+    memoryEnd = Config->MemoryAddress +
+        ImodSimulatorMemoryLength(Config, &erstOffset, &eventRingOffset, &deviceOffset);
+    if (barEnd < Config->BarAddress || memoryEnd < Config->MemoryAddress)
+    {
+        return FALSE;
+    }
+
+    return barEnd <= Config->MemoryAddress || memoryEnd <= Config->BarAddress;
+}
+
+VOID ImodSimulatorDefaultConfig(PIMOD_SIMULATOR_CONFIG Config)
+{
+    RtlZeroMemory(Config, sizeof(*Config));
+    Config->BarAddress = 0xF7F00000ULL;
+    Config->MemoryAddress = 0x100000000ULL;
+    Config->MaxSlots = 64;
+    Config->MaxIntrs = 8;
+    Config->MaxPorts = 16;
+    Config->EventRingTrbs = 256;
+    Config->DefaultInterval = IMOD_XHCI_IMODI_DEFAULT;
+    Config->Context64 = FALSE;
+}
+
+SIZE_T ImodSimulatorRequiredSize(const IMOD_SIMULATOR_CONFIG *Config)
+{
+    ULONG erstOffset;
+    ULONG eventRingOffset;
+    ULONG deviceOffset;
+
+    if (!ImodSimulatorConfigValid(Config))
+    {
+        return 0;
+    }
+
+    return IMOD_SIMULATOR_ALIGN(
+               sizeof(IMOD_SIMULATOR) + (Config->MaxIntrs * sizeof(IMOD_SIMULATOR_EVENT_RING)), 64) +
+        ImodSimulatorBarLength(Config->MaxIntrs) +
+        ImodSimulatorMemoryLength(Config, &erstOffset, &eventRingOffset, &deviceOffset);
+}
+
+static ULONG ImodSimulatorInterrupterOffset(ULONG Interrupter)
+{
+    return IMOD_SIMULATOR_RUNTIME_OFFSET + IMOD_XHCI_INTERRUPTER_OFFSET(Interrupter);
+}
+
+static ULONGLONG ImodSimulatorEventRingAddress(const IMOD_SIMULATOR *Simulator, ULONG Interrupter)
+{
+    return Simulator->Config.MemoryAddress + Simulator->EventRingOffset +
+        ((ULONGLONG)Interrupter * Simulator->Config.EventRingTrbs * IMOD_XHCI_TRB_SIZE);
+}
+
+ULONG ImodSimulatorInitialize(PIMOD_SIMULATOR Simulator, SIZE_T Size, const IMOD_SIMULATOR_CONFIG *Config)
+{
+    SIZE_T required = ImodSimulatorRequiredSize(Config);
+    ULONG operational = IMOD_SIMULATOR_CAPLENGTH;
+    ULONG index;
+
+    if (required == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Simulator == NULL || Size < required)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlZeroMemory(Simulator, required);
+    Simulator->Config = *Config;
+    Simulator->BarLength = ImodSimulatorBarLength(Config->MaxIntrs);
+    Simulator->DoorbellOffset = Simulator->BarLength - IMOD_SIMULATOR_PAGE;
+    Simulator->ContextSize = ImodSimulatorContextSize(Config);
+    Simulator->DeviceStride = ImodSimulatorDeviceStride(Config);
+    Simulator->DcbaaOffset = 0;
+    Simulator->MemoryLength = ImodSimulatorMemoryLength(
+        Config, &Simulator->ErstOffset, &Simulator->EventRingOffset, &Simulator->DeviceOffset);
+    Simulator->EventRings = (PIMOD_SIMULATOR_EVENT_RING)(Simulator + 1);
+    Simulator->Bar = (UCHAR *)Simulator +
+        IMOD_SIMULATOR_ALIGN(sizeof(IMOD_SIMULATOR) + (Config->MaxIntrs * sizeof(IMOD_SIMULATOR_EVENT_RING)), 64);
+    Simulator->Memory = Simulator->Bar + Simulator->BarLength;
+
+    ImodSimulatorPut32(Simulator->Bar, IMOD_XHCI_CAPLENGTH_OFFSET,
+        IMOD_SIMULATOR_CAPLENGTH | (IMOD_SIMULATOR_HCIVERSION << 16));
+    ImodSimulatorPut32(Simulator->Bar, IMOD_XHCI_HCSPARAMS1_OFFSET,
+        Config->MaxSlots | (Config->MaxIntrs << 8) | (Config->MaxPorts << 24));
+    ImodSimulatorPut32(Simulator->Bar, IMOD_XHCI_HCCPARAMS1_OFFSET, Config->Context64 ? IMOD_XHCI_HCC1_CSZ : 0);
+    ImodSimulatorPut32(Simulator->Bar, IMOD_XHCI_DBOFF_OFFSET, Simulator->DoorbellOffset);
+    ImodSimulatorPut32(Simulator->Bar, IMOD_XHCI_RTSOFF_OFFSET, IMOD_SIMULATOR_RUNTIME_OFFSET);
+
+    /* A running controller the host driver has already set up. */
+    ImodSimulatorPut32(Simulator->Bar, operational + IMOD_XHCI_USBCMD_OFFSET, IMOD_XHCI_USBCMD_RS | IMOD_XHCI_USBCMD_INTE);
+    ImodSimulatorPut32(Simulator->Bar, operational + IMOD_XHCI_PAGESIZE_OFFSET, 1);
+    ImodSimulatorPut64(Simulator->Bar, operational + IMOD_XHCI_DCBAAP_OFFSET,
+        Config->MemoryAddress + Simulator->DcbaaOffset);
+    ImodSimulatorPut32(Simulator->Bar, operational + IMOD_XHCI_CONFIG_OFFSET, Config->MaxSlots);
+
+    for (index = 0; index < Config->MaxPorts; ++index)
+    {
+        ImodSimulatorPut32(Simulator->Bar,
+            operational + IMOD_XHCI_PORTSC_BASE + (index * IMOD_XHCI_PORT_STRIDE), IMOD_XHCI_PORTSC_PP);
+    }
+
+    for (index = 0; index < Config->MaxIntrs; ++index)
+    {
+        ULONG interrupter = ImodSimulatorInterrupterOffset(index);
+        ULONG erst = Simulator->ErstOffset + (index * IMOD_SIMULATOR_ERST_STRIDE);
+
+        ImodSimulatorPut64(Simulator->Memory, erst, ImodSimulatorEventRingAddress(Simulator, index));
+        ImodSimulatorPut32(Simulator->Memory, erst + 8, Config->EventRingTrbs);
+
+        ImodSimulatorPut32(Simulator->Bar, interrupter + IMOD_XHCI_IMAN_OFFSET, IMOD_XHCI_IMAN_IE);
+        ImodSimulatorPut32(Simulator->Bar, interrupter + IMOD_XHCI_IMOD_OFFSET, Config->DefaultInterval);
+        ImodSimulatorPut32(Simulator->Bar, interrupter + IMOD_XHCI_ERSTSZ_OFFSET, 1);
+        ImodSimulatorPut64(Simulator->Bar, interrupter + IMOD_XHCI_ERSTBA_OFFSET, Config->MemoryAddress + erst);
+        ImodSimulatorPut64(Simulator->Bar, interrupter + IMOD_XHCI_ERDP_OFFSET,
+            ImodSimulatorEventRingAddress(Simulator, index));
+
+        Simulator->EventRings[index].Cycle = IMOD_XHCI_TRB_CYCLE;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+static VOID ImodSimulatorCharge(PIMOD_SIMULATOR Simulator, ULONG Nanoseconds)
+{
+    Simulator->Stats.ElapsedNs += Nanoseconds;
+    if (Nanoseconds != 0 && Simulator->Stall != NULL)
+    {
+        Simulator->Stall(Simulator->StallContext, Nanoseconds);
+    }
+}
+
+static BOOLEAN ImodSimulatorTrip(ULONG Every, ULONGLONG Count)
+{
+    return Every != 0 && (Count % Every) == 0;
+}
+
+static BOOLEAN ImodSimulatorInBar(const IMOD_SIMULATOR *Simulator, const IMOD_REGISTER_WINDOW *Window)
+{
+    return Window->PhysicalAddress >= Simulator->Config.BarAddress &&
+        Window->PhysicalAddress < Simulator->Config.BarAddress + Simulator->BarLength;
+}
+
+static BOOLEAN ImodSimulatorAccessValid(const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize)
+{
+    if (AccessSize != 1 && AccessSize != 2 && AccessSize != 4 && AccessSize != 8)
+    {
+        return FALSE;
+    }
+
+    return Window->Address != NULL && (Offset & (AccessSize - 1)) == 0 &&
+        Offset <= Window->Length && Window->Length - Offset >= AccessSize;
+}
+
+/* Bits that software clears by writing one: IMAN.IP and ERDP.EHB. */
+static ULONG ImodSimulatorWriteOneToClear(const IMOD_SIMULATOR *Simulator, ULONG BarOffset)
+{
+    ULONG relative;
+
+    if (BarOffset < ImodSimulatorInterrupterOffset(0) ||
+        BarOffset >= ImodSimulatorInterrupterOffset(Simulator->Config.MaxIntrs))
+    {
+        return 0;
+    }
+
+    relative = (BarOffset - ImodSimulatorInterrupterOffset(0)) % IMOD_XHCI_INTERRUPTER_STRIDE;
+    if (relative == IMOD_XHCI_IMAN_OFFSET)
+    {
+        return IMOD_XHCI_IMAN_IP;
+    }
+
+    return relative == IMOD_XHCI_ERDP_OFFSET ? IMOD_XHCI_ERDP_EHB : 0;
+}
+
+/* Stores the byte lanes under Mask into one BAR dword. Capability registers are read-only. */
+static VOID ImodSimulatorStoreRegister(PIMOD_SIMULATOR Simulator, ULONG BarOffset, ULONG Value, ULONG Mask)
+{
+    ULONG current;
+    ULONG clearable;
+
+    if (BarOffset < IMOD_SIMULATOR_CAPLENGTH)
+    {
+        return;
+    }
+
+    current = ImodSimulatorGet32(Simulator->Bar, BarOffset);
+    clearable = ImodSimulatorWriteOneToClear(Simulator, BarOffset);
+    ImodSimulatorPut32(Simulator->Bar, BarOffset,
+        (current & ~Mask) | (Value & Mask & ~clearable) | (current & Mask & clearable & ~Value));
+}
+
+static BOOLEAN ImodSimulatorMapWindow(PVOID Context, ULONGLONG PhysicalAddress, ULONG Length, PIMOD_REGISTER_WINDOW Window)
+{
+    PIMOD_SIMULATOR simulator = (PIMOD_SIMULATOR)Context;
+    const IMOD_SIMULATOR_CONFIG *config = &simulator->Config;
+    UCHAR *address = NULL;
+
+    RtlZeroMemory(Window, sizeof(*Window));
+    ++simulator->Stats.Maps;
+    ImodSimulatorCharge(simulator, simulator->Timing.MapLatencyNs);
+
+    if (ImodSimulatorTrip(simulator->Faults.FailMapEvery, simulator->Stats.Maps) || Length == 0)
+    {
+        ++simulator->Stats.FailedMaps;
+        return FALSE;
+    }
+
+    if (PhysicalAddress >= config->BarAddress && PhysicalAddress - config->BarAddress <= simulator->BarLength &&
+        Length <= simulator->BarLength - (PhysicalAddress - config->BarAddress))
+    {
+        address = simulator->Bar + (SIZE_T)(PhysicalAddress - config->BarAddress);
+    }
+    else if (PhysicalAddress >= config->MemoryAddress &&
+        PhysicalAddress - config->MemoryAddress <= simulator->MemoryLength &&
+        Length <= simulator->MemoryLength - (PhysicalAddress - config->MemoryAddress))
+    {
+        address = simulator->Memory + (SIZE_T)(PhysicalAddress - config->MemoryAddress);
+    }
+
+    /* Anything outside the BAR and the memory region is unbacked, like a bad MmMapIoSpace. */
+    if (address == NULL)
+    {
+        ++simulator->Stats.FailedMaps;
+        return FALSE;
+    }
+
+    Window->PhysicalAddress = PhysicalAddress;
+    Window->Length = Length;
+    Window->Address = address;
+    Window->MappingBase = address;
+    Window->MappingSize = Length;
+    return TRUE;
+}
+
+static VOID ImodSimulatorUnmapWindow(PVOID Context, PIMOD_REGISTER_WINDOW Window)
+{
+    PIMOD_SIMULATOR simulator = (PIMOD_SIMULATOR)Context;
+
+    ++simulator->Stats.Unmaps;
+    ImodSimulatorCharge(simulator, simulator->Timing.UnmapLatencyNs);
+    RtlZeroMemory(Window, sizeof(*Window));
+}
+
+static BOOLEAN ImodSimulatorReadRegister(
+    PVOID Context,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG *Value)
+{
+    PIMOD_SIMULATOR simulator = (PIMOD_SIMULATOR)Context;
+    const UCHAR *source;
+    ULONGLONG value = 0;
+    ULONG index;
+
+    ++simulator->Stats.Reads;
+    ImodSimulatorCharge(simulator, simulator->Timing.ReadLatencyNs);
+
+    if (ImodSimulatorTrip(simulator->Faults.FailReadEvery, simulator->Stats.Reads) ||
+        !ImodSimulatorAccessValid(Window, Offset, AccessSize))
+    {
+        ++simulator->Stats.FailedReads;
+        return FALSE;
+    }
+
+    if (simulator->Faults.Removed && ImodSimulatorInBar(simulator, Window))
+    {
+        *Value = AccessSize == 8 ? ~0ULL : ((1ULL << (AccessSize * 8)) - 1);
+        return TRUE;
+    }
+
+    source = (const UCHAR *)Window->Address + Offset;
+    for (index = 0; index < AccessSize; ++index)
+    {
+        value |= (ULONGLONG)source[index] << (index * 8);
+    }
+
+    *Value = value;
+    return TRUE;
+}
+
+static BOOLEAN ImodSimulatorWriteRegister(
+    PVOID Context,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG Value)
+{
+    PIMOD_SIMULATOR simulator = (PIMOD_SIMULATOR)Context;
+    ULONG barOffset;
+    ULONG index;
+
+    ++simulator->Stats.Writes;
+    ImodSimulatorCharge(simulator, simulator->Timing.WriteLatencyNs);
+
+    if (ImodSimulatorTrip(simulator->Faults.FailWriteEvery, simulator->Stats.Writes) ||
+        !ImodSimulatorAccessValid(Window, Offset, AccessSize))
+    {
+        ++simulator->Stats.FailedWrites;
+        return FALSE;
+    }
+
+    if (ImodSimulatorTrip(simulator->Faults.DropWriteEvery, simulator->Stats.Writes) ||
+        (simulator->Faults.Removed && ImodSimulatorInBar(simulator, Window)))
+    {
+        ++simulator->Stats.DroppedWrites;
+        return TRUE;
+    }
+
+    if (!ImodSimulatorInBar(simulator, Window))
+    {
+        UCHAR *target = (UCHAR *)Window->Address + Offset;
+
+        for (index = 0; index < AccessSize; ++index)
+        {
+            target[index] = (UCHAR)(Value >> (index * 8));
+        }
+        return TRUE;
+    }
+
+    barOffset = (ULONG)(Window->PhysicalAddress - simulator->Config.BarAddress) + Offset;
+    if (AccessSize == 8)
+    {
+        ImodSimulatorStoreRegister(simulator, barOffset, (ULONG)Value, 0xFFFFFFFFUL);
+        ImodSimulatorStoreRegister(simulator, barOffset + sizeof(ULONG), (ULONG)(Value >> 32), 0xFFFFFFFFUL);
+    }
+    else
+    {
+        ULONG shift = (barOffset & 0x3) * 8;
+        ULONG mask = AccessSize == 4 ? 0xFFFFFFFFUL : (((1UL << (AccessSize * 8)) - 1) << shift);
+
+        ImodSimulatorStoreRegister(simulator, barOffset & ~0x3UL, (ULONG)Value << shift, mask);
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN ImodSimulatorRead32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG *Value)
+{
+    ULONGLONG value = 0;
+
+    if (!ImodSimulatorReadRegister(Context, Window, Offset, sizeof(ULONG), &value))
+    {
+        return FALSE;
+    }
+
+    *Value = (ULONG)value;
+    return TRUE;
+}
+
+static BOOLEAN ImodSimulatorWrite32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG Value)
+{
+    return ImodSimulatorWriteRegister(Context, Window, Offset, sizeof(ULONG), Value);
+}
+
+VOID ImodSimulatorInitializePlatform(PIMOD_SIMULATOR Simulator, PIMOD_PLATFORM Platform)
+{
+    Platform->Context = Simulator;
+    Platform->MapWindow = ImodSimulatorMapWindow;
+    Platform->UnmapWindow = ImodSimulatorUnmapWindow;
+    Platform->Read32 = ImodSimulatorRead32;
+    Platform->Write32 = ImodSimulatorWrite32;
+    Platform->ReadRegister = ImodSimulatorReadRegister;
+    Platform->WriteRegister = ImodSimulatorWriteRegister;
+}
+
+ULONG ImodSimulatorAttachDevice(PIMOD_SIMULATOR Simulator, const IMOD_SIMULATOR_DEVICE *Device, ULONG *SlotId)
+{
+    ULONG contextEntries = 0;
+    ULONG contextBase;
+    ULONGLONG contextAddress;
+    ULONG portsc;
+    ULONG slotId;
+    ULONG index;
+
+    if (Simulator == NULL || Device == NULL || SlotId == NULL ||
+        Device->RootPort == 0 || Device->RootPort > Simulator->Config.MaxPorts ||
+        Device->Interrupter >= Simulator->Config.MaxIntrs ||
+        Device->RouteString > 0xFFFFFUL || Device->EndpointTypes[0] != IMOD_XHCI_EP_TYPE_CONTROL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Simulator->SlotCount >= Simulator->Config.MaxSlots)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    for (index = 0; index < IMOD_XHCI_MAX_CONTEXT_ENTRIES; ++index)
+    {
+        if (Device->EndpointTypes[index] != 0)
+        {
+            contextEntries = index + 1;
+        }
+    }
+
+    slotId = ++Simulator->SlotCount;
+    contextBase = Simulator->DeviceOffset + ((slotId - 1) * Simulator->DeviceStride);
+    contextAddress = Simulator->Config.MemoryAddress + contextBase;
+
+    ImodSimulatorPut32(Simulator->Memory, contextBase + 0x0,
+        Device->RouteString | ((Device->Hub ? 1UL : 0UL) << 26) | (contextEntries << 27));
+    ImodSimulatorPut32(Simulator->Memory, contextBase + 0x4, Device->RootPort << 16);
+    ImodSimulatorPut32(Simulator->Memory, contextBase + 0x8, Device->Interrupter << 22);
+    ImodSimulatorPut32(Simulator->Memory, contextBase + 0xC, slotId | (IMOD_XHCI_SLOT_STATE_CONFIGURED << 27));
+
+    for (index = 1; index <= contextEntries; ++index)
+    {
+        ULONG type = Device->EndpointTypes[index - 1];
+        ULONG endpoint = contextBase + (index * Simulator->ContextSize);
+        ULONG ring = contextBase + (IMOD_XHCI_DEVICE_CONTEXT_ENTRIES * Simulator->ContextSize) +
+            ((index - 1) * IMOD_SIMULATOR_TRANSFER_RING_TRBS * IMOD_XHCI_TRB_SIZE);
+        ULONG trbType = type == IMOD_XHCI_EP_TYPE_CONTROL
+            ? IMOD_XHCI_TRB_TYPE_SETUP_STAGE
+            : IMOD_XHCI_TRB_TYPE_NORMAL;
+
+        if (type == 0)
+        {
+            continue;
+        }
+
+        ImodSimulatorPut32(Simulator->Memory, endpoint + 0x0, IMOD_XHCI_EP_STATE_RUNNING);
+        ImodSimulatorPut32(Simulator->Memory, endpoint + 0x4, (type & 0x7UL) << 3);
+        ImodSimulatorPut64(Simulator->Memory, endpoint + 0x8,
+            (Simulator->Config.MemoryAddress + ring) | IMOD_XHCI_TRB_CYCLE);
+
+        ImodSimulatorPut32(Simulator->Memory, ring + 0x8, Device->Interrupter << 22);
+        ImodSimulatorPut32(Simulator->Memory, ring + 0xC, (trbType << 10) | IMOD_XHCI_TRB_CYCLE);
+    }
+
+    ImodSimulatorPut64(Simulator->Memory, Simulator->DcbaaOffset + (slotId * sizeof(ULONGLONG)), contextAddress);
+
+    portsc = IMOD_SIMULATOR_CAPLENGTH + IMOD_XHCI_PORTSC_BASE + ((Device->RootPort - 1) * IMOD_XHCI_PORT_STRIDE);
+    ImodSimulatorPut32(Simulator->Bar, portsc,
+        ImodSimulatorGet32(Simulator->Bar, portsc) | IMOD_XHCI_PORTSC_CCS | IMOD_XHCI_PORTSC_PED);
+
+    *SlotId = slotId;
+    return IMOD_RESULT_SUCCESS;
+}
+
+/*
+ * Controller side of an event ring: writes Count transfer events with the
+ * producer cycle bit and raises IMAN.IP. Stops one short of a full ring
+ * and returns how many were written.
+ */
+ULONG ImodSimulatorPostEvents(PIMOD_SIMULATOR Simulator, ULONG Interrupter, ULONG Count)
+{
+    PIMOD_SIMULATOR_EVENT_RING ring;
+    ULONG interrupter;
+    ULONG posted = 0;
+
+    if (Simulator == NULL || Interrupter >= Simulator->Config.MaxIntrs)
+    {
+        return 0;
+    }
+
+    ring = &Simulator->EventRings[Interrupter];
+    while (posted < Count && ring->Pending < Simulator->Config.EventRingTrbs - 1)
+    {
+        SIZE_T trb = (SIZE_T)(ImodSimulatorEventRingAddress(Simulator, Interrupter) - Simulator->Config.MemoryAddress) +
+            ((SIZE_T)ring->Enqueue * IMOD_XHCI_TRB_SIZE);
+
+        ImodSimulatorPut64(Simulator->Memory, trb, 0);
+        ImodSimulatorPut32(Simulator->Memory, trb + 0x8, IMOD_XHCI_COMPLETION_SUCCESS << 24);
+        ImodSimulatorPut32(Simulator->Memory, trb + 0xC, (IMOD_XHCI_TRB_TYPE_TRANSFER_EVENT << 10) | ring->Cycle);
+
+        if (++ring->Enqueue == Simulator->Config.EventRingTrbs)
+        {
+            ring->Enqueue = 0;
+            ring->Cycle ^= IMOD_XHCI_TRB_CYCLE;
+        }
+
+        ++ring->Pending;
+        ++posted;
+    }
+
+    if (posted != 0)
+    {
+        interrupter = ImodSimulatorInterrupterOffset(Interrupter);
+        ImodSimulatorPut32(Simulator->Bar, interrupter + IMOD_XHCI_IMAN_OFFSET,
+            ImodSimulatorGet32(Simulator->Bar, interrupter + IMOD_XHCI_IMAN_OFFSET) | IMOD_XHCI_IMAN_IP);
+    }
+
+    return posted;
+}
+
+/*
+ * Host driver side: consumes up to Count pending events, moves ERDP past
+ * them and acknowledges the interrupt once the ring is drained.
+ */
+ULONG ImodSimulatorConsumeEvents(PIMOD_SIMULATOR Simulator, ULONG Interrupter, ULONG Count)
+{
+    PIMOD_SIMULATOR_EVENT_RING ring;
+    ULONG interrupter;
+    ULONG consumed;
+
+    if (Simulator == NULL || Interrupter >= Simulator->Config.MaxIntrs)
+    {
+        return 0;
+    }
+
+    ring = &Simulator->EventRings[Interrupter];
+    consumed = Count < ring->Pending ? Count : ring->Pending;
+    ring->Dequeue = (ring->Dequeue + consumed) % Simulator->Config.EventRingTrbs;
+    ring->Pending -= consumed;
+
+    interrupter = ImodSimulatorInterrupterOffset(Interrupter);
+    ImodSimulatorPut64(Simulator->Bar, interrupter + IMOD_XHCI_ERDP_OFFSET,
+        ImodSimulatorEventRingAddress(Simulator, Interrupter) + ((ULONGLONG)ring->Dequeue * IMOD_XHCI_TRB_SIZE));
+
+    if (ring->Pending == 0)
+    {
+        ImodSimulatorPut32(Simulator->Bar, interrupter + IMOD_XHCI_IMAN_OFFSET,
+            ImodSimulatorGet32(Simulator->Bar, interrupter + IMOD_XHCI_IMAN_OFFSET) & ~IMOD_XHCI_IMAN_IP);
+    }
+
+    return consumed;
+}
+
+/* Puts every IMOD register back to its reset value, as a controller reset or a host driver reload would. */
+VOID ImodSimulatorRevertModeration(PIMOD_SIMULATOR Simulator)
+{
+    ULONG index;
+
+    for (index = 0; index < Simulator->Config.MaxIntrs; ++index)
+    {
+        ImodSimulatorPut32(Simulator->Bar, ImodSimulatorInterrupterOffset(index) + IMOD_XHCI_IMOD_OFFSET,
+            Simulator->Config.DefaultInterval);
+    }
+}
+
+ULONG ImodSimulatorInterval(const IMOD_SIMULATOR *Simulator, ULONG Interrupter)
+{
+    if (Simulator == NULL || Interrupter >= Simulator->Config.MaxIntrs)
+    {
+        return 0;
+    }
+
+    return ImodSimulatorGet32(Simulator->Bar, ImodSimulatorInterrupterOffset(Interrupter) + IMOD_XHCI_IMOD_OFFSET) &
+        IMOD_XHCI_IMODI_MASK;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_SIMULATOR_CAPLENGTH 0x80UL
+#define IMOD_SIMULATOR_HCIVERSION 0x0120UL
+#define IMOD_SIMULATOR_RUNTIME_OFFSET 0x2000UL
+#define IMOD_SIMULATOR_TRANSFER_RING_TRBS 16UL
+
+/*
+ * Shape of the simulated controller. The BAR holds capability, operational,
+ * runtime and doorbell registers; the memory region stands in for the
+ * system RAM the host driver would own (DCBAA, ERSTs, event rings, device
+ * contexts and transfer rings). Both must be 4 KiB aligned and disjoint.
+ */
+typedef struct _IMOD_SIMULATOR_CONFIG
+{
+    ULONGLONG BarAddress;
+    ULONGLONG MemoryAddress;
+    ULONG MaxSlots;
+    ULONG MaxIntrs;
+    ULONG MaxPorts;
+    ULONG EventRingTrbs;
+    ULONG DefaultInterval;
+    BOOLEAN Context64;
+} IMOD_SIMULATOR_CONFIG, *PIMOD_SIMULATOR_CONFIG;
+
+/*
+ * Per-access cost in nanoseconds. It is always added to Stats.ElapsedNs;
+ * when Stall is set the simulator also spends it for real.
+ */
+typedef struct _IMOD_SIMULATOR_TIMING
+{
+    ULONG MapLatencyNs;
+    ULONG UnmapLatencyNs;
+    ULONG ReadLatencyNs;
+    ULONG WriteLatencyNs;
+} IMOD_SIMULATOR_TIMING, *PIMOD_SIMULATOR_TIMING;
+
+/*
+ * Injected failures. The *Every counters fail every Nth call (0 = never).
+ * DropWriteEvery makes a write report success without landing, the way a
+ * controller ignores writes while it is resetting. Removed makes the BAR
+ * read back as all ones and swallow writes, as after surprise removal or
+ * in D3cold; the memory region is unaffected.
+ */
+typedef struct _IMOD_SIMULATOR_FAULTS
+{
+    ULONG FailMapEvery;
+    ULONG FailReadEvery;
+    ULONG FailWriteEvery;
+    ULONG DropWriteEvery;
+    BOOLEAN Removed;
+} IMOD_SIMULATOR_FAULTS, *PIMOD_SIMULATOR_FAULTS;
+
+typedef struct _IMOD_SIMULATOR_STATS
+{
+    ULONGLONG Maps;
+    ULONGLONG Unmaps;
+    ULONGLONG Reads;
+    ULONGLONG Writes;
+    ULONGLONG FailedMaps;
+    ULONGLONG FailedReads;
+    ULONGLONG FailedWrites;
+    ULONGLONG DroppedWrites;
+    ULONGLONG ElapsedNs;
+} IMOD_SIMULATOR_STATS, *PIMOD_SIMULATOR_STATS;
+
+/*
+ * A device to attach. EndpointTypes is indexed by device context index
+ * minus one, so entry 0 is the default control endpoint; 0 marks an
+ * unused endpoint. Every endpoint's first TRB targets Interrupter.
+ */
+typedef struct _IMOD_SIMULATOR_DEVICE
+{
+    ULONG RootPort;
+    ULONG RouteString;
+    ULONG Interrupter;
+    BOOLEAN Hub;
+    UCHAR EndpointTypes[IMOD_XHCI_MAX_CONTEXT_ENTRIES];
+} IMOD_SIMULATOR_DEVICE, *PIMOD_SIMULATOR_DEVICE;
+
+typedef struct _IMOD_SIMULATOR_EVENT_RING
+{
+    ULONG Enqueue;
+    ULONG Dequeue;
+    ULONG Pending;
+    ULONG Cycle;
+} IMOD_SIMULATOR_EVENT_RING, *PIMOD_SIMULATOR_EVENT_RING;
+
+/*
+ * One allocation holds the simulator, its per-interrupter event ring state,
+ * the BAR and the memory region; size it with ImodSimulatorRequiredSize.
+ * Timing, Faults, Stall and StallContext may be changed between accesses.
+ */
+typedef struct _IMOD_SIMULATOR
+{
+    IMOD_SIMULATOR_CONFIG Config;
+    IMOD_SIMULATOR_TIMING Timing;
+    IMOD_SIMULATOR_FAULTS Faults;
+    IMOD_SIMULATOR_STATS Stats;
+    VOID (*Stall)(PVOID Context, ULONG Nanoseconds);
+    PVOID StallContext;
+    ULONG BarLength;
+    ULONG DoorbellOffset;
+    ULONG MemoryLength;
+    ULONG ContextSize;
+    ULONG DcbaaOffset;
+    ULONG ErstOffset;
+    ULONG EventRingOffset;
+    ULONG DeviceOffset;
+    ULONG DeviceStride;
+    ULONG SlotCount;
+    PIMOD_SIMULATOR_EVENT_RING EventRings;
+    UCHAR *Bar;
+    UCHAR *Memory;
+} IMOD_SIMULATOR, *PIMOD_SIMULATOR;
+
+VOID ImodSimulatorDefaultConfig(PIMOD_SIMULATOR_CONFIG Config);
+
+SIZE_T ImodSimulatorRequiredSize(const IMOD_SIMULATOR_CONFIG *Config);
+
+ULONG ImodSimulatorInitialize(PIMOD_SIMULATOR Simulator, SIZE_T Size, const IMOD_SIMULATOR_CONFIG *Config);
+
+VOID ImodSimulatorInitializePlatform(PIMOD_SIMULATOR Simulator, PIMOD_PLATFORM Platform);
+
+ULONG ImodSimulatorAttachDevice(PIMOD_SIMULATOR Simulator, const IMOD_SIMULATOR_DEVICE *Device, ULONG *SlotId);
+
+ULONG ImodSimulatorPostEvents(PIMOD_SIMULATOR Simulator, ULONG Interrupter, ULONG Count);
+
+ULONG ImodSimulatorConsumeEvents(PIMOD_SIMULATOR Simulator, ULONG Interrupter, ULONG Count);
+
+VOID ImodSimulatorRevertModeration(PIMOD_SIMULATOR Simulator);
+
+ULONG ImodSimulatorInterval(const IMOD_SIMULATOR *Simulator, ULONG Interrupter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,718 @@
+#include "imod_topology.h"
+#include "imod_xhci.h"
+
+#define IMOD_TOPOLOGY_MAX_CAPABILITY_OFFSET 0x1000UL
+#define IMOD_TOPOLOGY_MAX_ENDPOINTS (IMOD_XHCI_MAX_SLOTS * IMOD_XHCI_MAX_CONTEXT_ENTRIES)
+#define IMOD_TOPOLOGY_FNV_OFFSET 0xCBF29CE484222325ULL
+#define IMOD_TOPOLOGY_FNV_PRIME 0x100000001B3ULL
+
+typedef struct _IMOD_TOPOLOGY_STATE
+{
+    const IMOD_PLATFORM *Platform;
+    struct tagImodTopologyHeader *Header;
+    struct tagImodTopologySlot *Slots;
+    struct tagImodTopologyEndpoint *Endpoints;
+    PIMOD_TOPOLOGY_CACHE Cache;
+    struct tagImodTopologyWalk *Walk;
+} IMOD_TOPOLOGY_STATE;
+
+/* Wraps the caller's platform so the walk can report its own maps and reads. */
+typedef struct _IMOD_TOPOLOGY_COUNTER
+{
+    const IMOD_PLATFORM *Inner;
+    struct tagImodTopologyWalk *Walk;
+} IMOD_TOPOLOGY_COUNTER;
+
+static BOOLEAN ImodTopologyCountMapWindow(PVOID Context, ULONGLONG PhysicalAddress, ULONG Length, PIMOD_REGISTER_WINDOW Window)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    ++counter->Walk->maps;
+    return counter->Inner->MapWindow(counter->Inner->Context, PhysicalAddress, Length, Window);
+}
+
+static VOID ImodTopologyCountUnmapWindow(PVOID Context, PIMOD_REGISTER_WINDOW Window)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    counter->Inner->UnmapWindow(counter->Inner->Context, Window);
+}
+
+static BOOLEAN ImodTopologyCountRead32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG *Value)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    ++counter->Walk->reads;
+    return counter->Inner->Read32(counter->Inner->Context, Window, Offset, Value);
+}
+
+static BOOLEAN ImodTopologyCountWrite32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG Value)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    return counter->Inner->Write32(counter->Inner->Context, Window, Offset, Value);
+}
+
+static BOOLEAN ImodTopologyCountReadRegister(
+    PVOID Context,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG *Value)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    ++counter->Walk->reads;
+    return counter->Inner->ReadRegister(counter->Inner->Context, Window, Offset, AccessSize, Value);
+}
+
+static BOOLEAN ImodTopologyCountWriteRegister(
+    PVOID Context,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONG AccessSize,
+    ULONGLONG Value)
+{
+    IMOD_TOPOLOGY_COUNTER *counter = (IMOD_TOPOLOGY_COUNTER *)Context;
+
+    return counter->Inner->WriteRegister(counter->Inner->Context, Window, Offset, AccessSize, Value);
+}
+
+/* FNV-1a over the eight bytes of Value. */
+static ULONGLONG ImodTopologyHash(ULONGLONG Hash, ULONGLONG Value)
+{
+    ULONG byteIndex;
+
+    for (byteIndex = 0; byteIndex < sizeof(Value); ++byteIndex)
+    {
+        Hash ^= (Value >> (byteIndex * 8)) & 0xFFULL;
+        Hash *= IMOD_TOPOLOGY_FNV_PRIME;
+    }
+
+    return Hash;
+}
+
+static BOOLEAN ImodTopologyRead64(
+    const IMOD_PLATFORM *Platform,
+    const IMOD_REGISTER_WINDOW *Window,
+    ULONG Offset,
+    ULONGLONG *Value)
+{
+    ULONG low = 0;
+    ULONG high = 0;
+
+    if (!Platform->Read32(Platform->Context, Window, Offset, &low) ||
+        !Platform->Read32(Platform->Context, Window, Offset + sizeof(ULONG), &high))
+    {
+        return FALSE;
+    }
+
+    *Value = ((ULONGLONG)high << 32) | low;
+    return TRUE;
+}
+
+/*
+ * Context and ring pointers come from controller-owned memory and are only
+ * followed when they are non-zero, do not wrap and do not land inside the
+ * controller's own register BAR.
+ */
+static BOOLEAN ImodTopologyPointerValid(
+    const struct tagImodTopologyHeader *Header,
+    ULONGLONG Address,
+    ULONG Length)
+{
+    ULONGLONG barLength = Header->barLength != 0 ? Header->barLength : IMOD_XHCI_MAX_CONTROLLER_WINDOW;
+
+    if (Address == 0 || Address + Length < Address)
+    {
+        return FALSE;
+    }
+
+    return Address + Length <= Header->capabilityAddress ||
+        Address >= Header->capabilityAddress + barLength;
+}
+
+static ULONG ImodTopologyReadControllerLayout(const IMOD_PLATFORM *Platform, struct tagImodTopologyHeader *header)
+{
+    IMOD_REGISTER_WINDOW window;
+    ULONG capabilityLength;
+    ULONG capabilityValue = 0;
+    ULONG hcsparamsValue = 0;
+    ULONG hccparamsValue = 0;
+    ULONGLONG dcbaap = 0;
+    BOOLEAN readOk;
+
+    capabilityLength = header->hcsparamsOffset > IMOD_XHCI_HCCPARAMS1_OFFSET
+        ? header->hcsparamsOffset + sizeof(ULONG)
+        : IMOD_XHCI_HCCPARAMS1_OFFSET + sizeof(ULONG);
+
+    if (!Platform->MapWindow(Platform->Context, header->capabilityAddress, capabilityLength, &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = Platform->Read32(Platform->Context, &window, IMOD_XHCI_CAPLENGTH_OFFSET, &capabilityValue) &&
+        Platform->Read32(Platform->Context, &window, header->hcsparamsOffset, &hcsparamsValue) &&
+        Platform->Read32(Platform->Context, &window, IMOD_XHCI_HCCPARAMS1_OFFSET, &hccparamsValue);
+
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    header->capLength = capabilityValue & 0xFFUL;
+    header->maxSlots = IMOD_XHCI_HCS1_MAX_SLOTS(hcsparamsValue);
+    header->maxIntrs = IMOD_XHCI_HCS1_MAX_INTRS(hcsparamsValue);
+    header->contextSize = (hccparamsValue & IMOD_XHCI_HCC1_CSZ) != 0 ? 64UL : 32UL;
+
+    if (header->capLength < IMOD_XHCI_INTERRUPTER_BASE || header->maxSlots == 0 ||
+        header->maxIntrs == 0 || header->maxIntrs > IMOD_XHCI_MAX_INTERRUPTERS)
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    if (!Platform->MapWindow(
+            Platform->Context,
+            header->capabilityAddress + header->capLength + IMOD_XHCI_DCBAAP_OFFSET,
+            sizeof(ULONGLONG),
+            &window))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    readOk = ImodTopologyRead64(Platform, &window, 0, &dcbaap);
+    Platform->UnmapWindow(Platform->Context, &window);
+
+    if (!readOk)
+    {
+        return IMOD_RESULT_ACCESS_FAILED;
+    }
+
+    header->dcbaap = dcbaap & IMOD_XHCI_CONTEXT_POINTER_MASK;
+
+    /* A halted controller has no device contexts to walk. */
+    if (!ImodTopologyPointerValid(header, header->dcbaap, (header->maxSlots + 1) * sizeof(ULONGLONG)))
+    {
+        return IMOD_RESULT_INVALID_CONTROLLER;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+static VOID ImodTopologyReadFirstTrb(
+    IMOD_TOPOLOGY_STATE *State,
+    ULONGLONG DequeuePointer,
+    struct tagImodTopologyEndpoint *Endpoint)
+{
+    const IMOD_PLATFORM *platform = State->Platform;
+    IMOD_REGISTER_WINDOW trbWindow;
+    ULONG trbDword2 = 0;
+    ULONG trbDword3 = 0;
+    BOOLEAN readOk;
+
+    if (!ImodTopologyPointerValid(State->Header, DequeuePointer, IMOD_XHCI_TRB_SIZE) ||
+        !platform->MapWindow(platform->Context, DequeuePointer, IMOD_XHCI_TRB_SIZE, &trbWindow))
+    {
+        return;
+    }
+
+    readOk = platform->Read32(platform->Context, &trbWindow, 0x8, &trbDword2) &&
+        platform->Read32(platform->Context, &trbWindow, 0xC, &trbDword3);
+
+    platform->UnmapWindow(platform->Context, &trbWindow);
+
+    if (readOk)
+    {
+        Endpoint->trbInterrupter = (USHORT)IMOD_XHCI_TRB_INTERRUPTER(trbDword2);
+        Endpoint->trbType = (UCHAR)IMOD_XHCI_TRB_TYPE(trbDword3);
+        Endpoint->flags |= IMOD_TOPOLOGY_ENDPOINT_TRB_VALID;
+    }
+}
+
+/* Appends a slot's endpoints to the reply, cut to the room the caller left. */
+static VOID ImodTopologyEmitEndpoints(
+    IMOD_TOPOLOGY_STATE *State,
+    struct tagImodTopologySlot *Slot,
+    const struct tagImodTopologyEndpoint *Endpoints,
+    ULONG EndpointCount)
+{
+    struct tagImodTopologyHeader *header = State->Header;
+    ULONG room = header->endpointCapacity - header->endpointCount;
+
+    if (EndpointCount > room)
+    {
+        Slot->flags |= IMOD_TOPOLOGY_SLOT_ENDPOINTS_TRUNCATED;
+        header->truncated |= IMOD_TOPOLOGY_TRUNCATED_ENDPOINTS;
+        EndpointCount = room;
+    }
+
+    Slot->firstEndpoint = (USHORT)header->endpointCount;
+    Slot->endpointCount = (USHORT)EndpointCount;
+    RtlCopyMemory(
+        &State->Endpoints[header->endpointCount],
+        Endpoints,
+        EndpointCount * sizeof(struct tagImodTopologyEndpoint));
+    header->endpointCount += EndpointCount;
+}
+
+/*
+ * The slot context and the first two dwords of each endpoint context are
+ * always read since they make up the fingerprint. Dequeue pointers and
+ * first TRBs are only followed when the fingerprint no longer matches the
+ * cached one. The cache keeps every endpoint of the slot even when the
+ * reply has no room for them, so a small query does not evict it.
+ */
+static VOID ImodTopologyReadSlot(IMOD_TOPOLOGY_STATE *State, ULONG SlotId, ULONGLONG DeviceContext)
+{
+    const IMOD_PLATFORM *platform = State->Platform;
+    struct tagImodTopologyHeader *header = State->Header;
+    PIMOD_TOPOLOGY_CACHE_SLOT cached = State->Cache != NULL ? &State->Cache->Slots[SlotId] : NULL;
+    struct tagImodTopologySlot *slot;
+    struct tagImodTopologyEndpoint endpoints[IMOD_XHCI_MAX_CONTEXT_ENTRIES];
+    IMOD_REGISTER_WINDOW contextWindow;
+    ULONG contextLength = IMOD_XHCI_DEVICE_CONTEXT_ENTRIES * header->contextSize;
+    ULONG slotDwords[4] = { 0 };
+    ULONG endpointDwords[IMOD_XHCI_MAX_CONTEXT_ENTRIES][2];
+    BOOLEAN endpointRead[IMOD_XHCI_MAX_CONTEXT_ENTRIES];
+    ULONGLONG fingerprint;
+    ULONG contextEntries;
+    ULONG contextIndex;
+    ULONG endpointCount = 0;
+    BOOLEAN endpointsLeft = FALSE;
+
+    if (!ImodTopologyPointerValid(header, DeviceContext, contextLength) ||
+        !platform->MapWindow(platform->Context, DeviceContext, contextLength, &contextWindow))
+    {
+        if (cached != NULL)
+        {
+            cached->Fingerprint = 0;
+        }
+
+        return;
+    }
+
+    if (!platform->Read32(platform->Context, &contextWindow, 0x0, &slotDwords[0]) ||
+        !platform->Read32(platform->Context, &contextWindow, 0x4, &slotDwords[1]) ||
+        !platform->Read32(platform->Context, &contextWindow, 0x8, &slotDwords[2]) ||
+        !platform->Read32(platform->Context, &contextWindow, 0xC, &slotDwords[3]))
+    {
+        platform->UnmapWindow(platform->Context, &contextWindow);
+
+        if (cached != NULL)
+        {
+            cached->Fingerprint = 0;
+        }
+
+        return;
+    }
+
+    contextEntries = IMOD_XHCI_SLOT_CONTEXT_ENTRIES(slotDwords[0]);
+
+    fingerprint = ImodTopologyHash(IMOD_TOPOLOGY_FNV_OFFSET, DeviceContext);
+    fingerprint = ImodTopologyHash(fingerprint, ((ULONGLONG)slotDwords[1] << 32) | slotDwords[0]);
+    fingerprint = ImodTopologyHash(fingerprint, ((ULONGLONG)slotDwords[3] << 32) | slotDwords[2]);
+
+    for (contextIndex = 1; contextIndex <= contextEntries; ++contextIndex)
+    {
+        ULONG offset = contextIndex * header->contextSize;
+        ULONG *dwords = endpointDwords[contextIndex - 1];
+
+        endpointRead[contextIndex - 1] =
+            platform->Read32(platform->Context, &contextWindow, offset, &dwords[0]) &&
+            platform->Read32(platform->Context, &contextWindow, offset + 0x4, &dwords[1]);
+
+        fingerprint = ImodTopologyHash(
+            fingerprint,
+            endpointRead[contextIndex - 1] ? ((ULONGLONG)dwords[1] << 32) | dwords[0] : ~0ULL);
+    }
+
+    if (fingerprint == 0)
+    {
+        fingerprint = 1;
+    }
+
+    slot = &State->Slots[header->slotCount++];
+    ++State->Walk->slotsScanned;
+
+    if (cached != NULL && cached->Fingerprint == fingerprint)
+    {
+        platform->UnmapWindow(platform->Context, &contextWindow);
+
+        RtlCopyMemory(slot, &cached->Slot, sizeof(*slot));
+        ImodTopologyEmitEndpoints(State, slot, cached->Endpoints, cached->Slot.endpointCount);
+        ++State->Walk->slotsReused;
+        return;
+    }
+
+    for (contextIndex = 1; contextIndex <= contextEntries; ++contextIndex)
+    {
+        struct tagImodTopologyEndpoint *endpoint;
+        ULONG offset = contextIndex * header->contextSize;
+        ULONG endpointDword0 = endpointDwords[contextIndex - 1][0];
+        ULONG endpointDword1 = endpointDwords[contextIndex - 1][1];
+        ULONGLONG dequeuePointer = 0;
+
+        if (!endpointRead[contextIndex - 1] || IMOD_XHCI_EP_STATE(endpointDword0) == 0)
+        {
+            continue;
+        }
+
+        if (!ImodTopologyRead64(platform, &contextWindow, offset + 0x8, &dequeuePointer))
+        {
+            continue;
+        }
+
+        /* Without a cache to fill, stop where the reply does. */
+        if (cached == NULL && header->endpointCount + endpointCount >= header->endpointCapacity)
+        {
+            endpointsLeft = TRUE;
+            break;
+        }
+
+        endpoint = &endpoints[endpointCount++];
+        RtlZeroMemory(endpoint, sizeof(*endpoint));
+        endpoint->contextIndex = (UCHAR)contextIndex;
+        endpoint->state = (UCHAR)IMOD_XHCI_EP_STATE(endpointDword0);
+        endpoint->type = (UCHAR)IMOD_XHCI_EP_TYPE(endpointDword1);
+
+        ImodTopologyReadFirstTrb(State, dequeuePointer & IMOD_XHCI_RING_POINTER_MASK, endpoint);
+    }
+
+    platform->UnmapWindow(platform->Context, &contextWindow);
+
+    RtlZeroMemory(slot, sizeof(*slot));
+    slot->slotId = (UCHAR)SlotId;
+    slot->slotState = (UCHAR)IMOD_XHCI_SLOT_STATE(slotDwords[3]);
+    slot->rootPort = (UCHAR)IMOD_XHCI_SLOT_ROOT_PORT(slotDwords[1]);
+    slot->deviceAddress = (UCHAR)IMOD_XHCI_SLOT_DEVICE_ADDRESS(slotDwords[3]);
+    slot->routeString = IMOD_XHCI_SLOT_ROUTE_STRING(slotDwords[0]);
+    slot->interrupter = (USHORT)IMOD_XHCI_SLOT_INTERRUPTER(slotDwords[2]);
+    slot->contextEntries = (UCHAR)contextEntries;
+    slot->flags = IMOD_XHCI_SLOT_HUB(slotDwords[0]) != 0 ? IMOD_TOPOLOGY_SLOT_HUB : 0;
+    slot->endpointCount = (USHORT)endpointCount;
+    ++State->Walk->slotsRead;
+    State->Walk->endpointsRead += endpointCount;
+
+    if (cached != NULL)
+    {
+        cached->Fingerprint = fingerprint;
+        RtlCopyMemory(&cached->Slot, slot, sizeof(*slot));
+        RtlCopyMemory(cached->Endpoints, endpoints, endpointCount * sizeof(struct tagImodTopologyEndpoint));
+    }
+
+    ImodTopologyEmitEndpoints(State, slot, endpoints, endpointCount);
+
+    if (endpointsLeft)
+    {
+        slot->flags |= IMOD_TOPOLOGY_SLOT_ENDPOINTS_TRUNCATED;
+        header->truncated |= IMOD_TOPOLOGY_TRUNCATED_ENDPOINTS;
+    }
+}
+
+VOID ImodTopologyCacheReset(PIMOD_TOPOLOGY_CACHE Cache)
+{
+    ULONG slotId;
+
+    Cache->Valid = FALSE;
+
+    for (slotId = 0; slotId <= IMOD_XHCI_MAX_SLOTS; ++slotId)
+    {
+        Cache->Slots[slotId].Fingerprint = 0;
+    }
+}
+
+/* Slot IDs only mean the same device under the same layout and DCBAA. */
+static VOID ImodTopologyCacheBind(PIMOD_TOPOLOGY_CACHE Cache, const struct tagImodTopologyHeader *Header)
+{
+    if (Cache->Valid &&
+        Cache->CapabilityAddress == Header->capabilityAddress &&
+        Cache->Dcbaap == Header->dcbaap &&
+        Cache->MaxSlots == Header->maxSlots &&
+        Cache->MaxIntrs == Header->maxIntrs &&
+        Cache->ContextSize == Header->contextSize)
+    {
+        return;
+    }
+
+    ImodTopologyCacheReset(Cache);
+    Cache->CapabilityAddress = Header->capabilityAddress;
+    Cache->Dcbaap = Header->dcbaap;
+    Cache->MaxSlots = Header->maxSlots;
+    Cache->MaxIntrs = Header->maxIntrs;
+    Cache->ContextSize = Header->contextSize;
+    Cache->Valid = TRUE;
+}
+
+ULONG ImodTopologySnapshot(
+    const IMOD_PLATFORM *Platform,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    return ImodTopologySnapshotCached(Platform, NULL, Buffer, InputLength, OutputLength, BytesReturned);
+}
+
+ULONG ImodTopologySnapshotCached(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_TOPOLOGY_CACHE Cache,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    struct tagImodTopologyHeader header;
+    struct tagImodTopologyWalk walk;
+    IMOD_TOPOLOGY_COUNTER counter;
+    IMOD_PLATFORM platform;
+    IMOD_TOPOLOGY_STATE state;
+    IMOD_REGISTER_WINDOW dcbaaWindow;
+    ULONG requiredLength;
+    ULONG result;
+    ULONG slotId;
+
+    *BytesReturned = 0;
+
+    if (Platform == NULL || Buffer == NULL || InputLength < sizeof(header) || OutputLength < sizeof(header))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&header, Buffer, sizeof(header));
+
+    if (header.version != IMOD_TOPOLOGY_VERSION)
+    {
+        return IMOD_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    if ((header.flags & ~IMOD_TOPOLOGY_FLAGS) != 0 || header.capabilityAddress == 0 ||
+        (header.hcsparamsOffset & 0x3) != 0 || header.hcsparamsOffset >= IMOD_TOPOLOGY_MAX_CAPABILITY_OFFSET ||
+        header.slotCapacity == 0 || header.slotCapacity > IMOD_XHCI_MAX_SLOTS ||
+        header.endpointCapacity > IMOD_TOPOLOGY_MAX_ENDPOINTS)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    requiredLength = sizeof(header) +
+        (header.slotCapacity * sizeof(struct tagImodTopologySlot)) +
+        (header.endpointCapacity * sizeof(struct tagImodTopologyEndpoint)) +
+        ((header.flags & IMOD_TOPOLOGY_FLAG_WALK) != 0 ? sizeof(walk) : 0);
+    if (InputLength < requiredLength || OutputLength < requiredLength)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    header.capLength = 0;
+    header.maxSlots = 0;
+    header.maxIntrs = 0;
+    header.contextSize = 0;
+    header.slotCount = 0;
+    header.endpointCount = 0;
+    header.truncated = 0;
+    header.dcbaap = 0;
+
+    RtlZeroMemory(&walk, sizeof(walk));
+    counter.Inner = Platform;
+    counter.Walk = &walk;
+    platform.Context = &counter;
+    platform.MapWindow = ImodTopologyCountMapWindow;
+    platform.UnmapWindow = ImodTopologyCountUnmapWindow;
+    platform.Read32 = ImodTopologyCountRead32;
+    platform.Write32 = ImodTopologyCountWrite32;
+    platform.ReadRegister = ImodTopologyCountReadRegister;
+    platform.WriteRegister = ImodTopologyCountWriteRegister;
+
+    if (Cache != NULL && (header.flags & IMOD_TOPOLOGY_FLAG_REFRESH) != 0)
+    {
+        ImodTopologyCacheReset(Cache);
+    }
+
+    result = ImodTopologyReadControllerLayout(&platform, &header);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (Cache != NULL)
+    {
+        ImodTopologyCacheBind(Cache, &header);
+    }
+
+    if (!platform.MapWindow(
+            platform.Context,
+            header.dcbaap,
+            (header.maxSlots + 1) * sizeof(ULONGLONG),
+            &dcbaaWindow))
+    {
+        return IMOD_RESULT_MAP_FAILED;
+    }
+
+    state.Platform = &platform;
+    state.Header = &header;
+    state.Slots = (struct tagImodTopologySlot *)((UCHAR *)Buffer + sizeof(header));
+    state.Endpoints = (struct tagImodTopologyEndpoint *)((UCHAR *)Buffer + sizeof(header) +
+        (header.slotCapacity * sizeof(struct tagImodTopologySlot)));
+    state.Cache = Cache;
+    state.Walk = &walk;
+
+    /* DCBAA entry 0 is the scratchpad array, device slots start at 1. */
+    for (slotId = 1; slotId <= header.maxSlots; ++slotId)
+    {
+        ULONGLONG deviceContext = 0;
+
+        if (!ImodTopologyRead64(&platform, &dcbaaWindow, slotId * sizeof(ULONGLONG), &deviceContext))
+        {
+            continue;
+        }
+
+        deviceContext &= IMOD_XHCI_CONTEXT_POINTER_MASK;
+        if (deviceContext == 0)
+        {
+            if (Cache != NULL && Cache->Slots[slotId].Fingerprint != 0)
+            {
+                Cache->Slots[slotId].Fingerprint = 0;
+                ++walk.slotsDropped;
+            }
+
+            continue;
+        }
+
+        if (header.slotCount >= header.slotCapacity)
+        {
+            header.truncated |= IMOD_TOPOLOGY_TRUNCATED_SLOTS;
+            break;
+        }
+
+        ImodTopologyReadSlot(&state, slotId, deviceContext);
+    }
+
+    platform.UnmapWindow(platform.Context, &dcbaaWindow);
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+
+    if ((header.flags & IMOD_TOPOLOGY_FLAG_WALK) != 0)
+    {
+        RtlCopyMemory((UCHAR *)Buffer + requiredLength - sizeof(walk), &walk, sizeof(walk));
+    }
+
+    *BytesReturned = requiredLength;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodTopologyEncodeRoute(const ULONG *Ports, ULONG Count, ULONG *RootPort, ULONG *RouteString)
+{
+    ULONG route = 0;
+    ULONG tier;
+
+    if (Ports == NULL || RootPort == NULL || RouteString == NULL || Count == 0 ||
+        Count > IMOD_TOPOLOGY_ROUTE_MAX_PORTS || Ports[0] == 0 || Ports[0] > 0xFF)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (tier = 1; tier < Count; ++tier)
+    {
+        if (Ports[tier] == 0 || Ports[tier] > 0xF)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        route |= Ports[tier] << ((tier - 1) * 4);
+    }
+
+    *RootPort = Ports[0];
+    *RouteString = route;
+    return IMOD_RESULT_SUCCESS;
+}
+
+ULONG ImodTopologyParseRoute(const char *Text, ULONG Length, ULONG *RootPort, ULONG *RouteString)
+{
+    ULONG ports[IMOD_TOPOLOGY_ROUTE_MAX_PORTS];
+    ULONG count = 0;
+    ULONG digits = 0;
+    ULONG value = 0;
+    ULONG i;
+
+    if (Text == NULL || Length == 0)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    for (i = 0; i <= Length; ++i)
+    {
+        if (i == Length || Text[i] == '.')
+        {
+            if (digits == 0 || count == IMOD_TOPOLOGY_ROUTE_MAX_PORTS)
+            {
+                return IMOD_RESULT_INVALID_PARAMETER;
+            }
+
+            ports[count++] = value;
+            digits = 0;
+            value = 0;
+            continue;
+        }
+
+        /* Three digits already cover every root port; more only hide an overflow. */
+        if (Text[i] < '0' || Text[i] > '9' || digits == 3)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        value = (value * 10) + (ULONG)(Text[i] - '0');
+        ++digits;
+    }
+
+    return ImodTopologyEncodeRoute(ports, count, RootPort, RouteString);
+}
+
+ULONG ImodTopologyFormatRoute(ULONG RootPort, ULONG RouteString, char *Buffer, ULONG BufferSize, ULONG *Written)
+{
+    char text[IMOD_TOPOLOGY_ROUTE_TEXT_SIZE];
+    ULONG length = 0;
+    ULONG tier;
+    ULONG port;
+
+    if (Buffer == NULL || Written == NULL || RootPort == 0 || RootPort > 0xFF)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (RootPort >= 100)
+    {
+        text[length++] = (char)('0' + (RootPort / 100));
+    }
+    if (RootPort >= 10)
+    {
+        text[length++] = (char)('0' + ((RootPort / 10) % 10));
+    }
+    text[length++] = (char)('0' + (RootPort % 10));
+
+    for (tier = 0; tier < IMOD_TOPOLOGY_ROUTE_MAX_TIERS; ++tier)
+    {
+        port = (RouteString >> (tier * 4)) & 0xF;
+        if (port == 0)
+        {
+            break;
+        }
+
+        text[length++] = '.';
+        if (port >= 10)
+        {
+            text[length++] = '1';
+        }
+        text[length++] = (char)('0' + (port % 10));
+    }
+
+    if (BufferSize <= length)
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlCopyMemory(Buffer, text, length);
+    Buffer[length] = '\0';
+    *Written = length;
+    return IMOD_RESULT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "imod_platform.h"
+#include "imod_xhci.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_TOPOLOGY_VERSION 1UL
+
+/* Append a tagImodTopologyWalk after the endpoint records. */
+#define IMOD_TOPOLOGY_FLAG_WALK 0x00000001UL
+/* Drop everything cached for the controller before walking it. */
+#define IMOD_TOPOLOGY_FLAG_REFRESH 0x00000002UL
+#define IMOD_TOPOLOGY_FLAGS (IMOD_TOPOLOGY_FLAG_WALK | IMOD_TOPOLOGY_FLAG_REFRESH)
+
+#define IMOD_TOPOLOGY_SLOT_HUB 0x01
+#define IMOD_TOPOLOGY_SLOT_ENDPOINTS_TRUNCATED 0x02
+
+#define IMOD_TOPOLOGY_ENDPOINT_TRB_VALID 0x01
+
+#define IMOD_TOPOLOGY_TRUNCATED_SLOTS 0x00000001UL
+#define IMOD_TOPOLOGY_TRUNCATED_ENDPOINTS 0x00000002UL
+
+#pragma pack(push, 1)
+
+/*
+ * Request and reply share one buffer: the header is followed by
+ * slotCapacity slot records, then endpointCapacity endpoint records and,
+ * with IMOD_TOPOLOGY_FLAG_WALK, one walk record. Fields up to
+ * endpointCapacity are input; the rest are filled in.
+ */
+struct tagImodTopologyHeader
+{
+    ULONG version;
+    ULONG flags;
+    ULONGLONG capabilityAddress;
+    ULONGLONG barLength;
+    ULONG hcsparamsOffset;
+    ULONG slotCapacity;
+    ULONG endpointCapacity;
+    ULONG capLength;
+    ULONG maxSlots;
+    ULONG maxIntrs;
+    ULONG contextSize;
+    ULONG slotCount;
+    ULONG endpointCount;
+    ULONG truncated;
+    ULONGLONG dcbaap;
+};
+
+struct tagImodTopologySlot
+{
+    UCHAR slotId;
+    UCHAR slotState;
+    UCHAR rootPort;
+    UCHAR deviceAddress;
+    ULONG routeString;
+    USHORT interrupter;
+    UCHAR contextEntries;
+    UCHAR flags;
+    USHORT firstEndpoint;
+    USHORT endpointCount;
+};
+
+struct tagImodTopologyEndpoint
+{
+    UCHAR contextIndex;
+    UCHAR state;
+    UCHAR type;
+    UCHAR flags;
+    USHORT trbInterrupter;
+    UCHAR trbType;
+    UCHAR reserved;
+};
+
+/*
+ * What the walk cost. slotsScanned counts occupied DCBAA entries;
+ * each of them was either read in full or reused from the cache.
+ * slotsDropped counts cached slots whose DCBAA entry has gone.
+ */
+struct tagImodTopologyWalk
+{
+    ULONG slotsScanned;
+    ULONG slotsRead;
+    ULONG slotsReused;
+    ULONG slotsDropped;
+    ULONG endpointsRead;
+    ULONG maps;
+    ULONG reads;
+    ULONG reserved;
+};
+
+#pragma pack(pop)
+
+/*
+ * Last walk of one controller, in flat arrays indexed by slot ID. A slot
+ * is fingerprinted over its device context pointer, the slot context and
+ * the first two dwords of every endpoint context it declares; while that
+ * stays the same its records are replayed instead of following each
+ * endpoint's ring. Fingerprint 0 marks an empty entry.
+ */
+typedef struct _IMOD_TOPOLOGY_CACHE_SLOT
+{
+    ULONGLONG Fingerprint;
+    struct tagImodTopologySlot Slot;
+    struct tagImodTopologyEndpoint Endpoints[IMOD_XHCI_MAX_CONTEXT_ENTRIES];
+} IMOD_TOPOLOGY_CACHE_SLOT, *PIMOD_TOPOLOGY_CACHE_SLOT;
+
+typedef struct _IMOD_TOPOLOGY_CACHE
+{
+    ULONGLONG CapabilityAddress;
+    ULONGLONG Dcbaap;
+    ULONG MaxSlots;
+    ULONG MaxIntrs;
+    ULONG ContextSize;
+    BOOLEAN Valid;
+    IMOD_TOPOLOGY_CACHE_SLOT Slots[IMOD_XHCI_MAX_SLOTS + 1];
+} IMOD_TOPOLOGY_CACHE, *PIMOD_TOPOLOGY_CACHE;
+
+VOID ImodTopologyCacheReset(PIMOD_TOPOLOGY_CACHE Cache);
+
+ULONG ImodTopologySnapshot(
+    const IMOD_PLATFORM *Platform,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+/*
+ * ImodTopologySnapshot through Cache, which may be NULL. The cache is
+ * rebuilt whenever the controller layout or DCBAAP no longer match it.
+ */
+ULONG ImodTopologySnapshotCached(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_TOPOLOGY_CACHE Cache,
+    PVOID Buffer,
+    ULONG InputLength,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+/*
+ * A device's place below the controller as a port path, "7.2.4": root
+ * hub port 7, then port 2 of the hub there and port 4 of the hub below
+ * that. The slot context holds the same path as its root port number and
+ * a Route String with one 4-bit hub port per tier, tier 1 in the low
+ * nibble, ending at the first zero, so a path has at most five hubs, each
+ * entered through ports 1-15.
+ */
+#define IMOD_TOPOLOGY_ROUTE_MAX_TIERS 5UL
+#define IMOD_TOPOLOGY_ROUTE_MAX_PORTS (IMOD_TOPOLOGY_ROUTE_MAX_TIERS + 1UL)
+/* "255.15.15.15.15.15" and its NUL. */
+#define IMOD_TOPOLOGY_ROUTE_TEXT_SIZE 19UL
+
+/* Ports[0] is the root port and Ports[1 .. Count - 1] the hub ports below it. */
+ULONG ImodTopologyEncodeRoute(const ULONG *Ports, ULONG Count, ULONG *RootPort, ULONG *RouteString);
+
+/*
+ * Length characters of Text, without spaces. Anything but decimal ports
+ * separated by single dots fails, as does a path the slot context cannot
+ * hold.
+ */
+ULONG ImodTopologyParseRoute(const char *Text, ULONG Length, ULONG *RootPort, ULONG *RouteString);
+
+/*
+ * The path NUL-terminated in Buffer; *Written leaves the NUL out. Route
+ * String nibbles past the first zero are ignored, as the controller does.
+ */
+ULONG ImodTopologyFormatRoute(ULONG RootPort, ULONG RouteString, char *Buffer, ULONG BufferSize, ULONG *Written);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,306 @@
+#include "imod_watchdog.h"
+
+static ULONG ImodWatchdogWidthMask(const struct tagImodWatchdogEntry *Entry)
+{
+    return Entry->accessSize == sizeof(USHORT) ? 0xFFFFUL : 0xFFFFFFFFUL;
+}
+
+ULONG ImodWatchdogValidate(const VOID *Config, ULONG Length, ULONG *EntryCount)
+{
+    const struct tagImodWatchdogConfigHeader *header = (const struct tagImodWatchdogConfigHeader *)Config;
+    const struct tagImodWatchdogEntry *entries;
+    ULONG groups[IMOD_WATCHDOG_MAX_GROUPS];
+    ULONG groupCount = 0;
+    ULONG index;
+
+    *EntryCount = 0;
+
+    if (Config == NULL || Length < sizeof(*header))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (header->version != IMOD_WATCHDOG_VERSION)
+    {
+        return IMOD_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    if (header->flags != 0 || header->entryCount > IMOD_WATCHDOG_MAX_ENTRIES)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (Length < sizeof(*header) + (header->entryCount * sizeof(struct tagImodWatchdogEntry)))
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    if (header->entryCount != 0 &&
+        (header->periodMs < IMOD_WATCHDOG_MIN_PERIOD_MS || header->periodMs > IMOD_WATCHDOG_MAX_PERIOD_MS))
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    entries = (const struct tagImodWatchdogEntry *)(header + 1);
+    for (index = 0; index < header->entryCount; ++index)
+    {
+        const struct tagImodWatchdogEntry *entry = &entries[index];
+        ULONG group;
+
+        if (entry->accessSize != sizeof(USHORT) && entry->accessSize != sizeof(ULONG))
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        if (entry->address == 0 || (entry->address & (entry->accessSize - 1)) != 0 ||
+            entry->address + entry->accessSize < entry->address ||
+            entry->mask == 0 || ((entry->mask | entry->orBits) & ~ImodWatchdogWidthMask(entry)) != 0 ||
+            (entry->value & ~entry->mask) != 0 || (entry->orBits & entry->mask) != 0 ||
+            entry->reserved != 0)
+        {
+            return IMOD_RESULT_INVALID_PARAMETER;
+        }
+
+        for (group = 0; group < groupCount && groups[group] != entries[index].groupId; ++group)
+        {
+        }
+
+        if (group == groupCount)
+        {
+            if (groupCount == IMOD_WATCHDOG_MAX_GROUPS)
+            {
+                return IMOD_RESULT_INVALID_PARAMETER;
+            }
+
+            groups[groupCount++] = entries[index].groupId;
+        }
+    }
+
+    *EntryCount = header->entryCount;
+    return IMOD_RESULT_SUCCESS;
+}
+
+SIZE_T ImodWatchdogRequiredSize(ULONG EntryCount)
+{
+    return sizeof(IMOD_WATCHDOG) +
+        ((SIZE_T)EntryCount * (sizeof(struct tagImodWatchdogEntry) + sizeof(IMOD_WATCHDOG_WINDOW) + sizeof(UCHAR)));
+}
+
+static ULONG ImodWatchdogGroupIndex(PIMOD_WATCHDOG Watchdog, ULONG GroupId)
+{
+    ULONG index;
+
+    for (index = 0; index < Watchdog->GroupCount; ++index)
+    {
+        if (Watchdog->Groups[index].groupId == GroupId)
+        {
+            return index;
+        }
+    }
+
+    Watchdog->Groups[index].groupId = GroupId;
+    ++Watchdog->GroupCount;
+    return index;
+}
+
+ULONG ImodWatchdogInitialize(PIMOD_WATCHDOG Watchdog, SIZE_T Size, const VOID *Config, ULONG Length)
+{
+    const struct tagImodWatchdogConfigHeader *header = (const struct tagImodWatchdogConfigHeader *)Config;
+    PIMOD_WATCHDOG_WINDOW window = NULL;
+    ULONG entryCount = 0;
+    ULONG result;
+    ULONG index;
+
+    result = ImodWatchdogValidate(Config, Length, &entryCount);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (Watchdog == NULL || Size < ImodWatchdogRequiredSize(entryCount))
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlZeroMemory(Watchdog, ImodWatchdogRequiredSize(entryCount));
+    Watchdog->PeriodMs = header->periodMs;
+    Watchdog->EntryCount = entryCount;
+    Watchdog->Entries = (struct tagImodWatchdogEntry *)(Watchdog + 1);
+    Watchdog->Windows = (PIMOD_WATCHDOG_WINDOW)(Watchdog->Entries + entryCount);
+    Watchdog->EntryGroups = (UCHAR *)(Watchdog->Windows + entryCount);
+    RtlCopyMemory(Watchdog->Entries, header + 1, entryCount * sizeof(struct tagImodWatchdogEntry));
+
+    for (index = 0; index < entryCount; ++index)
+    {
+        const struct tagImodWatchdogEntry *entry = &Watchdog->Entries[index];
+        ULONG group = ImodWatchdogGroupIndex(Watchdog, entry->groupId);
+
+        Watchdog->EntryGroups[index] = (UCHAR)group;
+        ++Watchdog->Groups[group].entryCount;
+
+        /* Neighbouring registers share one mapping per pass. */
+        if (window == NULL || entry->address < window->Base ||
+            entry->address + entry->accessSize - window->Base > IMOD_WATCHDOG_MAX_WINDOW)
+        {
+            window = &Watchdog->Windows[Watchdog->WindowCount++];
+            window->Base = entry->address;
+            window->FirstEntry = index;
+        }
+
+        if (entry->address + entry->accessSize - window->Base > window->Length)
+        {
+            window->Length = (ULONG)(entry->address + entry->accessSize - window->Base);
+        }
+
+        ++window->EntryCount;
+    }
+
+    return IMOD_RESULT_SUCCESS;
+}
+
+static ULONG ImodWatchdogCheckWindow(
+    const IMOD_PLATFORM *Platform,
+    PIMOD_WATCHDOG Watchdog,
+    const IMOD_WATCHDOG_WINDOW *Window,
+    UCHAR *Drifted)
+{
+    IMOD_REGISTER_WINDOW mapping;
+    ULONG rewritten = 0;
+    ULONG index;
+
+    if (!Platform->MapWindow(Platform->Context, Window->Base, Window->Length, &mapping))
+    {
+        for (index = Window->FirstEntry; index < Window->FirstEntry + Window->EntryCount; ++index)
+        {
+            ++Watchdog->Groups[Watchdog->EntryGroups[index]].unavailable;
+        }
+
+        return 0;
+    }
+
+    for (index = Window->FirstEntry; index < Window->FirstEntry + Window->EntryCount; ++index)
+    {
+        const struct tagImodWatchdogEntry *entry = &Watchdog->Entries[index];
+        struct tagImodWatchdogGroupStatus *group = &Watchdog->Groups[Watchdog->EntryGroups[index]];
+        ULONG offset = (ULONG)(entry->address - Window->Base);
+        ULONG widthMask = ImodWatchdogWidthMask(entry);
+        ULONGLONG raw = 0;
+        ULONG currentValue;
+
+        /*
+         * All ones is a device in D3 or being reset; writing now would be lost.
+         * Registers are accessed at their own width, so a 16-bit register never
+         * takes a read-modify-write of its neighbour.
+         */
+        if (!Platform->ReadRegister(Platform->Context, &mapping, offset, entry->accessSize, &raw) ||
+            ((ULONG)raw & widthMask) == widthMask)
+        {
+            ++group->unavailable;
+            continue;
+        }
+
+        currentValue = (ULONG)raw & widthMask;
+        if ((currentValue & entry->mask) == entry->value)
+        {
+            continue;
+        }
+
+        Drifted[Watchdog->EntryGroups[index]] = TRUE;
+
+        if (!Platform->WriteRegister(
+                Platform->Context,
+                &mapping,
+                offset,
+                entry->accessSize,
+                (currentValue & ~entry->mask) | entry->value | entry->orBits))
+        {
+            ++group->writeFailures;
+            continue;
+        }
+
+        ++group->rewrites;
+        ++rewritten;
+    }
+
+    Platform->UnmapWindow(Platform->Context, &mapping);
+    return rewritten;
+}
+
+ULONG ImodWatchdogCheck(const IMOD_PLATFORM *Platform, PIMOD_WATCHDOG Watchdog)
+{
+    UCHAR drifted[IMOD_WATCHDOG_MAX_GROUPS];
+    ULONG rewritten = 0;
+    ULONG index;
+
+    if (Platform == NULL || Watchdog == NULL)
+    {
+        return 0;
+    }
+
+    RtlZeroMemory(drifted, sizeof(drifted));
+    ++Watchdog->Passes;
+
+    for (index = 0; index < Watchdog->WindowCount; ++index)
+    {
+        rewritten += ImodWatchdogCheckWindow(Platform, Watchdog, &Watchdog->Windows[index], drifted);
+    }
+
+    /* A controller reset touches every interrupter at once; count it as one event. */
+    for (index = 0; index < Watchdog->GroupCount; ++index)
+    {
+        if (drifted[index])
+        {
+            ++Watchdog->Groups[index].driftEvents;
+            Watchdog->Groups[index].lastDriftPass = Watchdog->Passes;
+        }
+    }
+
+    return rewritten;
+}
+
+ULONG ImodWatchdogQuery(
+    const IMOD_WATCHDOG *Watchdog,
+    PVOID Buffer,
+    ULONG OutputLength,
+    ULONG *BytesReturned)
+{
+    struct tagImodWatchdogStatusHeader header;
+    ULONG capacity;
+    ULONG count;
+
+    *BytesReturned = 0;
+
+    if (Buffer == NULL)
+    {
+        return IMOD_RESULT_INVALID_PARAMETER;
+    }
+
+    if (OutputLength < sizeof(header))
+    {
+        return IMOD_RESULT_BUFFER_TOO_SMALL;
+    }
+
+    RtlZeroMemory(&header, sizeof(header));
+    header.version = IMOD_WATCHDOG_VERSION;
+
+    if (Watchdog != NULL)
+    {
+        header.armed = Watchdog->EntryCount != 0 ? 1UL : 0UL;
+        header.periodMs = Watchdog->PeriodMs;
+        header.entryCount = Watchdog->EntryCount;
+        header.groupCount = Watchdog->GroupCount;
+        header.windowCount = Watchdog->WindowCount;
+        header.passes = Watchdog->Passes;
+    }
+
+    capacity = (OutputLength - sizeof(header)) / sizeof(struct tagImodWatchdogGroupStatus);
+    count = header.groupCount < capacity ? header.groupCount : capacity;
+    if (count != 0)
+    {
+        RtlCopyMemory((UCHAR *)Buffer + sizeof(header), Watchdog->Groups, count * sizeof(struct tagImodWatchdogGroupStatus));
+    }
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+    *BytesReturned = sizeof(header) + (count * sizeof(struct tagImodWatchdogGroupStatus));
+    return IMOD_RESULT_SUCCESS;
+}
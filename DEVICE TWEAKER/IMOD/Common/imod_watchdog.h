@@ -0,0 +1,114 @@
+#pragma once
+
+#include "imod_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMOD_WATCHDOG_VERSION 2UL
+
+#define IMOD_WATCHDOG_MAX_ENTRIES 16384UL
+#define IMOD_WATCHDOG_MAX_GROUPS 64UL
+#define IMOD_WATCHDOG_MAX_WINDOW 0x10000UL
+#define IMOD_WATCHDOG_MIN_PERIOD_MS 100UL
+#define IMOD_WATCHDOG_MAX_PERIOD_MS 3600000UL
+
+#pragma pack(push, 1)
+
+/*
+ * Configuration request: the header is followed by entryCount entries.
+ * Each entry is a register of accessSize bytes (2 or 4) whose bits under
+ * `mask` must hold `value`; a rewrite keeps the bits outside `mask` and
+ * also sets `orBits`, write strobes such as EITR.CNT_WDIS that are not
+ * expected to read back. groupId ties entries to one controller or NIC
+ * adapter for the drift counters. entryCount == 0 disarms the watchdog.
+ */
+struct tagImodWatchdogConfigHeader
+{
+    ULONG version;
+    ULONG periodMs;
+    ULONG entryCount;
+    ULONG flags;
+};
+
+struct tagImodWatchdogEntry
+{
+    ULONGLONG address;
+    ULONG groupId;
+    ULONG mask;
+    ULONG value;
+    ULONG orBits;
+    ULONG accessSize;
+    ULONG reserved;
+};
+
+/* Query reply: the header is followed by groupCount group records. */
+struct tagImodWatchdogStatusHeader
+{
+    ULONG version;
+    ULONG armed;
+    ULONG periodMs;
+    ULONG entryCount;
+    ULONG groupCount;
+    ULONG windowCount;
+    ULONGLONG passes;
+};
+
+struct tagImodWatchdogGroupStatus
+{
+    ULONG groupId;
+    ULONG entryCount;
+    ULONG driftEvents;
+    ULONG rewrites;
+    ULONG writeFailures;
+    ULONG unavailable;
+    ULONGLONG lastDriftPass;
+};
+
+#pragma pack(pop)
+
+typedef struct _IMOD_WATCHDOG_WINDOW
+{
+    ULONGLONG Base;
+    ULONG Length;
+    ULONG FirstEntry;
+    ULONG EntryCount;
+} IMOD_WATCHDOG_WINDOW, *PIMOD_WATCHDOG_WINDOW;
+
+/*
+ * One allocation holds the watchdog, its entries and its windows; size it
+ * with ImodWatchdogRequiredSize. Consecutive entries that fit in one
+ * IMOD_WATCHDOG_MAX_WINDOW span share a window, so a pass maps each
+ * controller or NIC BAR region once.
+ */
+typedef struct _IMOD_WATCHDOG
+{
+    ULONG PeriodMs;
+    ULONG EntryCount;
+    ULONG WindowCount;
+    ULONG GroupCount;
+    ULONGLONG Passes;
+    struct tagImodWatchdogEntry *Entries;
+    UCHAR *EntryGroups;
+    PIMOD_WATCHDOG_WINDOW Windows;
+    struct tagImodWatchdogGroupStatus Groups[IMOD_WATCHDOG_MAX_GROUPS];
+} IMOD_WATCHDOG, *PIMOD_WATCHDOG;
+
+ULONG ImodWatchdogValidate(const VOID *Config, ULONG Length, ULONG *EntryCount);
+
+SIZE_T ImodWatchdogRequiredSize(ULONG EntryCount);
+
+ULONG ImodWatchdogInitialize(PIMOD_WATCHDOG Watchdog, SIZE_T Size, const VOID *Config, ULONG Length);
+
+ULONG ImodWatchdogCheck(const IMOD_PLATFORM *Platform, PIMOD_WATCHDOG Watchdog);
+
+ULONG ImodWatchdogQuery(
+    const IMOD_WATCHDOG *Watchdog,
+    PVOID Buffer,
+    ULONG OutputLength,
+    ULONG *BytesReturned);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#define IMOD_XHCI_CAPLENGTH_OFFSET 0x00
+#define IMOD_XHCI_HCSPARAMS1_OFFSET 0x04
+#define IMOD_XHCI_HCCPARAMS1_OFFSET 0x10
+#define IMOD_XHCI_DBOFF_OFFSET 0x14
+#define IMOD_XHCI_RTSOFF_OFFSET 0x18
+
+#define IMOD_XHCI_USBCMD_OFFSET 0x00
+#define IMOD_XHCI_USBSTS_OFFSET 0x04
+#define IMOD_XHCI_PAGESIZE_OFFSET 0x08
+
+#define IMOD_XHCI_DCBAAP_OFFSET 0x30
+#define IMOD_XHCI_CONFIG_OFFSET 0x38
+#define IMOD_XHCI_PORTSC_BASE 0x400UL
+#define IMOD_XHCI_PORT_STRIDE 0x10UL
+#define IMOD_XHCI_DOORBELL_ARRAY_SIZE 0x400UL
+
+#define IMOD_XHCI_USBCMD_RS 0x00000001UL
+#define IMOD_XHCI_USBCMD_INTE 0x00000004UL
+#define IMOD_XHCI_USBSTS_HCH 0x00000001UL
+#define IMOD_XHCI_PORTSC_CCS 0x00000001UL
+#define IMOD_XHCI_PORTSC_PED 0x00000002UL
+#define IMOD_XHCI_PORTSC_PP 0x00000200UL
+
+#define IMOD_XHCI_RTSOFF_MASK 0xFFFFFFE0UL
+#define IMOD_XHCI_INTERRUPTER_BASE 0x20UL
+#define IMOD_XHCI_INTERRUPTER_STRIDE 0x20UL
+#define IMOD_XHCI_IMAN_OFFSET 0x00UL
+#define IMOD_XHCI_IMOD_OFFSET 0x04UL
+#define IMOD_XHCI_ERSTSZ_OFFSET 0x08UL
+#define IMOD_XHCI_ERSTBA_OFFSET 0x10UL
+#define IMOD_XHCI_ERDP_OFFSET 0x18UL
+
+#define IMOD_XHCI_IMAN_IP 0x00000001UL
+#define IMOD_XHCI_IMAN_IE 0x00000002UL
+#define IMOD_XHCI_IMODI_MASK 0x0000FFFFUL
+#define IMOD_XHCI_IMODC_MASK 0xFFFF0000UL
+#define IMOD_XHCI_IMODI_TICK_NS 250UL
+#define IMOD_XHCI_IMODI_DEFAULT 4000UL
+
+#define IMOD_XHCI_ERSTSZ_MASK 0x0000FFFFUL
+#define IMOD_XHCI_ERST_ENTRY_SIZE 16UL
+#define IMOD_XHCI_ERST_BASE_MASK 0xFFFFFFFFFFFFFFC0ULL
+#define IMOD_XHCI_ERST_SIZE_MASK 0x0000FFFFUL
+#define IMOD_XHCI_ERDP_EHB 0x00000008UL
+#define IMOD_XHCI_MIN_EVENT_SEGMENT_TRBS 16UL
+#define IMOD_XHCI_MAX_EVENT_SEGMENT_TRBS 4096UL
+#define IMOD_XHCI_TRB_CYCLE 0x00000001UL
+#define IMOD_XHCI_TRB_TYPE_NORMAL 1UL
+#define IMOD_XHCI_TRB_TYPE_SETUP_STAGE 2UL
+#define IMOD_XHCI_TRB_TYPE_TRANSFER_EVENT 32UL
+#define IMOD_XHCI_COMPLETION_SUCCESS 1UL
+
+#define IMOD_XHCI_SLOT_STATE_CONFIGURED 3UL
+#define IMOD_XHCI_EP_STATE_RUNNING 1UL
+#define IMOD_XHCI_EP_TYPE_CONTROL 4UL
+
+#define IMOD_XHCI_MAX_INTERRUPTERS 1024UL
+#define IMOD_XHCI_MAX_SLOTS 255UL
+#define IMOD_XHCI_MAX_CONTEXT_ENTRIES 31UL
+#define IMOD_XHCI_DEVICE_CONTEXT_ENTRIES 32UL
+#define IMOD_XHCI_TRB_SIZE 16UL
+
+#define IMOD_XHCI_HCC1_CSZ 0x00000004UL
+#define IMOD_XHCI_CONTEXT_POINTER_MASK 0xFFFFFFFFFFFFFFC0ULL
+#define IMOD_XHCI_RING_POINTER_MASK 0xFFFFFFFFFFFFFFF0ULL
+
+/* Upper bound for capability + runtime registers of one controller BAR. */
+#define IMOD_XHCI_MAX_CONTROLLER_WINDOW 0x100000UL
+
+#define IMOD_XHCI_HCS1_MAX_SLOTS(value) ((value) & 0xFFUL)
+#define IMOD_XHCI_HCS1_MAX_INTRS(value) (((value) >> 8) & 0x7FFUL)
+#define IMOD_XHCI_HCS1_MAX_PORTS(value) (((value) >> 24) & 0xFFUL)
+
+#define IMOD_XHCI_SLOT_HUB(dword0) (((dword0) >> 26) & 0x1UL)
+#define IMOD_XHCI_SLOT_CONTEXT_ENTRIES(dword0) (((dword0) >> 27) & 0x1FUL)
+#define IMOD_XHCI_SLOT_ROUTE_STRING(dword0) ((dword0) & 0xFFFFFUL)
+#define IMOD_XHCI_SLOT_ROOT_PORT(dword1) (((dword1) >> 16) & 0xFFUL)
+#define IMOD_XHCI_SLOT_INTERRUPTER(dword2) (((dword2) >> 22) & 0x3FFUL)
+#define IMOD_XHCI_SLOT_DEVICE_ADDRESS(dword3) ((dword3) & 0xFFUL)
+#define IMOD_XHCI_SLOT_STATE(dword3) (((dword3) >> 27) & 0x1FUL)
+
+#define IMOD_XHCI_EP_STATE(dword0) ((dword0) & 0x7UL)
+#define IMOD_XHCI_EP_TYPE(dword1) (((dword1) >> 3) & 0x7UL)
+#define IMOD_XHCI_TRB_INTERRUPTER(dword2) (((dword2) >> 22) & 0x3FFUL)
+#define IMOD_XHCI_TRB_TYPE(dword3) (((dword3) >> 10) & 0x3FUL)
+
+#define IMOD_XHCI_INTERRUPTER_OFFSET(index) \
+    (IMOD_XHCI_INTERRUPTER_BASE + (IMOD_XHCI_INTERRUPTER_STRIDE * (ULONG)(index)))
+
+#define IMOD_XHCI_RUNTIME_WINDOW_SIZE(maxIntrs) \
+    (IMOD_XHCI_INTERRUPTER_BASE + (IMOD_XHCI_INTERRUPTER_STRIDE * (ULONG)(maxIntrs)))
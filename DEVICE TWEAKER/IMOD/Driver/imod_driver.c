@@ -1,8 +1,18 @@
 #include <ntddk.h>
 #include <initguid.h>
+#include <wdmguid.h>
 #include <wdmsec.h>
+#include <usbiodef.h>
+#include <intrin.h>
 
 #include "imod_driver.h"
+#include "imod_batch.h"
+#include "imod_boot.h"
+#include "imod_msix.h"
+#include "imod_session.h"
+#include "imod_topology.h"
+#include "imod_watchdog.h"
+#include "imod_xhci.h"
 
 extern NTKERNELAPI NTSTATUS IoCreateDriver(PUNICODE_STRING DriverName, PDRIVER_INITIALIZE InitializationFunction);
 
@@ -10,10 +20,53 @@ extern NTKERNELAPI NTSTATUS IoCreateDriver(PUNICODE_STRING DriverName, PDRIVER_I
 #define IMOD_DEVICE_NAME L"\\Device\\DeviceTweakerImod2"
 #define IMOD_DOS_DEVICE_NAME L"\\DosDevices\\DeviceTweakerImod2"
 #define IMOD_MAX_MAP_SIZE PAGE_SIZE
+#define IMOD_POOL_TAG 'domI'
+#define IMOD_BOOT_PARAMETERS_SUFFIX L"\\Parameters"
+#define IMOD_BOOT_MAX_TABLE_SIZE 0x20000UL
+#define IMOD_TOPOLOGY_MAX_CACHES 4UL
+
+typedef struct _IMOD_FILE_CONTEXT
+{
+    FAST_MUTEX Lock;
+    IMOD_SESSION_TABLE Sessions;
+} IMOD_FILE_CONTEXT, *PIMOD_FILE_CONTEXT;
 
 DEFINE_GUID(GUID_DEVCLASS_DEVICE_TWEAKER_IMOD,
     0x605c1705, 0x1cf0, 0x49c7, 0xa0, 0x56, 0xd6, 0x87, 0xa3, 0x70, 0x7f, 0xd0);
 
+/*
+ * Boot table state. Only present when DTIMOD was started as a service with
+ * an ImodBootTable value; guarded by ImodBootLock.
+ */
+static FAST_MUTEX ImodBootLock;
+static PIMOD_BOOT_STATE ImodBootState = NULL;
+static PVOID ImodBootTableData = NULL;
+static PVOID ImodBootNotificationEntry = NULL;
+static ULONG ImodBootWatchdogPeriodMs = 0;
+static ULONG ImodBootWatchdogConfigLength = 0;
+
+/*
+ * Register drift watchdog. The timer DPC only queues the work item; the
+ * compare/reassert pass maps registers, so it runs at PASSIVE_LEVEL under
+ * ImodWatchdogLock.
+ */
+static FAST_MUTEX ImodWatchdogLock;
+static PIMOD_WATCHDOG ImodWatchdog = NULL;
+static KTIMER ImodWatchdogTimer;
+static KDPC ImodWatchdogDpc;
+static PIO_WORKITEM ImodWatchdogWorkItem = NULL;
+static LONG ImodWatchdogQueued = 0;
+
+/*
+ * Topology caches, one per controller walked, so a repeated query only
+ * follows the rings of slots that changed since the last one. Allocated on
+ * a controller's first query; once all are taken the oldest is reused.
+ * Guarded by ImodTopologyLock.
+ */
+static FAST_MUTEX ImodTopologyLock;
+static PIMOD_TOPOLOGY_CACHE ImodTopologyCaches[IMOD_TOPOLOGY_MAX_CACHES] = { NULL };
+static ULONG ImodTopologyCacheNext = 0;
+
 static NTSTATUS ImodDriverDispatch(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp);
 static void ImodDriverUnload(IN PDRIVER_OBJECT DriverObject);
 static NTSTATUS ImodDriverInitialize(IN PDRIVER_OBJECT DriverObject);
@@ -21,6 +74,7 @@ static NTSTATUS ImodDriverCreateDriver(IN PDRIVER_OBJECT DriverObject, IN PUNICO
 static NTSTATUS ImodMapPhysicalMemory(
     PHYSICAL_ADDRESS physicalAddress,
     SIZE_T physicalMemorySize,
+    SIZE_T maximumSize,
     PVOID *mappedAddress,
     PVOID *mappedBase,
     SIZE_T *mappedSize);
@@ -35,10 +89,55 @@ static NTSTATUS ImodWritePhysicalMemory(
     PHYSICAL_ADDRESS physicalAddress,
     ULONG accessSize,
     ULONGLONG value);
+static NTSTATUS ImodReadRegister(PVOID address, ULONG accessSize, ULONGLONG *value);
+static NTSTATUS ImodWriteRegister(PVOID address, ULONG accessSize, ULONGLONG value);
 static BOOLEAN ImodIsValidAccessSize(ULONG accessSize);
+static NTSTATUS ImodSessionDispatch(
+    PFILE_OBJECT fileObject,
+    ULONG ioControlCode,
+    PVOID ioBuffer,
+    ULONG inputLength,
+    ULONG outputLength,
+    ULONG *bytesReturned);
+static NTSTATUS ImodResultToStatus(ULONG result);
+static NTSTATUS ImodTopologyQuery(PVOID ioBuffer, ULONG inputLength, ULONG outputLength, ULONG *bytesReturned);
+static VOID ImodTopologyShutdown(VOID);
+static NTSTATUS ImodMsixQuery(PVOID ioBuffer, ULONG inputLength, ULONG outputLength, ULONG *bytesReturned);
+static VOID ImodBootInitialize(IN PDRIVER_OBJECT DriverObject, IN PUNICODE_STRING RegistryPath);
+static VOID ImodBootShutdown(VOID);
+static NTSTATUS ImodBootReadTable(
+    IN PUNICODE_STRING RegistryPath,
+    PVOID *tableData,
+    ULONG *tableLength,
+    ULONG *watchdogPeriodMs);
+static NTSTATUS ImodBootInterfaceNotification(IN PVOID NotificationStructure, IN PVOID Context);
+static VOID ImodBootArmWatchdog(VOID);
+static NTSTATUS ImodWatchdogConfigure(const VOID *config, ULONG length);
+static VOID ImodWatchdogShutdown(VOID);
+static KDEFERRED_ROUTINE ImodWatchdogTimerDpc;
+static IO_WORKITEM_ROUTINE ImodWatchdogWorker;
+static BOOLEAN ImodKernelMapWindow(PVOID Context, ULONGLONG PhysicalAddress, ULONG Length, PIMOD_REGISTER_WINDOW Window);
+static VOID ImodKernelUnmapWindow(PVOID Context, PIMOD_REGISTER_WINDOW Window);
+static BOOLEAN ImodKernelRead32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG *Value);
+static BOOLEAN ImodKernelWrite32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG Value);
+static BOOLEAN ImodKernelReadRegister(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG *Value);
+static BOOLEAN ImodKernelWriteRegister(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG Value);
+
+static const IMOD_PLATFORM ImodKernelPlatform =
+{
+    NULL,
+    ImodKernelMapWindow,
+    ImodKernelUnmapWindow,
+    ImodKernelRead32,
+    ImodKernelWrite32,
+    ImodKernelReadRegister,
+    ImodKernelWriteRegister
+};
 
 NTSTATUS DriverEntry(IN PDRIVER_OBJECT DriverObject, IN PUNICODE_STRING RegistryPath)
 {
+    NTSTATUS status;
+
     if (DriverObject == NULL)
     {
         UNICODE_STRING driverName;
@@ -49,9 +148,13 @@ NTSTATUS DriverEntry(IN PDRIVER_OBJECT DriverObject, IN PUNICODE_STRING Registry
         return IoCreateDriver(&driverName, ImodDriverCreateDriver);
     }
 
-    UNREFERENCED_PARAMETER(RegistryPath);
+    status = ImodDriverInitialize(DriverObject);
+    if (NT_SUCCESS(status))
+    {
+        ImodBootInitialize(DriverObject, RegistryPath);
+    }
 
-    return ImodDriverInitialize(DriverObject);
+    return status;
 }
 
 static NTSTATUS ImodDriverCreateDriver(IN PDRIVER_OBJECT DriverObject, IN PUNICODE_STRING RegistryPath)
@@ -71,6 +174,12 @@ static NTSTATUS ImodDriverInitialize(IN PDRIVER_OBJECT DriverObject)
 
     KdPrint(("IMOD: DriverEntry"));
 
+    ExInitializeFastMutex(&ImodBootLock);
+    ExInitializeFastMutex(&ImodWatchdogLock);
+    ExInitializeFastMutex(&ImodTopologyLock);
+    KeInitializeTimer(&ImodWatchdogTimer);
+    KeInitializeDpc(&ImodWatchdogDpc, ImodWatchdogTimerDpc, NULL);
+
     RtlInitUnicodeString(&deviceName, IMOD_DEVICE_NAME);
     RtlInitUnicodeString(&deviceSecurity, L"D:P(A;;GA;;;SY)(A;;GA;;;BA)");
 
@@ -92,6 +201,7 @@ static NTSTATUS ImodDriverInitialize(IN PDRIVER_OBJECT DriverObject)
     }
 
     DriverObject->MajorFunction[IRP_MJ_CREATE] =
+        DriverObject->MajorFunction[IRP_MJ_CLEANUP] =
         DriverObject->MajorFunction[IRP_MJ_CLOSE] =
         DriverObject->MajorFunction[IRP_MJ_DEVICE_CONTROL] = ImodDriverDispatch;
     DriverObject->DriverUnload = ImodDriverUnload;
@@ -106,6 +216,8 @@ static NTSTATUS ImodDriverInitialize(IN PDRIVER_OBJECT DriverObject)
         return status;
     }
 
+    ImodWatchdogWorkItem = IoAllocateWorkItem(deviceObject);
+
     deviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
 
     return STATUS_SUCCESS;
@@ -121,7 +233,10 @@ static NTSTATUS ImodDriverDispatch(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp)
     NTSTATUS status = STATUS_SUCCESS;
     struct tagPhysStruct phys;
     struct tagPhysAccessStruct access;
+    struct tagImodDriverVersion version;
     PHYSICAL_ADDRESS physicalAddress;
+    ULONG bytesReturned;
+    PIMOD_FILE_CONTEXT fileContext;
 
     UNREFERENCED_PARAMETER(DeviceObject);
 
@@ -131,7 +246,36 @@ static NTSTATUS ImodDriverDispatch(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp)
     switch (irpStack->MajorFunction)
     {
     case IRP_MJ_CREATE:
+        fileContext = (PIMOD_FILE_CONTEXT)ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(IMOD_FILE_CONTEXT), IMOD_POOL_TAG);
+        if (fileContext == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        ExInitializeFastMutex(&fileContext->Lock);
+        ImodSessionTableInitialize(&fileContext->Sessions);
+        irpStack->FileObject->FsContext = fileContext;
+        break;
+
+    case IRP_MJ_CLEANUP:
+        fileContext = (PIMOD_FILE_CONTEXT)irpStack->FileObject->FsContext;
+        if (fileContext != NULL)
+        {
+            ExAcquireFastMutex(&fileContext->Lock);
+            ImodSessionCloseAll(&ImodKernelPlatform, &fileContext->Sessions);
+            ExReleaseFastMutex(&fileContext->Lock);
+        }
+        break;
+
     case IRP_MJ_CLOSE:
+        fileContext = (PIMOD_FILE_CONTEXT)irpStack->FileObject->FsContext;
+        if (fileContext != NULL)
+        {
+            ImodSessionCloseAll(&ImodKernelPlatform, &fileContext->Sessions);
+            irpStack->FileObject->FsContext = NULL;
+            ExFreePoolWithTag(fileContext, IMOD_POOL_TAG);
+        }
         break;
 
     case IRP_MJ_DEVICE_CONTROL:
@@ -158,6 +302,7 @@ static NTSTATUS ImodDriverDispatch(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp)
             status = ImodMapPhysicalMemory(
                 physicalAddress,
                 (SIZE_T)phys.physMemSizeInBytes,
+                IMOD_MAX_MAP_SIZE,
                 &mappedAddress,
                 &mappedBase,
                 &mappedSize);
@@ -239,6 +384,121 @@ static NTSTATUS ImodDriverDispatch(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp)
 
             break;
 
+        case IOCTL_IMOD_APPLY_BATCH:
+            bytesReturned = 0;
+            status = ImodResultToStatus(ImodBatchApply(
+                &ImodKernelPlatform,
+                ioBuffer,
+                inputLength,
+                outputLength,
+                &bytesReturned));
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
+        case IOCTL_IMOD_QUERY_TOPOLOGY:
+            bytesReturned = 0;
+            status = ImodTopologyQuery(ioBuffer, inputLength, outputLength, &bytesReturned);
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
+        case IOCTL_IMOD_QUERY_MSIX:
+            bytesReturned = 0;
+            status = ImodMsixQuery(ioBuffer, inputLength, outputLength, &bytesReturned);
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
+        case IOCTL_IMOD_QUERY_BOOT_STATUS:
+            bytesReturned = 0;
+            ExAcquireFastMutex(&ImodBootLock);
+            status = ImodResultToStatus(ImodBootQueryStatus(
+                ImodBootState,
+                ioBuffer,
+                outputLength,
+                &bytesReturned));
+            ExReleaseFastMutex(&ImodBootLock);
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
+        case IOCTL_IMOD_CONFIGURE_WATCHDOG:
+            if (ioBuffer == NULL)
+            {
+                status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            status = ImodWatchdogConfigure(ioBuffer, inputLength);
+            break;
+
+        case IOCTL_IMOD_QUERY_WATCHDOG:
+            bytesReturned = 0;
+            ExAcquireFastMutex(&ImodWatchdogLock);
+            status = ImodResultToStatus(ImodWatchdogQuery(
+                ImodWatchdog,
+                ioBuffer,
+                outputLength,
+                &bytesReturned));
+            ExReleaseFastMutex(&ImodWatchdogLock);
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
+        case IOCTL_IMOD_QUERY_VERSION:
+            if (ioBuffer == NULL || outputLength < sizeof(version))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            version.interfaceVersion = IMOD_DRIVER_INTERFACE_VERSION;
+            version.ioctlMask = IMOD_DRIVER_IOCTL_MASK;
+            RtlCopyMemory(ioBuffer, &version, sizeof(version));
+            Irp->IoStatus.Information = sizeof(version);
+            break;
+
+        case IOCTL_IMOD_OPEN_SESSION:
+        case IOCTL_IMOD_CLOSE_SESSION:
+        case IOCTL_IMOD_SESSION_READ:
+        case IOCTL_IMOD_SESSION_WRITE:
+            bytesReturned = 0;
+            status = ImodSessionDispatch(
+                irpStack->FileObject,
+                ioControlCode,
+                ioBuffer,
+                inputLength,
+                outputLength,
+                &bytesReturned);
+
+            if (NT_SUCCESS(status))
+            {
+                Irp->IoStatus.Information = bytesReturned;
+            }
+
+            break;
+
         default:
             status = STATUS_INVALID_DEVICE_REQUEST;
             break;
@@ -262,6 +522,10 @@ static void ImodDriverUnload(IN PDRIVER_OBJECT DriverObject)
     UNICODE_STRING deviceLink;
     NTSTATUS status;
 
+    ImodBootShutdown();
+    ImodWatchdogShutdown();
+    ImodTopologyShutdown();
+
     RtlInitUnicodeString(&deviceLink, IMOD_DOS_DEVICE_NAME);
 
     status = IoDeleteSymbolicLink(&deviceLink);
@@ -280,12 +544,80 @@ static BOOLEAN ImodIsValidAccessSize(ULONG accessSize)
 {
     return accessSize == sizeof(UCHAR) ||
         accessSize == sizeof(USHORT) ||
-        accessSize == sizeof(ULONG);
+        accessSize == sizeof(ULONG) ||
+        accessSize == sizeof(ULONGLONG);
+}
+
+static NTSTATUS ImodReadRegister(PVOID address, ULONG accessSize, ULONGLONG *value)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    __try
+    {
+        switch (accessSize)
+        {
+        case sizeof(UCHAR):
+            *value = READ_REGISTER_UCHAR((volatile UCHAR *)address);
+            break;
+        case sizeof(USHORT):
+            *value = READ_REGISTER_USHORT((volatile USHORT *)address);
+            break;
+        case sizeof(ULONG):
+            *value = READ_REGISTER_ULONG((volatile ULONG *)address);
+            break;
+        case sizeof(ULONGLONG):
+            *value = READ_REGISTER_ULONG64((volatile ULONG64 *)address);
+            break;
+        default:
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    return status;
+}
+
+static NTSTATUS ImodWriteRegister(PVOID address, ULONG accessSize, ULONGLONG value)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    __try
+    {
+        switch (accessSize)
+        {
+        case sizeof(UCHAR):
+            WRITE_REGISTER_UCHAR((volatile UCHAR *)address, (UCHAR)value);
+            break;
+        case sizeof(USHORT):
+            WRITE_REGISTER_USHORT((volatile USHORT *)address, (USHORT)value);
+            break;
+        case sizeof(ULONG):
+            WRITE_REGISTER_ULONG((volatile ULONG *)address, (ULONG)value);
+            break;
+        case sizeof(ULONGLONG):
+            WRITE_REGISTER_ULONG64((volatile ULONG64 *)address, value);
+            break;
+        default:
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    return status;
 }
 
 static NTSTATUS ImodMapPhysicalMemory(
     PHYSICAL_ADDRESS physicalAddress,
     SIZE_T physicalMemorySize,
+    SIZE_T maximumSize,
     PVOID *mappedAddress,
     PVOID *mappedBase,
     SIZE_T *mappedSize)
@@ -301,7 +633,7 @@ static NTSTATUS ImodMapPhysicalMemory(
     *mappedBase = NULL;
     *mappedSize = 0;
 
-    if (physicalMemorySize == 0 || physicalMemorySize > IMOD_MAX_MAP_SIZE)
+    if (physicalMemorySize == 0 || physicalMemorySize > maximumSize)
     {
         return STATUS_INVALID_PARAMETER;
     }
@@ -362,6 +694,7 @@ static NTSTATUS ImodReadPhysicalMemory(
     status = ImodMapPhysicalMemory(
         physicalAddress,
         accessSize,
+        IMOD_MAX_MAP_SIZE,
         &mappedAddress,
         &mappedBase,
         &mappedSize);
@@ -370,28 +703,7 @@ static NTSTATUS ImodReadPhysicalMemory(
         return status;
     }
 
-    __try
-    {
-        switch (accessSize)
-        {
-        case sizeof(UCHAR):
-            *value = READ_REGISTER_UCHAR((volatile UCHAR *)mappedAddress);
-            break;
-        case sizeof(USHORT):
-            *value = READ_REGISTER_USHORT((volatile USHORT *)mappedAddress);
-            break;
-        case sizeof(ULONG):
-            *value = READ_REGISTER_ULONG((volatile ULONG *)mappedAddress);
-            break;
-        default:
-            status = STATUS_INVALID_PARAMETER;
-            break;
-        }
-    }
-    __except (EXCEPTION_EXECUTE_HANDLER)
-    {
-        status = GetExceptionCode();
-    }
+    status = ImodReadRegister(mappedAddress, accessSize, value);
 
     (void)ImodUnmapPhysicalMemory(mappedBase, mappedSize);
     return status;
@@ -415,6 +727,7 @@ static NTSTATUS ImodWritePhysicalMemory(
     status = ImodMapPhysicalMemory(
         physicalAddress,
         accessSize,
+        IMOD_MAX_MAP_SIZE,
         &mappedAddress,
         &mappedBase,
         &mappedSize);
@@ -423,29 +736,770 @@ static NTSTATUS ImodWritePhysicalMemory(
         return status;
     }
 
-    __try
+    status = ImodWriteRegister(mappedAddress, accessSize, value);
+
+    (void)ImodUnmapPhysicalMemory(mappedBase, mappedSize);
+    return status;
+}
+
+static NTSTATUS ImodResultToStatus(ULONG result)
+{
+    switch (result)
     {
-        switch (accessSize)
+    case IMOD_RESULT_SUCCESS:
+        return STATUS_SUCCESS;
+    case IMOD_RESULT_BUFFER_TOO_SMALL:
+        return STATUS_BUFFER_TOO_SMALL;
+    case IMOD_RESULT_UNSUPPORTED_VERSION:
+        return STATUS_REVISION_MISMATCH;
+    case IMOD_RESULT_MAP_FAILED:
+        return STATUS_INSUFFICIENT_RESOURCES;
+    case IMOD_RESULT_ACCESS_FAILED:
+        return STATUS_IO_DEVICE_ERROR;
+    case IMOD_RESULT_INVALID_CONTROLLER:
+        return STATUS_DEVICE_NOT_READY;
+    case IMOD_RESULT_TOO_MANY_SESSIONS:
+        return STATUS_TOO_MANY_SESSIONS;
+    case IMOD_RESULT_INVALID_SESSION:
+        return STATUS_INVALID_HANDLE;
+    case IMOD_RESULT_INVALID_TABLE:
+        return STATUS_DATA_ERROR;
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
+static BOOLEAN ImodKernelMapWindow(PVOID Context, ULONGLONG PhysicalAddress, ULONG Length, PIMOD_REGISTER_WINDOW Window)
+{
+    PHYSICAL_ADDRESS physicalAddress;
+    NTSTATUS status;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    RtlZeroMemory(Window, sizeof(*Window));
+
+    physicalAddress.QuadPart = (LONGLONG)PhysicalAddress;
+    status = ImodMapPhysicalMemory(
+        physicalAddress,
+        Length,
+        IMOD_XHCI_MAX_CONTROLLER_WINDOW,
+        &Window->Address,
+        &Window->MappingBase,
+        &Window->MappingSize);
+    if (!NT_SUCCESS(status))
+    {
+        return FALSE;
+    }
+
+    Window->PhysicalAddress = PhysicalAddress;
+    Window->Length = Length;
+    return TRUE;
+}
+
+static VOID ImodKernelUnmapWindow(PVOID Context, PIMOD_REGISTER_WINDOW Window)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Window->MappingBase != NULL)
+    {
+        (void)ImodUnmapPhysicalMemory(Window->MappingBase, Window->MappingSize);
+    }
+
+    RtlZeroMemory(Window, sizeof(*Window));
+}
+
+static BOOLEAN ImodKernelReadRegister(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG *Value)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Window->Address == NULL || Offset > Window->Length || Window->Length - Offset < AccessSize)
+    {
+        return FALSE;
+    }
+
+    return NT_SUCCESS(ImodReadRegister((PUCHAR)Window->Address + Offset, AccessSize, Value));
+}
+
+static BOOLEAN ImodKernelWriteRegister(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG AccessSize, ULONGLONG Value)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Window->Address == NULL || Offset > Window->Length || Window->Length - Offset < AccessSize)
+    {
+        return FALSE;
+    }
+
+    return NT_SUCCESS(ImodWriteRegister((PUCHAR)Window->Address + Offset, AccessSize, Value));
+}
+
+static BOOLEAN ImodKernelRead32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG *Value)
+{
+    ULONGLONG value = 0;
+
+    if (!ImodKernelReadRegister(Context, Window, Offset, sizeof(ULONG), &value))
+    {
+        return FALSE;
+    }
+
+    *Value = (ULONG)value;
+    return TRUE;
+}
+
+static BOOLEAN ImodKernelWrite32(PVOID Context, const IMOD_REGISTER_WINDOW *Window, ULONG Offset, ULONG Value)
+{
+    return ImodKernelWriteRegister(Context, Window, Offset, sizeof(ULONG), Value);
+}
+
+static NTSTATUS ImodSessionDispatch(
+    PFILE_OBJECT fileObject,
+    ULONG ioControlCode,
+    PVOID ioBuffer,
+    ULONG inputLength,
+    ULONG outputLength,
+    ULONG *bytesReturned)
+{
+    PIMOD_FILE_CONTEXT fileContext = (PIMOD_FILE_CONTEXT)fileObject->FsContext;
+    struct tagImodSessionStruct session;
+    struct tagImodSessionAccessStruct access;
+    ULONG result;
+
+    *bytesReturned = 0;
+
+    if (fileContext == NULL || ioBuffer == NULL)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (ioControlCode == IOCTL_IMOD_OPEN_SESSION || ioControlCode == IOCTL_IMOD_CLOSE_SESSION)
+    {
+        if (inputLength < sizeof(session) || outputLength < sizeof(session))
         {
-        case sizeof(UCHAR):
-            WRITE_REGISTER_UCHAR((volatile UCHAR *)mappedAddress, (UCHAR)value);
-            break;
-        case sizeof(USHORT):
-            WRITE_REGISTER_USHORT((volatile USHORT *)mappedAddress, (USHORT)value);
-            break;
-        case sizeof(ULONG):
-            WRITE_REGISTER_ULONG((volatile ULONG *)mappedAddress, (ULONG)value);
-            break;
-        default:
-            status = STATUS_INVALID_PARAMETER;
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        RtlCopyMemory(&session, ioBuffer, sizeof(session));
+
+        ExAcquireFastMutex(&fileContext->Lock);
+        if (ioControlCode == IOCTL_IMOD_OPEN_SESSION)
+        {
+            result = ImodSessionOpen(
+                &ImodKernelPlatform,
+                &fileContext->Sessions,
+                session.physAddress,
+                session.length,
+                &session.sessionId);
+        }
+        else
+        {
+            result = ImodSessionClose(&ImodKernelPlatform, &fileContext->Sessions, session.sessionId);
+        }
+        ExReleaseFastMutex(&fileContext->Lock);
+
+        if (result == IMOD_RESULT_SUCCESS)
+        {
+            RtlCopyMemory(ioBuffer, &session, sizeof(session));
+            *bytesReturned = sizeof(session);
+        }
+
+        return ImodResultToStatus(result);
+    }
+
+    if (inputLength < sizeof(access) || outputLength < sizeof(access))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&access, ioBuffer, sizeof(access));
+
+    ExAcquireFastMutex(&fileContext->Lock);
+    if (ioControlCode == IOCTL_IMOD_SESSION_READ)
+    {
+        result = ImodSessionRead(
+            &ImodKernelPlatform,
+            &fileContext->Sessions,
+            access.sessionId,
+            access.offset,
+            access.accessSizeInBytes,
+            &access.value);
+    }
+    else
+    {
+        result = ImodSessionWrite(
+            &ImodKernelPlatform,
+            &fileContext->Sessions,
+            access.sessionId,
+            access.offset,
+            access.accessSizeInBytes,
+            access.value);
+    }
+    ExReleaseFastMutex(&fileContext->Lock);
+
+    if (result == IMOD_RESULT_SUCCESS)
+    {
+        RtlCopyMemory(ioBuffer, &access, sizeof(access));
+        *bytesReturned = sizeof(access);
+    }
+
+    return ImodResultToStatus(result);
+}
+
+static NTSTATUS ImodTopologyQuery(PVOID ioBuffer, ULONG inputLength, ULONG outputLength, ULONG *bytesReturned)
+{
+    struct tagImodTopologyHeader header;
+    PIMOD_TOPOLOGY_CACHE cache = NULL;
+    ULONG index;
+    ULONG result;
+
+    *bytesReturned = 0;
+
+    if (ioBuffer == NULL || inputLength < sizeof(header))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&header, ioBuffer, sizeof(header));
+
+    ExAcquireFastMutex(&ImodTopologyLock);
+
+    for (index = 0; index < IMOD_TOPOLOGY_MAX_CACHES; ++index)
+    {
+        if (ImodTopologyCaches[index] != NULL &&
+            ImodTopologyCaches[index]->Valid &&
+            ImodTopologyCaches[index]->CapabilityAddress == header.capabilityAddress)
+        {
+            cache = ImodTopologyCaches[index];
             break;
         }
     }
-    __except (EXCEPTION_EXECUTE_HANDLER)
+
+    if (cache == NULL)
     {
-        status = GetExceptionCode();
+        index = ImodTopologyCacheNext;
+        ImodTopologyCacheNext = (ImodTopologyCacheNext + 1) % IMOD_TOPOLOGY_MAX_CACHES;
+
+        if (ImodTopologyCaches[index] == NULL)
+        {
+            ImodTopologyCaches[index] = (PIMOD_TOPOLOGY_CACHE)ExAllocatePoolWithTag(
+                PagedPool,
+                sizeof(IMOD_TOPOLOGY_CACHE),
+                IMOD_POOL_TAG);
+        }
+
+        /* Without a cache the walk still works, it just reads everything. */
+        cache = ImodTopologyCaches[index];
+        if (cache != NULL)
+        {
+            ImodTopologyCacheReset(cache);
+        }
     }
 
-    (void)ImodUnmapPhysicalMemory(mappedBase, mappedSize);
+    result = ImodTopologySnapshotCached(
+        &ImodKernelPlatform,
+        cache,
+        ioBuffer,
+        inputLength,
+        outputLength,
+        bytesReturned);
+
+    ExReleaseFastMutex(&ImodTopologyLock);
+
+    return ImodResultToStatus(result);
+}
+
+static VOID ImodTopologyShutdown(VOID)
+{
+    ULONG index;
+
+    ExAcquireFastMutex(&ImodTopologyLock);
+
+    for (index = 0; index < IMOD_TOPOLOGY_MAX_CACHES; ++index)
+    {
+        if (ImodTopologyCaches[index] != NULL)
+        {
+            ExFreePoolWithTag(ImodTopologyCaches[index], IMOD_POOL_TAG);
+            ImodTopologyCaches[index] = NULL;
+        }
+    }
+
+    ExReleaseFastMutex(&ImodTopologyLock);
+}
+
+/*
+ * MSI/MSI-X state of one function on PCI segment 0. Config space comes from
+ * the HAL rather than from the caller, so the table address is the one the
+ * function's own BAR decodes. Each processor's APIC ID is read on that
+ * processor, which is what lets the entries name an LP.
+ */
+static NTSTATUS ImodMsixQuery(PVOID ioBuffer, ULONG inputLength, ULONG outputLength, ULONG *bytesReturned)
+{
+    struct tagImodMsixHeader header;
+    UCHAR config[IMOD_MSIX_CONFIG_SIZE];
+    PIMOD_MSIX_PROCESSOR processors;
+    PCI_SLOT_NUMBER slot;
+    ULONG processorCount;
+    ULONG configLength;
+    ULONG index;
+    ULONG result;
+
+    *bytesReturned = 0;
+
+    if (ioBuffer == NULL || inputLength < sizeof(header))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(&header, ioBuffer, sizeof(header));
+
+    if (header.bus > 0xFF || header.device >= PCI_MAX_DEVICES || header.function >= PCI_MAX_FUNCTION)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    slot.u.AsULONG = 0;
+    slot.u.bits.DeviceNumber = header.device;
+    slot.u.bits.FunctionNumber = header.function;
+
+    configLength = HalGetBusDataByOffset(PCIConfiguration, header.bus, slot.u.AsULONG, config, 0, sizeof(config));
+    if (configLength < 0x40)
+    {
+        return STATUS_NO_SUCH_DEVICE;
+    }
+
+    processorCount = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    processors = (PIMOD_MSIX_PROCESSOR)ExAllocatePoolWithTag(
+        PagedPool,
+        processorCount * sizeof(IMOD_MSIX_PROCESSOR),
+        IMOD_POOL_TAG);
+    if (processors == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (index = 0; index < processorCount; ++index)
+    {
+        PROCESSOR_NUMBER number;
+        GROUP_AFFINITY affinity;
+        GROUP_AFFINITY previous;
+        int registers[4];
+
+        RtlZeroMemory(&processors[index], sizeof(processors[index]));
+        if (!NT_SUCCESS(KeGetProcessorNumberFromIndex(index, &number)))
+        {
+            processors[index].ApicId = MAXULONG;
+            continue;
+        }
+
+        RtlZeroMemory(&affinity, sizeof(affinity));
+        affinity.Group = number.Group;
+        affinity.Mask = (KAFFINITY)1 << number.Number;
+        KeSetSystemGroupAffinityThread(&affinity, &previous);
+
+        /* Leaf 0xB EDX is the full x2APIC ID; leaf 1 EBX[31:24] the 8-bit xAPIC ID. */
+        __cpuid(registers, 0);
+        if (registers[0] >= 0xB)
+        {
+            __cpuidex(registers, 0xB, 0);
+            processors[index].ApicId = (ULONG)registers[3];
+        }
+        else
+        {
+            __cpuid(registers, 1);
+            processors[index].ApicId = ((ULONG)registers[1] >> 24) & 0xFF;
+        }
+
+        KeRevertToUserGroupAffinityThread(&previous);
+        processors[index].Group = number.Group;
+        processors[index].Number = number.Number;
+    }
+
+    result = ImodMsixSnapshot(
+        &ImodKernelPlatform,
+        config,
+        configLength,
+        processors,
+        processorCount,
+        ioBuffer,
+        inputLength,
+        outputLength,
+        bytesReturned);
+
+    ExFreePoolWithTag(processors, IMOD_POOL_TAG);
+
+    return ImodResultToStatus(result);
+}
+
+static VOID ImodBootInitialize(IN PDRIVER_OBJECT DriverObject, IN PUNICODE_STRING RegistryPath)
+{
+    PIMOD_BOOT_STATE bootState;
+    PVOID tableData = NULL;
+    ULONG tableLength = 0;
+    NTSTATUS status;
+
+    if (RegistryPath == NULL || RegistryPath->Buffer == NULL)
+    {
+        return;
+    }
+
+    status = ImodBootReadTable(RegistryPath, &tableData, &tableLength, &ImodBootWatchdogPeriodMs);
+    if (!NT_SUCCESS(status))
+    {
+        if (status != STATUS_OBJECT_NAME_NOT_FOUND)
+        {
+            KdPrint(("IMOD: boot table read failed: 0x%08X", status));
+        }
+        return;
+    }
+
+    bootState = (PIMOD_BOOT_STATE)ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(IMOD_BOOT_STATE), IMOD_POOL_TAG);
+    if (bootState == NULL)
+    {
+        ExFreePoolWithTag(tableData, IMOD_POOL_TAG);
+        return;
+    }
+
+    ImodBootStateInitialize(bootState, tableData, tableLength);
+    if (bootState->TableState != IMOD_BOOT_TABLE_LOADED)
+    {
+        KdPrint(("IMOD: boot table rejected: %lu", bootState->TableResult));
+    }
+
+    ExAcquireFastMutex(&ImodBootLock);
+    ImodBootState = bootState;
+    ImodBootTableData = tableData;
+    ExReleaseFastMutex(&ImodBootLock);
+
+    if (bootState->TableState != IMOD_BOOT_TABLE_LOADED)
+    {
+        return;
+    }
+
+    /*
+     * Existing host controllers are reported right away; controllers that
+     * start later are picked up when their interface arrives.
+     */
+    status = IoRegisterPlugPlayNotification(
+        EventCategoryDeviceInterfaceChange,
+        PNPNOTIFY_DEVICE_INTERFACE_INCLUDE_EXISTING_INTERFACES,
+        (PVOID)&GUID_DEVINTERFACE_USB_HOST_CONTROLLER,
+        DriverObject,
+        ImodBootInterfaceNotification,
+        NULL,
+        &ImodBootNotificationEntry);
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("IMOD: IoRegisterPlugPlayNotification failed: 0x%08X", status));
+        ImodBootNotificationEntry = NULL;
+    }
+}
+
+static VOID ImodBootShutdown(VOID)
+{
+    if (ImodBootNotificationEntry != NULL)
+    {
+        (void)IoUnregisterPlugPlayNotificationEx(ImodBootNotificationEntry);
+        ImodBootNotificationEntry = NULL;
+    }
+
+    ExAcquireFastMutex(&ImodBootLock);
+    if (ImodBootState != NULL)
+    {
+        ExFreePoolWithTag(ImodBootState, IMOD_POOL_TAG);
+        ImodBootState = NULL;
+    }
+
+    if (ImodBootTableData != NULL)
+    {
+        ExFreePoolWithTag(ImodBootTableData, IMOD_POOL_TAG);
+        ImodBootTableData = NULL;
+    }
+    ExReleaseFastMutex(&ImodBootLock);
+}
+
+static NTSTATUS ImodBootReadTable(
+    IN PUNICODE_STRING RegistryPath,
+    PVOID *tableData,
+    ULONG *tableLength,
+    ULONG *watchdogPeriodMs)
+{
+    UNICODE_STRING keyPath;
+    UNICODE_STRING valueName;
+    OBJECT_ATTRIBUTES attributes;
+    PKEY_VALUE_PARTIAL_INFORMATION valueInfo = NULL;
+    PKEY_VALUE_PARTIAL_INFORMATION periodInfo;
+    ULONGLONG periodBuffer[(sizeof(KEY_VALUE_PARTIAL_INFORMATION) + sizeof(ULONG) + sizeof(ULONGLONG) - 1) / sizeof(ULONGLONG)];
+    HANDLE key = NULL;
+    ULONG resultLength = 0;
+    USHORT keyPathLength;
+    NTSTATUS status;
+
+    *tableData = NULL;
+    *tableLength = 0;
+    *watchdogPeriodMs = 0;
+
+    keyPathLength = (USHORT)(RegistryPath->Length + sizeof(IMOD_BOOT_PARAMETERS_SUFFIX));
+    keyPath.Buffer = (PWCH)ExAllocatePoolWithTag(PagedPool, keyPathLength, IMOD_POOL_TAG);
+    if (keyPath.Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    keyPath.Length = 0;
+    keyPath.MaximumLength = keyPathLength;
+    RtlCopyUnicodeString(&keyPath, RegistryPath);
+    status = RtlAppendUnicodeToString(&keyPath, IMOD_BOOT_PARAMETERS_SUFFIX);
+    if (!NT_SUCCESS(status))
+    {
+        ExFreePoolWithTag(keyPath.Buffer, IMOD_POOL_TAG);
+        return status;
+    }
+
+    InitializeObjectAttributes(&attributes, &keyPath, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+    status = ZwOpenKey(&key, KEY_READ, &attributes);
+    ExFreePoolWithTag(keyPath.Buffer, IMOD_POOL_TAG);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    /* Optional; a missing or malformed period just leaves the watchdog off. */
+    RtlInitUnicodeString(&valueName, IMOD_BOOT_WATCHDOG_VALUE_NAME);
+    RtlZeroMemory(periodBuffer, sizeof(periodBuffer));
+    periodInfo = (PKEY_VALUE_PARTIAL_INFORMATION)periodBuffer;
+    if (NT_SUCCESS(ZwQueryValueKey(
+            key,
+            &valueName,
+            KeyValuePartialInformation,
+            periodInfo,
+            sizeof(periodBuffer),
+            &resultLength)) &&
+        periodInfo->Type == REG_DWORD && periodInfo->DataLength == sizeof(ULONG))
+    {
+        RtlCopyMemory(watchdogPeriodMs, periodInfo->Data, sizeof(ULONG));
+    }
+
+    RtlInitUnicodeString(&valueName, IMOD_BOOT_TABLE_VALUE_NAME);
+    status = ZwQueryValueKey(key, &valueName, KeyValuePartialInformation, NULL, 0, &resultLength);
+    if (status != STATUS_BUFFER_TOO_SMALL && status != STATUS_BUFFER_OVERFLOW)
+    {
+        ZwClose(key);
+        return NT_SUCCESS(status) ? STATUS_DATA_ERROR : status;
+    }
+
+    if (resultLength > FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + IMOD_BOOT_MAX_TABLE_SIZE)
+    {
+        ZwClose(key);
+        return STATUS_DATA_ERROR;
+    }
+
+    valueInfo = (PKEY_VALUE_PARTIAL_INFORMATION)ExAllocatePoolWithTag(PagedPool, resultLength, IMOD_POOL_TAG);
+    if (valueInfo == NULL)
+    {
+        ZwClose(key);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = ZwQueryValueKey(key, &valueName, KeyValuePartialInformation, valueInfo, resultLength, &resultLength);
+    ZwClose(key);
+
+    if (NT_SUCCESS(status) &&
+        (valueInfo->Type != REG_BINARY || valueInfo->DataLength == 0 || valueInfo->DataLength > IMOD_BOOT_MAX_TABLE_SIZE))
+    {
+        status = STATUS_DATA_ERROR;
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        *tableData = ExAllocatePoolWithTag(NonPagedPoolNx, valueInfo->DataLength, IMOD_POOL_TAG);
+        if (*tableData == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+        else
+        {
+            RtlCopyMemory(*tableData, valueInfo->Data, valueInfo->DataLength);
+            *tableLength = valueInfo->DataLength;
+        }
+    }
+
+    ExFreePoolWithTag(valueInfo, IMOD_POOL_TAG);
     return status;
 }
+
+static NTSTATUS ImodBootInterfaceNotification(IN PVOID NotificationStructure, IN PVOID Context)
+{
+    PDEVICE_INTERFACE_CHANGE_NOTIFICATION notification = (PDEVICE_INTERFACE_CHANGE_NOTIFICATION)NotificationStructure;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (!IsEqualGUID(&notification->Event, &GUID_DEVICE_INTERFACE_ARRIVAL))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    ExAcquireFastMutex(&ImodBootLock);
+    if (ImodBootState != NULL)
+    {
+        (void)ImodBootApplyPending(&ImodKernelPlatform, ImodBootState);
+        KdPrint(("IMOD: boot table pass %lu", ImodBootState->ApplyPasses));
+        ImodBootArmWatchdog();
+    }
+    ExReleaseFastMutex(&ImodBootLock);
+
+    return STATUS_SUCCESS;
+}
+
+/* Called with ImodBootLock held; re-arms only when the applied set changed. */
+static VOID ImodBootArmWatchdog(VOID)
+{
+    PVOID config;
+    ULONG configLength;
+    NTSTATUS status;
+
+    if (ImodBootWatchdogPeriodMs == 0)
+    {
+        return;
+    }
+
+    configLength = ImodBootWatchdogConfigSize(ImodBootState);
+    if (configLength == ImodBootWatchdogConfigLength)
+    {
+        return;
+    }
+
+    config = ExAllocatePoolWithTag(PagedPool, configLength, IMOD_POOL_TAG);
+    if (config == NULL)
+    {
+        return;
+    }
+
+    ImodBootBuildWatchdogConfig(ImodBootState, ImodBootWatchdogPeriodMs, config);
+    status = ImodWatchdogConfigure(config, configLength);
+    ExFreePoolWithTag(config, IMOD_POOL_TAG);
+
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("IMOD: boot watchdog rejected: 0x%08X", status));
+        return;
+    }
+
+    ImodBootWatchdogConfigLength = configLength;
+}
+
+static NTSTATUS ImodWatchdogConfigure(const VOID *config, ULONG length)
+{
+    PIMOD_WATCHDOG watchdog = NULL;
+    PIMOD_WATCHDOG previous;
+    LARGE_INTEGER dueTime;
+    ULONG entryCount = 0;
+    ULONG result;
+    SIZE_T size;
+
+    result = ImodWatchdogValidate(config, length, &entryCount);
+    if (result != IMOD_RESULT_SUCCESS)
+    {
+        return ImodResultToStatus(result);
+    }
+
+    if (entryCount != 0)
+    {
+        if (ImodWatchdogWorkItem == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        size = ImodWatchdogRequiredSize(entryCount);
+        watchdog = (PIMOD_WATCHDOG)ExAllocatePoolWithTag(NonPagedPoolNx, size, IMOD_POOL_TAG);
+        if (watchdog == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        result = ImodWatchdogInitialize(watchdog, size, config, length);
+        if (result != IMOD_RESULT_SUCCESS)
+        {
+            ExFreePoolWithTag(watchdog, IMOD_POOL_TAG);
+            return ImodResultToStatus(result);
+        }
+    }
+
+    ExAcquireFastMutex(&ImodWatchdogLock);
+    (void)KeCancelTimer(&ImodWatchdogTimer);
+    previous = ImodWatchdog;
+    ImodWatchdog = watchdog;
+
+    if (watchdog != NULL)
+    {
+        dueTime.QuadPart = -((LONGLONG)watchdog->PeriodMs * 10000);
+        (void)KeSetTimerEx(&ImodWatchdogTimer, dueTime, (LONG)watchdog->PeriodMs, &ImodWatchdogDpc);
+        KdPrint(("IMOD: watchdog armed: %lu entries every %lu ms", watchdog->EntryCount, watchdog->PeriodMs));
+    }
+    ExReleaseFastMutex(&ImodWatchdogLock);
+
+    if (previous != NULL)
+    {
+        ExFreePoolWithTag(previous, IMOD_POOL_TAG);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static VOID ImodWatchdogShutdown(VOID)
+{
+    LARGE_INTEGER delay;
+
+    (void)KeCancelTimer(&ImodWatchdogTimer);
+    KeFlushQueuedDpcs();
+
+    delay.QuadPart = -10 * 1000 * 10;
+    while (InterlockedCompareExchange(&ImodWatchdogQueued, 0, 0) != 0)
+    {
+        (void)KeDelayExecutionThread(KernelMode, FALSE, &delay);
+    }
+
+    ExAcquireFastMutex(&ImodWatchdogLock);
+    if (ImodWatchdog != NULL)
+    {
+        ExFreePoolWithTag(ImodWatchdog, IMOD_POOL_TAG);
+        ImodWatchdog = NULL;
+    }
+    ExReleaseFastMutex(&ImodWatchdogLock);
+
+    if (ImodWatchdogWorkItem != NULL)
+    {
+        IoFreeWorkItem(ImodWatchdogWorkItem);
+        ImodWatchdogWorkItem = NULL;
+    }
+}
+
+static VOID ImodWatchdogTimerDpc(
+    IN PKDPC Dpc,
+    IN PVOID DeferredContext,
+    IN PVOID SystemArgument1,
+    IN PVOID SystemArgument2)
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(DeferredContext);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    /* A slow pass simply absorbs the ticks that land while it runs. */
+    if (InterlockedCompareExchange(&ImodWatchdogQueued, 1, 0) == 0)
+    {
+        IoQueueWorkItem(ImodWatchdogWorkItem, ImodWatchdogWorker, DelayedWorkQueue, NULL);
+    }
+}
+
+static VOID ImodWatchdogWorker(IN PDEVICE_OBJECT DeviceObject, IN PVOID Context)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Context);
+
+    ExAcquireFastMutex(&ImodWatchdogLock);
+    if (ImodWatchdog != NULL && ImodWatchdogCheck(&ImodKernelPlatform, ImodWatchdog) != 0)
+    {
+        KdPrint(("IMOD: watchdog pass %I64u reasserted drifted registers", ImodWatchdog->Passes));
+    }
+    ExReleaseFastMutex(&ImodWatchdogLock);
+
+    InterlockedExchange(&ImodWatchdogQueued, 0);
+}
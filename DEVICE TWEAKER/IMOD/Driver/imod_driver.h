@@ -15,6 +15,49 @@
 #define IOCTL_IMOD_WRITE_PHYSICAL \
     CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 3, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+#define IOCTL_IMOD_APPLY_BATCH \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 4, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_OPEN_SESSION \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 5, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_CLOSE_SESSION \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 6, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_SESSION_READ \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 7, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_SESSION_WRITE \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 8, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_QUERY_TOPOLOGY \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 9, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_QUERY_BOOT_STATUS \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 10, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_CONFIGURE_WATCHDOG \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 11, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_QUERY_WATCHDOG \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 12, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_QUERY_MSIX \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 13, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_IMOD_QUERY_VERSION \
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 14, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+/*
+ * IOCTL_IMOD_QUERY_VERSION reports which IOCTLs this build handles: bit n of ioctlMask
+ * stands for IMOD_IOCTL_INDEX + n. The prebuilt DTIMOD.sys predates the query and only has
+ * map, unmap, read and write (+0..+3), so clients read a failed query as that set and do not
+ * send anything else.
+ */
+#define IMOD_DRIVER_INTERFACE_VERSION 2
+#define IMOD_DRIVER_IOCTL_MASK_LEGACY 0x000FUL
+#define IMOD_DRIVER_IOCTL_MASK 0x7FFFUL
+
 #pragma pack(push, 1)
 
 struct tagPhysStruct
@@ -34,4 +77,26 @@ struct tagPhysAccessStruct
     ULONGLONG value;
 };
 
+struct tagImodSessionStruct
+{
+    ULONGLONG physAddress;
+    ULONG length;
+    ULONG sessionId;
+};
+
+struct tagImodSessionAccessStruct
+{
+    ULONG sessionId;
+    ULONG offset;
+    ULONG accessSizeInBytes;
+    ULONG reserved;
+    ULONGLONG value;
+};
+
+struct tagImodDriverVersion
+{
+    ULONG interfaceVersion;
+    ULONG ioctlMask;
+};
+
 #pragma pack(pop)
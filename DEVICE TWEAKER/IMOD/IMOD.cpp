@@ -2,25 +2,47 @@
 #include <windows.h>
 #include <cfgmgr32.h>
 #include <setupapi.h>
+#include <powrprof.h>
 
 #include <bitset>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <cwchar>
 #include <cwctype>
+#include <deque>
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "Common/imod_batch.h"
+#include "Common/imod_boot.h"
+#include "Common/imod_governor.h"
+#include "Common/imod_nic.h"
+#include "Common/imod_nvme.h"
+#include "Common/imod_sampler.h"
+#include "Common/imod_topology.h"
+#include "Common/imod_watchdog.h"
+#include "IMODApply.h"
+#include "IMODWatch.h"
+
 #pragma comment(lib, "advapi32.lib")
 #pragma comment(lib, "cfgmgr32.lib")
+#pragma comment(lib, "powrprof.lib")
 #pragma comment(lib, "setupapi.lib")
 
 namespace {
@@ -28,11 +50,24 @@ namespace {
 constexpr uint32_t kDefaultInterval = 0x0;
 constexpr uint32_t kDefaultHcsparamsOffset = 0x4;
 constexpr uint32_t kDefaultRtsoff = 0x18;
+constexpr uint32_t kDefaultGovernorMaxLatencyUs = 1000;
+constexpr uint32_t kDefaultGovernorIrqBudget = 8000;
 
 constexpr const wchar_t* kImodDriverServiceName = L"DeviceTweakerImod2";
 constexpr const wchar_t* kImodDriverDevicePath = L"\\\\.\\DeviceTweakerImod2";
 constexpr const wchar_t* kDriverFileName = L"DTIMOD.sys";
 constexpr const wchar_t* kConfigFileName = L"imod-config.ini";
+constexpr DWORD kKduTimeoutMs = 60000;
+
+constexpr uint32_t kTopologySlotCapacity = 255;
+constexpr uint32_t kRoleDeviceMaxDepth = 12;
+// Role a shared root port is programmed for, as in the GUI; other roles follow by name.
+constexpr const wchar_t* kAdaptiveRolePriority[] = {L"Mouse", L"Keyboard", L"Audio", L"Gamepad", L"Webcam"};
+
+// GUID_DEVINTERFACE_USB_HOST_CONTROLLER, without pulling in usbiodef.h and initguid.h.
+constexpr GUID kUsbHostControllerInterface = {0x3ABF6F2D, 0x71C4, 0x462A, {0x8A, 0x92, 0x1E, 0x68, 0x61, 0xE6, 0xAF, 0x27}};
+// GUID_DEVINTERFACE_STORAGEPORT: the NVMe controller's storage port, where the protocol pass-through goes.
+constexpr GUID kStoragePortInterface = {0x2ACCFE60, 0xC130, 0x11D2, {0xB0, 0x82, 0x00, 0xA0, 0xC9, 0x1E, 0xFB, 0x8B}};
 
 constexpr uint32_t FILE_DEVICE_IMOD = 0x00008010;
 constexpr uint32_t IMOD_IOCTL_INDEX = 0x810;
@@ -45,6 +80,20 @@ constexpr uint32_t IoctlImodReadPhysicalMemory =
     CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 2, METHOD_BUFFERED, FILE_ANY_ACCESS);
 constexpr uint32_t IoctlImodWritePhysicalMemory =
     CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 3, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodApplyBatch =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 4, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodQueryTopology =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 9, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodQueryBootStatus =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 10, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodConfigureWatchdog =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 11, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodQueryWatchdog =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 12, METHOD_BUFFERED, FILE_ANY_ACCESS);
+constexpr uint32_t IoctlImodQueryVersion =
+    CTL_CODE(FILE_DEVICE_IMOD, IMOD_IOCTL_INDEX + 14, METHOD_BUFFERED, FILE_ANY_ACCESS);
+// What a DTIMOD.sys that does not answer IoctlImodQueryVersion handles: map, unmap, read, write.
+constexpr uint32_t kImodLegacyIoctlMask = 0x000F;
 
 #pragma pack(push, 1)
 struct PhysStruct {
@@ -61,38 +110,199 @@ struct PhysAccessStruct {
     uint32_t reserved;
     uint64_t value;
 };
+
+struct ImodDriverVersion {
+    uint32_t interfaceVersion;
+    uint32_t ioctlMask;
+};
 #pragma pack(pop)
 
-struct UsbControllerInfo {
+struct PciDeviceInfo {
+    DEVINST devInst = 0;
     std::wstring deviceId;
     std::wstring caption;
     ULONG problemCode = 0;
     uint64_t baseAddress = 0;
+    uint64_t baseLength = 0;
     bool hasBase = false;
     std::wstring baseError;
 };
 
+struct RoleInterval {
+    std::wstring role;
+    uint32_t interval = 0;
+};
+
+struct RootPortRoles {
+    uint32_t rootPort = 0;
+    std::vector<std::wstring> roles;
+};
+
+// Roles of the device at one port path (Common/imod_topology.h), so devices behind the same
+// hub keep apart what a root port binding would merge.
+struct RouteRoles {
+    uint32_t rootPort = 0;
+    uint32_t routeString = 0;
+    std::vector<std::wstring> roles;
+};
+
 struct ControllerOverride {
     std::wstring hwid;
     std::optional<uint32_t> interval;
+    // Interrupter i gets intervals[i]; interrupters past the end are left alone.
+    std::vector<uint32_t> intervals;
+    std::vector<RoleInterval> roleIntervals;
+    // Fixed root port -> role bindings; empty means discover them from the device tree.
+    std::vector<RootPortRoles> rootPortRoles;
+    // Fixed port path -> role bindings, applied over the root port ones where the path has a slot.
+    std::vector<RouteRoles> routeRoles;
+    std::optional<bool> adaptiveRoleBinding;
     std::optional<uint32_t> hcsparamsOffset;
     std::optional<uint32_t> rtsoff;
     std::optional<bool> enabled;
+    std::optional<uint32_t> governorMaxLatencyUs;
+    std::optional<uint32_t> governorIrqBudget;
+};
+
+// A [nic:HWID] section. Adapters with a built-in profile (Common/imod_nic.c) only need
+// values; the layout keys override the profile or describe an adapter without one.
+struct NicOverride {
+    std::wstring hwid;
+    std::vector<uint32_t> values;
+    std::vector<uint32_t> intervalsUs;
+    std::optional<bool> enabled;
+    std::optional<uint32_t> baseOffset;
+    std::optional<uint32_t> stride;
+    std::optional<uint32_t> queues;
+    std::optional<uint32_t> width;
+    std::optional<uint32_t> mask;
+    std::optional<uint32_t> orBits;
+};
+
+// A [nvme:HWID] section: Interrupt Coalescing for the controller and the I/O vectors kept out
+// of it. Keys left out keep what the controller has.
+struct NvmeOverride {
+    std::wstring hwid;
+    std::optional<bool> enabled;
+    std::optional<uint32_t> timeUs;
+    std::optional<uint32_t> threshold;
+    std::optional<std::vector<uint32_t>> disabledVectors;
 };
 
 struct Config {
+    // [global] ENABLED = false leaves xHCI controllers alone unless their [device:] section
+    // enables them; the GUI writes it when only NIC or NVMe settings are saved.
+    bool usbEnabled = true;
     uint32_t globalInterval = kDefaultInterval;
     uint32_t globalHcsparamsOffset = kDefaultHcsparamsOffset;
     uint32_t globalRtsoff = kDefaultRtsoff;
+    uint32_t governorMaxLatencyUs = kDefaultGovernorMaxLatencyUs;
+    uint32_t governorIrqBudget = kDefaultGovernorIrqBudget;
+    uint32_t governorHysteresis = IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT;
+    uint32_t governorHoldTicks = IMOD_GOVERNOR_DEFAULT_HOLD_TICKS;
     std::vector<ControllerOverride> overrides;
+    std::vector<NicOverride> nicOverrides;
+    std::vector<NvmeOverride> nvmeOverrides;
 };
 
 struct ImodDriverContext {
     HANDLE driverHandle = INVALID_HANDLE_VALUE;
     bool serviceCreated = false;
+    bool keepService = false;
+    bool keepLoaded = false;
+    bool wasRunning = false;
     std::wstring driverPath;
+    uint32_t interfaceVersion = 1;
+    uint32_t ioctlMask = kImodLegacyIoctlMask;
+};
+
+// Whether the loaded DTIMOD.sys handles an IOCTL, from its IoctlImodQueryVersion reply.
+bool DriverHandles(const ImodDriverContext& ctx, uint32_t ioctl) {
+    const uint32_t function = (ioctl >> 2) & 0xFFF;
+    return function >= IMOD_IOCTL_INDEX && function - IMOD_IOCTL_INDEX < 32 &&
+        ((ctx.ioctlMask >> (function - IMOD_IOCTL_INDEX)) & 1) != 0;
+}
+
+struct ImodApplyCounts {
+    uint32_t written = 0;
+    uint32_t skipped = 0;
+    uint32_t verified = 0;
+    uint32_t failures = 0;
+};
+
+// One enumerated controller as wmain prints it: the lines known before any register access,
+// and the engine job if the controller gets one.
+struct ControllerPlan {
+    std::wstring deviceId;
+    std::wstring header;
+    std::optional<size_t> job;
+    uint64_t capabilityAddress = 0;
+    uint64_t barLength = 0;
+    uint32_t hcsparamsOffset = 0;
+    uint32_t rtsoff = 0;
+    uint32_t interval = 0;
+    std::vector<uint32_t> intervals;
+    uint32_t governorMaxLatencyUs = 0;
+    uint32_t governorIrqBudget = 0;
+};
+
+struct BootTableController {
+    uint64_t capabilityAddress = 0;
+    uint64_t barLength = 0;
+    uint32_t hcsparamsOffset = 0;
+    uint32_t rtsoff = 0;
+    uint32_t hcsparamsSignature = 0;
+    uint32_t interval = 0;
+    std::vector<uint32_t> intervals;
+};
+
+struct WatchdogController {
+    uint64_t runtimeAddress = 0;
+    uint32_t maxIntrs = 0;
+    uint32_t interval = 0;
+    std::vector<uint32_t> intervals;
+};
+
+// One adapter's [nic:] apply, kept so the watchdog can hold what it left in place.
+struct WatchdogNic {
+    uint64_t barAddress = 0;
+    IMOD_NIC_PROFILE profile{};
+    IMOD_NIC_APPLY apply{};
+};
+
+// A present device whose setup class maps to an adaptive role.
+struct RoleDevice {
+    std::wstring role;
+    DEVINST devInst = 0;
+};
+
+struct SamplerController {
+    uint64_t runtimeAddress = 0;
+    uint32_t maxIntrs = 0;
+};
+
+struct SamplerInterrupter {
+    size_t controller = 0;
+    uint32_t interrupter = 0;
+    IMOD_EVENT_RING ring{};
+    IMOD_INTERRUPTER_RATE rate{};
+};
+
+struct GovernorController {
+    uint64_t runtimeAddress = 0;
+    uint32_t maxIntrs = 0;
+    IMOD_GOVERNOR_LIMITS limits{};
+};
+
+struct GovernorInterrupter {
+    SamplerInterrupter sampled;
+    IMOD_GOVERNOR_CHANNEL channel{};
 };
 
+std::atomic<bool> governorStopRequested{false};
+class WindowsWatchSource;
+std::atomic<WindowsWatchSource*> activeWatchSource{nullptr};
+
 template <typename F>
 class ScopeExit {
 public:
@@ -116,6 +326,13 @@ std::wstring ToUpper(std::wstring value) {
     return value;
 }
 
+std::wstring ToLower(std::wstring value) {
+    for (auto& ch : value) {
+        ch = static_cast<wchar_t>(towlower(ch));
+    }
+    return value;
+}
+
 std::wstring Trim(std::wstring value) {
     const auto isSpace = [](wchar_t ch) {
         return ch == L' ' || ch == L'\t' || ch == L'\r' || ch == L'\n';
@@ -223,6 +440,243 @@ bool TryParseBool(const std::wstring& text, bool* value) {
     return false;
 }
 
+std::vector<std::wstring> SplitList(const std::wstring& text, const wchar_t* separators) {
+    std::vector<std::wstring> parts;
+    size_t start = 0;
+    for (;;) {
+        const size_t end = text.find_first_of(separators, start);
+        std::wstring part = Trim(text.substr(start, end == std::wstring::npos ? std::wstring::npos : end - start));
+        if (!part.empty()) {
+            parts.push_back(std::move(part));
+        }
+        if (end == std::wstring::npos) {
+            return parts;
+        }
+        start = end + 1;
+    }
+}
+
+// Folds device names onto the roles the GUI knows; anything else is kept as written.
+std::wstring NormalizeAdaptiveRole(const std::wstring& text) {
+    const std::wstring value = Trim(text);
+    if (ContainsInsensitive(value, L"Mouse")) {
+        return L"Mouse";
+    }
+    if (ContainsInsensitive(value, L"Keyboard")) {
+        return L"Keyboard";
+    }
+    if (ContainsInsensitive(value, L"Audio") || ContainsInsensitive(value, L"Microphone") ||
+        ContainsInsensitive(value, L"Speaker") || ContainsInsensitive(value, L"Headphone")) {
+        return L"Audio";
+    }
+    if (ContainsInsensitive(value, L"Gamepad") || ContainsInsensitive(value, L"Controller") ||
+        ContainsInsensitive(value, L"Joystick")) {
+        return L"Gamepad";
+    }
+    if (ContainsInsensitive(value, L"Camera") || ContainsInsensitive(value, L"Webcam")) {
+        return L"Webcam";
+    }
+    return value;
+}
+
+void AddRole(std::vector<std::wstring>* roles, const std::wstring& role) {
+    const auto found = std::find_if(roles->begin(), roles->end(),
+        [&](const std::wstring& existing) { return EqualsInsensitive(existing, role); });
+    if (found == roles->end()) {
+        roles->insert(std::upper_bound(roles->begin(), roles->end(), role), role);
+    }
+}
+
+// "0x100, 0x100, 0xFA0"
+bool TryParseIntervalList(const std::wstring& text, std::vector<uint32_t>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L", \t")) {
+        uint32_t value = 0;
+        if (!TryParseUint32(part, &value) || value > IMOD_XHCI_IMODI_MASK) {
+            return false;
+        }
+        values->push_back(value);
+    }
+    return !values->empty() && values->size() <= IMOD_XHCI_MAX_INTERRUPTERS;
+}
+
+// "0x80000064, 0x80000028" or "50, 20": one per NIC vector, the first repeated past the end.
+bool TryParseNicValueList(const std::wstring& text, std::vector<uint32_t>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L", \t")) {
+        uint32_t value = 0;
+        if (!TryParseUint32(part, &value)) {
+            return false;
+        }
+        values->push_back(value);
+    }
+    return !values->empty() && values->size() <= IMOD_NIC_MAX_VECTORS;
+}
+
+// "1, 2": the I/O vectors that get Coalescing Disable; empty sets none.
+bool TryParseNvmeVectorList(const std::wstring& text, std::vector<uint32_t>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L", \t")) {
+        uint32_t value = 0;
+        if (!TryParseUint32(part, &value) || value == 0 || value >= IMOD_NVME_MAX_VECTORS) {
+            return false;
+        }
+        values->push_back(value);
+    }
+    return true;
+}
+
+// "Mouse=0x0, Keyboard=0x3E8"; a role given twice keeps the last value.
+bool TryParseRoleIntervals(const std::wstring& text, std::vector<RoleInterval>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L",")) {
+        const size_t eqPos = part.find(L'=');
+        uint32_t interval = 0;
+        if (eqPos == std::wstring::npos || !TryParseUint32(part.substr(eqPos + 1), &interval) ||
+            interval > IMOD_XHCI_IMODI_MASK) {
+            return false;
+        }
+        const std::wstring role = NormalizeAdaptiveRole(part.substr(0, eqPos));
+        if (role.empty()) {
+            return false;
+        }
+
+        const auto found = std::find_if(values->begin(), values->end(),
+            [&](const RoleInterval& existing) { return EqualsInsensitive(existing.role, role); });
+        if (found != values->end()) {
+            found->interval = interval;
+        } else {
+            values->push_back({role, interval});
+        }
+    }
+    return !values->empty();
+}
+
+// "3=Mouse, 5=Keyboard+Audio"
+bool TryParseRootPortRoles(const std::wstring& text, std::vector<RootPortRoles>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L",")) {
+        const size_t eqPos = part.find(L'=');
+        uint32_t rootPort = 0;
+        if (eqPos == std::wstring::npos || !TryParseUint32(part.substr(0, eqPos), &rootPort) ||
+            rootPort == 0 || rootPort > 0xFF) {
+            return false;
+        }
+
+        auto found = std::find_if(values->begin(), values->end(),
+            [&](const RootPortRoles& existing) { return existing.rootPort == rootPort; });
+        if (found == values->end()) {
+            found = values->insert(values->end(), {rootPort, {}});
+        }
+        for (const auto& role : SplitList(part.substr(eqPos + 1), L"+|")) {
+            AddRole(&found->roles, NormalizeAdaptiveRole(role));
+        }
+        if (found->roles.empty()) {
+            return false;
+        }
+    }
+    return !values->empty();
+}
+
+// "7.2.4=Mouse, 7.3=Keyboard+Audio"
+bool TryParseRouteRoles(const std::wstring& text, std::vector<RouteRoles>* values) {
+    values->clear();
+    for (const auto& part : SplitList(text, L",")) {
+        const size_t eqPos = part.find(L'=');
+        if (eqPos == std::wstring::npos) {
+            return false;
+        }
+
+        const std::wstring path = Trim(part.substr(0, eqPos));
+        if (std::any_of(path.begin(), path.end(), [](wchar_t ch) { return ch > 0x7F; })) {
+            return false;
+        }
+        const std::string narrow(path.begin(), path.end());
+        ULONG rootPort = 0;
+        ULONG routeString = 0;
+        if (ImodTopologyParseRoute(narrow.data(), static_cast<ULONG>(narrow.size()), &rootPort, &routeString) !=
+            IMOD_RESULT_SUCCESS) {
+            return false;
+        }
+
+        auto found = std::find_if(values->begin(), values->end(), [&](const RouteRoles& existing) {
+            return existing.rootPort == rootPort && existing.routeString == routeString;
+        });
+        if (found == values->end()) {
+            found = values->insert(values->end(), {rootPort, routeString, {}});
+        }
+        for (const auto& role : SplitList(part.substr(eqPos + 1), L"+|")) {
+            AddRole(&found->roles, NormalizeAdaptiveRole(role));
+        }
+        if (found->roles.empty()) {
+            return false;
+        }
+    }
+    return !values->empty();
+}
+
+std::wstring FormatRoute(uint32_t rootPort, uint32_t routeString) {
+    char text[IMOD_TOPOLOGY_ROUTE_TEXT_SIZE];
+    ULONG written = 0;
+    if (ImodTopologyFormatRoute(rootPort, routeString, text, sizeof(text), &written) != IMOD_RESULT_SUCCESS) {
+        return L"?";
+    }
+    return std::wstring(text, text + written);
+}
+
+std::wstring FormatRouteRoles(const std::vector<RouteRoles>& bindings) {
+    std::wstring text;
+    for (const auto& binding : bindings) {
+        if (!text.empty()) {
+            text += L", ";
+        }
+        text += FormatRoute(binding.rootPort, binding.routeString) + L"=";
+        for (size_t i = 0; i < binding.roles.size(); ++i) {
+            text += (i == 0 ? L"" : L"+") + binding.roles[i];
+        }
+    }
+    return text;
+}
+
+std::wstring FormatRootPortRoles(const std::vector<RootPortRoles>& bindings) {
+    std::wstring text;
+    for (const auto& binding : bindings) {
+        if (!text.empty()) {
+            text += L", ";
+        }
+        text += std::to_wstring(binding.rootPort) + L"=";
+        for (size_t i = 0; i < binding.roles.size(); ++i) {
+            text += (i == 0 ? L"" : L"+") + binding.roles[i];
+        }
+    }
+    return text;
+}
+
+const RoleInterval* SelectAdaptiveRole(const std::vector<std::wstring>& roles, const std::vector<RoleInterval>& roleIntervals) {
+    const auto find = [&](const std::wstring& role) -> const RoleInterval* {
+        for (const auto& entry : roleIntervals) {
+            if (EqualsInsensitive(entry.role, role)) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    };
+
+    for (const wchar_t* role : kAdaptiveRolePriority) {
+        const bool present = std::any_of(roles.begin(), roles.end(),
+            [&](const std::wstring& candidate) { return EqualsInsensitive(candidate, role); });
+        if (present && find(role)) {
+            return find(role);
+        }
+    }
+    for (const auto& role : roles) {
+        if (const RoleInterval* entry = find(role)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
 bool FileExists(const std::wstring& path) {
     const DWORD attrs = GetFileAttributesW(path.c_str());
     if (attrs == INVALID_FILE_ATTRIBUTES) {
@@ -481,7 +935,7 @@ bool GetDeviceProblemCode(DEVINST devInst, ULONG* problemCode) {
     return true;
 }
 
-bool ExtractBaseFromResource(RESOURCEID resType, const BYTE* data, size_t size, uint64_t* base) {
+bool ExtractBaseFromResource(RESOURCEID resType, const BYTE* data, size_t size, uint64_t* base, uint64_t* length) {
     if (resType == ResType_Mem) {
         if (size < sizeof(MEM_RESOURCE)) {
             return false;
@@ -495,6 +949,7 @@ bool ExtractBaseFromResource(RESOURCEID resType, const BYTE* data, size_t size,
             return false;
         }
         *base = candidate;
+        *length = mem->MEM_Header.MD_Alloc_End >= candidate ? mem->MEM_Header.MD_Alloc_End - candidate + 1 : 0;
         return true;
     }
 
@@ -511,6 +966,7 @@ bool ExtractBaseFromResource(RESOURCEID resType, const BYTE* data, size_t size,
             return false;
         }
         *base = candidate;
+        *length = mem->MEM_LARGE_Header.MLD_Alloc_End >= candidate ? mem->MEM_LARGE_Header.MLD_Alloc_End - candidate + 1 : 0;
         return true;
     }
 
@@ -528,6 +984,8 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
 
     Config result;
     ControllerOverride* currentDevice = nullptr;
+    NicOverride* currentNic = nullptr;
+    NvmeOverride* currentNvme = nullptr;
     bool inGlobal = true;
 
     std::string lineRaw;
@@ -554,15 +1012,43 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
             std::wstring section = Trim(line.substr(1, line.size() - 2));
             if (EqualsInsensitive(section, L"global")) {
                 currentDevice = nullptr;
+                currentNic = nullptr;
+                currentNvme = nullptr;
                 inGlobal = true;
                 continue;
             }
 
+            if (StartsWithInsensitive(section, L"nic:")) {
+                std::wstring hwid = Trim(section.substr(4));
+                if (!hwid.empty()) {
+                    currentNic = &result.nicOverrides.emplace_back();
+                    currentNic->hwid = hwid;
+                    currentDevice = nullptr;
+                    currentNvme = nullptr;
+                    inGlobal = false;
+                }
+                continue;
+            }
+
+            if (StartsWithInsensitive(section, L"nvme:")) {
+                std::wstring hwid = Trim(section.substr(5));
+                if (!hwid.empty()) {
+                    currentNvme = &result.nvmeOverrides.emplace_back();
+                    currentNvme->hwid = hwid;
+                    currentDevice = nullptr;
+                    currentNic = nullptr;
+                    inGlobal = false;
+                }
+                continue;
+            }
+
             if (StartsWithInsensitive(section, L"device:")) {
                 std::wstring hwid = Trim(section.substr(7));
                 if (!hwid.empty()) {
-                    result.overrides.push_back({hwid, std::nullopt, std::nullopt, std::nullopt, std::nullopt});
-                    currentDevice = &result.overrides.back();
+                    currentDevice = &result.overrides.emplace_back();
+                    currentDevice->hwid = hwid;
+                    currentNic = nullptr;
+                    currentNvme = nullptr;
                     inGlobal = false;
                 }
                 continue;
@@ -571,8 +1057,10 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
             if (StartsWithInsensitive(section, L"device ")) {
                 std::wstring hwid = Trim(section.substr(7));
                 if (!hwid.empty()) {
-                    result.overrides.push_back({hwid, std::nullopt, std::nullopt, std::nullopt, std::nullopt});
-                    currentDevice = &result.overrides.back();
+                    currentDevice = &result.overrides.emplace_back();
+                    currentDevice->hwid = hwid;
+                    currentNic = nullptr;
+                    currentNvme = nullptr;
                     inGlobal = false;
                 }
                 continue;
@@ -589,6 +1077,72 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
         std::wstring key = ToUpper(Trim(line.substr(0, eqPos)));
         std::wstring value = Trim(line.substr(eqPos + 1));
 
+        if (currentNic != nullptr) {
+            bool parsedNic = false;
+            uint32_t parsed = 0;
+            if (key == L"ENABLED") {
+                bool parsedEnabled = true;
+                parsedNic = TryParseBool(value, &parsedEnabled);
+                currentNic->enabled = parsedEnabled;
+            } else if (key == L"VALUES") {
+                // The last of VALUES and INTERVAL_US wins.
+                parsedNic = TryParseNicValueList(value, &currentNic->values);
+                currentNic->intervalsUs.clear();
+            } else if (key == L"INTERVAL_US" || key == L"INTERVALS_US") {
+                parsedNic = TryParseNicValueList(value, &currentNic->intervalsUs);
+                currentNic->values.clear();
+            } else if (TryParseUint32(value, &parsed)) {
+                parsedNic = true;
+                if (key == L"BASE_OFFSET") {
+                    currentNic->baseOffset = parsed;
+                } else if (key == L"STRIDE") {
+                    currentNic->stride = parsed;
+                } else if (key == L"QUEUES") {
+                    currentNic->queues = parsed;
+                } else if (key == L"WIDTH") {
+                    currentNic->width = parsed;
+                } else if (key == L"MASK") {
+                    currentNic->mask = parsed;
+                } else if (key == L"OR_BITS") {
+                    currentNic->orBits = parsed;
+                }
+            }
+            if (!parsedNic) {
+                if (error) {
+                    *error = L"invalid " + ToLower(key) + L" value at line " + std::to_wstring(lineNumber);
+                }
+                return false;
+            }
+            continue;
+        }
+
+        if (currentNvme != nullptr) {
+            bool parsedNvme = false;
+            uint32_t parsed = 0;
+            if (key == L"ENABLED") {
+                bool parsedEnabled = true;
+                parsedNvme = TryParseBool(value, &parsedEnabled);
+                currentNvme->enabled = parsedEnabled;
+            } else if (key == L"CD" || key == L"COALESCING_DISABLE") {
+                std::vector<uint32_t> vectors;
+                parsedNvme = TryParseNvmeVectorList(value, &vectors);
+                currentNvme->disabledVectors = std::move(vectors);
+            } else if (key == L"TIME_US" && TryParseUint32(value, &parsed)) {
+                parsedNvme = parsed <= IMOD_NVME_MAX_TIME_US;
+                currentNvme->timeUs = parsed;
+            } else if (key == L"THRESHOLD" && TryParseUint32(value, &parsed)) {
+                parsedNvme = parsed >= 1 && parsed <= IMOD_NVME_MAX_THRESHOLD;
+                currentNvme->threshold = parsed;
+            }
+            if (!parsedNvme) {
+                if (error) {
+                    *error = L"invalid " + ToLower(key) + L" value at line " + std::to_wstring(lineNumber);
+                }
+                return false;
+            }
+            continue;
+        }
+
         if (key == L"ENABLED") {
             bool parsedEnabled = true;
             if (!TryParseBool(value, &parsedEnabled)) {
@@ -600,6 +1154,40 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
 
             if (!inGlobal && currentDevice != nullptr) {
                 currentDevice->enabled = parsedEnabled;
+            } else if (inGlobal) {
+                result.usbEnabled = parsedEnabled;
+            }
+            continue;
+        }
+
+        if (key == L"INTERVALS" || key == L"ROLE_INTERVALS" || key == L"ROOT_PORT_ROLES" || key == L"ROUTE_ROLES" ||
+            key == L"ADAPTIVE_ROLE_BINDING") {
+            if (inGlobal || currentDevice == nullptr) {
+                if (error) {
+                    *error = ToLower(key) + L" is only valid in a device section (line " + std::to_wstring(lineNumber) + L")";
+                }
+                return false;
+            }
+
+            bool parsedList = false;
+            if (key == L"INTERVALS") {
+                parsedList = TryParseIntervalList(value, &currentDevice->intervals);
+            } else if (key == L"ROLE_INTERVALS") {
+                parsedList = TryParseRoleIntervals(value, &currentDevice->roleIntervals);
+            } else if (key == L"ROOT_PORT_ROLES") {
+                parsedList = TryParseRootPortRoles(value, &currentDevice->rootPortRoles);
+            } else if (key == L"ROUTE_ROLES") {
+                parsedList = TryParseRouteRoles(value, &currentDevice->routeRoles);
+            } else {
+                bool adaptive = true;
+                parsedList = TryParseBool(value, &adaptive);
+                currentDevice->adaptiveRoleBinding = adaptive;
+            }
+            if (!parsedList) {
+                if (error) {
+                    *error = L"invalid " + ToLower(key) + L" value at line " + std::to_wstring(lineNumber);
+                }
+                return false;
             }
             continue;
         }
@@ -619,6 +1207,10 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
                 target->hcsparamsOffset = val;
             } else if (keyName == L"RTSOFF") {
                 target->rtsoff = val;
+            } else if (keyName == L"GOVERNOR_MAX_LATENCY_US") {
+                target->governorMaxLatencyUs = val;
+            } else if (keyName == L"GOVERNOR_IRQ_BUDGET") {
+                target->governorIrqBudget = val;
             }
         };
 
@@ -629,6 +1221,14 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
                 result.globalHcsparamsOffset = parsed;
             } else if (key == L"RTSOFF") {
                 result.globalRtsoff = parsed;
+            } else if (key == L"GOVERNOR_MAX_LATENCY_US") {
+                result.governorMaxLatencyUs = parsed;
+            } else if (key == L"GOVERNOR_IRQ_BUDGET") {
+                result.governorIrqBudget = parsed;
+            } else if (key == L"GOVERNOR_HYSTERESIS") {
+                result.governorHysteresis = parsed;
+            } else if (key == L"GOVERNOR_HOLD") {
+                result.governorHoldTicks = parsed;
             }
         } else {
             applyValue(currentDevice, key, parsed);
@@ -639,7 +1239,7 @@ bool LoadConfigFile(const std::wstring& path, Config* config, std::wstring* erro
     return true;
 }
 
-bool GetDeviceMemoryBase(DEVINST devInst, uint64_t* base, std::wstring* error) {
+bool GetDeviceMemoryBase(DEVINST devInst, uint64_t* base, uint64_t* length, std::wstring* error) {
     LOG_CONF logConf = 0;
     CONFIGRET cr = CM_Get_First_Log_Conf(&logConf, devInst, ALLOC_LOG_CONF);
     if (cr != CR_SUCCESS) {
@@ -655,6 +1255,7 @@ bool GetDeviceMemoryBase(DEVINST devInst, uint64_t* base, std::wstring* error) {
     ScopeExit logConfCleanup([&]() { CM_Free_Log_Conf_Handle(logConf); });
 
     uint64_t minBase = 0;
+    uint64_t minBaseLength = 0;
     bool found = false;
     const RESOURCEID resTypes[] = {ResType_Mem, ResType_MemLarge};
 
@@ -668,9 +1269,11 @@ bool GetDeviceMemoryBase(DEVINST devInst, uint64_t* base, std::wstring* error) {
                 std::vector<BYTE> buffer(dataSize);
                 if (CM_Get_Res_Des_Data(resDes, buffer.data(), dataSize, 0) == CR_SUCCESS) {
                     uint64_t candidate = 0;
-                    if (ExtractBaseFromResource(resType, buffer.data(), buffer.size(), &candidate)) {
+                    uint64_t candidateLength = 0;
+                    if (ExtractBaseFromResource(resType, buffer.data(), buffer.size(), &candidate, &candidateLength)) {
                         if (!found || candidate < minBase) {
                             minBase = candidate;
+                            minBaseLength = candidateLength;
                             found = true;
                         }
                     }
@@ -693,10 +1296,40 @@ bool GetDeviceMemoryBase(DEVINST devInst, uint64_t* base, std::wstring* error) {
     }
 
     *base = minBase;
+    *length = minBaseLength;
     return true;
 }
 
-bool EnumerateXhciControllers(std::vector<UsbControllerInfo>* out, std::wstring* error) {
+bool HasEthernetClassCode(const std::vector<std::wstring>& ids) {
+    for (const auto& id : ids) {
+        if (ContainsInsensitive(id, L"CC_0200") || ContainsInsensitive(id, L"CLASS_0200")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsEthernetDevice(HDEVINFO devInfoSet, SP_DEVINFO_DATA* devInfo) {
+    std::vector<std::wstring> ids;
+    return GetDeviceMultiSzProperty(devInfoSet, devInfo, SPDRP_COMPATIBLEIDS, &ids) && HasEthernetClassCode(ids);
+}
+
+// Class 01, subclass 08, programming interface 02: an NVM Express controller.
+bool HasNvmeClassCode(const std::vector<std::wstring>& ids) {
+    for (const auto& id : ids) {
+        if (ContainsInsensitive(id, L"CC_010802") || ContainsInsensitive(id, L"CLASS_010802")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsNvmeController(HDEVINFO devInfoSet, SP_DEVINFO_DATA* devInfo) {
+    std::vector<std::wstring> ids;
+    return GetDeviceMultiSzProperty(devInfoSet, devInfo, SPDRP_COMPATIBLEIDS, &ids) && HasNvmeClassCode(ids);
+}
+
+bool EnumeratePciDevices(bool (*match)(HDEVINFO, SP_DEVINFO_DATA*), std::vector<PciDeviceInfo>* out, std::wstring* error) {
     HDEVINFO devInfoSet = SetupDiGetClassDevsW(nullptr, L"PCI", nullptr, DIGCF_PRESENT | DIGCF_ALLCLASSES);
     if (devInfoSet == INVALID_HANDLE_VALUE) {
         if (error) {
@@ -707,7 +1340,7 @@ bool EnumerateXhciControllers(std::vector<UsbControllerInfo>* out, std::wstring*
 
     ScopeExit cleanup([&]() { SetupDiDestroyDeviceInfoList(devInfoSet); });
 
-    std::vector<UsbControllerInfo> results;
+    std::vector<PciDeviceInfo> results;
     for (DWORD index = 0;; ++index) {
         SP_DEVINFO_DATA devInfo{};
         devInfo.cbSize = sizeof(devInfo);
@@ -721,11 +1354,12 @@ bool EnumerateXhciControllers(std::vector<UsbControllerInfo>* out, std::wstring*
             return false;
         }
 
-        if (!IsXhciDevice(devInfoSet, &devInfo)) {
+        if (!match(devInfoSet, &devInfo)) {
             continue;
         }
 
-        UsbControllerInfo info;
+        PciDeviceInfo info;
+        info.devInst = devInfo.DevInst;
         if (!GetDeviceInstanceId(devInfoSet, &devInfo, &info.deviceId)) {
             continue;
         }
@@ -734,7 +1368,7 @@ bool EnumerateXhciControllers(std::vector<UsbControllerInfo>* out, std::wstring*
         GetDeviceProblemCode(devInfo.DevInst, &info.problemCode);
 
         std::wstring baseError;
-        if (GetDeviceMemoryBase(devInfo.DevInst, &info.baseAddress, &baseError)) {
+        if (GetDeviceMemoryBase(devInfo.DevInst, &info.baseAddress, &info.baseLength, &baseError)) {
             info.hasBase = true;
         } else {
             info.baseError = baseError;
@@ -747,115 +1381,2122 @@ bool EnumerateXhciControllers(std::vector<UsbControllerInfo>* out, std::wstring*
     return true;
 }
 
-bool MapPhysicalMemory(const ImodDriverContext& ctx, uint64_t address, uint64_t size, PhysStruct* out, std::wstring* error) {
-    PhysStruct phys{};
-    phys.physMemSizeInBytes = size;
-    phys.physAddress = address;
+bool EnumerateXhciControllers(std::vector<PciDeviceInfo>* out, std::wstring* error) {
+    return EnumeratePciDevices(IsXhciDevice, out, error);
+}
 
-    DWORD bytesReturned = 0;
-    if (!DeviceIoControl(
-            ctx.driverHandle,
-            IoctlImodMapPhysicalMemory,
-            &phys, sizeof(phys),
-            &phys, sizeof(phys),
-            &bytesReturned,
-            nullptr)) {
-        if (error) {
-            *error = L"failed to map physical memory: " + GetLastErrorMessage(GetLastError());
-        }
+bool EnumerateEthernetAdapters(std::vector<PciDeviceInfo>* out, std::wstring* error) {
+    return EnumeratePciDevices(IsEthernetDevice, out, error);
+}
+
+bool EnumerateNvmeControllers(std::vector<PciDeviceInfo>* out, std::wstring* error) {
+    return EnumeratePciDevices(IsNvmeController, out, error);
+}
+
+// "PCI\VEN_8086&DEV_15F3&SUBSYS_..." -> 0x8086, 0x15F3.
+bool ParsePciVendorDevice(const std::wstring& deviceId, USHORT* vendorId, USHORT* productId) {
+    const std::wstring upper = ToUpper(deviceId);
+    const size_t ven = upper.find(L"VEN_");
+    const size_t dev = upper.find(L"DEV_");
+    if (ven == std::wstring::npos || dev == std::wstring::npos || ven + 8 > upper.size() || dev + 8 > upper.size()) {
         return false;
     }
-
-    if (phys.physMemLin == 0) {
-        if (error) {
-            *error = L"failed to map physical memory: returned null linear address";
-        }
+    uint32_t vendor = 0;
+    uint32_t product = 0;
+    if (!TryParseUint32(L"0x" + upper.substr(ven + 4, 4), &vendor) ||
+        !TryParseUint32(L"0x" + upper.substr(dev + 4, 4), &product)) {
         return false;
     }
-
-    *out = phys;
+    *vendorId = static_cast<USHORT>(vendor);
+    *productId = static_cast<USHORT>(product);
     return true;
 }
 
-bool UnmapPhysicalMemory(const ImodDriverContext& ctx, const PhysStruct& phys, std::wstring* error) {
-    PhysStruct local = phys;
-    DWORD bytesReturned = 0;
-    if (!DeviceIoControl(
-            ctx.driverHandle,
-            IoctlImodUnmapPhysicalMemory,
-            &local, sizeof(local),
-            &local, sizeof(local),
-            &bytesReturned,
-            nullptr)) {
-        if (error) {
-            *error = L"failed to unmap physical memory: " + GetLastErrorMessage(GetLastError());
-        }
-        return false;
+std::wstring GetVidPidKey(const std::wstring& deviceId) {
+    const std::wstring upper = ToUpper(deviceId);
+    const size_t vid = upper.find(L"VID_");
+    const size_t pid = upper.find(L"PID_");
+    if (vid == std::wstring::npos || pid == std::wstring::npos) {
+        return L"";
     }
-    return true;
+    return upper.substr(vid, 8) + L"&" + upper.substr(pid, 8);
+}
+
+// One pass over the present devices, keeping those whose setup class names a role. HID
+// devices count as gamepads unless they belong to a keyboard or mouse (same VID/PID).
+std::vector<RoleDevice> EnumerateRoleDevices() {
+    std::vector<RoleDevice> devices;
+    HDEVINFO devInfoSet = SetupDiGetClassDevsW(nullptr, nullptr, nullptr, DIGCF_PRESENT | DIGCF_ALLCLASSES);
+    if (devInfoSet == INVALID_HANDLE_VALUE) {
+        return devices;
+    }
+
+    ScopeExit cleanup([&]() { SetupDiDestroyDeviceInfoList(devInfoSet); });
+
+    std::vector<std::wstring> inputVidPids;
+    std::vector<std::pair<DEVINST, std::wstring>> hidDevices;
+    SP_DEVINFO_DATA devInfo{};
+    devInfo.cbSize = sizeof(devInfo);
+    for (DWORD index = 0; SetupDiEnumDeviceInfo(devInfoSet, index, &devInfo); ++index) {
+        std::wstring setupClass;
+        std::wstring deviceId;
+        if (!GetDeviceStringProperty(devInfoSet, &devInfo, SPDRP_CLASS, &setupClass) ||
+            !GetDeviceInstanceId(devInfoSet, &devInfo, &deviceId)) {
+            continue;
+        }
+
+        std::wstring role;
+        if (EqualsInsensitive(setupClass, L"Keyboard")) {
+            role = L"Keyboard";
+        } else if (EqualsInsensitive(setupClass, L"Mouse")) {
+            role = L"Mouse";
+        } else if (EqualsInsensitive(setupClass, L"MEDIA")) {
+            role = L"Audio";
+        } else if (EqualsInsensitive(setupClass, L"Camera") || EqualsInsensitive(setupClass, L"Image")) {
+            role = L"Webcam";
+        } else if (EqualsInsensitive(setupClass, L"HIDClass")) {
+            hidDevices.emplace_back(devInfo.DevInst, GetVidPidKey(deviceId));
+            continue;
+        } else {
+            continue;
+        }
+
+        if (role == L"Keyboard" || role == L"Mouse") {
+            inputVidPids.push_back(GetVidPidKey(deviceId));
+        }
+        devices.push_back({role, devInfo.DevInst});
+    }
+
+    for (const auto& [devInst, vidPid] : hidDevices) {
+        if (vidPid.empty() || std::find(inputVidPids.begin(), inputVidPids.end(), vidPid) == inputVidPids.end()) {
+            devices.push_back({L"Gamepad", devInst});
+        }
+    }
+    return devices;
+}
+
+std::optional<uint32_t> GetUsbPortNumber(DEVINST devInst) {
+    wchar_t location[256] = {};
+    ULONG size = sizeof(location);
+    if (CM_Get_DevNode_Registry_PropertyW(devInst, CM_DRP_LOCATION_INFORMATION, nullptr, location, &size, 0) == CR_SUCCESS) {
+        if (const wchar_t* port = wcsstr(location, L"Port_#")) {
+            const uint32_t value = static_cast<uint32_t>(wcstoul(port + 6, nullptr, 10));
+            if (value != 0) {
+                return value;
+            }
+        }
+    }
+
+    ULONG address = 0;
+    size = sizeof(address);
+    if (CM_Get_DevNode_Registry_PropertyW(devInst, CM_DRP_ADDRESS, nullptr, &address, &size, 0) == CR_SUCCESS &&
+        address != 0) {
+        return address;
+    }
+    return std::nullopt;
+}
+
+// The root hub port `device` hangs off when it sits below `controller`: the ancestor whose
+// parent is the controller's root hub carries the port number.
+std::optional<uint32_t> FindRootPort(DEVINST device, DEVINST controller) {
+    DEVINST current = device;
+    for (uint32_t depth = 0; depth < kRoleDeviceMaxDepth; ++depth) {
+        DEVINST parent = 0;
+        DEVINST grandparent = 0;
+        if (CM_Get_Parent(&parent, current, 0) != CR_SUCCESS || CM_Get_Parent(&grandparent, parent, 0) != CR_SUCCESS) {
+            return std::nullopt;
+        }
+        if (grandparent == controller) {
+            return GetUsbPortNumber(current);
+        }
+        current = parent;
+    }
+    return std::nullopt;
+}
+
+// Root port bindings for the roles the config gives an interval, found from where the
+// role devices are plugged in right now.
+std::vector<RootPortRoles> DiscoverRootPortRoles(DEVINST controller, const std::vector<RoleDevice>& devices,
+    const std::vector<RoleInterval>& roleIntervals) {
+    std::vector<RootPortRoles> bindings;
+    for (const auto& device : devices) {
+        const bool wanted = std::any_of(roleIntervals.begin(), roleIntervals.end(),
+            [&](const RoleInterval& entry) { return EqualsInsensitive(entry.role, device.role); });
+        if (!wanted) {
+            continue;
+        }
+
+        const std::optional<uint32_t> rootPort = FindRootPort(device.devInst, controller);
+        if (!rootPort) {
+            continue;
+        }
+
+        auto found = std::find_if(bindings.begin(), bindings.end(),
+            [&](const RootPortRoles& binding) { return binding.rootPort == *rootPort; });
+        if (found == bindings.end()) {
+            found = bindings.insert(
+                std::upper_bound(bindings.begin(), bindings.end(), *rootPort,
+                    [](uint32_t port, const RootPortRoles& binding) { return port < binding.rootPort; }),
+                {*rootPort, {}});
+        }
+        AddRole(&found->roles, device.role);
+    }
+    return bindings;
+}
+
+std::wstring FormatTopologyWalk(const tagImodTopologyWalk& walk) {
+    std::wostringstream text;
+    text << L"slots=" << walk.slotsScanned << L" (read " << walk.slotsRead << L", reused " << walk.slotsReused
+         << L", dropped " << walk.slotsDropped << L"), maps=" << walk.maps << L", reads=" << walk.reads;
+    return text.str();
+}
+
+// Interrupters the controller's enabled device slots target, by root port and by port path
+// ("7.2.4"), from DTIMOD's DCBAA walk. DTIMOD caches the walk per controller, so a repeated
+// query (--watch) only re-reads slots that changed; `walk` gets what this one cost when the
+// driver reports it.
+bool QueryRootPortInterrupters(const ImodDriverContext& ctx, uint64_t capabilityAddress, uint64_t barLength,
+    uint32_t hcsparamsOffset, uint32_t* maxIntrs, std::map<uint32_t, std::vector<uint32_t>>* byRootPort,
+    std::map<std::wstring, std::vector<uint32_t>>* byRoute, std::optional<tagImodTopologyWalk>* walk,
+    std::wstring* error) {
+    const size_t recordsLength = sizeof(tagImodTopologyHeader) + (kTopologySlotCapacity * sizeof(tagImodTopologySlot));
+    std::vector<BYTE> buffer(recordsLength + sizeof(tagImodTopologyWalk));
+    tagImodTopologyHeader header{};
+    header.version = IMOD_TOPOLOGY_VERSION;
+    header.flags = IMOD_TOPOLOGY_FLAG_WALK;
+    header.capabilityAddress = capabilityAddress;
+    header.barLength = barLength;
+    header.hcsparamsOffset = hcsparamsOffset;
+    header.slotCapacity = kTopologySlotCapacity;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    if (!DriverHandles(ctx, IoctlImodQueryTopology)) {
+        if (error) {
+            *error = L"loaded DTIMOD.sys has no topology query";
+        }
+        return false;
+    }
+
+    DWORD bytesReturned = 0;
+    BOOL queried = DeviceIoControl(
+        ctx.driverHandle,
+        IoctlImodQueryTopology,
+        buffer.data(), static_cast<DWORD>(buffer.size()),
+        buffer.data(), static_cast<DWORD>(buffer.size()),
+        &bytesReturned,
+        nullptr);
+    // A DTIMOD.sys that predates the walk record rejects any flag.
+    if (!queried && GetLastError() == ERROR_INVALID_PARAMETER) {
+        header.flags = 0;
+        buffer.resize(recordsLength);
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        queried = DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodQueryTopology,
+            buffer.data(), static_cast<DWORD>(buffer.size()),
+            buffer.data(), static_cast<DWORD>(buffer.size()),
+            &bytesReturned,
+            nullptr);
+    }
+    if (!queried) {
+        const DWORD lastError = GetLastError();
+        if (error) {
+            *error = lastError == ERROR_INVALID_FUNCTION
+                ? L"loaded DTIMOD.sys has no topology query"
+                : L"failed to query xHCI topology: " + GetLastErrorMessage(lastError);
+        }
+        return false;
+    }
+
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (bytesReturned < buffer.size() || header.slotCount > kTopologySlotCapacity) {
+        if (error) {
+            *error = L"failed to query xHCI topology: malformed reply";
+        }
+        return false;
+    }
+
+    walk->reset();
+    if (buffer.size() > recordsLength) {
+        tagImodTopologyWalk reported{};
+        std::memcpy(&reported, buffer.data() + recordsLength, sizeof(reported));
+        *walk = reported;
+    }
+
+    *maxIntrs = header.maxIntrs;
+    byRootPort->clear();
+    byRoute->clear();
+    for (uint32_t i = 0; i < header.slotCount; ++i) {
+        tagImodTopologySlot slot{};
+        std::memcpy(&slot, buffer.data() + sizeof(header) + (i * sizeof(slot)), sizeof(slot));
+        if (slot.slotState < 2 || (slot.flags & IMOD_TOPOLOGY_SLOT_HUB) != 0 || slot.rootPort == 0 ||
+            slot.interrupter >= header.maxIntrs) {
+            continue;
+        }
+
+        for (std::vector<uint32_t>* interrupters :
+            {&(*byRootPort)[slot.rootPort], &(*byRoute)[FormatRoute(slot.rootPort, slot.routeString)]}) {
+            if (std::find(interrupters->begin(), interrupters->end(), slot.interrupter) == interrupters->end()) {
+                interrupters->push_back(slot.interrupter);
+            }
+        }
+    }
+    return true;
+}
+
+// Interval vector for the whole controller: interrupters behind a bound root port get the
+// interval of the port's highest-priority role, then those of a bound port path get the
+// path's, and the rest keep `fallback` (or the configured vector where it reaches).
+bool BuildAdaptiveIntervals(const ImodDriverContext& ctx, const ControllerPlan& plan,
+    const std::vector<RoleInterval>& roleIntervals, const std::vector<RootPortRoles>& bindings,
+    const std::vector<RouteRoles>& routeBindings, std::vector<uint32_t>* intervals, std::wstring* detail) {
+    uint32_t maxIntrs = 0;
+    std::map<uint32_t, std::vector<uint32_t>> byRootPort;
+    std::map<std::wstring, std::vector<uint32_t>> byRoute;
+    std::optional<tagImodTopologyWalk> walk;
+    if (!QueryRootPortInterrupters(ctx, plan.capabilityAddress, plan.barLength, plan.hcsparamsOffset, &maxIntrs,
+            &byRootPort, &byRoute, &walk, detail)) {
+        return false;
+    }
+
+    const uint32_t count = std::min<uint32_t>(maxIntrs, IMOD_XHCI_MAX_INTERRUPTERS);
+    if (count == 0) {
+        *detail = L"controller reports zero interrupters";
+        return false;
+    }
+
+    std::vector<uint32_t> result(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        result[i] = (i < plan.intervals.size() ? plan.intervals[i] : plan.interval) & IMOD_XHCI_IMODI_MASK;
+    }
+
+    uint32_t matchedPorts = 0;
+    uint32_t matchedRoutes = 0;
+    uint32_t assigned = 0;
+    uint32_t listed = 0;
+    std::vector<bool> bound(count, false);
+    std::wostringstream shown;
+    const auto assign = [&](const std::wstring& where, const std::vector<uint32_t>& interrupters,
+                            const RoleInterval& selected) {
+        for (uint32_t interrupter : interrupters) {
+            if (interrupter >= count) {
+                continue;
+            }
+            result[interrupter] = selected.interval & IMOD_XHCI_IMODI_MASK;
+            if (!bound[interrupter]) {
+                bound[interrupter] = true;
+                ++assigned;
+            }
+            if (listed++ < 8) {
+                shown << (listed == 1 ? L"" : L", ") << where << L"->I" << interrupter << L"=" << selected.role
+                      << L":" << ToHex(selected.interval);
+            }
+        }
+    };
+
+    for (const auto& binding : bindings) {
+        const auto interrupters = byRootPort.find(binding.rootPort);
+        const RoleInterval* selected = SelectAdaptiveRole(binding.roles, roleIntervals);
+        if (interrupters == byRootPort.end() || selected == nullptr) {
+            continue;
+        }
+
+        ++matchedPorts;
+        assign(L"port" + std::to_wstring(binding.rootPort), interrupters->second, *selected);
+    }
+
+    // A path is more specific than its root port, so it wins an interrupter both reach.
+    for (const auto& binding : routeBindings) {
+        const std::wstring route = FormatRoute(binding.rootPort, binding.routeString);
+        const auto interrupters = byRoute.find(route);
+        const RoleInterval* selected = SelectAdaptiveRole(binding.roles, roleIntervals);
+        if (interrupters == byRoute.end() || selected == nullptr) {
+            continue;
+        }
+
+        ++matchedRoutes;
+        assign(L"route" + route, interrupters->second, *selected);
+    }
+
+    if (assigned == 0) {
+        *detail = L"no bound root port or route has an active interrupter (" + std::to_wstring(byRootPort.size()) +
+            L" ports, " + std::to_wstring(byRoute.size()) + L" routes with devices)";
+        return false;
+    }
+
+    std::wostringstream text;
+    text << L"vector=" << count << L", ports=" << matchedPorts << L", routes=" << matchedRoutes
+         << L", interrupters=" << assigned << L" ["
+         << shown.str() << (listed > 8 ? L", +" + std::to_wstring(listed - 8) + L" more" : L"") << L"]";
+    if (walk) {
+        text << L", walk: " << FormatTopologyWalk(*walk);
+    }
+    *detail = text.str();
+    *intervals = std::move(result);
+    return true;
+}
+
+bool MapPhysicalMemory(const ImodDriverContext& ctx, uint64_t address, uint64_t size, PhysStruct* out, std::wstring* error) {
+    PhysStruct phys{};
+    phys.physMemSizeInBytes = size;
+    phys.physAddress = address;
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodMapPhysicalMemory,
+            &phys, sizeof(phys),
+            &phys, sizeof(phys),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to map physical memory: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    if (phys.physMemLin == 0) {
+        if (error) {
+            *error = L"failed to map physical memory: returned null linear address";
+        }
+        return false;
+    }
+
+    *out = phys;
+    return true;
+}
+
+bool UnmapPhysicalMemory(const ImodDriverContext& ctx, const PhysStruct& phys, std::wstring* error) {
+    PhysStruct local = phys;
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodUnmapPhysicalMemory,
+            &local, sizeof(local),
+            &local, sizeof(local),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to unmap physical memory: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ReadPhys(const ImodDriverContext& ctx, uint64_t address, uint32_t accessSize, uint32_t* value, std::wstring* error) {
+    PhysAccessStruct access{};
+    access.physAddress = address;
+    access.accessSizeInBytes = accessSize;
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodReadPhysicalMemory,
+            &access, sizeof(access),
+            &access, sizeof(access),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to read physical memory: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    if (bytesReturned < sizeof(access)) {
+        if (error) {
+            *error = L"failed to read physical memory: short driver response";
+        }
+        return false;
+    }
+
+    *value = static_cast<uint32_t>(access.value);
+    return true;
 }
 
 bool ReadPhys32(const ImodDriverContext& ctx, uint64_t address, uint32_t* value, std::wstring* error) {
+    return ReadPhys(ctx, address, sizeof(uint32_t), value, error);
+}
+
+bool WritePhys(const ImodDriverContext& ctx, uint64_t address, uint32_t accessSize, uint32_t value, std::wstring* error) {
     PhysAccessStruct access{};
     access.physAddress = address;
-    access.accessSizeInBytes = sizeof(uint32_t);
+    access.accessSizeInBytes = accessSize;
+    access.value = value;
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodWritePhysicalMemory,
+            &access, sizeof(access),
+            &access, sizeof(access),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to write physical memory: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool WritePhys32(const ImodDriverContext& ctx, uint64_t address, uint32_t value, std::wstring* error) {
+    return WritePhys(ctx, address, sizeof(uint32_t), value, error);
+}
+
+// DTIMOD backend of IMOD_PLATFORM over the single-register IOCTLs. The sampler and governor
+// touch controller registers through an IMOD_PLATFORM, and the apply goes through an
+// ImodApplyBackend, so the same code runs against Common/imod_simulator.c off Windows.
+// Windows are bookkeeping only; every access is one driver round trip.
+BOOLEAN DtimodMapWindow(PVOID, ULONGLONG physicalAddress, ULONG length, PIMOD_REGISTER_WINDOW window) {
+    *window = {};
+    window->PhysicalAddress = physicalAddress;
+    window->Length = length;
+    return TRUE;
+}
+
+VOID DtimodUnmapWindow(PVOID, PIMOD_REGISTER_WINDOW) {}
+
+BOOLEAN DtimodRead32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG* value) {
+    uint32_t readValue = 0;
+    if (offset > window->Length || window->Length - offset < sizeof(ULONG) ||
+        !ReadPhys32(*static_cast<const ImodDriverContext*>(context), window->PhysicalAddress + offset, &readValue, nullptr)) {
+        return FALSE;
+    }
+    *value = readValue;
+    return TRUE;
+}
+
+BOOLEAN DtimodWrite32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG value) {
+    if (offset > window->Length || window->Length - offset < sizeof(ULONG)) {
+        return FALSE;
+    }
+    return WritePhys32(*static_cast<const ImodDriverContext*>(context), window->PhysicalAddress + offset, value, nullptr)
+        ? TRUE
+        : FALSE;
+}
+
+// 16- and 32-bit only: the xHCI registers are dwords, and the Realtek IntrMit is a word.
+BOOLEAN DtimodReadRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize, ULONGLONG* value) {
+    uint32_t readValue = 0;
+    if ((accessSize != sizeof(USHORT) && accessSize != sizeof(ULONG)) || offset > window->Length ||
+        window->Length - offset < accessSize ||
+        !ReadPhys(*static_cast<const ImodDriverContext*>(context), window->PhysicalAddress + offset, accessSize,
+            &readValue, nullptr)) {
+        return FALSE;
+    }
+    *value = readValue;
+    return TRUE;
+}
+
+BOOLEAN DtimodWriteRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize, ULONGLONG value) {
+    if ((accessSize != sizeof(USHORT) && accessSize != sizeof(ULONG)) || offset > window->Length ||
+        window->Length - offset < accessSize) {
+        return FALSE;
+    }
+    return WritePhys(*static_cast<const ImodDriverContext*>(context), window->PhysicalAddress + offset, accessSize,
+               static_cast<uint32_t>(value), nullptr)
+        ? TRUE
+        : FALSE;
+}
+
+IMOD_PLATFORM MakeDtimodPlatform(const ImodDriverContext& ctx) {
+    return IMOD_PLATFORM{
+        const_cast<ImodDriverContext*>(&ctx),
+        DtimodMapWindow,
+        DtimodUnmapWindow,
+        DtimodRead32,
+        DtimodWrite32,
+        DtimodReadRegister,
+        DtimodWriteRegister};
+}
+
+// Apply-engine channel over DTIMOD. Each channel has its own overlapped handle, because the
+// I/O manager serializes requests on a synchronous handle and would undo the worker pool.
+// DTIMOD completes every IOCTL in its dispatch routine, so most requests finish inside
+// DeviceIoControl; those are handed back from a local queue instead of the completion port.
+class DtimodApplyChannel final : public ImodApplyChannel {
+public:
+    DtimodApplyChannel(HANDLE device, HANDLE port, bool batch) : device_(device), port_(port), batch_(batch) {}
+
+    ~DtimodApplyChannel() override {
+        CloseHandle(port_);
+        CloseHandle(device_);
+    }
+
+    void Submit(ImodApplyOp* op) override {
+        auto request = std::make_unique<Request>();
+        request->op = op;
+        DWORD code = IoctlImodApplyBatch;
+        void* buffer = op->buffer.data();
+        DWORD length = static_cast<DWORD>(op->buffer.size());
+        if (op->kind != ImodApplyOpKind::Batch) {
+            code = op->kind == ImodApplyOpKind::Read32 ? IoctlImodReadPhysicalMemory : IoctlImodWritePhysicalMemory;
+            request->access.physAddress = op->address;
+            request->access.accessSizeInBytes = sizeof(uint32_t);
+            request->access.value = op->value;
+            buffer = &request->access;
+            length = sizeof(request->access);
+        } else if (!batch_) {
+            // Reads as the ERROR_INVALID_FUNCTION an older DTIMOD.sys would give, without asking it.
+            Finish(std::move(request), 0, ERROR_INVALID_FUNCTION);
+            return;
+        }
+
+        DWORD bytesReturned = 0;
+        if (DeviceIoControl(device_, code, buffer, length, buffer, length, &bytesReturned, &request->overlapped)) {
+            Finish(std::move(request), bytesReturned, ERROR_SUCCESS);
+            return;
+        }
+
+        const DWORD lastError = GetLastError();
+        if (lastError != ERROR_IO_PENDING) {
+            Finish(std::move(request), 0, lastError);
+            return;
+        }
+        request.release();
+    }
+
+    ImodApplyOp* WaitAny() override {
+        while (finished_.empty()) {
+            DWORD bytesReturned = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED* overlapped = nullptr;
+            const BOOL ok = GetQueuedCompletionStatus(port_, &bytesReturned, &key, &overlapped, INFINITE);
+            if (overlapped != nullptr) {
+                Finish(std::unique_ptr<Request>(CONTAINING_RECORD(overlapped, Request, overlapped)),
+                    bytesReturned, ok ? ERROR_SUCCESS : GetLastError());
+            }
+        }
+
+        ImodApplyOp* op = finished_.front();
+        finished_.pop_front();
+        return op;
+    }
+
+private:
+    struct Request {
+        OVERLAPPED overlapped{};
+        PhysAccessStruct access{};
+        ImodApplyOp* op = nullptr;
+    };
+
+    void Finish(std::unique_ptr<Request> request, DWORD bytesReturned, DWORD error) {
+        ImodApplyOp* op = request->op;
+        const DWORD expected = op->kind == ImodApplyOpKind::Batch
+            ? static_cast<DWORD>(op->buffer.size())
+            : static_cast<DWORD>(sizeof(request->access));
+        op->systemError = error;
+        if (error == ERROR_INVALID_FUNCTION) {
+            op->result = ImodApplyOpResult::Unsupported;
+        } else if (error == ERROR_INVALID_PARAMETER) {
+            op->result = ImodApplyOpResult::Rejected;
+        } else if (error != ERROR_SUCCESS || bytesReturned < expected) {
+            op->result = ImodApplyOpResult::Failed;
+        } else {
+            op->result = ImodApplyOpResult::Success;
+            if (op->kind == ImodApplyOpKind::Read32) {
+                op->value = static_cast<uint32_t>(request->access.value);
+            }
+        }
+        finished_.push_back(op);
+    }
+
+    HANDLE device_;
+    HANDLE port_;
+    bool batch_;
+    std::deque<ImodApplyOp*> finished_;
+};
+
+class DtimodApplyBackend final : public ImodApplyBackend {
+public:
+    explicit DtimodApplyBackend(const ImodDriverContext& ctx) : batch_(DriverHandles(ctx, IoctlImodApplyBatch)) {}
+
+    std::unique_ptr<ImodApplyChannel> OpenChannel() override {
+        HANDLE device = CreateFileW(
+            kImodDriverDevicePath,
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+            nullptr);
+        if (device == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        HANDLE port = CreateIoCompletionPort(device, nullptr, 0, 1);
+        if (port == nullptr || !SetFileCompletionNotificationModes(device, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)) {
+            if (port != nullptr) {
+                CloseHandle(port);
+            }
+            CloseHandle(device);
+            return nullptr;
+        }
+        return std::make_unique<DtimodApplyChannel>(device, port, batch_);
+    }
+
+private:
+    bool batch_;
+};
+
+std::wstring DescribeApplyError(const ImodApplyReport& report) {
+    return report.systemError != ERROR_SUCCESS ? GetLastErrorMessage(report.systemError) : L"short driver response";
+}
+
+void CountImodStatus(uint32_t status, ImodApplyCounts* counts) {
+    switch (status) {
+    case IMOD_BATCH_STATUS_VERIFIED:
+        ++counts->verified;
+        [[fallthrough]];
+    case IMOD_BATCH_STATUS_WRITTEN:
+        ++counts->written;
+        break;
+    case IMOD_BATCH_STATUS_UNCHANGED:
+    case IMOD_BATCH_STATUS_INACTIVE:
+        ++counts->skipped;
+        break;
+    default:
+        ++counts->failures;
+        break;
+    }
+}
+
+const wchar_t* ImodStatusName(uint32_t status) {
+    switch (status) {
+    case IMOD_BATCH_STATUS_WRITTEN: return L"written";
+    case IMOD_BATCH_STATUS_OUT_OF_WINDOW: return L"out of window";
+    case IMOD_BATCH_STATUS_READ_FAILED: return L"read failed";
+    case IMOD_BATCH_STATUS_WRITE_FAILED: return L"write failed";
+    case IMOD_BATCH_STATUS_UNCHANGED: return L"unchanged";
+    case IMOD_BATCH_STATUS_INACTIVE: return L"inactive";
+    case IMOD_BATCH_STATUS_VERIFY_FAILED: return L"verify failed";
+    case IMOD_BATCH_STATUS_VERIFIED: return L"verified";
+    default: return L"unknown";
+    }
+}
+
+std::vector<BYTE> BuildBootTable(const std::vector<BootTableController>& controllers) {
+    tagImodBootTableHeader header{};
+    header.magic = IMOD_BOOT_TABLE_MAGIC;
+    header.version = IMOD_BOOT_TABLE_VERSION;
+    header.headerSize = sizeof(header);
+    header.controllerCount = static_cast<ULONG>(controllers.size());
+
+    // Vectors go into the shared interval pool; at boot the interrupters past a vector get
+    // the controller's scalar interval.
+    std::vector<ULONG> pool;
+    for (const auto& controller : controllers) {
+        pool.insert(pool.end(), controller.intervals.begin(), controller.intervals.end());
+    }
+    header.intervalCount = static_cast<ULONG>(pool.size());
+
+    const size_t recordsSize = controllers.size() * sizeof(tagImodBootTableController);
+    std::vector<BYTE> table(sizeof(header) + recordsSize + (pool.size() * sizeof(ULONG)));
+    auto* records = reinterpret_cast<tagImodBootTableController*>(table.data() + sizeof(header));
+    if (!pool.empty()) {
+        std::memcpy(table.data() + sizeof(header) + recordsSize, pool.data(), pool.size() * sizeof(ULONG));
+    }
+    ULONG firstInterval = 0;
+    for (size_t i = 0; i < controllers.size(); ++i) {
+        tagImodBootTableController record{};
+        record.capabilityAddress = controllers[i].capabilityAddress;
+        record.barLength = controllers[i].barLength;
+        record.hcsparamsOffset = controllers[i].hcsparamsOffset;
+        record.rtsoffOffset = controllers[i].rtsoff;
+        record.hcsparamsSignature = controllers[i].hcsparamsSignature;
+        record.defaultInterval = controllers[i].interval & IMOD_XHCI_IMODI_MASK;
+        record.firstInterval = firstInterval;
+        record.intervalCount = static_cast<ULONG>(controllers[i].intervals.size());
+        firstInterval += record.intervalCount;
+        std::memcpy(&records[i], &record, sizeof(record));
+    }
+
+    header.checksum = ImodBootTableChecksum(table.data() + sizeof(header), static_cast<ULONG>(table.size() - sizeof(header)));
+    std::memcpy(table.data(), &header, sizeof(header));
+    return table;
+}
+
+std::wstring GetImodDriverParametersKey() {
+    return std::wstring(L"SYSTEM\\CurrentControlSet\\Services\\") + kImodDriverServiceName + L"\\Parameters";
+}
+
+bool SetImodDriverServiceStartType(DWORD startType, std::wstring* error) {
+    SC_HANDLE scm = OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ALL_ACCESS);
+    if (!scm) {
+        if (error) {
+            *error = L"failed to open service manager: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    SC_HANDLE service = OpenServiceW(scm, kImodDriverServiceName, SERVICE_CHANGE_CONFIG);
+    if (!service) {
+        const DWORD lastError = GetLastError();
+        CloseServiceHandle(scm);
+        if (error) {
+            *error = L"failed to open IMOD driver service: " + GetLastErrorMessage(lastError);
+        }
+        return false;
+    }
+
+    const BOOL changed = ChangeServiceConfigW(
+        service, SERVICE_NO_CHANGE, startType, SERVICE_NO_CHANGE,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+    const DWORD lastError = GetLastError();
+    CloseServiceHandle(service);
+    CloseServiceHandle(scm);
+    if (!changed) {
+        if (error) {
+            *error = L"failed to change IMOD driver service start type: " + GetLastErrorMessage(lastError);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+// Stores the table where DTIMOD reads it on start and switches the service to auto start,
+// so the intervals are programmed by the driver before anyone logs on.
+bool InstallBootTable(ImodDriverContext& ctx, const std::vector<BYTE>& table, std::wstring* error) {
+    HKEY key = nullptr;
+    LSTATUS status = RegCreateKeyExW(
+        HKEY_LOCAL_MACHINE, GetImodDriverParametersKey().c_str(), 0, nullptr, 0, KEY_SET_VALUE, nullptr, &key, nullptr);
+    if (status != ERROR_SUCCESS) {
+        if (error) {
+            *error = L"failed to open IMOD driver parameters: " + GetLastErrorMessage(status);
+        }
+        return false;
+    }
+
+    status = RegSetValueExW(key, IMOD_BOOT_TABLE_VALUE_NAME, 0, REG_BINARY, table.data(), static_cast<DWORD>(table.size()));
+    RegCloseKey(key);
+    if (status != ERROR_SUCCESS) {
+        if (error) {
+            *error = L"failed to write boot table: " + GetLastErrorMessage(status);
+        }
+        return false;
+    }
+
+    if (!SetImodDriverServiceStartType(SERVICE_AUTO_START, error)) {
+        return false;
+    }
+
+    ctx.keepService = true;
+    return true;
+}
+
+// DTIMOD re-arms its watchdog from the boot table with this period; 0 leaves it off.
+bool SetBootWatchdogPeriod(uint32_t periodMs, std::wstring* error) {
+    HKEY key = nullptr;
+    LSTATUS status = RegCreateKeyExW(
+        HKEY_LOCAL_MACHINE, GetImodDriverParametersKey().c_str(), 0, nullptr, 0, KEY_SET_VALUE, nullptr, &key, nullptr);
+    if (status != ERROR_SUCCESS) {
+        if (error) {
+            *error = L"failed to open IMOD driver parameters: " + GetLastErrorMessage(status);
+        }
+        return false;
+    }
+
+    const DWORD value = periodMs;
+    status = RegSetValueExW(key, IMOD_BOOT_WATCHDOG_VALUE_NAME, 0, REG_DWORD,
+        reinterpret_cast<const BYTE*>(&value), sizeof(value));
+    RegCloseKey(key);
+    if (status != ERROR_SUCCESS) {
+        if (error) {
+            *error = L"failed to write boot watchdog period: " + GetLastErrorMessage(status);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool ClearBootTable(std::wstring* error) {
+    const LSTATUS status = RegDeleteKeyValueW(HKEY_LOCAL_MACHINE, GetImodDriverParametersKey().c_str(), IMOD_BOOT_TABLE_VALUE_NAME);
+    if (status != ERROR_SUCCESS && status != ERROR_FILE_NOT_FOUND) {
+        if (error) {
+            *error = L"failed to delete boot table: " + GetLastErrorMessage(status);
+        }
+        return false;
+    }
+
+    const LSTATUS periodStatus = RegDeleteKeyValueW(
+        HKEY_LOCAL_MACHINE, GetImodDriverParametersKey().c_str(), IMOD_BOOT_WATCHDOG_VALUE_NAME);
+    if (periodStatus != ERROR_SUCCESS && periodStatus != ERROR_FILE_NOT_FOUND) {
+        if (error) {
+            *error = L"failed to delete boot watchdog period: " + GetLastErrorMessage(periodStatus);
+        }
+        return false;
+    }
+
+    return SetImodDriverServiceStartType(SERVICE_DEMAND_START, error);
+}
+
+const wchar_t* BootControllerStateName(ULONG state) {
+    switch (state) {
+    case IMOD_BOOT_CONTROLLER_PENDING:
+        return L"pending";
+    case IMOD_BOOT_CONTROLLER_APPLIED:
+        return L"applied";
+    case IMOD_BOOT_CONTROLLER_MISMATCH:
+        return L"signature mismatch";
+    case IMOD_BOOT_CONTROLLER_FAILED:
+        return L"failed";
+    default:
+        return L"unknown";
+    }
+}
+
+bool PrintBootStatus(const ImodDriverContext& ctx, std::wstring* error) {
+    if (!DriverHandles(ctx, IoctlImodQueryBootStatus)) {
+        if (error) {
+            *error = L"loaded DTIMOD.sys has no boot table support";
+        }
+        return false;
+    }
+
+    std::vector<BYTE> buffer(sizeof(tagImodBootStatusHeader) +
+        (IMOD_BOOT_MAX_CONTROLLERS * sizeof(tagImodBootControllerStatus)));
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodQueryBootStatus,
+            nullptr, 0,
+            buffer.data(), static_cast<DWORD>(buffer.size()),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to query boot status: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    if (bytesReturned < sizeof(tagImodBootStatusHeader)) {
+        if (error) {
+            *error = L"failed to query boot status: short driver response";
+        }
+        return false;
+    }
+
+    tagImodBootStatusHeader header{};
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    switch (header.tableState) {
+    case IMOD_BOOT_TABLE_LOADED:
+        std::wcout << L"boot_table = loaded, passes = " << header.applyPasses
+                   << L", pending = " << header.pendingCount << std::endl;
+        break;
+    case IMOD_BOOT_TABLE_REJECTED:
+        std::wcout << L"boot_table = rejected (result " << header.tableResult << L")" << std::endl;
+        break;
+    default:
+        std::wcout << L"boot_table = none" << std::endl;
+        break;
+    }
+
+    const size_t shown = std::min<size_t>(header.controllerCount,
+        (bytesReturned - sizeof(header)) / sizeof(tagImodBootControllerStatus));
+    for (size_t i = 0; i < shown; ++i) {
+        tagImodBootControllerStatus status{};
+        std::memcpy(&status, buffer.data() + sizeof(header) + (i * sizeof(status)), sizeof(status));
+        std::wcout << L"  base_address = " << ToHex(status.capabilityAddress)
+                   << L", state = " << BootControllerStateName(status.state)
+                   << L", hcsparams = " << ToHex(status.hcsparams)
+                   << L", writes = " << status.written
+                   << L", failures = " << status.failed
+                   << L", attempts = " << status.attempts << std::endl;
+    }
+
+    return true;
+}
+
+// Hands the IMOD and NIC ITR registers just programmed to the driver's drift watchdog.
+// Controllers take group ids from 0 and adapters follow them. Empty lists disarm it.
+// While armed, DTIMOD stays loaded after IMOD.exe exits.
+bool ConfigureWatchdog(ImodDriverContext& ctx, uint32_t periodMs,
+    const std::vector<WatchdogController>& controllers, const std::vector<WatchdogNic>& adapters,
+    std::wstring* error) {
+    if (!DriverHandles(ctx, IoctlImodConfigureWatchdog)) {
+        if (error) {
+            *error = L"loaded DTIMOD.sys has no watchdog";
+        }
+        return false;
+    }
+    if (controllers.size() + adapters.size() > IMOD_WATCHDOG_MAX_GROUPS) {
+        if (error) {
+            *error = L"watchdog supports at most " + std::to_wstring(IMOD_WATCHDOG_MAX_GROUPS)
+                + L" controllers and adapters";
+        }
+        return false;
+    }
+
+    std::vector<tagImodWatchdogEntry> entries;
+    for (size_t i = 0; i < controllers.size(); ++i) {
+        for (uint32_t interrupter = 0; interrupter < controllers[i].maxIntrs; ++interrupter) {
+            tagImodWatchdogEntry entry{};
+            entry.address = controllers[i].runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(interrupter) + IMOD_XHCI_IMOD_OFFSET;
+            entry.groupId = static_cast<ULONG>(i);
+            entry.mask = IMOD_XHCI_IMODI_MASK;
+            entry.value = (interrupter < controllers[i].intervals.size()
+                ? controllers[i].intervals[interrupter]
+                : controllers[i].interval) & IMOD_XHCI_IMODI_MASK;
+            entry.accessSize = sizeof(ULONG);
+            entries.push_back(entry);
+        }
+    }
+
+    for (size_t i = 0; i < adapters.size(); ++i) {
+        const size_t first = entries.size();
+        entries.resize(first + adapters[i].profile.MaxQueues);
+        entries.resize(first + ImodNicWatchdogEntries(adapters[i].barAddress, &adapters[i].profile,
+            &adapters[i].apply, static_cast<ULONG>(controllers.size() + i), entries.data() + first));
+    }
+
+    if (entries.size() > IMOD_WATCHDOG_MAX_ENTRIES) {
+        if (error) {
+            *error = L"watchdog supports at most " + std::to_wstring(IMOD_WATCHDOG_MAX_ENTRIES) + L" registers";
+        }
+        return false;
+    }
+
+    tagImodWatchdogConfigHeader header{};
+    header.version = IMOD_WATCHDOG_VERSION;
+    header.periodMs = periodMs;
+    header.entryCount = static_cast<ULONG>(entries.size());
+
+    std::vector<BYTE> buffer(sizeof(header) + (entries.size() * sizeof(tagImodWatchdogEntry)));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(buffer.data() + sizeof(header), entries.data(), entries.size() * sizeof(tagImodWatchdogEntry));
+    }
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodConfigureWatchdog,
+            buffer.data(), static_cast<DWORD>(buffer.size()),
+            nullptr, 0,
+            &bytesReturned,
+            nullptr)) {
+        const DWORD lastError = GetLastError();
+        if (error) {
+            *error = lastError == ERROR_INVALID_FUNCTION
+                ? L"loaded DTIMOD.sys has no register watchdog"
+                : L"failed to configure watchdog: " + GetLastErrorMessage(lastError);
+        }
+        return false;
+    }
+
+    ctx.keepLoaded = !entries.empty();
+    ctx.keepService = ctx.keepService || ctx.keepLoaded;
+    return true;
+}
+
+bool PrintWatchdogStatus(const ImodDriverContext& ctx, std::wstring* error) {
+    if (!DriverHandles(ctx, IoctlImodQueryWatchdog)) {
+        if (error) {
+            *error = L"loaded DTIMOD.sys has no watchdog";
+        }
+        return false;
+    }
+
+    std::vector<BYTE> buffer(sizeof(tagImodWatchdogStatusHeader) +
+        (IMOD_WATCHDOG_MAX_GROUPS * sizeof(tagImodWatchdogGroupStatus)));
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(
+            ctx.driverHandle,
+            IoctlImodQueryWatchdog,
+            nullptr, 0,
+            buffer.data(), static_cast<DWORD>(buffer.size()),
+            &bytesReturned,
+            nullptr)) {
+        if (error) {
+            *error = L"failed to query watchdog: " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    if (bytesReturned < sizeof(tagImodWatchdogStatusHeader)) {
+        if (error) {
+            *error = L"failed to query watchdog: short driver response";
+        }
+        return false;
+    }
+
+    tagImodWatchdogStatusHeader header{};
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.armed == 0) {
+        std::wcout << L"watchdog = off" << std::endl;
+        return true;
+    }
+
+    std::wcout << L"watchdog = armed, period_ms = " << header.periodMs
+               << L", registers = " << header.entryCount
+               << L", passes = " << header.passes << std::endl;
+
+    const size_t shown = std::min<size_t>(header.groupCount,
+        (bytesReturned - sizeof(header)) / sizeof(tagImodWatchdogGroupStatus));
+    for (size_t i = 0; i < shown; ++i) {
+        tagImodWatchdogGroupStatus group{};
+        std::memcpy(&group, buffer.data() + sizeof(header) + (i * sizeof(group)), sizeof(group));
+        std::wcout << L"  group = " << group.groupId
+                   << L", registers = " << group.entryCount
+                   << L", drift_events = " << group.driftEvents
+                   << L", rewrites = " << group.rewrites
+                   << L", write_failures = " << group.writeFailures
+                   << L", unavailable = " << group.unavailable << std::endl;
+    }
+
+    return true;
+}
+
+std::wstring FormatHundredths(uint64_t value) {
+    std::wostringstream out;
+    out << (value / 100) << L"." << ((value % 100) < 10 ? L"0" : L"") << (value % 100);
+    return out.str();
+}
+
+uint64_t QueryMicroseconds() {
+    static const LONGLONG frequency = [] {
+        LARGE_INTEGER value{};
+        QueryPerformanceFrequency(&value);
+        return value.QuadPart;
+    }();
+
+    LARGE_INTEGER counter{};
+    QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>((counter.QuadPart / frequency) * 1000000LL +
+        ((counter.QuadPart % frequency) * 1000000LL) / frequency);
+}
+
+// Reads ERDP of every interrupter with an event ring at a fixed rate and prints one CSV row
+// per interrupter and tick, then a per-interrupter summary. Nothing is written.
+// Interrupters the host driver never gave an event ring are left out.
+std::vector<SamplerInterrupter> FindSampledInterrupters(const IMOD_PLATFORM& platform,
+    const std::vector<SamplerController>& controllers) {
+    std::vector<SamplerInterrupter> interrupters;
+    for (size_t c = 0; c < controllers.size(); ++c) {
+        for (uint32_t i = 0; i < controllers[c].maxIntrs; ++i) {
+            SamplerInterrupter target{};
+            target.controller = c;
+            target.interrupter = i;
+            if (ImodSamplerReadEventRing(&platform, controllers[c].runtimeAddress, i, &target.ring) == IMOD_RESULT_SUCCESS) {
+                interrupters.push_back(target);
+            }
+        }
+    }
+    return interrupters;
+}
+
+int RunEventRingSampler(const ImodDriverContext& ctx, const std::vector<SamplerController>& controllers,
+    uint32_t periodMs, uint32_t sampleCount) {
+    const IMOD_PLATFORM platform = MakeDtimodPlatform(ctx);
+    std::vector<SamplerInterrupter> interrupters = FindSampledInterrupters(platform, controllers);
+
+    if (interrupters.empty()) {
+        std::wcout << L"error: no interrupter has an event ring to sample" << std::endl;
+        return 1;
+    }
+
+    std::wcout << L"sample_period_ms = " << periodMs << L", samples = " << sampleCount
+               << L", interrupters = " << interrupters.size() << std::endl;
+    std::wcout << L"time_ms,controller,interrupter,events,events_per_s,dequeue_updates,"
+                  L"events_per_update,events_per_irq_min,pending,imodi" << std::endl;
+
+    const uint64_t startUs = QueryMicroseconds();
+    for (uint32_t tick = 0; tick <= sampleCount; ++tick) {
+        const uint64_t deadlineUs = startUs + (static_cast<uint64_t>(tick) * periodMs * 1000ULL);
+        const uint64_t nowUs = QueryMicroseconds();
+        if (deadlineUs > nowUs) {
+            Sleep(static_cast<DWORD>((deadlineUs - nowUs) / 1000ULL));
+        }
+
+        for (auto& target : interrupters) {
+            IMOD_INTERRUPTER_SAMPLE sample{};
+            const ULONG result = ImodSamplerReadInterrupter(&platform, controllers[target.controller].runtimeAddress,
+                target.interrupter, &target.ring, IMOD_SAMPLER_DEFAULT_SCAN, QueryMicroseconds(), &sample);
+            if (result == IMOD_RESULT_INVALID_CONTROLLER) {
+                // Controller reset or power transition: pick up the new ring and start over.
+                target.rate.HasPrevious = FALSE;
+                (void)ImodSamplerReadEventRing(&platform, controllers[target.controller].runtimeAddress,
+                    target.interrupter, &target.ring);
+                continue;
+            }
+            if (result != IMOD_RESULT_SUCCESS) {
+                continue;
+            }
+
+            const bool baseline = !target.rate.HasPrevious;
+            ImodSamplerAccumulate(&target.rate, &target.ring, &sample);
+            if (baseline) {
+                continue;
+            }
+
+            std::wcout << ((sample.TimeUs - startUs) / 1000ULL) << L"," << target.controller << L","
+                       << target.interrupter << L"," << target.rate.LastEvents << L","
+                       << target.rate.EventsPerSecond << L"," << target.rate.DequeueUpdates << L","
+                       << FormatHundredths(target.rate.EventsPerUpdateX100) << L","
+                       << FormatHundredths(target.rate.EventsPerInterruptMinX100) << L",";
+            if (sample.Pending != IMOD_SAMPLER_PENDING_UNKNOWN) {
+                std::wcout << sample.Pending;
+            }
+            std::wcout << L"," << ToHex(sample.Imod & IMOD_XHCI_IMODI_MASK) << std::endl;
+        }
+    }
+
+    std::wcout << std::endl;
+    for (const auto& target : interrupters) {
+        const uint64_t average = target.rate.ElapsedUs != 0
+            ? (target.rate.TotalEvents * 1000000ULL) / target.rate.ElapsedUs
+            : 0;
+        std::wcout << L"controller = " << target.controller << L", interrupter = " << target.interrupter
+                   << L", ring_trbs = " << target.ring.TrbCount
+                   << L", events = " << target.rate.TotalEvents
+                   << L", avg_events_per_s = " << average
+                   << L", peak_events_per_s = " << target.rate.PeakEventsPerSecond
+                   << L", events_per_update = " << FormatHundredths(target.rate.EventsPerUpdateX100)
+                   << L", peak_pending = " << target.rate.PeakPending << std::endl;
+    }
+
+    return 0;
+}
+
+// The configured interval is the governor's floor; the latency ceiling is converted from
+// microseconds to 250 ns IMODI units and never drops below that floor.
+IMOD_GOVERNOR_LIMITS MakeGovernorLimits(const Config& config, uint32_t interval, uint32_t maxLatencyUs, uint32_t irqBudget) {
+    IMOD_GOVERNOR_LIMITS limits{};
+    limits.MinInterval = interval & IMOD_XHCI_IMODI_MASK;
+    limits.MaxInterval = static_cast<ULONG>(std::min<uint64_t>(static_cast<uint64_t>(maxLatencyUs) * 4, IMOD_XHCI_IMODI_MASK));
+    limits.MaxInterval = std::max(limits.MaxInterval, limits.MinInterval);
+    limits.IrqBudget = irqBudget;
+    limits.HysteresisPercent = config.governorHysteresis;
+    limits.HoldTicks = config.governorHoldTicks;
+    return limits;
+}
+
+const wchar_t* GovernorReasonName(ULONG reason) {
+    switch (reason) {
+    case IMOD_GOVERNOR_REASON_OVER_BUDGET:
+        return L"over irq budget";
+    case IMOD_GOVERNOR_REASON_UNDER_BUDGET:
+        return L"under irq budget";
+    case IMOD_GOVERNOR_REASON_LATENCY_CEILING:
+        return L"over irq budget, held at latency ceiling";
+    case IMOD_GOVERNOR_REASON_LIMITS_CHANGED:
+        return L"outside limits";
+    default:
+        return L"none";
+    }
+}
+
+bool WriteGovernedInterval(const IMOD_PLATFORM& platform, uint64_t runtimeAddress, uint32_t interrupter, uint32_t interval) {
+    IMOD_REGISTER_WINDOW window{};
+    ULONG currentValue = 0;
+    if (!platform.MapWindow(platform.Context, runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(interrupter),
+            IMOD_XHCI_INTERRUPTER_STRIDE, &window)) {
+        return false;
+    }
+
+    const bool written = platform.Read32(platform.Context, &window, IMOD_XHCI_IMOD_OFFSET, &currentValue) &&
+        currentValue != 0xFFFFFFFFU &&
+        platform.Write32(platform.Context, &window, IMOD_XHCI_IMOD_OFFSET,
+            (currentValue & IMOD_XHCI_IMODC_MASK) | (interval & IMOD_XHCI_IMODI_MASK));
+    platform.UnmapWindow(platform.Context, &window);
+    return written;
+}
+
+BOOL WINAPI GovernorConsoleHandler(DWORD controlType) {
+    if (controlType == CTRL_C_EVENT || controlType == CTRL_BREAK_EVENT || controlType == CTRL_CLOSE_EVENT) {
+        governorStopRequested = true;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Closed loop on top of the event ring sampler: every period each interrupter's event rate
+// goes through the portable control law and IMODI is rewritten when it decides to move.
+// Runs until Ctrl+C, then puts every interrupter back on its configured floor.
+int RunImodGovernor(const ImodDriverContext& ctx, const std::vector<GovernorController>& controllers, uint32_t periodMs) {
+    const IMOD_PLATFORM platform = MakeDtimodPlatform(ctx);
+    std::vector<SamplerController> sampled;
+    for (const auto& controller : controllers) {
+        sampled.push_back({controller.runtimeAddress, controller.maxIntrs});
+    }
+
+    std::vector<GovernorInterrupter> interrupters;
+    for (const auto& target : FindSampledInterrupters(platform, sampled)) {
+        interrupters.push_back({target, {}});
+    }
+
+    if (interrupters.empty()) {
+        std::wcout << L"error: no interrupter has an event ring to govern" << std::endl;
+        return 1;
+    }
+
+    SetConsoleCtrlHandler(GovernorConsoleHandler, TRUE);
+    std::wcout << L"governor = running, period_ms = " << periodMs << L", interrupters = " << interrupters.size()
+               << L" (Ctrl+C to stop)" << std::endl;
+
+    const uint64_t startUs = QueryMicroseconds();
+    while (!governorStopRequested) {
+        for (auto& target : interrupters) {
+            const GovernorController& controller = controllers[target.sampled.controller];
+            IMOD_INTERRUPTER_SAMPLE sample{};
+            const ULONG result = ImodSamplerReadInterrupter(&platform, controller.runtimeAddress,
+                target.sampled.interrupter, &target.sampled.ring, 0, QueryMicroseconds(), &sample);
+            if (result == IMOD_RESULT_INVALID_CONTROLLER) {
+                target.sampled.rate.HasPrevious = FALSE;
+                (void)ImodSamplerReadEventRing(&platform, controller.runtimeAddress,
+                    target.sampled.interrupter, &target.sampled.ring);
+                continue;
+            }
+            if (result != IMOD_RESULT_SUCCESS) {
+                continue;
+            }
+
+            const bool baseline = !target.sampled.rate.HasPrevious;
+            ImodSamplerAccumulate(&target.sampled.rate, &target.sampled.ring, &sample);
+            if (baseline) {
+                // Start from what the register holds, which also covers a controller reset.
+                ImodGovernorInitialize(&target.channel, sample.Imod);
+                continue;
+            }
+
+            IMOD_GOVERNOR_DECISION decision{};
+            if (!ImodGovernorStep(&controller.limits, &target.channel, target.sampled.rate.EventsPerSecond, &decision)) {
+                continue;
+            }
+
+            const bool written = WriteGovernedInterval(platform, controller.runtimeAddress,
+                target.sampled.interrupter, decision.Interval);
+            std::wcout << L"governor: t_ms = " << ((sample.TimeUs - startUs) / 1000ULL)
+                       << L", controller = " << target.sampled.controller
+                       << L", interrupter = " << target.sampled.interrupter
+                       << L", imodi = " << ToHex(decision.PreviousInterval) << L" -> " << ToHex(decision.Interval)
+                       << L", events_per_s = " << decision.SmoothedEventsPerSecond
+                       << L", budget = " << controller.limits.IrqBudget
+                       << L", reason = " << GovernorReasonName(decision.Reason);
+            if (!written) {
+                std::wcout << L", error: write failed";
+                target.channel.Interval = decision.PreviousInterval;
+            }
+            std::wcout << std::endl;
+        }
+
+        Sleep(periodMs);
+    }
+
+    std::wcout << std::endl;
+    for (const auto& target : interrupters) {
+        const GovernorController& controller = controllers[target.sampled.controller];
+        const uint32_t floor = controller.limits.MinInterval & IMOD_XHCI_IMODI_MASK;
+        const bool restored = target.channel.Interval == floor ||
+            WriteGovernedInterval(platform, controller.runtimeAddress, target.sampled.interrupter, floor);
+        std::wcout << L"controller = " << target.sampled.controller << L", interrupter = " << target.sampled.interrupter
+                   << L", adjustments = " << target.channel.Adjustments
+                   << L", restored = " << (restored ? ToHex(floor) : std::wstring(L"failed")) << std::endl;
+    }
+
+    SetConsoleCtrlHandler(GovernorConsoleHandler, FALSE);
+    return 0;
+}
+
+// Everything up to the first register access: what the config gives each controller, printed
+// into its plan, and the engine job when it gets one. Shared by the one-shot run and --watch.
+void PlanControllers(const ImodDriverContext& ctx, const Config& config, const std::vector<PciDeviceInfo>& controllers,
+    uint32_t applyFlags, bool layoutOnly, std::vector<ControllerPlan>* plans, std::vector<ImodApplyJob>* jobs) {
+    std::optional<std::vector<RoleDevice>> roleDevices;
+    for (const auto& controller : controllers) {
+        if (controller.problemCode == CM_PROB_DISABLED) {
+            continue;
+        }
+
+        ControllerPlan& plan = plans->emplace_back();
+        plan.deviceId = controller.deviceId;
+        std::wostringstream out;
+        out << controller.caption << L" - " << controller.deviceId << std::endl;
+        if (controller.problemCode != 0) {
+            out << L"  problem_code = " << controller.problemCode << std::endl;
+        }
+
+        if (!controller.hasBase) {
+            if (!controller.baseError.empty()) {
+                out << L"  base_address = error: " << controller.baseError << std::endl << std::endl;
+            } else {
+                out << L"  base_address = error: could not obtain base address" << std::endl << std::endl;
+            }
+            plan.header = out.str();
+            continue;
+        }
+
+        uint32_t desiredInterval = config.globalInterval;
+        std::vector<uint32_t> desiredIntervals;
+        const ControllerOverride* adaptiveEntry = nullptr;
+        uint32_t hcsparamsOffset = config.globalHcsparamsOffset;
+        uint32_t rtsoff = config.globalRtsoff;
+        uint32_t governorMaxLatencyUs = config.governorMaxLatencyUs;
+        uint32_t governorIrqBudget = config.governorIrqBudget;
+        bool enabled = config.usbEnabled;
+        std::wstring overrideMatch;
+
+        for (const auto& entry : config.overrides) {
+            if (ContainsInsensitive(controller.deviceId, entry.hwid)) {
+                if (entry.enabled) {
+                    enabled = *entry.enabled;
+                }
+                if (entry.interval) {
+                    desiredInterval = *entry.interval;
+                    desiredIntervals.clear();
+                }
+                if (!entry.intervals.empty()) {
+                    desiredIntervals = entry.intervals;
+                }
+                if (entry.adaptiveRoleBinding == false) {
+                    adaptiveEntry = nullptr;
+                } else if (!entry.roleIntervals.empty()) {
+                    adaptiveEntry = &entry;
+                }
+                if (entry.hcsparamsOffset) {
+                    hcsparamsOffset = *entry.hcsparamsOffset;
+                }
+                if (entry.rtsoff) {
+                    rtsoff = *entry.rtsoff;
+                }
+                if (entry.governorMaxLatencyUs) {
+                    governorMaxLatencyUs = *entry.governorMaxLatencyUs;
+                }
+                if (entry.governorIrqBudget) {
+                    governorIrqBudget = *entry.governorIrqBudget;
+                }
+                overrideMatch = entry.hwid;
+            }
+        }
+
+        const uint64_t capabilityAddress = controller.baseAddress;
+        out << L"  base_address = " << ToHex(capabilityAddress) << std::endl;
+        out << L"  interval = " << ToHex(desiredInterval);
+        if (!overrideMatch.empty()) {
+            out << L" (override: " << overrideMatch << L")";
+        }
+        out << std::endl;
+        if (!desiredIntervals.empty()) {
+            out << L"  intervals = vector=" << desiredIntervals.size() << std::endl;
+        }
+        out << L"  hcsparams_offset = " << ToHex(hcsparamsOffset)
+            << L", rtsoff = " << ToHex(rtsoff) << std::endl;
+
+        if (!enabled) {
+            if (!overrideMatch.empty()) {
+                out << L"  skipped (disabled by config: " << overrideMatch << L")" << std::endl << std::endl;
+            } else {
+                out << L"  skipped (disabled by config)" << std::endl << std::endl;
+            }
+            plan.header = out.str();
+            continue;
+        }
+
+        plan.job = jobs->size();
+        plan.capabilityAddress = capabilityAddress;
+        plan.barLength = controller.baseLength;
+        plan.hcsparamsOffset = hcsparamsOffset;
+        plan.rtsoff = rtsoff;
+        plan.interval = desiredInterval;
+        plan.intervals = std::move(desiredIntervals);
+        plan.governorMaxLatencyUs = governorMaxLatencyUs;
+        plan.governorIrqBudget = governorIrqBudget;
+
+        // Role intervals become a vector here, from the controller's current slot topology.
+        // On failure the controller is applied as if no roles were configured.
+        if (adaptiveEntry != nullptr && !layoutOnly) {
+            std::vector<RootPortRoles> bindings = adaptiveEntry->rootPortRoles;
+            const std::vector<RouteRoles>& routeBindings = adaptiveEntry->routeRoles;
+            const wchar_t* source = L"config";
+            if (bindings.empty() && routeBindings.empty()) {
+                if (!roleDevices) {
+                    roleDevices = EnumerateRoleDevices();
+                }
+                bindings = DiscoverRootPortRoles(controller.devInst, *roleDevices, adaptiveEntry->roleIntervals);
+                source = L"discovered";
+            }
+
+            out << L"  root_port_roles = " << (bindings.empty() ? L"none" : FormatRootPortRoles(bindings))
+                << L" (" << source << L")" << std::endl;
+            if (!routeBindings.empty()) {
+                out << L"  route_roles = " << FormatRouteRoles(routeBindings) << L" (config)" << std::endl;
+            }
+            std::vector<uint32_t> adaptiveIntervals;
+            std::wstring adaptiveDetail = L"no role device below this controller";
+            if ((!bindings.empty() || !routeBindings.empty()) &&
+                BuildAdaptiveIntervals(ctx, plan, adaptiveEntry->roleIntervals, bindings, routeBindings,
+                    &adaptiveIntervals, &adaptiveDetail)) {
+                plan.intervals = std::move(adaptiveIntervals);
+                out << L"  adaptive = " << adaptiveDetail << std::endl;
+            } else {
+                out << L"  adaptive = fallback: " << adaptiveDetail << std::endl;
+            }
+        }
+        plan.header = out.str();
+
+        ImodApplyJob& job = jobs->emplace_back();
+        job.capabilityAddress = capabilityAddress;
+        job.barLength = controller.baseLength;
+        job.hcsparamsOffset = hcsparamsOffset;
+        job.rtsoffOffset = rtsoff;
+        job.interval = desiredInterval;
+        job.intervals = plan.intervals;
+        job.flags = applyFlags;
+        job.layoutOnly = layoutOnly;
+    }
+}
+
+// "\\?\PCI#VEN_8086&DEV_A36D&...#3&11583659&0&A0#{3abf6f2d-...}" -> "PCI\VEN_8086&DEV_A36D&...\3&11583659&0&A0",
+// the instance id EnumerateXhciControllers reports for the same controller.
+std::wstring InterfaceToInstanceId(const std::wstring& symbolicLink) {
+    std::wstring id = symbolicLink;
+    if (StartsWithInsensitive(id, L"\\\\?\\")) {
+        id.erase(0, 4);
+    }
+    const size_t classPos = id.rfind(L"#{");
+    if (classPos != std::wstring::npos) {
+        id.erase(classPos);
+    }
+    std::replace(id.begin(), id.end(), L'#', L'\\');
+    return id;
+}
+
+uint64_t GetFileWriteTime(const std::wstring& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        return 0;
+    }
+    return (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+// Events for --watch: host controller interfaces coming and going, resume from sleep, writes
+// to the config file and Ctrl+C. Notifications arrive on system threads and are queued here
+// for the watch loop.
+class WindowsWatchSource final : public ImodWatchSource {
+public:
+    ~WindowsWatchSource() override {
+        Close();
+    }
+
+    bool Open(const std::wstring& configPath, std::wstring* error) {
+        CM_NOTIFY_FILTER filter{};
+        filter.cbSize = sizeof(filter);
+        filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+        filter.u.DeviceInterface.ClassGuid = kUsbHostControllerInterface;
+        const CONFIGRET cr = CM_Register_Notification(&filter, this, OnDeviceInterface, &deviceNotify_);
+        if (cr != CR_SUCCESS) {
+            deviceNotify_ = nullptr;
+            *error = L"failed to register for USB host controller notifications: CONFIGRET " + std::to_wstring(cr);
+            return false;
+        }
+
+        power_.Callback = OnPower;
+        power_.Context = this;
+        const DWORD powerError = PowerRegisterSuspendResumeNotification(DEVICE_NOTIFY_CALLBACK, &power_, &powerNotify_);
+        if (powerError != ERROR_SUCCESS) {
+            powerNotify_ = nullptr;
+            *error = L"failed to register for resume notifications: " + GetLastErrorMessage(powerError);
+            return false;
+        }
+
+        if (configPath.empty()) {
+            return true;
+        }
+
+        configPath_ = configPath;
+        configWriteTime_ = GetFileWriteTime(configPath_);
+        configChange_ = FindFirstChangeNotificationW(ParentPath(configPath_).c_str(), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+        stopEvent_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (configChange_ == INVALID_HANDLE_VALUE || stopEvent_ == nullptr) {
+            *error = L"failed to watch " + configPath_ + L": " + GetLastErrorMessage(GetLastError());
+            return false;
+        }
+        configThread_ = std::thread(&WindowsWatchSource::WatchConfig, this);
+        return true;
+    }
+
+    void Close() {
+        if (deviceNotify_ != nullptr) {
+            CM_Unregister_Notification(deviceNotify_);
+            deviceNotify_ = nullptr;
+        }
+        if (powerNotify_ != nullptr) {
+            PowerUnregisterSuspendResumeNotification(powerNotify_);
+            powerNotify_ = nullptr;
+        }
+        if (configThread_.joinable()) {
+            SetEvent(stopEvent_);
+            configThread_.join();
+        }
+        if (configChange_ != INVALID_HANDLE_VALUE) {
+            FindCloseChangeNotification(configChange_);
+            configChange_ = INVALID_HANDLE_VALUE;
+        }
+        if (stopEvent_ != nullptr) {
+            CloseHandle(stopEvent_);
+            stopEvent_ = nullptr;
+        }
+    }
+
+    void Push(ImodWatchEvent event) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back(std::move(event));
+        }
+        ready_.notify_one();
+    }
+
+    bool Wait(uint32_t timeoutMs, ImodWatchEvent* event) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto queued = [this]() { return !events_.empty(); };
+        if (timeoutMs == kImodWatchInfinite) {
+            ready_.wait(lock, queued);
+        } else if (!ready_.wait_for(lock, std::chrono::milliseconds(timeoutMs), queued)) {
+            return false;
+        }
+        *event = std::move(events_.front());
+        events_.pop_front();
+        return true;
+    }
+
+private:
+    static DWORD CALLBACK OnDeviceInterface(HCMNOTIFICATION, PVOID context, CM_NOTIFY_ACTION action,
+        PCM_NOTIFY_EVENT_DATA data, DWORD) {
+        auto* source = static_cast<WindowsWatchSource*>(context);
+        if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL) {
+            source->Push({ImodWatchEventKind::DeviceArrived, InterfaceToInstanceId(data->u.DeviceInterface.SymbolicLink)});
+        } else if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) {
+            source->Push({ImodWatchEventKind::DeviceRemoved, InterfaceToInstanceId(data->u.DeviceInterface.SymbolicLink)});
+        }
+        return ERROR_SUCCESS;
+    }
+
+    static ULONG CALLBACK OnPower(PVOID context, ULONG type, PVOID) {
+        if (type == PBT_APMRESUMEAUTOMATIC) {
+            static_cast<WindowsWatchSource*>(context)->Push({ImodWatchEventKind::Resumed, L""});
+        }
+        return ERROR_SUCCESS;
+    }
+
+    void WatchConfig() {
+        const HANDLE handles[] = {stopEvent_, configChange_};
+        while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+            // The directory signals for any file in it; only a new write time on the config counts.
+            const uint64_t writeTime = GetFileWriteTime(configPath_);
+            if (writeTime != configWriteTime_) {
+                configWriteTime_ = writeTime;
+                Push({ImodWatchEventKind::ConfigChanged, L""});
+            }
+            if (!FindNextChangeNotification(configChange_)) {
+                break;
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<ImodWatchEvent> events_;
+    HCMNOTIFICATION deviceNotify_ = nullptr;
+    DEVICE_NOTIFY_SUBSCRIBE_PARAMETERS power_{};
+    HPOWERNOTIFY powerNotify_ = nullptr;
+    std::wstring configPath_;
+    uint64_t configWriteTime_ = 0;
+    HANDLE configChange_ = INVALID_HANDLE_VALUE;
+    HANDLE stopEvent_ = nullptr;
+    std::thread configThread_;
+};
+
+BOOL WINAPI WatchConsoleHandler(DWORD controlType) {
+    WindowsWatchSource* source = activeWatchSource;
+    if (source != nullptr &&
+        (controlType == CTRL_C_EVENT || controlType == CTRL_BREAK_EVENT || controlType == CTRL_CLOSE_EVENT)) {
+        source->Push({ImodWatchEventKind::Stop, L""});
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// The machine as --watch sees it: the config it was started with, reloaded on edits, and the
+// controllers planned from it. Each pass prints the plan of every controller it applied.
+class DtimodWatchHost final : public ImodWatchHost {
+public:
+    DtimodWatchHost(const ImodDriverContext& ctx, std::wstring configPath, Config config, uint32_t applyFlags)
+        : ctx_(ctx), configPath_(std::move(configPath)), config_(std::move(config)), applyFlags_(applyFlags) {}
+
+    bool ReloadConfig() override {
+        Config config;
+        std::wstring configError;
+        if (!configPath_.empty() && !LoadConfigFile(configPath_, &config, &configError)) {
+            std::wcout << L"watch: config = error: " << configError << L" (keeping previous)" << std::endl;
+            return false;
+        }
+        config_ = std::move(config);
+        return true;
+    }
+
+    bool Enumerate(std::vector<ImodWatchTarget>* targets) override {
+        std::wstring enumError;
+        std::vector<PciDeviceInfo> controllers;
+        if (!EnumerateXhciControllers(&controllers, &enumError)) {
+            std::wcout << L"watch: error: " << enumError << std::endl;
+            return false;
+        }
+
+        std::vector<ControllerPlan> plans;
+        std::vector<ImodApplyJob> jobs;
+        PlanControllers(ctx_, config_, controllers, applyFlags_, false, &plans, &jobs);
+        headers_.clear();
+        targets->clear();
+        for (const auto& plan : plans) {
+            if (plan.job) {
+                targets->push_back({plan.deviceId, jobs[*plan.job]});
+                headers_[plan.deviceId] = plan.header;
+            }
+        }
+        return true;
+    }
+
+    void Report(const ImodWatchPass& pass) override {
+        if (pass.configReloaded) {
+            std::wcout << L"watch: config = reloaded" << std::endl;
+        }
+        if (pass.resumed) {
+            std::wcout << L"watch: resumed" << std::endl;
+        }
+        for (const auto& deviceId : pass.removed) {
+            std::wcout << L"watch: removed " << deviceId << std::endl;
+        }
+        if (!pass.applied.empty()) {
+            std::wcout << std::endl;
+        }
+
+        for (const auto& applied : pass.applied) {
+            std::wcout << headers_[applied.deviceId];
+            const ImodApplyReport& report = applied.report;
+            if (report.failedStage == ImodApplyStage::Channel) {
+                std::wcout << L"error: failed to open " << kImodDriverDevicePath << std::endl << std::endl;
+                continue;
+            }
+            if (report.failedStage == ImodApplyStage::Layout || report.failedStage == ImodApplyStage::Batch) {
+                std::wcout << L"error: failed to apply IMOD: " << DescribeApplyError(report) << std::endl << std::endl;
+                continue;
+            }
+
+            ImodApplyCounts counts;
+            for (uint32_t status : report.statuses) {
+                CountImodStatus(status, &counts);
+            }
+            std::wcout << L"  written = " << counts.written << L", skipped = " << counts.skipped
+                       << L", verified = " << counts.verified << L", failures = " << counts.failures << std::endl;
+            std::wcout << L"  elapsed_us = " << (report.elapsedNs / 1000) << L", round_trips = " << report.operations
+                       << std::endl << std::endl;
+        }
+
+        std::wcout << L"watch: applied = " << pass.applied.size() << L", unchanged = " << pass.unchanged
+                   << L", removed = " << pass.removed.size() << std::endl;
+    }
+
+private:
+    const ImodDriverContext& ctx_;
+    std::wstring configPath_;
+    Config config_;
+    uint32_t applyFlags_;
+    std::map<std::wstring, std::wstring> headers_;
+};
+
+// Stays resident with the driver open: everything is applied once, then only what a device,
+// resume or config event touched, until Ctrl+C.
+int RunImodWatchMode(const ImodDriverContext& ctx, const std::wstring& configPath, Config config,
+    uint32_t applyFlags, const ImodApplyOptions& options, uint32_t quietMs) {
+    // Registered before the first pass so nothing that happens during it is missed.
+    WindowsWatchSource source;
+    std::wstring sourceError;
+    if (!source.Open(configPath, &sourceError)) {
+        std::wcout << L"error: " << sourceError << std::endl;
+        return 1;
+    }
+
+    DtimodWatchHost host(ctx, configPath, std::move(config), applyFlags);
+    DtimodApplyBackend backend(ctx);
+    ImodWatcher watcher(host, backend, options);
+
+    activeWatchSource = &source;
+    SetConsoleCtrlHandler(WatchConsoleHandler, TRUE);
+    std::wcout << L"watch = running, quiet_ms = " << quietMs << L" (Ctrl+C to stop)" << std::endl;
+
+    RunImodWatch(watcher, source, host, quietMs);
+
+    SetConsoleCtrlHandler(WatchConsoleHandler, FALSE);
+    activeWatchSource = nullptr;
+    std::wcout << L"watch = stopped" << std::endl;
+    return 0;
+}
+
+// [nic:HWID] sections: each matching Ethernet adapter gets one masked write per vector through
+// its built-in profile, found by VEN_/DEV_ through a hashed index built once per run, or through
+// the layout the section spells out. Sections apply in order, so a later one refines an earlier.
+void ApplyNicOverrides(const ImodDriverContext& ctx, const Config& config, uint32_t applyFlags, bool verbose,
+    std::vector<WatchdogNic>* watched) {
+    if (config.nicOverrides.empty()) {
+        return;
+    }
+
+    IMOD_NIC_INDEX index{};
+    if (ImodNicIndexBuild(&index) != IMOD_RESULT_SUCCESS) {
+        std::wcout << L"error: NIC profile table does not fit its index" << std::endl << std::endl;
+        return;
+    }
+
+    std::vector<PciDeviceInfo> adapters;
+    std::wstring enumError;
+    if (!EnumerateEthernetAdapters(&adapters, &enumError)) {
+        std::wcout << L"error: " << enumError << std::endl << std::endl;
+        return;
+    }
+
+    const IMOD_PLATFORM platform = MakeDtimodPlatform(ctx);
+    for (const auto& adapter : adapters) {
+        NicOverride merged;
+        bool matched = false;
+        for (const auto& entry : config.nicOverrides) {
+            if (!ContainsInsensitive(adapter.deviceId, entry.hwid)) {
+                continue;
+            }
+            matched = true;
+            merged.enabled = entry.enabled ? entry.enabled : merged.enabled;
+            if (!entry.values.empty() || !entry.intervalsUs.empty()) {
+                merged.values = entry.values;
+                merged.intervalsUs = entry.intervalsUs;
+            }
+            merged.baseOffset = entry.baseOffset ? entry.baseOffset : merged.baseOffset;
+            merged.stride = entry.stride ? entry.stride : merged.stride;
+            merged.queues = entry.queues ? entry.queues : merged.queues;
+            merged.width = entry.width ? entry.width : merged.width;
+            merged.mask = entry.mask ? entry.mask : merged.mask;
+            merged.orBits = entry.orBits ? entry.orBits : merged.orBits;
+        }
+        if (!matched || adapter.problemCode == CM_PROB_DISABLED) {
+            continue;
+        }
+
+        std::wcout << adapter.caption << L" - " << adapter.deviceId << std::endl;
+        if (merged.enabled && !*merged.enabled) {
+            std::wcout << L"  nic_itr = disabled by config" << std::endl << std::endl;
+            continue;
+        }
+        if (merged.values.empty() && merged.intervalsUs.empty()) {
+            std::wcout << L"error: [nic:...] section has no VALUES or INTERVAL_US" << std::endl << std::endl;
+            continue;
+        }
+        if (!adapter.hasBase) {
+            std::wcout << L"  base_address = error: "
+                       << (adapter.baseError.empty() ? L"could not obtain base address" : adapter.baseError)
+                       << std::endl << std::endl;
+            continue;
+        }
 
-    DWORD bytesReturned = 0;
-    if (!DeviceIoControl(
-            ctx.driverHandle,
-            IoctlImodReadPhysicalMemory,
-            &access, sizeof(access),
-            &access, sizeof(access),
-            &bytesReturned,
-            nullptr)) {
-        if (error) {
-            *error = L"failed to read physical memory: " + GetLastErrorMessage(GetLastError());
+        USHORT vendorId = 0;
+        USHORT productId = 0;
+        const IMOD_NIC_PROFILE* builtIn = ParsePciVendorDevice(adapter.deviceId, &vendorId, &productId)
+            ? ImodNicLookup(&index, vendorId, productId)
+            : nullptr;
+        if (builtIn == nullptr && (!merged.baseOffset || !merged.queues || !merged.mask)) {
+            std::wcout << L"error: no built-in NIC profile; set BASE_OFFSET, QUEUES and MASK" << std::endl
+                       << std::endl;
+            continue;
         }
-        return false;
-    }
 
-    if (bytesReturned < sizeof(access)) {
-        if (error) {
-            *error = L"failed to read physical memory: short driver response";
+        IMOD_NIC_PROFILE profile{};
+        if (builtIn != nullptr) {
+            profile = *builtIn;
+        } else {
+            profile.Name = "custom";
+            profile.Stride = 4;
+            profile.Width = 32;
         }
-        return false;
+        profile.BaseOffset = merged.baseOffset.value_or(profile.BaseOffset);
+        profile.Stride = merged.stride.value_or(profile.Stride);
+        profile.MaxQueues = merged.queues.value_or(profile.MaxQueues);
+        profile.Width = merged.width.value_or(profile.Width);
+        profile.ReadMask = merged.mask.value_or(profile.ReadMask);
+        profile.WriteOrBits = merged.orBits.value_or(profile.WriteOrBits);
+
+        IMOD_NIC_APPLY apply{};
+        const std::vector<uint32_t>& values = merged.intervalsUs.empty() ? merged.values : merged.intervalsUs;
+        apply.Flags = applyFlags | (merged.intervalsUs.empty() ? 0 : IMOD_NIC_APPLY_INTERVAL_US);
+        apply.Count = static_cast<ULONG>(values.size());
+        std::copy(values.begin(), values.end(), apply.Values);
+
+        std::wcout << L"  profile = " << profile.Name << L", base_offset = " << ToHex(profile.BaseOffset)
+                   << L", vectors = " << profile.MaxQueues << std::endl;
+        const ULONG result = ImodNicApply(&platform, adapter.baseAddress, adapter.baseLength, &profile, &apply);
+        if (result == IMOD_RESULT_INVALID_CONTROLLER) {
+            std::wcout << L"error: adapter registers read back as all ones (powered down?)" << std::endl << std::endl;
+            continue;
+        }
+        if (result != IMOD_RESULT_SUCCESS) {
+            std::wcout << L"error: NIC layout or values do not fit " << ToHex(adapter.baseAddress) << L" (length "
+                       << ToHex(adapter.baseLength) << L")" << std::endl << std::endl;
+            continue;
+        }
+
+        ImodApplyCounts counts;
+        for (ULONG vector = 0; vector < profile.MaxQueues; ++vector) {
+            const uint32_t failuresBefore = counts.failures;
+            CountImodStatus(apply.Status[vector], &counts);
+            const uint64_t address = adapter.baseAddress + profile.BaseOffset + (static_cast<uint64_t>(vector) * profile.Stride);
+            if (counts.failures != failuresBefore) {
+                std::wcout << L"error: failed to write NIC ITR at " << ToHex(address) << L": "
+                           << ImodStatusName(apply.Status[vector]) << std::endl;
+            } else if (verbose || apply.Status[vector] != IMOD_BATCH_STATUS_UNCHANGED) {
+                const ULONG now = apply.Status[vector] == IMOD_BATCH_STATUS_UNCHANGED ? apply.Previous[vector]
+                                                                                       : apply.Written[vector];
+                std::wcout << L"  vector[" << vector << L"] = " << ToHex(apply.Previous[vector]) << L" ("
+                           << ImodNicIntervalNs(&profile, apply.Previous[vector]) / 1000 << L" us) -> " << ToHex(now)
+                           << L" (" << ImodNicIntervalNs(&profile, now) / 1000 << L" us), "
+                           << ImodStatusName(apply.Status[vector]) << std::endl;
+            }
+        }
+        std::wcout << L"  written = " << counts.written << L", skipped = " << counts.skipped
+                   << L", verified = " << counts.verified << L", failures = " << counts.failures << std::endl;
+        std::wcout << std::endl;
+        watched->push_back({adapter.baseAddress, profile, apply});
+    }
+}
+
+// Get/Set Features through the storage protocol pass-through StorNVMe takes on the controller's
+// storage port. Neither IOCTL carries SEL or SV, so only current values are read and written;
+// they last until the controller resets, which is why [nvme:] sections are reapplied on every
+// run like [nic:] ones.
+BOOLEAN StoragePortGetFeature(PVOID context, ULONG cdw10, ULONG cdw11, ULONG* completion) {
+    if (((cdw10 >> 8) & 0x7) != IMOD_NVME_SELECT_CURRENT) {
+        return FALSE;
     }
 
-    *value = static_cast<uint32_t>(access.value);
-    return true;
+    alignas(8) BYTE buffer[FIELD_OFFSET(STORAGE_PROPERTY_QUERY, AdditionalParameters) +
+        sizeof(STORAGE_PROTOCOL_SPECIFIC_DATA)]{};
+    auto* query = reinterpret_cast<STORAGE_PROPERTY_QUERY*>(buffer);
+    query->PropertyId = StorageAdapterProtocolSpecificProperty;
+    query->QueryType = PropertyStandardQuery;
+    auto* data = reinterpret_cast<STORAGE_PROTOCOL_SPECIFIC_DATA*>(query->AdditionalParameters);
+    data->ProtocolType = ProtocolTypeNvme;
+    data->DataType = NVMeDataTypeFeature;
+    data->ProtocolDataRequestValue = cdw10 & 0xFF;
+    data->ProtocolDataRequestSubValue = cdw11;
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(static_cast<HANDLE>(context), IOCTL_STORAGE_QUERY_PROPERTY, buffer, sizeof(buffer), buffer,
+            sizeof(buffer), &bytesReturned, nullptr) ||
+        bytesReturned < sizeof(STORAGE_PROTOCOL_DATA_DESCRIPTOR)) {
+        return FALSE;
+    }
+    *completion = reinterpret_cast<const STORAGE_PROTOCOL_DATA_DESCRIPTOR*>(buffer)->ProtocolSpecificData.FixedProtocolReturnData;
+    return TRUE;
 }
 
-bool WritePhys32(const ImodDriverContext& ctx, uint64_t address, uint32_t value, std::wstring* error) {
-    PhysAccessStruct access{};
-    access.physAddress = address;
-    access.accessSizeInBytes = sizeof(uint32_t);
-    access.value = value;
+BOOLEAN StoragePortSetFeature(PVOID context, ULONG cdw10, ULONG cdw11, ULONG* completion) {
+    alignas(8) BYTE buffer[FIELD_OFFSET(STORAGE_PROPERTY_SET, AdditionalParameters) +
+        sizeof(STORAGE_PROTOCOL_SPECIFIC_DATA_EXT)]{};
+    auto* set = reinterpret_cast<STORAGE_PROPERTY_SET*>(buffer);
+    set->PropertyId = StorageAdapterProtocolSpecificProperty;
+    set->SetType = PropertyStandardSet;
+    auto* data = reinterpret_cast<STORAGE_PROTOCOL_SPECIFIC_DATA_EXT*>(set->AdditionalParameters);
+    data->ProtocolType = ProtocolTypeNvme;
+    data->DataType = NVMeDataTypeFeature;
+    data->ProtocolDataValue = cdw10 & 0xFF;
+    data->ProtocolDataSubValue = cdw11;
 
     DWORD bytesReturned = 0;
-    if (!DeviceIoControl(
-            ctx.driverHandle,
-            IoctlImodWritePhysicalMemory,
-            &access, sizeof(access),
-            &access, sizeof(access),
-            &bytesReturned,
-            nullptr)) {
-        if (error) {
-            *error = L"failed to write physical memory: " + GetLastErrorMessage(GetLastError());
-        }
-        return false;
+    if (!DeviceIoControl(static_cast<HANDLE>(context), IOCTL_STORAGE_SET_PROPERTY, buffer, sizeof(buffer), buffer,
+            sizeof(buffer), &bytesReturned, nullptr)) {
+        return FALSE;
     }
+    *completion = bytesReturned >= sizeof(STORAGE_PROTOCOL_DATA_DESCRIPTOR_EXT)
+        ? reinterpret_cast<const STORAGE_PROTOCOL_DATA_DESCRIPTOR_EXT*>(buffer)->ProtocolSpecificData.FixedProtocolReturnData
+        : 0;
+    return TRUE;
+}
 
-    return true;
+HANDLE OpenStoragePort(const std::wstring& instanceId, std::wstring* error) {
+    GUID interfaceGuid = kStoragePortInterface;
+    std::wstring deviceId = instanceId;
+    ULONG length = 0;
+    if (CM_Get_Device_Interface_List_SizeW(&length, &interfaceGuid, deviceId.data(),
+            CM_GET_DEVICE_INTERFACE_LIST_PRESENT) != CR_SUCCESS ||
+        length <= 1) {
+        *error = L"controller has no storage port (not on StorNVMe?)";
+        return INVALID_HANDLE_VALUE;
+    }
+
+    std::vector<wchar_t> interfaces(length, L'\0');
+    if (CM_Get_Device_Interface_ListW(&interfaceGuid, deviceId.data(), interfaces.data(), length,
+            CM_GET_DEVICE_INTERFACE_LIST_PRESENT) != CR_SUCCESS ||
+        interfaces[0] == L'\0') {
+        *error = L"failed to list the controller's storage port";
+        return INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE port = CreateFileW(
+        interfaces.data(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (port == INVALID_HANDLE_VALUE) {
+        *error = L"failed to open storage port: " + GetLastErrorMessage(GetLastError());
+    }
+    return port;
 }
 
-bool WriteImodInterval(const ImodDriverContext& ctx, uint64_t address, uint32_t interval, std::wstring* error) {
-    uint32_t currentValue = 0;
-    if (!ReadPhys32(ctx, address, &currentValue, error)) {
-        return false;
+std::wstring FormatNvmeCoalescing(ULONG timeUs, ULONG threshold) {
+    return std::to_wstring(timeUs) + L" us x " + std::to_wstring(threshold);
+}
+
+// [nvme:HWID] sections: each matching NVMe controller gets its Interrupt Coalescing and the
+// Coalescing Disable bits in one all-or-nothing apply, where a refused write or readback puts
+// back everything written before it. Windows reports no queue-to-vector list, so the mapping
+// -v prints is StorNVMe's layout over the vectors the controller answers for.
+void ApplyNvmeOverrides(const Config& config, uint32_t applyFlags, bool verbose) {
+    if (config.nvmeOverrides.empty()) {
+        return;
+    }
+
+    std::vector<PciDeviceInfo> controllers;
+    std::wstring enumError;
+    if (!EnumerateNvmeControllers(&controllers, &enumError)) {
+        std::wcout << L"error: " << enumError << std::endl << std::endl;
+        return;
     }
 
-    const uint32_t mergedValue = (currentValue & 0xFFFF0000U) | (interval & 0xFFFFU);
-    return WritePhys32(ctx, address, mergedValue, error);
+    for (const auto& controller : controllers) {
+        NvmeOverride merged;
+        bool matched = false;
+        for (const auto& entry : config.nvmeOverrides) {
+            if (!ContainsInsensitive(controller.deviceId, entry.hwid)) {
+                continue;
+            }
+            matched = true;
+            merged.enabled = entry.enabled ? entry.enabled : merged.enabled;
+            merged.timeUs = entry.timeUs ? entry.timeUs : merged.timeUs;
+            merged.threshold = entry.threshold ? entry.threshold : merged.threshold;
+            merged.disabledVectors = entry.disabledVectors ? entry.disabledVectors : merged.disabledVectors;
+        }
+        if (!matched || controller.problemCode == CM_PROB_DISABLED) {
+            continue;
+        }
+
+        std::wcout << controller.caption << L" - " << controller.deviceId << std::endl;
+        if (merged.enabled && !*merged.enabled) {
+            std::wcout << L"  nvme_coalescing = disabled by config" << std::endl << std::endl;
+            continue;
+        }
+        if (!merged.timeUs && !merged.threshold && !merged.disabledVectors) {
+            std::wcout << L"error: [nvme:...] section has no TIME_US, THRESHOLD or CD" << std::endl << std::endl;
+            continue;
+        }
+
+        std::wstring portError;
+        HANDLE port = OpenStoragePort(controller.deviceId, &portError);
+        if (port == INVALID_HANDLE_VALUE) {
+            std::wcout << L"error: " << portError << std::endl << std::endl;
+            continue;
+        }
+        ScopeExit closePort([&]() { CloseHandle(port); });
+
+        const IMOD_NVME_TRANSPORT transport{port, StoragePortGetFeature, StoragePortSetFeature};
+        IMOD_NVME_STATE state{};
+        if (ImodNvmeRead(&transport, IMOD_NVME_SELECT_CURRENT, &state) != IMOD_RESULT_SUCCESS) {
+            std::wcout << L"error: controller refused Get Features for its queues or interrupt coalescing" << std::endl
+                       << std::endl;
+            continue;
+        }
+
+        // Vectors answer from 1 up to the last MSI-X message the controller was granted.
+        ULONG messages = 1;
+        while (messages < state.Settings.Vectors && state.VectorRead[messages] != 0) {
+            ++messages;
+        }
+        std::wcout << L"  queues = " << state.SubmissionQueues << L" sq / " << state.CompletionQueues
+                   << L" cq, vectors = " << messages << std::endl;
+        if (verbose) {
+            for (ULONG queue = 1; queue <= state.CompletionQueues; ++queue) {
+                std::wcout << L"  queue[" << queue << L"] -> vector[" << ImodNvmeQueueVector(queue, messages) << L"]"
+                           << std::endl;
+            }
+        }
+
+        IMOD_NVME_APPLY apply{};
+        apply.Flags = applyFlags;
+        apply.Target = state.Settings;
+        apply.Target.Vectors = messages;
+        apply.Target.TimeUs = merged.timeUs.value_or(state.Settings.TimeUs);
+        apply.Target.Threshold = merged.threshold.value_or(state.Settings.Threshold);
+        bool inRange = true;
+        if (merged.disabledVectors) {
+            std::fill(std::begin(apply.Target.CoalescingDisable), std::end(apply.Target.CoalescingDisable), 0);
+            for (const uint32_t vector : *merged.disabledVectors) {
+                inRange = inRange && vector < messages;
+                apply.Target.CoalescingDisable[vector] = vector < messages ? 1 : 0;
+            }
+        }
+        if (!inRange) {
+            std::wcout << L"error: CD names a vector past the " << (messages - 1)
+                       << L" I/O vectors the controller reports" << std::endl << std::endl;
+            continue;
+        }
+
+        const ULONG result = ImodNvmeApply(&transport, &apply);
+        if (result == IMOD_RESULT_INVALID_PARAMETER) {
+            std::wcout << L"error: controller stopped reporting its vectors" << std::endl << std::endl;
+            continue;
+        }
+
+        ImodApplyCounts counts;
+        for (ULONG vector = 1; vector < messages; ++vector) {
+            const uint32_t failuresBefore = counts.failures;
+            CountImodStatus(apply.VectorStatus[vector], &counts);
+            const bool now = apply.VectorStatus[vector] == IMOD_BATCH_STATUS_UNCHANGED
+                ? apply.Previous.CoalescingDisable[vector] != 0
+                : apply.Target.CoalescingDisable[vector] != 0;
+            if (counts.failures != failuresBefore) {
+                std::wcout << L"error: failed to set coalescing disable on vector " << vector << L": "
+                           << ImodStatusName(apply.VectorStatus[vector]) << std::endl;
+            } else if (verbose || apply.VectorStatus[vector] != IMOD_BATCH_STATUS_UNCHANGED) {
+                std::wcout << L"  vector[" << vector << L"] = "
+                           << (apply.Previous.CoalescingDisable[vector] != 0 ? L"disabled" : L"coalesced") << L" -> "
+                           << (now ? L"disabled" : L"coalesced") << L", " << ImodStatusName(apply.VectorStatus[vector])
+                           << std::endl;
+            }
+        }
+
+        const uint32_t failuresBefore = counts.failures;
+        CountImodStatus(apply.CoalescingStatus, &counts);
+        if (counts.failures != failuresBefore) {
+            std::wcout << L"error: failed to set interrupt coalescing: " << ImodStatusName(apply.CoalescingStatus)
+                       << std::endl;
+        } else if (verbose || apply.CoalescingStatus != IMOD_BATCH_STATUS_UNCHANGED) {
+            std::wcout << L"  coalescing = " << FormatNvmeCoalescing(apply.Previous.TimeUs, apply.Previous.Threshold)
+                       << L" -> " << FormatNvmeCoalescing(apply.Target.TimeUs, apply.Target.Threshold) << L", "
+                       << ImodStatusName(apply.CoalescingStatus) << std::endl;
+        }
+
+        std::wcout << L"  written = " << counts.written << L", skipped = " << counts.skipped
+                   << L", verified = " << counts.verified << L", failures = " << counts.failures << std::endl;
+        if (result != IMOD_RESULT_SUCCESS) {
+            std::wcout << L"  rolled_back = " << apply.RolledBack << L", rollback_failed = " << apply.RollbackFailed
+                       << std::endl;
+        }
+        std::wcout << std::endl;
+    }
 }
 
 bool QueryServiceStatus(SC_HANDLE service, SERVICE_STATUS_PROCESS* status) {
@@ -882,6 +3523,49 @@ bool IsImodDriverDeviceAvailable() {
     return true;
 }
 
+// Maps DTIMOD.sys through KDU with the arguments the GUI uses, for machines where the service
+// cannot load it. KDU's exit code is not reliable, so the device answering is what counts.
+bool MapImodDriverWithKdu(const std::wstring& kduPath, const std::wstring& driverPath, std::wstring* error) {
+    std::wstring commandLine = L"\"" + kduPath + L"\" -scv 3 -drvn " + kImodDriverServiceName +
+        L" -drvr " + kImodDriverServiceName + L" -map \"" + driverPath + L"\"";
+    const std::wstring workingDirectory = ParentPath(kduPath);
+    STARTUPINFOW startup{};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process{};
+    if (!CreateProcessW(kduPath.c_str(), commandLine.data(), nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr,
+            workingDirectory.empty() ? nullptr : workingDirectory.c_str(), &startup, &process)) {
+        if (error) {
+            *error = L"failed to start " + kduPath + L": " + GetLastErrorMessage(GetLastError());
+        }
+        return false;
+    }
+
+    CloseHandle(process.hThread);
+    ScopeExit closeProcess([&]() { CloseHandle(process.hProcess); });
+    if (WaitForSingleObject(process.hProcess, kKduTimeoutMs) != WAIT_OBJECT_0) {
+        TerminateProcess(process.hProcess, 1);
+        if (error) {
+            *error = L"kdu.exe timed out";
+        }
+        return false;
+    }
+
+    DWORD exitCode = 0;
+    GetExitCodeProcess(process.hProcess, &exitCode);
+    for (int i = 0; i < 10; ++i) {
+        if (IsImodDriverDeviceAvailable()) {
+            return true;
+        }
+        Sleep(100);
+    }
+
+    if (error) {
+        *error = L"kdu.exe exited with " + std::to_wstring(exitCode) + L" and " +
+            kImodDriverDevicePath + L" did not appear";
+    }
+    return false;
+}
+
 bool EnsureImodDriverService(ImodDriverContext& ctx, std::wstring* error) {
     SC_HANDLE scm = OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ALL_ACCESS);
     if (!scm) {
@@ -965,6 +3649,7 @@ bool EnsureImodDriverService(ImodDriverContext& ctx, std::wstring* error) {
         }
     }
 
+    ctx.wasRunning = wasRunning;
     if (!wasRunning) {
         if (!StartServiceW(service, 0, nullptr)) {
             const DWORD lastError = GetLastError();
@@ -985,6 +3670,10 @@ bool EnsureImodDriverService(ImodDriverContext& ctx, std::wstring* error) {
 }
 
 void StopImodDriverServiceIfNeeded(const ImodDriverContext& ctx) {
+    if (ctx.keepLoaded) {
+        return;
+    }
+
     SC_HANDLE scm = OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ALL_ACCESS);
     if (!scm) {
         return;
@@ -1010,7 +3699,7 @@ void StopImodDriverServiceIfNeeded(const ImodDriverContext& ctx) {
         }
     }
 
-    if (ctx.serviceCreated) {
+    if (ctx.serviceCreated && !ctx.keepService) {
         DeleteService(service);
     }
 
@@ -1019,7 +3708,10 @@ void StopImodDriverServiceIfNeeded(const ImodDriverContext& ctx) {
 }
 
 bool InitializeImodDriver(ImodDriverContext& ctx, std::wstring* error) {
-    if (!EnsureImodDriverService(ctx, error)) {
+    // A driver mapped by KDU has no service to start, and starting one would collide with it.
+    if (IsImodDriverDeviceAvailable()) {
+        ctx.wasRunning = true;
+    } else if (!EnsureImodDriverService(ctx, error)) {
         return false;
     }
 
@@ -1038,6 +3730,15 @@ bool InitializeImodDriver(ImodDriverContext& ctx, std::wstring* error) {
         return false;
     }
 
+    // The prebuilt DTIMOD.sys has no version query; it keeps the legacy set.
+    ImodDriverVersion version{};
+    DWORD bytesReturned = 0;
+    if (DeviceIoControl(ctx.driverHandle, IoctlImodQueryVersion, nullptr, 0, &version, sizeof(version), &bytesReturned,
+            nullptr) &&
+        bytesReturned >= sizeof(version)) {
+        ctx.interfaceVersion = version.interfaceVersion;
+        ctx.ioctlMask = version.ioctlMask | kImodLegacyIoctlMask;
+    }
     return true;
 }
 
@@ -1054,17 +3755,139 @@ void ShutdownImodDriver(ImodDriverContext& ctx) {
 
 int wmain(int argc, wchar_t* argv[]) {
     bool verbose = false;
+    bool writeBootTable = false;
+    bool clearBootTable = false;
+    bool showBootStatus = false;
+    bool showWatchdogStatus = false;
+    std::optional<uint32_t> watchdogPeriodMs;
+    uint32_t samplePeriodMs = 0;
+    uint32_t sampleCount = 0;
+    uint32_t governorPeriodMs = 0;
+    bool force = false;
+    bool watch = false;
+    uint32_t watchQuietMs = kImodWatchDefaultQuietMs;
+    std::wstring kduPath;
+    std::wstring logPath;
+    ImodApplyOptions applyOptions;
     for (int i = 1; i < argc; ++i) {
         if (wcscmp(argv[i], L"-v") == 0 || wcscmp(argv[i], L"--verbose") == 0 || wcscmp(argv[i], L"/v") == 0) {
             verbose = true;
+        } else if (wcscmp(argv[i], L"--force") == 0) {
+            force = true;
+        } else if (wcscmp(argv[i], L"--workers") == 0) {
+            if (i + 1 >= argc || !TryParseUint32(argv[i + 1], &applyOptions.workers) ||
+                applyOptions.workers == 0 || applyOptions.workers > kImodApplyMaxWorkers) {
+                std::wcout << L"error: --workers needs 1-" << kImodApplyMaxWorkers << std::endl;
+                return 1;
+            }
+            ++i;
+        } else if (wcscmp(argv[i], L"--depth") == 0) {
+            if (i + 1 >= argc || !TryParseUint32(argv[i + 1], &applyOptions.depth) ||
+                applyOptions.depth == 0 || applyOptions.depth > kImodApplyMaxDepth) {
+                std::wcout << L"error: --depth needs 1-" << kImodApplyMaxDepth << std::endl;
+                return 1;
+            }
+            ++i;
+        } else if (wcscmp(argv[i], L"--watch") == 0) {
+            watch = true;
+        } else if (wcscmp(argv[i], L"--quiet-ms") == 0) {
+            if (i + 1 >= argc || !TryParseUint32(argv[i + 1], &watchQuietMs) || watchQuietMs > 60000) {
+                std::wcout << L"error: --quiet-ms needs 0-60000" << std::endl;
+                return 1;
+            }
+            ++i;
+        } else if (wcscmp(argv[i], L"--boot-table") == 0) {
+            writeBootTable = true;
+        } else if (wcscmp(argv[i], L"--boot-table-clear") == 0) {
+            clearBootTable = true;
+        } else if (wcscmp(argv[i], L"--boot-status") == 0) {
+            showBootStatus = true;
+        } else if (wcscmp(argv[i], L"--watchdog-status") == 0) {
+            showWatchdogStatus = true;
+        } else if (wcscmp(argv[i], L"--watchdog") == 0) {
+            uint32_t periodMs = 0;
+            if (i + 1 >= argc || !TryParseUint32(argv[i + 1], &periodMs) ||
+                (periodMs != 0 && (periodMs < IMOD_WATCHDOG_MIN_PERIOD_MS || periodMs > IMOD_WATCHDOG_MAX_PERIOD_MS))) {
+                std::wcout << L"error: --watchdog needs 0 or a period of " << IMOD_WATCHDOG_MIN_PERIOD_MS
+                           << L"-" << IMOD_WATCHDOG_MAX_PERIOD_MS << L" ms" << std::endl;
+                return 1;
+            }
+            watchdogPeriodMs = periodMs;
+            ++i;
+        } else if (wcscmp(argv[i], L"--sample") == 0) {
+            if (i + 2 >= argc || !TryParseUint32(argv[i + 1], &samplePeriodMs) ||
+                !TryParseUint32(argv[i + 2], &sampleCount) ||
+                samplePeriodMs == 0 || samplePeriodMs > 60000 || sampleCount == 0) {
+                std::wcout << L"error: --sample needs <period_ms 1-60000> <count>" << std::endl;
+                return 1;
+            }
+            i += 2;
+        } else if (wcscmp(argv[i], L"--governor") == 0) {
+            if (i + 1 >= argc || !TryParseUint32(argv[i + 1], &governorPeriodMs) ||
+                governorPeriodMs < 50 || governorPeriodMs > 5000) {
+                std::wcout << L"error: --governor needs <period_ms 50-5000>" << std::endl;
+                return 1;
+            }
+            ++i;
+        } else if (wcscmp(argv[i], L"--kdu") == 0) {
+            if (i + 1 >= argc || argv[i + 1][0] == L'\0') {
+                std::wcout << L"error: --kdu needs <kdu.exe>" << std::endl;
+                return 1;
+            }
+            kduPath = argv[++i];
+        } else if (wcscmp(argv[i], L"--log") == 0) {
+            if (i + 1 >= argc || argv[i + 1][0] == L'\0') {
+                std::wcout << L"error: --log needs <file>" << std::endl;
+                return 1;
+            }
+            logPath = argv[++i];
+        }
+    }
+
+    // The logon launcher starts IMOD.exe through ShellExecute for elevation, which cannot
+    // redirect output, so the log is appended to here. A log that cannot be opened does not
+    // stop the apply.
+    if (!logPath.empty()) {
+        std::error_code ignored;
+        std::filesystem::create_directories(std::filesystem::path(logPath).parent_path(), ignored);
+        FILE* logFile = nullptr;
+        if (_wfreopen_s(&logFile, logPath.c_str(), L"a", stdout) != 0) {
+            std::wcerr << L"warning: failed to open log " << logPath << std::endl;
+        } else {
+            SYSTEMTIME now{};
+            GetLocalTime(&now);
+            wchar_t stamp[32] = {};
+            swprintf_s(stamp, L"%04u-%02u-%02u %02u:%02u:%02u", now.wYear, now.wMonth, now.wDay,
+                now.wHour, now.wMinute, now.wSecond);
+            std::wcout << L"--- " << stamp << L" ---" << std::endl;
         }
     }
 
+    if (governorPeriodMs != 0 && (samplePeriodMs != 0 || watchdogPeriodMs || writeBootTable)) {
+        std::wcout << L"error: --governor cannot be combined with --sample, --watchdog or --boot-table" << std::endl;
+        return 1;
+    }
+
+    if (samplePeriodMs != 0 && (watchdogPeriodMs || writeBootTable)) {
+        std::wcout << L"error: --sample cannot be combined with --watchdog or --boot-table" << std::endl;
+        return 1;
+    }
+
+    if (watch && (governorPeriodMs != 0 || samplePeriodMs != 0 || watchdogPeriodMs || writeBootTable ||
+                  clearBootTable || showBootStatus || showWatchdogStatus)) {
+        std::wcout << L"error: --watch cannot be combined with --governor, --sample, --watchdog or --boot-*" << std::endl;
+        return 1;
+    }
+
     if (!IsAdmin()) {
         std::wcout << L"error: administrator privileges required" << std::endl;
         return 1;
     }
 
+    // Unless forced, leave interrupters that already hold the interval or are not enabled, so
+    // re-running on a tuned machine costs reads only.
+    const uint32_t applyFlags = force ? IMOD_BATCH_FLAG_VERIFY : (IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY);
+
     std::wstring driverPath = FindDriverPath();
     if (driverPath.empty()) {
         std::wcout << L"error: DTIMOD.sys not exists" << std::endl;
@@ -1082,12 +3905,21 @@ int wmain(int argc, wchar_t* argv[]) {
     }
 
     std::wstring enumError;
-    std::vector<UsbControllerInfo> controllers;
+    std::vector<PciDeviceInfo> controllers;
     if (!EnumerateXhciControllers(&controllers, &enumError)) {
         std::wcout << L"error: " << enumError << std::endl;
         return 1;
     }
 
+    if (!kduPath.empty() && !IsImodDriverDeviceAvailable()) {
+        std::wstring kduError;
+        if (MapImodDriverWithKdu(kduPath, driverPath, &kduError)) {
+            std::wcout << L"kdu = mapped" << std::endl;
+        } else {
+            std::wcout << L"kdu = " << kduError << L", falling back to the driver service" << std::endl;
+        }
+    }
+
     ImodDriverContext imodDriver;
     imodDriver.driverPath = driverPath;
     std::wstring driverError;
@@ -1099,89 +3931,84 @@ int wmain(int argc, wchar_t* argv[]) {
 
     ScopeExit cleanup([&]() { ShutdownImodDriver(imodDriver); });
 
-    if (!configPath.empty()) {
-        std::wcout << L"config = " << configPath << L" (overrides: " << config.overrides.size() << L")" << std::endl;
-    } else {
-        std::wcout << L"config = defaults (no " << kConfigFileName << L" found)" << std::endl;
-    }
-    std::wcout << L"DTIMOD.sys = " << driverPath << std::endl << std::endl;
-
-    for (const auto& controller : controllers) {
-        if (controller.problemCode == CM_PROB_DISABLED) {
-            continue;
+    if (showBootStatus || clearBootTable || showWatchdogStatus) {
+        std::wstring bootError;
+        if (showBootStatus && !PrintBootStatus(imodDriver, &bootError)) {
+            std::wcout << L"error: " << bootError << std::endl;
+            return 1;
         }
-
-        std::wcout << controller.caption << L" - " << controller.deviceId << std::endl;
-        if (controller.problemCode != 0) {
-            std::wcout << L"  problem_code = " << controller.problemCode << std::endl;
+        if (showWatchdogStatus) {
+            // Looking must not unload a driver that is watching registers.
+            imodDriver.keepLoaded = imodDriver.wasRunning;
+            if (!PrintWatchdogStatus(imodDriver, &bootError)) {
+                std::wcout << L"error: " << bootError << std::endl;
+                return 1;
+            }
         }
-
-        if (!controller.hasBase) {
-            if (!controller.baseError.empty()) {
-                std::wcout << L"  base_address = error: " << controller.baseError << std::endl << std::endl;
-            } else {
-                std::wcout << L"  base_address = error: could not obtain base address" << std::endl << std::endl;
+        if (clearBootTable) {
+            if (!ClearBootTable(&bootError)) {
+                std::wcout << L"error: " << bootError << std::endl;
+                return 1;
             }
-            continue;
+            std::wcout << L"boot_table = cleared" << std::endl;
         }
+        return 0;
+    }
 
-        uint32_t desiredInterval = config.globalInterval;
-        uint32_t hcsparamsOffset = config.globalHcsparamsOffset;
-        uint32_t rtsoff = config.globalRtsoff;
-        bool enabled = true;
-        std::wstring overrideMatch;
+    std::vector<BootTableController> bootControllers;
+    std::vector<WatchdogController> watchdogControllers;
+    std::vector<SamplerController> samplerControllers;
+    std::vector<GovernorController> governorControllers;
 
-        for (const auto& entry : config.overrides) {
-            if (ContainsInsensitive(controller.deviceId, entry.hwid)) {
-                if (entry.enabled) {
-                    enabled = *entry.enabled;
-                }
-                if (entry.interval) {
-                    desiredInterval = *entry.interval;
-                }
-                if (entry.hcsparamsOffset) {
-                    hcsparamsOffset = *entry.hcsparamsOffset;
-                }
-                if (entry.rtsoff) {
-                    rtsoff = *entry.rtsoff;
-                }
-                overrideMatch = entry.hwid;
-            }
-        }
+    if (!configPath.empty()) {
+        std::wcout << L"config = " << configPath << L" (overrides: " << config.overrides.size()
+                   << L", nic: " << config.nicOverrides.size() << L", nvme: " << config.nvmeOverrides.size() << L")"
+                   << std::endl;
+    } else {
+        std::wcout << L"config = defaults (no " << kConfigFileName << L" found)" << std::endl;
+    }
+    std::wcout << L"DTIMOD.sys = " << driverPath << L" (interface " << imodDriver.interfaceVersion << L")" << std::endl
+               << std::endl;
 
-        const uint64_t capabilityAddress = controller.baseAddress;
-        std::wcout << L"  base_address = " << ToHex(capabilityAddress) << std::endl;
-        std::wcout << L"  interval = " << ToHex(desiredInterval);
-        if (!overrideMatch.empty()) {
-            std::wcout << L" (override: " << overrideMatch << L")";
-        }
-        std::wcout << std::endl;
-        std::wcout << L"  hcsparams_offset = " << ToHex(hcsparamsOffset)
-                   << L", rtsoff = " << ToHex(rtsoff) << std::endl;
+    if (watch) {
+        return RunImodWatchMode(imodDriver, configPath, std::move(config), applyFlags, applyOptions, watchQuietMs);
+    }
 
-        if (!enabled) {
-            if (!overrideMatch.empty()) {
-                std::wcout << L"  skipped (disabled by config: " << overrideMatch << L")" << std::endl << std::endl;
-            } else {
-                std::wcout << L"  skipped (disabled by config)" << std::endl << std::endl;
-            }
+    // Everything up to the first register access is printed into the plan; the engine then
+    // runs all controllers at once and the results are printed in enumeration order.
+    std::vector<ControllerPlan> plans;
+    std::vector<ImodApplyJob> jobs;
+    PlanControllers(imodDriver, config, controllers, applyFlags, samplePeriodMs != 0, &plans, &jobs);
+
+    DtimodApplyBackend applyBackend(imodDriver);
+    const std::vector<ImodApplyReport> reports = RunImodApply(applyBackend, jobs, applyOptions);
+
+    for (const auto& plan : plans) {
+        std::wcout << plan.header;
+        if (!plan.job) {
             continue;
         }
 
-        uint32_t hcsparamsValue = 0;
-        uint32_t rtsoffValue = 0;
-        std::wstring ioError;
-        if (!ReadPhys32(imodDriver, capabilityAddress + hcsparamsOffset, &hcsparamsValue, &ioError)) {
-            std::wcout << L"error: failed to read XHCI registers: " << ioError << std::endl << std::endl;
+        const ImodApplyReport& report = reports[*plan.job];
+        if (report.failedStage == ImodApplyStage::Channel) {
+            std::wcout << L"error: failed to open " << kImodDriverDevicePath << std::endl << std::endl;
             continue;
         }
-        if (!ReadPhys32(imodDriver, capabilityAddress + rtsoff, &rtsoffValue, &ioError)) {
-            std::wcout << L"error: failed to read XHCI registers: " << ioError << std::endl << std::endl;
+        if (report.failedStage == ImodApplyStage::Layout) {
+            std::wcout << L"error: failed to read XHCI registers: " << DescribeApplyError(report) << std::endl << std::endl;
             continue;
         }
 
-        const uint32_t maxIntrs = (hcsparamsValue >> 8) & 0x7FF;
-        const uint64_t runtimeAddress = capabilityAddress + rtsoffValue;
+        const uint64_t capabilityAddress = plan.capabilityAddress;
+        const uint32_t hcsparamsValue = report.hcsparams;
+        const uint32_t rtsoffValue = report.rtsoffValue;
+        const uint32_t maxIntrs = report.maxIntrs;
+        const uint64_t runtimeAddress = report.runtimeAddress;
+
+        if (maxIntrs > 0) {
+            bootControllers.push_back({capabilityAddress, plan.barLength, plan.hcsparamsOffset, plan.rtsoff,
+                hcsparamsValue, plan.interval, plan.intervals});
+        }
 
         std::wcout << L"  max_intrs = " << maxIntrs
                    << L", runtime_address = " << ToHex(runtimeAddress) << std::endl;
@@ -1189,40 +4016,129 @@ int wmain(int argc, wchar_t* argv[]) {
         if (verbose) {
             std::wcout << L"capability_address  = " << ToHex(capabilityAddress) << std::endl;
             std::wcout << L"HCSPARAMS_value     = capability_address + hcsparams_offset = "
-                       << ToHex(capabilityAddress) << L" + " << ToHex(hcsparamsOffset) << L" = "
+                       << ToHex(capabilityAddress) << L" + " << ToHex(plan.hcsparamsOffset) << L" = "
                        << ToHex(hcsparamsValue) << std::endl;
             std::wcout << L"HCSPARAMS_bitmask   = " << std::bitset<32>(hcsparamsValue) << std::endl;
             std::wcout << L"max_intrs           = " << maxIntrs << std::endl;
             std::wcout << L"RTSOFF_value        = capability_address + rtsoff = "
-                       << ToHex(capabilityAddress) << L" + " << ToHex(rtsoff) << L" = "
+                       << ToHex(capabilityAddress) << L" + " << ToHex(plan.rtsoff) << L" = "
                        << ToHex(rtsoffValue) << std::endl;
             std::wcout << L"runtime_address     = capability_address + RTSOFF_value = "
                        << ToHex(capabilityAddress) << L" + " << ToHex(rtsoffValue) << L" = "
                        << ToHex(runtimeAddress) << std::endl;
         }
 
-        uint32_t writeFailures = 0;
-        for (uint32_t i = 0; i < maxIntrs; ++i) {
-            const uint64_t interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
-            const std::wstring interrupterHex = ToHex(interrupterAddress);
+        if (samplePeriodMs != 0) {
+            if (maxIntrs > 0) {
+                std::wcout << L"  sample_controller = " << samplerControllers.size() << std::endl;
+                samplerControllers.push_back({runtimeAddress, maxIntrs});
+            }
+            std::wcout << std::endl;
+            continue;
+        }
+
+        if (report.failedStage == ImodApplyStage::Batch) {
+            std::wcout << L"error: failed to apply IMOD batch: " << DescribeApplyError(report) << std::endl << std::endl;
+            continue;
+        }
 
+        if (verbose && maxIntrs > 0 && !report.batched) {
+            std::wcout << L"IMOD batch unsupported by driver, using per-register writes" << std::endl;
+        }
+
+        ImodApplyCounts counts;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(report.statuses.size()); ++i) {
+            const uint64_t interrupterAddress = runtimeAddress + 0x24 + (0x20 * i);
             if (verbose) {
                 std::wcout << std::endl;
                 std::wcout << L"interrupter_address = runtime_address + 0x24 + (0x20 * index) = "
                            << ToHex(runtimeAddress) << L" + 0x24 + (0x20 * " << i << L") = "
-                           << interrupterHex << std::endl;
-                std::wcout << L"Write IMOD interval = " << ToHex(desiredInterval) << std::endl;
+                           << ToHex(interrupterAddress) << std::endl;
+                std::wcout << L"Write IMOD interval = "
+                           << ToHex(i < plan.intervals.size() ? plan.intervals[i] : plan.interval) << std::endl;
             }
-
-            if (!WriteImodInterval(imodDriver, interrupterAddress, desiredInterval, &ioError)) {
+            const uint32_t failuresBefore = counts.failures;
+            CountImodStatus(report.statuses[i], &counts);
+            if (counts.failures != failuresBefore) {
                 std::wcout << L"error: failed to write IMOD interval at "
-                           << interrupterHex << L": " << ioError << std::endl;
-                ++writeFailures;
+                           << ToHex(interrupterAddress) << L": " << ImodStatusName(report.statuses[i]) << std::endl;
+            } else if (verbose) {
+                std::wcout << L"IMOD status = " << ImodStatusName(report.statuses[i]) << std::endl;
             }
         }
 
-        std::wcout << L"  writes = " << maxIntrs << L", failures = " << writeFailures << std::endl;
+        std::wcout << L"  written = " << counts.written << L", skipped = " << counts.skipped
+                   << L", verified = " << counts.verified << L", failures = " << counts.failures << std::endl;
+        std::wcout << L"  elapsed_us = " << (report.elapsedNs / 1000) << L", round_trips = " << report.operations
+                   << L", worker = " << report.worker << std::endl;
         std::wcout << std::endl;
+        if (maxIntrs > 0) {
+            // Only what was programmed is watched: a vector leaves the interrupters past it alone.
+            const uint32_t watched = plan.intervals.empty()
+                ? maxIntrs
+                : static_cast<uint32_t>(report.statuses.size());
+            watchdogControllers.push_back({runtimeAddress, watched, plan.interval, plan.intervals});
+            if (governorPeriodMs != 0) {
+                governorControllers.push_back({runtimeAddress, maxIntrs,
+                    MakeGovernorLimits(config, plan.interval, plan.governorMaxLatencyUs, plan.governorIrqBudget)});
+            }
+        }
+    }
+
+    if (governorPeriodMs != 0) {
+        return RunImodGovernor(imodDriver, governorControllers, governorPeriodMs);
+    }
+
+    if (samplePeriodMs != 0) {
+        return RunEventRingSampler(imodDriver, samplerControllers, samplePeriodMs, sampleCount);
+    }
+
+    std::vector<WatchdogNic> watchdogAdapters;
+    ApplyNicOverrides(imodDriver, config, applyFlags, verbose, &watchdogAdapters);
+    ApplyNvmeOverrides(config, applyFlags, verbose);
+
+    if (watchdogPeriodMs) {
+        std::wstring watchdogError;
+        const std::vector<WatchdogController> noControllers;
+        const std::vector<WatchdogNic> noAdapters;
+        if (!ConfigureWatchdog(imodDriver, *watchdogPeriodMs,
+                *watchdogPeriodMs != 0 ? watchdogControllers : noControllers,
+                *watchdogPeriodMs != 0 ? watchdogAdapters : noAdapters, &watchdogError)) {
+            std::wcout << L"error: " << watchdogError << std::endl;
+            return 1;
+        }
+        if (imodDriver.keepLoaded) {
+            std::wcout << L"watchdog = armed (" << watchdogControllers.size() << L" controllers, "
+                       << watchdogAdapters.size() << L" adapters, every "
+                       << *watchdogPeriodMs << L" ms)" << std::endl;
+        } else {
+            std::wcout << L"watchdog = off" << std::endl;
+        }
+    }
+
+    if (writeBootTable) {
+        if (bootControllers.empty() || bootControllers.size() > IMOD_BOOT_MAX_CONTROLLERS) {
+            std::wcout << L"error: boot table needs 1-" << IMOD_BOOT_MAX_CONTROLLERS
+                       << L" controllers, found " << bootControllers.size() << std::endl;
+            return 1;
+        }
+
+        // The table would sit in the registry with nothing to read it.
+        if (!DriverHandles(imodDriver, IoctlImodQueryBootStatus)) {
+            std::wcout << L"error: loaded DTIMOD.sys has no boot table support" << std::endl;
+            return 1;
+        }
+
+        std::wstring bootError;
+        if (!InstallBootTable(imodDriver, BuildBootTable(bootControllers), &bootError)) {
+            std::wcout << L"error: " << bootError << std::endl;
+            return 1;
+        }
+        if (!SetBootWatchdogPeriod(watchdogPeriodMs.value_or(0), &bootError)) {
+            std::wcout << L"error: " << bootError << std::endl;
+            return 1;
+        }
+        std::wcout << L"boot_table = written (" << bootControllers.size() << L" controllers)" << std::endl;
     }
 
     return 0;
@@ -0,0 +1,303 @@
+﻿#include "IMODApply.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "Common/imod_batch.h"
+#include "Common/imod_xhci.h"
+
+namespace {
+
+// What the batch path turned out not to support, shared by all workers so only the first
+// controller pays for finding out.
+struct ApplyState {
+    std::atomic<bool> batchUnsupported{false};
+    std::atomic<bool> batchFlagsUnsupported{false};
+};
+
+// Per-register counterpart of one ImodBatchApply entry: read IMOD, then with DIFF stop if it
+// already matches and read IMAN only once a write is due, write, and with VERIFY read back.
+enum class ChainStep {
+    ReadImod,
+    ReadIman,
+    Write,
+    Verify,
+};
+
+struct Chain {
+    uint32_t index = 0;
+    uint32_t interval = 0;
+    uint32_t current = 0;
+    uint64_t imanAddress = 0;
+    ChainStep step = ChainStep::ReadImod;
+    ImodApplyOp op;
+};
+
+uint32_t TargetInterval(const ImodApplyJob& job, uint32_t index) {
+    return (job.intervals.empty() ? job.interval : job.intervals[index]) & IMOD_XHCI_IMODI_MASK;
+}
+
+void Submit(ImodApplyChannel& channel, ImodApplyOp* op, ImodApplyOpKind kind, uint64_t address, uint32_t value,
+    ImodApplyReport* report) {
+    op->kind = kind;
+    op->address = address;
+    op->value = value;
+    op->result = ImodApplyOpResult::Success;
+    op->systemError = 0;
+    ++report->operations;
+    channel.Submit(op);
+}
+
+// HCSPARAMS and RTSOFF are independent, so with room for two they go out together.
+bool ReadLayout(ImodApplyChannel& channel, const ImodApplyJob& job, uint32_t depth, ImodApplyReport* report) {
+    ImodApplyOp hcsparams;
+    ImodApplyOp rtsoff;
+    Submit(channel, &hcsparams, ImodApplyOpKind::Read32, job.capabilityAddress + job.hcsparamsOffset, 0, report);
+    if (depth < 2) {
+        channel.WaitAny();
+    }
+    Submit(channel, &rtsoff, ImodApplyOpKind::Read32, job.capabilityAddress + job.rtsoffOffset, 0, report);
+    channel.WaitAny();
+    if (depth >= 2) {
+        channel.WaitAny();
+    }
+
+    for (const ImodApplyOp* op : {&hcsparams, &rtsoff}) {
+        if (op->result != ImodApplyOpResult::Success) {
+            report->failedStage = ImodApplyStage::Layout;
+            report->systemError = op->systemError;
+            return false;
+        }
+    }
+
+    report->hcsparams = hcsparams.value;
+    report->rtsoffValue = rtsoff.value;
+    report->maxIntrs = IMOD_XHCI_HCS1_MAX_INTRS(hcsparams.value);
+    report->runtimeAddress = job.capabilityAddress + (rtsoff.value & IMOD_XHCI_RTSOFF_MASK);
+    return true;
+}
+
+// Returns false when the caller should fall back to per-register access.
+bool ApplyBatch(ImodApplyChannel& channel, const ImodApplyJob& job, uint32_t count, ApplyState& state,
+    ImodApplyReport* report) {
+    uint32_t flags = state.batchFlagsUnsupported ? 0 : job.flags;
+    bool retriedWithoutFlags = false;
+    for (;;) {
+        ImodApplyOp op;
+        op.buffer.resize(sizeof(tagImodBatchHeader) + (static_cast<size_t>(count) * sizeof(ULONG)));
+        tagImodBatchHeader header{};
+        header.version = IMOD_BATCH_VERSION;
+        header.count = count;
+        header.capabilityAddress = job.capabilityAddress;
+        header.barLength = job.barLength;
+        header.hcsparamsOffset = job.hcsparamsOffset;
+        header.rtsoffOffset = job.rtsoffOffset;
+        header.flags = flags;
+        std::memcpy(op.buffer.data(), &header, sizeof(header));
+        for (uint32_t i = 0; i < count; ++i) {
+            const ULONG entry = TargetInterval(job, i);
+            std::memcpy(op.buffer.data() + sizeof(header) + (i * sizeof(ULONG)), &entry, sizeof(entry));
+        }
+
+        Submit(channel, &op, ImodApplyOpKind::Batch, job.capabilityAddress, 0, report);
+        channel.WaitAny();
+
+        if (op.result == ImodApplyOpResult::Success) {
+            report->statuses.resize(count);
+            std::memcpy(report->statuses.data(), op.buffer.data() + sizeof(header), count * sizeof(ULONG));
+            report->batched = true;
+            report->ok = true;
+            return true;
+        }
+        if (op.result == ImodApplyOpResult::Unsupported) {
+            state.batchUnsupported = true;
+            return false;
+        }
+        if (op.result == ImodApplyOpResult::Rejected && flags != 0) {
+            state.batchFlagsUnsupported = true;
+            flags = 0;
+            retriedWithoutFlags = true;
+            continue;
+        }
+        if (op.result == ImodApplyOpResult::Rejected && retriedWithoutFlags) {
+            // Rejected with and without flags: the flags were not the problem.
+            state.batchFlagsUnsupported = false;
+        }
+
+        report->failedStage = ImodApplyStage::Batch;
+        report->systemError = op.systemError;
+        return true;
+    }
+}
+
+// Moves a chain on after its op finished. Returns true with `status` set once the
+// interrupter is done.
+bool AdvanceChain(ImodApplyChannel& channel, const ImodApplyJob& job, Chain& chain, ImodApplyReport* report,
+    uint32_t* status) {
+    const bool succeeded = chain.op.result == ImodApplyOpResult::Success;
+    const uint64_t imodAddress = chain.imanAddress + IMOD_XHCI_IMOD_OFFSET;
+    switch (chain.step) {
+    case ChainStep::ReadImod:
+        if (!succeeded) {
+            *status = IMOD_BATCH_STATUS_READ_FAILED;
+            return true;
+        }
+        chain.current = chain.op.value;
+        if ((job.flags & IMOD_BATCH_FLAG_DIFF) != 0) {
+            if ((chain.current & IMOD_XHCI_IMODI_MASK) == chain.interval) {
+                *status = IMOD_BATCH_STATUS_UNCHANGED;
+                return true;
+            }
+            chain.step = ChainStep::ReadIman;
+            Submit(channel, &chain.op, ImodApplyOpKind::Read32, chain.imanAddress, 0, report);
+            return false;
+        }
+        break;
+    case ChainStep::ReadIman:
+        if (!succeeded) {
+            *status = IMOD_BATCH_STATUS_READ_FAILED;
+            return true;
+        }
+        if ((chain.op.value & IMOD_XHCI_IMAN_IE) == 0) {
+            *status = IMOD_BATCH_STATUS_INACTIVE;
+            return true;
+        }
+        break;
+    case ChainStep::Write:
+        if (!succeeded) {
+            *status = IMOD_BATCH_STATUS_WRITE_FAILED;
+            return true;
+        }
+        if ((job.flags & IMOD_BATCH_FLAG_VERIFY) == 0) {
+            *status = IMOD_BATCH_STATUS_WRITTEN;
+            return true;
+        }
+        chain.step = ChainStep::Verify;
+        Submit(channel, &chain.op, ImodApplyOpKind::Read32, imodAddress, 0, report);
+        return false;
+    case ChainStep::Verify:
+        *status = succeeded && (chain.op.value & IMOD_XHCI_IMODI_MASK) == chain.interval
+            ? IMOD_BATCH_STATUS_VERIFIED
+            : IMOD_BATCH_STATUS_VERIFY_FAILED;
+        return true;
+    }
+
+    chain.step = ChainStep::Write;
+    Submit(channel, &chain.op, ImodApplyOpKind::Write32, imodAddress,
+        (chain.current & IMOD_XHCI_IMODC_MASK) | chain.interval, report);
+    return false;
+}
+
+// Up to `depth` interrupters are in flight at once, each with one op outstanding.
+void ApplyPerRegister(ImodApplyChannel& channel, const ImodApplyJob& job, uint32_t count, uint32_t depth,
+    ImodApplyReport* report) {
+    report->statuses.assign(count, IMOD_BATCH_STATUS_READ_FAILED);
+    std::vector<Chain> chains(std::min(depth, count));
+    uint32_t next = 0;
+    uint32_t active = 0;
+
+    const auto start = [&](Chain& chain) {
+        if (next >= count) {
+            return false;
+        }
+        chain.index = next++;
+        chain.interval = TargetInterval(job, chain.index);
+        chain.imanAddress = report->runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(chain.index) + IMOD_XHCI_IMAN_OFFSET;
+        chain.step = ChainStep::ReadImod;
+        Submit(channel, &chain.op, ImodApplyOpKind::Read32, chain.imanAddress + IMOD_XHCI_IMOD_OFFSET, 0, report);
+        return true;
+    };
+
+    for (Chain& chain : chains) {
+        active += start(chain) ? 1 : 0;
+    }
+
+    while (active > 0) {
+        ImodApplyOp* done = channel.WaitAny();
+        const auto found = std::find_if(chains.begin(), chains.end(), [done](const Chain& c) { return &c.op == done; });
+        if (found == chains.end()) {
+            continue;
+        }
+
+        uint32_t status = IMOD_BATCH_STATUS_READ_FAILED;
+        if (AdvanceChain(channel, job, *found, report, &status)) {
+            report->statuses[found->index] = status;
+            if (!start(*found)) {
+                --active;
+            }
+        }
+    }
+
+    report->ok = true;
+}
+
+void RunJob(ImodApplyChannel& channel, const ImodApplyJob& job, uint32_t depth, bool useBatch, ApplyState& state,
+    ImodApplyReport* report) {
+    if (!ReadLayout(channel, job, depth, report)) {
+        return;
+    }
+
+    const uint32_t count = job.intervals.empty()
+        ? report->maxIntrs
+        : std::min(report->maxIntrs, static_cast<uint32_t>(job.intervals.size()));
+    if (job.layoutOnly || count == 0) {
+        report->ok = true;
+        return;
+    }
+
+    if (useBatch && !state.batchUnsupported && ApplyBatch(channel, job, count, state, report)) {
+        return;
+    }
+    ApplyPerRegister(channel, job, count, depth, report);
+}
+
+}  // namespace
+
+std::vector<ImodApplyReport> RunImodApply(
+    ImodApplyBackend& backend, const std::vector<ImodApplyJob>& jobs, const ImodApplyOptions& options) {
+    std::vector<ImodApplyReport> reports(jobs.size());
+    if (jobs.empty()) {
+        return reports;
+    }
+
+    const uint32_t workers = std::min<uint32_t>(
+        std::clamp<uint32_t>(options.workers, 1, kImodApplyMaxWorkers), static_cast<uint32_t>(jobs.size()));
+    const uint32_t depth = std::clamp<uint32_t>(options.depth, 1, kImodApplyMaxDepth);
+    ApplyState state;
+    std::atomic<size_t> nextJob{0};
+
+    const auto work = [&](uint32_t worker) {
+        std::unique_ptr<ImodApplyChannel> channel = backend.OpenChannel();
+        for (size_t index = nextJob++; index < jobs.size(); index = nextJob++) {
+            ImodApplyReport& report = reports[index];
+            report.worker = worker;
+            if (!channel) {
+                report.failedStage = ImodApplyStage::Channel;
+                continue;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            RunJob(*channel, jobs[index], depth, options.batch, state, &report);
+            report.elapsedNs = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+    };
+
+    if (workers == 1) {
+        work(0);
+        return reports;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (uint32_t worker = 0; worker < workers; ++worker) {
+        threads.emplace_back(work, worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return reports;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Multi-controller IMOD apply. Controllers are spread over a small worker pool; each worker
+// owns one backend channel and keeps up to `depth` register operations of its controller in
+// flight. Reports come back in job order whatever order the workers finish in, so output
+// built from them is deterministic.
+
+constexpr uint32_t kImodApplyMaxWorkers = 16;
+constexpr uint32_t kImodApplyMaxDepth = 64;
+
+enum class ImodApplyOpKind : uint32_t {
+    Read32,
+    Write32,
+    Batch,
+};
+
+enum class ImodApplyOpResult : uint32_t {
+    Success,
+    Failed,
+    // The backend has no batch path (a DTIMOD.sys without IOCTL_IMOD_APPLY_BATCH).
+    Unsupported,
+    // The backend refused the request as malformed; for a batch with flags this is a driver
+    // that predates IMOD_BATCH_FLAG_*.
+    Rejected,
+};
+
+// One register access or batch request. A batch carries tagImodBatchHeader plus entries in
+// `buffer` and gets the reply back in place.
+struct ImodApplyOp {
+    ImodApplyOpKind kind = ImodApplyOpKind::Read32;
+    uint64_t address = 0;
+    uint32_t value = 0;
+    std::vector<unsigned char> buffer;
+    ImodApplyOpResult result = ImodApplyOpResult::Success;
+    uint32_t systemError = 0;
+};
+
+// Outstanding-operation queue used by one worker only. Submit starts an op, possibly finishing
+// it on the spot; every submitted op, failed or not, comes back exactly once from WaitAny.
+class ImodApplyChannel {
+public:
+    virtual ~ImodApplyChannel() = default;
+    virtual void Submit(ImodApplyOp* op) = 0;
+    virtual ImodApplyOp* WaitAny() = 0;
+};
+
+class ImodApplyBackend {
+public:
+    virtual ~ImodApplyBackend() = default;
+    virtual std::unique_ptr<ImodApplyChannel> OpenChannel() = 0;
+};
+
+struct ImodApplyJob {
+    uint64_t capabilityAddress = 0;
+    uint64_t barLength = 0;
+    uint32_t hcsparamsOffset = 0;
+    uint32_t rtsoffOffset = 0;
+    uint32_t interval = 0;
+    // Per-interrupter intervals; empty programs `interval` on every interrupter.
+    std::vector<uint32_t> intervals;
+    uint32_t flags = 0;
+    // Read HCSPARAMS and RTSOFF only.
+    bool layoutOnly = false;
+};
+
+enum class ImodApplyStage : uint32_t {
+    None,
+    Channel,
+    Layout,
+    Batch,
+};
+
+struct ImodApplyReport {
+    bool ok = false;
+    ImodApplyStage failedStage = ImodApplyStage::None;
+    uint32_t systemError = 0;
+    uint32_t hcsparams = 0;
+    uint32_t rtsoffValue = 0;
+    uint32_t maxIntrs = 0;
+    uint64_t runtimeAddress = 0;
+    bool batched = false;
+    // IMOD_BATCH_STATUS_* per programmed interrupter, from the batch or the per-register path.
+    std::vector<uint32_t> statuses;
+    uint32_t operations = 0;
+    uint32_t worker = 0;
+    uint64_t elapsedNs = 0;
+};
+
+struct ImodApplyOptions {
+    uint32_t workers = 4;
+    uint32_t depth = 8;
+    bool batch = true;
+};
+
+std::vector<ImodApplyReport> RunImodApply(
+    ImodApplyBackend& backend, const std::vector<ImodApplyJob>& jobs, const ImodApplyOptions& options);
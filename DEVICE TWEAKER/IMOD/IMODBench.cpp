@@ -0,0 +1,3955 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "IMODApply.h"
+#include "IMODWatch.h"
+#include "Common/imod_affinity.h"
+#include "Common/imod_batch.h"
+#include "Common/imod_boot.h"
+#include "Common/imod_budget.h"
+#include "Common/imod_cpuset.h"
+#include "Common/imod_governor.h"
+#include "Common/imod_latency.h"
+#include "Common/imod_msix.h"
+#include "Common/imod_nic.h"
+#include "Common/imod_nicsampler.h"
+#include "Common/imod_nvme.h"
+#include "Common/imod_rss.h"
+#include "Common/imod_sampler.h"
+#include "Common/imod_session.h"
+#include "Common/imod_simulator.h"
+#include "Common/imod_topology.h"
+#include "Common/imod_watchdog.h"
+
+// Cost of IMOD.exe and DTIMOD operations against the simulated controller. Register
+// accesses, maps and the simulated latency come from the simulator's counters; round
+// trips are user/kernel transitions the same operation costs on a real machine: one per
+// IOCTL, so an engine that runs inside DTIMOD (batch, topology) is one round trip however
+// many registers it touches, while the single-register path pays one per access. The
+// engine_* cases run the IMOD.exe apply engine over several controllers at once, and the
+// watch_* cases replay a script of device, power and config events through IMOD.exe --watch.
+// The topology_cached_* cases keep one topology cache across iterations, as DTIMOD keeps one
+// per controller across queries. The budget_* cases run the interrupt budget estimator over
+// machine snapshots instead of the controller, the affinity_* cases the affinity planner, the
+// cpuset_* cases the processor-group bitset encoders, the topology_route_* cases the port
+// path helpers behind ROUTE_ROLES, the msix_* cases the MSI/MSI-X decoder
+// over captured config spaces and tables, the nic_* cases the NIC queue sampler over a
+// simulated register window, the nicitr_* cases the NIC ITR registry and masked apply, the
+// watchdog_* cases the drift watchdog holding a NIC ITR apply, the boot_* cases DTIMOD's boot
+// table apply over controllers that mismatch or sit in D3, the sampler_* cases the event ring
+// sampler against known ERDP movement, the governor_* cases the adaptive interval governor
+// over event rate traces, the latency_* cases IMODSim's moderation model, the rss_* cases the
+// RSS planner's Toeplitz kernel over synthetic flows, and the nvme_* cases the NVMe interrupt
+// coalescing planner and apply against a mock controller.
+
+namespace {
+
+constexpr uint32_t kHcsparamsOffset = IMOD_XHCI_HCSPARAMS1_OFFSET;
+constexpr uint32_t kRtsoffOffset = IMOD_XHCI_RTSOFF_OFFSET;
+constexpr uint32_t kInterval = 0x3E8;
+constexpr uint32_t kSweepMaxSlots = 255;
+constexpr uint32_t kAdaptiveSlotCapacity = 4;
+constexpr uint32_t kAdaptiveEndpointCapacity = 16;
+constexpr uint32_t kDefaultIterations = 20;
+constexpr uint32_t kEngineControllers = 4;
+constexpr uint32_t kEngineDepth = 8;
+constexpr uint64_t kControllerBarStride = 0x100000;
+constexpr uint64_t kControllerMemoryStride = 0x10000000;
+constexpr uint32_t kWatchControllers = 5;
+constexpr uint32_t kResetInterval = 0xFA0;
+
+const std::vector<uint32_t> kInterrupterSweep = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+const std::vector<uint32_t> kSlotSweep = {1, 8, 32, 128, 255};
+const std::vector<uint32_t> kQuickInterrupterSweep = {1, 8, 1024};
+const std::vector<uint32_t> kQuickSlotSweep = {1, 255};
+
+struct Options {
+    uint32_t iterations = kDefaultIterations;
+    uint32_t readLatencyNs = 0;
+    uint32_t writeLatencyNs = 0;
+    uint32_t mapLatencyNs = 0;
+    bool stall = false;
+    bool quick = false;
+    bool json = false;
+    std::string outputPath;
+    std::string baselinePath;
+};
+
+struct Counters {
+    uint64_t roundTrips = 0;
+    uint64_t maps = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t simulatedNs = 0;
+};
+
+struct Result {
+    std::string name;
+    uint32_t interrupters = 0;
+    uint32_t slots = 0;
+    bool ok = true;
+    Counters counters{};
+    uint64_t wallNs = 0;
+};
+
+struct SimulatorDeleter {
+    void operator()(IMOD_SIMULATOR* simulator) const { std::free(simulator); }
+};
+
+using SimulatorPtr = std::unique_ptr<IMOD_SIMULATOR, SimulatorDeleter>;
+
+// Wall time with --stall has to include the simulated latency, so spin instead of sleeping.
+void SpinStall(PVOID, ULONG nanoseconds) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nanoseconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+    }
+}
+
+bool TryParseUint32(const char* text, uint32_t* value) {
+    char* end = nullptr;
+    const unsigned long long parsed = std::strtoull(text, &end, 0);
+    if (end == text || *end != '\0' || parsed > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    *value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+// Devices get a control endpoint plus bulk in/out and spread over ports and interrupters
+// the way a loaded desktop controller looks.
+SimulatorPtr MakeController(uint32_t interrupters, uint32_t slots, const Options& options, uint32_t ordinal = 0) {
+    IMOD_SIMULATOR_CONFIG config{};
+    ImodSimulatorDefaultConfig(&config);
+    config.BarAddress += ordinal * kControllerBarStride;
+    config.MemoryAddress += ordinal * kControllerMemoryStride;
+    config.MaxIntrs = interrupters;
+    config.MaxSlots = kSweepMaxSlots;
+    config.MaxPorts = 32;
+    config.EventRingTrbs = IMOD_XHCI_MIN_EVENT_SEGMENT_TRBS;
+
+    const SIZE_T size = ImodSimulatorRequiredSize(&config);
+    SimulatorPtr simulator(static_cast<IMOD_SIMULATOR*>(std::calloc(1, size)));
+    if (!simulator || ImodSimulatorInitialize(simulator.get(), size, &config) != IMOD_RESULT_SUCCESS) {
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < slots; ++i) {
+        IMOD_SIMULATOR_DEVICE device{};
+        device.RootPort = 1 + (i % config.MaxPorts);
+        device.RouteString = i < config.MaxPorts ? 0 : ((i / config.MaxPorts) & 0xF);
+        device.Interrupter = i % interrupters;
+        device.EndpointTypes[0] = IMOD_XHCI_EP_TYPE_CONTROL;
+        device.EndpointTypes[2] = 2;
+        device.EndpointTypes[3] = 6;
+        ULONG slotId = 0;
+        if (ImodSimulatorAttachDevice(simulator.get(), &device, &slotId) != IMOD_RESULT_SUCCESS) {
+            return nullptr;
+        }
+    }
+
+    simulator->Timing.ReadLatencyNs = options.readLatencyNs;
+    simulator->Timing.WriteLatencyNs = options.writeLatencyNs;
+    simulator->Timing.MapLatencyNs = options.mapLatencyNs;
+    if (options.stall) {
+        simulator->Stall = SpinStall;
+    }
+    return simulator;
+}
+
+uint64_t CapabilityAddress(const IMOD_SIMULATOR& simulator) {
+    return simulator.Config.BarAddress;
+}
+
+// IMOD.exe's single-register path: map, access and unmap per IOCTL.
+bool ReadRegister32(const IMOD_PLATFORM& platform, Counters* counters, uint64_t address, ULONG* value) {
+    IMOD_REGISTER_WINDOW window{};
+    ++counters->roundTrips;
+    if (!platform.MapWindow(platform.Context, address, sizeof(ULONG), &window)) {
+        return false;
+    }
+    const bool readOk = platform.Read32(platform.Context, &window, 0, value) != FALSE;
+    platform.UnmapWindow(platform.Context, &window);
+    return readOk;
+}
+
+bool WriteRegister32(const IMOD_PLATFORM& platform, Counters* counters, uint64_t address, ULONG value) {
+    IMOD_REGISTER_WINDOW window{};
+    ++counters->roundTrips;
+    if (!platform.MapWindow(platform.Context, address, sizeof(ULONG), &window)) {
+        return false;
+    }
+    const bool writeOk = platform.Write32(platform.Context, &window, 0, value) != FALSE;
+    platform.UnmapWindow(platform.Context, &window);
+    return writeOk;
+}
+
+bool ReadLayout(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters,
+    uint32_t* maxIntrs, uint64_t* runtimeAddress) {
+    ULONG hcsparams = 0;
+    ULONG rtsoff = 0;
+    if (!ReadRegister32(platform, counters, CapabilityAddress(simulator) + kHcsparamsOffset, &hcsparams) ||
+        !ReadRegister32(platform, counters, CapabilityAddress(simulator) + kRtsoffOffset, &rtsoff)) {
+        return false;
+    }
+    *maxIntrs = IMOD_XHCI_HCS1_MAX_INTRS(hcsparams);
+    *runtimeAddress = CapabilityAddress(simulator) + (rtsoff & IMOD_XHCI_RTSOFF_MASK);
+    return true;
+}
+
+bool ApplyBatch(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters, bool vector,
+    uint32_t flags) {
+    const uint32_t count = simulator.Config.MaxIntrs;
+    std::vector<unsigned char> buffer(sizeof(tagImodBatchHeader) + (count * sizeof(ULONG)));
+    tagImodBatchHeader header{};
+    header.version = IMOD_BATCH_VERSION;
+    header.count = count;
+    header.capabilityAddress = CapabilityAddress(simulator);
+    header.barLength = simulator.BarLength;
+    header.hcsparamsOffset = kHcsparamsOffset;
+    header.rtsoffOffset = kRtsoffOffset;
+    header.flags = flags;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    // A vector gives the primary interrupter its own value, as role-based tables do.
+    auto* entries = reinterpret_cast<ULONG*>(buffer.data() + sizeof(header));
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i] = vector && i == 0 ? kInterval / 2 : kInterval;
+    }
+
+    ULONG bytesReturned = 0;
+    ++counters->roundTrips;
+    if (ImodBatchApply(&platform, buffer.data(), static_cast<ULONG>(buffer.size()),
+            static_cast<ULONG>(buffer.size()), &bytesReturned) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    return header.failed == 0;
+}
+
+bool ApplyPerRegister(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    uint32_t maxIntrs = 0;
+    uint64_t runtimeAddress = 0;
+    if (!ReadLayout(platform, simulator, counters, &maxIntrs, &runtimeAddress)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < maxIntrs; ++i) {
+        const uint64_t address = runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(i) + IMOD_XHCI_IMOD_OFFSET;
+        ULONG current = 0;
+        if (!ReadRegister32(platform, counters, address, &current) ||
+            !WriteRegister32(platform, counters, address, (current & IMOD_XHCI_IMODC_MASK) | kInterval)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadbackPerRegister(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    uint32_t maxIntrs = 0;
+    uint64_t runtimeAddress = 0;
+    if (!ReadLayout(platform, simulator, counters, &maxIntrs, &runtimeAddress)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < maxIntrs; ++i) {
+        ULONG value = 0;
+        if (!ReadRegister32(platform, counters,
+                runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(i) + IMOD_XHCI_IMOD_OFFSET, &value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The GUI's readback: layout through single reads, then one session over the runtime registers.
+bool ReadbackSession(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    uint32_t maxIntrs = 0;
+    uint64_t runtimeAddress = 0;
+    if (!ReadLayout(platform, simulator, counters, &maxIntrs, &runtimeAddress)) {
+        return false;
+    }
+
+    IMOD_SESSION_TABLE table{};
+    ImodSessionTableInitialize(&table);
+    const uint64_t capabilityAddress = CapabilityAddress(simulator);
+    const ULONG length = static_cast<ULONG>(runtimeAddress - capabilityAddress) + IMOD_XHCI_RUNTIME_WINDOW_SIZE(maxIntrs);
+    ULONG sessionId = 0;
+    ++counters->roundTrips;
+    if (ImodSessionOpen(&platform, &table, capabilityAddress, length, &sessionId) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+
+    bool ok = true;
+    for (uint32_t i = 0; i < maxIntrs && ok; ++i) {
+        ULONGLONG value = 0;
+        const ULONG offset = static_cast<ULONG>(runtimeAddress - capabilityAddress) +
+            IMOD_XHCI_INTERRUPTER_OFFSET(i) + IMOD_XHCI_IMOD_OFFSET;
+        ++counters->roundTrips;
+        ok = ImodSessionRead(&platform, &table, sessionId, offset, sizeof(ULONG), &value) == IMOD_RESULT_SUCCESS;
+    }
+
+    ++counters->roundTrips;
+    ImodSessionClose(&platform, &table, sessionId);
+    return ok;
+}
+
+bool QueryTopology(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters,
+    uint32_t slotCapacity, uint32_t endpointCapacity, uint32_t* truncated) {
+    std::vector<unsigned char> buffer(sizeof(tagImodTopologyHeader) +
+        (slotCapacity * sizeof(tagImodTopologySlot)) + (endpointCapacity * sizeof(tagImodTopologyEndpoint)));
+    tagImodTopologyHeader header{};
+    header.version = IMOD_TOPOLOGY_VERSION;
+    header.capabilityAddress = CapabilityAddress(simulator);
+    header.barLength = simulator.BarLength;
+    header.hcsparamsOffset = kHcsparamsOffset;
+    header.slotCapacity = slotCapacity;
+    header.endpointCapacity = endpointCapacity;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    ULONG bytesReturned = 0;
+    ++counters->roundTrips;
+    if (ImodTopologySnapshot(&platform, buffer.data(), static_cast<ULONG>(buffer.size()),
+            static_cast<ULONG>(buffer.size()), &bytesReturned) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    *truncated = header.truncated;
+    return true;
+}
+
+// What the GUI does today: one query sized for the worst case.
+bool TopologyFull(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    uint32_t truncated = 0;
+    return QueryTopology(platform, simulator, counters, IMOD_XHCI_MAX_SLOTS,
+        IMOD_XHCI_MAX_SLOTS * IMOD_XHCI_MAX_CONTEXT_ENTRIES, &truncated) && truncated == 0;
+}
+
+// Small first query, doubled while the driver reports truncation.
+bool TopologyAdaptive(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    uint32_t slotCapacity = kAdaptiveSlotCapacity;
+    uint32_t endpointCapacity = kAdaptiveEndpointCapacity;
+    for (;;) {
+        uint32_t truncated = 0;
+        if (!QueryTopology(platform, simulator, counters, slotCapacity, endpointCapacity, &truncated)) {
+            return false;
+        }
+        if (truncated == 0) {
+            return true;
+        }
+        if ((truncated & IMOD_TOPOLOGY_TRUNCATED_SLOTS) != 0) {
+            slotCapacity = std::min<uint32_t>(slotCapacity * 2, IMOD_XHCI_MAX_SLOTS);
+        }
+        if ((truncated & IMOD_TOPOLOGY_TRUNCATED_ENDPOINTS) != 0) {
+            endpointCapacity = std::min<uint32_t>(endpointCapacity * 2, IMOD_XHCI_MAX_SLOTS * IMOD_XHCI_MAX_CONTEXT_ENTRIES);
+        }
+    }
+}
+
+IMOD_TOPOLOGY_CACHE& TopologyCache() {
+    static const std::unique_ptr<IMOD_TOPOLOGY_CACHE> cache = std::make_unique<IMOD_TOPOLOGY_CACHE>();
+    return *cache;
+}
+
+// A full-capacity query through the shared cache. With `reply` and `expected`, the records it
+// returned are compared against an uncached walk of the same controller.
+bool QueryTopologyCached(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters,
+    uint32_t flags, tagImodTopologyWalk* walk, std::vector<unsigned char>* reply = nullptr,
+    std::vector<unsigned char>* expected = nullptr) {
+    const uint32_t slotCapacity = IMOD_XHCI_MAX_SLOTS;
+    const uint32_t endpointCapacity = IMOD_XHCI_MAX_SLOTS * IMOD_XHCI_MAX_CONTEXT_ENTRIES;
+    const size_t recordsLength = sizeof(tagImodTopologyHeader) + (slotCapacity * sizeof(tagImodTopologySlot)) +
+        (endpointCapacity * sizeof(tagImodTopologyEndpoint));
+    std::vector<unsigned char> buffer(recordsLength + sizeof(tagImodTopologyWalk));
+    tagImodTopologyHeader header{};
+    header.version = IMOD_TOPOLOGY_VERSION;
+    header.flags = IMOD_TOPOLOGY_FLAG_WALK | flags;
+    header.capabilityAddress = CapabilityAddress(simulator);
+    header.barLength = simulator.BarLength;
+    header.hcsparamsOffset = kHcsparamsOffset;
+    header.slotCapacity = slotCapacity;
+    header.endpointCapacity = endpointCapacity;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    ULONG bytesReturned = 0;
+    ++counters->roundTrips;
+    if (ImodTopologySnapshotCached(&platform, &TopologyCache(), buffer.data(), static_cast<ULONG>(buffer.size()),
+            static_cast<ULONG>(buffer.size()), &bytesReturned) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    std::memcpy(walk, buffer.data() + recordsLength, sizeof(*walk));
+    if (expected == nullptr) {
+        return true;
+    }
+
+    // Same request without flags, which are then the only bytes allowed to differ.
+    expected->assign(recordsLength, 0);
+    header.flags = 0;
+    std::memcpy(expected->data(), &header, sizeof(header));
+    if (ImodTopologySnapshot(&platform, expected->data(), static_cast<ULONG>(expected->size()),
+            static_cast<ULONG>(expected->size()), &bytesReturned) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    reply->assign(buffer.begin(), buffer.begin() + recordsLength);
+    std::memcpy(reply->data() + offsetof(tagImodTopologyHeader, flags),
+        expected->data() + offsetof(tagImodTopologyHeader, flags), sizeof(header.flags));
+    return true;
+}
+
+// First query after the cache was dropped: every slot is read.
+bool TopologyCachedCold(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    tagImodTopologyWalk walk{};
+    return QueryTopologyCached(platform, simulator, counters, IMOD_TOPOLOGY_FLAG_REFRESH, &walk) &&
+        walk.slotsRead == simulator.SlotCount && walk.slotsReused == 0;
+}
+
+// Nothing changed since the last query: every slot is replayed.
+bool TopologyCachedWarm(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    tagImodTopologyWalk walk{};
+    return QueryTopologyCached(platform, simulator, counters, 0, &walk) && walk.slotsRead == 0 &&
+        walk.slotsReused == simulator.SlotCount;
+}
+
+// One device moved to another interrupter since the last query: only its slot is read.
+bool TopologyCachedChurn(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    auto* mutableSimulator = static_cast<IMOD_SIMULATOR*>(platform.Context);
+    unsigned char* slotContext = mutableSimulator->Memory + mutableSimulator->DeviceOffset;
+    ULONG dword2 = 0;
+    std::memcpy(&dword2, slotContext + 0x8, sizeof(dword2));
+    dword2 ^= 1UL << 22;
+    std::memcpy(slotContext + 0x8, &dword2, sizeof(dword2));
+
+    tagImodTopologyWalk walk{};
+    return QueryTopologyCached(platform, simulator, counters, 0, &walk) && walk.slotsRead == 1 &&
+        walk.slotsReused + 1 == simulator.SlotCount;
+}
+
+// Whatever the measured runs left in the cache has to replay to exactly an uncached walk.
+bool TopologyCacheMatches(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    tagImodTopologyWalk walk{};
+    std::vector<unsigned char> reply;
+    std::vector<unsigned char> expected;
+    return QueryTopologyCached(platform, simulator, counters, 0, &walk, &reply, &expected) &&
+        walk.slotsRead == 0 && reply == expected;
+}
+
+using BenchCase = bool (*)(const IMOD_PLATFORM&, const IMOD_SIMULATOR&, Counters*);
+
+bool ApplyFull(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    return ApplyBatch(platform, simulator, counters, false, 0);
+}
+
+bool ApplyVector(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    return ApplyBatch(platform, simulator, counters, true, 0);
+}
+
+// The startup apply on a machine that is already tuned: everything is read, nothing written.
+bool ApplyRerun(const IMOD_PLATFORM& platform, const IMOD_SIMULATOR& simulator, Counters* counters) {
+    return ApplyBatch(platform, simulator, counters, false, IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY);
+}
+
+// `prime` runs once on the fresh controller before any measured iteration, `check` once
+// after the last one.
+struct BenchEntry {
+    const char* name;
+    BenchCase run;
+    BenchCase prime;
+    BenchCase check = nullptr;
+};
+
+const std::vector<BenchEntry> kCases = {
+    {"apply_full", ApplyFull, nullptr},
+    {"apply_vector", ApplyVector, nullptr},
+    {"apply_rerun", ApplyRerun, ApplyFull},
+    {"apply_register", ApplyPerRegister, nullptr},
+    {"readback_register", ReadbackPerRegister, nullptr},
+    {"readback_session", ReadbackSession, nullptr},
+    {"topology_full", TopologyFull, nullptr},
+    {"topology_adaptive", TopologyAdaptive, nullptr},
+    {"topology_cached_cold", TopologyCachedCold, nullptr, TopologyCacheMatches},
+    {"topology_cached_warm", TopologyCachedWarm, TopologyCachedCold, TopologyCacheMatches},
+    {"topology_cached_churn", TopologyCachedChurn, TopologyCachedCold, TopologyCacheMatches},
+};
+
+Result RunCase(const BenchEntry& entry, uint32_t interrupters, uint32_t slots, const Options& options) {
+    Result result{entry.name, interrupters, slots};
+    SimulatorPtr simulator = MakeController(interrupters, slots, options);
+    if (!simulator) {
+        result.ok = false;
+        return result;
+    }
+
+    IMOD_PLATFORM platform{};
+    ImodSimulatorInitializePlatform(simulator.get(), &platform);
+    if (entry.prime != nullptr) {
+        Counters primeCounters;
+        if (!entry.prime(platform, *simulator, &primeCounters)) {
+            result.ok = false;
+            return result;
+        }
+    }
+
+    // Counts are per run and must not depend on the iteration; wall time is the mean.
+    uint64_t totalNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        Counters counters;
+        simulator->Stats = {};
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = entry.run(platform, *simulator, &counters);
+        totalNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        counters.maps = simulator->Stats.Maps;
+        counters.reads = simulator->Stats.Reads;
+        counters.writes = simulator->Stats.Writes;
+        counters.simulatedNs = simulator->Stats.ElapsedNs;
+        result.counters = counters;
+        result.ok = result.ok && ok;
+    }
+
+    if (entry.check != nullptr) {
+        Counters checkCounters;
+        result.ok = result.ok && entry.check(platform, *simulator, &checkCounters);
+    }
+
+    result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    return result;
+}
+
+// Apply-engine backend over simulated controllers. An op runs against its controller when it
+// is submitted and, with --stall, only comes back from WaitAny once the simulated latency of
+// its accesses has passed, so ops in flight overlap their latency the way overlapped IOCTLs
+// do. Controllers are locked individually; workers on different controllers never contend.
+class SimulatedApplyBackend final : public ImodApplyBackend {
+public:
+    SimulatedApplyBackend(const std::vector<SimulatorPtr>& simulators, bool stall) : stall_(stall) {
+        for (const SimulatorPtr& simulator : simulators) {
+            auto controller = std::make_unique<Controller>();
+            controller->simulator = simulator.get();
+            ImodSimulatorInitializePlatform(simulator.get(), &controller->platform);
+            controllers_.push_back(std::move(controller));
+        }
+    }
+
+    std::unique_ptr<ImodApplyChannel> OpenChannel() override {
+        return std::make_unique<Channel>(this);
+    }
+
+private:
+    struct Controller {
+        IMOD_SIMULATOR* simulator = nullptr;
+        IMOD_PLATFORM platform{};
+        std::mutex lock;
+    };
+
+    class Channel final : public ImodApplyChannel {
+    public:
+        explicit Channel(SimulatedApplyBackend* backend) : backend_(backend) {}
+
+        void Submit(ImodApplyOp* op) override {
+            const uint64_t costNs = backend_->Execute(op);
+            const auto due = std::chrono::steady_clock::now() +
+                std::chrono::nanoseconds(backend_->stall_ ? costNs : 0);
+            pending_.push_back({due, op});
+        }
+
+        ImodApplyOp* WaitAny() override {
+            const auto next = std::min_element(pending_.begin(), pending_.end(),
+                [](const Pending& a, const Pending& b) { return a.due < b.due; });
+            // Yield rather than spin: the other workers' ops are due meanwhile.
+            while (std::chrono::steady_clock::now() < next->due) {
+                std::this_thread::yield();
+            }
+            ImodApplyOp* op = next->op;
+            pending_.erase(next);
+            return op;
+        }
+
+    private:
+        struct Pending {
+            std::chrono::steady_clock::time_point due;
+            ImodApplyOp* op = nullptr;
+        };
+
+        SimulatedApplyBackend* backend_;
+        std::vector<Pending> pending_;
+    };
+
+    // Returns the simulated cost of the op in nanoseconds.
+    uint64_t Execute(ImodApplyOp* op) {
+        const auto found = std::find_if(controllers_.begin(), controllers_.end(), [op](const auto& controller) {
+            const uint64_t base = controller->simulator->Config.BarAddress;
+            return op->address >= base && op->address < base + controller->simulator->BarLength;
+        });
+        if (found == controllers_.end()) {
+            op->result = ImodApplyOpResult::Failed;
+            return 0;
+        }
+
+        Controller& controller = **found;
+        std::lock_guard<std::mutex> guard(controller.lock);
+        const IMOD_PLATFORM& platform = controller.platform;
+        const uint64_t before = controller.simulator->Stats.ElapsedNs;
+        if (op->kind == ImodApplyOpKind::Batch) {
+            ULONG bytesReturned = 0;
+            const ULONG length = static_cast<ULONG>(op->buffer.size());
+            const ULONG result = ImodBatchApply(&platform, op->buffer.data(), length, length, &bytesReturned);
+            op->result = result == IMOD_RESULT_SUCCESS ? ImodApplyOpResult::Success
+                : result == IMOD_RESULT_INVALID_PARAMETER ? ImodApplyOpResult::Rejected
+                : ImodApplyOpResult::Failed;
+        } else {
+            IMOD_REGISTER_WINDOW window{};
+            bool ok = platform.MapWindow(platform.Context, op->address, sizeof(ULONG), &window) != FALSE;
+            if (ok) {
+                ULONG value = op->value;
+                ok = op->kind == ImodApplyOpKind::Read32
+                    ? platform.Read32(platform.Context, &window, 0, &value) != FALSE
+                    : platform.Write32(platform.Context, &window, 0, value) != FALSE;
+                op->value = value;
+                platform.UnmapWindow(platform.Context, &window);
+            }
+            op->result = ok ? ImodApplyOpResult::Success : ImodApplyOpResult::Failed;
+        }
+        return controller.simulator->Stats.ElapsedNs - before;
+    }
+
+    std::vector<std::unique_ptr<Controller>> controllers_;
+    bool stall_;
+};
+
+struct EngineCase {
+    const char* name;
+    bool batch;
+    uint32_t workers;
+    uint32_t depth;
+};
+
+const std::vector<EngineCase> kEngineCases = {
+    {"engine_batch_serial", true, 1, 1},
+    {"engine_batch_parallel", true, kEngineControllers, kEngineDepth},
+    {"engine_register_serial", false, 1, 1},
+    {"engine_register_parallel", false, kEngineControllers, kEngineDepth},
+};
+
+// kEngineControllers identical controllers applied in one engine run; counts are totals.
+Result RunEngineCase(const EngineCase& engineCase, uint32_t interrupters, uint32_t slots, const Options& options) {
+    Result result{engineCase.name, interrupters, slots};
+    std::vector<SimulatorPtr> simulators;
+    std::vector<ImodApplyJob> jobs;
+    for (uint32_t ordinal = 0; ordinal < kEngineControllers; ++ordinal) {
+        SimulatorPtr simulator = MakeController(interrupters, slots, options, ordinal);
+        if (!simulator) {
+            result.ok = false;
+            return result;
+        }
+        // The channel spends the latency; stalling under the controller lock would serialize.
+        simulator->Stall = nullptr;
+
+        ImodApplyJob& job = jobs.emplace_back();
+        job.capabilityAddress = CapabilityAddress(*simulator);
+        job.barLength = simulator->BarLength;
+        job.hcsparamsOffset = kHcsparamsOffset;
+        job.rtsoffOffset = kRtsoffOffset;
+        job.interval = kInterval;
+        simulators.push_back(std::move(simulator));
+    }
+
+    SimulatedApplyBackend backend(simulators, options.stall);
+    ImodApplyOptions applyOptions;
+    applyOptions.batch = engineCase.batch;
+    applyOptions.workers = engineCase.workers;
+    applyOptions.depth = engineCase.depth;
+
+    uint64_t totalNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        for (SimulatorPtr& simulator : simulators) {
+            simulator->Stats = {};
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<ImodApplyReport> reports = RunImodApply(backend, jobs, applyOptions);
+        totalNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        Counters counters;
+        for (size_t i = 0; i < reports.size(); ++i) {
+            const ImodApplyReport& report = reports[i];
+            counters.roundTrips += report.operations;
+            counters.maps += simulators[i]->Stats.Maps;
+            counters.reads += simulators[i]->Stats.Reads;
+            counters.writes += simulators[i]->Stats.Writes;
+            counters.simulatedNs += simulators[i]->Stats.ElapsedNs;
+            result.ok = result.ok && report.ok && report.batched == engineCase.batch &&
+                std::all_of(report.statuses.begin(), report.statuses.end(),
+                    [](uint32_t status) { return status == IMOD_BATCH_STATUS_WRITTEN; });
+        }
+        result.counters = counters;
+    }
+
+    result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    return result;
+}
+
+Counters SumStats(const std::vector<SimulatorPtr>& simulators) {
+    Counters counters;
+    for (const SimulatorPtr& simulator : simulators) {
+        counters.maps += simulator->Stats.Maps;
+        counters.reads += simulator->Stats.Reads;
+        counters.writes += simulator->Stats.Writes;
+        counters.simulatedNs += simulator->Stats.ElapsedNs;
+    }
+    return counters;
+}
+
+std::wstring WatchDeviceId(uint32_t ordinal) {
+    return L"PCI\\VEN_8086&DEV_A36D&SUBSYS_00000000\\3&11583659&0&" + std::to_wstring(ordinal);
+}
+
+// What IMOD.exe --watch sees of the simulated machine: which controllers are plugged in and
+// the config on disk, which only takes effect on ReloadConfig. Each pass is recorded with
+// the register traffic it caused.
+class BenchWatchHost final : public ImodWatchHost {
+public:
+    struct Pass {
+        ImodWatchPass pass;
+        Counters counters;
+        uint64_t wallNs = 0;
+    };
+
+    explicit BenchWatchHost(const std::vector<SimulatorPtr>& simulators)
+        : present(simulators.size(), true),
+          fileIntervals(simulators.size(), kInterval),
+          simulators_(simulators),
+          intervals_(fileIntervals) {
+        Rebase();
+    }
+
+    bool ReloadConfig() override {
+        if (!configValid) {
+            return false;
+        }
+        intervals_ = fileIntervals;
+        return true;
+    }
+
+    bool Enumerate(std::vector<ImodWatchTarget>* targets) override {
+        targets->clear();
+        for (uint32_t i = 0; i < simulators_.size(); ++i) {
+            if (!present[i]) {
+                continue;
+            }
+            ImodWatchTarget& target = targets->emplace_back();
+            target.deviceId = WatchDeviceId(i);
+            target.job.capabilityAddress = CapabilityAddress(*simulators_[i]);
+            target.job.barLength = simulators_[i]->BarLength;
+            target.job.hcsparamsOffset = kHcsparamsOffset;
+            target.job.rtsoffOffset = kRtsoffOffset;
+            target.job.interval = intervals_[i];
+            target.job.flags = IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY;
+        }
+        return true;
+    }
+
+    void Report(const ImodWatchPass& pass) override {
+        const Counters now = SumStats(simulators_);
+        Pass& recorded = passes.emplace_back();
+        recorded.pass = pass;
+        recorded.counters.maps = now.maps - base_.maps;
+        recorded.counters.reads = now.reads - base_.reads;
+        recorded.counters.writes = now.writes - base_.writes;
+        recorded.counters.simulatedNs = now.simulatedNs - base_.simulatedNs;
+        for (const ImodWatchApplied& applied : pass.applied) {
+            recorded.counters.roundTrips += applied.report.operations;
+        }
+        recorded.wallNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since_).count());
+        Rebase();
+    }
+
+    // Keeps the script's own register pokes out of the next pass.
+    void Rebase() {
+        base_ = SumStats(simulators_);
+        since_ = std::chrono::steady_clock::now();
+    }
+
+    std::vector<bool> present;
+    std::vector<uint32_t> fileIntervals;
+    bool configValid = true;
+    std::vector<Pass> passes;
+
+private:
+    const std::vector<SimulatorPtr>& simulators_;
+    std::vector<uint32_t> intervals_;
+    Counters base_;
+    std::chrono::steady_clock::time_point since_;
+};
+
+// Puts every interrupter of a controller back to its reset interval, as a resume from S3 does.
+bool ResetInterrupters(IMOD_SIMULATOR* simulator) {
+    IMOD_PLATFORM platform{};
+    ImodSimulatorInitializePlatform(simulator, &platform);
+    Counters ignored;
+    uint32_t maxIntrs = 0;
+    uint64_t runtimeAddress = 0;
+    if (!ReadLayout(platform, *simulator, &ignored, &maxIntrs, &runtimeAddress)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < maxIntrs; ++i) {
+        const uint64_t imodAddress = runtimeAddress + IMOD_XHCI_INTERRUPTER_OFFSET(i) + IMOD_XHCI_IMOD_OFFSET;
+        if (!WriteRegister32(platform, &ignored, imodAddress, kResetInterval)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct WatchStep {
+    const char* name;
+    // Applied to the machine before the burst is delivered.
+    std::function<bool(BenchWatchHost&, std::vector<SimulatorPtr>&)> change;
+    std::vector<ImodWatchEvent> burst;
+    size_t expectApplied;
+    size_t expectRemoved;
+};
+
+// Controllers 0-3 are present at start and 4 arrives later.
+const std::vector<WatchStep> kWatchScript = {
+    {"watch_config_edit",
+        [](BenchWatchHost& host, std::vector<SimulatorPtr>&) { host.fileIntervals[1] = kInterval * 2; return true; },
+        {{ImodWatchEventKind::ConfigChanged, L""}, {ImodWatchEventKind::ConfigChanged, L""}}, 1, 0},
+    {"watch_arrival",
+        [](BenchWatchHost& host, std::vector<SimulatorPtr>&) { host.present[4] = true; return true; },
+        {{ImodWatchEventKind::DeviceArrived, WatchDeviceId(4)}}, 1, 0},
+    {"watch_removal",
+        [](BenchWatchHost& host, std::vector<SimulatorPtr>&) { host.present[0] = false; return true; },
+        {{ImodWatchEventKind::DeviceRemoved, WatchDeviceId(0)}}, 0, 1},
+    {"watch_resume",
+        [](BenchWatchHost&, std::vector<SimulatorPtr>& simulators) { return ResetInterrupters(simulators[2].get()); },
+        {{ImodWatchEventKind::Resumed, L""}}, 4, 0},
+    {"watch_config_invalid",
+        [](BenchWatchHost& host, std::vector<SimulatorPtr>&) {
+            host.configValid = false;
+            host.fileIntervals[3] = kInterval * 2;
+            return true;
+        },
+        {{ImodWatchEventKind::ConfigChanged, L""}}, 0, 0},
+};
+
+// Delivers kWatchScript one burst per wait, then Stop.
+class ScriptedWatchSource final : public ImodWatchSource {
+public:
+    ScriptedWatchSource(BenchWatchHost& host, std::vector<SimulatorPtr>& simulators)
+        : host_(host), simulators_(simulators) {}
+
+    bool Wait(uint32_t timeoutMs, ImodWatchEvent* event) override {
+        if (timeoutMs != kImodWatchInfinite) {
+            if (step_ == 0 || next_ >= kWatchScript[step_ - 1].burst.size()) {
+                return false;
+            }
+            *event = kWatchScript[step_ - 1].burst[next_++];
+            return true;
+        }
+
+        if (step_ >= kWatchScript.size()) {
+            *event = {ImodWatchEventKind::Stop, L""};
+            return true;
+        }
+        const WatchStep& step = kWatchScript[step_++];
+        changed = changed && step.change(host_, simulators_);
+        host_.Rebase();
+        next_ = 1;
+        *event = step.burst.front();
+        return true;
+    }
+
+    bool changed = true;
+
+private:
+    BenchWatchHost& host_;
+    std::vector<SimulatorPtr>& simulators_;
+    size_t step_ = 0;
+    size_t next_ = 0;
+};
+
+bool AllApplied(const ImodWatchPass& pass) {
+    return std::all_of(pass.applied.begin(), pass.applied.end(), [](const ImodWatchApplied& applied) {
+        return applied.report.ok && std::none_of(applied.report.statuses.begin(), applied.report.statuses.end(),
+            [](uint32_t status) {
+                return status == IMOD_BATCH_STATUS_READ_FAILED || status == IMOD_BATCH_STATUS_WRITE_FAILED ||
+                    status == IMOD_BATCH_STATUS_VERIFY_FAILED;
+            });
+    });
+}
+
+// watch_start is the initial apply of controllers 0-3; every later result is one pass of
+// kWatchScript and should touch only the controllers its events concern.
+std::vector<Result> RunWatchCases(uint32_t interrupters, const Options& options) {
+    std::vector<Result> results(kWatchScript.size() + 1);
+    results[0].name = "watch_start";
+    for (size_t i = 0; i < kWatchScript.size(); ++i) {
+        results[i + 1].name = kWatchScript[i].name;
+    }
+    for (Result& result : results) {
+        result.interrupters = interrupters;
+        result.slots = 1;
+    }
+
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        std::vector<SimulatorPtr> simulators;
+        for (uint32_t ordinal = 0; ordinal < kWatchControllers; ++ordinal) {
+            SimulatorPtr simulator = MakeController(interrupters, 1, options, ordinal);
+            if (!simulator) {
+                for (Result& result : results) {
+                    result.ok = false;
+                }
+                return results;
+            }
+            simulator->Stall = nullptr;
+            simulators.push_back(std::move(simulator));
+        }
+
+        BenchWatchHost host(simulators);
+        host.present[4] = false;
+        SimulatedApplyBackend backend(simulators, options.stall);
+        ImodWatcher watcher(host, backend, ImodApplyOptions{});
+        ScriptedWatchSource source(host, simulators);
+        RunImodWatch(watcher, source, host, 0);
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            Result& result = results[i];
+            if (i >= host.passes.size()) {
+                result.ok = false;
+                continue;
+            }
+            const BenchWatchHost::Pass& pass = host.passes[i];
+            const size_t expectApplied = i == 0 ? kWatchControllers - 1 : kWatchScript[i - 1].expectApplied;
+            const size_t expectRemoved = i == 0 ? 0 : kWatchScript[i - 1].expectRemoved;
+            result.ok = result.ok && source.changed && AllApplied(pass.pass) &&
+                pass.pass.applied.size() == expectApplied && pass.pass.removed.size() == expectRemoved;
+            result.counters = pass.counters;
+            result.wallNs += pass.wallNs / options.iterations;
+        }
+    }
+    return results;
+}
+
+// A machine as the budget estimator sees it: how many processors and which interrupting
+// functions sit where. expectOver is how many processors the snapshot is built to overload.
+struct BudgetSnapshot {
+    const char* name;
+    uint32_t processors;
+    std::vector<IMOD_BUDGET_DEVICE> devices;
+    uint32_t expectOver;
+};
+
+IMOD_BUDGET_DEVICE MakeBudgetDevice(ULONG kind, ULONG moderation, ULONG vectors, ULONG value, ULONG eventsPerSecond,
+    USHORT group, ULONGLONG affinity, ULONG messageLimit = 0) {
+    IMOD_BUDGET_DEVICE device{};
+    device.Kind = kind;
+    device.Moderation = moderation;
+    device.VectorCount = vectors;
+    device.MessageLimit = messageLimit;
+    device.IsrNs = kind == IMOD_BUDGET_KIND_USB ? 1500 : 1000;
+    device.DpcNs = kind == IMOD_BUDGET_KIND_USB ? 3000 : 2000;
+    device.EventNs = kind == IMOD_BUDGET_KIND_NIC ? 300 : 200;
+    device.Group = group;
+    device.Affinity = affinity;
+    for (ULONG vector = 0; vector < vectors; ++vector) {
+        device.Values[vector] = value;
+        device.EventsPerSecond[vector] = eventsPerSecond;
+    }
+    return device;
+}
+
+std::vector<BudgetSnapshot> MakeBudgetSnapshots() {
+    std::vector<BudgetSnapshot> snapshots;
+
+    // 8 threads: 8 kHz mouse on LP2, I225 on LP4-5, NVMe with a queue per processor.
+    BudgetSnapshot& desktop = snapshots.emplace_back(BudgetSnapshot{"budget_desktop", 8, {}, 0});
+    desktop.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_USB, IMOD_BUDGET_MODERATION_XHCI_IMODI, 1, 0, 8100, 0, 1ULL << 2));
+    desktop.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_NIC, IMOD_BUDGET_MODERATION_INTEL_EITR, 5, 100 << 2, 5000, 0, 0x30));
+    desktop.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_STORAGE, IMOD_BUDGET_MODERATION_NONE, 8, 0, 2000, 0, 0));
+
+    // An unmoderated RTL8125 taking 200k packets/s on LP0 next to two moderated mice.
+    BudgetSnapshot& storm = snapshots.emplace_back(BudgetSnapshot{"budget_storm", 16, {}, 1});
+    storm.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_NIC, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2, 1, 0, 200000, 0, 1));
+    storm.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_USB, IMOD_BUDGET_MODERATION_XHCI_IMODI, 1, 0xFA0, 4000, 0, 1ULL << 2));
+    storm.devices.push_back(
+        MakeBudgetDevice(IMOD_BUDGET_KIND_USB, IMOD_BUDGET_MODERATION_XHCI_IMODI, 1, 0xFA0, 4000, 0, 1ULL << 3));
+
+    // Sixteen busy queues folded onto one MSI message.
+    BudgetSnapshot& folded = snapshots.emplace_back(BudgetSnapshot{"budget_folded", 32, {}, 1});
+    folded.devices.push_back(MakeBudgetDevice(
+        IMOD_BUDGET_KIND_NIC, IMOD_BUDGET_MODERATION_INTEL_ITR, 16, 0xC4, 20000, 0, 0xFFFF0000ULL, 1));
+
+    BudgetSnapshot& workstation = snapshots.emplace_back(BudgetSnapshot{"budget_workstation", 64, {}, 0});
+    for (USHORT controller = 0; controller < 3; ++controller) {
+        workstation.devices.push_back(MakeBudgetDevice(IMOD_BUDGET_KIND_USB, IMOD_BUDGET_MODERATION_XHCI_IMODI, 4,
+            kInterval, 1000, 0, 1ULL << (2 + (controller * 2))));
+    }
+    for (USHORT nic = 0; nic < 2; ++nic) {
+        workstation.devices.push_back(MakeBudgetDevice(IMOD_BUDGET_KIND_NIC, IMOD_BUDGET_MODERATION_INTEL_EITR, 8,
+            50 << 2, 20000, 0, 0xFFULL << (16 + (nic * 8))));
+    }
+    for (USHORT disk = 0; disk < 4; ++disk) {
+        workstation.devices.push_back(
+            MakeBudgetDevice(IMOD_BUDGET_KIND_STORAGE, IMOD_BUDGET_MODERATION_NONE, 64, 0, 1500, 0, 0));
+    }
+
+    // Four processor groups; every group has its own NVMe and a NIC folded onto 8 messages.
+    BudgetSnapshot& server = snapshots.emplace_back(BudgetSnapshot{"budget_server", 256, {}, 0});
+    for (USHORT group = 0; group < 4; ++group) {
+        for (USHORT disk = 0; disk < 2; ++disk) {
+            server.devices.push_back(MakeBudgetDevice(
+                IMOD_BUDGET_KIND_STORAGE, IMOD_BUDGET_MODERATION_NONE, 64, 0, 2500, group, ~0ULL));
+        }
+        server.devices.push_back(MakeBudgetDevice(IMOD_BUDGET_KIND_NIC, IMOD_BUDGET_MODERATION_INTEL_EITR, 16,
+            50 << 2, 30000, group, 0xFF00ULL, 8));
+    }
+    return snapshots;
+}
+
+// budget_* reuse the result columns: interrupters is the processor count, slots the device
+// count. No registers are touched, so the counters stay zero and only wall_ns and ok matter.
+// ok also requires that every interrupt and message the model produced landed on exactly one
+// processor.
+std::vector<Result> RunBudgetCases(const Options& options) {
+    std::vector<Result> results;
+    for (const BudgetSnapshot& snapshot : MakeBudgetSnapshots()) {
+        Result& result = results.emplace_back(
+            Result{snapshot.name, snapshot.processors, static_cast<uint32_t>(snapshot.devices.size())});
+        std::vector<IMOD_BUDGET_PROCESSOR> processors(snapshot.processors);
+        ULONG over = 0;
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            const ULONG status = ImodBudgetEstimate(nullptr, snapshot.devices.data(),
+                static_cast<ULONG>(snapshot.devices.size()), snapshot.processors, processors.data(), &over);
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.ok = result.ok && status == IMOD_RESULT_SUCCESS;
+        }
+
+        uint64_t expectInterrupts = 0;
+        uint64_t expectMessages = 0;
+        for (const IMOD_BUDGET_DEVICE& device : snapshot.devices) {
+            for (ULONG vector = 0; vector < device.VectorCount; ++vector) {
+                expectInterrupts +=
+                    ImodBudgetInterruptRate(device.Moderation, device.Values[vector], device.EventsPerSecond[vector]);
+            }
+            expectMessages += device.MessageLimit == 0 ? device.VectorCount : std::min(device.MessageLimit, device.VectorCount);
+        }
+
+        uint64_t interrupts = 0;
+        uint64_t messages = 0;
+        for (const IMOD_BUDGET_PROCESSOR& processor : processors) {
+            interrupts += processor.InterruptsPerSecond;
+            messages += processor.Messages;
+        }
+        result.ok = result.ok && interrupts == expectInterrupts && messages == expectMessages &&
+            over == snapshot.expectOver;
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// A machine as the affinity planner sees it. Ranks follow a scrambled CPPC order so the
+// strongest core is not simply the first one.
+struct AffinitySnapshot {
+    const char* name;
+    std::vector<IMOD_AFFINITY_PROCESSOR> processors;
+    std::vector<IMOD_AFFINITY_DEVICE> devices;
+    ULONG targetCcd;
+};
+
+// Appends cores * threads processors; Core, Llc and Ccd are the first processor of each.
+void AddAffinityCores(AffinitySnapshot* snapshot, ULONG cores, ULONG threads, ULONG coresPerLlc, ULONG llcsPerCcd,
+    UCHAR efficiency) {
+    const ULONG firstProcessor = static_cast<ULONG>(snapshot->processors.size());
+    for (ULONG core = 0; core < cores; ++core) {
+        for (ULONG thread = 0; thread < threads; ++thread) {
+            IMOD_AFFINITY_PROCESSOR processor{};
+            processor.Core = firstProcessor + (core * threads);
+            processor.Llc = firstProcessor + ((core / coresPerLlc) * coresPerLlc * threads);
+            processor.Ccd = firstProcessor + ((core / (coresPerLlc * llcsPerCcd)) * coresPerLlc * llcsPerCcd * threads);
+            processor.Rank = firstProcessor + ((((core * 5) + 3) % cores) * threads) + thread;
+            processor.Efficiency = efficiency;
+            snapshot->processors.push_back(processor);
+        }
+    }
+}
+
+std::vector<AffinitySnapshot> MakeAffinitySnapshots() {
+    std::vector<AffinitySnapshot> snapshots;
+    const auto device = [](ULONG role, ULONG load, ULONG cluster = IMOD_AFFINITY_ANY) {
+        return IMOD_AFFINITY_DEVICE{role, load, cluster};
+    };
+
+    // 8 cores / 16 threads, one CCD: mouse and GPU hand frames to each other.
+    AffinitySnapshot& desktop = snapshots.emplace_back(AffinitySnapshot{"affinity_desktop", {}, {}, IMOD_AFFINITY_ANY});
+    AddAffinityCores(&desktop, 8, 2, 8, 1, 0);
+    desktop.devices = {device(IMOD_AFFINITY_ROLE_INPUT, 80, 0), device(IMOD_AFFINITY_ROLE_INPUT, 10),
+        device(IMOD_AFFINITY_ROLE_AUDIO, 50), device(IMOD_AFFINITY_ROLE_GPU, 150, 0),
+        device(IMOD_AFFINITY_ROLE_NIC, 120, 1), device(IMOD_AFFINITY_ROLE_STORAGE, 60),
+        device(IMOD_AFFINITY_ROLE_STORAGE, 60), device(IMOD_AFFINITY_ROLE_OTHER, 20)};
+    desktop.processors[0].Flags = IMOD_AFFINITY_PROCESSOR_CORE0;
+    desktop.processors[1].Flags = IMOD_AFFINITY_PROCESSOR_CORE0;
+
+    // Two CCDs with a CCX each; the game runs on CCD 0, so latency-critical devices belong there.
+    AffinitySnapshot& dual = snapshots.emplace_back(AffinitySnapshot{"affinity_dual_ccd", {}, {}, 0});
+    AddAffinityCores(&dual, 16, 2, 8, 1, 0);
+    dual.devices = {device(IMOD_AFFINITY_ROLE_INPUT, 120, 0), device(IMOD_AFFINITY_ROLE_INPUT, 15),
+        device(IMOD_AFFINITY_ROLE_INPUT, 15), device(IMOD_AFFINITY_ROLE_AUDIO, 40),
+        device(IMOD_AFFINITY_ROLE_GPU, 200, 0), device(IMOD_AFFINITY_ROLE_NIC, 150, 1),
+        device(IMOD_AFFINITY_ROLE_NIC, 150, 1), device(IMOD_AFFINITY_ROLE_STORAGE, 90),
+        device(IMOD_AFFINITY_ROLE_STORAGE, 90), device(IMOD_AFFINITY_ROLE_STORAGE, 90),
+        device(IMOD_AFFINITY_ROLE_OTHER, 30), device(IMOD_AFFINITY_ROLE_OTHER, 30)};
+
+    // 8 P-cores with SMT and 8 E-cores; LP0-1 are reserved CPU sets.
+    AffinitySnapshot& hybrid = snapshots.emplace_back(AffinitySnapshot{"affinity_hybrid", {}, {}, IMOD_AFFINITY_ANY});
+    AddAffinityCores(&hybrid, 8, 2, 8, 1, 0);
+    AddAffinityCores(&hybrid, 8, 1, 4, 2, 1);
+    for (IMOD_AFFINITY_PROCESSOR& processor : hybrid.processors) {
+        processor.Llc = 0;
+        processor.Ccd = 0;
+    }
+    hybrid.processors[0].Flags = IMOD_AFFINITY_PROCESSOR_RESERVED;
+    hybrid.processors[1].Flags = IMOD_AFFINITY_PROCESSOR_RESERVED;
+    hybrid.devices = {device(IMOD_AFFINITY_ROLE_INPUT, 100, 0), device(IMOD_AFFINITY_ROLE_INPUT, 10),
+        device(IMOD_AFFINITY_ROLE_AUDIO, 60), device(IMOD_AFFINITY_ROLE_GPU, 180, 0),
+        device(IMOD_AFFINITY_ROLE_NIC, 140), device(IMOD_AFFINITY_ROLE_STORAGE, 80),
+        device(IMOD_AFFINITY_ROLE_STORAGE, 80), device(IMOD_AFFINITY_ROLE_OTHER, 40),
+        device(IMOD_AFFINITY_ROLE_OTHER, 40), device(IMOD_AFFINITY_ROLE_OTHER, 40)};
+
+    // 128 cores / 256 threads over 8 CCDs, 100 devices in 16 clusters.
+    AffinitySnapshot& server = snapshots.emplace_back(AffinitySnapshot{"affinity_server", {}, {}, 0});
+    AddAffinityCores(&server, 128, 2, 16, 1, 0);
+    for (ULONG index = 0; index < 100; ++index) {
+        static const ULONG roles[] = {IMOD_AFFINITY_ROLE_NIC, IMOD_AFFINITY_ROLE_STORAGE, IMOD_AFFINITY_ROLE_STORAGE,
+            IMOD_AFFINITY_ROLE_OTHER, IMOD_AFFINITY_ROLE_INPUT, IMOD_AFFINITY_ROLE_GPU, IMOD_AFFINITY_ROLE_AUDIO};
+        server.devices.push_back(device(roles[index % 7], 50 + ((index * 37) % 400), index % 3 == 0 ? index % 16 : IMOD_AFFINITY_ANY));
+    }
+    server.processors[0].Flags = IMOD_AFFINITY_PROCESSOR_CORE0;
+    server.processors[1].Flags = IMOD_AFFINITY_PROCESSOR_CORE0;
+    return snapshots;
+}
+
+// What AUTO did before the planner: latency-critical devices round-robin over the P-cores of
+// the target CCD in CPPC order, everything else over all of them.
+std::vector<ULONG> MakeRoundRobinPlacement(const AffinitySnapshot& snapshot) {
+    std::vector<ULONG> preferred;
+    std::vector<ULONG> all;
+    for (ULONG index = 0; index < snapshot.processors.size(); ++index) {
+        const IMOD_AFFINITY_PROCESSOR& processor = snapshot.processors[index];
+        if ((processor.Flags & IMOD_AFFINITY_PROCESSOR_RESERVED) != 0) {
+            continue;
+        }
+        all.push_back(index);
+        if (processor.Efficiency == 0 &&
+            (snapshot.targetCcd == IMOD_AFFINITY_ANY || processor.Ccd == snapshot.targetCcd)) {
+            preferred.push_back(index);
+        }
+    }
+    const auto byRank = [&](ULONG left, ULONG right) {
+        return snapshot.processors[left].Rank < snapshot.processors[right].Rank;
+    };
+    std::sort(preferred.begin(), preferred.end(), byRank);
+    std::sort(all.begin(), all.end(), byRank);
+
+    std::vector<ULONG> placement;
+    size_t critical = 0;
+    size_t rest = 0;
+    for (const IMOD_AFFINITY_DEVICE& device : snapshot.devices) {
+        placement.push_back(device.Role <= IMOD_AFFINITY_ROLE_NIC && !preferred.empty()
+                ? preferred[critical++ % preferred.size()]
+                : all[rest++ % all.size()]);
+    }
+    return placement;
+}
+
+// affinity_* use interrupters for the processor count and slots for the device count, like
+// budget_*. ok requires two identical plans, no device on a reserved processor, a final cost
+// no higher than the greedy seed or the round-robin placement, and a Final that ImodAffinityCost
+// reproduces from the placement alone.
+std::vector<Result> RunAffinityCases(const Options& options) {
+    std::vector<Result> results;
+    auto workspace = std::make_unique<IMOD_AFFINITY_WORKSPACE>();
+    for (const AffinitySnapshot& snapshot : MakeAffinitySnapshots()) {
+        Result& result = results.emplace_back(Result{snapshot.name, static_cast<uint32_t>(snapshot.processors.size()),
+            static_cast<uint32_t>(snapshot.devices.size())});
+        const ULONG processorCount = static_cast<ULONG>(snapshot.processors.size());
+        const ULONG deviceCount = static_cast<ULONG>(snapshot.devices.size());
+        IMOD_AFFINITY_CONFIG config;
+        ImodAffinityDefaultConfig(&config);
+        config.TargetCcd = snapshot.targetCcd;
+
+        std::vector<IMOD_AFFINITY_ASSIGNMENT> first(deviceCount);
+        std::vector<IMOD_AFFINITY_ASSIGNMENT> assignments(deviceCount);
+        IMOD_AFFINITY_SUMMARY summary{};
+        result.ok = ImodAffinityPlan(&config, snapshot.processors.data(), processorCount, snapshot.devices.data(),
+                        deviceCount, workspace.get(), first.data(), &summary) == IMOD_RESULT_SUCCESS;
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            const ULONG status = ImodAffinityPlan(&config, snapshot.processors.data(), processorCount,
+                snapshot.devices.data(), deviceCount, workspace.get(), assignments.data(), &summary);
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.ok = result.ok && status == IMOD_RESULT_SUCCESS;
+        }
+
+        std::vector<ULONG> placement;
+        for (ULONG index = 0; index < deviceCount; ++index) {
+            result.ok = result.ok && assignments[index].Processor == first[index].Processor &&
+                assignments[index].Reasons == first[index].Reasons && assignments[index].Cost == first[index].Cost &&
+                (snapshot.processors[assignments[index].Processor].Flags & IMOD_AFFINITY_PROCESSOR_RESERVED) == 0;
+            placement.push_back(assignments[index].Processor);
+        }
+
+        IMOD_AFFINITY_COST replayed{};
+        IMOD_AFFINITY_COST roundRobin{};
+        const std::vector<ULONG> baseline = MakeRoundRobinPlacement(snapshot);
+        result.ok = result.ok &&
+            ImodAffinityCost(&config, snapshot.processors.data(), processorCount, snapshot.devices.data(), deviceCount,
+                placement.data(), workspace.get(), &replayed) == IMOD_RESULT_SUCCESS &&
+            ImodAffinityCost(&config, snapshot.processors.data(), processorCount, snapshot.devices.data(), deviceCount,
+                baseline.data(), workspace.get(), &roundRobin) == IMOD_RESULT_SUCCESS &&
+            replayed.Total == summary.Final.Total && summary.Final.Total <= summary.Initial.Total &&
+            summary.Final.Total <= roundRobin.Total;
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+struct CpuSetLayoutCase {
+    const char* name;
+    std::vector<UCHAR> groups;
+};
+
+const std::vector<CpuSetLayoutCase> kCpuSetLayouts = {
+    {"cpuset_single_group", {32}},
+    {"cpuset_dual_socket", {48, 48}},
+    {"cpuset_full_groups", std::vector<UCHAR>(16, 64)},
+    {"cpuset_uneven_groups", {48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48, 16}},
+};
+
+// One pass over a layout; false on the first encoder that does not round-trip.
+bool CheckCpuSetLayout(const IMOD_CPUSET_LAYOUT& layout, uint32_t processors, uint32_t seed) {
+    for (ULONG index = 0; index < processors; ++index) {
+        ULONG group = 0;
+        ULONG number = 0;
+        ULONG back = 0;
+        if (!ImodCpuSetFromIndex(&layout, index, &group, &number) || !ImodCpuSetToIndex(&layout, group, number, &back) ||
+            back != index) {
+            return false;
+        }
+    }
+
+    ULONG outside = 0;
+    if (ImodCpuSetFromIndex(&layout, processors, &outside, &outside)) {
+        return false;
+    }
+
+    std::vector<UCHAR> bitmap((processors + 7) / 8);
+    uint32_t state = seed;
+    for (uint32_t round = 0; round < 16; ++round) {
+        // Random subset: every processor with probability 1/4, plus one contiguous run.
+        IMOD_CPUSET set;
+        ImodCpuSetClear(&set);
+        std::vector<ULONG> chosen;
+        for (ULONG index = 0; index < processors; ++index) {
+            state = (state * 1664525U) + 1013904223U;
+            if ((state >> 30) == 0) {
+                chosen.push_back(index);
+            }
+        }
+        for (ULONG index : chosen) {
+            ULONG group = 0;
+            ULONG number = 0;
+            ImodCpuSetFromIndex(&layout, index, &group, &number);
+            ImodCpuSetAdd(&set, group, number);
+        }
+
+        ULONG written = 0;
+        IMOD_CPUSET decoded;
+        if (ImodCpuSetCount(&set) != chosen.size() ||
+            ImodCpuSetEncodeBitmap(&set, &layout, bitmap.data(), static_cast<ULONG>(bitmap.size()), &written) !=
+                IMOD_RESULT_SUCCESS ||
+            ImodCpuSetDecodeBitmap(bitmap.data(), written, &layout, &decoded) != IMOD_RESULT_SUCCESS ||
+            std::memcmp(&set, &decoded, sizeof(set)) != 0 ||
+            written != (chosen.empty() ? 0 : (chosen.back() / 8) + 1)) {
+            return false;
+        }
+
+        // AssignmentSetOverride per group, and a refusal for a set spanning groups.
+        UCHAR policy[IMOD_CPUSET_GROUP_AFFINITY_SIZE];
+        for (ULONG group = 0; group < layout.GroupCount; ++group) {
+            IMOD_CPUSET single;
+            ImodCpuSetClear(&single);
+            single.Groups[group] = set.Groups[group] | 1;
+            if (ImodCpuSetEncodeAffinityPolicy(&single, policy, sizeof(policy), &written) != IMOD_RESULT_SUCCESS ||
+                written != (group == 0 ? 8U : IMOD_CPUSET_GROUP_AFFINITY_SIZE) ||
+                ImodCpuSetDecodeAffinityPolicy(policy, written, &decoded) != IMOD_RESULT_SUCCESS ||
+                std::memcmp(&single, &decoded, sizeof(single)) != 0) {
+                return false;
+            }
+        }
+        ULONG firstGroup = 0;
+        if (ImodCpuSetGroupCount(&set, &firstGroup) > 1 &&
+            ImodCpuSetEncodeAffinityPolicy(&set, policy, sizeof(policy), &written) != IMOD_RESULT_INVALID_PARAMETER) {
+            return false;
+        }
+
+        // An RSS run of up to 16 processors that may cross a group boundary.
+        state = (state * 1664525U) + 1013904223U;
+        const ULONG runLength = 1 + ((state >> 16) % std::min<uint32_t>(16, processors));
+        const ULONG runStart = (state >> 8) % (processors - runLength + 1);
+        IMOD_CPUSET run;
+        ImodCpuSetClear(&run);
+        for (ULONG index = runStart; index < runStart + runLength; ++index) {
+            ULONG group = 0;
+            ULONG number = 0;
+            ImodCpuSetFromIndex(&layout, index, &group, &number);
+            ImodCpuSetAdd(&run, group, number);
+        }
+
+        IMOD_CPUSET_RSS_RANGE range{};
+        BOOLEAN exact = FALSE;
+        ULONG baseIndex = 0;
+        ULONG maxIndex = 0;
+        if (ImodCpuSetRssRange(&run, &layout, &range, &exact) != IMOD_RESULT_SUCCESS || !exact ||
+            range.MaxProcessors != runLength || !ImodCpuSetToIndex(&layout, range.BaseGroup, range.BaseNumber, &baseIndex) ||
+            !ImodCpuSetToIndex(&layout, range.MaxGroup, range.MaxNumber, &maxIndex) || baseIndex != runStart ||
+            maxIndex != runStart + runLength - 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// cpuset_* check the processor-group bitset and its registry encoders up to 1024 processors:
+// index <-> (group, number), ReservedCpuSets bitmaps, AssignmentSetOverride as KAFFINITY or
+// GROUP_AFFINITY, and NDIS RSS ranges across group boundaries. interrupters is the processor
+// count, slots the group count.
+std::vector<Result> RunCpuSetCases(const Options& options) {
+    std::vector<Result> results;
+    for (const CpuSetLayoutCase& entry : kCpuSetLayouts) {
+        IMOD_CPUSET_LAYOUT layout{};
+        uint32_t processors = 0;
+        layout.GroupCount = static_cast<ULONG>(entry.groups.size());
+        for (size_t group = 0; group < entry.groups.size(); ++group) {
+            layout.ProcessorCount[group] = entry.groups[group];
+            processors += entry.groups[group];
+        }
+
+        Result& result = results.emplace_back(Result{entry.name, processors, layout.GroupCount});
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = CheckCpuSetLayout(layout, processors, 0x9E3779B9U + iteration) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// Port paths as ROUTE_ROLES carries them and the GUI keys its route map: parse, format and the
+// encoding from topology path ports, including what a Route String cannot hold.
+bool CheckTopologyRoutes() {
+    struct Parse {
+        const char* text;
+        ULONG result;
+        ULONG rootPort;
+        ULONG routeString;
+    };
+    const Parse parses[] = {
+        {"7", IMOD_RESULT_SUCCESS, 7, 0},
+        {"7.2.4", IMOD_RESULT_SUCCESS, 7, 0x42},
+        {"255.15.15.15.15.15", IMOD_RESULT_SUCCESS, 255, 0xFFFFF},
+        {"12.1.10", IMOD_RESULT_SUCCESS, 12, 0xA1},
+        {"007.02", IMOD_RESULT_SUCCESS, 7, 0x2},
+        {"", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"0", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"256", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"4294967303", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7.16", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7.0.4", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7.1.1.1.1.1.1", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7..2", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {".7", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7.", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"7 .2", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+        {"0x7", IMOD_RESULT_INVALID_PARAMETER, 0, 0},
+    };
+    for (const Parse& parse : parses) {
+        ULONG rootPort = 0;
+        ULONG routeString = 0;
+        if (ImodTopologyParseRoute(parse.text, static_cast<ULONG>(std::strlen(parse.text)), &rootPort, &routeString) !=
+                parse.result ||
+            (parse.result == IMOD_RESULT_SUCCESS && (rootPort != parse.rootPort || routeString != parse.routeString))) {
+            return false;
+        }
+    }
+
+    struct Format {
+        ULONG rootPort;
+        ULONG routeString;
+        ULONG result;
+        const char* text;
+    };
+    const Format formats[] = {
+        {7, 0, IMOD_RESULT_SUCCESS, "7"},
+        {7, 0x42, IMOD_RESULT_SUCCESS, "7.2.4"},
+        {12, 0xA1, IMOD_RESULT_SUCCESS, "12.1.10"},
+        {255, 0xFFFFF, IMOD_RESULT_SUCCESS, "255.15.15.15.15.15"},
+        // The controller stops at the first zero tier, and so does the path.
+        {7, 0x302, IMOD_RESULT_SUCCESS, "7.2"},
+        {0, 0x2, IMOD_RESULT_INVALID_PARAMETER, ""},
+        {256, 0, IMOD_RESULT_INVALID_PARAMETER, ""},
+    };
+    for (const Format& format : formats) {
+        char text[IMOD_TOPOLOGY_ROUTE_TEXT_SIZE] = {};
+        ULONG written = 0;
+        if (ImodTopologyFormatRoute(format.rootPort, format.routeString, text, sizeof(text), &written) !=
+                format.result ||
+            (format.result == IMOD_RESULT_SUCCESS &&
+                (written != std::strlen(format.text) || std::strcmp(text, format.text) != 0))) {
+            return false;
+        }
+    }
+
+    char small[6] = {};
+    ULONG written = 0;
+    if (ImodTopologyFormatRoute(7, 0x42, small, 5, &written) != IMOD_RESULT_BUFFER_TOO_SMALL ||
+        ImodTopologyFormatRoute(7, 0x42, small, 6, &written) != IMOD_RESULT_SUCCESS || written != 5) {
+        return false;
+    }
+
+    // Every path a Route String can hold survives format and parse.
+    for (ULONG rootPort = 1; rootPort <= 0xFF; rootPort += 17) {
+        for (ULONG routeString = 0; routeString <= 0xFFFFF; routeString += 0x1111) {
+            char text[IMOD_TOPOLOGY_ROUTE_TEXT_SIZE] = {};
+            ULONG parsedRoot = 0;
+            ULONG parsedRoute = 0;
+            ULONG canonical = 0;
+            for (ULONG tier = 0; tier < IMOD_TOPOLOGY_ROUTE_MAX_TIERS && ((routeString >> (tier * 4)) & 0xF) != 0; ++tier) {
+                canonical |= routeString & (0xFUL << (tier * 4));
+            }
+            if (ImodTopologyFormatRoute(rootPort, routeString, text, sizeof(text), &written) != IMOD_RESULT_SUCCESS ||
+                ImodTopologyParseRoute(text, written, &parsedRoot, &parsedRoute) != IMOD_RESULT_SUCCESS ||
+                parsedRoot != rootPort || parsedRoute != canonical) {
+                return false;
+            }
+        }
+    }
+
+    // "HC0/Port7/Port2/Port4" as the GUI collects it from UsbTopologyInterop.
+    const ULONG ports[] = {7, 2, 4, 1, 1, 1, 1};
+    const ULONG deep[] = {7, 16};
+    ULONG rootPort = 0;
+    ULONG routeString = 0;
+    return ImodTopologyEncodeRoute(ports, 3, &rootPort, &routeString) == IMOD_RESULT_SUCCESS && rootPort == 7 &&
+        routeString == 0x42 &&
+        ImodTopologyEncodeRoute(ports, IMOD_TOPOLOGY_ROUTE_MAX_PORTS, &rootPort, &routeString) == IMOD_RESULT_SUCCESS &&
+        routeString == 0x11142 &&
+        ImodTopologyEncodeRoute(ports, IMOD_TOPOLOGY_ROUTE_MAX_PORTS + 1, &rootPort, &routeString) ==
+            IMOD_RESULT_INVALID_PARAMETER &&
+        ImodTopologyEncodeRoute(deep, 2, &rootPort, &routeString) == IMOD_RESULT_INVALID_PARAMETER &&
+        ImodTopologyEncodeRoute(ports, 0, &rootPort, &routeString) == IMOD_RESULT_INVALID_PARAMETER;
+}
+
+// A mouse and a webcam behind hubs on root port 7 and a keyboard on root port 5, each on its
+// own interrupter: the walk's slots, keyed by formatted path, keep the three apart where the
+// root port key would merge the first two.
+bool CheckTopologyRouteWalk(const Options& options, Counters* counters) {
+    SimulatorPtr simulator = MakeController(4, 0, options);
+    if (!simulator) {
+        return false;
+    }
+
+    struct Device {
+        ULONG rootPort;
+        ULONG routeString;
+        ULONG interrupter;
+        BOOLEAN hub;
+    };
+    const Device devices[] = {
+        {7, 0x0, 0, TRUE},
+        {7, 0x2, 0, TRUE},
+        {7, 0x42, 1, FALSE},
+        {7, 0x3, 2, FALSE},
+        {5, 0x0, 3, FALSE},
+    };
+    for (const Device& entry : devices) {
+        IMOD_SIMULATOR_DEVICE device{};
+        device.RootPort = entry.rootPort;
+        device.RouteString = entry.routeString;
+        device.Interrupter = entry.interrupter;
+        device.Hub = entry.hub;
+        device.EndpointTypes[0] = IMOD_XHCI_EP_TYPE_CONTROL;
+        device.EndpointTypes[2] = 7;
+        ULONG slotId = 0;
+        if (ImodSimulatorAttachDevice(simulator.get(), &device, &slotId) != IMOD_RESULT_SUCCESS) {
+            return false;
+        }
+    }
+
+    IMOD_PLATFORM platform{};
+    ImodSimulatorInitializePlatform(simulator.get(), &platform);
+    std::vector<unsigned char> buffer(sizeof(tagImodTopologyHeader) + (8 * sizeof(tagImodTopologySlot)));
+    tagImodTopologyHeader header{};
+    header.version = IMOD_TOPOLOGY_VERSION;
+    header.capabilityAddress = CapabilityAddress(*simulator);
+    header.barLength = simulator->BarLength;
+    header.hcsparamsOffset = kHcsparamsOffset;
+    header.slotCapacity = 8;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    ULONG bytesReturned = 0;
+    ++counters->roundTrips;
+    if (ImodTopologySnapshot(&platform, buffer.data(), static_cast<ULONG>(buffer.size()),
+            static_cast<ULONG>(buffer.size()), &bytesReturned) != IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    counters->maps = simulator->Stats.Maps;
+    counters->reads = simulator->Stats.Reads;
+
+    std::map<std::string, std::vector<uint32_t>> byRoute;
+    std::map<uint32_t, std::vector<uint32_t>> byRootPort;
+    for (uint32_t i = 0; i < header.slotCount; ++i) {
+        tagImodTopologySlot slot{};
+        std::memcpy(&slot, buffer.data() + sizeof(header) + (i * sizeof(slot)), sizeof(slot));
+        if ((slot.flags & IMOD_TOPOLOGY_SLOT_HUB) != 0) {
+            continue;
+        }
+
+        char text[IMOD_TOPOLOGY_ROUTE_TEXT_SIZE] = {};
+        ULONG written = 0;
+        if (ImodTopologyFormatRoute(slot.rootPort, slot.routeString, text, sizeof(text), &written) !=
+            IMOD_RESULT_SUCCESS) {
+            return false;
+        }
+        byRoute[text].push_back(slot.interrupter);
+        byRootPort[slot.rootPort].push_back(slot.interrupter);
+    }
+
+    const std::map<std::string, std::vector<uint32_t>> expected = {{"5", {3}}, {"7.2.4", {1}}, {"7.3", {2}}};
+    return header.slotCount == 5 && byRoute == expected && byRootPort[7].size() == 2;
+}
+
+std::vector<Result> RunTopologyRouteCases(const Options& options) {
+    std::vector<Result> results{Result{"topology_route_text", 0, 0}, Result{"topology_route_walk", 4, 5}};
+    Result& text = results[0];
+    Result& walk = results[1];
+    uint64_t textNs = 0;
+    uint64_t walkNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        auto start = std::chrono::steady_clock::now();
+        text.ok = CheckTopologyRoutes() && text.ok;
+        textNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        Counters counters;
+        start = std::chrono::steady_clock::now();
+        walk.ok = CheckTopologyRouteWalk(options, &counters) && walk.ok;
+        walkNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        walk.counters = counters;
+    }
+    text.wallNs = textNs / std::max<uint32_t>(options.iterations, 1);
+    walk.wallNs = walkNs / std::max<uint32_t>(options.iterations, 1);
+    return results;
+}
+
+// A function's BAR as DTIMOD's MmMapIoSpace platform sees it: the MSI-X table of the msix_*
+// cases, the NIC registers of the nic_* cases. Maps outside the BAR fail and are counted, and
+// neither reader has any business writing, so writes fail too and are counted.
+struct DeviceBar {
+    uint64_t base = 0;
+    std::vector<uint8_t> bytes;
+    Counters* counters = nullptr;
+    uint32_t outsideMaps = 0;
+    bool writable = false;
+};
+
+BOOLEAN DeviceBarMapWindow(PVOID context, ULONGLONG address, ULONG length, PIMOD_REGISTER_WINDOW window) {
+    auto* bar = static_cast<DeviceBar*>(context);
+    std::memset(window, 0, sizeof(*window));
+    ++bar->counters->maps;
+    if (address < bar->base || address - bar->base + length > bar->bytes.size()) {
+        ++bar->outsideMaps;
+        return FALSE;
+    }
+    window->PhysicalAddress = address;
+    window->Length = length;
+    window->Address = bar->bytes.data() + (address - bar->base);
+    return TRUE;
+}
+
+VOID DeviceBarUnmapWindow(PVOID, PIMOD_REGISTER_WINDOW window) {
+    std::memset(window, 0, sizeof(*window));
+}
+
+BOOLEAN DeviceBarReadRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize,
+    ULONGLONG* value) {
+    auto* bar = static_cast<DeviceBar*>(context);
+    ++bar->counters->reads;
+    if (window->Address == nullptr || offset + accessSize > window->Length) {
+        return FALSE;
+    }
+    *value = 0;
+    std::memcpy(value, static_cast<const uint8_t*>(window->Address) + offset, accessSize);
+    return TRUE;
+}
+
+BOOLEAN DeviceBarRead32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG* value) {
+    ULONGLONG wide = 0;
+    if (!DeviceBarReadRegister(context, window, offset, sizeof(ULONG), &wide)) {
+        return FALSE;
+    }
+    *value = static_cast<ULONG>(wide);
+    return TRUE;
+}
+
+BOOLEAN DeviceBarWriteRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize,
+    ULONGLONG value) {
+    auto* bar = static_cast<DeviceBar*>(context);
+    ++bar->counters->writes;
+    if (!bar->writable || window->Address == nullptr || offset + accessSize > window->Length) {
+        return FALSE;
+    }
+    std::memcpy(static_cast<uint8_t*>(window->Address) + offset, &value, accessSize);
+    return TRUE;
+}
+
+BOOLEAN DeviceBarWrite32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG value) {
+    return DeviceBarWriteRegister(context, window, offset, sizeof(ULONG), value);
+}
+
+struct MsixTableEntry {
+    uint32_t addressLow;
+    uint32_t addressHigh;
+    uint32_t data;
+    uint32_t control;
+};
+
+struct MsixExpected {
+    USHORT index;
+    UCHAR vector;
+    ULONG destination;
+    UCHAR flags;
+    USHORT group;
+    UCHAR number;
+};
+
+// config is an `lspci -xxx` capture with the all-zero lines left out. Processors are laid out
+// group by group with APIC ID index * apicStride, which is how the fixtures' machines number them.
+struct MsixCase {
+    const char* name;
+    const char* config;
+    uint64_t barAddress;
+    uint64_t barLength;
+    uint32_t tableOffset;
+    std::vector<MsixTableEntry> table;
+    std::vector<UCHAR> groups;
+    ULONG apicStride;
+    ULONG entryCapacity;
+    ULONG result;
+    ULONG kind;
+    ULONG state;
+    ULONG entryCount;
+    std::vector<MsixExpected> expected;
+};
+
+constexpr UCHAR kMsixRemapped = IMOD_MSIX_ENTRY_REMAPPED;
+constexpr UCHAR kMsixResolved = IMOD_MSIX_ENTRY_RESOLVED;
+
+// VT-d remappable format with SHV: the handle base in the address, the subhandle in the data.
+std::vector<MsixTableEntry> MakeRemappedTable(uint32_t entries, uint32_t handle) {
+    std::vector<MsixTableEntry> table;
+    for (uint32_t index = 0; index < entries; ++index) {
+        table.push_back({0xFEE00018U | (handle << 5), 0, index, 0});
+    }
+    return table;
+}
+
+const std::vector<MsixCase> kMsixCases = {
+    // Alder Lake-S PCH xHCI (8086:7ae0): 64-bit MSI at 0x80, eight vectors to APIC ID 2.
+    {"msix_xhci_msi",
+        "00: 86 80 e0 7a 06 04 90 02 11 30 03 0c 00 00 80 00\n"
+        "10: 04 00 20 a1 00 00 00 00 00 00 00 00 00 00 00 00\n"
+        "20: 00 00 00 00 00 00 00 00 00 00 00 00 28 10 b4 0b\n"
+        "30: 00 00 00 00 70 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "70: 01 80 c2 c1 08 00 00 00 00 00 00 00 00 00 00 00\n"
+        "80: 05 90 b7 00 00 20 e0 fe 00 00 00 00 60 40 00 00\n"
+        "90: 09 00 14 f0 10 00 40 01 00 00 00 00 c1 00 00 00\n",
+        0, 0x10000, 0, {}, {8}, 1, 16, IMOD_RESULT_SUCCESS, IMOD_MSIX_KIND_MSI, IMOD_MSIX_STATE_ENABLED, 8,
+        {{0, 0x60, 2, kMsixResolved, 0, 2}, {7, 0x67, 2, kMsixResolved, 0, 2}}},
+    // I225-V (8086:15f3): MSI-X in BAR3, four RSS queues on even APIC IDs and a masked link vector.
+    {"msix_i225_queues",
+        "00: 86 80 f3 15 06 04 10 00 03 00 00 02 10 00 00 00\n"
+        "10: 00 00 20 a1 00 00 00 00 00 00 00 00 00 00 30 a1\n"
+        "20: 00 00 00 00 00 00 00 00 00 00 00 00 86 80 00 00\n"
+        "30: 00 00 00 00 40 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "40: 01 50 23 c8 08 20 00 00 00 00 00 00 00 00 00 00\n"
+        "50: 05 70 80 01 00 00 00 00 00 00 00 00 00 00 00 00\n"
+        "70: 11 a0 04 80 03 00 00 00 03 20 00 00 00 00 00 00\n"
+        "a0: 10 00 02 00 c2 8c 00 10 10 28 19 00 12 5c 47 00\n",
+        0xA1300000, 0x4000, 0,
+        {{0xFEE00000, 0, 0x51, 0}, {0xFEE02000, 0, 0x52, 0}, {0xFEE04000, 0, 0x53, 0}, {0xFEE06000, 0, 0x54, 0},
+            {0xFEE00000, 0, 0x55, 1}},
+        {8}, 1, 16, IMOD_RESULT_SUCCESS, IMOD_MSIX_KIND_MSIX, IMOD_MSIX_STATE_ENABLED, 5,
+        {{0, 0x51, 0, kMsixResolved, 0, 0}, {1, 0x52, 2, kMsixResolved, 0, 2}, {2, 0x53, 4, kMsixResolved, 0, 4},
+            {3, 0x54, 6, kMsixResolved, 0, 6}, {4, 0x55, 0, IMOD_MSIX_ENTRY_MASKED | kMsixResolved, 0, 0}}},
+    // X710 (8086:1572) behind VT-d: 64-bit BAR3, 129 remapped entries read into room for 64.
+    {"msix_x710_remapped",
+        "00: 86 80 72 15 06 04 10 00 02 00 00 02 10 00 80 00\n"
+        "10: 0c 00 00 00 00 60 00 00 00 00 00 00 0c 80 00 00\n"
+        "20: 00 60 00 00 00 00 00 00 00 00 00 00 86 80 00 00\n"
+        "30: 00 00 00 00 40 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "40: 01 50 03 f8 08 00 00 00 00 00 00 00 00 00 00 00\n"
+        "50: 05 70 80 01 00 00 00 00 00 00 00 00 00 00 00 00\n"
+        "70: 11 a0 80 80 03 00 00 00 03 10 00 00 00 00 00 00\n"
+        "a0: 10 00 02 00 e2 8c 00 10 37 29 10 00 83 3c 47 00\n",
+        0x0000600000008000, 0x8000, 0, MakeRemappedTable(129, 0x40), {48, 48}, 2, 64, IMOD_RESULT_SUCCESS,
+        IMOD_MSIX_KIND_MSIX, IMOD_MSIX_STATE_ENABLED | IMOD_MSIX_STATE_TRUNCATED, 64,
+        {{0, 0, 0x40, kMsixRemapped, 0, 0}, {63, 63, 0x40 + 63, kMsixRemapped, 0, 0}}},
+    // virtio-net (1af4:1041) in a 512-vCPU KVM guest: destinations above 255 in the extended
+    // destination ID bits.
+    {"msix_virtio_extended_id",
+        "00: f4 1a 41 10 07 05 10 00 01 00 00 02 00 00 00 00\n"
+        "10: 00 00 00 00 00 00 00 fc 00 00 00 00 00 00 00 00\n"
+        "20: 0c 00 00 00 00 08 00 00 00 00 00 00 f4 1a 01 11\n"
+        "30: 00 00 00 00 98 00 00 00 00 00 00 00 0b 01 00 00\n"
+        "70: 09 00 10 02 00 00 00 00 00 00 00 00 00 00 00 00\n"
+        "84: 09 70 14 04 04 00 00 00 00 00 00 00 00 00 00 00\n"
+        "98: 11 84 02 80 01 00 00 00 01 08 00 00 00 00 00 00\n",
+        0xFC000000, 0x1000, 0,
+        {{0xFEE00000, 0, 0x41, 0}, {0xFEE2C020, 0, 0x42, 0}, {0xFEEFF020, 0, 0x43, 0}},
+        std::vector<UCHAR>(8, 64), 1, 16, IMOD_RESULT_SUCCESS, IMOD_MSIX_KIND_MSIX, IMOD_MSIX_STATE_ENABLED, 3,
+        {{0, 0x41, 0, kMsixResolved, 0, 0}, {1, 0x42, 300, kMsixResolved, 4, 44}, {2, 0x43, 511, kMsixResolved, 7, 63}}},
+    // RTL8125 (10ec:8125) with the function masked: a logical-mode entry that names no single CPU
+    // and an unprogrammed one.
+    {"msix_rtl8125_logical",
+        "00: ec 10 25 81 07 04 10 00 05 00 00 02 10 00 00 00\n"
+        "10: 01 30 00 00 00 00 00 00 04 00 20 a1 00 00 00 00\n"
+        "20: 04 40 20 a1 00 00 00 00 00 00 00 00 ec 10 23 01\n"
+        "30: 00 00 00 00 40 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "40: 01 50 c3 ff 08 00 00 00 00 00 00 00 00 00 00 00\n"
+        "50: 05 70 80 01 00 00 00 00 00 00 00 00 00 00 00 00\n"
+        "70: 10 b0 02 02 c0 8f 90 05 10 21 09 00 12 cc 47 00\n"
+        "b0: 11 d0 1f c0 04 00 00 00 04 08 00 00 00 00 00 00\n",
+        0xA1204000, 0x4000, 0, {{0xFEE0100C, 0, 0x4071, 0}, {0, 0, 0, 0}}, {16}, 1, 32, IMOD_RESULT_SUCCESS,
+        IMOD_MSIX_KIND_MSIX, IMOD_MSIX_STATE_ENABLED | IMOD_MSIX_STATE_FUNCTION_MASKED, 32,
+        {{0, 0x71, 1, IMOD_MSIX_ENTRY_LOGICAL | IMOD_MSIX_ENTRY_REDIRECTION_HINT, 0, 0},
+            {1, 0, 0, IMOD_MSIX_ENTRY_NOT_APIC, 0, 0}}},
+    // The I225 again, told its BAR is 64 bytes: the table is outside it and nothing is mapped.
+    {"msix_table_outside_bar",
+        "00: 86 80 f3 15 06 04 10 00 03 00 00 02 10 00 00 00\n"
+        "10: 00 00 20 a1 00 00 00 00 00 00 00 00 00 00 30 a1\n"
+        "30: 00 00 00 00 70 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "70: 11 00 04 80 03 00 00 00 03 20 00 00 00 00 00 00\n",
+        0xA1300000, 0x40, 0, {}, {8}, 1, 16, IMOD_RESULT_INVALID_CONTROLLER, 0, 0, 0, {}},
+    // A capability list that loops back on itself ends, and a function in D3cold reads as all ones.
+    {"msix_capability_loop",
+        "00: 86 80 f3 15 06 04 10 00 03 00 00 02 10 00 00 00\n"
+        "30: 00 00 00 00 40 00 00 00 00 00 00 00 ff 01 00 00\n"
+        "40: 01 48 23 c8 08 20 00 00 09 40 00 00 00 00 00 00\n",
+        0, 0, 0, {}, {8}, 1, 16, IMOD_RESULT_SUCCESS, IMOD_MSIX_KIND_NONE, 0, 0, {}},
+    {"msix_function_absent",
+        "00: ff ff ff ff ff ff ff ff ff ff ff ff ff ff ff ff\n",
+        0, 0, 0, {}, {8}, 1, 16, IMOD_RESULT_INVALID_CONTROLLER, 0, 0, 0, {}},
+};
+
+std::vector<UCHAR> ParseConfigDump(const char* dump) {
+    std::vector<UCHAR> config(IMOD_MSIX_CONFIG_SIZE, 0);
+    std::istringstream lines(dump);
+    std::string line;
+    while (std::getline(lines, line)) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        size_t offset = std::stoul(line.substr(0, colon), nullptr, 16);
+        std::istringstream bytes(line.substr(colon + 1));
+        std::string byte;
+        while (bytes >> byte && offset < config.size()) {
+            config[offset++] = static_cast<UCHAR>(std::stoul(byte, nullptr, 16));
+        }
+    }
+    return config;
+}
+
+// One DTIMOD query against a fixture; false when the reply differs from what the capture holds.
+bool QueryMsix(const MsixCase& entry, const std::vector<UCHAR>& config, const std::vector<IMOD_MSIX_PROCESSOR>& processors,
+    DeviceBar* bar) {
+    std::vector<uint8_t> buffer(sizeof(tagImodMsixHeader) + (entry.entryCapacity * sizeof(tagImodMsixEntry)));
+    tagImodMsixHeader header{};
+    header.version = IMOD_MSIX_VERSION;
+    header.entryCapacity = entry.entryCapacity;
+    header.barLength = entry.barLength;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    IMOD_PLATFORM platform{bar, DeviceBarMapWindow, DeviceBarUnmapWindow, DeviceBarRead32, DeviceBarWrite32,
+        DeviceBarReadRegister, DeviceBarWriteRegister};
+    ULONG bytesReturned = 0;
+    ++bar->counters->roundTrips;
+    const ULONG status = ImodMsixSnapshot(&platform, config.data(), static_cast<ULONG>(config.size()), processors.data(),
+        static_cast<ULONG>(processors.size()), buffer.data(), static_cast<ULONG>(buffer.size()),
+        static_cast<ULONG>(buffer.size()), &bytesReturned);
+    if (status != entry.result || bar->counters->writes != 0) {
+        return false;
+    }
+    if (status != IMOD_RESULT_SUCCESS) {
+        return bar->counters->maps == 0;
+    }
+
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (bytesReturned != buffer.size() || header.kind != entry.kind || header.state != entry.state ||
+        header.entryCount != entry.entryCount ||
+        (entry.kind == IMOD_MSIX_KIND_MSIX && header.barAddress != entry.barAddress)) {
+        return false;
+    }
+
+    const auto* entries = reinterpret_cast<const tagImodMsixEntry*>(buffer.data() + sizeof(header));
+    for (const MsixExpected& expected : entry.expected) {
+        const tagImodMsixEntry& actual = entries[expected.index];
+        const bool resolved = (expected.flags & IMOD_MSIX_ENTRY_RESOLVED) != 0;
+        if (actual.index != expected.index || actual.vector != expected.vector ||
+            actual.destination != expected.destination || actual.flags != expected.flags ||
+            (resolved && (actual.group != expected.group || actual.number != expected.number))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// msix_* decode captured config spaces and MSI-X tables the way IOCTL_IMOD_QUERY_MSIX does:
+// MSI from the capability, MSI-X from the table in the function's own BAR, destinations mapped
+// to (group, number) through the APIC IDs. interrupters is the vector count, slots the processor
+// count; maps and reads are what one query costs.
+std::vector<Result> RunMsixCases(const Options& options) {
+    std::vector<Result> results;
+    for (const MsixCase& entry : kMsixCases) {
+        const std::vector<UCHAR> config = ParseConfigDump(entry.config);
+        std::vector<IMOD_MSIX_PROCESSOR> processors;
+        for (size_t group = 0; group < entry.groups.size(); ++group) {
+            for (UCHAR number = 0; number < entry.groups[group]; ++number) {
+                const ULONG index = static_cast<ULONG>(processors.size());
+                processors.push_back({index * entry.apicStride, static_cast<USHORT>(group), number, 0});
+            }
+        }
+
+        Result& result = results.emplace_back(
+            Result{entry.name, entry.entryCount, static_cast<uint32_t>(processors.size())});
+        DeviceBar bar;
+        bar.base = entry.barAddress;
+        bar.bytes.resize(std::max<uint64_t>(entry.barLength, entry.tableOffset + (entry.table.size() * 16)));
+        if (!entry.table.empty()) {
+            std::memcpy(bar.bytes.data() + entry.tableOffset, entry.table.data(), entry.table.size() * 16);
+        }
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            Counters counters;
+            bar.counters = &counters;
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = QueryMsix(entry, config, processors, &bar) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.counters = counters;
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// Traffic on one queue pair of a simulated NIC, in packets per second.
+struct NicTraffic {
+    uint32_t rxPerSecond;
+    uint32_t txPerSecond;
+};
+
+struct NicExpected {
+    ULONG value;
+    ULONG reason;
+};
+
+// One adapter sampled every sampleUs for samples reads. Every queue's vector runs value under
+// moderation; expected holds the recommendation per queue for target, sized from the peak rate.
+// Realtek adapters have no rings in the BAR and are sampled through a running packet counter.
+struct NicCase {
+    const char* name;
+    ULONG family;
+    ULONG moderation;
+    ULONG value;
+    uint64_t barLength;
+    uint32_t ringDescriptors;
+    std::vector<NicTraffic> traffic;
+    IMOD_NIC_TARGET target;
+    std::vector<NicExpected> expected;
+    ULONG result = IMOD_RESULT_SUCCESS;
+    bool removed = false;
+    uint32_t sampleUs = 1000;
+    uint32_t samples = 100;
+};
+
+constexpr uint64_t kNicBarAddress = 0xF7A00000;
+
+const std::vector<NicCase> kNicCases = {
+    // I210 with four busy-to-idle queues at EITR 100 us against 8000 interrupts/s per vector.
+    {"nic_i210_eitr", IMOD_NIC_FAMILY_INTEL_IGB, IMOD_BUDGET_MODERATION_INTEL_EITR, 50 << 2, 0x20000, 256,
+        {{40000, 20000}, {5000, 0}, {0, 0}, {150000, 0}}, {200, 8000, 150, 3000, 300},
+        {{55 << 2, IMOD_NIC_REASON_BUDGET}, {0, IMOD_NIC_REASON_NONE}, {0, IMOD_NIC_REASON_NONE},
+            {60 << 2, IMOD_NIC_REASON_BUDGET}}},
+    // I225 at 200k packets/s: 4000 interrupts/s would take 245 us, the 50 us ceiling wins.
+    {"nic_i225_latency_ceiling", IMOD_NIC_FAMILY_INTEL_IGB, IMOD_BUDGET_MODERATION_INTEL_EITR, 0x80000000 | (10 << 2),
+        0x20000, 512, {{200000, 0}, {0, 1000}}, {50, 4000, 0, 3000, 300},
+        {{0x80000000 | (25 << 2), IMOD_NIC_REASON_LATENCY_CEILING}, {0x80000000, IMOD_NIC_REASON_NONE}}},
+    // I219: one queue pair on the legacy ITR in 256 ns units.
+    {"nic_i219_itr", IMOD_NIC_FAMILY_INTEL_E1000E, IMOD_BUDGET_MODERATION_INTEL_ITR, 0xC4, 0x20000, 256,
+        {{30000, 10000}}, {500, 8000, 0, 3000, 300}, {{0x187, IMOD_NIC_REASON_BUDGET}}},
+    // A 64-descriptor ring laps almost every sample; the heads still add up.
+    {"nic_ring_wrap", IMOD_NIC_FAMILY_INTEL_IGB, IMOD_BUDGET_MODERATION_INTEL_EITR, 0, 0x20000, 64,
+        {{50000, 60000}}, {0, 0, 0, 0, 0}, {{0, IMOD_NIC_REASON_NONE}}},
+    // RTL8125 from the OS counter; the TX half of IntrMit is kept.
+    {"nic_rtl8125_counter", IMOD_NIC_FAMILY_REALTEK, IMOD_BUDGET_MODERATION_REALTEK_INTRMIT_V2, 0x12340000, 0x10000,
+        0, {{100000, 0}}, {100, 10000, 0, 3000, 300}, {{0x1234005A, IMOD_NIC_REASON_BUDGET}}},
+    // The TX rings lie past a 52 KiB BAR: refused before anything outside is mapped.
+    {"nic_outside_bar", IMOD_NIC_FAMILY_INTEL_IGB, IMOD_BUDGET_MODERATION_INTEL_EITR, 0, 0xD000, 256,
+        {{1000, 0}}, {}, {}, IMOD_RESULT_INVALID_PARAMETER},
+    // Surprise removal: every register reads back as all ones.
+    {"nic_removed", IMOD_NIC_FAMILY_INTEL_IGB, IMOD_BUDGET_MODERATION_INTEL_EITR, 0, 0x20000, 256, {{1000, 0}}, {},
+        {}, IMOD_RESULT_INVALID_CONTROLLER, true},
+};
+
+uint64_t NicPacketsBy(uint32_t perSecond, uint64_t timeUs) {
+    return (static_cast<uint64_t>(perSecond) * timeUs) / 1000000;
+}
+
+// The hardware advances the heads as packets arrive; the driver hands descriptors back by
+// moving the tail once per interrupt, and interrupts fire on moderation interval boundaries.
+void UpdateNicRing(DeviceBar* bar, const IMOD_NIC_LAYOUT& layout, uint32_t offset, uint32_t descriptors,
+    uint32_t perSecond, uint64_t timeUs, uint64_t intervalNs) {
+    const uint64_t lastInterruptUs = intervalNs != 0 ? ((timeUs * 1000) / intervalNs) * intervalNs / 1000 : timeUs;
+    const uint64_t arrived = NicPacketsBy(perSecond, timeUs);
+    const uint64_t handled = NicPacketsBy(perSecond, lastInterruptUs);
+    const uint32_t length = descriptors * IMOD_NIC_DESCRIPTOR_SIZE;
+    const uint32_t head = static_cast<uint32_t>(arrived % descriptors);
+    const uint32_t tail = static_cast<uint32_t>((handled + descriptors - 1) % descriptors);
+    std::memcpy(bar->bytes.data() + offset + layout.LengthOffset, &length, sizeof(length));
+    std::memcpy(bar->bytes.data() + offset + layout.HeadOffset, &head, sizeof(head));
+    std::memcpy(bar->bytes.data() + offset + layout.TailOffset, &tail, sizeof(tail));
+}
+
+bool SampleNic(const NicCase& entry, DeviceBar* bar) {
+    IMOD_NIC_LAYOUT layout{};
+    const bool hasRings = ImodNicSamplerLayout(entry.family, &layout) != FALSE;
+    if (hasRings == (entry.family == IMOD_NIC_FAMILY_REALTEK)) {
+        return false;
+    }
+
+    IMOD_PLATFORM platform{bar, DeviceBarMapWindow, DeviceBarUnmapWindow, DeviceBarRead32, DeviceBarWrite32,
+        DeviceBarReadRegister, DeviceBarWriteRegister};
+    const uint64_t intervalNs = ImodBudgetIntervalNs(entry.moderation, entry.value);
+    std::vector<IMOD_NIC_QUEUE_RATE> rates(entry.traffic.size());
+    for (uint32_t sample = 0; sample < entry.samples; ++sample) {
+        const uint64_t timeUs = static_cast<uint64_t>(sample) * entry.sampleUs;
+        for (ULONG queue = 0; queue < entry.traffic.size(); ++queue) {
+            const NicTraffic& traffic = entry.traffic[queue];
+            if (!hasRings) {
+                const uint64_t packets = NicPacketsBy(traffic.rxPerSecond, timeUs) + NicPacketsBy(traffic.txPerSecond, timeUs);
+                ImodNicSamplerAccumulateCounter(&rates[queue], timeUs, packets, entry.moderation, entry.value);
+                continue;
+            }
+
+            if (entry.removed) {
+                std::fill(bar->bytes.begin(), bar->bytes.end(), static_cast<uint8_t>(0xFF));
+            } else {
+                const uint32_t rxOffset = layout.RxBase + (queue * layout.QueueStride);
+                const uint32_t txOffset = layout.TxBase + (queue * layout.QueueStride);
+                UpdateNicRing(bar, layout, rxOffset, entry.ringDescriptors, traffic.rxPerSecond, timeUs, intervalNs);
+                if (txOffset + layout.QueueStride <= bar->bytes.size()) {
+                    UpdateNicRing(bar, layout, txOffset, entry.ringDescriptors, traffic.txPerSecond, timeUs, intervalNs);
+                }
+            }
+
+            IMOD_NIC_QUEUE_SAMPLE queueSample{};
+            ++bar->counters->roundTrips;
+            const ULONG status =
+                ImodNicSamplerReadQueue(&platform, bar->base, entry.barLength, &layout, queue, timeUs, &queueSample);
+            if (status != entry.result) {
+                return false;
+            }
+            if (status != IMOD_RESULT_SUCCESS) {
+                return bar->outsideMaps == 0 && bar->counters->writes == 0;
+            }
+            ImodNicSamplerAccumulate(&rates[queue], &queueSample, entry.moderation, entry.value);
+        }
+    }
+
+    if (entry.result != IMOD_RESULT_SUCCESS || bar->outsideMaps != 0 || bar->counters->writes != 0) {
+        return false;
+    }
+
+    for (size_t queue = 0; queue < rates.size(); ++queue) {
+        const IMOD_NIC_QUEUE_RATE& rate = rates[queue];
+        const uint32_t perSecond = entry.traffic[queue].rxPerSecond + entry.traffic[queue].txPerSecond;
+        if (rate.Samples != entry.samples || rate.AveragePacketsPerSecond != perSecond ||
+            rate.PeakPacketsPerSecond != perSecond || rate.InterruptsPerSecond < rate.InterruptsPerSecondMin ||
+            (hasRings && (rate.TailUpdates != 0) != (perSecond != 0)) ||
+            (perSecond != 0 && rate.InterruptsPerSecond == 0)) {
+            return false;
+        }
+
+        IMOD_NIC_RECOMMENDATION recommendation{};
+        if (ImodNicSamplerRecommend(&entry.target, entry.moderation, entry.value, rate.PeakPacketsPerSecond,
+                &recommendation) != IMOD_RESULT_SUCCESS ||
+            recommendation.Value != entry.expected[queue].value || recommendation.Reason != entry.expected[queue].reason) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// nic_* sample the per-queue descriptor rings of a simulated NIC register window the way the
+// GUI's NIC ITR sampler does, then recommend a moderation value per queue. interrupters is the
+// queue count, slots the number of samples; maps and reads are what the whole run costs.
+std::vector<Result> RunNicCases(const Options& options) {
+    std::vector<Result> results;
+    for (const NicCase& entry : kNicCases) {
+        Result& result =
+            results.emplace_back(Result{entry.name, static_cast<uint32_t>(entry.traffic.size()), entry.samples});
+        DeviceBar bar;
+        bar.base = kNicBarAddress;
+        bar.bytes.resize(entry.barLength);
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            Counters counters;
+            bar.counters = &counters;
+            bar.outsideMaps = 0;
+            std::fill(bar.bytes.begin(), bar.bytes.end(), static_cast<uint8_t>(0));
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = SampleNic(entry, &bar) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.counters = counters;
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// One apply of a built-in NIC profile, found through the VID/DID index. initial holds each
+// vector register's value before the apply and expected its value after; vectors past the end
+// of either take the first entry. The rest of the BAR is filled with kNicItrFill and must
+// come through untouched.
+struct NicItrCase {
+    const char* name;
+    USHORT vendorId;
+    USHORT deviceId;
+    ULONG flags;
+    std::vector<ULONG> values;
+    std::vector<ULONG> initial;
+    std::vector<ULONG> expected;
+    ULONG applied;
+    ULONG failed = 0;
+    ULONG result = IMOD_RESULT_SUCCESS;
+    uint64_t barLength = 0x20000;
+    bool writable = true;
+};
+
+constexpr uint8_t kNicItrFill = 0x5A;
+constexpr ULONG kNicItrApplyFlags = IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY;
+
+const std::vector<NicItrCase> kNicItrCases = {
+    // I225: bits outside the interval field are kept, CNT_WDIS is set on every write, and the
+    // vector that already holds 50 us is left alone.
+    {"nicitr_i225_apply", 0x8086, 0x15F2, kNicItrApplyFlags, {25 << 2}, {0x00A00028, 0x00A00064},
+        {0x80A00064, 0x00A00064}, 4},
+    // Interval microseconds per vector, encoded over what each register holds.
+    {"nicitr_i225_interval_us", 0x8086, 0x125C, kNicItrApplyFlags | IMOD_NIC_APPLY_INTERVAL_US, {50, 20}, {0},
+        {0x80000064, 0x80000028}, 5},
+    // RTL8111: a 16-bit IntrMit at 0xE2; the frame threshold nibbles are kept.
+    {"nicitr_rtl8111_interval_us", 0x10EC, 0x8168, IMOD_BATCH_FLAG_VERIFY | IMOD_NIC_APPLY_INTERVAL_US, {125},
+        {0x5F50}, {0x5F51}, 1},
+    // RTL8125: four 32-bit IntrMit registers 8 bytes apart; only the RX timer byte moves.
+    {"nicitr_rtl8125_interval_us", 0x10EC, 0x8125, kNicItrApplyFlags | IMOD_NIC_APPLY_INTERVAL_US, {20},
+        {0x12345678}, {0x12345614}, 4},
+    // 2 ms is past the RTL8111's 1875 us field: refused before anything is mapped.
+    {"nicitr_interval_range", 0x10EC, 0x8168, kNicItrApplyFlags | IMOD_NIC_APPLY_INTERVAL_US, {2000}, {0x5F50},
+        {0x5F50}, 0, 0, IMOD_RESULT_INVALID_PARAMETER},
+    // The EITR block lies past a 4 KiB BAR.
+    {"nicitr_outside_bar", 0x8086, 0x1533, kNicItrApplyFlags, {25 << 2}, {0}, {0}, 0, 0,
+        IMOD_RESULT_INVALID_PARAMETER, 0x1000},
+    // Surprise removal: the first vector reads back as all ones.
+    {"nicitr_removed", 0x8086, 0x1521, kNicItrApplyFlags, {25 << 2}, {0xFFFFFFFF}, {0xFFFFFFFF}, 0, 0,
+        IMOD_RESULT_INVALID_CONTROLLER},
+    // Writes refused by the platform fail per vector and leave the registers as they were.
+    {"nicitr_write_refused", 0x8086, 0x15B8, kNicItrApplyFlags, {0xC4}, {0x0}, {0x0}, 0, 1, IMOD_RESULT_SUCCESS,
+        0x20000, false},
+};
+
+ULONG NicItrVectorValue(const std::vector<ULONG>& values, ULONG vector) {
+    return values[vector < values.size() ? vector : 0];
+}
+
+bool ApplyNicItr(const NicItrCase& entry, const IMOD_NIC_INDEX& index, DeviceBar* bar) {
+    const IMOD_NIC_PROFILE* profile = ImodNicLookup(&index, entry.vendorId, entry.deviceId);
+    if (profile == nullptr) {
+        return false;
+    }
+
+    const ULONG accessSize = profile->Width / 8;
+    std::fill(bar->bytes.begin(), bar->bytes.end(), kNicItrFill);
+    for (ULONG vector = 0; vector < profile->MaxQueues; ++vector) {
+        const uint64_t offset = profile->BaseOffset + (static_cast<uint64_t>(vector) * profile->Stride);
+        const ULONG value = NicItrVectorValue(entry.initial, vector);
+        if (offset + accessSize <= bar->bytes.size()) {
+            std::memcpy(bar->bytes.data() + offset, &value, accessSize);
+        }
+    }
+
+    IMOD_PLATFORM platform{bar, DeviceBarMapWindow, DeviceBarUnmapWindow, DeviceBarRead32, DeviceBarWrite32,
+        DeviceBarReadRegister, DeviceBarWriteRegister};
+    IMOD_NIC_APPLY apply{};
+    apply.Flags = entry.flags;
+    apply.Count = static_cast<ULONG>(entry.values.size());
+    std::copy(entry.values.begin(), entry.values.end(), apply.Values);
+    ++bar->counters->roundTrips;
+    const ULONG status = ImodNicApply(&platform, bar->base, entry.barLength, profile, &apply);
+    if (status != entry.result || bar->outsideMaps != 0) {
+        return false;
+    }
+    if (status != IMOD_RESULT_SUCCESS) {
+        return bar->counters->writes == 0 &&
+            (status == IMOD_RESULT_INVALID_CONTROLLER || bar->counters->maps == 0);
+    }
+    if (apply.Applied != entry.applied || (entry.failed != 0) != (apply.Failed != 0)) {
+        return false;
+    }
+
+    std::vector<uint8_t> expected(bar->bytes.size(), kNicItrFill);
+    for (ULONG vector = 0; vector < profile->MaxQueues; ++vector) {
+        const uint64_t offset = profile->BaseOffset + (static_cast<uint64_t>(vector) * profile->Stride);
+        const ULONG value = NicItrVectorValue(entry.expected, vector);
+        std::memcpy(expected.data() + offset, &value, accessSize);
+        if (apply.Previous[vector] != NicItrVectorValue(entry.initial, vector) ||
+            (apply.Status[vector] == IMOD_BATCH_STATUS_VERIFIED && apply.Written[vector] != value)) {
+            return false;
+        }
+    }
+    return expected == bar->bytes;
+}
+
+// Every built-in device resolves to its own profile through the index, unknown adapters to
+// none, and the interval encoder rounds, keeps the other fields and refuses what the field
+// cannot hold.
+bool CheckNicItrRegistry(const IMOD_NIC_INDEX& index) {
+    for (ULONG number = 0; number < ImodNicProfileCount(); ++number) {
+        const IMOD_NIC_PROFILE* profile = ImodNicProfileAt(number);
+        for (ULONG device = 0; device < profile->DeviceCount; ++device) {
+            if (ImodNicLookup(&index, profile->VendorId, profile->DeviceIds[device]) != profile) {
+                return false;
+            }
+        }
+    }
+    if (ImodNicLookup(&index, 0x8086, 0xFFFF) != nullptr || ImodNicLookup(&index, 0x10EC, 0x8139) != nullptr ||
+        ImodNicLookup(&index, 0x8086, 0x8168) != nullptr || index.MaxProbes == 0 || index.MaxProbes > 8) {
+        return false;
+    }
+
+    const IMOD_NIC_PROFILE* eitr = ImodNicLookup(&index, 0x8086, 0x15F2);
+    const IMOD_NIC_PROFILE* itr = ImodNicLookup(&index, 0x8086, 0x15B8);
+    const IMOD_NIC_PROFILE* intrMit = ImodNicLookup(&index, 0x10EC, 0x8168);
+    const IMOD_NIC_PROFILE* intrMitV2 = ImodNicLookup(&index, 0x10EC, 0x8125);
+    ULONG value = 0;
+    return ImodNicEncodeIntervalUs(eitr, 0x80000003, 50, &value) == IMOD_RESULT_SUCCESS && value == (0x80000003 | (25 << 2)) &&
+        ImodNicEncodeIntervalUs(eitr, 0, 51, &value) == IMOD_RESULT_SUCCESS && value == (26 << 2) &&
+        ImodNicEncodeIntervalUs(itr, 0, 50, &value) == IMOD_RESULT_SUCCESS && value == 195 &&
+        ImodNicEncodeIntervalUs(intrMit, 0x5F50, 125, &value) == IMOD_RESULT_SUCCESS && value == 0x5F51 &&
+        ImodNicEncodeIntervalUs(intrMitV2, 0x12345678, 20, &value) == IMOD_RESULT_SUCCESS && value == 0x12345614 &&
+        ImodNicIntervalNs(intrMitV2, 0x12345614) == 20000 &&
+        ImodNicEncodeIntervalUs(eitr, 0, 20000, &value) == IMOD_RESULT_INVALID_PARAMETER &&
+        ImodNicEncodeIntervalUs(intrMit, 0, 2000, &value) == IMOD_RESULT_INVALID_PARAMETER;
+}
+
+// nicitr_* apply built-in NIC ITR profiles to a simulated register window the way IMOD.exe
+// reapplies [nic:...] sections at boot. interrupters is the profile's vector count.
+std::vector<Result> RunNicItrCases(const Options& options) {
+    std::vector<Result> results;
+    IMOD_NIC_INDEX index{};
+    const bool indexed = ImodNicIndexBuild(&index) == IMOD_RESULT_SUCCESS;
+
+    Result& registry = results.emplace_back(Result{"nicitr_registry", ImodNicProfileCount(), index.Entries});
+    uint64_t registryNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        const auto start = std::chrono::steady_clock::now();
+        registry.ok = indexed && CheckNicItrRegistry(index) && registry.ok;
+        registryNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    registry.wallNs = registryNs / std::max<uint32_t>(options.iterations, 1);
+
+    for (const NicItrCase& entry : kNicItrCases) {
+        const IMOD_NIC_PROFILE* profile = ImodNicLookup(&index, entry.vendorId, entry.deviceId);
+        Result& result = results.emplace_back(Result{entry.name, profile != nullptr ? profile->MaxQueues : 0, 0});
+        DeviceBar bar;
+        bar.base = kNicBarAddress;
+        bar.bytes.resize(entry.barLength);
+        bar.writable = entry.writable;
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            Counters counters;
+            bar.counters = &counters;
+            bar.outsideMaps = 0;
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = indexed && ApplyNicItr(entry, index, &bar) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.counters = counters;
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// One [nic:] apply handed to the drift watchdog, then every vector register is set to drift,
+// the way an adapter reset leaves them, and one pass must leave expected there. The rest of
+// the BAR is filled with kNicItrFill and must come through untouched, so a 16-bit IntrMit
+// is never rewritten together with its neighbour.
+struct WatchdogCase {
+    const char* name;
+    USHORT vendorId;
+    USHORT deviceId;
+    ULONG flags;
+    ULONG value;
+    ULONG initial;
+    ULONG drift;
+    ULONG expected;
+    ULONG rewrites;
+    ULONG unavailable = 0;
+};
+
+const std::vector<WatchdogCase> kWatchdogCases = {
+    // I225: the interval field is put back over what the reset left, with CNT_WDIS set.
+    {"watchdog_i225_drift", 0x8086, 0x15F2, kNicItrApplyFlags, 25 << 2, 0x00A00028, 0x00A00000, 0x80A00064, 5},
+    // CNT_WDIS does not read back; a register that only lost it has not drifted.
+    {"watchdog_i225_strobe", 0x8086, 0x15F2, kNicItrApplyFlags, 25 << 2, 0x00A00028, 0x00A00064, 0x00A00064, 0},
+    // RTL8111: IntrMit is 16 bits at 0xE2 and is rewritten at 16 bits.
+    {"watchdog_rtl8111_width", 0x10EC, 0x8168, kNicItrApplyFlags | IMOD_NIC_APPLY_INTERVAL_US, 125, 0x5F50,
+        0x0000, 0x5F51, 1},
+    // RTL8125: a reset clears IntrMit; the new RX timer and the TX half the apply kept come back.
+    {"watchdog_rtl8125_drift", 0x10EC, 0x8125, kNicItrApplyFlags | IMOD_NIC_APPLY_INTERVAL_US, 20, 0x12345678,
+        0x00000000, 0x12345614, 4},
+    // An adapter in D3 reads all ones: counted as unavailable and not written.
+    {"watchdog_removed", 0x8086, 0x15F2, kNicItrApplyFlags, 25 << 2, 0x00A00028, 0xFFFFFFFF, 0xFFFFFFFF, 0, 5},
+};
+
+bool FillNicVectors(const IMOD_NIC_PROFILE& profile, ULONG value, DeviceBar* bar) {
+    const ULONG accessSize = profile.Width / 8;
+    for (ULONG vector = 0; vector < profile.MaxQueues; ++vector) {
+        const uint64_t offset = profile.BaseOffset + (static_cast<uint64_t>(vector) * profile.Stride);
+        if (offset + accessSize > bar->bytes.size()) {
+            return false;
+        }
+        std::memcpy(bar->bytes.data() + offset, &value, accessSize);
+    }
+    return true;
+}
+
+bool RunWatchdog(const WatchdogCase& entry, const IMOD_NIC_INDEX& index, DeviceBar* bar) {
+    const IMOD_NIC_PROFILE* profile = ImodNicLookup(&index, entry.vendorId, entry.deviceId);
+    if (profile == nullptr) {
+        return false;
+    }
+
+    std::fill(bar->bytes.begin(), bar->bytes.end(), kNicItrFill);
+    if (!FillNicVectors(*profile, entry.initial, bar)) {
+        return false;
+    }
+
+    IMOD_PLATFORM platform{bar, DeviceBarMapWindow, DeviceBarUnmapWindow, DeviceBarRead32, DeviceBarWrite32,
+        DeviceBarReadRegister, DeviceBarWriteRegister};
+    IMOD_NIC_APPLY apply{};
+    apply.Flags = entry.flags;
+    apply.Count = 1;
+    apply.Values[0] = entry.value;
+    if (ImodNicApply(&platform, bar->base, bar->bytes.size(), profile, &apply) != IMOD_RESULT_SUCCESS ||
+        apply.Failed != 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> config(sizeof(tagImodWatchdogConfigHeader) +
+        (profile->MaxQueues * sizeof(tagImodWatchdogEntry)));
+    tagImodWatchdogConfigHeader header{};
+    header.version = IMOD_WATCHDOG_VERSION;
+    header.periodMs = IMOD_WATCHDOG_MIN_PERIOD_MS;
+    header.entryCount = ImodNicWatchdogEntries(bar->base, profile, &apply, 0,
+        reinterpret_cast<tagImodWatchdogEntry*>(config.data() + sizeof(header)));
+    std::memcpy(config.data(), &header, sizeof(header));
+    if (header.entryCount != profile->MaxQueues) {
+        return false;
+    }
+
+    std::vector<ULONGLONG> storage((ImodWatchdogRequiredSize(header.entryCount) + sizeof(ULONGLONG) - 1) /
+        sizeof(ULONGLONG));
+    auto* watchdog = reinterpret_cast<IMOD_WATCHDOG*>(storage.data());
+    if (ImodWatchdogInitialize(watchdog, storage.size() * sizeof(ULONGLONG), config.data(),
+            static_cast<ULONG>(config.size())) != IMOD_RESULT_SUCCESS ||
+        ImodWatchdogCheck(&platform, watchdog) != 0) {
+        return false;
+    }
+
+    if (!FillNicVectors(*profile, entry.drift, bar)) {
+        return false;
+    }
+    ++bar->counters->roundTrips;
+    const uint32_t writesBefore = bar->counters->writes;
+    if (ImodWatchdogCheck(&platform, watchdog) != entry.rewrites ||
+        bar->counters->writes - writesBefore != entry.rewrites ||
+        watchdog->Groups[0].rewrites != entry.rewrites ||
+        watchdog->Groups[0].unavailable != entry.unavailable ||
+        watchdog->Groups[0].driftEvents != (entry.rewrites != 0 ? 1U : 0U) ||
+        bar->outsideMaps != 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> expected(bar->bytes.size(), kNicItrFill);
+    const ULONG accessSize = profile->Width / 8;
+    for (ULONG vector = 0; vector < profile->MaxQueues; ++vector) {
+        const uint64_t offset = profile->BaseOffset + (static_cast<uint64_t>(vector) * profile->Stride);
+        std::memcpy(expected.data() + offset, &entry.expected, accessSize);
+    }
+    return expected == bar->bytes;
+}
+
+// The driver refuses entries the pass could not perform at their own width.
+bool CheckWatchdogValidation() {
+    struct Config {
+        tagImodWatchdogConfigHeader header;
+        tagImodWatchdogEntry entry;
+    };
+    const auto make = [](ULONGLONG address, ULONG accessSize, ULONG mask, ULONG value, ULONG orBits) {
+        Config config{};
+        config.header.version = IMOD_WATCHDOG_VERSION;
+        config.header.periodMs = IMOD_WATCHDOG_MIN_PERIOD_MS;
+        config.header.entryCount = 1;
+        config.entry.address = address;
+        config.entry.mask = mask;
+        config.entry.value = value;
+        config.entry.orBits = orBits;
+        config.entry.accessSize = accessSize;
+        return config;
+    };
+    const auto validate = [](const Config& config) {
+        ULONG count = 0;
+        return ImodWatchdogValidate(&config, sizeof(config), &count);
+    };
+
+    Config version = make(kNicBarAddress + 0x1680, 4, 0x7FFC, 0x64, 0x80000000);
+    version.header.version = 1;
+    return validate(make(kNicBarAddress + 0x1680, 4, 0x7FFC, 0x64, 0x80000000)) == IMOD_RESULT_SUCCESS &&
+        validate(make(kNicBarAddress + 0xE2, 2, 0xFFFF, 0x5F51, 0)) == IMOD_RESULT_SUCCESS &&
+        validate(make(kNicBarAddress + 0xE2, 4, 0xFFFF, 0x5F51, 0)) == IMOD_RESULT_INVALID_PARAMETER &&
+        validate(make(kNicBarAddress + 0xE1, 2, 0xFFFF, 0x5F51, 0)) == IMOD_RESULT_INVALID_PARAMETER &&
+        validate(make(kNicBarAddress + 0xE0, 8, 0xFFFF, 0x5F51, 0)) == IMOD_RESULT_INVALID_PARAMETER &&
+        validate(make(kNicBarAddress + 0xE2, 2, 0x1FFFF, 0x5F51, 0)) == IMOD_RESULT_INVALID_PARAMETER &&
+        validate(make(kNicBarAddress + 0x1680, 4, 0x7FFC, 0x64, 0x4)) == IMOD_RESULT_INVALID_PARAMETER &&
+        validate(version) == IMOD_RESULT_UNSUPPORTED_VERSION;
+}
+
+// watchdog_* hand a NIC ITR apply to the drift watchdog the way IMOD.exe --watchdog does
+// and replay an adapter reset under it. interrupters is the profile's vector count.
+std::vector<Result> RunWatchdogCases(const Options& options) {
+    std::vector<Result> results;
+    IMOD_NIC_INDEX index{};
+    const bool indexed = ImodNicIndexBuild(&index) == IMOD_RESULT_SUCCESS;
+
+    Result& validation = results.emplace_back(Result{"watchdog_validate", 1, 0});
+    uint64_t validationNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        const auto start = std::chrono::steady_clock::now();
+        validation.ok = CheckWatchdogValidation() && validation.ok;
+        validationNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    validation.wallNs = validationNs / std::max<uint32_t>(options.iterations, 1);
+
+    for (const WatchdogCase& entry : kWatchdogCases) {
+        const IMOD_NIC_PROFILE* profile = ImodNicLookup(&index, entry.vendorId, entry.deviceId);
+        Result& result = results.emplace_back(Result{entry.name, profile != nullptr ? profile->MaxQueues : 0, 0});
+        DeviceBar bar;
+        bar.base = kNicBarAddress;
+        bar.bytes.resize(0x4000);
+        bar.writable = true;
+
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            Counters counters;
+            bar.counters = &counters;
+            bar.outsideMaps = 0;
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = indexed && RunWatchdog(entry, index, &bar) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.counters = counters;
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// DTIMOD's boot path (Common/imod_boot.c) over simulated controllers: the table it reads from
+// the registry, one apply pass per controller arrival, the watchdog config it derives from what
+// was applied and the status IMOD.exe queries. The controllers share one platform, as they
+// share DTIMOD's, which hands each access to the simulator whose BAR holds it.
+struct BootMachine {
+    std::vector<SimulatorPtr> simulators;
+    std::vector<IMOD_PLATFORM> platforms;
+};
+
+const IMOD_PLATFORM* BootPlatformAt(PVOID context, ULONGLONG address) {
+    BootMachine* machine = static_cast<BootMachine*>(context);
+    for (size_t i = 0; i < machine->simulators.size(); ++i) {
+        const ULONGLONG base = machine->simulators[i]->Config.BarAddress;
+        if (address >= base && address - base < machine->simulators[i]->BarLength) {
+            return &machine->platforms[i];
+        }
+    }
+    return nullptr;
+}
+
+BOOLEAN BootMapWindow(PVOID context, ULONGLONG address, ULONG length, PIMOD_REGISTER_WINDOW window) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, address);
+    return platform != nullptr && platform->MapWindow(platform->Context, address, length, window);
+}
+
+VOID BootUnmapWindow(PVOID context, PIMOD_REGISTER_WINDOW window) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, window->PhysicalAddress);
+    if (platform != nullptr) {
+        platform->UnmapWindow(platform->Context, window);
+    }
+}
+
+BOOLEAN BootRead32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG* value) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, window->PhysicalAddress);
+    return platform != nullptr && platform->Read32(platform->Context, window, offset, value);
+}
+
+BOOLEAN BootWrite32(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG value) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, window->PhysicalAddress);
+    return platform != nullptr && platform->Write32(platform->Context, window, offset, value);
+}
+
+BOOLEAN BootReadRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize,
+    ULONGLONG* value) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, window->PhysicalAddress);
+    return platform != nullptr && platform->ReadRegister(platform->Context, window, offset, accessSize, value);
+}
+
+BOOLEAN BootWriteRegister(PVOID context, const IMOD_REGISTER_WINDOW* window, ULONG offset, ULONG accessSize,
+    ULONGLONG value) {
+    const IMOD_PLATFORM* platform = BootPlatformAt(context, window->PhysicalAddress);
+    return platform != nullptr && platform->WriteRegister(platform->Context, window, offset, accessSize, value);
+}
+
+bool MakeBootMachine(uint32_t controllers, uint32_t interrupters, const Options& options, BootMachine* machine,
+    IMOD_PLATFORM* platform) {
+    for (uint32_t ordinal = 0; ordinal < controllers; ++ordinal) {
+        SimulatorPtr simulator = MakeController(interrupters, 0, options, ordinal);
+        if (!simulator) {
+            return false;
+        }
+        ImodSimulatorInitializePlatform(simulator.get(), &machine->platforms.emplace_back());
+        machine->simulators.push_back(std::move(simulator));
+    }
+
+    *platform = {};
+    platform->Context = machine;
+    platform->MapWindow = BootMapWindow;
+    platform->UnmapWindow = BootUnmapWindow;
+    platform->Read32 = BootRead32;
+    platform->Write32 = BootWrite32;
+    platform->ReadRegister = BootReadRegister;
+    platform->WriteRegister = BootWriteRegister;
+    return true;
+}
+
+ULONG SimulatorHcsparams(const IMOD_SIMULATOR& simulator) {
+    ULONG value = 0;
+    std::memcpy(&value, simulator.Bar + kHcsparamsOffset, sizeof(value));
+    return value;
+}
+
+tagImodBootTableController MakeBootController(const IMOD_SIMULATOR& simulator, ULONG firstInterval,
+    ULONG intervalCount) {
+    tagImodBootTableController controller{};
+    controller.capabilityAddress = CapabilityAddress(simulator);
+    controller.barLength = simulator.BarLength;
+    controller.hcsparamsOffset = kHcsparamsOffset;
+    controller.rtsoffOffset = kRtsoffOffset;
+    controller.hcsparamsSignature = SimulatorHcsparams(simulator);
+    controller.defaultInterval = kInterval;
+    controller.firstInterval = firstInterval;
+    controller.intervalCount = intervalCount;
+    return controller;
+}
+
+// The REG_BINARY IMOD.exe writes: header, controller records, interval pool, FNV-1a over the
+// last two.
+std::vector<UCHAR> MakeBootTable(const std::vector<tagImodBootTableController>& controllers,
+    const std::vector<ULONG>& intervals) {
+    tagImodBootTableHeader header{};
+    header.magic = IMOD_BOOT_TABLE_MAGIC;
+    header.version = IMOD_BOOT_TABLE_VERSION;
+    header.headerSize = sizeof(header);
+    header.controllerCount = static_cast<ULONG>(controllers.size());
+    header.intervalCount = static_cast<ULONG>(intervals.size());
+
+    const size_t controllerBytes = controllers.size() * sizeof(tagImodBootTableController);
+    std::vector<UCHAR> table(sizeof(header) + controllerBytes + (intervals.size() * sizeof(ULONG)));
+    std::memcpy(table.data() + sizeof(header), controllers.data(), controllerBytes);
+    std::memcpy(table.data() + sizeof(header) + controllerBytes, intervals.data(), intervals.size() * sizeof(ULONG));
+    header.checksum = ImodBootTableChecksum(table.data() + sizeof(header), static_cast<ULONG>(table.size() - sizeof(header)));
+    std::memcpy(table.data(), &header, sizeof(header));
+    return table;
+}
+
+ULONG ParseBootTable(const std::vector<UCHAR>& table) {
+    IMOD_BOOT_TABLE parsed{};
+    return ImodBootTableParse(table.data(), static_cast<ULONG>(table.size()), &parsed);
+}
+
+// A valid table, then one defect at a time; every rejected table leaves nothing to apply.
+bool CheckBootTable(const Options& options) {
+    BootMachine machine;
+    IMOD_PLATFORM platform{};
+    if (!MakeBootMachine(1, 8, options, &machine, &platform)) {
+        return false;
+    }
+
+    const IMOD_SIMULATOR& simulator = *machine.simulators[0];
+    const std::vector<UCHAR> valid = MakeBootTable({MakeBootController(simulator, 0, 2)}, {0x100, 0x200});
+    IMOD_BOOT_TABLE parsed{};
+    if (ImodBootTableParse(valid.data(), static_cast<ULONG>(valid.size()), &parsed) != IMOD_RESULT_SUCCESS ||
+        parsed.Header->controllerCount != 1 || ImodBootPlanInterval(&parsed, 0, 0) != 0x100 ||
+        ImodBootPlanInterval(&parsed, 0, 1) != 0x200 || ImodBootPlanInterval(&parsed, 0, 7) != kInterval) {
+        return false;
+    }
+
+    std::vector<UCHAR> badMagic = valid;
+    badMagic[0] ^= 0xFF;
+    std::vector<UCHAR> badVersion = valid;
+    tagImodBootTableHeader header{};
+    std::memcpy(&header, badVersion.data(), sizeof(header));
+    header.version = IMOD_BOOT_TABLE_VERSION + 1;
+    std::memcpy(badVersion.data(), &header, sizeof(header));
+    std::vector<UCHAR> badChecksum = valid;
+    badChecksum.back() ^= 0x01;
+    std::vector<UCHAR> truncated(valid.begin(), valid.end() - sizeof(ULONG));
+    tagImodBootTableController absent = MakeBootController(simulator, 0, 2);
+    absent.hcsparamsSignature = 0xFFFFFFFF;
+    tagImodBootTableController overrun = MakeBootController(simulator, 1, 2);
+
+    if (ParseBootTable(badMagic) != IMOD_RESULT_INVALID_TABLE ||
+        ParseBootTable(badVersion) != IMOD_RESULT_UNSUPPORTED_VERSION ||
+        ParseBootTable(badChecksum) != IMOD_RESULT_INVALID_TABLE ||
+        ParseBootTable(truncated) != IMOD_RESULT_INVALID_TABLE ||
+        ParseBootTable(MakeBootTable({absent}, {0x100, 0x200})) != IMOD_RESULT_INVALID_TABLE ||
+        ParseBootTable(MakeBootTable({overrun}, {0x100, 0x200})) != IMOD_RESULT_INVALID_TABLE ||
+        ParseBootTable(MakeBootTable({}, {})) != IMOD_RESULT_INVALID_TABLE) {
+        return false;
+    }
+
+    IMOD_BOOT_STATE state{};
+    ImodBootStateInitialize(&state, badChecksum.data(), static_cast<ULONG>(badChecksum.size()));
+    return state.TableState == IMOD_BOOT_TABLE_REJECTED && state.TableResult == IMOD_RESULT_INVALID_TABLE &&
+        ImodBootApplyPending(&platform, &state) == 0 && state.ApplyPasses == 0 &&
+        machine.simulators[0]->Stats.Writes == 0;
+}
+
+// Controller 0 applies on the first pass, controller 1 now reports a different HCSPARAMS1 and
+// is left alone for good, controller 2 is in D3 until the second pass.
+bool CheckBootApply(const Options& options, IMOD_BOOT_STATE* state, BootMachine* machine, IMOD_PLATFORM* platform,
+    std::vector<UCHAR>* table, Counters* counters) {
+    if (!MakeBootMachine(3, 8, options, machine, platform)) {
+        return false;
+    }
+
+    tagImodBootTableController replaced = MakeBootController(*machine->simulators[1], 0, 0);
+    replaced.hcsparamsSignature ^= 0x1;
+    *table = MakeBootTable(
+        {MakeBootController(*machine->simulators[0], 0, 2), replaced, MakeBootController(*machine->simulators[2], 2, 1)},
+        {0x100, 0x200, 0x40});
+    ImodBootStateInitialize(state, table->data(), static_cast<ULONG>(table->size()));
+    if (state->TableState != IMOD_BOOT_TABLE_LOADED) {
+        return false;
+    }
+
+    machine->simulators[2]->Faults.Removed = TRUE;
+    ++counters->roundTrips;
+    if (ImodBootApplyPending(platform, state) != 1 ||
+        state->Controllers[0].state != IMOD_BOOT_CONTROLLER_APPLIED ||
+        state->Controllers[1].state != IMOD_BOOT_CONTROLLER_MISMATCH ||
+        state->Controllers[2].state != IMOD_BOOT_CONTROLLER_PENDING ||
+        state->Controllers[2].hcsparams != 0xFFFFFFFF || machine->simulators[1]->Stats.Writes != 0) {
+        return false;
+    }
+
+    machine->simulators[2]->Faults.Removed = FALSE;
+    ++counters->roundTrips;
+    if (ImodBootApplyPending(platform, state) != 0 ||
+        state->Controllers[2].state != IMOD_BOOT_CONTROLLER_APPLIED || state->Controllers[2].attempts != 2 ||
+        state->Controllers[1].attempts != 1 || state->Controllers[0].attempts != 1 || state->ApplyPasses != 2) {
+        return false;
+    }
+
+    *counters = {counters->roundTrips};
+    for (const SimulatorPtr& simulator : machine->simulators) {
+        counters->maps += simulator->Stats.Maps;
+        counters->reads += simulator->Stats.Reads;
+        counters->writes += simulator->Stats.Writes;
+    }
+
+    // Controller 0 takes pool entries 0-1, controller 2 entry 2; the rest get the default.
+    for (ULONG interrupter = 0; interrupter < 8; ++interrupter) {
+        if (ImodSimulatorInterval(machine->simulators[0].get(), interrupter) !=
+                (interrupter < 2 ? 0x100 * (interrupter + 1) : kInterval) ||
+            ImodSimulatorInterval(machine->simulators[1].get(), interrupter) != IMOD_XHCI_IMODI_DEFAULT ||
+            ImodSimulatorInterval(machine->simulators[2].get(), interrupter) != (interrupter == 0 ? 0x40 : kInterval)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A controller that never leaves D3 is tried IMOD_BOOT_MAX_ATTEMPTS times and then dropped,
+// so a late wake-up does not get the boot values any more.
+bool CheckBootExhaust(const Options& options, Counters* counters) {
+    BootMachine machine;
+    IMOD_PLATFORM platform{};
+    if (!MakeBootMachine(1, 8, options, &machine, &platform)) {
+        return false;
+    }
+
+    const std::vector<UCHAR> table = MakeBootTable({MakeBootController(*machine.simulators[0], 0, 0)}, {});
+    IMOD_BOOT_STATE state{};
+    ImodBootStateInitialize(&state, table.data(), static_cast<ULONG>(table.size()));
+    machine.simulators[0]->Faults.Removed = TRUE;
+    for (ULONG pass = 1; pass <= IMOD_BOOT_MAX_ATTEMPTS; ++pass) {
+        ++counters->roundTrips;
+        const ULONG pending = ImodBootApplyPending(&platform, &state);
+        if (pending != (pass < IMOD_BOOT_MAX_ATTEMPTS ? 1UL : 0UL) || state.Controllers[0].attempts != pass ||
+            state.Controllers[0].state != IMOD_BOOT_CONTROLLER_PENDING) {
+            return false;
+        }
+    }
+
+    machine.simulators[0]->Faults.Removed = FALSE;
+    ++counters->roundTrips;
+    counters->maps = machine.simulators[0]->Stats.Maps;
+    counters->reads = machine.simulators[0]->Stats.Reads;
+    counters->writes = machine.simulators[0]->Stats.Writes;
+    return ImodBootApplyPending(&platform, &state) == 0 && state.Controllers[0].attempts == IMOD_BOOT_MAX_ATTEMPTS &&
+        ImodSimulatorInterval(machine.simulators[0].get(), 0) == IMOD_XHCI_IMODI_DEFAULT &&
+        ImodBootWatchdogConfigSize(&state) == sizeof(tagImodWatchdogConfigHeader);
+}
+
+// One watchdog entry per interrupter of every applied controller, grouped by table index, at
+// the IMOD register the batch just wrote and holding the planned interval.
+bool CheckBootWatchdog(const IMOD_BOOT_STATE& state, const BootMachine& machine) {
+    const ULONG size = ImodBootWatchdogConfigSize(&state);
+    std::vector<UCHAR> config(size);
+    ImodBootBuildWatchdogConfig(&state, 250, config.data());
+    tagImodWatchdogConfigHeader header{};
+    std::memcpy(&header, config.data(), sizeof(header));
+    ULONG validated = 0;
+    if (size != sizeof(header) + (16 * sizeof(tagImodWatchdogEntry)) || header.version != IMOD_WATCHDOG_VERSION ||
+        header.periodMs != 250 || header.entryCount != 16 ||
+        ImodWatchdogValidate(config.data(), size, &validated) != IMOD_RESULT_SUCCESS || validated != 16) {
+        return false;
+    }
+
+    const ULONG groups[] = {0, 2};
+    for (ULONG i = 0; i < header.entryCount; ++i) {
+        tagImodWatchdogEntry entry{};
+        std::memcpy(&entry, config.data() + sizeof(header) + (i * sizeof(entry)), sizeof(entry));
+        const ULONG index = groups[i / 8];
+        const ULONG interrupter = i % 8;
+        const ULONGLONG runtime = machine.simulators[index]->Config.BarAddress + IMOD_SIMULATOR_RUNTIME_OFFSET;
+        if (entry.groupId != index || entry.mask != IMOD_XHCI_IMODI_MASK || entry.accessSize != sizeof(ULONG) ||
+            entry.address != runtime + IMOD_XHCI_INTERRUPTER_OFFSET(interrupter) + IMOD_XHCI_IMOD_OFFSET ||
+            entry.value != ImodBootPlanInterval(&state.Table, index, interrupter)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The IOCTL reply: header and per-controller records, cut to what fits.
+bool CheckBootStatus(const IMOD_BOOT_STATE& state) {
+    std::vector<UCHAR> buffer(sizeof(tagImodBootStatusHeader) + (3 * sizeof(tagImodBootControllerStatus)));
+    ULONG bytesReturned = 0;
+    tagImodBootStatusHeader header{};
+    if (ImodBootQueryStatus(&state, buffer.data(), static_cast<ULONG>(buffer.size()), &bytesReturned) !=
+            IMOD_RESULT_SUCCESS ||
+        bytesReturned != buffer.size()) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.version != IMOD_BOOT_STATUS_VERSION || header.tableState != IMOD_BOOT_TABLE_LOADED ||
+        header.tableResult != IMOD_RESULT_SUCCESS || header.controllerCount != 3 || header.pendingCount != 0 ||
+        header.applyPasses != 2) {
+        return false;
+    }
+
+    const ULONG states[] = {IMOD_BOOT_CONTROLLER_APPLIED, IMOD_BOOT_CONTROLLER_MISMATCH, IMOD_BOOT_CONTROLLER_APPLIED};
+    for (ULONG i = 0; i < 3; ++i) {
+        tagImodBootControllerStatus status{};
+        std::memcpy(&status, buffer.data() + sizeof(header) + (i * sizeof(status)), sizeof(status));
+        if (status.capabilityAddress != state.Table.Controllers[i].capabilityAddress || status.state != states[i] ||
+            (status.state == IMOD_BOOT_CONTROLLER_APPLIED && (status.written != 8 || status.failed != 0))) {
+            return false;
+        }
+    }
+
+    // Room for the header and one record: the counts still cover every controller.
+    if (ImodBootQueryStatus(&state, buffer.data(),
+            static_cast<ULONG>(sizeof(header) + sizeof(tagImodBootControllerStatus)), &bytesReturned) !=
+            IMOD_RESULT_SUCCESS ||
+        bytesReturned != sizeof(header) + sizeof(tagImodBootControllerStatus)) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.controllerCount != 3 ||
+        ImodBootQueryStatus(&state, buffer.data(), sizeof(header) - 1, &bytesReturned) != IMOD_RESULT_BUFFER_TOO_SMALL ||
+        ImodBootQueryStatus(nullptr, buffer.data(), static_cast<ULONG>(buffer.size()), &bytesReturned) !=
+            IMOD_RESULT_SUCCESS) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.tableState != IMOD_BOOT_TABLE_NONE || bytesReturned != sizeof(header)) {
+        return false;
+    }
+
+    IMOD_BOOT_STATE rejected{};
+    const UCHAR garbage[sizeof(tagImodBootTableHeader)] = {};
+    ImodBootStateInitialize(&rejected, garbage, sizeof(garbage));
+    ImodBootQueryStatus(&rejected, buffer.data(), static_cast<ULONG>(buffer.size()), &bytesReturned);
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    return header.tableState == IMOD_BOOT_TABLE_REJECTED && header.tableResult == IMOD_RESULT_INVALID_TABLE &&
+        header.controllerCount == 0;
+}
+
+std::vector<Result> RunBootCases(const Options& options) {
+    std::vector<Result> results{Result{"boot_table", 8, 1}, Result{"boot_apply", 8, 3}, Result{"boot_exhaust", 8, 1},
+        Result{"boot_watchdog", 8, 3}, Result{"boot_status", 8, 3}};
+    std::vector<uint64_t> totalNs(results.size());
+    const auto timed = [&](size_t index, const std::function<bool()>& body) {
+        const auto start = std::chrono::steady_clock::now();
+        results[index].ok = body() && results[index].ok;
+        totalNs[index] += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        timed(0, [&] { return CheckBootTable(options); });
+
+        // The state points into the table, which has to outlive it.
+        auto state = std::make_unique<IMOD_BOOT_STATE>();
+        BootMachine machine;
+        IMOD_PLATFORM platform{};
+        std::vector<UCHAR> table;
+        Counters applyCounters;
+        timed(1, [&] { return CheckBootApply(options, state.get(), &machine, &platform, &table, &applyCounters); });
+        results[1].counters = applyCounters;
+
+        Counters exhaustCounters;
+        timed(2, [&] { return CheckBootExhaust(options, &exhaustCounters); });
+        results[2].counters = exhaustCounters;
+
+        const bool applied = results[1].ok;
+        timed(3, [&] { return applied && CheckBootWatchdog(*state, machine); });
+        timed(4, [&] { return applied && CheckBootStatus(*state); });
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        results[i].wallNs = totalNs[i] / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// IMOD.exe --sample over a simulated controller. Between samples the host driver side consumes
+// a known number of events per interrupter, so the rates ImodSamplerAccumulate derives from
+// ERDP alone are known exactly. 0 runs at 5000 events/s and laps the 16-TRB ring three times,
+// 1 at 6000 with three events left pending throughout, 2 sees nothing, 3 runs with IMODI=0.
+constexpr ULONG kSamplerEvents[] = {5, 6, 0, 7};
+constexpr ULONG kSamplerBacklog[] = {0, 3, 0, 0};
+constexpr ULONG kSamplerMinX100[] = {500, 600, 0, 100};
+constexpr ULONG kSamplerPeriodUs = 1000;
+constexpr ULONG kSamplerSamples = 12;
+
+bool CheckSamplerRates(const Options& options, Counters* counters) {
+    SimulatorPtr simulator = MakeController(4, 0, options);
+    if (!simulator) {
+        return false;
+    }
+
+    IMOD_PLATFORM platform{};
+    ImodSimulatorInitializePlatform(simulator.get(), &platform);
+    const ULONGLONG runtime = simulator->Config.BarAddress + IMOD_SIMULATOR_RUNTIME_OFFSET;
+    const ULONG unmoderated = 0;
+    std::memcpy(simulator->Bar + IMOD_SIMULATOR_RUNTIME_OFFSET + IMOD_XHCI_INTERRUPTER_OFFSET(3) + IMOD_XHCI_IMOD_OFFSET,
+        &unmoderated, sizeof(unmoderated));
+
+    IMOD_EVENT_RING rings[4]{};
+    IMOD_INTERRUPTER_RATE rates[4]{};
+    for (ULONG i = 0; i < 4; ++i) {
+        if (ImodSamplerReadEventRing(&platform, runtime, i, &rings[i]) != IMOD_RESULT_SUCCESS ||
+            rings[i].SegmentCount != 1 || rings[i].TrbCount != simulator->Config.EventRingTrbs ||
+            ImodSimulatorPostEvents(simulator.get(), i, kSamplerBacklog[i]) != kSamplerBacklog[i]) {
+            return false;
+        }
+    }
+
+    for (ULONG sample = 0; sample < kSamplerSamples; ++sample) {
+        for (ULONG i = 0; i < 4; ++i) {
+            if (sample != 0 && (ImodSimulatorPostEvents(simulator.get(), i, kSamplerEvents[i]) != kSamplerEvents[i] ||
+                                   ImodSimulatorConsumeEvents(simulator.get(), i, kSamplerEvents[i]) != kSamplerEvents[i])) {
+                return false;
+            }
+
+            IMOD_INTERRUPTER_SAMPLE read{};
+            ++counters->roundTrips;
+            if (ImodSamplerReadInterrupter(&platform, runtime, i, &rings[i], IMOD_SAMPLER_DEFAULT_SCAN,
+                    static_cast<ULONGLONG>(sample) * kSamplerPeriodUs, &read) != IMOD_RESULT_SUCCESS ||
+                read.DequeueIndex != (sample * kSamplerEvents[i]) % rings[i].TrbCount ||
+                read.Pending != kSamplerBacklog[i]) {
+                return false;
+            }
+            ImodSamplerAccumulate(&rates[i], &rings[i], &read);
+
+            const ULONG expected = kSamplerEvents[i] * (1000000 / kSamplerPeriodUs);
+            if (sample != 0 && (rates[i].LastEvents != kSamplerEvents[i] || rates[i].EventsPerSecond != expected ||
+                                   rates[i].EventsPerInterruptMinX100 != kSamplerMinX100[i])) {
+                return false;
+            }
+        }
+    }
+
+    for (ULONG i = 0; i < 4; ++i) {
+        const ULONG intervals = kSamplerSamples - 1;
+        if (rates[i].Samples != kSamplerSamples || rates[i].TotalEvents != intervals * kSamplerEvents[i] ||
+            rates[i].ElapsedUs != intervals * kSamplerPeriodUs ||
+            rates[i].DequeueUpdates != (kSamplerEvents[i] != 0 ? intervals : 0) ||
+            rates[i].EventsPerUpdateX100 != kSamplerEvents[i] * 100 ||
+            rates[i].PeakEventsPerSecond != rates[i].EventsPerSecond || rates[i].PeakPending != kSamplerBacklog[i]) {
+            return false;
+        }
+    }
+
+    // A controller gone to D3 reads all ones, which is not a dequeue pointer.
+    simulator->Faults.Removed = TRUE;
+    IMOD_INTERRUPTER_SAMPLE removed{};
+    ++counters->roundTrips;
+    const bool rejected = ImodSamplerReadInterrupter(&platform, runtime, 0, &rings[0], IMOD_SAMPLER_DEFAULT_SCAN,
+                              kSamplerSamples * kSamplerPeriodUs, &removed) == IMOD_RESULT_INVALID_CONTROLLER &&
+        removed.Pending == IMOD_SAMPLER_PENDING_UNKNOWN;
+
+    counters->maps = simulator->Stats.Maps;
+    counters->reads = simulator->Stats.Reads;
+    counters->writes = simulator->Stats.Writes;
+    counters->simulatedNs = simulator->Stats.ElapsedNs;
+    return rejected;
+}
+
+std::vector<Result> RunSamplerCases(const Options& options) {
+    Result result{"sampler_rates", 4, 0};
+    uint64_t totalNs = 0;
+    for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+        Counters counters;
+        const auto start = std::chrono::steady_clock::now();
+        result.ok = CheckSamplerRates(options, &counters) && result.ok;
+        totalNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        result.counters = counters;
+    }
+
+    result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    return {result};
+}
+
+// IMOD.exe --govern's control step (Common/imod_governor.c) over recorded event rate traces:
+// one rate per tick, the decisions checked tick by tick. Intervals are IMODI units.
+constexpr ULONG kGovernorFloor = 0x100;
+constexpr ULONG kGovernorCeiling = 0x2000;
+
+IMOD_GOVERNOR_LIMITS GovernorLimits(ULONG budget, ULONG hysteresis, ULONG holdTicks) {
+    IMOD_GOVERNOR_LIMITS limits{};
+    limits.MinInterval = kGovernorFloor;
+    limits.MaxInterval = kGovernorCeiling;
+    limits.IrqBudget = budget;
+    limits.HysteresisPercent = hysteresis;
+    limits.HoldTicks = holdTicks;
+    return limits;
+}
+
+// Runs the trace and returns the ticks at which the interval moved.
+std::vector<size_t> RunGovernorTrace(const IMOD_GOVERNOR_LIMITS& limits, const std::vector<ULONG>& trace,
+    IMOD_GOVERNOR_CHANNEL* channel, std::vector<IMOD_GOVERNOR_DECISION>* decisions) {
+    std::vector<size_t> changes;
+    for (size_t tick = 0; tick < trace.size(); ++tick) {
+        IMOD_GOVERNOR_DECISION decision{};
+        if (ImodGovernorStep(&limits, channel, trace[tick], &decision)) {
+            changes.push_back(tick);
+        }
+        if (decisions != nullptr) {
+            decisions->push_back(decision);
+        }
+    }
+    return changes;
+}
+
+// The smoothed rate is the integer EWMA with 1/4 weight, primed by the first sample, and
+// settles within 3 events/s of a step in either direction.
+bool CheckGovernorEwma() {
+    std::vector<ULONG> trace(40, 12000);
+    trace.insert(trace.end(), 40, 2000);
+    trace.front() = 0;
+
+    IMOD_GOVERNOR_CHANNEL channel{};
+    ImodGovernorInitialize(&channel, kGovernorFloor);
+    std::vector<IMOD_GOVERNOR_DECISION> decisions;
+    RunGovernorTrace(GovernorLimits(100000, IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT, 0), trace, &channel, &decisions);
+
+    ULONG smoothed = 0;
+    for (size_t tick = 0; tick < trace.size(); ++tick) {
+        smoothed = tick == 0 ? trace[tick] : static_cast<ULONG>((3ULL * smoothed + trace[tick]) / 4);
+        if (decisions[tick].SmoothedEventsPerSecond != smoothed) {
+            return false;
+        }
+    }
+
+    const ULONG rising = decisions[39].SmoothedEventsPerSecond;
+    const ULONG falling = decisions.back().SmoothedEventsPerSecond;
+    return rising <= 12000 && 12000 - rising <= 3 && falling >= 2000 && falling - 2000 <= 3 && channel.Adjustments == 0;
+}
+
+// A load that swings +/- 700 around a 4000/s budget: once over it, the default 20% band keeps
+// the interval put, where a governor without a band or hold flips it every tick.
+bool CheckGovernorHysteresis() {
+    std::vector<ULONG> trace(20, 8000);
+    for (size_t tick = 0; tick < 200; ++tick) {
+        trace.push_back(tick % 2 == 0 ? 3300 : 4700);
+    }
+
+    IMOD_GOVERNOR_CHANNEL banded{};
+    ImodGovernorInitialize(&banded, kGovernorFloor);
+    std::vector<IMOD_GOVERNOR_DECISION> decisions;
+    const std::vector<size_t> bandedChanges = RunGovernorTrace(
+        GovernorLimits(4000, IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT, IMOD_GOVERNOR_DEFAULT_HOLD_TICKS), trace,
+        &banded, &decisions);
+
+    IMOD_GOVERNOR_CHANNEL bare{};
+    ImodGovernorInitialize(&bare, kGovernorFloor);
+    const std::vector<size_t> bareChanges = RunGovernorTrace(GovernorLimits(4000, 0, 0), trace, &bare, nullptr);
+
+    return bandedChanges == std::vector<size_t>{0} && decisions[0].Reason == IMOD_GOVERNOR_REASON_OVER_BUDGET &&
+        banded.Interval == ImodGovernorBudgetInterval(4000) && bareChanges.size() > 150;
+}
+
+// After a move the channel sits out HoldTicks ticks even with the rate already under the band,
+// then drops on the first tick it may.
+bool CheckGovernorHold() {
+    const std::vector<ULONG> trace = {0, 5000, 0, 0, 0, 0, 0, 0};
+    for (ULONG hold = 0; hold <= 5; ++hold) {
+        IMOD_GOVERNOR_CHANNEL channel{};
+        ImodGovernorInitialize(&channel, kGovernorFloor);
+        std::vector<IMOD_GOVERNOR_DECISION> decisions;
+        const std::vector<size_t> changes =
+            RunGovernorTrace(GovernorLimits(1000, IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT, hold), trace, &channel,
+                &decisions);
+
+        // The smoothed rate crosses the 1200/s band edge on tick 1 and falls under 800/s on tick 3.
+        const std::vector<size_t> expected = {1, std::max<size_t>(3, 2 + hold)};
+        if (changes != expected || decisions[expected[1]].Reason != IMOD_GOVERNOR_REASON_UNDER_BUDGET ||
+            channel.Interval != kGovernorFloor) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A pseudo-random trace over several budgets: every interval the governor picks is the floor
+// or the budget interval clipped to the latency ceiling, and limits edited mid-hold apply at
+// once.
+bool CheckGovernorClamp() {
+    const ULONG budgets[] = {0, 400, 500, 1000, 4000, 20000, 250000, 4000000};
+    uint32_t seed = 0x6A09E667U;
+    bool ceilingHit = false;
+    for (ULONG budget : budgets) {
+        const IMOD_GOVERNOR_LIMITS limits = GovernorLimits(budget, 10, 1);
+        const ULONG budgetInterval = std::min(std::max(ImodGovernorBudgetInterval(budget), kGovernorFloor), kGovernorCeiling);
+        std::vector<ULONG> trace;
+        for (size_t tick = 0; tick < 400; ++tick) {
+            seed = (seed * 1664525U) + 1013904223U;
+            trace.push_back((seed >> 8) % (tick % 50 < 25 ? 2 * std::max<ULONG>(budget, 1) : 200000));
+        }
+
+        IMOD_GOVERNOR_CHANNEL channel{};
+        ImodGovernorInitialize(&channel, 0);
+        std::vector<IMOD_GOVERNOR_DECISION> decisions;
+        RunGovernorTrace(limits, trace, &channel, &decisions);
+        for (const IMOD_GOVERNOR_DECISION& decision : decisions) {
+            if ((decision.Interval != kGovernorFloor && decision.Interval != budgetInterval) ||
+                (decision.Reason == IMOD_GOVERNOR_REASON_LATENCY_CEILING) !=
+                    (decision.Reason != IMOD_GOVERNOR_REASON_NONE && decision.Interval == kGovernorCeiling &&
+                        ImodGovernorBudgetInterval(budget) > kGovernorCeiling)) {
+                return false;
+            }
+            ceilingHit = ceilingHit || decision.Reason == IMOD_GOVERNOR_REASON_LATENCY_CEILING;
+        }
+        if (budget == 0 && channel.Adjustments != 1) {
+            return false;
+        }
+    }
+    if (!ceilingHit) {
+        return false;
+    }
+
+    // Raising the floor over the current interval while the channel holds moves it right away.
+    IMOD_GOVERNOR_LIMITS limits = GovernorLimits(1000, IMOD_GOVERNOR_DEFAULT_HYSTERESIS_PERCENT, 10);
+    IMOD_GOVERNOR_CHANNEL channel{};
+    ImodGovernorInitialize(&channel, kGovernorFloor);
+    IMOD_GOVERNOR_DECISION decision{};
+    if (!ImodGovernorStep(&limits, &channel, 50000, &decision) || channel.HoldRemaining != 10) {
+        return false;
+    }
+    limits.MinInterval = ImodGovernorBudgetInterval(1000) + 1;
+    return ImodGovernorStep(&limits, &channel, 50000, &decision) &&
+        decision.Reason == IMOD_GOVERNOR_REASON_LIMITS_CHANGED && decision.Interval == limits.MinInterval;
+}
+
+struct GovernorCase {
+    const char* name;
+    bool (*check)();
+};
+
+constexpr GovernorCase kGovernorCases[] = {
+    {"governor_ewma", CheckGovernorEwma},
+    {"governor_hysteresis", CheckGovernorHysteresis},
+    {"governor_hold", CheckGovernorHold},
+    {"governor_clamp", CheckGovernorClamp},
+};
+
+std::vector<Result> RunGovernorCases(const Options& options) {
+    std::vector<Result> results;
+    for (const GovernorCase& entry : kGovernorCases) {
+        Result& result = results.emplace_back(Result{entry.name, 1, 0});
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = entry.check() && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// IMODSim's model (Common/imod_latency.c) held to what moderation has to do whatever the
+// devices: IMODI=0 reports every event at once, a longer interval never lowers latency or
+// raises the interrupt rate, and one seed always gives the same answer. Two interrupters: a
+// polled mouse with an occasional keyboard, and a gamepad next to an audio stream.
+constexpr IMOD_LATENCY_DEVICE kLatencyDevices[] = {
+    {IMOD_LATENCY_SPEED_HIGH, 1, 0, 1000, 0},
+    {IMOD_LATENCY_SPEED_FULL, 10, 0, 100, 0},
+    {IMOD_LATENCY_SPEED_FULL, 4, 0, 1000, 1},
+    {IMOD_LATENCY_SPEED_HIGH, 4, 0, 700, 1},
+};
+constexpr ULONG kLatencyDeviceCount = sizeof(kLatencyDevices) / sizeof(kLatencyDevices[0]);
+constexpr ULONG kLatencySweep[] = {0, 0x10, 0x40, 0xFA, 0x3E8, 0xFA0, 0x2000, 0x8000, IMOD_XHCI_IMODI_MASK};
+
+struct LatencyRun {
+    std::vector<IMOD_LATENCY_DEVICE_RESULT> devices = std::vector<IMOD_LATENCY_DEVICE_RESULT>(kLatencyDeviceCount);
+    IMOD_LATENCY_INTERRUPTER_RESULT interrupters[2]{};
+};
+
+bool SimulateLatency(ULONG interval, ULONGLONG seed, LatencyRun* run) {
+    const IMOD_LATENCY_CONFIG config{IMOD_LATENCY_LANES, 100000, seed};
+    const ULONG intervals[] = {interval, interval};
+    return ImodLatencySimulate(&config, kLatencyDevices, kLatencyDeviceCount, intervals, 2, run->devices.data(),
+               run->interrupters) == IMOD_RESULT_SUCCESS;
+}
+
+bool CheckLatencyZeroInterval() {
+    LatencyRun run;
+    if (!SimulateLatency(0, 1, &run)) {
+        return false;
+    }
+    for (const IMOD_LATENCY_DEVICE_RESULT& device : run.devices) {
+        if (device.Events == 0 || device.Histogram[0] != device.Events || device.P50Ns != 0 || device.P99Ns != 0 ||
+            device.MaxNs != 0) {
+            return false;
+        }
+    }
+    for (const IMOD_LATENCY_INTERRUPTER_RESULT& interrupter : run.interrupters) {
+        if (interrupter.MaxNs != 0 || interrupter.InterruptsPerSecond == 0 ||
+            interrupter.InterruptsPerSecond > interrupter.EventsPerSecond) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The same polls and completions at every interval, so the event rate stays put while the
+// latency percentiles only grow and the interrupt rate only falls.
+bool CheckLatencyMonotonic() {
+    LatencyRun previous;
+    for (size_t i = 0; i < std::size(kLatencySweep); ++i) {
+        LatencyRun run;
+        if (!SimulateLatency(kLatencySweep[i], 1, &run)) {
+            return false;
+        }
+        if (i == 0) {
+            previous = run;
+            continue;
+        }
+
+        for (ULONG d = 0; d < kLatencyDeviceCount; ++d) {
+            const IMOD_LATENCY_DEVICE_RESULT& now = run.devices[d];
+            const IMOD_LATENCY_DEVICE_RESULT& before = previous.devices[d];
+            if (now.Events != before.Events || now.P50Ns < before.P50Ns || now.P99Ns < before.P99Ns ||
+                now.MaxNs < before.MaxNs) {
+                return false;
+            }
+        }
+        for (ULONG n = 0; n < 2; ++n) {
+            const IMOD_LATENCY_INTERRUPTER_RESULT& now = run.interrupters[n];
+            const IMOD_LATENCY_INTERRUPTER_RESULT& before = previous.interrupters[n];
+            if (now.EventsPerSecond != before.EventsPerSecond || now.InterruptsPerSecond > before.InterruptsPerSecond ||
+                now.P50Ns < before.P50Ns || now.P99Ns < before.P99Ns || now.MaxNs < before.MaxNs) {
+                return false;
+            }
+        }
+        previous = run;
+    }
+
+    // Past the poll period every interrupt carries more than one event.
+    return previous.interrupters[0].InterruptsPerSecond < previous.interrupters[0].EventsPerSecond;
+}
+
+bool SameLatency(const LatencyRun& left, const LatencyRun& right) {
+    return std::memcmp(left.devices.data(), right.devices.data(), kLatencyDeviceCount * sizeof(IMOD_LATENCY_DEVICE_RESULT)) == 0 &&
+        std::memcmp(left.interrupters, right.interrupters, sizeof(left.interrupters)) == 0;
+}
+
+// Bit-identical results for a repeated seed, and the vector run matches each interrupter run on
+// its own, so a sweep compares candidates on the same traffic.
+bool CheckLatencySeed() {
+    LatencyRun first;
+    LatencyRun second;
+    LatencyRun other;
+    if (!SimulateLatency(0xFA, 0x5EED, &first) || !SimulateLatency(0xFA, 0x5EED, &second) ||
+        !SimulateLatency(0xFA, 0x5EED + 1, &other) || !SameLatency(first, second) || SameLatency(first, other)) {
+        return false;
+    }
+
+    const IMOD_LATENCY_CONFIG config{IMOD_LATENCY_LANES, 100000, 0x5EED};
+    LatencyRun single;
+    for (ULONG n = 0; n < 2; ++n) {
+        if (ImodLatencySimulateInterrupter(&config, kLatencyDevices, kLatencyDeviceCount, n, 0xFA,
+                single.devices.data(), &single.interrupters[n]) != IMOD_RESULT_SUCCESS) {
+            return false;
+        }
+    }
+    return SameLatency(first, single);
+}
+
+struct LatencyCase {
+    const char* name;
+    bool (*check)();
+};
+
+constexpr LatencyCase kLatencyCases[] = {
+    {"latency_zero_interval", CheckLatencyZeroInterval},
+    {"latency_monotonic", CheckLatencyMonotonic},
+    {"latency_seed", CheckLatencySeed},
+};
+
+std::vector<Result> RunLatencyCases(const Options& options) {
+    std::vector<Result> results;
+    for (const LatencyCase& entry : kLatencyCases) {
+        Result& result = results.emplace_back(Result{entry.name, 2, 0});
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = entry.check() && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    }
+    return results;
+}
+
+// The verification examples from the NDIS RSS documentation: the default key, and for each
+// pair the expected hash over the addresses alone and over the full 4-tuple.
+struct RssVector {
+    UCHAR family;
+    std::vector<uint16_t> source;
+    std::vector<uint16_t> destination;
+    USHORT sourcePort;
+    USHORT destinationPort;
+    ULONG addressHash;
+    ULONG tupleHash;
+};
+
+const uint8_t kRssKey[IMOD_RSS_KEY_SIZE] = {
+    0x6D, 0x5A, 0x56, 0xDA, 0x25, 0x5B, 0x0E, 0xC2, 0x41, 0x67, 0x25, 0x3D, 0x43, 0xA3,
+    0x8F, 0xB0, 0xD0, 0xCA, 0x2B, 0xCB, 0xAE, 0x7B, 0x30, 0xB4, 0x77, 0xCB, 0x2D, 0xA3,
+    0x80, 0x30, 0xF2, 0x0C, 0x6A, 0x42, 0xB7, 0x3B, 0xBE, 0xAC, 0x01, 0xFA};
+
+// IPv4 addresses are two 16-bit halves, IPv6 addresses eight groups.
+const std::vector<RssVector> kRssVectors = {
+    {IMOD_RSS_FAMILY_IPV4, {0x4209, 0x95BB}, {0xA18E, 0x6450}, 2794, 1766, 0x323E8FC2, 0x51CCC178},
+    {IMOD_RSS_FAMILY_IPV4, {0xC75C, 0x6F02}, {0x4145, 0x8C53}, 14230, 4739, 0xD718262A, 0xC626B0EA},
+    {IMOD_RSS_FAMILY_IPV4, {0x1813, 0xC65F}, {0x0C16, 0xCFB8}, 12898, 38024, 0xD2D0A5DE, 0x5C2B394A},
+    {IMOD_RSS_FAMILY_IPV4, {0x261B, 0xCD1E}, {0xD18E, 0xA306}, 48228, 2217, 0x82989176, 0xAFC7327F},
+    {IMOD_RSS_FAMILY_IPV4, {0x9927, 0xA3BF}, {0xCABC, 0x7F02}, 44251, 1303, 0x5D1809C5, 0x10E828A2},
+    {IMOD_RSS_FAMILY_IPV6, {0x3FFE, 0x2501, 0x0200, 0x1FFF, 0, 0, 0, 0x0007}, {0x3FFE, 0x2501, 0x0200, 0x0003, 0, 0, 0, 0x0001},
+        2794, 1766, 0x2CC18CD5, 0x40207D3D},
+    {IMOD_RSS_FAMILY_IPV6, {0x3FFE, 0x0501, 0x0008, 0, 0x0260, 0x97FF, 0xFE40, 0xEFAB}, {0xFF02, 0, 0, 0, 0, 0, 0, 0x0001},
+        14230, 4739, 0x0F0C461C, 0xDDE51BBF},
+    {IMOD_RSS_FAMILY_IPV6, {0x3FFE, 0x1900, 0x4545, 0x0003, 0x0200, 0xF8FF, 0xFE21, 0x67CF},
+        {0xFE80, 0, 0, 0, 0x0200, 0xF8FF, 0xFE21, 0x67CF}, 44251, 38024, 0x4B61E985, 0x02D1FEEF},
+};
+
+void StoreRssAddress(const std::vector<uint16_t>& groups, UCHAR* address) {
+    for (size_t i = 0; i < groups.size(); ++i) {
+        address[i * 2] = static_cast<UCHAR>(groups[i] >> 8);
+        address[(i * 2) + 1] = static_cast<UCHAR>(groups[i]);
+    }
+}
+
+bool CheckRssVectors(const IMOD_RSS_TOEPLITZ& toeplitz) {
+    for (const RssVector& vector : kRssVectors) {
+        IMOD_RSS_FLOW flows[2]{};
+        for (IMOD_RSS_FLOW& flow : flows) {
+            flow.Family = vector.family;
+            StoreRssAddress(vector.source, flow.Source);
+            StoreRssAddress(vector.destination, flow.Destination);
+            flow.SourcePort = vector.sourcePort;
+            flow.DestinationPort = vector.destinationPort;
+        }
+        flows[1].HasPorts = 1;
+
+        ULONG hashes[2]{};
+        ImodRssHashFlows(&toeplitz, flows, 2, hashes);
+        for (uint32_t i = 0; i < 2; ++i) {
+            UCHAR input[IMOD_RSS_MAX_INPUT];
+            const ULONG length = ImodRssFlowInput(&flows[i], input);
+            const ULONG expected = i == 0 ? vector.addressHash : vector.tupleHash;
+            if (hashes[i] != expected || ImodRssHash(&toeplitz, input, length) != expected ||
+                ImodRssHashReference(kRssKey, IMOD_RSS_KEY_SIZE, input, length) != expected) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Clients on ephemeral ports against a few servers, the shape of a game or download host.
+std::vector<IMOD_RSS_FLOW> MakeRssFlows(uint32_t count, UCHAR family) {
+    std::vector<IMOD_RSS_FLOW> flows(count);
+    uint32_t state = 0x12345678;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    for (IMOD_RSS_FLOW& flow : flows) {
+        const uint32_t client = next();
+        const uint32_t server = next() % 16;
+        flow.Family = family;
+        flow.HasPorts = 1;
+        const uint32_t length = family == IMOD_RSS_FAMILY_IPV4 ? 4 : 16;
+        std::memcpy(flow.Source + length - 4, &client, 4);
+        flow.Source[0] = family == IMOD_RSS_FAMILY_IPV4 ? 10 : 0x20;
+        flow.Destination[0] = family == IMOD_RSS_FAMILY_IPV4 ? 192 : 0x20;
+        flow.Destination[length - 1] = static_cast<UCHAR>(10 + server);
+        flow.SourcePort = static_cast<USHORT>(49152 + (next() % 16384));
+        flow.DestinationPort = server < 8 ? 443 : 27015;
+        flow.Weight = 1 + (next() % 64);
+    }
+    return flows;
+}
+
+// Every 4096th hash is checked against the bit-serial reference.
+bool HashRssFlows(const IMOD_RSS_TOEPLITZ& toeplitz, const std::vector<IMOD_RSS_FLOW>& flows, std::vector<ULONG>* hashes,
+    IMOD_RSS_BUCKETS* buckets) {
+    ImodRssHashFlows(&toeplitz, flows.data(), static_cast<ULONG>(flows.size()), hashes->data());
+    ImodRssBucketsReset(buckets);
+    ImodRssBucketsAdd(buckets, flows.data(), hashes->data(), static_cast<ULONG>(flows.size()));
+    for (size_t i = 0; i < flows.size(); i += 4096) {
+        UCHAR input[IMOD_RSS_MAX_INPUT];
+        const ULONG length = ImodRssFlowInput(&flows[i], input);
+        if ((*hashes)[i] != ImodRssHashReference(kRssKey, IMOD_RSS_KEY_SIZE, input, length)) {
+            return false;
+        }
+    }
+    return buckets->TotalFlows == flows.size();
+}
+
+// Every base and power-of-two queue count on 64 processors, round robin and balanced. The
+// balanced fill may never come out less even than round robin over the same processors.
+bool PlanRss(const IMOD_RSS_BUCKETS& buckets, uint32_t* candidates) {
+    *candidates = 0;
+    for (uint32_t queues = 2; queues <= IMOD_RSS_MAX_PROCESSORS; queues *= 2) {
+        for (uint32_t base = 0; base + queues <= IMOD_RSS_MAX_PROCESSORS; ++base) {
+            IMOD_RSS_CANDIDATE roundRobin{base, queues, 1, IMOD_RSS_MAX_TABLE, IMOD_RSS_TABLE_ROUND_ROBIN, {}};
+            IMOD_RSS_CANDIDATE balanced{base, queues, 1, IMOD_RSS_MAX_TABLE, IMOD_RSS_TABLE_BALANCED, {}};
+            IMOD_RSS_SPREAD roundRobinSpread{};
+            IMOD_RSS_SPREAD balancedSpread{};
+            if (ImodRssFillIndirection(&roundRobin, &buckets) != IMOD_RESULT_SUCCESS ||
+                ImodRssFillIndirection(&balanced, &buckets) != IMOD_RESULT_SUCCESS ||
+                ImodRssEvaluate(&buckets, &roundRobin, &roundRobinSpread) != IMOD_RESULT_SUCCESS ||
+                ImodRssEvaluate(&buckets, &balanced, &balancedSpread) != IMOD_RESULT_SUCCESS ||
+                balancedSpread.ImbalancePermille > roundRobinSpread.ImbalancePermille ||
+                roundRobinSpread.IdleProcessors != 0 || roundRobinSpread.HotProcessor < base ||
+                roundRobinSpread.HotProcessor >= base + queues) {
+                return false;
+            }
+            *candidates += 2;
+        }
+    }
+
+    // A table that is not a power of two and processors past the limit are refused.
+    IMOD_RSS_CANDIDATE bad{0, 2, 1, 96, IMOD_RSS_TABLE_ROUND_ROBIN, {}};
+    IMOD_RSS_CANDIDATE past{IMOD_RSS_MAX_PROCESSORS - 1, 2, 1, IMOD_RSS_MAX_TABLE, IMOD_RSS_TABLE_ROUND_ROBIN, {}};
+    return ImodRssFillIndirection(&bad, &buckets) == IMOD_RESULT_INVALID_PARAMETER &&
+        ImodRssFillIndirection(&past, &buckets) == IMOD_RESULT_INVALID_PARAMETER;
+}
+
+// rss_* run the offline RSS planner's Toeplitz kernel and candidate sweep. rss_verify checks
+// the documented hash examples; rss_hash_* hash slots synthetic flows per iteration, so
+// wall_ns / slots is the cost of one flow; rss_plan ranks interrupters candidates.
+std::vector<Result> RunRssCases(const Options& options) {
+    std::vector<Result> results;
+    auto toeplitz = std::make_unique<IMOD_RSS_TOEPLITZ>();
+    const bool prepared = ImodRssToeplitzPrepare(kRssKey, IMOD_RSS_KEY_SIZE, toeplitz.get()) == IMOD_RESULT_SUCCESS;
+    const uint32_t flowCount = options.quick ? (1U << 16) : (1U << 20);
+
+    auto timed = [&](Result& result, const std::function<bool()>& body) {
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = prepared && body() && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    };
+
+    Result& verify = results.emplace_back(Result{"rss_verify", 0, static_cast<uint32_t>(kRssVectors.size() * 2)});
+    timed(verify, [&]() { return CheckRssVectors(*toeplitz); });
+
+    IMOD_RSS_BUCKETS buckets{};
+    for (const UCHAR family : {static_cast<UCHAR>(IMOD_RSS_FAMILY_IPV4), static_cast<UCHAR>(IMOD_RSS_FAMILY_IPV6)}) {
+        const std::vector<IMOD_RSS_FLOW> flows = MakeRssFlows(flowCount, family);
+        std::vector<ULONG> hashes(flows.size());
+        Result& hash = results.emplace_back(
+            Result{family == IMOD_RSS_FAMILY_IPV4 ? "rss_hash_ipv4" : "rss_hash_ipv6", 0, flowCount});
+        timed(hash, [&]() { return HashRssFlows(*toeplitz, flows, &hashes, &buckets); });
+    }
+
+    Result& plan = results.emplace_back(Result{"rss_plan", 0, static_cast<uint32_t>(buckets.TotalFlows)});
+    timed(plan, [&]() { return PlanRss(buckets, &plan.interrupters); });
+    return results;
+}
+
+// A controller that keeps features 07h-09h the way the NVMe specification has them: Number of
+// Queues fixed at reset, Interrupt Coalescing one dword, Interrupt Vector Configuration one per
+// vector, saved values apart from current ones. Only the first vectors answer Get Features 09h,
+// as on a controller granted fewer MSI-X messages than queues. failSet fails the n-th Set
+// Features (from 1) and, when sticky, every one after it; ignoreSet reports success without
+// storing anything, so only a readback can tell.
+struct MockNvme {
+    uint32_t queues = 8;
+    uint32_t vectors = 9;
+    ULONG coalescing = 0;
+    ULONG savedCoalescing = 0;
+    std::vector<UCHAR> disable = std::vector<UCHAR>(IMOD_NVME_MAX_VECTORS, 0);
+    std::vector<UCHAR> savedDisable = std::vector<UCHAR>(IMOD_NVME_MAX_VECTORS, 0);
+    uint32_t sets = 0;
+    uint32_t failSet = 0;
+    uint32_t ignoreSet = 0;
+    bool sticky = false;
+    Counters* counters = nullptr;
+};
+
+BOOLEAN MockNvmeGetFeature(PVOID context, ULONG cdw10, ULONG cdw11, ULONG* completion) {
+    auto* nvme = static_cast<MockNvme*>(context);
+    const ULONG select = (cdw10 >> 8) & 0x7;
+    const ULONG vector = cdw11 & 0xFFFF;
+    ++nvme->counters->roundTrips;
+    ++nvme->counters->reads;
+    *completion = 0;
+    switch (cdw10 & 0xFF) {
+    case IMOD_NVME_FEATURE_NUMBER_OF_QUEUES:
+        *completion = ((nvme->queues - 1) << 16) | (nvme->queues - 1);
+        return select == IMOD_NVME_SELECT_CURRENT ? TRUE : FALSE;
+    case IMOD_NVME_FEATURE_INTERRUPT_COALESCING:
+        *completion = select == IMOD_NVME_SELECT_DEFAULT ? 0
+            : select == IMOD_NVME_SELECT_SAVED           ? nvme->savedCoalescing
+                                                         : nvme->coalescing;
+        return TRUE;
+    case IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG:
+        if (vector >= nvme->vectors) {
+            return FALSE;
+        }
+        *completion = vector | (static_cast<ULONG>(select == IMOD_NVME_SELECT_DEFAULT ? 0
+                                        : select == IMOD_NVME_SELECT_SAVED         ? nvme->savedDisable[vector]
+                                                                                   : nvme->disable[vector])
+                                   << 16);
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+BOOLEAN MockNvmeSetFeature(PVOID context, ULONG cdw10, ULONG cdw11, ULONG* completion) {
+    auto* nvme = static_cast<MockNvme*>(context);
+    const bool save = (cdw10 & 0x80000000UL) != 0;
+    const ULONG vector = cdw11 & 0xFFFF;
+    ++nvme->counters->roundTrips;
+    ++nvme->counters->writes;
+    *completion = 0;
+    ++nvme->sets;
+    if (nvme->sets == nvme->failSet || (nvme->sticky && nvme->failSet != 0 && nvme->sets > nvme->failSet)) {
+        return FALSE;
+    }
+    if (nvme->sets == nvme->ignoreSet) {
+        return TRUE;
+    }
+
+    switch (cdw10 & 0xFF) {
+    case IMOD_NVME_FEATURE_INTERRUPT_COALESCING:
+        nvme->coalescing = cdw11 & 0xFFFF;
+        nvme->savedCoalescing = save ? nvme->coalescing : nvme->savedCoalescing;
+        return TRUE;
+    case IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG:
+        // The admin vector is never coalesced, so it has nothing to disable.
+        if (vector == 0 || vector >= nvme->vectors) {
+            return FALSE;
+        }
+        nvme->disable[vector] = static_cast<UCHAR>((cdw11 >> 16) & 1);
+        nvme->savedDisable[vector] = save ? nvme->disable[vector] : nvme->savedDisable[vector];
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+// 100 us and 4 entries, with vector 2 already kept out of coalescing.
+MockNvme MakeMockNvme(uint32_t queues, uint32_t vectors, Counters* counters) {
+    MockNvme nvme;
+    nvme.queues = queues;
+    nvme.vectors = vectors;
+    nvme.coalescing = 0x0103;
+    nvme.savedCoalescing = nvme.coalescing;
+    nvme.disable[2] = 1;
+    nvme.savedDisable[2] = 1;
+    nvme.counters = counters;
+    return nvme;
+}
+
+bool CheckNvmeEncoding() {
+    struct Encoding {
+        ULONG timeUs;
+        ULONG threshold;
+        ULONG result;
+        ULONG cdw11;
+    };
+    const Encoding encodings[] = {
+        {0, 1, IMOD_RESULT_SUCCESS, 0x0000},
+        {100, 1, IMOD_RESULT_SUCCESS, 0x0100},
+        {149, 8, IMOD_RESULT_SUCCESS, 0x0107},
+        {150, 8, IMOD_RESULT_SUCCESS, 0x0207},
+        {IMOD_NVME_MAX_TIME_US, IMOD_NVME_MAX_THRESHOLD, IMOD_RESULT_SUCCESS, 0xFFFF},
+        {IMOD_NVME_MAX_TIME_US + 49, 1, IMOD_RESULT_SUCCESS, 0xFF00},
+        {IMOD_NVME_MAX_TIME_US + 50, 1, IMOD_RESULT_INVALID_PARAMETER, 0},
+        {100, 0, IMOD_RESULT_INVALID_PARAMETER, 0},
+        {100, IMOD_NVME_MAX_THRESHOLD + 1, IMOD_RESULT_INVALID_PARAMETER, 0},
+    };
+    for (const Encoding& encoding : encodings) {
+        ULONG cdw11 = 0;
+        if (ImodNvmeEncodeCoalescing(encoding.timeUs, encoding.threshold, &cdw11) != encoding.result ||
+            (encoding.result == IMOD_RESULT_SUCCESS && cdw11 != encoding.cdw11)) {
+            return false;
+        }
+    }
+
+    for (ULONG value = 0; value <= 0xFFFF; ++value) {
+        ULONG timeUs = 0;
+        ULONG threshold = 0;
+        ULONG cdw11 = 0;
+        ImodNvmeDecodeCoalescing(value | 0xABCD0000UL, &timeUs, &threshold);
+        if (ImodNvmeEncodeCoalescing(timeUs, threshold, &cdw11) != IMOD_RESULT_SUCCESS || cdw11 != value) {
+            return false;
+        }
+    }
+
+    const ULONG queueVectors[][3] = {{0, 9, 0}, {1, 1, 0}, {4, 1, 0}, {1, 9, 1}, {8, 9, 8}, {9, 9, 1}, {5, 3, 1}, {6, 3, 2}};
+    for (const auto& queue : queueVectors) {
+        if (ImodNvmeQueueVector(queue[0], queue[1]) != queue[2]) {
+            return false;
+        }
+    }
+    return ImodNvmeGetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_COALESCING, IMOD_NVME_SELECT_SAVED) == 0x208 &&
+        ImodNvmeSetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_VECTOR_CONFIG) == 0x09 &&
+        ImodNvmeSetFeatureCdw10(IMOD_NVME_FEATURE_INTERRUPT_COALESCING) == 0x08 &&
+        ImodNvmeEncodeVectorConfig(5, TRUE) == 0x10005 && ImodNvmeEncodeVectorConfig(64, FALSE) == 64;
+}
+
+// Eight queues on a controller that answers for five vectors: the rest read as not reported.
+bool ReadMockNvme(Counters* counters) {
+    MockNvme nvme = MakeMockNvme(8, 5, counters);
+    const IMOD_NVME_TRANSPORT transport{&nvme, MockNvmeGetFeature, MockNvmeSetFeature};
+    IMOD_NVME_STATE current{};
+    IMOD_NVME_STATE defaults{};
+    if (ImodNvmeRead(&transport, IMOD_NVME_SELECT_CURRENT, &current) != IMOD_RESULT_SUCCESS ||
+        ImodNvmeRead(&transport, IMOD_NVME_SELECT_DEFAULT, &defaults) != IMOD_RESULT_SUCCESS ||
+        ImodNvmeRead(&transport, 3, &defaults) != IMOD_RESULT_INVALID_PARAMETER) {
+        return false;
+    }
+    for (ULONG vector = 0; vector < current.Settings.Vectors; ++vector) {
+        if (current.VectorRead[vector] != (vector >= 1 && vector < 5 ? 1 : 0) ||
+            current.Settings.CoalescingDisable[vector] != (vector == 2 ? 1 : 0) ||
+            defaults.Settings.CoalescingDisable[vector] != 0) {
+            return false;
+        }
+    }
+    return counters->writes == 0 && current.SubmissionQueues == 8 && current.CompletionQueues == 8 &&
+        current.Settings.Vectors == 9 && current.Coalescing == 0x0103 && current.Settings.TimeUs == 100 &&
+        current.Settings.Threshold == 4 && defaults.Settings.TimeUs == 0 && defaults.Settings.Threshold == 1;
+}
+
+// rates are completions per second on I/O vectors 1, 2, ...; disabled lists the vectors the
+// plan must keep out of coalescing.
+struct NvmePlanCase {
+    const char* name;
+    std::vector<ULONG> rates;
+    std::vector<ULONG> critical;
+    ULONG budgetUs;
+    ULONG maxInterrupts;
+    ULONG result;
+    ULONG timeUs;
+    ULONG threshold;
+    bool underLimit;
+    std::vector<ULONG> disabled;
+};
+
+const std::vector<NvmePlanCase> kNvmePlanCases = {
+    // Desktop load: nothing above the limit, coalescing stays off.
+    {"nvme_plan_idle", {20000, 12000, 3000, 0}, {}, 100, 50000, IMOD_RESULT_SUCCESS, 0, 1, true, {}},
+    // QD32 random reads on four queues: four entries per interrupt already fit, 8 us added.
+    {"nvme_plan_qd32", {400000, 400000, 400000, 400000}, {}, 100, 100000, IMOD_RESULT_SUCCESS, 100, 4, true, {}},
+    // A game's loader queue stays uncoalesced next to two bulk copy queues and an idle one.
+    {"nvme_plan_mixed", {300000, 300000, 5000, 600000}, {2}, 200, 50000, IMOD_RESULT_SUCCESS, 100, 12, true, {2, 3}},
+    // 2M completions a second under a 50 us budget: the limit is out of reach, so the fewest
+    // interrupts the budget allows.
+    {"nvme_plan_tight_budget", {2000000}, {}, 50, 10000, IMOD_RESULT_SUCCESS, 100, 101, false, {}},
+    {"nvme_plan_no_limit", {2000000}, {}, 50, 0, IMOD_RESULT_INVALID_PARAMETER, 0, 0, false, {}},
+};
+
+bool PlanNvme(const NvmePlanCase& entry) {
+    IMOD_NVME_PLAN_INPUT input{};
+    IMOD_NVME_PLAN plan{};
+    input.Vectors = static_cast<ULONG>(entry.rates.size() + 1);
+    input.LatencyBudgetUs = entry.budgetUs;
+    input.MaxInterruptsPerSecond = entry.maxInterrupts;
+    std::copy(entry.rates.begin(), entry.rates.end(), input.CompletionsPerSecond + 1);
+    for (const ULONG vector : entry.critical) {
+        input.LatencyCritical[vector] = 1;
+    }
+    const ULONG status = ImodNvmePlan(&input, &plan);
+    if (status != entry.result) {
+        return false;
+    }
+    if (status != IMOD_RESULT_SUCCESS) {
+        return true;
+    }
+
+    ULONGLONG total = 0;
+    for (ULONG vector = 1; vector < input.Vectors; ++vector) {
+        const bool disabled = std::find(entry.disabled.begin(), entry.disabled.end(), vector) != entry.disabled.end();
+        if (plan.Settings.CoalescingDisable[vector] != (disabled ? 1 : 0) ||
+            (plan.Reason[vector] == IMOD_NVME_VECTOR_COALESCED && plan.AddedLatencyUs[vector] > entry.budgetUs) ||
+            (disabled && plan.InterruptsPerSecond[vector] != input.CompletionsPerSecond[vector])) {
+            return false;
+        }
+        total += plan.InterruptsPerSecond[vector];
+    }
+    return plan.Settings.Vectors == input.Vectors && plan.Settings.TimeUs == entry.timeUs &&
+        plan.Settings.Threshold == entry.threshold && (plan.UnderLimit != FALSE) == entry.underLimit &&
+        plan.TotalInterruptsPerSecond == total;
+}
+
+// Every apply starts from MakeMockNvme. restored is whether the controller must end up as it
+// started, after a rollback; otherwise it must hold the target. Saved values never move, since
+// the apply does not send SV.
+struct NvmeApplyCase {
+    const char* name;
+    uint32_t vectors;
+    ULONG flags;
+    ULONG timeUs;
+    ULONG threshold;
+    ULONG targetVectors;
+    std::vector<ULONG> disabled;
+    uint32_t failSet;
+    uint32_t ignoreSet;
+    bool sticky;
+    ULONG result;
+    ULONG applied;
+    ULONG rolledBack;
+    ULONG rollbackFailed;
+    bool restored;
+};
+
+constexpr ULONG kNvmeDiffVerify = IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY;
+
+const std::vector<NvmeApplyCase> kNvmeApplyCases = {
+    // Only vector 1 and the coalescing differ from what the controller holds.
+    {"nvme_apply", 9, kNvmeDiffVerify, 200, 32, 9, {1, 2}, 0, 0, false, IMOD_RESULT_SUCCESS, 2, 0, 0, false},
+    // Without DIFF every vector is written.
+    {"nvme_apply_full", 9, IMOD_BATCH_FLAG_VERIFY, 200, 32, 9, {1, 2}, 0, 0, false, IMOD_RESULT_SUCCESS, 9, 0, 0, false},
+    // The third write fails: the two vectors before it go back, newest first.
+    {"nvme_rollback", 9, IMOD_BATCH_FLAG_VERIFY, 200, 32, 9, {1, 4}, 3, 0, false, IMOD_RESULT_ACCESS_FAILED, 2, 2, 0, true},
+    // The coalescing write is acknowledged but not taken; only the readback catches it.
+    {"nvme_verify_rollback", 9, kNvmeDiffVerify, 200, 32, 9, {1, 2}, 0, 2, false, IMOD_RESULT_ACCESS_FAILED, 1, 2, 0, true},
+    // A controller that stops taking commands keeps the vector it already took.
+    {"nvme_rollback_failed", 9, kNvmeDiffVerify, 200, 32, 9, {1, 2, 3}, 2, 0, true, IMOD_RESULT_ACCESS_FAILED, 1, 0, 1,
+        false},
+    // Vectors the controller does not report cannot be restored, so nothing is written.
+    {"nvme_vector_range", 5, kNvmeDiffVerify, 200, 32, 9, {1}, 0, 0, false, IMOD_RESULT_INVALID_PARAMETER, 0, 0, 0, true},
+    {"nvme_invalid_threshold", 9, kNvmeDiffVerify, 200, 0, 9, {}, 0, 0, false, IMOD_RESULT_INVALID_PARAMETER, 0, 0, 0,
+        true},
+};
+
+bool ApplyNvme(const NvmeApplyCase& entry, Counters* counters) {
+    MockNvme nvme = MakeMockNvme(8, entry.vectors, counters);
+    nvme.failSet = entry.failSet;
+    nvme.ignoreSet = entry.ignoreSet;
+    nvme.sticky = entry.sticky;
+    const MockNvme before = nvme;
+    const IMOD_NVME_TRANSPORT transport{&nvme, MockNvmeGetFeature, MockNvmeSetFeature};
+    IMOD_NVME_APPLY apply{};
+    apply.Flags = entry.flags;
+    apply.Target.TimeUs = entry.timeUs;
+    apply.Target.Threshold = entry.threshold;
+    apply.Target.Vectors = entry.targetVectors;
+    for (const ULONG vector : entry.disabled) {
+        apply.Target.CoalescingDisable[vector] = 1;
+    }
+
+    const ULONG status = ImodNvmeApply(&transport, &apply);
+    if (status != entry.result || apply.Applied != entry.applied || apply.RolledBack != entry.rolledBack ||
+        apply.RollbackFailed != entry.rollbackFailed) {
+        return false;
+    }
+    if (status == IMOD_RESULT_INVALID_PARAMETER) {
+        return counters->writes == 0;
+    }
+    if (apply.Previous.TimeUs != 100 || apply.Previous.Threshold != 4 || apply.Previous.CoalescingDisable[2] != 1) {
+        return false;
+    }
+
+    ULONG target = 0;
+    ImodNvmeEncodeCoalescing(entry.timeUs, entry.threshold, &target);
+    if (entry.restored) {
+        return nvme.coalescing == before.coalescing && nvme.disable == before.disable;
+    }
+    if (status != IMOD_RESULT_SUCCESS) {
+        return nvme.disable != before.disable;
+    }
+    return nvme.coalescing == target && nvme.disable == std::vector<UCHAR>(apply.Target.CoalescingDisable,
+                                                             apply.Target.CoalescingDisable + IMOD_NVME_MAX_VECTORS) &&
+        nvme.savedCoalescing == before.savedCoalescing && nvme.savedDisable == before.savedDisable;
+}
+
+// nvme_* check the NVMe interrupt coalescing encoders, planner and all-or-nothing apply against
+// a mock controller reached through the same Get/Set Features transport IMOD.exe gives the
+// storage pass-through. interrupters is the vector count; reads and writes are Get and Set
+// Features commands, one round trip each.
+std::vector<Result> RunNvmeCases(const Options& options) {
+    std::vector<Result> results;
+    auto timed = [&](Result& result, const std::function<bool(Counters*)>& body) {
+        uint64_t totalNs = 0;
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration) {
+            Counters counters;
+            const auto start = std::chrono::steady_clock::now();
+            result.ok = body(&counters) && result.ok;
+            totalNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            result.counters = counters;
+        }
+        result.wallNs = totalNs / std::max<uint32_t>(options.iterations, 1);
+    };
+
+    Result& encode = results.emplace_back(Result{"nvme_encode", 0, 0});
+    timed(encode, [](Counters*) { return CheckNvmeEncoding(); });
+    Result& read = results.emplace_back(Result{"nvme_read", 9, 0});
+    timed(read, ReadMockNvme);
+    for (const NvmePlanCase& entry : kNvmePlanCases) {
+        Result& result = results.emplace_back(Result{entry.name, static_cast<uint32_t>(entry.rates.size() + 1), 0});
+        timed(result, [&entry](Counters*) { return PlanNvme(entry); });
+    }
+    for (const NvmeApplyCase& entry : kNvmeApplyCases) {
+        Result& result = results.emplace_back(Result{entry.name, entry.targetVectors, 0});
+        timed(result, [&entry](Counters* counters) { return ApplyNvme(entry, counters); });
+    }
+    return results;
+}
+
+void WriteCsv(std::ostream& out, const std::vector<Result>& results) {
+    out << "case,interrupters,slots,ok,round_trips,maps,reads,writes,accesses,simulated_ns,wall_ns\n";
+    for (const auto& result : results) {
+        const Counters& c = result.counters;
+        out << result.name << ',' << result.interrupters << ',' << result.slots << ',' << (result.ok ? 1 : 0) << ','
+            << c.roundTrips << ',' << c.maps << ',' << c.reads << ',' << c.writes << ',' << (c.reads + c.writes) << ','
+            << c.simulatedNs << ',' << result.wallNs << '\n';
+    }
+}
+
+void WriteJson(std::ostream& out, const std::vector<Result>& results, const Options& options) {
+    out << "{\n  \"iterations\": " << options.iterations
+        << ",\n  \"read_latency_ns\": " << options.readLatencyNs
+        << ",\n  \"write_latency_ns\": " << options.writeLatencyNs
+        << ",\n  \"map_latency_ns\": " << options.mapLatencyNs
+        << ",\n  \"stall\": " << (options.stall ? "true" : "false")
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        const Counters& c = result.counters;
+        out << "    {\"case\": \"" << result.name << "\", \"interrupters\": " << result.interrupters
+            << ", \"slots\": " << result.slots << ", \"ok\": " << (result.ok ? "true" : "false")
+            << ", \"round_trips\": " << c.roundTrips << ", \"maps\": " << c.maps << ", \"reads\": " << c.reads
+            << ", \"writes\": " << c.writes << ", \"accesses\": " << (c.reads + c.writes)
+            << ", \"simulated_ns\": " << c.simulatedNs << ", \"wall_ns\": " << result.wallNs << '}'
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+using CaseKey = std::tuple<std::string, uint32_t, uint32_t>;
+
+// Reads round_trips, maps and accesses back from an earlier CSV run.
+bool LoadBaseline(const std::string& path, std::map<CaseKey, Counters>* baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 8) {
+            continue;
+        }
+
+        uint32_t values[6] = {};
+        const size_t columns[6] = {1, 2, 4, 5, 6, 7};
+        bool parsed = true;
+        for (size_t i = 0; i < 6 && parsed; ++i) {
+            parsed = TryParseUint32(fields[columns[i]].c_str(), &values[i]);
+        }
+        if (!parsed) {
+            continue;
+        }
+
+        Counters counters;
+        counters.roundTrips = values[2];
+        counters.maps = values[3];
+        counters.reads = values[4];
+        counters.writes = values[5];
+        (*baseline)[CaseKey{fields[0], values[0], values[1]}] = counters;
+    }
+    return true;
+}
+
+// Any case that got more expensive in round trips, maps or accesses is a regression; wall
+// time is too noisy to gate on.
+int CheckBaseline(const std::vector<Result>& results, const std::map<CaseKey, Counters>& baseline) {
+    int regressions = 0;
+    for (const auto& result : results) {
+        const auto found = baseline.find(CaseKey{result.name, result.interrupters, result.slots});
+        if (found == baseline.end()) {
+            continue;
+        }
+
+        const Counters& before = found->second;
+        const Counters& after = result.counters;
+        if (!result.ok || after.roundTrips > before.roundTrips || after.maps > before.maps ||
+            after.reads + after.writes > before.reads + before.writes) {
+            std::cerr << "regression: " << result.name << " interrupters = " << result.interrupters
+                      << ", slots = " << result.slots << ", round_trips = " << before.roundTrips << " -> "
+                      << after.roundTrips << ", maps = " << before.maps << " -> " << after.maps
+                      << ", accesses = " << (before.reads + before.writes) << " -> " << (after.reads + after.writes)
+                      << (result.ok ? "" : ", failed") << std::endl;
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+void PrintUsage() {
+    std::cerr << "usage: IMODBench [--quick] [--iterations <n>] [--latency-ns <read> <write>] [--map-latency-ns <n>]\n"
+                 "                 [--stall] [--format csv|json] [--output <file>] [--baseline <csv>]\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--stall") {
+            options.stall = true;
+        } else if (arg == "--iterations" && i + 1 < argc && TryParseUint32(argv[i + 1], &options.iterations) &&
+                   options.iterations != 0) {
+            ++i;
+        } else if (arg == "--latency-ns" && i + 2 < argc && TryParseUint32(argv[i + 1], &options.readLatencyNs) &&
+                   TryParseUint32(argv[i + 2], &options.writeLatencyNs)) {
+            i += 2;
+        } else if (arg == "--map-latency-ns" && i + 1 < argc && TryParseUint32(argv[i + 1], &options.mapLatencyNs)) {
+            ++i;
+        } else if (arg == "--format" && i + 1 < argc &&
+                   (std::strcmp(argv[i + 1], "csv") == 0 || std::strcmp(argv[i + 1], "json") == 0)) {
+            options.json = std::strcmp(argv[i + 1], "json") == 0;
+            ++i;
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baselinePath = argv[++i];
+        } else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    std::map<CaseKey, Counters> baseline;
+    if (!options.baselinePath.empty() && !LoadBaseline(options.baselinePath, &baseline)) {
+        std::cerr << "error: cannot read baseline " << options.baselinePath << std::endl;
+        return 2;
+    }
+
+    const auto& interrupterSweep = options.quick ? kQuickInterrupterSweep : kInterrupterSweep;
+    const auto& slotSweep = options.quick ? kQuickSlotSweep : kSlotSweep;
+
+    std::vector<Result> results;
+    for (const auto& entry : kCases) {
+        for (uint32_t interrupters : interrupterSweep) {
+            for (uint32_t slots : slotSweep) {
+                results.push_back(RunCase(entry, interrupters, slots, options));
+            }
+        }
+    }
+    for (const auto& engineCase : kEngineCases) {
+        for (uint32_t interrupters : interrupterSweep) {
+            for (uint32_t slots : slotSweep) {
+                results.push_back(RunEngineCase(engineCase, interrupters, slots, options));
+            }
+        }
+    }
+    for (uint32_t interrupters : interrupterSweep) {
+        const std::vector<Result> watchResults = RunWatchCases(interrupters, options);
+        results.insert(results.end(), watchResults.begin(), watchResults.end());
+    }
+    const std::vector<Result> budgetResults = RunBudgetCases(options);
+    results.insert(results.end(), budgetResults.begin(), budgetResults.end());
+    const std::vector<Result> affinityResults = RunAffinityCases(options);
+    results.insert(results.end(), affinityResults.begin(), affinityResults.end());
+    const std::vector<Result> cpuSetResults = RunCpuSetCases(options);
+    results.insert(results.end(), cpuSetResults.begin(), cpuSetResults.end());
+    const std::vector<Result> routeResults = RunTopologyRouteCases(options);
+    results.insert(results.end(), routeResults.begin(), routeResults.end());
+    const std::vector<Result> msixResults = RunMsixCases(options);
+    results.insert(results.end(), msixResults.begin(), msixResults.end());
+    const std::vector<Result> nicResults = RunNicCases(options);
+    results.insert(results.end(), nicResults.begin(), nicResults.end());
+    const std::vector<Result> nicItrResults = RunNicItrCases(options);
+    results.insert(results.end(), nicItrResults.begin(), nicItrResults.end());
+    const std::vector<Result> watchdogResults = RunWatchdogCases(options);
+    results.insert(results.end(), watchdogResults.begin(), watchdogResults.end());
+    const std::vector<Result> bootResults = RunBootCases(options);
+    results.insert(results.end(), bootResults.begin(), bootResults.end());
+    const std::vector<Result> samplerResults = RunSamplerCases(options);
+    results.insert(results.end(), samplerResults.begin(), samplerResults.end());
+    const std::vector<Result> governorResults = RunGovernorCases(options);
+    results.insert(results.end(), governorResults.begin(), governorResults.end());
+    const std::vector<Result> latencyResults = RunLatencyCases(options);
+    results.insert(results.end(), latencyResults.begin(), latencyResults.end());
+    const std::vector<Result> rssResults = RunRssCases(options);
+    results.insert(results.end(), rssResults.begin(), rssResults.end());
+    const std::vector<Result> nvmeResults = RunNvmeCases(options);
+    results.insert(results.end(), nvmeResults.begin(), nvmeResults.end());
+
+    std::ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath, std::ios::out | std::ios::trunc);
+        if (!file) {
+            std::cerr << "error: cannot write " << options.outputPath << std::endl;
+            return 2;
+        }
+    }
+    std::ostream& out = options.outputPath.empty() ? std::cout : file;
+    if (options.json) {
+        WriteJson(out, results, options);
+    } else {
+        WriteCsv(out, results);
+    }
+
+    const bool failed = std::any_of(results.begin(), results.end(), [](const Result& r) { return !r.ok; });
+    if (failed) {
+        std::cerr << "error: one or more cases failed against the simulator" << std::endl;
+    }
+    if (!baseline.empty() && CheckBaseline(results, baseline) != 0) {
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
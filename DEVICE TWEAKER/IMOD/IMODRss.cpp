@@ -0,0 +1,490 @@
+﻿#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Common/imod_rss.h"
+
+// Offline RSS planner: hashes a captured list of flows with the adapter's Toeplitz key the way
+// the NIC does, then spreads them over candidate base processor / queue count / indirection
+// table combinations and ranks them by how much more than its share the busiest processor
+// gets. The flows are hashed once; every candidate only folds the 128 hash buckets, so the
+// candidate sweep costs the same for a thousand flows as for ten million.
+
+namespace {
+
+// The key from the NDIS RSS verification examples, which is also what most miniports ship.
+const uint8_t kDefaultKey[IMOD_RSS_KEY_SIZE] = {
+    0x6D, 0x5A, 0x56, 0xDA, 0x25, 0x5B, 0x0E, 0xC2, 0x41, 0x67, 0x25, 0x3D, 0x43, 0xA3,
+    0x8F, 0xB0, 0xD0, 0xCA, 0x2B, 0xCB, 0xAE, 0x7B, 0x30, 0xB4, 0x77, 0xCB, 0x2D, 0xA3,
+    0x80, 0x30, 0xF2, 0x0C, 0x6A, 0x42, 0xB7, 0x3B, 0xBE, 0xAC, 0x01, 0xFA};
+
+struct Options {
+    std::string flowsPath;
+    uint32_t synthetic = 0;
+    uint32_t seed = 1;
+    std::vector<uint8_t> key{std::begin(kDefaultKey), std::end(kDefaultKey)};
+    uint32_t processors = 8;
+    std::vector<uint32_t> queues;
+    std::vector<uint32_t> bases;
+    std::vector<uint32_t> strides{1};
+    std::vector<uint32_t> tables{IMOD_RSS_MAX_TABLE};
+    std::vector<uint32_t> indirection;
+    bool balanced = false;
+    uint32_t top = 0;
+    bool json = false;
+};
+
+struct Row {
+    IMOD_RSS_CANDIDATE candidate{};
+    IMOD_RSS_SPREAD spread{};
+};
+
+bool TryParseUint32(const std::string& text, uint32_t* value) {
+    char* end = nullptr;
+    const unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+    if (text.empty() || *end != '\0' || parsed > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    *value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+std::vector<std::string> Split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+std::string Trim(const std::string& text) {
+    const size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool TryParseList(const std::string& text, uint32_t limit, std::vector<uint32_t>* values) {
+    values->clear();
+    for (const std::string& part : Split(text, ',')) {
+        uint32_t value = 0;
+        if (!TryParseUint32(Trim(part), &value) || value > limit) {
+            return false;
+        }
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+// "6d5a56da..." or "6D:5A:56:DA ..."; separators are ignored.
+bool TryParseKey(const std::string& text, std::vector<uint8_t>* key) {
+    std::string digits;
+    for (const char c : text) {
+        if (std::isxdigit(static_cast<unsigned char>(c))) {
+            digits.push_back(c);
+        } else if (c != ':' && c != '-' && c != ' ' && c != ',') {
+            return false;
+        }
+    }
+    if (digits.size() % 2 != 0 || digits.size() / 2 < IMOD_RSS_KEY_SIZE) {
+        return false;
+    }
+    key->clear();
+    for (size_t i = 0; i < digits.size(); i += 2) {
+        key->push_back(static_cast<uint8_t>(std::strtoul(digits.substr(i, 2).c_str(), nullptr, 16)));
+    }
+    return true;
+}
+
+bool TryParseIpv4(const std::string& text, uint8_t* address) {
+    const std::vector<std::string> parts = Split(text, '.');
+    if (parts.size() != 4) {
+        return false;
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        uint32_t value = 0;
+        if (parts[i].empty() || parts[i].size() > 3 ||
+            !std::all_of(parts[i].begin(), parts[i].end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }) ||
+            !TryParseUint32(parts[i], &value) || value > 255) {
+            return false;
+        }
+        address[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+bool TryParseIpv6Groups(const std::string& text, std::vector<uint16_t>* groups) {
+    groups->clear();
+    if (text.empty()) {
+        return true;
+    }
+    for (const std::string& part : Split(text, ':')) {
+        if (part.empty() || part.size() > 4 ||
+            !std::all_of(part.begin(), part.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); })) {
+            return false;
+        }
+        groups->push_back(static_cast<uint16_t>(std::strtoul(part.c_str(), nullptr, 16)));
+    }
+    return text.back() != ':';
+}
+
+// Eight hex groups, with one "::" standing in for a run of zero groups.
+bool TryParseIpv6(const std::string& text, uint8_t* address) {
+    std::vector<uint16_t> head;
+    std::vector<uint16_t> tail;
+    const size_t gap = text.find("::");
+    if (gap == std::string::npos) {
+        if (!TryParseIpv6Groups(text, &head) || head.size() != 8) {
+            return false;
+        }
+    } else if (text.find("::", gap + 1) != std::string::npos || !TryParseIpv6Groups(text.substr(0, gap), &head) ||
+               !TryParseIpv6Groups(text.substr(gap + 2), &tail) || head.size() + tail.size() > 7) {
+        return false;
+    }
+
+    std::vector<uint16_t> groups = head;
+    groups.resize(8 - tail.size(), 0);
+    groups.insert(groups.end(), tail.begin(), tail.end());
+    for (size_t i = 0; i < 8; ++i) {
+        address[i * 2] = static_cast<uint8_t>(groups[i] >> 8);
+        address[(i * 2) + 1] = static_cast<uint8_t>(groups[i]);
+    }
+    return true;
+}
+
+bool TryParseAddress(const std::string& text, UCHAR* family, uint8_t* address) {
+    if (TryParseIpv4(text, address)) {
+        *family = IMOD_RSS_FAMILY_IPV4;
+        return true;
+    }
+    if (TryParseIpv6(text, address)) {
+        *family = IMOD_RSS_FAMILY_IPV6;
+        return true;
+    }
+    return false;
+}
+
+// source,destination[,source_port,destination_port[,weight]]; without ports the flow hashes
+// on the addresses alone, as NDIS does for non-TCP traffic.
+bool TryParseFlow(const std::string& line, IMOD_RSS_FLOW* flow) {
+    std::vector<std::string> parts = Split(line, ',');
+    for (std::string& part : parts) {
+        part = Trim(part);
+    }
+    if (parts.size() < 2 || parts.size() > 5 || parts.size() == 3) {
+        return false;
+    }
+
+    *flow = {};
+    UCHAR destinationFamily = 0;
+    if (!TryParseAddress(parts[0], &flow->Family, flow->Source) ||
+        !TryParseAddress(parts[1], &destinationFamily, flow->Destination) || destinationFamily != flow->Family) {
+        return false;
+    }
+    if (parts.size() >= 4 && !(parts[2].empty() && parts[3].empty())) {
+        uint32_t sourcePort = 0;
+        uint32_t destinationPort = 0;
+        if (!TryParseUint32(parts[2], &sourcePort) || !TryParseUint32(parts[3], &destinationPort) ||
+            sourcePort > 0xFFFF || destinationPort > 0xFFFF) {
+            return false;
+        }
+        flow->HasPorts = 1;
+        flow->SourcePort = static_cast<USHORT>(sourcePort);
+        flow->DestinationPort = static_cast<USHORT>(destinationPort);
+    }
+    return parts.size() < 5 || TryParseUint32(parts[4], &flow->Weight);
+}
+
+bool LoadFlows(const std::string& path, std::vector<IMOD_RSS_FLOW>* flows) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "error: cannot read " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        line = Trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        IMOD_RSS_FLOW flow{};
+        if (!TryParseFlow(line, &flow)) {
+            // A header line naming the columns.
+            if (lineNumber == 1) {
+                continue;
+            }
+            std::cerr << "error: bad flow at " << path << ':' << lineNumber << std::endl;
+            return false;
+        }
+        flows->push_back(flow);
+    }
+    return true;
+}
+
+// TCP/IPv4 clients on ephemeral ports talking to a handful of servers, as a stand-in capture.
+void MakeSyntheticFlows(uint32_t count, uint32_t seed, std::vector<IMOD_RSS_FLOW>* flows) {
+    std::mt19937 random(seed);
+    flows->resize(count);
+    for (IMOD_RSS_FLOW& flow : *flows) {
+        const uint32_t source = random();
+        const uint32_t server = random() % 16;
+        flow = {};
+        flow.Family = IMOD_RSS_FAMILY_IPV4;
+        flow.HasPorts = 1;
+        flow.Source[0] = 10;
+        flow.Source[1] = static_cast<uint8_t>(source >> 16);
+        flow.Source[2] = static_cast<uint8_t>(source >> 8);
+        flow.Source[3] = static_cast<uint8_t>(source);
+        flow.Destination[0] = 192;
+        flow.Destination[1] = 168;
+        flow.Destination[2] = 1;
+        flow.Destination[3] = static_cast<uint8_t>(10 + server);
+        flow.SourcePort = static_cast<USHORT>(49152 + (random() % 16384));
+        flow.DestinationPort = server < 8 ? 443 : 27015;
+        flow.Weight = 1 + (random() % 64);
+    }
+}
+
+const char* FillName(ULONG kind) {
+    switch (kind) {
+    case IMOD_RSS_TABLE_ROUND_ROBIN: return "round_robin";
+    case IMOD_RSS_TABLE_EXPLICIT: return "explicit";
+    case IMOD_RSS_TABLE_BALANCED: return "balanced";
+    default: return "unknown";
+    }
+}
+
+// "2:498;3:502": each of the candidate's processors and its share of the traffic in permille.
+std::string FormatLoads(const Row& row, const IMOD_RSS_BUCKETS& buckets) {
+    std::ostringstream out;
+    bool first = true;
+    for (uint32_t processor = 0; processor < IMOD_RSS_MAX_PROCESSORS; ++processor) {
+        const bool queue = row.candidate.Queues != 0 && processor >= row.candidate.BaseProcessor &&
+            (processor - row.candidate.BaseProcessor) % row.candidate.Stride == 0 &&
+            (processor - row.candidate.BaseProcessor) / row.candidate.Stride < row.candidate.Queues;
+        const bool indexed = std::find(row.candidate.Indirection, row.candidate.Indirection + row.candidate.TableSize,
+                                 static_cast<UCHAR>(processor)) != row.candidate.Indirection + row.candidate.TableSize;
+        if (!queue && !indexed) {
+            continue;
+        }
+        out << (first ? "" : ";") << processor << ':'
+            << (buckets.TotalWeight != 0 ? (row.spread.Load[processor] * 1000) / buckets.TotalWeight : 0);
+        first = false;
+    }
+    return out.str();
+}
+
+void WriteCsv(std::ostream& out, const std::vector<Row>& rows, const IMOD_RSS_BUCKETS& buckets) {
+    out << "rank,base,queues,stride,table,fill,imbalance_permille,hot_processor,hot_share_permille,idle,load_permille\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row& row = rows[i];
+        out << (i + 1) << ',' << row.candidate.BaseProcessor << ',' << row.candidate.Queues << ','
+            << row.candidate.Stride << ',' << row.candidate.TableSize << ',' << FillName(row.candidate.TableKind) << ','
+            << row.spread.ImbalancePermille << ',' << row.spread.HotProcessor << ',' << row.spread.HotSharePermille << ','
+            << row.spread.IdleProcessors << ',' << FormatLoads(row, buckets) << '\n';
+    }
+}
+
+void WriteJson(std::ostream& out, const std::vector<Row>& rows, const IMOD_RSS_BUCKETS& buckets) {
+    out << "{\n  \"flows\": " << buckets.TotalFlows << ",\n  \"weight\": " << buckets.TotalWeight
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row& row = rows[i];
+        out << "    {\"rank\": " << (i + 1) << ", \"base\": " << row.candidate.BaseProcessor
+            << ", \"queues\": " << row.candidate.Queues << ", \"stride\": " << row.candidate.Stride
+            << ", \"table\": " << row.candidate.TableSize << ", \"fill\": \"" << FillName(row.candidate.TableKind)
+            << "\", \"imbalance_permille\": " << row.spread.ImbalancePermille
+            << ", \"hot_processor\": " << row.spread.HotProcessor
+            << ", \"hot_share_permille\": " << row.spread.HotSharePermille << ", \"idle\": " << row.spread.IdleProcessors
+            << ", \"load_permille\": \"" << FormatLoads(row, buckets) << "\", \"indirection\": [";
+        for (uint32_t entry = 0; entry < row.candidate.TableSize; ++entry) {
+            out << (entry == 0 ? "" : ", ") << static_cast<uint32_t>(row.candidate.Indirection[entry]);
+        }
+        out << "]}" << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void PrintUsage() {
+    std::cerr << "usage: IMODRss (--flows <file> | --synthetic <n> [--seed <n>]) [--key <hex>]\n"
+                 "               [--processors <n>] [--queues <n[,n...]>] [--bases <n[,n...]>] [--stride <n[,n...]>]\n"
+                 "               [--table <n[,n...]>] [--indirection <cpu[,cpu...]>] [--balanced]\n"
+                 "               [--top <n>] [--format csv|json]\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--flows" && hasValue) {
+            options.flowsPath = argv[++i];
+        } else if (arg == "--synthetic" && hasValue && TryParseUint32(argv[i + 1], &options.synthetic) &&
+                   options.synthetic != 0) {
+            ++i;
+        } else if (arg == "--seed" && hasValue && TryParseUint32(argv[i + 1], &options.seed)) {
+            ++i;
+        } else if (arg == "--key" && hasValue && TryParseKey(argv[i + 1], &options.key)) {
+            ++i;
+        } else if (arg == "--processors" && hasValue && TryParseUint32(argv[i + 1], &options.processors) &&
+                   options.processors != 0 && options.processors <= IMOD_RSS_MAX_PROCESSORS) {
+            ++i;
+        } else if (arg == "--queues" && hasValue && TryParseList(argv[i + 1], IMOD_RSS_MAX_PROCESSORS, &options.queues)) {
+            ++i;
+        } else if (arg == "--bases" && hasValue &&
+                   TryParseList(argv[i + 1], IMOD_RSS_MAX_PROCESSORS - 1, &options.bases)) {
+            ++i;
+        } else if (arg == "--stride" && hasValue && TryParseList(argv[i + 1], IMOD_RSS_MAX_PROCESSORS, &options.strides)) {
+            ++i;
+        } else if (arg == "--table" && hasValue && TryParseList(argv[i + 1], IMOD_RSS_MAX_TABLE, &options.tables)) {
+            ++i;
+        } else if (arg == "--indirection" && hasValue &&
+                   TryParseList(argv[i + 1], IMOD_RSS_MAX_PROCESSORS - 1, &options.indirection) &&
+                   options.indirection.size() <= IMOD_RSS_MAX_TABLE) {
+            ++i;
+        } else if (arg == "--balanced") {
+            options.balanced = true;
+        } else if (arg == "--top" && hasValue && TryParseUint32(argv[i + 1], &options.top)) {
+            ++i;
+        } else if (arg == "--format" && hasValue &&
+                   (std::strcmp(argv[i + 1], "csv") == 0 || std::strcmp(argv[i + 1], "json") == 0)) {
+            options.json = std::strcmp(argv[++i], "json") == 0;
+        } else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (options.flowsPath.empty() == (options.synthetic == 0)) {
+        PrintUsage();
+        return 2;
+    }
+    // One queue has nothing to spread and would always rank first; ask for it with --queues 1.
+    if (options.queues.empty()) {
+        for (uint32_t queues = 2; queues <= options.processors; queues *= 2) {
+            options.queues.push_back(queues);
+        }
+    }
+
+    std::vector<IMOD_RSS_FLOW> flows;
+    if (options.synthetic != 0) {
+        MakeSyntheticFlows(options.synthetic, options.seed, &flows);
+    } else if (!LoadFlows(options.flowsPath, &flows)) {
+        return 1;
+    }
+
+    auto toeplitz = std::make_unique<IMOD_RSS_TOEPLITZ>();
+    if (ImodRssToeplitzPrepare(options.key.data(), static_cast<ULONG>(options.key.size()), toeplitz.get()) !=
+        IMOD_RESULT_SUCCESS) {
+        std::cerr << "error: the RSS key needs at least " << IMOD_RSS_KEY_SIZE << " bytes" << std::endl;
+        return 2;
+    }
+
+    const auto hashStart = std::chrono::steady_clock::now();
+    std::vector<ULONG> hashes(flows.size());
+    IMOD_RSS_BUCKETS buckets{};
+    ImodRssBucketsReset(&buckets);
+    constexpr size_t kChunk = 1 << 16;
+    for (size_t first = 0; first < flows.size(); first += kChunk) {
+        const ULONG count = static_cast<ULONG>(std::min(kChunk, flows.size() - first));
+        ImodRssHashFlows(toeplitz.get(), flows.data() + first, count, hashes.data() + first);
+        ImodRssBucketsAdd(&buckets, flows.data() + first, hashes.data() + first, count);
+    }
+    const auto hashElapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hashStart);
+
+    // Every queue count from every base that keeps its processors on the machine, for each stride
+    // and table size; the explicit table is one more candidate of its own.
+    const auto planStart = std::chrono::steady_clock::now();
+    std::vector<Row> rows;
+    auto evaluate = [&](IMOD_RSS_CANDIDATE candidate) {
+        Row row{candidate, {}};
+        if (ImodRssFillIndirection(&row.candidate, &buckets) == IMOD_RESULT_SUCCESS &&
+            ImodRssEvaluate(&buckets, &row.candidate, &row.spread) == IMOD_RESULT_SUCCESS) {
+            rows.push_back(row);
+        }
+    };
+    for (uint32_t table : options.tables) {
+        for (uint32_t stride : options.strides) {
+            for (uint32_t queues : options.queues) {
+                if (queues == 0 || stride == 0 || static_cast<uint64_t>(queues - 1) * stride >= options.processors) {
+                    continue;
+                }
+                const uint32_t lastBase = options.processors - 1 - ((queues - 1) * stride);
+                std::vector<uint32_t> bases = options.bases;
+                if (bases.empty()) {
+                    for (uint32_t base = 0; base <= lastBase; ++base) {
+                        bases.push_back(base);
+                    }
+                }
+                for (uint32_t base : bases) {
+                    if (base > lastBase) {
+                        continue;
+                    }
+                    evaluate({base, queues, stride, table, IMOD_RSS_TABLE_ROUND_ROBIN, {}});
+                    if (options.balanced && queues > 1) {
+                        evaluate({base, queues, stride, table, IMOD_RSS_TABLE_BALANCED, {}});
+                    }
+                }
+            }
+        }
+    }
+    if (!options.indirection.empty()) {
+        // The table repeats to the next power of two, as NDIS replicates a short table.
+        IMOD_RSS_CANDIDATE candidate{0, 0, 1, 1, IMOD_RSS_TABLE_EXPLICIT, {}};
+        while (candidate.TableSize < options.indirection.size()) {
+            candidate.TableSize *= 2;
+        }
+        for (uint32_t entry = 0; entry < candidate.TableSize; ++entry) {
+            candidate.Indirection[entry] = static_cast<UCHAR>(options.indirection[entry % options.indirection.size()]);
+        }
+        evaluate(candidate);
+    }
+
+    // The most even spread first; at the same spread the smaller busiest share (more queues),
+    // the table NDIS fills by itself and the lower base win.
+    std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return std::make_tuple(a.spread.ImbalancePermille, a.spread.HotSharePermille, a.candidate.TableKind,
+                   a.candidate.BaseProcessor) <
+            std::make_tuple(b.spread.ImbalancePermille, b.spread.HotSharePermille, b.candidate.TableKind,
+                b.candidate.BaseProcessor);
+    });
+    const auto planElapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - planStart);
+    const size_t ranked = rows.size();
+    if (options.top != 0 && rows.size() > options.top) {
+        rows.resize(options.top);
+    }
+
+    if (options.json) {
+        WriteJson(std::cout, rows, buckets);
+    } else {
+        WriteCsv(std::cout, rows, buckets);
+    }
+
+    const double hashSeconds = static_cast<double>(hashElapsed.count()) / 1e9;
+    std::cerr << flows.size() << " flows hashed in " << (hashElapsed.count() / 1e6) << " ms ("
+              << (hashSeconds > 0 ? static_cast<double>(flows.size()) / hashSeconds / 1e6 : 0.0) << " Mflows/s), "
+              << ranked << " candidates ranked in " << (planElapsed.count() / 1e6) << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,307 @@
+﻿#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Common/imod_latency.h"
+
+// Offline model of what IMOD intervals do to USB input: periodic endpoints polled on the
+// microframe schedule share interrupters, each interrupter moderated by its IMODI, and the
+// result is the latency moderation adds to each device's transfer events plus the interrupt
+// rate per interrupter. --sweep evaluates candidate intervals per interrupter (they do not
+// interact) and, with --max-rate, picks the smallest one that keeps each under the budget.
+
+namespace {
+
+struct Device {
+    std::string role;
+    IMOD_LATENCY_DEVICE model{};
+};
+
+struct Options {
+    std::vector<Device> devices;
+    std::vector<uint32_t> intervals;
+    std::vector<uint32_t> sweep;
+    uint32_t maxRate = 0;
+    IMOD_LATENCY_CONFIG config{IMOD_LATENCY_DEFAULT_TRIALS, IMOD_LATENCY_DEFAULT_WINDOW_US, 1};
+    bool json = false;
+};
+
+struct Row {
+    const char* scope = "";
+    uint32_t interrupter = 0;
+    uint32_t interval = 0;
+    int device = -1;
+    IMOD_LATENCY_INTERRUPTER_RESULT summary{};
+    const IMOD_LATENCY_DEVICE_RESULT* detail = nullptr;
+};
+
+bool TryParseUint32(const std::string& text, uint32_t* value) {
+    char* end = nullptr;
+    const unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+    if (text.empty() || *end != '\0' || parsed > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    *value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+std::vector<std::string> Split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+bool TryParseList(const std::string& text, std::vector<uint32_t>* values) {
+    values->clear();
+    for (const std::string& part : Split(text, ',')) {
+        uint32_t value = 0;
+        if (!TryParseUint32(part, &value) || value > IMOD_XHCI_IMODI_MASK) {
+            return false;
+        }
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+bool TryParseSpeed(std::string text, ULONG* speed) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (text == "low" || text == "ls") {
+        *speed = IMOD_LATENCY_SPEED_LOW;
+    } else if (text == "full" || text == "fs") {
+        *speed = IMOD_LATENCY_SPEED_FULL;
+    } else if (text == "high" || text == "hs") {
+        *speed = IMOD_LATENCY_SPEED_HIGH;
+    } else if (text == "super" || text == "ss") {
+        *speed = IMOD_LATENCY_SPEED_SUPER;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// How often a poll of the role's endpoint returns data while it is in use: input that is
+// being moved or streamed reports on every poll, a keyboard only on key changes.
+uint32_t DefaultDutyPermille(const std::string& role) {
+    for (const char* streaming : {"Mouse", "Gamepad", "Audio", "Webcam"}) {
+        if (role.size() == std::strlen(streaming) &&
+            std::equal(role.begin(), role.end(), streaming,
+                [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); })) {
+            return 1000;
+        }
+    }
+    return role == "Keyboard" || role == "keyboard" ? 100 : 500;
+}
+
+// role:speed:bInterval[:pollingHz[:interrupter[:dutyPermille]]]; an empty field keeps its default.
+bool TryParseDevice(const std::string& text, Device* device) {
+    const std::vector<std::string> parts = Split(text, ':');
+    if (parts.size() < 3 || parts.size() > 6 || parts[0].empty() || !TryParseSpeed(parts[1], &device->model.Speed) ||
+        !TryParseUint32(parts[2], &device->model.Interval)) {
+        return false;
+    }
+    device->role = parts[0];
+    device->model.DutyPermille = DefaultDutyPermille(device->role);
+    if (parts.size() > 3 && !parts[3].empty() && !TryParseUint32(parts[3], &device->model.PollingHz)) {
+        return false;
+    }
+    if (parts.size() > 4 && !parts[4].empty() && (!TryParseUint32(parts[4], &device->model.Interrupter) ||
+                                device->model.Interrupter >= IMOD_XHCI_MAX_INTERRUPTERS)) {
+        return false;
+    }
+    if (parts.size() > 5 && !parts[5].empty() && (!TryParseUint32(parts[5], &device->model.DutyPermille) || device->model.DutyPermille > 1000)) {
+        return false;
+    }
+    return ImodLatencyPeriod(&device->model) != 0;
+}
+
+void WriteCsv(std::ostream& out, const std::vector<Row>& rows, const Options& options) {
+    out << "scope,interrupter,imod,device,role,period_us,irq_per_s,events_per_s,p50_ns,p99_ns,max_ns\n";
+    for (const Row& row : rows) {
+        out << row.scope << ',' << row.interrupter << ",0x" << std::hex << std::uppercase << row.interval << std::dec
+            << std::nouppercase << ',';
+        if (row.detail != nullptr) {
+            const IMOD_LATENCY_DEVICE_RESULT& d = *row.detail;
+            out << row.device << ',' << options.devices[row.device].role << ','
+                << (d.PeriodMicroframes * (IMOD_LATENCY_MICROFRAME_NS / 1000)) << ",," << d.EventsPerSecond << ','
+                << d.P50Ns << ',' << d.P99Ns << ',' << d.MaxNs << '\n';
+        } else {
+            const IMOD_LATENCY_INTERRUPTER_RESULT& s = row.summary;
+            out << ",,," << s.InterruptsPerSecond << ',' << s.EventsPerSecond << ',' << s.P50Ns << ',' << s.P99Ns << ','
+                << s.MaxNs << '\n';
+        }
+    }
+}
+
+void WriteJson(std::ostream& out, const std::vector<Row>& rows, const Options& options) {
+    out << "{\n  \"trials\": " << options.config.Trials << ",\n  \"window_us\": " << options.config.WindowUs
+        << ",\n  \"seed\": " << options.config.Seed << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row& row = rows[i];
+        out << "    {\"scope\": \"" << row.scope << "\", \"interrupter\": " << row.interrupter
+            << ", \"imod\": " << row.interval;
+        if (row.detail != nullptr) {
+            const IMOD_LATENCY_DEVICE_RESULT& d = *row.detail;
+            out << ", \"device\": " << row.device << ", \"role\": \"" << options.devices[row.device].role
+                << "\", \"period_us\": " << (d.PeriodMicroframes * (IMOD_LATENCY_MICROFRAME_NS / 1000))
+                << ", \"events_per_s\": " << d.EventsPerSecond << ", \"p50_ns\": " << d.P50Ns
+                << ", \"p99_ns\": " << d.P99Ns << ", \"max_ns\": " << d.MaxNs << '}';
+        } else {
+            const IMOD_LATENCY_INTERRUPTER_RESULT& s = row.summary;
+            out << ", \"irq_per_s\": " << s.InterruptsPerSecond << ", \"events_per_s\": " << s.EventsPerSecond
+                << ", \"p50_ns\": " << s.P50Ns << ", \"p99_ns\": " << s.P99Ns << ", \"max_ns\": " << s.MaxNs << '}';
+        }
+        out << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void PrintUsage() {
+    std::cerr << "usage: IMODSim --device <role:speed:bInterval[:hz[:interrupter[:duty]]]> [--device ...]\n"
+                 "               (--imod <v[,v...]> | --sweep <v[,v...]> [--max-rate <irq/s>])\n"
+                 "               [--trials <n>] [--window-ms <n>] [--seed <n>] [--format csv|json]\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        uint32_t value = 0;
+        if (arg == "--device" && hasValue && options.devices.size() < IMOD_LATENCY_MAX_DEVICES) {
+            Device device;
+            if (!TryParseDevice(argv[++i], &device)) {
+                std::cerr << "error: bad device " << argv[i] << std::endl;
+                return 2;
+            }
+            options.devices.push_back(device);
+        } else if (arg == "--imod" && hasValue && TryParseList(argv[i + 1], &options.intervals)) {
+            ++i;
+        } else if (arg == "--sweep" && hasValue && TryParseList(argv[i + 1], &options.sweep)) {
+            ++i;
+        } else if (arg == "--max-rate" && hasValue && TryParseUint32(argv[i + 1], &options.maxRate)) {
+            ++i;
+        } else if (arg == "--trials" && hasValue && TryParseUint32(argv[i + 1], &value) && value != 0) {
+            options.config.Trials = value;
+            ++i;
+        } else if (arg == "--window-ms" && hasValue && TryParseUint32(argv[i + 1], &value) && value != 0 &&
+                   value <= 60000) {
+            options.config.WindowUs = value * 1000;
+            ++i;
+        } else if (arg == "--seed" && hasValue && TryParseUint32(argv[i + 1], &value)) {
+            options.config.Seed = value;
+            ++i;
+        } else if (arg == "--format" && hasValue &&
+                   (std::strcmp(argv[i + 1], "csv") == 0 || std::strcmp(argv[i + 1], "json") == 0)) {
+            options.json = std::strcmp(argv[++i], "json") == 0;
+        } else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (options.devices.empty() || options.intervals.empty() == options.sweep.empty() ||
+        (options.maxRate != 0 && options.sweep.empty())) {
+        PrintUsage();
+        return 2;
+    }
+    options.config.Trials = ((options.config.Trials + IMOD_LATENCY_LANES - 1) / IMOD_LATENCY_LANES) * IMOD_LATENCY_LANES;
+
+    uint32_t interrupterCount = 0;
+    std::vector<IMOD_LATENCY_DEVICE> models;
+    for (const Device& device : options.devices) {
+        models.push_back(device.model);
+        interrupterCount = std::max<uint32_t>(interrupterCount, device.model.Interrupter + 1);
+    }
+
+    // A single --imod value covers every interrupter, a vector has to reach the highest one used.
+    if (options.intervals.size() == 1) {
+        options.intervals.resize(interrupterCount, options.intervals[0]);
+    } else if (!options.intervals.empty() && options.intervals.size() < interrupterCount) {
+        std::cerr << "error: --imod has " << options.intervals.size() << " values, devices use " << interrupterCount
+                  << " interrupters" << std::endl;
+        return 2;
+    }
+
+    const std::vector<uint32_t>& candidates = options.sweep.empty() ? options.intervals : options.sweep;
+    std::vector<std::vector<IMOD_LATENCY_DEVICE_RESULT>> details;
+    std::vector<Row> rows;
+    std::vector<uint32_t> chosen;
+    uint32_t runs = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t interrupter = 0; interrupter < interrupterCount; ++interrupter) {
+        if (std::none_of(models.begin(), models.end(),
+                [&](const IMOD_LATENCY_DEVICE& model) { return model.Interrupter == interrupter; })) {
+            continue;
+        }
+
+        const size_t first = options.sweep.empty() ? interrupter : 0;
+        const size_t last = options.sweep.empty() ? interrupter + 1 : candidates.size();
+        std::vector<Row> choice;
+        for (size_t c = first; c < last; ++c) {
+            auto& results = details.emplace_back(models.size());
+            Row summary{"interrupter", interrupter, candidates[c]};
+            if (ImodLatencySimulateInterrupter(&options.config, models.data(), static_cast<ULONG>(models.size()),
+                    interrupter, candidates[c], results.data(), &summary.summary) != IMOD_RESULT_SUCCESS) {
+                std::cerr << "error: simulation failed for interrupter " << interrupter << std::endl;
+                return 1;
+            }
+            ++runs;
+
+            rows.push_back(summary);
+            for (size_t d = 0; d < models.size(); ++d) {
+                if (models[d].Interrupter == interrupter) {
+                    rows.push_back({"device", interrupter, candidates[c], static_cast<int>(d), {}, &results[d]});
+                }
+            }
+
+            // Candidates are tried in the order given; the first one under the budget wins, the
+            // one with the fewest interrupts otherwise.
+            if (options.maxRate != 0 &&
+                (choice.empty() ||
+                    (choice[0].summary.InterruptsPerSecond > options.maxRate &&
+                        summary.summary.InterruptsPerSecond < choice[0].summary.InterruptsPerSecond))) {
+                choice.assign(1, summary);
+                choice[0].scope = "choice";
+            }
+        }
+        if (!choice.empty()) {
+            rows.push_back(choice[0]);
+            chosen.resize(interrupter + 1, 0);
+            chosen[interrupter] = choice[0].interval;
+        }
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (options.json) {
+        WriteJson(std::cout, rows, options);
+    } else {
+        WriteCsv(std::cout, rows, options);
+    }
+
+    std::cerr << runs << " interrupter runs (" << options.config.Trials << " trials x "
+              << (options.config.WindowUs / 1000) << " ms) in " << (elapsed.count() / 1000.0) << " ms";
+    if (!chosen.empty()) {
+        std::cerr << ", imod=";
+        for (size_t i = 0; i < chosen.size(); ++i) {
+            std::cerr << (i == 0 ? "" : ",") << "0x" << std::hex << std::uppercase << chosen[i] << std::dec
+                      << std::nouppercase;
+        }
+    }
+    std::cerr << std::endl;
+    return 0;
+}
@@ -0,0 +1,174 @@
+﻿#include "IMODWatch.h"
+
+#include <algorithm>
+#include <cwctype>
+
+#include "Common/imod_batch.h"
+
+namespace {
+
+bool SameDevice(const std::wstring& left, const std::wstring& right) {
+    return left.size() == right.size() &&
+        std::equal(left.begin(), left.end(), right.begin(),
+            [](wchar_t a, wchar_t b) { return std::towupper(a) == std::towupper(b); });
+}
+
+bool SameJob(const ImodApplyJob& left, const ImodApplyJob& right) {
+    return left.capabilityAddress == right.capabilityAddress && left.barLength == right.barLength &&
+        left.hcsparamsOffset == right.hcsparamsOffset && left.rtsoffOffset == right.rtsoffOffset &&
+        left.interval == right.interval && left.intervals == right.intervals && left.flags == right.flags &&
+        left.layoutOnly == right.layoutOnly;
+}
+
+// A controller only counts as applied once nothing on it failed; anything else is retried
+// on the next pass.
+bool Applied(const ImodApplyReport& report) {
+    return report.ok && std::none_of(report.statuses.begin(), report.statuses.end(), [](uint32_t status) {
+        return status == IMOD_BATCH_STATUS_READ_FAILED || status == IMOD_BATCH_STATUS_WRITE_FAILED ||
+            status == IMOD_BATCH_STATUS_VERIFY_FAILED;
+    });
+}
+
+}  // namespace
+
+ImodWatcher::ImodWatcher(ImodWatchHost& host, ImodApplyBackend& backend, const ImodApplyOptions& options)
+    : host_(host), backend_(backend), options_(options) {}
+
+ImodWatchPass ImodWatcher::Start() {
+    known_.clear();
+    arrived_.clear();
+    rescan_ = reload_ = resumed_ = false;
+
+    ImodWatchPass pass;
+    std::vector<ImodWatchTarget> targets;
+    if (!host_.Enumerate(&targets)) {
+        pass.enumerateFailed = true;
+        rescan_ = true;
+        return pass;
+    }
+    return Apply(std::move(targets), std::move(pass));
+}
+
+void ImodWatcher::Post(const ImodWatchEvent& event) {
+    switch (event.kind) {
+    case ImodWatchEventKind::DeviceArrived:
+        rescan_ = true;
+        if (!event.deviceId.empty()) {
+            arrived_.push_back(event.deviceId);
+        }
+        break;
+    case ImodWatchEventKind::DeviceRemoved:
+        rescan_ = true;
+        break;
+    case ImodWatchEventKind::Resumed:
+        resumed_ = true;
+        break;
+    case ImodWatchEventKind::ConfigChanged:
+        reload_ = true;
+        break;
+    case ImodWatchEventKind::Stop:
+        break;
+    }
+}
+
+bool ImodWatcher::Pending() const {
+    return rescan_ || reload_ || resumed_;
+}
+
+ImodWatchPass ImodWatcher::Flush() {
+    ImodWatchPass pass;
+    if (!Pending()) {
+        return pass;
+    }
+
+    if (reload_) {
+        pass.configReloaded = host_.ReloadConfig();
+        pass.configFailed = !pass.configReloaded;
+    }
+
+    // Jobs only change with the device set or the config; a resume alone reuses them.
+    std::vector<ImodWatchTarget> targets;
+    if (rescan_ || pass.configReloaded) {
+        if (!host_.Enumerate(&targets)) {
+            pass.enumerateFailed = true;
+            reload_ = false;
+            rescan_ = true;
+            return pass;
+        }
+    } else {
+        for (const Known& known : known_) {
+            targets.push_back(known.target);
+        }
+    }
+
+    pass.resumed = resumed_;
+    return Apply(std::move(targets), std::move(pass));
+}
+
+ImodWatchPass ImodWatcher::Apply(std::vector<ImodWatchTarget> targets, ImodWatchPass pass) {
+    for (const Known& known : known_) {
+        const bool present = std::any_of(targets.begin(), targets.end(),
+            [&](const ImodWatchTarget& target) { return SameDevice(target.deviceId, known.target.deviceId); });
+        if (!present) {
+            pass.removed.push_back(known.target.deviceId);
+        }
+    }
+
+    // Resume resets the controllers, and an arrival may be the same controller coming back
+    // with reset registers, so both re-apply even when the job is unchanged. Jobs carry
+    // IMOD_BATCH_FLAG_DIFF, so registers that survived cost a read.
+    std::vector<Known> next;
+    std::vector<size_t> dirty;
+    std::vector<ImodApplyJob> jobs;
+    for (ImodWatchTarget& target : targets) {
+        const auto known = std::find_if(known_.begin(), known_.end(),
+            [&](const Known& entry) { return SameDevice(entry.target.deviceId, target.deviceId); });
+        const bool arrived = std::any_of(arrived_.begin(), arrived_.end(),
+            [&](const std::wstring& deviceId) { return SameDevice(deviceId, target.deviceId); });
+        const bool changed = known == known_.end() || !known->ok || !SameJob(known->target.job, target.job);
+        if (changed || arrived || resumed_) {
+            dirty.push_back(next.size());
+            jobs.push_back(target.job);
+        } else {
+            ++pass.unchanged;
+        }
+        next.push_back({std::move(target), known != known_.end() && known->ok});
+    }
+
+    const std::vector<ImodApplyReport> reports = RunImodApply(backend_, jobs, options_);
+    for (size_t i = 0; i < dirty.size(); ++i) {
+        Known& known = next[dirty[i]];
+        known.ok = Applied(reports[i]);
+        pass.applied.push_back({known.target.deviceId, reports[i]});
+    }
+
+    known_ = std::move(next);
+    arrived_.clear();
+    rescan_ = reload_ = resumed_ = false;
+    return pass;
+}
+
+void RunImodWatch(ImodWatcher& watcher, ImodWatchSource& source, ImodWatchHost& host, uint32_t quietMs) {
+    host.Report(watcher.Start());
+
+    ImodWatchEvent event;
+    while (source.Wait(kImodWatchInfinite, &event) && event.kind != ImodWatchEventKind::Stop) {
+        // Coalesce the burst: a resume brings a run of arrivals, an editor may save twice.
+        bool stop = false;
+        watcher.Post(event);
+        while (source.Wait(quietMs, &event)) {
+            if (event.kind == ImodWatchEventKind::Stop) {
+                stop = true;
+                break;
+            }
+            watcher.Post(event);
+        }
+
+        if (watcher.Pending()) {
+            host.Report(watcher.Flush());
+        }
+        if (stop) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IMODApply.h"
+
+// Resident re-apply for IMOD.exe --watch. Device, power and config notifications are folded
+// into pending work and acted on once a burst has gone quiet. Only controllers that
+// (re)appeared, whose apply job changed with the config, or that lost their registers to a
+// resume are applied again; the rest are left alone.
+
+constexpr uint32_t kImodWatchInfinite = 0xFFFFFFFF;
+constexpr uint32_t kImodWatchDefaultQuietMs = 500;
+
+enum class ImodWatchEventKind : uint32_t {
+    DeviceArrived,
+    DeviceRemoved,
+    Resumed,
+    ConfigChanged,
+    Stop,
+};
+
+struct ImodWatchEvent {
+    ImodWatchEventKind kind = ImodWatchEventKind::Stop;
+    // Controller instance id for arrival and removal; empty when the source cannot tell.
+    std::wstring deviceId;
+};
+
+class ImodWatchSource {
+public:
+    virtual ~ImodWatchSource() = default;
+    // Returns false once timeoutMs passes without an event.
+    virtual bool Wait(uint32_t timeoutMs, ImodWatchEvent* event) = 0;
+};
+
+struct ImodWatchTarget {
+    std::wstring deviceId;
+    ImodApplyJob job;
+};
+
+struct ImodWatchApplied {
+    std::wstring deviceId;
+    ImodApplyReport report;
+};
+
+// What one pass did, in target order.
+struct ImodWatchPass {
+    bool configReloaded = false;
+    bool configFailed = false;
+    bool enumerateFailed = false;
+    bool resumed = false;
+    std::vector<ImodWatchApplied> applied;
+    std::vector<std::wstring> removed;
+    uint32_t unchanged = 0;
+};
+
+class ImodWatchHost {
+public:
+    virtual ~ImodWatchHost() = default;
+    // Re-reads the config; on failure the previous one stays in effect.
+    virtual bool ReloadConfig() = 0;
+    // Controllers present now, each with the job the loaded config gives it.
+    virtual bool Enumerate(std::vector<ImodWatchTarget>* targets) = 0;
+    virtual void Report(const ImodWatchPass& pass) = 0;
+};
+
+class ImodWatcher {
+public:
+    ImodWatcher(ImodWatchHost& host, ImodApplyBackend& backend, const ImodApplyOptions& options);
+
+    // Applies every controller; later passes compare against what this one applied.
+    ImodWatchPass Start();
+    void Post(const ImodWatchEvent& event);
+    bool Pending() const;
+    // Acts on everything posted since the last pass.
+    ImodWatchPass Flush();
+
+private:
+    struct Known {
+        ImodWatchTarget target;
+        bool ok = false;
+    };
+
+    ImodWatchPass Apply(std::vector<ImodWatchTarget> targets, ImodWatchPass pass);
+
+    ImodWatchHost& host_;
+    ImodApplyBackend& backend_;
+    ImodApplyOptions options_;
+    std::vector<Known> known_;
+    std::vector<std::wstring> arrived_;
+    bool rescan_ = false;
+    bool reload_ = false;
+    bool resumed_ = false;
+};
+
+// Start, then one Flush per burst of events until the source reports Stop. A burst ends
+// when quietMs passes without another event.
+void RunImodWatch(ImodWatcher& watcher, ImodWatchSource& source, ImodWatchHost& host, uint32_t quietMs);
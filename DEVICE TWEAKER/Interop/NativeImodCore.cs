@@ -0,0 +1,346 @@
+using System.Runtime.InteropServices;
+
+namespace DeviceTweakerCS;
+
+// IMODCore.dll: the IMOD/Common engines IMOD.exe and IMODBench run, exported through
+// IMOD/IMODCore.def so the GUI calls the same code instead of keeping a C# copy. The DLL is
+// embedded next to IMOD.exe; MainForm.RegisterImodCoreResolver extracts and loads it.
+internal static class NativeImodCore
+{
+    internal const string LibraryName = "IMODCore";
+    internal const uint ResultSuccess = 0;
+    internal const uint ResultInvalidParameter = 1;
+    internal const int CpuSetMaxGroups = 32;
+    internal const uint AffinityAny = 0xFFFFFFFF;
+    internal const byte AffinityProcessorReserved = 0x1;
+    internal const byte AffinityProcessorCore0 = 0x2;
+
+    // IMOD_AFFINITY_WORKSPACE in ULONGs: Load, CoreDevices and CoreInputs for 256 processors,
+    // ClusterPlaced and ClusterLlc for 16 clusters, Placement and Order for 128 devices.
+    internal const int AffinityWorkspaceSize = (3 * 256) + 16 + (16 * 256) + (2 * 128);
+
+    internal const int BudgetMaxVectors = 64;
+    internal const uint BudgetKindUsb = 0;
+    internal const uint BudgetKindNic = 1;
+    internal const uint BudgetKindStorage = 2;
+    internal const uint BudgetFlagOverRate = 0x1;
+    internal const uint BudgetFlagOverLoad = 0x2;
+
+    internal const int NvmeMaxVectors = 65;
+    internal const uint NvmeSelectCurrent = 0;
+    internal const uint NvmeApplyDiffVerify = 0x3;
+    internal const uint BatchStatusWriteFailed = 3;
+    internal const uint BatchStatusInactive = 5;
+    internal const uint BatchStatusVerifyFailed = 6;
+
+    internal const int NicIndexSlots = 256;
+    internal const int TopologyRouteMaxPorts = 6;
+    internal const int TopologyRouteTextSize = 19;
+
+    // IMOD_CPUSET_LAYOUT: ULONG GroupCount, UCHAR ProcessorCount[32].
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct CpuSetLayout
+    {
+        public uint GroupCount;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = CpuSetMaxGroups)]
+        public byte[] ProcessorCount;
+    }
+
+    // IMOD_AFFINITY_PROCESSOR, _DEVICE, _CONFIG, _ASSIGNMENT, _COST and _SUMMARY of imod_affinity.h.
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinityProcessor
+    {
+        public uint Core;
+        public uint Llc;
+        public uint Ccd;
+        public uint Rank;
+        public byte Efficiency;
+        public byte Flags;
+        private readonly ushort Reserved;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinityDevice
+    {
+        public uint Role;
+        public uint LoadPermille;
+        public uint Cluster;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinityConfig
+    {
+        public uint TargetCcd;
+        public uint MaxPasses;
+        public uint ECore;
+        public uint Rank;
+        public uint OffTarget;
+        public uint Core0;
+        public uint Smt;
+        public uint SmtInput;
+        public uint SplitCluster;
+        public uint Load;
+        public uint Overload;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinityAssignment
+    {
+        public uint Processor;
+        public uint Reasons;
+        public ulong Cost;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinityCost
+    {
+        public ulong Total;
+        public ulong Placement;
+        public ulong Smt;
+        public ulong SplitCluster;
+        public ulong Load;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct AffinitySummary
+    {
+        public AffinityCost Initial;
+        public AffinityCost Final;
+        public uint Passes;
+        public uint Relocations;
+        public uint Swaps;
+        public ulong Evaluations;
+    }
+
+    // IMOD_BUDGET_DEVICE, _CONFIG and _PROCESSOR of imod_budget.h.
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct BudgetDevice
+    {
+        public uint Kind;
+        public uint Moderation;
+        public uint VectorCount;
+        public uint MessageLimit;
+        public uint IsrNs;
+        public uint DpcNs;
+        public uint EventNs;
+        public ushort Group;
+        private readonly ushort Reserved;
+        public ulong Affinity;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = BudgetMaxVectors)]
+        public uint[] Values;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = BudgetMaxVectors)]
+        public uint[] EventsPerSecond;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct BudgetConfig
+    {
+        public uint MaxInterruptsPerSecond;
+        public uint MaxLoadPermille;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct BudgetProcessor
+    {
+        public uint Messages;
+        public uint InterruptsPerSecond;
+        public uint EventsPerSecond;
+        public uint IsrNsPerSecond;
+        public uint DpcNsPerSecond;
+        public uint LoadPermille;
+        public uint Flags;
+    }
+
+    // IMOD_NVME_TRANSPORT: BOOLEAN (*)(PVOID Context, ULONG Cdw10, ULONG Cdw11, ULONG *Completion).
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    internal delegate byte NvmeFeatureCallback(IntPtr context, uint cdw10, uint cdw11, out uint completion);
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NvmeTransport
+    {
+        public IntPtr Context;
+        public IntPtr GetFeature;
+        public IntPtr SetFeature;
+    }
+
+    // IMOD_NVME_SETTINGS, _STATE and _APPLY of imod_nvme.h.
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NvmeSettings
+    {
+        public uint TimeUs;
+        public uint Threshold;
+        public uint Vectors;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = NvmeMaxVectors)]
+        public byte[] CoalescingDisable;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NvmeState
+    {
+        public uint SubmissionQueues;
+        public uint CompletionQueues;
+        public uint Coalescing;
+        public NvmeSettings Settings;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = NvmeMaxVectors)]
+        public byte[] VectorRead;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NvmeApply
+    {
+        public uint Flags;
+        public NvmeSettings Target;
+        public NvmeSettings Previous;
+        public uint CoalescingStatus;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = NvmeMaxVectors)]
+        public uint[] VectorStatus;
+
+        public uint Applied;
+        public uint RolledBack;
+        public uint RollbackFailed;
+    }
+
+    // IMOD_NIC_PROFILE and IMOD_NIC_INDEX of imod_nic.h. Name and DeviceIds point into the
+    // DLL's static table.
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NicProfile
+    {
+        public IntPtr Name;
+        public ushort VendorId;
+        private readonly ushort Reserved;
+        public uint Moderation;
+        public uint Family;
+        public uint BaseOffset;
+        public uint Stride;
+        public uint MaxQueues;
+        public uint Width;
+        public uint ReadMask;
+        public uint WriteOrBits;
+        public uint FirstQueueVector;
+        public IntPtr DeviceIds;
+        public uint DeviceCount;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct NicIndex
+    {
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = NicIndexSlots)]
+        public uint[] Slots;
+
+        public uint Entries;
+        public uint MaxProbes;
+    }
+
+    // What a call into IMODCore raises when the DLL is missing, lacks the export, or was built
+    // for another architecture.
+    internal static bool IsUnavailable(Exception ex)
+    {
+        return ex is DllNotFoundException or EntryPointNotFoundException or BadImageFormatException;
+    }
+
+    // IMOD_CPUSET is ULONGLONG Groups[32]; callers pass a ulong[CpuSetMaxGroups].
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodCpuSetEncodeAffinityPolicy(ulong[] set, byte[] buffer, uint bufferSize, out uint written);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodCpuSetDecodeAffinityPolicy(byte[] buffer, uint length, [Out] ulong[] set);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodCpuSetEncodeBitmap(
+        ulong[] set,
+        ref CpuSetLayout layout,
+        [Out] byte[] buffer,
+        uint bufferSize,
+        out uint written);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodCpuSetDecodeBitmap(byte[] buffer, uint length, ref CpuSetLayout layout, [Out] ulong[] set);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern void ImodAffinityDefaultConfig(out AffinityConfig config);
+
+    // Workspace is a uint[AffinityWorkspaceSize] scratch buffer.
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodAffinityCost(
+        ref AffinityConfig config,
+        AffinityProcessor[] processors,
+        uint processorCount,
+        AffinityDevice[] devices,
+        uint deviceCount,
+        uint[] placement,
+        uint[] workspace,
+        out AffinityCost cost);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodAffinityPlan(
+        ref AffinityConfig config,
+        AffinityProcessor[] processors,
+        uint processorCount,
+        AffinityDevice[] devices,
+        uint deviceCount,
+        uint[] workspace,
+        [Out] AffinityAssignment[] assignments,
+        out AffinitySummary summary);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern ulong ImodBudgetIntervalNs(uint moderation, uint value);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodBudgetInterruptRate(uint moderation, uint value, uint eventsPerSecond);
+
+    // Processor n of the estimate is bit n % 64 of group n / 64.
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodBudgetEstimate(
+        ref BudgetConfig config,
+        BudgetDevice[] devices,
+        uint deviceCount,
+        uint processorCount,
+        [Out] BudgetProcessor[] processors,
+        out uint overBudget);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNvmeEncodeCoalescing(uint timeUs, uint threshold, out uint cdw11);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern void ImodNvmeDecodeCoalescing(uint value, out uint timeUs, out uint threshold);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNvmeQueueVector(uint queue, uint messages);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNvmeRead(ref NvmeTransport transport, uint select, out NvmeState state);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNvmeApply(ref NvmeTransport transport, ref NvmeApply apply);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNicProfileCount();
+
+    // Both return a const IMOD_NIC_PROFILE * (IntPtr.Zero for none).
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern IntPtr ImodNicProfileAt(uint index);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodNicIndexBuild(out NicIndex index);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern IntPtr ImodNicLookup(ref NicIndex index, ushort vendorId, ushort deviceId);
+
+    // Port paths ("7.2.4") as IMOD.exe reads them from ROUTE_ROLES; the text is ASCII.
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodTopologyEncodeRoute(uint[] ports, uint count, out uint rootPort, out uint routeString);
+
+    [DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern uint ImodTopologyFormatRoute(
+        uint rootPort,
+        uint routeString,
+        [Out] byte[] buffer,
+        uint bufferSize,
+        out uint written);
+}
@@ -0,0 +1,153 @@
+using System.Buffers.Binary;
+using System.Runtime.InteropServices;
+using Microsoft.Win32.SafeHandles;
+
+namespace DeviceTweakerCS;
+
+// Get/Set Features through the storage protocol pass-through StorNVMe takes on the controller's
+// storage port, laid out as IMOD.cpp's StoragePortGetFeature / StoragePortSetFeature do it.
+internal sealed class NvmeInterop : INvmeFeatureTransport, IDisposable
+{
+    private const uint IoctlStorageQueryProperty = 0x002D1400;
+    private const uint IoctlStorageSetProperty = 0x002D93FC;
+    private const int StorageAdapterProtocolSpecificProperty = 49;
+    private const int PropertyStandardQuery = 0;
+    private const int PropertyStandardSet = 0;
+    private const int ProtocolTypeNvme = 3;
+    private const int NvmeDataTypeFeature = 3;
+
+    // STORAGE_PROPERTY_QUERY / _SET header, then STORAGE_PROTOCOL_SPECIFIC_DATA (10 dwords) or
+    // its _EXT form (16 dwords). The descriptor that comes back has FixedProtocolReturnData at 32.
+    private const int PropertyHeaderSize = 8;
+    private const int QueryBufferSize = PropertyHeaderSize + (10 * sizeof(uint));
+    private const int SetBufferSize = PropertyHeaderSize + (16 * sizeof(uint));
+    private const int FixedProtocolReturnDataOffset = 32;
+
+    private const uint CmGetDeviceInterfaceListPresent = 0x00000000;
+    private const int CrSuccess = 0;
+    private const uint GenericRead = 0x80000000;
+    private const uint GenericWrite = 0x40000000;
+    private const uint FileShareRead = 0x00000001;
+    private const uint FileShareWrite = 0x00000002;
+    private const uint OpenExisting = 3;
+
+    private static readonly Guid GuidDevinterfaceStoragePort = new("2ACCFE60-C130-11D2-B082-00A0C91EFB8B");
+
+    private readonly SafeFileHandle _port;
+
+    private NvmeInterop(SafeFileHandle port)
+    {
+        _port = port;
+    }
+
+    [DllImport("cfgmgr32.dll", CharSet = CharSet.Unicode)]
+    private static extern int CM_Get_Device_Interface_List_SizeW(out uint length, ref Guid interfaceClassGuid, string deviceId, uint flags);
+
+    [DllImport("cfgmgr32.dll", CharSet = CharSet.Unicode)]
+    private static extern int CM_Get_Device_Interface_ListW(ref Guid interfaceClassGuid, string deviceId, [Out] char[] buffer, uint bufferLength, uint flags);
+
+    [DllImport("kernel32.dll", CharSet = CharSet.Unicode, SetLastError = true)]
+    private static extern SafeFileHandle CreateFile(
+        string fileName,
+        uint desiredAccess,
+        uint shareMode,
+        IntPtr securityAttributes,
+        uint creationDisposition,
+        uint flagsAndAttributes,
+        IntPtr templateFile);
+
+    [DllImport("kernel32.dll", SetLastError = true)]
+    private static extern bool DeviceIoControl(
+        SafeFileHandle device,
+        uint ioControlCode,
+        [In, Out] byte[] inBuffer,
+        int inBufferSize,
+        [In, Out] byte[] outBuffer,
+        int outBufferSize,
+        out int bytesReturned,
+        IntPtr overlapped);
+
+    public static bool TryOpen(string instanceId, out NvmeInterop? controller, out string? error)
+    {
+        controller = null;
+        error = null;
+        Guid interfaceGuid = GuidDevinterfaceStoragePort;
+        if (CM_Get_Device_Interface_List_SizeW(out uint length, ref interfaceGuid, instanceId, CmGetDeviceInterfaceListPresent) != CrSuccess
+            || length <= 1)
+        {
+            error = "controller has no storage port (not on StorNVMe?)";
+            return false;
+        }
+
+        char[] interfaces = new char[length];
+        if (CM_Get_Device_Interface_ListW(ref interfaceGuid, instanceId, interfaces, length, CmGetDeviceInterfaceListPresent) != CrSuccess
+            || interfaces[0] == '\0')
+        {
+            error = "failed to list the controller's storage port";
+            return false;
+        }
+
+        string path = new(interfaces, 0, Array.IndexOf(interfaces, '\0'));
+        SafeFileHandle port = CreateFile(path, GenericRead | GenericWrite, FileShareRead | FileShareWrite, IntPtr.Zero, OpenExisting, 0, IntPtr.Zero);
+        if (port.IsInvalid)
+        {
+            error = $"failed to open storage port (error {Marshal.GetLastWin32Error()})";
+            port.Dispose();
+            return false;
+        }
+
+        controller = new NvmeInterop(port);
+        return true;
+    }
+
+    public bool TryGetFeature(uint cdw10, uint cdw11, out uint completion)
+    {
+        completion = 0;
+        byte[] buffer = new byte[QueryBufferSize];
+        WriteHeader(buffer, PropertyStandardQuery, cdw10, cdw11);
+        if (!DeviceIoControl(_port, IoctlStorageQueryProperty, buffer, buffer.Length, buffer, buffer.Length, out int bytesReturned, IntPtr.Zero)
+            || bytesReturned < QueryBufferSize)
+        {
+            return false;
+        }
+
+        completion = BinaryPrimitives.ReadUInt32LittleEndian(buffer.AsSpan(FixedProtocolReturnDataOffset));
+        return true;
+    }
+
+    public bool TrySetFeature(uint cdw10, uint cdw11, out uint completion)
+    {
+        completion = 0;
+        byte[] buffer = new byte[SetBufferSize];
+        WriteHeader(buffer, PropertyStandardSet, cdw10, cdw11);
+        if (!DeviceIoControl(_port, IoctlStorageSetProperty, buffer, buffer.Length, buffer, buffer.Length, out int bytesReturned, IntPtr.Zero))
+        {
+            return false;
+        }
+
+        if (bytesReturned >= SetBufferSize)
+        {
+            completion = BinaryPrimitives.ReadUInt32LittleEndian(buffer.AsSpan(FixedProtocolReturnDataOffset));
+        }
+
+        return true;
+    }
+
+    public void Dispose()
+    {
+        _port.Dispose();
+    }
+
+    // PropertyId, QueryType / SetType, then ProtocolType, DataType, feature identifier, Cdw11.
+    // Only the identifier of Cdw10 goes through; the pass-through has no SEL.
+    private static void WriteHeader(byte[] buffer, int type, uint cdw10, uint cdw11)
+    {
+        Span<byte> span = buffer;
+        BinaryPrimitives.WriteInt32LittleEndian(span, StorageAdapterProtocolSpecificProperty);
+        BinaryPrimitives.WriteInt32LittleEndian(span[4..], type);
+        BinaryPrimitives.WriteInt32LittleEndian(span[8..], ProtocolTypeNvme);
+        BinaryPrimitives.WriteInt32LittleEndian(span[12..], NvmeDataTypeFeature);
+        BinaryPrimitives.WriteUInt32LittleEndian(span[16..], cdw10 & 0xFF);
+        BinaryPrimitives.WriteUInt32LittleEndian(span[20..], cdw11);
+    }
+}
@@ -0,0 +1,376 @@
+using System.Buffers.Binary;
+using System.Globalization;
+using System.Numerics;
+
+namespace DeviceTweakerCS;
+
+// Processors by group, word g being the KAFFINITY of group g. The registry encodings are
+// IMOD/Common/imod_cpuset.c through IMODCore.dll, the code IMODBench checks up to 1024 LPs,
+// with a managed copy of the same rules for when the DLL cannot be loaded.
+internal sealed class CpuSet : IEquatable<CpuSet>
+{
+    public const int GroupSize = 64;
+    public const int MaxGroups = 32;
+    public const int GroupAffinitySize = 16;
+
+    private readonly ulong[] _groups;
+
+    public static CpuSet Empty { get; } = new([]);
+
+    private CpuSet(ulong[] groups)
+    {
+        int length = groups.Length;
+        while (length > 0 && groups[length - 1] == 0)
+        {
+            length--;
+        }
+
+        _groups = length == groups.Length ? groups : groups[..length];
+    }
+
+    public static CpuSet FromMask(ulong mask)
+    {
+        return FromGroup(0, mask);
+    }
+
+    public static CpuSet FromGroup(int group, ulong mask)
+    {
+        if (mask == 0)
+        {
+            return Empty;
+        }
+
+        ArgumentOutOfRangeException.ThrowIfNegative(group);
+        ArgumentOutOfRangeException.ThrowIfGreaterThanOrEqual(group, MaxGroups);
+        ulong[] groups = new ulong[group + 1];
+        groups[group] = mask;
+        return new CpuSet(groups);
+    }
+
+    public static CpuSet FromProcessors(IEnumerable<(int Group, int Number)> processors)
+    {
+        ulong[] groups = new ulong[MaxGroups];
+        foreach ((int group, int number) in processors)
+        {
+            if (group is >= 0 and < MaxGroups && number is >= 0 and < GroupSize)
+            {
+                groups[group] |= 1UL << number;
+            }
+        }
+
+        return new CpuSet(groups);
+    }
+
+    public bool IsEmpty => _groups.Length == 0;
+    public int Count => _groups.Sum(mask => BitOperations.PopCount(mask));
+    public int GroupCount => _groups.Count(mask => mask != 0);
+    public int FirstGroup => Array.FindIndex(_groups, mask => mask != 0);
+
+    public ulong GetGroupMask(int group)
+    {
+        return group >= 0 && group < _groups.Length ? _groups[group] : 0;
+    }
+
+    public bool Contains(int group, int number)
+    {
+        return number is >= 0 and < GroupSize && (GetGroupMask(group) & (1UL << number)) != 0;
+    }
+
+    public IEnumerable<(int Group, int Number)> Processors
+    {
+        get
+        {
+            for (int group = 0; group < _groups.Length; group++)
+            {
+                ulong mask = _groups[group];
+                while (mask != 0)
+                {
+                    int number = BitOperations.TrailingZeroCount(mask);
+                    yield return (group, number);
+                    mask &= mask - 1;
+                }
+            }
+        }
+    }
+
+    public CpuSet With(int group, int number)
+    {
+        if (group is < 0 or >= MaxGroups || number is < 0 or >= GroupSize || Contains(group, number))
+        {
+            return this;
+        }
+
+        ulong[] groups = new ulong[Math.Max(_groups.Length, group + 1)];
+        _groups.CopyTo(groups, 0);
+        groups[group] |= 1UL << number;
+        return new CpuSet(groups);
+    }
+
+    public static CpuSet operator |(CpuSet left, CpuSet right)
+    {
+        ulong[] groups = new ulong[Math.Max(left._groups.Length, right._groups.Length)];
+        for (int group = 0; group < groups.Length; group++)
+        {
+            groups[group] = left.GetGroupMask(group) | right.GetGroupMask(group);
+        }
+
+        return new CpuSet(groups);
+    }
+
+    // AssignmentSetOverride: the 8-byte KAFFINITY for group 0, as the value
+    // has always been written, and a GROUP_AFFINITY (Mask, Group, Reserved[3])
+    // for any other group. An interrupt targets one group, so a set that spans
+    // groups has no encoding.
+    public bool TryEncodeAffinityPolicy(out byte[] value)
+    {
+        try
+        {
+            value = [];
+            byte[] buffer = new byte[GroupAffinitySize];
+            if (NativeImodCore.ImodCpuSetEncodeAffinityPolicy(ToNative(), buffer, (uint)buffer.Length, out uint written) != NativeImodCore.ResultSuccess)
+            {
+                return false;
+            }
+
+            value = buffer[..(int)written];
+            return true;
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            return TryEncodeAffinityPolicyManaged(out value);
+        }
+    }
+
+    // REG_BINARY values of 4, 8 or 16 bytes; a REG_DWORD or REG_QWORD is the mask itself.
+    // False for any other length or type, and for a group past MaxGroups.
+    public static bool TryDecodeAffinityPolicy(object? raw, out CpuSet set)
+    {
+        set = Empty;
+        byte[]? bytes = raw switch
+        {
+            byte[] value => value,
+            int value => BitConverter.GetBytes(value),
+            uint value => BitConverter.GetBytes(value),
+            long value => BitConverter.GetBytes(value),
+            ulong value => BitConverter.GetBytes(value),
+            _ => null,
+        };
+        if (bytes is null)
+        {
+            return false;
+        }
+
+        ulong[] groups = new ulong[MaxGroups];
+        try
+        {
+            if (NativeImodCore.ImodCpuSetDecodeAffinityPolicy(bytes, (uint)bytes.Length, groups) != NativeImodCore.ResultSuccess)
+            {
+                return false;
+            }
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            if (!TryDecodeAffinityPolicyManaged(bytes, groups))
+            {
+                return false;
+            }
+        }
+
+        set = new CpuSet(groups);
+        return true;
+    }
+
+    public static CpuSet DecodeAffinityPolicy(object? raw)
+    {
+        return TryDecodeAffinityPolicy(raw, out CpuSet set) ? set : Empty;
+    }
+
+    // ReservedCpuSets: bit i is system-wide processor index i, trimmed after
+    // the last set byte. The indices are system-wide already, so they go
+    // through a layout of full groups: index i is bit i % 64 of group i / 64.
+    // False for an index the value cannot hold.
+    public static bool TryEncodeBitmap(IEnumerable<int> indices, out byte[] bytes)
+    {
+        bytes = [];
+        int[] valid = indices.Distinct().ToArray();
+        if (valid.Any(index => index is < 0 or >= MaxGroups * GroupSize))
+        {
+            return false;
+        }
+
+        CpuSet set = FromProcessors(valid.Select(index => (index / GroupSize, index % GroupSize)));
+        byte[] buffer = new byte[MaxGroups * GroupSize / 8];
+        try
+        {
+            NativeImodCore.CpuSetLayout layout = GetFullGroupLayout();
+            if (NativeImodCore.ImodCpuSetEncodeBitmap(set.ToNative(), ref layout, buffer, (uint)buffer.Length, out uint written) != NativeImodCore.ResultSuccess)
+            {
+                return false;
+            }
+
+            bytes = buffer[..(int)written];
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            bytes = EncodeBitmapManaged(valid);
+        }
+
+        return true;
+    }
+
+    // Bits past the last processor a value can name are ignored, as the kernel ignores them.
+    public static bool TryDecodeBitmap(byte[] bytes, out List<int> indices)
+    {
+        indices = [];
+        ulong[] groups = new ulong[MaxGroups];
+        try
+        {
+            NativeImodCore.CpuSetLayout layout = GetFullGroupLayout();
+            if (NativeImodCore.ImodCpuSetDecodeBitmap(bytes, (uint)bytes.Length, ref layout, groups) != NativeImodCore.ResultSuccess)
+            {
+                return false;
+            }
+        }
+        catch (Exception ex) when (NativeImodCore.IsUnavailable(ex))
+        {
+            DecodeBitmapManaged(bytes, groups);
+        }
+
+        indices = new CpuSet(groups).Processors.Select(processor => (processor.Group * GroupSize) + processor.Number).ToList();
+        return true;
+    }
+
+    // The managed encoders only run when IMODCore.dll cannot be loaded. They follow the rules
+    // of imod_cpuset.c, so a value read or written either way is the same.
+    private bool TryEncodeAffinityPolicyManaged(out byte[] value)
+    {
+        value = [];
+        if (GroupCount > 1)
+        {
+            return false;
+        }
+
+        int group = Math.Max(0, FirstGroup);
+        value = new byte[group == 0 ? sizeof(ulong) : GroupAffinitySize];
+        BinaryPrimitives.WriteUInt64LittleEndian(value, GetGroupMask(group));
+        if (group != 0)
+        {
+            BinaryPrimitives.WriteUInt16LittleEndian(value.AsSpan(8), (ushort)group);
+        }
+
+        return true;
+    }
+
+    private static bool TryDecodeAffinityPolicyManaged(byte[] bytes, ulong[] groups)
+    {
+        switch (bytes.Length)
+        {
+            case sizeof(uint):
+                groups[0] = BinaryPrimitives.ReadUInt32LittleEndian(bytes);
+                return true;
+            case sizeof(ulong):
+                groups[0] = BinaryPrimitives.ReadUInt64LittleEndian(bytes);
+                return true;
+            case GroupAffinitySize:
+                int group = BinaryPrimitives.ReadUInt16LittleEndian(bytes.AsSpan(8));
+                if (group >= MaxGroups)
+                {
+                    return false;
+                }
+
+                groups[group] = BinaryPrimitives.ReadUInt64LittleEndian(bytes);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    private static byte[] EncodeBitmapManaged(int[] indices)
+    {
+        if (indices.Length == 0)
+        {
+            return [];
+        }
+
+        byte[] bytes = new byte[(indices.Max() / 8) + 1];
+        foreach (int index in indices)
+        {
+            bytes[index / 8] |= (byte)(1 << (index % 8));
+        }
+
+        return bytes;
+    }
+
+    private static void DecodeBitmapManaged(byte[] bytes, ulong[] groups)
+    {
+        int bits = Math.Min(bytes.Length * 8, MaxGroups * GroupSize);
+        for (int index = 0; index < bits; index++)
+        {
+            if ((bytes[index / 8] & (1 << (index % 8))) != 0)
+            {
+                groups[index / GroupSize] |= 1UL << (index % GroupSize);
+            }
+        }
+    }
+
+    private static NativeImodCore.CpuSetLayout GetFullGroupLayout()
+    {
+        byte[] counts = new byte[MaxGroups];
+        Array.Fill(counts, (byte)GroupSize);
+        return new NativeImodCore.CpuSetLayout { GroupCount = MaxGroups, ProcessorCount = counts };
+    }
+
+    private ulong[] ToNative()
+    {
+        ulong[] groups = new ulong[MaxGroups];
+        _groups.CopyTo(groups, 0);
+        return groups;
+    }
+
+    public bool Equals(CpuSet? other)
+    {
+        return other is not null && _groups.AsSpan().SequenceEqual(other._groups);
+    }
+
+    public override bool Equals(object? obj)
+    {
+        return Equals(obj as CpuSet);
+    }
+
+    public override int GetHashCode()
+    {
+        HashCode hash = new();
+        foreach (ulong mask in _groups)
+        {
+            hash.Add(mask);
+        }
+
+        return hash.ToHashCode();
+    }
+
+    public static bool operator ==(CpuSet? left, CpuSet? right)
+    {
+        return left is null ? right is null : left.Equals(right);
+    }
+
+    public static bool operator !=(CpuSet? left, CpuSet? right)
+    {
+        return !(left == right);
+    }
+
+    // Group 0 alone keeps the old 0x mask form in logs.
+    public override string ToString()
+    {
+        if (_groups.Length <= 1)
+        {
+            return $"0x{GetGroupMask(0):X}";
+        }
+
+        return string.Join(
+            ",",
+            _groups
+                .Select((mask, group) => (mask, group))
+                .Where(item => item.mask != 0)
+                .Select(item => string.Create(CultureInfo.InvariantCulture, $"G{item.group}:0x{item.mask:X}")));
+    }
+}
@@ -33,7 +33,8 @@ internal sealed record NdisRssRuntimeState(
     string AdapterName,
     string InterfaceDescription,
     string Profile,
-    string Error);
+    string Error,
+    IReadOnlyList<NdisRssProcessor>? IndirectionTable = null);
 
 internal sealed record CpuVendorInfo(string Name, string Vendor);
 
@@ -179,6 +180,12 @@ internal sealed class DeviceBlock
     public Button? NicItrApplyButton { get; init; }
     public Button? NicItrSaveButton { get; init; }
     public Button? NicItrCheckButton { get; init; }
+    public Button? NicItrSampleButton { get; init; }
+    public TextBox? NvmeBox { get; init; }
+    public Label? NvmeStatusLabel { get; init; }
+    public Label? NvmeDetailLabel { get; init; }
+    public Button? NvmeApplyButton { get; init; }
+    public Button? NvmeSaveButton { get; init; }
     public required CheckBox ImodAutoCheck { get; init; }
     public ThemedDropDownPicker? ImodModeCombo { get; init; }
     public Button? ImodCheckButton { get; init; }
@@ -192,12 +199,16 @@ internal sealed class DeviceBlock
     public required Control InfoLabel { get; init; }
     public Action? RelayoutAction { get; set; }
 
-    public ulong AffinityMask { get; set; }
+    public CpuSet AffinityMask { get; set; } = CpuSet.Empty;
+    /// <summary>Why AssignmentSetOverride could not be read; APPLY leaves it alone until CPUs are picked again.</summary>
+    public string? AffinityReadError { get; set; }
     public int? IrqCount { get; set; }
     public int SuppressCpuEvents { get; set; }
     public int SuppressImodEvents { get; set; }
     public int? RssBaseCore { get; set; }
     public int NicItrOperationGeneration { get; set; }
+    public IReadOnlyList<uint>? NicItrSampledRates { get; set; }
+    public int NvmeOperationGeneration { get; set; }
     public NdisRssRuntimeState? NdisRssRuntime { get; set; }
 }
 
@@ -271,4 +282,6 @@ internal sealed class ReservedCpuPanelTag
     public required List<ReservedCpuEntry> Meta { get; init; }
     public required InfoTextBox PathLabel { get; init; }
     public required InfoTextBox ValueLabel { get; init; }
+    /// <summary>Set when ReservedCpuSets could not be read; the CPUs stay locked so nothing is written over it.</summary>
+    public bool ReadFailed { get; init; }
 }
@@ -0,0 +1,183 @@
+using System.Globalization;
+
+namespace DeviceTweakerCS;
+
+// One indirection table entry: the processor whose DPC gets the hash bucket's packets.
+internal readonly record struct NdisRssProcessor(int Group, int Number);
+
+// Turns what Windows reports about an adapter's RSS state into NdisRssRuntimeState. The
+// input is the MSFT_NetAdapter and MSFT_NetAdapterRssSettingData properties as name/value
+// bags, read in-process by Devices/NdisRssRuntimeProvider.cs. Nothing here touches WMI.
+internal static class NdisRssStateParser
+{
+    // MSFT_NetAdapterRssSettingData.Profile, named as Set-NetAdapterRss -Profile takes them.
+    private static readonly string[] ProfileNames = ["", "Closest", "ClosestStatic", "NUMA", "NUMAStatic", "Conservative"];
+
+    public static NdisRssRuntimeState Parse(IReadOnlyDictionary<string, object?>? adapter, IReadOnlyDictionary<string, object?>? rss)
+    {
+        if (adapter is null && rss is null)
+        {
+            return Empty("adapter-not-found");
+        }
+
+        IReadOnlyDictionary<string, object?> names = adapter ?? rss!;
+        string adapterName = GetString(names, "Name");
+        string description = GetString(names, "InterfaceDescription");
+        if (rss is null)
+        {
+            return Empty("rss-not-found") with
+            {
+                AdapterFound = true,
+                AdapterName = adapterName,
+                InterfaceDescription = description,
+            };
+        }
+
+        return new NdisRssRuntimeState(
+            AdapterFound: true,
+            RssFound: true,
+            Enabled: GetBool(rss, "Enabled"),
+            BaseProcessorGroup: GetInt(rss, "BaseProcessorGroup"),
+            BaseProcessorNumber: GetInt(rss, "BaseProcessorNumber"),
+            MaxProcessorGroup: GetInt(rss, "MaxProcessorGroup"),
+            MaxProcessorNumber: GetInt(rss, "MaxProcessorNumber"),
+            MaxProcessors: GetInt(rss, "MaxProcessors"),
+            NumberOfReceiveQueues: GetInt(rss, "NumberOfReceiveQueues"),
+            AdapterName: adapterName,
+            InterfaceDescription: description,
+            Profile: FormatProfile(rss.GetValueOrDefault("Profile")),
+            Error: string.Empty,
+            IndirectionTable: ParseProcessors(rss.GetValueOrDefault("IndirectionTable")));
+    }
+
+    public static NdisRssRuntimeState Empty(string error)
+    {
+        return new NdisRssRuntimeState(
+            AdapterFound: false,
+            RssFound: false,
+            Enabled: null,
+            BaseProcessorGroup: null,
+            BaseProcessorNumber: null,
+            MaxProcessorGroup: null,
+            MaxProcessorNumber: null,
+            MaxProcessors: null,
+            NumberOfReceiveQueues: null,
+            AdapterName: string.Empty,
+            InterfaceDescription: string.Empty,
+            Profile: string.Empty,
+            Error: error);
+    }
+
+    // IndirectionTable is an array of embedded MSFT_NetAdapterProcessor instances, each with
+    // ProcessorGroup / ProcessorNumber.
+    public static IReadOnlyList<NdisRssProcessor> ParseProcessors(object? value)
+    {
+        List<NdisRssProcessor> processors = [];
+        switch (value)
+        {
+            case null or string:
+                break;
+            case IReadOnlyDictionary<string, object?> entry:
+                if (TryGetProcessor(entry, out NdisRssProcessor single))
+                {
+                    processors.Add(single);
+                }
+
+                break;
+            case System.Collections.IEnumerable items:
+                foreach (object? item in items)
+                {
+                    processors.AddRange(ParseProcessors(item));
+                }
+
+                break;
+        }
+
+        return processors;
+    }
+
+    public static string FormatProfile(object? value)
+    {
+        int? number = ToInt(value);
+        if (number is int index && index > 0 && index < ProfileNames.Length)
+        {
+            return ProfileNames[index];
+        }
+
+        return value?.ToString()?.Trim() ?? string.Empty;
+    }
+
+    // Entries per processor in table order, e.g. "0:0x32 0:2x32 0:4x32 0:6x32".
+    public static string FormatIndirection(IReadOnlyList<NdisRssProcessor>? table)
+    {
+        if (table is null || table.Count == 0)
+        {
+            return "-";
+        }
+
+        return string.Join(' ', CountIndirection(table).Select(p => $"{p.Processor.Group}:{p.Processor.Number}x{p.Entries}"));
+    }
+
+    public static IReadOnlyList<(NdisRssProcessor Processor, int Entries)> CountIndirection(IReadOnlyList<NdisRssProcessor> table)
+    {
+        List<(NdisRssProcessor Processor, int Entries)> counts = [];
+        foreach (NdisRssProcessor processor in table)
+        {
+            int index = counts.FindIndex(c => c.Processor == processor);
+            if (index < 0)
+            {
+                counts.Add((processor, 1));
+            }
+            else
+            {
+                counts[index] = (processor, counts[index].Entries + 1);
+            }
+        }
+
+        return counts;
+    }
+
+    private static bool TryGetProcessor(IReadOnlyDictionary<string, object?> entry, out NdisRssProcessor processor)
+    {
+        int? group = GetInt(entry, "ProcessorGroup");
+        int? number = GetInt(entry, "ProcessorNumber");
+        processor = new NdisRssProcessor(group ?? 0, number ?? 0);
+        return number.HasValue;
+    }
+
+    private static string GetString(IReadOnlyDictionary<string, object?> bag, string name)
+    {
+        return bag.GetValueOrDefault(name)?.ToString()?.Trim() ?? string.Empty;
+    }
+
+    private static int? GetInt(IReadOnlyDictionary<string, object?> bag, string name)
+    {
+        return ToInt(bag.GetValueOrDefault(name));
+    }
+
+    private static bool? GetBool(IReadOnlyDictionary<string, object?> bag, string name)
+    {
+        return bag.GetValueOrDefault(name) switch
+        {
+            bool value => value,
+            string text when bool.TryParse(text.Trim(), out bool parsed) => parsed,
+            _ => null,
+        };
+    }
+
+    private static int? ToInt(object? value)
+    {
+        switch (value)
+        {
+            case int number:
+                return number;
+            case long or uint or ushort or short or byte or sbyte:
+                long wide = Convert.ToInt64(value, CultureInfo.InvariantCulture);
+                return wide is >= int.MinValue and <= int.MaxValue ? (int)wide : null;
+            case string text when int.TryParse(text.Trim(), NumberStyles.Integer, CultureInfo.InvariantCulture, out int parsed):
+                return parsed;
+            default:
+                return null;
+        }
+    }
+}
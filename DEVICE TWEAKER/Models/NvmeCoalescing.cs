@@ -0,0 +1,211 @@
+using System.Runtime.InteropServices;
+
+namespace DeviceTweakerCS;
+
+// Get/Set Features on one NVMe controller: Cdw10 (feature identifier in bits 7:0), Cdw11, and
+// dword 0 of the completion. Interop/NvmeInterop.cs backs it with the storage protocol
+// pass-through, which only reaches current values (no SEL, no SV).
+internal interface INvmeFeatureTransport
+{
+    bool TryGetFeature(uint cdw10, uint cdw11, out uint completion);
+
+    bool TrySetFeature(uint cdw10, uint cdw11, out uint completion);
+}
+
+// What the controller reports. Messages counts vector 0 plus the I/O vectors that answered
+// Interrupt Vector Configuration in a row from 1, i.e. the MSI-X messages it was granted.
+internal sealed record NvmeCoalescingState(
+    int SubmissionQueues,
+    int CompletionQueues,
+    int TimeUs,
+    int Threshold,
+    int Messages,
+    bool[] CoalescingDisable);
+
+internal sealed record NvmeCoalescingApplyResult(
+    bool Ok,
+    string? Error,
+    int Written,
+    int RolledBack,
+    int RollbackFailed);
+
+// Interrupt Coalescing (08h) and Interrupt Vector Configuration (09h). The encoding, the
+// StorNVMe queue layout, the read and the all-or-nothing apply are IMOD/Common/imod_nvme.c
+// through IMODCore.dll; this side only hands it the transport and words the result.
+internal static class NvmeCoalescing
+{
+    public const int MaxVectors = NativeImodCore.NvmeMaxVectors;
+    public const int TimeUnitUs = 100;
+    public const int MaxTimeUs = 255 * TimeUnitUs;
+    public const int MaxThreshold = 256;
+
+    public static bool TryEncodeCoalescing(int timeUs, int threshold, out uint cdw11)
+    {
+        cdw11 = 0;
+        return timeUs >= 0
+            && threshold >= 0
+            && NativeImodCore.ImodNvmeEncodeCoalescing((uint)timeUs, (uint)threshold, out cdw11) == NativeImodCore.ResultSuccess;
+    }
+
+    public static (int TimeUs, int Threshold) DecodeCoalescing(uint value)
+    {
+        NativeImodCore.ImodNvmeDecodeCoalescing(value, out uint timeUs, out uint threshold);
+        return ((int)timeUs, (int)threshold);
+    }
+
+    // StorNVMe gives I/O queue n message n, wrapping over messages 1 .. Messages - 1, and
+    // shares message 0 with the admin queue when it was granted only one.
+    public static int QueueVector(int queue, int messages)
+    {
+        return queue < 0 || messages < 0 ? 0 : (int)NativeImodCore.ImodNvmeQueueVector((uint)queue, (uint)messages);
+    }
+
+    public static bool TryRead(INvmeFeatureTransport transport, out NvmeCoalescingState? state, out string? error)
+    {
+        state = null;
+        error = null;
+        NativeImodCore.NvmeState native = default;
+        uint result = CallWithTransport(transport, (ref NativeImodCore.NvmeTransport t) =>
+            NativeImodCore.ImodNvmeRead(ref t, NativeImodCore.NvmeSelectCurrent, out native));
+        if (result != NativeImodCore.ResultSuccess)
+        {
+            error = "Get Features (Number of Queues / Interrupt Coalescing) failed";
+            return false;
+        }
+
+        int vectors = (int)native.Settings.Vectors;
+        int messages = 1;
+        while (messages < vectors && native.VectorRead[messages] != 0)
+        {
+            messages++;
+        }
+
+        state = new NvmeCoalescingState(
+            (int)native.SubmissionQueues,
+            (int)native.CompletionQueues,
+            (int)native.Settings.TimeUs,
+            (int)native.Settings.Threshold,
+            messages,
+            native.Settings.CoalescingDisable[..messages].Select(value => value != 0).ToArray());
+        return true;
+    }
+
+    // ImodNvmeApply with IMOD_BATCH_FLAG_DIFF | IMOD_BATCH_FLAG_VERIFY over vectors
+    // 1 .. previous.Messages - 1: vectors first, then the coalescing, every write read back,
+    // and what was written put back newest first on the first failure.
+    public static NvmeCoalescingApplyResult Apply(
+        INvmeFeatureTransport transport,
+        NvmeCoalescingState previous,
+        int timeUs,
+        int threshold,
+        IReadOnlyCollection<int> disabledVectors)
+    {
+        if (!TryEncodeCoalescing(timeUs, threshold, out _))
+        {
+            return new NvmeCoalescingApplyResult(false, "coalescing out of range", 0, 0, 0);
+        }
+
+        foreach (int vector in disabledVectors)
+        {
+            if (vector < 1 || vector >= previous.Messages)
+            {
+                return new NvmeCoalescingApplyResult(false, $"vector {vector} is not an I/O vector (1-{previous.Messages - 1})", 0, 0, 0);
+            }
+        }
+
+        NativeImodCore.NvmeApply apply = new()
+        {
+            Flags = NativeImodCore.NvmeApplyDiffVerify,
+            Target = new NativeImodCore.NvmeSettings
+            {
+                TimeUs = (uint)timeUs,
+                Threshold = (uint)threshold,
+                Vectors = (uint)previous.Messages,
+                CoalescingDisable = new byte[MaxVectors],
+            },
+            Previous = new NativeImodCore.NvmeSettings { CoalescingDisable = new byte[MaxVectors] },
+            CoalescingStatus = NativeImodCore.BatchStatusInactive,
+            VectorStatus = Enumerable.Repeat(NativeImodCore.BatchStatusInactive, MaxVectors).ToArray(),
+        };
+        foreach (int vector in disabledVectors)
+        {
+            apply.Target.CoalescingDisable[vector] = 1;
+        }
+
+        uint result = CallWithTransport(transport, (ref NativeImodCore.NvmeTransport t) =>
+            NativeImodCore.ImodNvmeApply(ref t, ref apply));
+        if (result == NativeImodCore.ResultSuccess)
+        {
+            return new NvmeCoalescingApplyResult(true, null, (int)apply.Applied, 0, 0);
+        }
+
+        string error = result == NativeImodCore.ResultInvalidParameter
+            ? "controller state changed since it was read"
+            : DescribeApplyFailure(apply);
+        return new NvmeCoalescingApplyResult(false, error, 0, (int)apply.RolledBack, (int)apply.RollbackFailed);
+    }
+
+    // "100 us x 8", or "off" when either field leaves completions uncoalesced.
+    public static string FormatCoalescing(int timeUs, int threshold)
+    {
+        return timeUs == 0 || threshold <= 1 ? "off" : $"{timeUs} us x {threshold}";
+    }
+
+    private delegate uint TransportCall(ref NativeImodCore.NvmeTransport transport);
+
+    // The transport is handed to imod_nvme.c as IMOD_NVME_TRANSPORT for the length of one call;
+    // an exception must not unwind through the native frames, so it reads as a failed command.
+    private static uint CallWithTransport(INvmeFeatureTransport transport, TransportCall call)
+    {
+        NativeImodCore.NvmeFeatureCallback getFeature = (IntPtr _, uint cdw10, uint cdw11, out uint completion) =>
+            Invoke(transport.TryGetFeature, cdw10, cdw11, out completion);
+        NativeImodCore.NvmeFeatureCallback setFeature = (IntPtr _, uint cdw10, uint cdw11, out uint completion) =>
+            Invoke(transport.TrySetFeature, cdw10, cdw11, out completion);
+        NativeImodCore.NvmeTransport native = new()
+        {
+            GetFeature = Marshal.GetFunctionPointerForDelegate(getFeature),
+            SetFeature = Marshal.GetFunctionPointerForDelegate(setFeature),
+        };
+
+        uint result = call(ref native);
+        GC.KeepAlive(getFeature);
+        GC.KeepAlive(setFeature);
+        return result;
+    }
+
+    private delegate bool FeatureCall(uint cdw10, uint cdw11, out uint completion);
+
+    private static byte Invoke(FeatureCall feature, uint cdw10, uint cdw11, out uint completion)
+    {
+        completion = 0;
+        try
+        {
+            return feature(cdw10, cdw11, out completion) ? (byte)1 : (byte)0;
+        }
+        catch (Exception)
+        {
+            return 0;
+        }
+    }
+
+    private static string DescribeApplyFailure(NativeImodCore.NvmeApply apply)
+    {
+        for (int vector = 1; vector < MaxVectors; vector++)
+        {
+            switch (apply.VectorStatus[vector])
+            {
+                case NativeImodCore.BatchStatusWriteFailed:
+                    return $"Set Features (vector {vector}) failed";
+                case NativeImodCore.BatchStatusVerifyFailed:
+                    return $"vector {vector} did not read back";
+            }
+        }
+
+        return apply.CoalescingStatus switch
+        {
+            NativeImodCore.BatchStatusWriteFailed => "Set Features (Interrupt Coalescing) failed",
+            NativeImodCore.BatchStatusVerifyFailed => "interrupt coalescing did not read back",
+            _ => "Get Features (Number of Queues / Interrupt Coalescing) failed",
+        };
+    }
+}
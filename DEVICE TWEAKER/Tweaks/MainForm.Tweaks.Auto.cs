@@ -512,7 +512,7 @@ public sealed partial class MainForm
                 extra = $" | IMOD={(string.IsNullOrWhiteSpace(imod) ? "n/a" : imod)}";
             }
 
-            WriteLog($"AUTO.RESULT.APPLIED: {role} | {kind} | \"{name}\" -> CPU=[{lps}] mask=0x{block.AffinityMask:X} MSI={msi} prio={prio} policy={policy}{extra} | reason={slot.Reason}");
+            WriteLog($"AUTO.RESULT.APPLIED: {role} | {kind} | \"{name}\" -> CPU=[{lps}] mask={block.AffinityMask} MSI={msi} prio={prio} policy={policy}{extra} | reason={slot.Reason}");
         }
 
         foreach (AutoAffinityPlanSlot slot in planSlots.Where(slot => slot.Lps.Count == 0))
@@ -803,9 +803,9 @@ public sealed partial class MainForm
             bool isSkipAuto = skipAutoIds.Contains(block.Device.InstanceId);
             bool isMsiOnlyGpu = msiOnlyGpuIds.Contains(block.Device.InstanceId);
             bool isWifi = wifiIds.Contains(block.Device.InstanceId);
-            ulong beforeMask = block.AffinityMask;
+            CpuSet beforeMask = block.AffinityMask;
             string beforePolicy = block.PolicyCombo.SelectedItem?.ToString() ?? "(none)";
-            WriteLog($"AUTO.RESET: {block.Device.InstanceId} Kind={block.Kind} maskBefore=0x{beforeMask:X} policyBefore={beforePolicy}");
+            WriteLog($"AUTO.RESET: {block.Device.InstanceId} Kind={block.Kind} maskBefore={beforeMask} policyBefore={beforePolicy}");
 
             if (isMsiOnlyGpu)
             {
@@ -833,7 +833,7 @@ public sealed partial class MainForm
                         block.SuppressCpuEvents--;
                     }
 
-                    block.AffinityMask = 0;
+                    block.AffinityMask = CpuSet.Empty;
                     block.RssBaseCore = null;
                 }
 
@@ -857,7 +857,7 @@ public sealed partial class MainForm
                 block.SuppressCpuEvents--;
             }
 
-            block.AffinityMask = 0;
+            block.AffinityMask = CpuSet.Empty;
 
             if (isSkipAuto)
             {
@@ -898,9 +898,9 @@ public sealed partial class MainForm
 
             RecalcAffinityMask(block);
 
-            ulong afterMask = block.AffinityMask;
+            CpuSet afterMask = block.AffinityMask;
             string afterPolicy = block.PolicyCombo.SelectedItem?.ToString() ?? "(none)";
-            WriteLog($"AUTO.RESET: {block.Device.InstanceId} Kind={block.Kind} maskAfter=0x{afterMask:X} policyAfter={afterPolicy} skipAuto={isSkipAuto}");
+            WriteLog($"AUTO.RESET: {block.Device.InstanceId} Kind={block.Kind} maskAfter={afterMask} policyAfter={afterPolicy} skipAuto={isSkipAuto}");
             if (isSkipAuto)
             {
                 string reason = IsSpdifAudioEndpointsText(block.Device.AudioEndpoints) ? "digital S/PDIF audio" : "display/HDMI audio";
@@ -1145,17 +1145,9 @@ public sealed partial class MainForm
 
             string FormatGpuPair((AutoCpuUnit First, AutoCpuUnit Second) pair)
             {
-                ulong mask = 0;
-                foreach (int lp in new[] { pair.First.PrimaryLp, pair.Second.PrimaryLp })
-                {
-                    if (lp >= 0 && lp < 64)
-                    {
-                        mask |= 1UL << lp;
-                    }
-                }
-
+                CpuSet mask = BuildCpuSet([pair.First.PrimaryLp, pair.Second.PrimaryLp]);
                 string ccx = HasVisibleCcxSplit() ? $"/ccx={pair.First.Ccx},{pair.Second.Ccx}" : string.Empty;
-                return $"[{pair.First.PrimaryLp},{pair.Second.PrimaryLp}]/mask=0x{mask:X}/ccd={pair.First.Ccd},{pair.Second.Ccd}{ccx}/rank={pair.First.Rank},{pair.Second.Rank}/rating={pair.First.Rating},{pair.Second.Rating}";
+                return $"[{pair.First.PrimaryLp},{pair.Second.PrimaryLp}]/mask={mask}/ccd={pair.First.Ccd},{pair.Second.Ccd}{ccx}/rank={pair.First.Rank},{pair.Second.Rank}/rating={pair.First.Rating},{pair.Second.Rating}";
             }
 
             WriteLog($"AUTO.PLAN.GPU.PAIRS: candidates={pairs.Count} [{string.Join("; ", pairs.Select(FormatGpuPair))}]");
@@ -1573,6 +1565,8 @@ public sealed partial class MainForm
         }
 
         WriteLog($"AUTO.PLAN.FINAL: consumed=[{string.Join(',', consumedCores.OrderBy(x => x))}] inputShare=[{string.Join(',', inputShareCores.Distinct().OrderBy(x => x))}] assigned={planSlots.Count(s => s.Lps.Count > 0)} skipped={planSlots.Count(s => s.Lps.Count == 0)}");
+        WriteAutoInterruptBudget();
+        WriteAutoAffinityPlanner(planSlots, targetCcdLps);
         WriteAutoOptimizationResultSummary(
             optimizeUsbImod,
             usingP,
@@ -1665,7 +1659,7 @@ public sealed partial class MainForm
                             b.SuppressCpuEvents--;
                         }
 
-                        b.AffinityMask = 0;
+                        b.AffinityMask = CpuSet.Empty;
                         b.AffinityLabel.Text = "Affinity Mask: 0x0";
                         b.PrioCombo.SelectedItem = "Undefined";
                         if (b.Kind == DeviceKind.NET_NDIS)
@@ -0,0 +1,270 @@
+namespace DeviceTweakerCS;
+
+// Interrupt load per logical processor for the settings currently in the blocks, so AUTO
+// can flag a core it is about to overload before anything is written. The model is
+// IMOD/Common/imod_budget.c through IMODCore.dll (see IMODBench budget_* for the benchmark
+// over snapshots): timer moderation spaces interrupts by at least its interval, vectors fold
+// onto the MSI messages the limit grants, and messages go round-robin to the processors of
+// the mask.
+public sealed partial class MainForm
+{
+    private const int InterruptBudgetMaxInterrupts = 20000;
+    private const int InterruptBudgetMaxLoadPermille = 150;
+    private const uint InterruptBudgetNicEventsPerSecond = 20000;
+    private const uint InterruptBudgetStorageEventsPerSecond = 4000;
+    private const uint InterruptBudgetUsbOtherEventsPerSecond = 1000;
+    private const int InterruptBudgetMaxVectors = 64;
+
+    // IMOD_BUDGET_MODERATION_*.
+    private enum InterruptBudgetModeration : uint
+    {
+        None,
+        XhciImodi,
+        IntelEitr,
+        IntelItr,
+        RealtekIntrMit,
+        RealtekIntrMitV2,
+    }
+
+    private sealed record InterruptBudgetVector(ulong Value, uint EventsPerSecond);
+
+    private sealed record InterruptBudgetSource(
+        DeviceBlock Block,
+        InterruptBudgetModeration Moderation,
+        int MessageLimit,
+        uint IsrNs,
+        uint DpcNs,
+        uint EventNs,
+        List<InterruptBudgetVector> Vectors);
+
+    private sealed record InterruptBudgetEstimate(NativeImodCore.BudgetProcessor[] Processors, HashSet<string>[] Sources, uint Over);
+
+    private static ulong GetInterruptBudgetIntervalNs(InterruptBudgetModeration moderation, ulong value)
+    {
+        return NativeImodCore.ImodBudgetIntervalNs((uint)moderation, (uint)value);
+    }
+
+    private static ulong GetInterruptBudgetRate(InterruptBudgetModeration moderation, ulong value, uint eventsPerSecond)
+    {
+        return NativeImodCore.ImodBudgetInterruptRate((uint)moderation, (uint)value, eventsPerSecond);
+    }
+
+    // An interrupt targets one group, so the device gets the first group of its mask.
+    private static NativeImodCore.BudgetDevice BuildInterruptBudgetDevice(InterruptBudgetSource source)
+    {
+        int group = Math.Max(0, source.Block.AffinityMask.FirstGroup);
+        NativeImodCore.BudgetDevice device = new()
+        {
+            Kind = source.Block.Kind switch
+            {
+                DeviceKind.USB => NativeImodCore.BudgetKindUsb,
+                DeviceKind.STOR => NativeImodCore.BudgetKindStorage,
+                _ => NativeImodCore.BudgetKindNic,
+            },
+            Moderation = (uint)source.Moderation,
+            VectorCount = (uint)source.Vectors.Count,
+            MessageLimit = (uint)Math.Max(0, source.MessageLimit),
+            IsrNs = source.IsrNs,
+            DpcNs = source.DpcNs,
+            EventNs = source.EventNs,
+            Group = (ushort)group,
+            Affinity = source.Block.AffinityMask.GetGroupMask(group),
+            Values = new uint[NativeImodCore.BudgetMaxVectors],
+            EventsPerSecond = new uint[NativeImodCore.BudgetMaxVectors],
+        };
+
+        for (int vector = 0; vector < source.Vectors.Count; vector++)
+        {
+            device.Values[vector] = (uint)source.Vectors[vector].Value;
+            device.EventsPerSecond[vector] = source.Vectors[vector].EventsPerSecond;
+        }
+
+        return device;
+    }
+
+    // Null when the estimator rejects the input, e.g. more than 256 processors. Sources lists the
+    // devices whose messages land on each processor, from the same model run per device.
+    private static InterruptBudgetEstimate? EstimateInterruptBudget(IReadOnlyList<InterruptBudgetSource> sources, int processorCount)
+    {
+        NativeImodCore.BudgetConfig config = new()
+        {
+            MaxInterruptsPerSecond = InterruptBudgetMaxInterrupts,
+            MaxLoadPermille = InterruptBudgetMaxLoadPermille,
+        };
+        List<InterruptBudgetSource> active = sources.Where(source => source.Vectors.Count > 0).ToList();
+        NativeImodCore.BudgetDevice[] devices = active.Select(BuildInterruptBudgetDevice).ToArray();
+        NativeImodCore.BudgetProcessor[] processors = new NativeImodCore.BudgetProcessor[processorCount];
+        if (NativeImodCore.ImodBudgetEstimate(ref config, devices, (uint)devices.Length, (uint)processorCount, processors, out uint over) != NativeImodCore.ResultSuccess)
+        {
+            return null;
+        }
+
+        HashSet<string>[] names = Enumerable.Range(0, processorCount)
+            .Select(_ => new HashSet<string>(StringComparer.OrdinalIgnoreCase))
+            .ToArray();
+        NativeImodCore.BudgetProcessor[] single = new NativeImodCore.BudgetProcessor[processorCount];
+        for (int index = 0; index < devices.Length; index++)
+        {
+            NativeImodCore.ImodBudgetEstimate(ref config, [devices[index]], 1, (uint)processorCount, single, out _);
+            for (int processor = 0; processor < processorCount; processor++)
+            {
+                if (single[processor].Messages != 0)
+                {
+                    names[processor].Add(active[index].Block.Device.InstanceId);
+                }
+            }
+        }
+
+        return new InterruptBudgetEstimate(processors, names, over);
+    }
+
+    // USB: one vector per role when the IMOD text binds roles, otherwise every role shares
+    // interrupter 0. Mice report on every poll, keyboards about one poll in ten.
+    private static InterruptBudgetSource BuildUsbInterruptBudgetSource(DeviceBlock block, int messageLimit)
+    {
+        if (!TryParseImodInput(block.ImodBox.Text ?? string.Empty, ImodDefaultInterval, out ImodInput input))
+        {
+            input = new ImodInput(ImodDefaultInterval, null, null, true);
+        }
+
+        uint fallback = input.Interval ?? input.Intervals?.FirstOrDefault() ?? ImodDefaultInterval;
+        List<InterruptBudgetVector> vectors = [];
+        uint shared = 0;
+        foreach (string roleText in (block.Device.UsbRoles ?? string.Empty).Split(',', StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries))
+        {
+            uint events = InterruptBudgetUsbOtherEventsPerSecond;
+            string role = roleText.Split(' ', 2)[0];
+            if (TryExtractPollingRateFromRole(roleText, out string pollingRole, out double hertz))
+            {
+                role = pollingRole;
+                events = (uint)Math.Round(pollingRole.Equals("Keyboard", StringComparison.OrdinalIgnoreCase) ? hertz / 10 : hertz);
+            }
+
+            if (role.Equals("Microphone", StringComparison.OrdinalIgnoreCase) || role.Equals("Speaker", StringComparison.OrdinalIgnoreCase))
+            {
+                role = "Audio";
+            }
+
+            if (input.RoleIntervals is { } roleIntervals && vectors.Count < InterruptBudgetMaxVectors)
+            {
+                vectors.Add(new InterruptBudgetVector(roleIntervals.TryGetValue(role, out uint interval) ? interval : fallback, events));
+            }
+            else
+            {
+                shared += events;
+            }
+        }
+
+        if (shared > 0 || vectors.Count == 0)
+        {
+            vectors.Insert(0, new InterruptBudgetVector(fallback, shared));
+        }
+
+        return new InterruptBudgetSource(block, InterruptBudgetModeration.XhciImodi, messageLimit, 1500, 3000, 200, vectors);
+    }
+
+    // NIC: the expected packet rate is split over the RSS queues in use; the rest of the
+    // queues and a separate "Other" vector carry next to nothing. A SAMPLE run replaces the
+    // guess with the measured rate of each vector.
+    private static InterruptBudgetSource BuildNicInterruptBudgetSource(DeviceBlock block, int messageLimit)
+    {
+        NicItrProfile? profile = TryGetNicItrProfile(block.Device.InstanceId);
+        int activeQueues = Math.Max(1, (int)(block.RssQueueBox?.Value ?? 1));
+        List<ulong> values = [];
+        if (profile is not null && TryParseNicItrInput(block.NicItrBox?.Text ?? string.Empty, profile, out List<ulong> parsed))
+        {
+            values = parsed.Count == 1 ? Enumerable.Repeat(parsed[0], Math.Max(1, profile.MaxQueues)).ToList() : parsed;
+        }
+
+        if (values.Count == 0)
+        {
+            values = Enumerable.Repeat(0UL, profile?.MaxQueues ?? activeQueues).ToList();
+        }
+
+        int firstQueue = profile?.FirstQueueVector ?? 0;
+        activeQueues = Math.Min(activeQueues, Math.Max(1, values.Count - firstQueue));
+        uint perQueue = InterruptBudgetNicEventsPerSecond / (uint)activeQueues;
+        IReadOnlyList<uint>? sampled = block.NicItrSampledRates;
+        List<InterruptBudgetVector> vectors = values
+            .Take(InterruptBudgetMaxVectors)
+            .Select((value, index) => new InterruptBudgetVector(
+                value,
+                sampled is not null
+                    ? (index < sampled.Count ? sampled[index] : 0)
+                    : (index >= firstQueue && index < firstQueue + activeQueues ? perQueue : 0)))
+            .ToList();
+
+        InterruptBudgetModeration moderation = profile?.Moderation ?? InterruptBudgetModeration.None;
+        return new InterruptBudgetSource(block, moderation, messageLimit, 1000, 2000, 300, vectors);
+    }
+
+    // Storage: an NVMe-style completion queue per processor, no moderation.
+    private static InterruptBudgetSource BuildStorageInterruptBudgetSource(DeviceBlock block, int messageLimit, int processorCount)
+    {
+        int queues = Math.Clamp(processorCount, 1, InterruptBudgetMaxVectors);
+        uint perQueue = InterruptBudgetStorageEventsPerSecond / (uint)queues;
+        List<InterruptBudgetVector> vectors = Enumerable.Range(0, queues)
+            .Select(_ => new InterruptBudgetVector(0, perQueue))
+            .ToList();
+        return new InterruptBudgetSource(block, InterruptBudgetModeration.None, messageLimit, 1000, 2000, 200, vectors);
+    }
+
+    private List<InterruptBudgetSource> BuildInterruptBudgetSources(int processorCount)
+    {
+        List<InterruptBudgetSource> sources = [];
+        foreach (DeviceBlock block in _blocks)
+        {
+            int messageLimit = int.TryParse(block.LimitBox.Text?.Trim(), out int limit) && limit > 0 ? limit : 0;
+            InterruptBudgetSource? source = block.Kind switch
+            {
+                DeviceKind.USB when IsUsbImodTarget(block.Device) => BuildUsbInterruptBudgetSource(block, messageLimit),
+                DeviceKind.NET_NDIS or DeviceKind.NET_CX when !block.Device.Wifi => BuildNicInterruptBudgetSource(block, messageLimit),
+                DeviceKind.STOR => BuildStorageInterruptBudgetSource(block, messageLimit, processorCount),
+                _ => null,
+            };
+
+            if (source is not null)
+            {
+                sources.Add(source);
+            }
+        }
+
+        return sources;
+    }
+
+    private void WriteAutoInterruptBudget()
+    {
+        // imod_budget.c numbers processor n as bit n % 64 of group n / 64; on one group that is the LP.
+        int logicalCount = Math.Max(_maxLogical, 1);
+        int processorCount = _cpuGroupCount > 1 ? _cpuGroupCount * CpuSet.GroupSize : logicalCount;
+        List<InterruptBudgetSource> sources = BuildInterruptBudgetSources(logicalCount);
+        InterruptBudgetEstimate? estimate = EstimateInterruptBudget(sources, processorCount);
+        if (estimate is null)
+        {
+            WriteLog($"AUTO.BUDGET: skipped (estimator rejected sources={sources.Count} processors={processorCount})");
+            return;
+        }
+
+        for (int index = 0; index < estimate.Processors.Length; index++)
+        {
+            NativeImodCore.BudgetProcessor processor = estimate.Processors[index];
+            if (processor.Messages == 0)
+            {
+                continue;
+            }
+
+            TryGetCpuIndex(index / CpuSet.GroupSize, index % CpuSet.GroupSize, out int lp);
+            string line = $"LP{lp} messages={processor.Messages} irq/s={processor.InterruptsPerSecond} events/s={processor.EventsPerSecond} isr={processor.IsrNsPerSecond / 1000}us/s dpc={processor.DpcNsPerSecond / 1000}us/s load={processor.LoadPermille / 10.0:0.0}% sources=[{string.Join(',', estimate.Sources[index])}]";
+            if (processor.Flags != 0)
+            {
+                WriteLog($"AUTO.BUDGET.OVER: {line} limits=irq/s<={InterruptBudgetMaxInterrupts},load<={InterruptBudgetMaxLoadPermille / 10.0:0.0}%");
+            }
+            else
+            {
+                WriteLog($"AUTO.BUDGET: {line}");
+            }
+        }
+
+        WriteLog($"AUTO.BUDGET.SUMMARY: sources={sources.Count} processors={logicalCount} over={estimate.Over} (USB from roles/polling, NIC {InterruptBudgetNicEventsPerSecond} pkt/s, storage {InterruptBudgetStorageEventsPerSecond} IO/s)");
+    }
+}
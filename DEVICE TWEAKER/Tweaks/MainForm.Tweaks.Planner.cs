@@ -0,0 +1,227 @@
+using System.Diagnostics;
+
+namespace DeviceTweakerCS;
+
+// Cost-model check of the AUTO affinity plan, run by IMOD/Common/imod_affinity.c through
+// IMODCore.dll (see IMODBench affinity_* for the benchmark over 16-256 processor snapshots):
+// a greedy seed in role order, then relocations and pairwise swaps while any strictly lowers
+// the cost. The cost counts E-cores, weak CPPC ranks and the wrong CCD for latency-critical
+// devices, core 0, devices sharing a physical core (worse next to input), the mouse/GPU pair
+// split across last-level caches, and quadratic per-processor load. Results are logged, not
+// applied.
+public sealed partial class MainForm
+{
+    private const int AffinityPlannerGpuLoadPermille = 100;
+    private const int AffinityPlannerAudioLoadPermille = 30;
+    private const int AffinityPlannerOtherLoadPermille = 10;
+
+    // IMOD_AFFINITY_ROLE_*.
+    private enum AffinityPlannerRole : uint
+    {
+        Input,
+        Audio,
+        Gpu,
+        Nic,
+        Storage,
+        Other,
+    }
+
+    // IMOD_AFFINITY_REASON_*.
+    [Flags]
+    private enum AffinityPlannerReason : uint
+    {
+        None = 0,
+        ECore = 0x1,
+        OffTarget = 0x2,
+        Core0 = 0x4,
+        SmtShared = 0x8,
+        SplitCluster = 0x10,
+        Overloaded = 0x20,
+    }
+
+    private sealed record AffinityPlannerProcessor(int Lp, int Core, int Llc, int Ccd, int Rank, bool Efficiency, bool Reserved, bool Core0);
+
+    private sealed record AffinityPlannerDevice(AutoAffinityPlanSlot Slot, AffinityPlannerRole Role, int LoadPermille, int Cluster);
+
+    private List<AffinityPlannerProcessor> BuildAffinityPlannerProcessors()
+    {
+        if (_cpuInfo is null)
+        {
+            return [];
+        }
+
+        List<CpuLpInfo> lps = _cpuInfo.Topology.LPs
+            .Where(lp => lp.LP >= 0 && lp.LP < _maxLogical)
+            .OrderBy(lp => lp.LP)
+            .ToList();
+        List<int> byStrength = SortAutoCpuCandidates(lps.Select(lp => lp.LP), preferStrongest: true);
+        Dictionary<int, int> rank = byStrength.Select((lp, index) => (lp, index)).ToDictionary(x => x.lp, x => x.index);
+        bool[]? reserved = GetReservedCpuSets(_maxLogical);
+        if (reserved is null)
+        {
+            WriteLog("AUTO.PLANNER: ReservedCpuSets unreadable, planning as if nothing were reserved");
+            reserved = [];
+        }
+
+        Dictionary<int, int> coreIndex = [];
+        Dictionary<int, int> llcIndex = [];
+        int core0 = lps.Where(lp => lp.LP == 0).Select(lp => CpuTopology.MakeCoreKey(lp.Group, lp.Core)).DefaultIfEmpty(-1).First();
+
+        List<AffinityPlannerProcessor> processors = [];
+        foreach (CpuLpInfo lp in lps)
+        {
+            int coreKey = CpuTopology.MakeCoreKey(lp.Group, lp.Core);
+            int llcKey = CpuTopology.MakeLlcKey(lp.Group, lp.LLC);
+            int core = coreIndex.TryAdd(coreKey, processors.Count) ? processors.Count : coreIndex[coreKey];
+            int llc = llcIndex.TryAdd(llcKey, processors.Count) ? processors.Count : llcIndex[llcKey];
+            processors.Add(new AffinityPlannerProcessor(
+                lp.LP,
+                core,
+                llc,
+                _cpuInfo.CcdMap.TryGetValue(lp.LP, out int ccd) ? ccd : 0,
+                rank.GetValueOrDefault(lp.LP, lps.Count),
+                IsEfficiencyCore(lp),
+                lp.LP < reserved.Length && reserved[lp.LP],
+                coreKey == core0));
+        }
+
+        return processors;
+    }
+
+    // Load per device: USB and NICs from the interrupt budget model, the rest a fixed guess.
+    private static int EstimateAffinityPlannerLoad(AutoAffinityPlanSlot slot)
+    {
+        InterruptBudgetSource? source = slot.Block.Kind switch
+        {
+            DeviceKind.USB when IsUsbImodTarget(slot.Block.Device) => BuildUsbInterruptBudgetSource(slot.Block, 0),
+            DeviceKind.NET_NDIS or DeviceKind.NET_CX => BuildNicInterruptBudgetSource(slot.Block, 0),
+            _ => null,
+        };
+
+        if (source is null)
+        {
+            return slot.Role switch
+            {
+                AutoAffinityRole.Gpu => AffinityPlannerGpuLoadPermille,
+                AutoAffinityRole.Audio => AffinityPlannerAudioLoadPermille,
+                _ => AffinityPlannerOtherLoadPermille,
+            };
+        }
+
+        ulong loadNs = 0;
+        foreach (InterruptBudgetVector vector in source.Vectors)
+        {
+            ulong rate = GetInterruptBudgetRate(source.Moderation, vector.Value, vector.EventsPerSecond);
+            loadNs += (rate * (source.IsrNs + source.DpcNs)) + ((ulong)vector.EventsPerSecond * source.EventNs);
+        }
+
+        return (int)Math.Min(1000UL, (loadNs + 500_000UL) / 1_000_000UL);
+    }
+
+    private static AffinityPlannerRole GetAffinityPlannerRole(AutoAffinityRole role)
+    {
+        return role switch
+        {
+            AutoAffinityRole.InputMouse or AutoAffinityRole.InputController or AutoAffinityRole.Keyboard => AffinityPlannerRole.Input,
+            AutoAffinityRole.Audio => AffinityPlannerRole.Audio,
+            AutoAffinityRole.Gpu => AffinityPlannerRole.Gpu,
+            AutoAffinityRole.Nic => AffinityPlannerRole.Nic,
+            _ => AffinityPlannerRole.Other,
+        };
+    }
+
+    private static string FormatAffinityPlannerCost(NativeImodCore.AffinityCost cost)
+    {
+        return $"{cost.Total} (placement={cost.Placement} smt={cost.Smt} split={cost.SplitCluster} load={cost.Load})";
+    }
+
+    private void WriteAutoAffinityPlanner(IReadOnlyList<AutoAffinityPlanSlot> planSlots, IReadOnlyList<int> targetCcdLps)
+    {
+        List<AffinityPlannerProcessor> processors = BuildAffinityPlannerProcessors();
+        if (processors.Count == 0 || processors.All(processor => processor.Reserved))
+        {
+            WriteLog("AUTO.PLANNER: skipped (CPU map unavailable)");
+            return;
+        }
+
+        Dictionary<int, int> processorByLp = processors.Select((processor, index) => (processor.Lp, index)).ToDictionary(x => x.Lp, x => x.index);
+        List<AffinityPlannerDevice> devices = planSlots
+            .Where(slot => slot.Lps.Count > 0 && processorByLp.ContainsKey(slot.Lps[0]))
+            .Select(slot => new AffinityPlannerDevice(
+                slot,
+                GetAffinityPlannerRole(slot.Role),
+                EstimateAffinityPlannerLoad(slot),
+                slot.Role is AutoAffinityRole.InputMouse or AutoAffinityRole.Gpu ? 0 : -1))
+            .ToList();
+        int targetCcd = targetCcdLps.Count > 0 && _cpuInfo is not null && _cpuInfo.CcdMap.TryGetValue(targetCcdLps[0], out int ccd) ? ccd : -1;
+
+        // The planner takes dense CCD indices below the processor count.
+        List<int> ccds = processors.Select(processor => processor.Ccd).Distinct().Order().ToList();
+        NativeImodCore.AffinityProcessor[] nativeProcessors = processors
+            .Select(processor => new NativeImodCore.AffinityProcessor
+            {
+                Core = (uint)processor.Core,
+                Llc = (uint)processor.Llc,
+                Ccd = (uint)ccds.IndexOf(processor.Ccd),
+                Rank = (uint)processor.Rank,
+                Efficiency = processor.Efficiency ? (byte)1 : (byte)0,
+                Flags = (byte)((processor.Reserved ? NativeImodCore.AffinityProcessorReserved : 0)
+                    | (processor.Core0 ? NativeImodCore.AffinityProcessorCore0 : 0)),
+            })
+            .ToArray();
+        NativeImodCore.AffinityDevice[] nativeDevices = devices
+            .Select(device => new NativeImodCore.AffinityDevice
+            {
+                Role = (uint)device.Role,
+                LoadPermille = (uint)device.LoadPermille,
+                Cluster = device.Cluster >= 0 ? (uint)device.Cluster : NativeImodCore.AffinityAny,
+            })
+            .ToArray();
+        NativeImodCore.ImodAffinityDefaultConfig(out NativeImodCore.AffinityConfig config);
+        config.TargetCcd = targetCcd >= 0 && ccds.Contains(targetCcd) ? (uint)ccds.IndexOf(targetCcd) : NativeImodCore.AffinityAny;
+        uint[] workspace = new uint[NativeImodCore.AffinityWorkspaceSize];
+        NativeImodCore.AffinityAssignment[] assignments = new NativeImodCore.AffinityAssignment[devices.Count];
+        uint[] placement = devices.Select(device => (uint)processorByLp[device.Slot.Lps[0]]).ToArray();
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        uint result = NativeImodCore.ImodAffinityPlan(
+            ref config,
+            nativeProcessors,
+            (uint)nativeProcessors.Length,
+            nativeDevices,
+            (uint)nativeDevices.Length,
+            workspace,
+            assignments,
+            out NativeImodCore.AffinitySummary summary);
+        stopwatch.Stop();
+
+        NativeImodCore.AffinityCost current = default;
+        if (result == NativeImodCore.ResultSuccess)
+        {
+            result = NativeImodCore.ImodAffinityCost(
+                ref config,
+                nativeProcessors,
+                (uint)nativeProcessors.Length,
+                nativeDevices,
+                (uint)nativeDevices.Length,
+                placement,
+                workspace,
+                out current);
+        }
+
+        if (result != NativeImodCore.ResultSuccess)
+        {
+            WriteLog($"AUTO.PLANNER: skipped (planner rejected processors={processors.Count} devices={devices.Count} result={result})");
+            return;
+        }
+
+        for (int index = 0; index < devices.Count; index++)
+        {
+            AutoAffinityPlanSlot slot = devices[index].Slot;
+            NativeImodCore.AffinityAssignment assignment = assignments[index];
+            WriteLog($"AUTO.PLANNER: role={slot.Role} {slot.Block.Device.InstanceId} load={devices[index].LoadPermille / 10.0:0.0}% plan=LP{slot.Lps[0]} planner=LP{processors[(int)assignment.Processor].Lp} cost={assignment.Cost} reasons={(AffinityPlannerReason)assignment.Reasons}");
+        }
+
+        WriteLog($"AUTO.PLANNER.SUMMARY: devices={devices.Count} processors={processors.Count} targetCCD={(targetCcd >= 0 ? targetCcd.ToString() : "any")} plan={FormatAffinityPlannerCost(current)} greedy={FormatAffinityPlannerCost(summary.Initial)} planner={FormatAffinityPlannerCost(summary.Final)} passes={summary.Passes} relocations={summary.Relocations} swaps={summary.Swaps} elapsed={stopwatch.Elapsed.TotalMilliseconds:0.00}ms");
+    }
+}
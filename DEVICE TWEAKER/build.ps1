@@ -5,6 +5,7 @@ param(
     [string]$Configuration = "Release",
     [switch]$NoClean,
     [switch]$SkipImodDriverBuild,
+    [switch]$SkipImodExeBuild,
     [switch]$TrustImodDriverCert,
     [string]$MsBuildPath,
     [string]$ImodDriverCertThumbprint = "9CE4C30CD75905786774B1DDFAC126329ACAEA8D",
@@ -43,6 +44,10 @@ if ($SkipImodDriverBuild) {
     $argsList += "-SkipImodDriverBuild"
 }
 
+if ($SkipImodExeBuild) {
+    $argsList += "-SkipImodExeBuild"
+}
+
 if ($TrustImodDriverCert) {
     $argsList += "-TrustImodDriverCert"
 }
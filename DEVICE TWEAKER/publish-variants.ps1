@@ -6,6 +6,7 @@ param(
     [string]$Runtime = "win-x64",
     [switch]$Clean,
     [switch]$SkipImodDriverBuild,
+    [switch]$SkipImodExeBuild,
     [switch]$BuildDriverOnly,
     [switch]$TrustImodDriverCert,
     [switch]$SkipReleasePackage,
@@ -23,6 +24,10 @@ $driverOutDir = Join-Path $PSScriptRoot "IMOD"
 $driverOutPath = Join-Path $driverOutDir "DTIMOD.sys"
 $driverHashPath = "$driverOutPath.sha256"
 $driverCertPath = Join-Path $driverOutDir "DTIMOD.cer"
+$imodProject = Join-Path $PSScriptRoot "IMOD\IMOD.vcxproj"
+$imodExePath = Join-Path $PSScriptRoot "IMOD\build\Release\IMOD.exe"
+$imodCoreProject = Join-Path $PSScriptRoot "IMOD\IMODCore.vcxproj"
+$imodCorePath = Join-Path $PSScriptRoot "IMOD\build\Release\IMODCore.dll"
 $publishRoot = Join-Path $PSScriptRoot "bin\Publish"
 $selfContainedDisplayName = "DEVICE TWEAKER (NET FRAMEWORK)"
 $frameworkDependentDisplayName = "DEVICE TWEAKER"
@@ -147,8 +152,16 @@ function Invoke-ImodDriverManualBuild {
 
     $driverBuildDir = Join-Path $PSScriptRoot "IMOD\Driver\build\x64\$Configuration"
     $driverObjDir = Join-Path $PSScriptRoot "IMOD\Driver\obj\x64\$Configuration\manual"
-    $driverSource = Join-Path $PSScriptRoot "IMOD\Driver\imod_driver.c"
-    $driverObj = Join-Path $driverObjDir "imod_driver.obj"
+    $driverCommonDir = Join-Path $PSScriptRoot "IMOD\Common"
+    $driverSources = @(
+        (Join-Path $PSScriptRoot "IMOD\Driver\imod_driver.c"),
+        (Join-Path $driverCommonDir "imod_batch.c"),
+        (Join-Path $driverCommonDir "imod_boot.c"),
+        (Join-Path $driverCommonDir "imod_session.c"),
+        (Join-Path $driverCommonDir "imod_topology.c"),
+        (Join-Path $driverCommonDir "imod_watchdog.c")
+    )
+    $driverObjs = @($driverSources | ForEach-Object { Join-Path $driverObjDir ([System.IO.Path]::GetFileNameWithoutExtension($_) + ".obj") })
     $driverOut = Join-Path $driverBuildDir "DTIMOD.sys"
 
     New-Item -ItemType Directory -Force -Path $driverBuildDir | Out-Null
@@ -158,12 +171,12 @@ function Invoke-ImodDriverManualBuild {
     Write-Host "CL:    $($vs.Cl)"
     Write-Host "Link:  $($vs.Link)"
 
-    & $vs.Cl /nologo /c /TC /GS- /Zl /W3 /D_AMD64_ /DAMD64 /DWIN64 /D_KERNEL_MODE /DNTDDI_VERSION=0x0A00000A /D_WIN32_WINNT=0x0A00 /Fo"$driverObj" /I"$($vs.Include)" /I"$($wdk.Include)\km" /I"$($wdk.Include)\shared" /I"$($wdk.Include)\ucrt" /I"$($wdk.Include)\um" $driverSource
+    & $vs.Cl /nologo /c /TC /GS- /Zl /W3 /D_AMD64_ /DAMD64 /DWIN64 /D_KERNEL_MODE /DNTDDI_VERSION=0x0A00000A /D_WIN32_WINNT=0x0A00 /Fo"$driverObjDir\\" /I"$driverCommonDir" /I"$($vs.Include)" /I"$($wdk.Include)\km" /I"$($wdk.Include)\shared" /I"$($wdk.Include)\ucrt" /I"$($wdk.Include)\um" $driverSources
     if ($LASTEXITCODE -ne 0) {
         throw "IMOD driver manual compile failed with exit code $LASTEXITCODE"
     }
 
-    & $vs.Link /nologo /driver /subsystem:native /entry:DriverEntry /out:"$driverOut" /nodefaultlib /machine:x64 /libpath:"$($wdk.Lib)" /libpath:"$($vs.Lib)" "$driverObj" ntoskrnl.lib hal.lib wdm.lib wdmsec.lib libcntpr.lib BufferOverflowK.lib
+    & $vs.Link /nologo /driver /subsystem:native /entry:DriverEntry /out:"$driverOut" /nodefaultlib /machine:x64 /libpath:"$($wdk.Lib)" /libpath:"$($vs.Lib)" $driverObjs ntoskrnl.lib hal.lib wdm.lib wdmsec.lib libcntpr.lib BufferOverflowK.lib
     if ($LASTEXITCODE -ne 0) {
         throw "IMOD driver manual link failed with exit code $LASTEXITCODE"
     }
@@ -458,6 +471,46 @@ function Invoke-ImodDriverBuild {
     }
 }
 
+# IMOD.exe is what the logon launcher runs and IMODCore.dll holds the engines the GUI calls
+# through P/Invoke. Only Release|x64 carries IMOD.exe's administrator manifest, so both are
+# built that way whatever -Configuration says.
+function Invoke-ImodExeBuild {
+    $msbuild = Resolve-MsBuild -RequestedPath $MsBuildPath
+    $builds = @(
+        @{ Project = $imodProject; Output = $imodExePath },
+        @{ Project = $imodCoreProject; Output = $imodCorePath }
+    )
+
+    foreach ($build in $builds) {
+        $name = Split-Path -Leaf $build.Output
+        if (-not (Test-Path -LiteralPath $build.Project)) {
+            throw "IMOD project not found: $($build.Project)"
+        }
+
+        Write-Host "Building $name..."
+        Write-Host "Project: $($build.Project)"
+        Write-Host "MSBuild: $msbuild"
+
+        & $msbuild $build.Project `
+            /p:Configuration=Release `
+            /p:Platform=x64 `
+            "/p:SolutionDir=$driverOutDir\\" `
+            /m `
+            /nologo `
+            /v:m
+
+        if ($LASTEXITCODE -ne 0) {
+            throw "$name build failed (exit code $LASTEXITCODE)"
+        }
+
+        if (-not (Test-Path -LiteralPath $build.Output)) {
+            throw "Built $name was not found at $($build.Output)"
+        }
+
+        Write-Host "Generated: $($build.Output)"
+    }
+}
+
 function Rename-PublishedExe {
     param(
         [string]$OutputDir,
@@ -625,6 +678,9 @@ function New-ReleasePackage {
 
 if ($BuildDriverOnly) {
     Invoke-ImodDriverBuild
+    if (-not $SkipImodExeBuild) {
+        Invoke-ImodExeBuild
+    }
     return
 }
 
@@ -640,6 +696,10 @@ if (-not $SkipImodDriverBuild) {
     Invoke-ImodDriverBuild
 }
 
+if (-not $SkipImodExeBuild) {
+    Invoke-ImodExeBuild
+}
+
 Write-Host "Restoring project..."
 dotnet restore $projectPath -p:BuildImodDriver=false
 if ($LASTEXITCODE -ne 0) {